@@ -0,0 +1,382 @@
+/*
+ * Microbenchmarks of the packet path: header parsing, address matching, formatting and the capture time on synthetic
+ * IPv4 TCP, UDP and ICMP packets of several sizes. Each case is warmed up, then measured by repetitions of the same
+ * packets count, the median time of repetitions is reported. Results are written as JSON Lines and compared with the
+ * results of another commit by -baseline.
+ * Usage: netsniffer-bench [-case SUBSTRING] [-repetitions N] [-time MS] [-results FILE] [-baseline FILE]
+ *                         [-threshold PERCENT]
+ */
+#include "netsniffer.h"
+#include "printing.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_REPETITIONS_DEFAULT 5
+#define BENCH_REPETITIONS_MAX 100
+#define BENCH_TIME_DEFAULT_MS 50
+#define BENCH_THRESHOLD_DEFAULT_PERCENT 10
+#define BENCH_FRAME_MAX_SIZE 1500
+#define BENCH_CASE_NAME_MAX_SIZE 64
+#define BENCH_BASELINE_MAX_COUNT 256
+
+typedef struct
+{
+  const char* Name;
+  uint8_t Data[BENCH_FRAME_MAX_SIZE];
+  size_t Size;
+  char SourceIP[IP_MAX_SIZE];
+  char DestIP[IP_MAX_SIZE];
+  int SourcePort;
+  int DestPort;
+} BenchFrame_t;
+
+typedef struct
+{
+  const BenchFrame_t* Frame;
+  Sniffer_t* Sniffer;
+  PacketBuffers_t* Buffers;
+  char* HexBuffer;
+  TimeInfo_t Time;
+} BenchContext_t;
+
+typedef size_t (*BenchFunc_t)(BenchContext_t* c);
+
+typedef struct
+{
+  const char* Name;
+  BenchFunc_t Func;
+  bool PerFrame; // the case is measured for each frame
+} BenchCase_t;
+
+typedef struct
+{
+  char Name[BENCH_CASE_NAME_MAX_SIZE];
+  double NsPerPacket;
+} BenchResult_t;
+
+static size_t BuildFrame(BenchFrame_t* f, const char* name, uint8_t protocol, size_t size, uint16_t dport);
+static int AddAddress(Sniffer_t* s, const char* address, Protocol_t protocol, Direction_t direction);
+static size_t ParseHeaders(BenchContext_t* c);
+static size_t DecodeView(BenchContext_t* c);
+static size_t MatchAddress(BenchContext_t* c);
+static size_t FormatPacket(BenchContext_t* c);
+static size_t HexDumpTable(BenchContext_t* c);
+static size_t HexDumpSnprintf(BenchContext_t* c);
+static size_t CaptureTime(BenchContext_t* c);
+static double Measure(BenchFunc_t func, BenchContext_t* c, uint64_t packets);
+static int CompareDoubles(const void* a, const void* b);
+static size_t ReadBaseline(const char* path, BenchResult_t* results, size_t maxCount);
+
+int main(int argc, char** argv)
+{
+  const char* filter = NULL;
+  const char* resultsPath = NULL;
+  const char* baselinePath = NULL;
+  unsigned long repetitions = BENCH_REPETITIONS_DEFAULT;
+  unsigned long timeMs = BENCH_TIME_DEFAULT_MS;
+  double threshold = BENCH_THRESHOLD_DEFAULT_PERCENT;
+  for (int i = 1; i < argc; ++i) {
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (value != NULL && strcmp(argv[i], "-case") == 0)
+      filter = value;
+    else if (value != NULL && strcmp(argv[i], "-repetitions") == 0)
+      repetitions = strtoul(value, NULL, 10);
+    else if (value != NULL && strcmp(argv[i], "-time") == 0)
+      timeMs = strtoul(value, NULL, 10);
+    else if (value != NULL && strcmp(argv[i], "-results") == 0)
+      resultsPath = value;
+    else if (value != NULL && strcmp(argv[i], "-baseline") == 0)
+      baselinePath = value;
+    else if (value != NULL && strcmp(argv[i], "-threshold") == 0)
+      threshold = strtod(value, NULL);
+    else {
+      fprintf(stderr,
+              "Usage: %s [-case SUBSTRING] [-repetitions N (1-%d)] [-time MS] [-results FILE] [-baseline FILE] "
+              "[-threshold PERCENT]\n",
+              argv[0],
+              BENCH_REPETITIONS_MAX);
+      return 1;
+    }
+    ++i;
+  }
+  if (repetitions == 0 || repetitions > BENCH_REPETITIONS_MAX || timeMs == 0) {
+    fprintf(stderr, "Invalid repetitions or time of repetitions.\n");
+    return 1;
+  }
+
+  static BenchFrame_t frames[7];
+  size_t framesCount = 0;
+  BuildFrame(&frames[framesCount++], "tcp-64", Protocol_TCP, 64, 8080);
+  BuildFrame(&frames[framesCount++], "tcp-576", Protocol_TCP, 576, 8080);
+  BuildFrame(&frames[framesCount++], "tcp-1500", Protocol_TCP, 1500, 8080);
+  BuildFrame(&frames[framesCount++], "udp-64", Protocol_UDP, 64, 53);
+  BuildFrame(&frames[framesCount++], "udp-576", Protocol_UDP, 576, 53);
+  BuildFrame(&frames[framesCount++], "udp-1500", Protocol_UDP, 1500, 53);
+  BuildFrame(&frames[framesCount++], "icmp-64", Protocol_ICMP, 64, 0);
+
+  // the sniffer is not started, only its address filters are used
+  static Sniffer_t sniffer;
+  memset(&sniffer, 0, sizeof(sniffer));
+  if (AddAddress(&sniffer, "10.0.0.1:22", Protocol_TCP, Direction_ANY) < 0 ||
+      AddAddress(&sniffer, "192.168.1.1:0", Protocol_ANY, Direction_SOURCE) < 0 ||
+      AddAddress(&sniffer, "any:53", Protocol_UDP, Direction_DESTINATION) < 0 ||
+      AddAddress(&sniffer, "127.0.0.2:8080", Protocol_TCP, Direction_ANY) < 0) {
+    fprintf(stderr, "%s\n", sniffer.ErrorMessage);
+    return 1;
+  }
+
+  PacketBuffers_t buffers;
+  PacketBuffersInit(&buffers);
+  BenchContext_t context = {NULL, &sniffer, &buffers, malloc(DATA_BUFFER_SUFFICIENT_SIZE), {0}};
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", context.HexBuffer != NULL);
+  GetTimeInfoNow(&context.Time, &sniffer.ErrorMessage);
+
+  static BenchResult_t baseline[BENCH_BASELINE_MAX_COUNT];
+  size_t baselineCount = 0;
+  if (baselinePath != NULL && (baselineCount = ReadBaseline(baselinePath, baseline, BENCH_BASELINE_MAX_COUNT)) == 0) {
+    fprintf(stderr, "Cannot read results of the baseline '%s'.\n", baselinePath);
+    return 1;
+  }
+  FILE* results = NULL;
+  if (resultsPath != NULL && (results = fopen(resultsPath, "w")) == NULL) {
+    fprintf(stderr, "Cannot open the results file '%s'.\n", resultsPath);
+    return 1;
+  }
+
+  const BenchCase_t cases[] = {{"parse", ParseHeaders, true},
+                               {"decode", DecodeView, true},
+                               {"match", MatchAddress, true},
+                               {"format", FormatPacket, true},
+                               {"hexdump-table", HexDumpTable, true},
+                               {"hexdump-snprintf", HexDumpSnprintf, true},
+                               {"timestamp", CaptureTime, false}};
+
+  printf("netsniffer %s, %lu repetitions of %lu ms\n", NetsnifferVersion(), repetitions, timeMs);
+  int regressions = 0;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+    for (size_t f = 0; f < (cases[i].PerFrame ? framesCount : 1); ++f) {
+      char name[BENCH_CASE_NAME_MAX_SIZE];
+      if (cases[i].PerFrame)
+        snprintf(name, sizeof(name), "%s/%s", cases[i].Name, frames[f].Name);
+      else
+        snprintf(name, sizeof(name), "%s", cases[i].Name);
+      if (filter != NULL && strstr(name, filter) == NULL)
+        continue;
+
+      // the warm-up also estimates packets of one repetition
+      context.Frame = &frames[f];
+      uint64_t packets = 1000;
+      double seconds = Measure(cases[i].Func, &context, packets);
+      while (seconds < (double) timeMs / 1e4 && packets < (UINT64_MAX >> 4)) {
+        packets *= 4;
+        seconds = Measure(cases[i].Func, &context, packets);
+      }
+      packets = (uint64_t) ((double) packets * ((double) timeMs / 1e3) / seconds) + 1;
+
+      double ns[BENCH_REPETITIONS_MAX];
+      for (unsigned long r = 0; r < repetitions; ++r)
+        ns[r] = Measure(cases[i].Func, &context, packets) * 1e9 / (double) packets;
+      qsort(ns, repetitions, sizeof(double), CompareDoubles);
+      double median = ns[repetitions / 2];
+
+      printf("%-28s %10.1f ns/packet %14.0f packets/s (min %.1f, max %.1f)",
+             name,
+             median,
+             1e9 / median,
+             ns[0],
+             ns[repetitions - 1]);
+      for (size_t b = 0; b < baselineCount; ++b) {
+        if (strcmp(baseline[b].Name, name) != 0)
+          continue;
+        double change = (median - baseline[b].NsPerPacket) * 100.0 / baseline[b].NsPerPacket;
+        printf(" %+6.1f%%%s", change, change > threshold ? " REGRESSION" : "");
+        regressions += change > threshold;
+      }
+      printf("\n");
+
+      if (results != NULL)
+        fprintf(results,
+                "{\"case\":\"%s\",\"version\":\"%s\",\"packets\":%llu,\"repetitions\":%lu,\"ns_per_packet\":%.3f,"
+                "\"min_ns_per_packet\":%.3f,\"max_ns_per_packet\":%.3f,\"packets_per_sec\":%.0f}\n",
+                name,
+                NetsnifferVersion(),
+                (unsigned long long) packets,
+                repetitions,
+                median,
+                ns[0],
+                ns[repetitions - 1],
+                1e9 / median);
+    }
+  }
+
+  if (results != NULL)
+    fclose(results);
+  free(context.HexBuffer);
+  PacketBuffersDelete(&buffers);
+  SnifferClear(&sniffer);
+  if (regressions > 0) {
+    fprintf(stderr, "%d cases are slower than the baseline by more than %.1f%%.\n", regressions, threshold);
+    return 2;
+  }
+  return 0;
+}
+
+size_t BuildFrame(BenchFrame_t* f, const char* name, uint8_t protocol, size_t size, uint16_t dport)
+{
+  memset(f, 0, sizeof(BenchFrame_t));
+  f->Name = name;
+  f->Size = size;
+  snprintf(f->SourceIP, IP_MAX_SIZE, "127.0.0.1");
+  snprintf(f->DestIP, IP_MAX_SIZE, "127.0.0.2");
+  f->SourcePort = protocol == Protocol_ICMP ? 0 : 40000;
+  f->DestPort = dport;
+
+  uint8_t* ip = f->Data;
+  uint32_t source = htonl(0x7F000001), dest = htonl(0x7F000002);
+  ip[0] = 0x45;
+  ip[2] = (uint8_t) (size >> 8);
+  ip[3] = (uint8_t) size;
+  ip[8] = 64;
+  ip[9] = protocol;
+  memcpy(ip + 12, &source, 4);
+  memcpy(ip + 16, &dest, 4);
+
+  uint8_t* transport = ip + 20;
+  size_t headerSize = 20;
+  if (protocol == Protocol_TCP) {
+    uint16_t sport = htons((uint16_t) f->SourcePort), port = htons(dport);
+    memcpy(transport, &sport, 2);
+    memcpy(transport + 2, &port, 2);
+    transport[12] = 0x50;
+    transport[13] = 0x18; // PSH ACK
+    headerSize += 20;
+  } else if (protocol == Protocol_UDP) {
+    uint16_t sport = htons((uint16_t) f->SourcePort), port = htons(dport), length = htons((uint16_t) (size - 20));
+    memcpy(transport, &sport, 2);
+    memcpy(transport + 2, &port, 2);
+    memcpy(transport + 4, &length, 2);
+    headerSize += 8;
+  } else {
+    transport[0] = 8; // echo request
+    headerSize += 8;
+  }
+
+  srand(1);
+  for (size_t i = headerSize; i < size; ++i)
+    f->Data[i] = (uint8_t) rand();
+  return size;
+}
+
+int AddAddress(Sniffer_t* s, const char* address, Protocol_t protocol, Direction_t direction)
+{
+  Filter_t filter;
+  FilterInitDefaults(&filter);
+  filter.Protocol = protocol;
+  filter.Direction = direction;
+  return SnifferAddAddress(s, address, &filter);
+}
+
+size_t ParseHeaders(BenchContext_t* c)
+{
+  IPHeader_t* iphdr = GetIPHeader((Buffer_t) c->Frame->Data);
+  size_t offset = 0;
+  Buffer_t data = GetPacketData((Buffer_t) c->Frame->Data, &offset);
+  return GetIPHeaderLength(iphdr) + offset + (data != NULL);
+}
+
+size_t DecodeView(BenchContext_t* c)
+{
+  PacketView_t view;
+  DecodePacketView((Buffer_t) c->Frame->Data, c->Frame->Size, &view);
+  return view.PayloadSize;
+}
+
+size_t MatchAddress(BenchContext_t* c)
+{
+  const BenchFrame_t* f = c->Frame;
+  bool tlsProcessed = false;
+  return SnifferMatchAddress(c->Sniffer,
+                             (Buffer_t) f->Data,
+                             f->Size,
+                             f->SourceIP,
+                             f->SourcePort,
+                             f->DestIP,
+                             f->DestPort,
+                             &tlsProcessed);
+}
+
+size_t FormatPacket(BenchContext_t* c)
+{
+  PrintPacketToBuffers((Buffer_t) c->Frame->Data, c->Frame->Size, c->Buffers, &c->Time);
+  return (size_t) c->Buffers->DataBuffer[0];
+}
+
+size_t HexDumpTable(BenchContext_t* c)
+{
+  return PrintHexDump(c->Frame->Data, c->Frame->Size, c->HexBuffer, DATA_BUFFER_SUFFICIENT_SIZE, false);
+}
+
+size_t HexDumpSnprintf(BenchContext_t* c)
+{
+  // the previous implementation of PrintPacketData (two snprintf calls per byte)
+  int length = 0;
+  for (size_t i = 0; i < c->Frame->Size; ++i) {
+    length += snprintf(
+        c->HexBuffer + length, DATA_BUFFER_SUFFICIENT_SIZE - (size_t) length, "[%02X]", c->Frame->Data[i]);
+    if ((i + 1) % HEX_DUMP_LINE_SIZE == 0)
+      length += snprintf(c->HexBuffer + length, DATA_BUFFER_SUFFICIENT_SIZE - (size_t) length, "\n");
+    else
+      length += snprintf(c->HexBuffer + length, DATA_BUFFER_SUFFICIENT_SIZE - (size_t) length, " ");
+  }
+  return (size_t) length;
+}
+
+size_t CaptureTime(BenchContext_t* c)
+{
+  GetTimeInfoNow(&c->Time, &c->Sniffer->ErrorMessage);
+  return (size_t) c->Time.TimestampNanosec;
+}
+
+double Measure(BenchFunc_t func, BenchContext_t* c, uint64_t packets)
+{
+  struct timespec start, end;
+  volatile size_t total = 0; // keeps the results alive
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint64_t i = 0; i < packets; ++i)
+    total += func(c);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  (void) total;
+  return (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int CompareDoubles(const void* a, const void* b)
+{
+  double x = *(const double*) a, y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+size_t ReadBaseline(const char* path, BenchResult_t* results, size_t maxCount)
+{
+  FILE* file = fopen(path, "r");
+  if (file == NULL)
+    return 0;
+
+  size_t count = 0;
+  char line[512];
+  while (count < maxCount && fgets(line, sizeof(line), file) != NULL) {
+    const char* name = strstr(line, "\"case\":\"");
+    const char* ns = strstr(line, "\"ns_per_packet\":");
+    if (name == NULL || ns == NULL)
+      continue;
+    if (sscanf(name + 8, "%63[^\"]", results[count].Name) == 1 &&
+        sscanf(ns + 16, "%lf", &results[count].NsPerPacket) == 1 && results[count].NsPerPacket > 0)
+      ++count;
+  }
+  fclose(file);
+  return count;
+}
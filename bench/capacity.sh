@@ -0,0 +1,145 @@
+#!/usr/bin/env bash
+#
+# Capacity benchmark: runs netsniffer on the interface, sends traffic by netsniffer-loadgen at increasing rates and
+# reports the highest rate that is captured without kernel drops, for each output mode. On Linux the capture backend
+# is the packet socket (the only backend of the platform).
+# With -netns the traffic is sent over a veth pair to a private network namespace, otherwise over lo.
+# Usage: capacity.sh [-build DIR] [-protocol udp|tcp] [-size BYTES] [-duration SEC] [-start PPS] [-max PPS]
+#                    [-step PERCENT] [-modes "text brief json bin stats"] [-netns] [-results FILE]
+# Must be run as root.
+
+set -u
+
+BUILD_DIR=.
+PROTOCOL=udp
+SIZE=64
+DURATION=3
+START_RATE=10000
+MAX_RATE=4000000
+STEP_PERCENT=50
+MODES="text brief json bin stats"
+NETNS=0
+RESULTS=
+PORT=9555
+BACKEND=packet-socket
+
+NETNS_NAME=netsniffer-capacity
+HOST_VETH=nscap0
+NS_VETH=nscap1
+HOST_IP=10.203.0.1
+NS_IP=10.203.0.2
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    -build) BUILD_DIR=$2; shift ;;
+    -protocol) PROTOCOL=$2; shift ;;
+    -size) SIZE=$2; shift ;;
+    -duration) DURATION=$2; shift ;;
+    -start) START_RATE=$2; shift ;;
+    -max) MAX_RATE=$2; shift ;;
+    -step) STEP_PERCENT=$2; shift ;;
+    -modes) MODES=$2; shift ;;
+    -netns) NETNS=1 ;;
+    -results) RESULTS=$2; shift ;;
+    *)
+      sed -n '7,8s/^# //p' "$0" >&2
+      exit 1 ;;
+  esac
+  shift
+done
+
+SNIFFER="$BUILD_DIR/netsniffer"
+LOADGEN="$BUILD_DIR/netsniffer-loadgen"
+if [ ! -x "$SNIFFER" ] || [ ! -x "$LOADGEN" ]; then
+  echo "netsniffer and netsniffer-loadgen are not found in '$BUILD_DIR' (build with -DBENCHMARKS_ENABLED=1)." >&2
+  exit 1
+fi
+LOG=$(mktemp)
+
+cleanup() {
+  rm -f "$LOG"
+  if [ "$NETNS" -eq 1 ]; then
+    ip link del "$HOST_VETH" 2> /dev/null
+    ip netns del "$NETNS_NAME" 2> /dev/null
+  fi
+}
+trap cleanup EXIT
+
+if [ "$NETNS" -eq 1 ]; then
+  ip netns add "$NETNS_NAME" &&
+    ip link add "$HOST_VETH" type veth peer name "$NS_VETH" &&
+    ip link set "$NS_VETH" netns "$NETNS_NAME" &&
+    ip addr add "$HOST_IP/30" dev "$HOST_VETH" &&
+    ip link set "$HOST_VETH" up &&
+    ip netns exec "$NETNS_NAME" ip addr add "$NS_IP/30" dev "$NS_VETH" &&
+    ip netns exec "$NETNS_NAME" ip link set "$NS_VETH" up || exit 1
+  INTERFACE=$HOST_VETH
+  TARGET=$NS_IP:$PORT
+else
+  INTERFACE=lo
+  TARGET=127.0.0.1:$PORT
+fi
+
+# prints "SENT_PPS RECEIVED DROPS" of one run
+run_once() {
+  local mode=$1 rate=$2 sinkPid= sniffer
+  case "$mode" in
+    stats) set -- -stats ;;
+    *) set -- -format "$mode" ;;
+  esac
+
+  if [ "$NETNS" -eq 1 ]; then
+    ip netns exec "$NETNS_NAME" "$LOADGEN" -sink -target "$TARGET" -protocol "$PROTOCOL" \
+      -duration $((DURATION + 3)) > /dev/null &
+    sinkPid=$!
+  fi
+  "$SNIFFER" "$INTERFACE" "$@" -stats-interval 1 "$PROTOCOL" "$TARGET" > /dev/null 2> "$LOG" &
+  sniffer=$!
+  sleep 1
+
+  local sent
+  sent=$("$LOADGEN" -target "$TARGET" -protocol "$PROTOCOL" -size "$SIZE" -rate "$rate" -duration "$DURATION" -json |
+    sed -n 's/.*"packets_per_sec":\([0-9]*\).*/\1/p')
+  sleep 1
+  kill -INT "$sniffer"
+  wait "$sniffer" 2> /dev/null
+  [ -n "$sinkPid" ] && wait "$sinkPid" 2> /dev/null
+
+  local received drops
+  received=$(sed -n 's/^capture: received [0-9]* (+[0-9]*), handled \([0-9]*\) .*/\1/p' "$LOG" | tail -n 1)
+  drops=$(sed -n 's/^Warning: the kernel dropped \([0-9]*\) of.*/\1/p' "$LOG")
+  echo "${sent:-0} ${received:-0} ${drops:-0}"
+}
+
+echo "netsniffer capacity: $BACKEND backend, $INTERFACE, $PROTOCOL packets of $SIZE bytes, $DURATION s per rate"
+[ -n "$RESULTS" ] && : > "$RESULTS"
+for mode in $MODES; do
+  rate=$START_RATE
+  capacity=0
+  limit="kernel drops"
+  while :; do
+    read -r sent received drops <<< "$(run_once "$mode" "$rate")"
+    printf "%-6s rate %10d: sent %10d packets/s, handled %12d, kernel drops %d\n" \
+      "$mode" "$rate" "$sent" "$received" "$drops"
+    if [ "$drops" -gt 0 ]; then
+      break
+    fi
+    capacity=$sent
+    # the generator cannot send faster, the sniffer keeps up with it
+    if [ "$sent" -lt $((rate * 9 / 10)) ]; then
+      limit="generator limit"
+      break
+    fi
+    if [ "$rate" -ge "$MAX_RATE" ]; then
+      limit="max rate"
+      break
+    fi
+    rate=$((rate + rate * STEP_PERCENT / 100))
+    [ "$rate" -gt "$MAX_RATE" ] && rate=$MAX_RATE
+  done
+  printf "%-6s capacity %d packets/s without drops (%s)\n" "$mode" "$capacity" "$limit"
+  if [ -n "$RESULTS" ]; then
+    FORMAT='{"backend":"%s","interface":"%s","mode":"%s","protocol":"%s","size":%d,"packets_per_sec":%d,"limit":"%s"}'
+    printf "$FORMAT\n" "$BACKEND" "$INTERFACE" "$mode" "$PROTOCOL" "$SIZE" "$capacity" "$limit" >> "$RESULTS"
+  fi
+done
@@ -0,0 +1,301 @@
+/*
+ * Traffic generator of the capacity benchmark: sends UDP datagrams or TCP segments of the same size to the target by
+ * sendmmsg() at the configured rate (packets per second, 0 is unlimited). If the target address is local, the sink is
+ * opened on it: UDP datagrams are queued to the socket that is never read (the kernel drops them without ICMP
+ * errors), TCP connections are accepted and drained. Packets are sent by batches, each batch is paced by
+ * clock_nanosleep(), so the rate is kept on average of about 1 ms. -sink only opens the sink for the duration, it is
+ * started in another network namespace when the traffic is sent over a veth pair.
+ * Usage: netsniffer-loadgen -target IP:PORT [-protocol udp|tcp] [-rate PPS] [-size BYTES] [-duration SEC]
+ *                           [-batch N] [-interface NAME] [-sink] [-json]
+ */
+#define _GNU_SOURCE
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOADGEN_BATCH_DEFAULT_SIZE 64
+#define LOADGEN_BATCH_MAX_SIZE 1024
+#define LOADGEN_PAYLOAD_DEFAULT_SIZE 64
+#define LOADGEN_PAYLOAD_MAX_SIZE 65000
+#define LOADGEN_DURATION_DEFAULT_SEC 5
+#define LOADGEN_TARGET_MAX_SIZE 64
+
+typedef struct
+{
+  struct sockaddr_in Target;
+  int Protocol;
+  unsigned long Rate;
+  unsigned long Size;
+  unsigned long DurationSec;
+  unsigned long Batch;
+  const char* Interface;
+  bool SinkOnly;
+  bool Json;
+} LoadgenArgs_t;
+
+typedef struct
+{
+  int Socket;
+  pthread_t Thread;
+  bool Opened;
+} LoadgenSink_t;
+
+static int ParseTarget(const char* value, struct sockaddr_in* target);
+static int OpenSink(const LoadgenArgs_t* args, LoadgenSink_t* sink);
+static void CloseSink(LoadgenSink_t* sink);
+static void* DrainConnections(void* args);
+static int OpenSender(const LoadgenArgs_t* args);
+static void AddNs(struct timespec* t, uint64_t ns);
+
+int main(int argc, char** argv)
+{
+  LoadgenArgs_t args;
+  memset(&args, 0, sizeof(args));
+  args.Protocol = IPPROTO_UDP;
+  args.Size = LOADGEN_PAYLOAD_DEFAULT_SIZE;
+  args.DurationSec = LOADGEN_DURATION_DEFAULT_SEC;
+  args.Batch = LOADGEN_BATCH_DEFAULT_SIZE;
+  bool hasTarget = false;
+  for (int i = 1; i < argc; ++i) {
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    bool valid = value != NULL;
+    if (valid && strcmp(argv[i], "-target") == 0)
+      valid = hasTarget = ParseTarget(value, &args.Target) == 0;
+    else if (valid && strcmp(argv[i], "-protocol") == 0) {
+      args.Protocol = strcmp(value, "tcp") == 0 ? IPPROTO_TCP : IPPROTO_UDP;
+      valid = strcmp(value, "tcp") == 0 || strcmp(value, "udp") == 0;
+    } else if (valid && strcmp(argv[i], "-rate") == 0)
+      args.Rate = strtoul(value, NULL, 10);
+    else if (valid && strcmp(argv[i], "-size") == 0)
+      args.Size = strtoul(value, NULL, 10);
+    else if (valid && strcmp(argv[i], "-duration") == 0)
+      args.DurationSec = strtoul(value, NULL, 10);
+    else if (valid && strcmp(argv[i], "-batch") == 0)
+      args.Batch = strtoul(value, NULL, 10);
+    else if (valid && strcmp(argv[i], "-interface") == 0)
+      args.Interface = value;
+    else if (strcmp(argv[i], "-sink") == 0) {
+      args.SinkOnly = true;
+      continue;
+    } else if (strcmp(argv[i], "-json") == 0) {
+      args.Json = true;
+      continue;
+    } else
+      valid = false;
+
+    if (!valid) {
+      fprintf(stderr,
+              "Usage: %s -target IP:PORT [-protocol udp|tcp] [-rate PPS] [-size BYTES (1-%d)] [-duration SEC] "
+              "[-batch N (1-%d)] [-interface NAME] [-sink] [-json]\n",
+              argv[0],
+              LOADGEN_PAYLOAD_MAX_SIZE,
+              LOADGEN_BATCH_MAX_SIZE);
+      return 1;
+    }
+    ++i;
+  }
+  if (!hasTarget || args.Size == 0 || args.Size > LOADGEN_PAYLOAD_MAX_SIZE || args.DurationSec == 0 ||
+      args.Batch == 0 || args.Batch > LOADGEN_BATCH_MAX_SIZE) {
+    fprintf(stderr, "Invalid target, size, duration or batch size.\n");
+    return 1;
+  }
+  // bursts are not longer than 1 ms of the rate
+  if (args.Rate > 0 && args.Batch > args.Rate / 1000)
+    args.Batch = args.Rate / 1000 > 0 ? args.Rate / 1000 : 1;
+
+  LoadgenSink_t sink;
+  if (OpenSink(&args, &sink) < 0)
+    return 1;
+  if (args.SinkOnly) {
+    if (!sink.Opened) {
+      fprintf(stderr, "Cannot open the sink: the target address is not local.\n");
+      return 1;
+    }
+    sleep((unsigned int) args.DurationSec);
+    CloseSink(&sink);
+    return 0;
+  }
+  int sock = OpenSender(&args);
+  if (sock < 0) {
+    CloseSink(&sink);
+    return 1;
+  }
+
+  char* payload = malloc(args.Size);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", payload != NULL);
+  for (unsigned long i = 0; i < args.Size; ++i)
+    payload[i] = (char) ('a' + i % 26);
+  static struct mmsghdr messages[LOADGEN_BATCH_MAX_SIZE];
+  struct iovec iov = {payload, args.Size};
+  memset(messages, 0, sizeof(messages));
+  for (unsigned long i = 0; i < args.Batch; ++i) {
+    messages[i].msg_hdr.msg_iov = &iov;
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  uint64_t sent = 0, errors = 0;
+  uint64_t startNs = GetMonotonicTimeNs();
+  uint64_t endNs = startNs + (uint64_t) args.DurationSec * 1000000000;
+  uint64_t batchNs = args.Rate > 0 ? (uint64_t) args.Batch * 1000000000 / args.Rate : 0;
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (GetMonotonicTimeNs() < endNs) {
+    int count = sendmmsg(sock, messages, (unsigned int) args.Batch, 0);
+    if (count > 0)
+      sent += (uint64_t) count;
+    else if (errno != EINTR && errno != EAGAIN && errno != ENOBUFS && errno != ECONNREFUSED) {
+      fprintf(stderr, "sendmmsg() failed: %s.\n", strerror(errno));
+      break;
+    } else
+      errors++;
+
+    if (batchNs > 0) {
+      AddNs(&deadline, batchNs);
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+        ;
+    }
+  }
+  double seconds = (double) (GetMonotonicTimeNs() - startNs) / 1e9;
+
+  close(sock);
+  CloseSink(&sink);
+  free(payload);
+
+  double pps = (double) sent / seconds;
+  double mbps = pps * (double) args.Size * 8.0 / 1e6;
+  if (args.Json)
+    printf("{\"protocol\":\"%s\",\"size\":%lu,\"rate\":%lu,\"sent\":%llu,\"errors\":%llu,\"seconds\":%.3f,"
+           "\"packets_per_sec\":%.0f,\"mbit_per_sec\":%.1f}\n",
+           args.Protocol == IPPROTO_TCP ? "tcp" : "udp",
+           args.Size,
+           args.Rate,
+           (unsigned long long) sent,
+           (unsigned long long) errors,
+           seconds,
+           pps,
+           mbps);
+  else
+    printf("Sent %llu %s packets of %lu bytes in %.3f s: %.0f packets/s, %.1f Mbit/s payload, %llu errors\n",
+           (unsigned long long) sent,
+           args.Protocol == IPPROTO_TCP ? "TCP" : "UDP",
+           args.Size,
+           seconds,
+           pps,
+           mbps,
+           (unsigned long long) errors);
+  return 0;
+}
+
+int ParseTarget(const char* value, struct sockaddr_in* target)
+{
+  char ip[LOADGEN_TARGET_MAX_SIZE];
+  const char* colon = strrchr(value, ':');
+  if (colon == NULL || (size_t) (colon - value) >= sizeof(ip))
+    return -1;
+  memcpy(ip, value, (size_t) (colon - value));
+  ip[colon - value] = '\0';
+  unsigned long port = strtoul(colon + 1, NULL, 10);
+  if (port == 0 || port > 65535)
+    return -1;
+
+  memset(target, 0, sizeof(*target));
+  target->sin_family = AF_INET;
+  target->sin_port = htons((uint16_t) port);
+  return inet_pton(AF_INET, ip, &target->sin_addr) == 1 ? 0 : -1;
+}
+
+int OpenSink(const LoadgenArgs_t* args, LoadgenSink_t* sink)
+{
+  memset(sink, 0, sizeof(*sink));
+  sink->Socket = socket(AF_INET, args->Protocol == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+  if (sink->Socket < 0) {
+    fprintf(stderr, "Cannot open the sink socket: %s.\n", strerror(errno));
+    return -1;
+  }
+  int on = 1;
+  setsockopt(sink->Socket, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  if (bind(sink->Socket, (const struct sockaddr*) &args->Target, sizeof(args->Target)) < 0) {
+    // the target is not local, the traffic is sent to another host or namespace
+    int error = errno;
+    close(sink->Socket);
+    if (error != EADDRNOTAVAIL)
+      fprintf(stderr, "Cannot bind the sink socket: %s.\n", strerror(error));
+    return error == EADDRNOTAVAIL ? 0 : -1;
+  }
+  if (args->Protocol == IPPROTO_TCP) {
+    if (listen(sink->Socket, 16) < 0 || pthread_create(&sink->Thread, NULL, DrainConnections, sink) != 0) {
+      fprintf(stderr, "Cannot listen on the sink socket: %s.\n", strerror(errno));
+      close(sink->Socket);
+      return -1;
+    }
+  }
+  sink->Opened = true;
+  return 0;
+}
+
+void CloseSink(LoadgenSink_t* sink)
+{
+  if (!sink->Opened)
+    return;
+  // accept() and recv() of the drain thread are interrupted by shutdown()
+  shutdown(sink->Socket, SHUT_RDWR);
+  if (sink->Thread != 0)
+    pthread_join(sink->Thread, NULL);
+  close(sink->Socket);
+  sink->Opened = false;
+}
+
+void* DrainConnections(void* args)
+{
+  LoadgenSink_t* sink = (LoadgenSink_t*) args;
+  static char buffer[LOADGEN_PAYLOAD_MAX_SIZE];
+  int connection;
+  while ((connection = accept(sink->Socket, NULL, NULL)) >= 0) {
+    while (recv(connection, buffer, sizeof(buffer), 0) > 0)
+      ;
+    close(connection);
+  }
+  return NULL;
+}
+
+int OpenSender(const LoadgenArgs_t* args)
+{
+  int sock = socket(AF_INET, args->Protocol == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+  if (sock < 0) {
+    fprintf(stderr, "Cannot open the socket: %s.\n", strerror(errno));
+    return -1;
+  }
+  int on = 1;
+  if (args->Protocol == IPPROTO_TCP)
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  if (args->Interface != NULL &&
+      setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, args->Interface, (socklen_t) strlen(args->Interface)) < 0) {
+    fprintf(stderr, "Cannot bind the socket to the interface '%s': %s.\n", args->Interface, strerror(errno));
+    close(sock);
+    return -1;
+  }
+  if (connect(sock, (const struct sockaddr*) &args->Target, sizeof(args->Target)) < 0) {
+    fprintf(stderr, "Cannot connect to the target: %s.\n", strerror(errno));
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+void AddNs(struct timespec* t, uint64_t ns)
+{
+  ns += (uint64_t) t->tv_nsec;
+  t->tv_sec += (time_t) (ns / 1000000000);
+  t->tv_nsec = (long) (ns % 1000000000);
+}
@@ -0,0 +1,87 @@
+#include "allocaudit.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size);
+void* __wrap_calloc(size_t count, size_t size);
+void* __wrap_realloc(void* p, size_t size);
+
+static void CountAllocation(size_t size);
+
+static _Thread_local bool Auditing = false;
+static _Thread_local bool Strict = false;
+static _Thread_local uint64_t Allocations = 0;
+static _Thread_local size_t LastSize = 0;
+static atomic_bool ProcessAuditing = false;
+static atomic_uint_fast64_t ProcessAllocations = 0;
+
+void AllocAuditBegin(bool strict)
+{
+  Allocations = 0;
+  LastSize = 0;
+  Strict = strict;
+  Auditing = true;
+}
+
+uint64_t AllocAuditEnd()
+{
+  Auditing = false;
+  return Allocations;
+}
+
+void AllocAuditBeginProcess()
+{
+  atomic_store(&ProcessAllocations, 0);
+  atomic_store(&ProcessAuditing, true);
+}
+
+uint64_t AllocAuditEndProcess()
+{
+  atomic_store(&ProcessAuditing, false);
+  return atomic_load(&ProcessAllocations);
+}
+
+size_t AllocAuditLastSize()
+{
+  return LastSize;
+}
+
+void* __wrap_malloc(size_t size)
+{
+  CountAllocation(size);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+  CountAllocation(count * size);
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* p, size_t size)
+{
+  CountAllocation(size);
+  return __real_realloc(p, size);
+}
+
+void CountAllocation(size_t size)
+{
+  if (atomic_load_explicit(&ProcessAuditing, memory_order_relaxed))
+    atomic_fetch_add_explicit(&ProcessAllocations, 1, memory_order_relaxed);
+  if (!Auditing)
+    return;
+
+  Allocations++;
+  LastSize = size;
+  if (Strict) {
+    // fputs() does not allocate if the stream is unbuffered (stderr)
+    fputs("Allocation audit: the packet path allocated memory after the warm-up.\n", stderr);
+    abort();
+  }
+}
@@ -0,0 +1,46 @@
+#ifndef __ALLOCAUDIT_H
+#define __ALLOCAUDIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Allocation audit of the packet path. It is only built with ALLOCATION_AUDIT_ENABLED: the executable is linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc, so allocations of the library and the executable are
+ * counted (allocations inside libc are not seen). Only allocations of the thread between AllocAuditBegin() and
+ * AllocAuditEnd() are counted, other threads (the output, the metrics server) are not audited. Tests which run only
+ * threads of the packet path audit all threads with AllocAuditBeginProcess().
+ */
+#define ALLOCATION_AUDIT_WARMUP_PACKETS 1000
+
+/**
+ * @brief AllocAuditBegin
+ * Starts counting allocations of the current thread, after the warm-up (buffers of the packet path are allocated).
+ * @param strict Abort at the first allocation (the stack shows the allocation in a debugger)
+ */
+void AllocAuditBegin(bool strict);
+/**
+ * @brief AllocAuditEnd
+ * Stops counting allocations of the current thread.
+ * @return Allocations (malloc, calloc and realloc calls) since AllocAuditBegin().
+ */
+uint64_t AllocAuditEnd();
+/**
+ * @brief AllocAuditBeginProcess
+ * Starts counting allocations of all threads (workers of the format pool, the writer of the output).
+ */
+void AllocAuditBeginProcess();
+/**
+ * @brief AllocAuditEndProcess
+ * Stops counting allocations of all threads.
+ * @return Allocations of all threads since AllocAuditBeginProcess().
+ */
+uint64_t AllocAuditEndProcess();
+/**
+ * @brief AllocAuditLastSize
+ * @return The size of the last counted allocation of the current thread.
+ */
+size_t AllocAuditLastSize();
+
+#endif // __ALLOCAUDIT_H
@@ -0,0 +1,319 @@
+#include "checksum.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#elif _WIN32
+#include <winsock2.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHECKSUM_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * 32-bit lanes of SIMD accumulators are flushed to the 64-bit sum after this number of blocks. Every block adds two
+ * 16-bit words to each lane, so the lanes cannot overflow.
+ */
+#define CHECKSUM_SIMD_FLUSH_BLOCKS 8192
+#define IPV4_FLAG_MORE_FRAGMENTS 0x20
+#define IPV4_FRAGMENT_OFFSET_MASK 0x1F
+
+typedef uint64_t (*ChecksumAddFunc_t)(const uint8_t*, size_t, uint64_t);
+
+static uint64_t ChecksumAddScalar(const uint8_t* data, size_t size, uint64_t sum);
+#ifdef CHECKSUM_X86_SIMD
+static uint64_t ChecksumAddSSE2(const uint8_t* data, size_t size, uint64_t sum);
+static uint64_t ChecksumAddAVX2(const uint8_t* data, size_t size, uint64_t sum);
+#endif
+static ChecksumAddFunc_t ChecksumSelectImplementation();
+
+static ChecksumAddFunc_t ChecksumAddImpl = NULL;
+static ChecksumImplementation_t ChecksumImpl = ChecksumImplementation_AUTO;
+
+int ChecksumSetImplementation(ChecksumImplementation_t impl)
+{
+#ifdef CHECKSUM_X86_SIMD
+  __builtin_cpu_init();
+#endif
+  switch (impl) {
+  case ChecksumImplementation_AUTO:
+    ChecksumAddImpl = ChecksumSelectImplementation();
+    return 0;
+  case ChecksumImplementation_SCALAR:
+    ChecksumAddImpl = ChecksumAddScalar;
+    break;
+#ifdef CHECKSUM_X86_SIMD
+  case ChecksumImplementation_SSE2:
+    if (!__builtin_cpu_supports("sse2"))
+      return -1;
+    ChecksumAddImpl = ChecksumAddSSE2;
+    break;
+  case ChecksumImplementation_AVX2:
+    if (!__builtin_cpu_supports("avx2"))
+      return -1;
+    ChecksumAddImpl = ChecksumAddAVX2;
+    break;
+#endif
+  default:
+    return -1;
+  }
+
+  ChecksumImpl = impl;
+  return 0;
+}
+
+const char* ChecksumImplementationName()
+{
+  if (ChecksumAddImpl == NULL)
+    ChecksumAddImpl = ChecksumSelectImplementation();
+
+  switch (ChecksumImpl) {
+  case ChecksumImplementation_SSE2:
+    return "sse2";
+  case ChecksumImplementation_AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+uint64_t ChecksumAdd(const void* data, size_t size, uint64_t sum)
+{
+  if (ChecksumAddImpl == NULL)
+    ChecksumAddImpl = ChecksumSelectImplementation();
+
+  return ChecksumAddImpl((const uint8_t*) data, size, sum);
+}
+
+uint16_t ChecksumFold(uint64_t sum)
+{
+  while (sum >> 16)
+    sum = (sum & 0xFFFF) + (sum >> 16);
+  return (uint16_t) sum;
+}
+
+bool ChecksumVerifyIPHeader(Buffer_t buf, size_t size)
+{
+  if (size < sizeof(IPHeader_t))
+    return false;
+
+  size_t hdrlen = GetIPHeaderLength(GetIPHeader(buf));
+  if (hdrlen < sizeof(IPHeader_t) || hdrlen > size)
+    return false;
+
+  return ChecksumFold(ChecksumAdd(buf, hdrlen, 0)) == 0xFFFF;
+}
+
+ChecksumStatus_t ChecksumVerifyPacket(Buffer_t buf, size_t size, ChecksumHint_t hint, ChecksumStats_t* stats)
+{
+  ChecksumStats_t unused = {0};
+  if (stats == NULL)
+    stats = &unused;
+
+  switch (hint) {
+  case ChecksumHint_KERNEL_VALID:
+    stats->KernelValid++;
+    return ChecksumStatus_KERNEL_VALID;
+  case ChecksumHint_NOT_READY:
+    stats->Offloaded++;
+    return ChecksumStatus_OFFLOADED;
+  default:
+    break;
+  }
+
+  IPHeader_t* iphdr = GetIPHeader(buf);
+  if (size < sizeof(IPHeader_t) || iphdr->Version != 4) {
+    stats->NotChecked++;
+    return ChecksumStatus_NOT_CHECKED;
+  }
+
+  size_t hdrlen = GetIPHeaderLength(iphdr);
+  size_t totalLength = ntohs(iphdr->TotalLength);
+  if (hdrlen < sizeof(IPHeader_t) || totalLength < hdrlen || totalLength > size) {
+    stats->NotChecked++;
+    return ChecksumStatus_NOT_CHECKED;
+  }
+
+  if (ChecksumFold(ChecksumAdd(buf, hdrlen, 0)) != 0xFFFF) {
+    stats->BadIPHeader++;
+    return ChecksumStatus_BAD_IP_HEADER;
+  }
+
+  const uint8_t* raw = (const uint8_t*) buf;
+  if ((raw[6] & (IPV4_FLAG_MORE_FRAGMENTS | IPV4_FRAGMENT_OFFSET_MASK)) != 0 || raw[7] != 0) {
+    /*
+     * The transport checksum covers the whole datagram, fragments cannot be verified without the reassembly.
+     */
+    stats->NotChecked++;
+    return ChecksumStatus_NOT_CHECKED;
+  }
+
+  size_t segmentLength = totalLength - hdrlen;
+  uint64_t sum = 0;
+  uint64_t* badCounter = NULL;
+  switch (iphdr->Protocol) {
+  case Protocol_ICMP: {
+    if (segmentLength < sizeof(ICMPHeader_t)) {
+      stats->NotChecked++;
+      return ChecksumStatus_NOT_CHECKED;
+    }
+    badCounter = &stats->BadICMP;
+    break;
+  }
+  case Protocol_TCP:
+  case Protocol_UDP: {
+    if (iphdr->Protocol == Protocol_TCP) {
+      if (segmentLength < 20 /* minimal TCP header */) {
+        stats->NotChecked++;
+        return ChecksumStatus_NOT_CHECKED;
+      }
+      badCounter = &stats->BadTCP;
+    } else {
+      if (segmentLength < sizeof(UDPHeader_t) || GetUDPHeader(buf)->Checksum == 0 /* not computed by sender */) {
+        stats->NotChecked++;
+        return ChecksumStatus_NOT_CHECKED;
+      }
+      badCounter = &stats->BadUDP;
+    }
+
+    uint8_t pseudoHeader[12];
+    memcpy(pseudoHeader, &iphdr->SourceAddress, 4);
+    memcpy(pseudoHeader + 4, &iphdr->DestinationAddress, 4);
+    pseudoHeader[8] = 0;
+    pseudoHeader[9] = iphdr->Protocol;
+    pseudoHeader[10] = (uint8_t) (segmentLength >> 8);
+    pseudoHeader[11] = (uint8_t) (segmentLength & 0xFF);
+    sum = ChecksumAdd(pseudoHeader, sizeof(pseudoHeader), 0);
+    break;
+  }
+  default:
+    // only the IP header is verified
+    stats->NotChecked++;
+    return ChecksumStatus_NOT_CHECKED;
+  }
+
+  stats->Verified++;
+  if (ChecksumFold(ChecksumAdd(buf + hdrlen, segmentLength, sum)) != 0xFFFF) {
+    (*badCounter)++;
+    return ChecksumStatus_BAD_TRANSPORT;
+  }
+  return ChecksumStatus_VALID;
+}
+
+const char* ChecksumStatusToString(ChecksumStatus_t status)
+{
+  switch (status) {
+  case ChecksumStatus_VALID:
+    return "valid";
+  case ChecksumStatus_BAD_IP_HEADER:
+    return "bad (IP header)";
+  case ChecksumStatus_BAD_TRANSPORT:
+    return "bad (protocol)";
+  case ChecksumStatus_KERNEL_VALID:
+    return "valid (kernel)";
+  case ChecksumStatus_OFFLOADED:
+    return "offloaded";
+  default:
+    return "not checked";
+  }
+}
+
+bool ChecksumStatusIsBad(ChecksumStatus_t status)
+{
+  return status == ChecksumStatus_BAD_IP_HEADER || status == ChecksumStatus_BAD_TRANSPORT;
+}
+
+uint64_t ChecksumAddScalar(const uint8_t* data, size_t size, uint64_t sum)
+{
+  while (size >= 4) {
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+    sum += word;
+    data += 4;
+    size -= 4;
+  }
+  if (size >= 2) {
+    uint16_t word;
+    memcpy(&word, data, sizeof(word));
+    sum += word;
+    data += 2;
+    size -= 2;
+  }
+  if (size > 0) {
+    uint16_t word = 0; // the odd byte is padded with zero
+    memcpy(&word, data, 1);
+    sum += word;
+  }
+  return sum;
+}
+
+#ifdef CHECKSUM_X86_SIMD
+__attribute__((target("sse2"))) uint64_t ChecksumAddSSE2(const uint8_t* data, size_t size, uint64_t sum)
+{
+  const __m128i zero = _mm_setzero_si128();
+  while (size >= 16) {
+    size_t blocks = size / 16;
+    if (blocks > CHECKSUM_SIMD_FLUSH_BLOCKS)
+      blocks = CHECKSUM_SIMD_FLUSH_BLOCKS;
+
+    __m128i acc = zero;
+    for (size_t i = 0; i < blocks; ++i) {
+      __m128i v = _mm_loadu_si128((const __m128i*) data);
+      acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+      acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+      data += 16;
+    }
+    size -= blocks * 16;
+
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i*) lanes, acc);
+    sum += (uint64_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  return ChecksumAddScalar(data, size, sum);
+}
+
+__attribute__((target("avx2"))) uint64_t ChecksumAddAVX2(const uint8_t* data, size_t size, uint64_t sum)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  while (size >= 32) {
+    size_t blocks = size / 32;
+    if (blocks > CHECKSUM_SIMD_FLUSH_BLOCKS)
+      blocks = CHECKSUM_SIMD_FLUSH_BLOCKS;
+
+    __m256i acc = zero;
+    for (size_t i = 0; i < blocks; ++i) {
+      __m256i v = _mm256_loadu_si256((const __m256i*) data);
+      acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+      acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+      data += 32;
+    }
+    size -= blocks * 32;
+
+    uint32_t lanes[8];
+    _mm256_storeu_si256((__m256i*) lanes, acc);
+    for (int i = 0; i < 8; ++i)
+      sum += lanes[i];
+  }
+  return ChecksumAddScalar(data, size, sum);
+}
+#endif
+
+ChecksumAddFunc_t ChecksumSelectImplementation()
+{
+#ifdef CHECKSUM_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    ChecksumImpl = ChecksumImplementation_AVX2;
+    return ChecksumAddAVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    ChecksumImpl = ChecksumImplementation_SSE2;
+    return ChecksumAddSSE2;
+  }
+#endif
+  ChecksumImpl = ChecksumImplementation_SCALAR;
+  return ChecksumAddScalar;
+}
@@ -0,0 +1,121 @@
+#ifndef __CHECKSUM_H
+#define __CHECKSUM_H
+
+#include "structures.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief ChecksumImplementation_t
+ * Implementations of the ones-complement sum.
+ */
+typedef enum
+{
+  ChecksumImplementation_AUTO = 0,
+  ChecksumImplementation_SCALAR = 1,
+  ChecksumImplementation_SSE2 = 2,
+  ChecksumImplementation_AVX2 = 3
+} ChecksumImplementation_t;
+
+/**
+ * @brief ChecksumHint_t
+ * Checksum information reported by the kernel for the received packet (PACKET_AUXDATA on Linux).
+ */
+typedef enum
+{
+  ChecksumHint_NONE = 0,         //! No information, the packet must be verified
+  ChecksumHint_KERNEL_VALID = 1, //! The kernel (or NIC) already validated the checksum (TP_STATUS_CSUM_VALID)
+  ChecksumHint_NOT_READY = 2     //! Outgoing packet, the checksum will be computed by the NIC (TP_STATUS_CSUMNOTREADY)
+} ChecksumHint_t;
+
+/**
+ * @brief ChecksumStatus_t
+ * Result of the packet checksum verification.
+ */
+typedef enum
+{
+  ChecksumStatus_NOT_CHECKED = 0, //! Not an IPv4 packet, truncated packet, a fragment or no transport checksum
+  ChecksumStatus_VALID = 1,
+  ChecksumStatus_BAD_IP_HEADER = 2,
+  ChecksumStatus_BAD_TRANSPORT = 3,
+  ChecksumStatus_KERNEL_VALID = 4, //! Skipped, see ChecksumHint_KERNEL_VALID
+  ChecksumStatus_OFFLOADED = 5     //! Skipped, see ChecksumHint_NOT_READY
+} ChecksumStatus_t;
+
+/**
+ * @brief ChecksumStats_t
+ * Counters of the checksum verification.
+ */
+typedef struct
+{
+  uint64_t Verified;      //! Packets with the transport checksum verified in software
+  uint64_t BadIPHeader;   //! Packets with the bad IP header checksum
+  uint64_t BadICMP;       //! Packets with the bad ICMP checksum
+  uint64_t BadTCP;        //! Packets with the bad TCP checksum
+  uint64_t BadUDP;        //! Packets with the bad UDP checksum
+  uint64_t KernelValid;   //! Packets skipped, validated by the kernel
+  uint64_t Offloaded;     //! Packets skipped, the checksum is offloaded to the NIC
+  uint64_t NotChecked;    //! Packets which cannot be verified (fragments, truncated packets, no transport checksum)
+} ChecksumStats_t;
+
+/**
+ * @brief ChecksumSetImplementation
+ * Selects the implementation of the ones-complement sum. By default (ChecksumImplementation_AUTO) the fastest
+ * implementation supported by the CPU will be used.
+ * @param impl The implementation
+ * @return -1 if this implementation is not supported by the CPU, otherwise 0.
+ */
+int ChecksumSetImplementation(ChecksumImplementation_t impl);
+/**
+ * @brief ChecksumImplementationName
+ * @return The name of the currently used implementation.
+ */
+const char* ChecksumImplementationName();
+/**
+ * @brief ChecksumAdd
+ * Adds 16-bit words of the data to the ones-complement sum. Only the last chunk of the data may have an odd size.
+ * @param data The data
+ * @param size The data size
+ * @param sum The current sum (0 for the first chunk)
+ * @return The new sum. Use ChecksumFold() to get the 16-bit value.
+ */
+uint64_t ChecksumAdd(const void* data, size_t size, uint64_t sum);
+/**
+ * @brief ChecksumFold
+ * Folds the sum returned by ChecksumAdd() to 16 bits. The data with a valid checksum folds to 0xFFFF.
+ * @param sum The sum
+ * @return The folded sum.
+ */
+uint16_t ChecksumFold(uint64_t sum);
+/**
+ * @brief ChecksumVerifyIPHeader
+ * @param buf The pointer to the network packet without the ETH header
+ * @param size Size of the network packet
+ * @return true if the IP header checksum is valid.
+ */
+bool ChecksumVerifyIPHeader(Buffer_t buf, size_t size);
+/**
+ * @brief ChecksumVerifyPacket
+ * Verifies the IP header checksum and the ICMP, TCP or UDP checksum (header and payload) of the packet. Updates the
+ * passed counters.
+ * @param buf The pointer to the network packet without the ETH header
+ * @param size Size of the network packet
+ * @param hint The kernel information about the checksum
+ * @param stats The counters (may be NULL)
+ * @return The verification result.
+ */
+ChecksumStatus_t ChecksumVerifyPacket(Buffer_t buf, size_t size, ChecksumHint_t hint, ChecksumStats_t* stats);
+/**
+ * @brief ChecksumStatusToString
+ * @param status The verification result
+ * @return The string representation of the verification result.
+ */
+const char* ChecksumStatusToString(ChecksumStatus_t status);
+/**
+ * @brief ChecksumStatusIsBad
+ * @param status The verification result
+ * @return true if the packet has a bad checksum.
+ */
+bool ChecksumStatusIsBad(ChecksumStatus_t status);
+
+#endif // __CHECKSUM_H
@@ -1,11 +1,29 @@
 #include "cmdargs.h"
 
 #include "utils.h"
+#include "output.h"
+#include "formatpool.h"
+#include "recorder.h"
+#include "storage.h"
 
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#define FLUSH_INTERVAL_MAX_MS 60000
+#define FLUSH_SIZE_MAX (64 * 1024 * 1024)
+#define PAYLOAD_BYTES_MAX 65535
+#define SAMPLING_RATIO_MAX 1000000000
+#define MAX_RATE_MAX 10000000
+#define STATS_INTERVAL_MAX_SEC 3600
+#define FLIGHT_RECORDER_WINDOW_MAX_SEC 86400
+
+static int ParseUnsignedArg(
+    const char* name, const char* value, uint64_t min, uint64_t max, uint64_t* result, char** error);
+static int ParseSizeArg(
+    const char* name, const char* value, uint64_t min, uint64_t max, uint64_t* result, char** error);
+static int ParseFlightRecorderArg(const char* value, uint64_t* size, uint64_t* windowSec, char** error);
+
 ParseArgsReturnCode_t ParseCommandLineArgs(int argc, char** argv, CmdArgs_t* args, char** error)
 {
   if (args == NULL) {
@@ -16,6 +34,37 @@ ParseArgsReturnCode_t ParseCommandLineArgs(int argc, char** argv, CmdArgs_t* arg
   args->PromiscMode = false;
   args->IncludeETHHeader = false;
 #endif
+  args->VerifyChecksums = false;
+  args->BadChecksumsOnly = false;
+  args->DecodeDns = false;
+  args->DecodeHttp = false;
+  args->DecodeTls = false;
+  args->AnalyzeTcp = false;
+  args->HexAscii = false;
+  args->Format = OutputFormat_TEXT;
+  args->PayloadBytes = 0;
+  args->FormatThreads = 0;
+  args->SampleFlows = 0;
+  args->SampleEvery = 0;
+  args->SampleRandom = 0;
+  args->MaxRate = 0;
+  args->OutputStats = false;
+  args->Profile = false;
+  args->StatsIntervalSec = 0;
+#ifdef __linux__
+  args->MetricsAddress[0] = '\0';
+  args->ControlPath[0] = '\0';
+  args->FlightRecorderSize = 0;
+  args->FlightRecorderWindowSec = 0;
+  args->DumpOnRst = false;
+  args->DumpOnRstPort = 0;
+  args->StorePath[0] = '\0';
+  args->StoreSegmentSize = STORAGE_SEGMENT_DEFAULT_SIZE;
+  args->StoreCompressThreads = 0;
+#endif
+  args->FlushIntervalMs = OUTPUT_DEFAULT_FLUSH_INTERVAL_MS;
+  args->FlushSize = OUTPUT_DEFAULT_BLOCK_SIZE;
+  args->RulesPath[0] = '\0';
   args->Interface[0] = '\0';
 
   for (int i = 0; i < ADDRESSES_MAX_COUNT; ++i)
@@ -32,6 +81,132 @@ ParseArgsReturnCode_t ParseCommandLineArgs(int argc, char** argv, CmdArgs_t* arg
     } else if (strcmp(arg, "-include-eth-header") == 0) {
       args->IncludeETHHeader = true;
 #endif
+    } else if (strcmp(arg, "-verify-checksums") == 0) {
+      args->VerifyChecksums = true;
+    } else if (strcmp(arg, "-bad-checksums-only") == 0) {
+      args->VerifyChecksums = true;
+      args->BadChecksumsOnly = true;
+    } else if (strcmp(arg, "-dns") == 0) {
+      args->DecodeDns = true;
+    } else if (strcmp(arg, "-http") == 0) {
+      args->DecodeHttp = true;
+    } else if (strcmp(arg, "-tls") == 0) {
+      args->DecodeTls = true;
+    } else if (strcmp(arg, "-tcp-analysis") == 0) {
+      args->AnalyzeTcp = true;
+    } else if (strcmp(arg, "-hex-ascii") == 0) {
+      args->HexAscii = true;
+    } else if (strcmp(arg, "-brief") == 0) {
+      args->Format = OutputFormat_BRIEF;
+    } else if (strcmp(arg, "-stats") == 0) {
+      args->Format = OutputFormat_STATS;
+    } else if (strcmp(arg, "-format") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : "";
+      if (strcmp(value, "text") == 0)
+        args->Format = OutputFormat_TEXT;
+      else if (strcmp(value, "brief") == 0)
+        args->Format = OutputFormat_BRIEF;
+      else if (strcmp(value, "json") == 0)
+        args->Format = OutputFormat_JSON;
+      else if (strcmp(value, "bin") == 0)
+        args->Format = OutputFormat_BINARY;
+      else {
+        FormatStringBuffer(error, "Invalid output format '%s' (text, brief, json or bin).", value);
+        return CmdArgs_ERROR;
+      }
+    } else if (strcmp(arg, "-payload-bytes") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 0, PAYLOAD_BYTES_MAX, &args->PayloadBytes, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-format-threads") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 0, FORMAT_POOL_THREADS_MAX, &args->FormatThreads, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-sample") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 1, SAMPLING_RATIO_MAX, &args->SampleEvery, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-sample-random") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 1, SAMPLING_RATIO_MAX, &args->SampleRandom, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-sample-flows") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 1, SAMPLING_RATIO_MAX, &args->SampleFlows, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-max-rate") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 1, MAX_RATE_MAX, &args->MaxRate, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-output-stats") == 0) {
+      args->OutputStats = true;
+    } else if (strcmp(arg, "-profile") == 0) {
+#ifdef PROFILING_ENABLED
+      args->Profile = true;
+#else
+      FormatStringBuffer(error, "Profiling is not available, the binary is built without PROFILING_ENABLED.");
+      return CmdArgs_ERROR;
+#endif
+    } else if (strcmp(arg, "-stats-interval") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 1, STATS_INTERVAL_MAX_SEC, &args->StatsIntervalSec, error) < 0)
+        return CmdArgs_ERROR;
+#ifdef __linux__
+    } else if (strcmp(arg, "-metrics") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : "";
+      if (strlen(value) == 0 || strlen(value) >= METRICS_ADDRESS_MAX_SIZE) {
+        FormatStringBuffer(error, "Invalid metrics address '%s' (IP:PORT, PORT or the unix socket path).", value);
+        return CmdArgs_ERROR;
+      }
+      strncpy(args->MetricsAddress, value, METRICS_ADDRESS_MAX_SIZE);
+    } else if (strcmp(arg, "-control") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : "";
+      if (strlen(value) == 0 || strlen(value) >= CONTROL_PATH_MAX_SIZE) {
+        FormatStringBuffer(error, "Invalid path of the control socket '%s'.", value);
+        return CmdArgs_ERROR;
+      }
+      strncpy(args->ControlPath, value, CONTROL_PATH_MAX_SIZE);
+    } else if (strcmp(arg, "-flight-recorder") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseFlightRecorderArg(value, &args->FlightRecorderSize, &args->FlightRecorderWindowSec, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-dump-on-rst") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 0, UINT16_MAX, &args->DumpOnRstPort, error) < 0)
+        return CmdArgs_ERROR;
+      args->DumpOnRst = true;
+    } else if (strcmp(arg, "-store") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (value == NULL || strlen(value) == 0 || strlen(value) >= STORAGE_PATH_MAX_SIZE) {
+        FormatStringBuffer(error, "Invalid storage directory: '%s'.", value != NULL ? value : "");
+        return CmdArgs_ERROR;
+      }
+      strncpy(args->StorePath, value, STORAGE_PATH_MAX_SIZE);
+    } else if (strcmp(arg, "-store-segment") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseSizeArg(
+              arg, value, STORAGE_SEGMENT_MIN_SIZE, STORAGE_SEGMENT_MAX_SIZE, &args->StoreSegmentSize, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-store-compress") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 1, COMPRESS_THREADS_MAX, &args->StoreCompressThreads, error) < 0)
+        return CmdArgs_ERROR;
+#endif
+    } else if (strcmp(arg, "-flush-interval") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 0, FLUSH_INTERVAL_MAX_MS, &args->FlushIntervalMs, error) < 0)
+        return CmdArgs_ERROR;
+    } else if (strcmp(arg, "-rules") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : "";
+      if (strlen(value) == 0 || strlen(value) >= RULES_PATH_MAX_SIZE) {
+        FormatStringBuffer(error, "Invalid rules file '%s'.", value);
+        return CmdArgs_ERROR;
+      }
+      strncpy(args->RulesPath, value, RULES_PATH_MAX_SIZE);
+    } else if (strcmp(arg, "-flush-size") == 0) {
+      const char* value = i + 1 < argc ? argv[++i] : NULL;
+      if (ParseUnsignedArg(arg, value, 1, FLUSH_SIZE_MAX, &args->FlushSize, error) < 0)
+        return CmdArgs_ERROR;
     } else {
       if ((char*) strstr(arg, ":") == NULL) {
         if (strlen(args->Interface) == 0)
@@ -47,7 +222,15 @@ ParseArgsReturnCode_t ParseCommandLineArgs(int argc, char** argv, CmdArgs_t* arg
             args->Filters[args->AddressesCount].Protocol = Protocol_UDP;
           else if (strcmp(arg, "icmp") == 0)
             args->Filters[args->AddressesCount].Protocol = Protocol_ICMP;
-          else {
+          else if (strcmp(arg, "sni") == 0) {
+            if (i + 1 >= argc || strlen(argv[i + 1]) >= SNI_PATTERN_MAX_SIZE) {
+              FormatStringBuffer(error, "Invalid or missing server name pattern after 'sni'.");
+              return CmdArgs_ERROR;
+            }
+            // the server name is sent only over TCP
+            strncpy(args->Filters[args->AddressesCount].SNI, argv[++i], SNI_PATTERN_MAX_SIZE);
+            args->Filters[args->AddressesCount].Protocol = Protocol_TCP;
+          } else {
             FormatStringBuffer(error, "Invalid filter option: %s", arg);
             return CmdArgs_ERROR;
           }
@@ -69,7 +252,19 @@ ParseArgsReturnCode_t ParseCommandLineArgs(int argc, char** argv, CmdArgs_t* arg
     return CmdArgs_ERROR;
   }
 
-  if (args->AddressesCount == 0) {
+#ifdef __linux__
+  if (args->DumpOnRst && args->FlightRecorderSize == 0) {
+    FormatStringBuffer(error, "-dump-on-rst requires -flight-recorder.");
+    return CmdArgs_ERROR;
+  }
+#endif
+
+  // rules may be added by the control socket
+  bool rulesChangeable = strlen(args->RulesPath) > 0;
+#ifdef __linux__
+  rulesChangeable = rulesChangeable || strlen(args->ControlPath) > 0;
+#endif
+  if (args->AddressesCount == 0 && !rulesChangeable) {
     FormatStringBuffer(error, "No addresses specified.");
     return CmdArgs_ERROR;
   }
@@ -90,6 +285,39 @@ void PrintHelp()
 #ifdef __linux__
                         "\t-enable-promisc-mode      \t\tEnable the promiscious mode on the interface. \n"
                         "\t-include-eth-header       \t\tShow the Ethernet header of each packet. \n"
+#endif
+                        "\t-verify-checksums         \t\tVerify IP, ICMP, TCP and UDP checksums of each packet. \n"
+                        "\t-bad-checksums-only       \t\tShow only packets with bad checksums. \n"
+                        "\t-dns                      \t\tDecode DNS messages (UDP port 53), show resolution latency. \n"
+                        "\t-http                     \t\tDecode HTTP/1.x request and status lines, show response time. \n"
+                        "\t-tls                      \t\tDecode TLS ClientHello (SNI, ALPN, version), count SNIs. \n"
+                        "\t-tcp-analysis             \t\tShow TCP RTT, retransmissions, dup ACKs and zero windows. \n"
+                        "\t-hex-ascii                \t\tShow printable characters next to the hex dump of the data. \n"
+                        "\t-brief                    \t\tShow one line per packet (time, protocol, addresses, flags). \n"
+                        "\t-format FORMAT            \t\tOutput format: text, brief, json (JSON Lines) or bin (records). \n"
+                        "\t-stats                    \t\tShow rates by protocol, direction, address and size instead of packets. \n"
+                        "\t-payload-bytes N          \t\tInclude up to N bytes of the payload in json and bin records. \n"
+                        "\t-format-threads N         \t\tFormat text records by N threads, records keep the capture order. \n"
+                        "\t-sample N                 \t\tPrint every N-th packet. \n"
+                        "\t-sample-random N          \t\tPrint packets with the probability 1/N. \n"
+                        "\t-sample-flows N           \t\tPrint all packets of 1 of N flows (decoders see whole flows). \n"
+                        "\t-max-rate N               \t\tPrint at most N packets per second. \n"
+                        "\t-flush-interval MS        \t\tMax time before the output is written (default: 100 ms). \n"
+                        "\t-flush-size BYTES         \t\tSize of output blocks, full blocks are written at once. \n"
+                        "\t-rules FILE               \t\tMatch packets with addresses of the file, reloaded on change or SIGHUP. \n"
+                        "\t-output-stats             \t\tShow bytes written, flush latency, blocked time and time of stages on exit. \n"
+#ifdef PROFILING_ENABLED
+                        "\t-profile                  \t\tShow p50, p99 and p999 time of receive, filter, format and output on exit. \n"
+#endif
+                        "\t-stats-interval SEC       \t\tPrint received, handled and dropped packets to stderr. \n"
+#ifdef __linux__
+                        "\t-metrics ADDR             \t\tServe Prometheus /metrics on IP:PORT, PORT (127.0.0.1) or a unix socket. \n"
+                        "\t-control PATH             \t\tAccept commands on the unix socket: add, remove, list, stats, pcap, dump. \n"
+                        "\t-flight-recorder SIZE|SECs\t\tKeep the last packets in memory (64M, 1G or 30s), dump them on SIGUSR2. \n"
+                        "\t-dump-on-rst PORT         \t\tDump the flight recorder on TCP RST to the port (0 - any port). \n"
+                        "\t-store DIR                \t\tWrite packets to indexed pcap segments of the directory (netsniffer-query). \n"
+                        "\t-store-segment SIZE       \t\tMax size of each segment of -store (256M by default). \n"
+                        "\t-store-compress THREADS   \t\tCompress segments of -store in blocks by the threads. \n"
 #endif
                         "\n"
                         "To sniffing from any IP and port, use address: any:0.\n"
@@ -97,6 +325,7 @@ void PrintHelp()
                         "Available filters: \n"
                         "\tProtocols: [tcp (TCP), udp (UDP), icmp (ICMP)].\n"
                         "\tDirection: [src (Source), dst (Destination)].\n"
+                        "\tTLS server name: [sni PATTERN (for example: sni *.example.com)].\n"
 #ifdef _WIN32
                         "On Windows to sniff from localhost set the interface index as 0.\n"
 #endif
@@ -117,3 +346,82 @@ void PrintHelp()
                         "\n";
   printf("%s", message);
 }
+
+int ParseUnsignedArg(const char* name, const char* value, uint64_t min, uint64_t max, uint64_t* result, char** error)
+{
+  char* endptr = NULL;
+  unsigned long long parsed = value != NULL ? strtoull(value, &endptr, 10) : 0;
+  if (value == NULL || *value == '\0' || *value == '-' || *endptr != '\0' || parsed < min || parsed > max) {
+    FormatStringBuffer(error,
+                       "Invalid value of '%s': '%s' (min value: %llu, max value: %llu).",
+                       name,
+                       value != NULL ? value : "",
+                       (unsigned long long) min,
+                       (unsigned long long) max);
+    return -1;
+  }
+
+  *result = parsed;
+  return 0;
+}
+
+int ParseSizeArg(const char* name, const char* value, uint64_t min, uint64_t max, uint64_t* result, char** error)
+{
+  // bytes with the optional suffix: K, M or G
+  char* endptr = NULL;
+  unsigned long long parsed = value != NULL ? strtoull(value, &endptr, 10) : 0;
+  unsigned long long multiplier = 0;
+  if (value != NULL && *value != '\0' && *value != '-' && endptr != value && (*endptr == '\0' || endptr[1] == '\0')) {
+    switch (*endptr) {
+    case '\0':
+      multiplier = 1;
+      break;
+    case 'K':
+    case 'k':
+      multiplier = 1024ULL;
+      break;
+    case 'M':
+    case 'm':
+      multiplier = 1024ULL * 1024;
+      break;
+    case 'G':
+    case 'g':
+      multiplier = 1024ULL * 1024 * 1024;
+      break;
+    default:
+      break;
+    }
+  }
+  if (multiplier == 0 || parsed > max / multiplier || parsed * multiplier < min) {
+    FormatStringBuffer(error,
+                       "Invalid size of '%s': '%s' (min value: %llu, max value: %llu bytes).",
+                       name,
+                       value != NULL ? value : "",
+                       (unsigned long long) min,
+                       (unsigned long long) max);
+    return -1;
+  }
+  *result = parsed * multiplier;
+  return 0;
+}
+
+int ParseFlightRecorderArg(const char* value, uint64_t* size, uint64_t* windowSec, char** error)
+{
+  // the window of seconds is kept in the arena of the default size
+  size_t length = value != NULL ? strlen(value) : 0;
+  if (length > 0 && value[length - 1] == 's') {
+    char* endptr = NULL;
+    unsigned long long parsed = strtoull(value, &endptr, 10);
+    if (*value == '-' || endptr == value || *endptr != 's' || parsed < 1 || parsed > FLIGHT_RECORDER_WINDOW_MAX_SEC) {
+      FormatStringBuffer(
+          error, "Invalid seconds of '-flight-recorder': '%s' (max: %d).", value, FLIGHT_RECORDER_WINDOW_MAX_SEC);
+      return -1;
+    }
+    *size = RECORDER_DEFAULT_SIZE;
+    *windowSec = parsed;
+    return 0;
+  }
+
+  *windowSec = 0;
+  return ParseSizeArg("-flight-recorder", value, RECORDER_MIN_SIZE, RECORDER_MAX_SIZE, size, error);
+}
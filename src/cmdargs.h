@@ -2,8 +2,13 @@
 #define __CMDARGS_H
 
 #include "structures.h"
+#include "metrics.h"
+#include "control.h"
+#include "storage.h"
 #include <stdbool.h>
 
+#define RULES_PATH_MAX_SIZE 1024
+
 /**
  * @brief ParseArgsReturnCode_t
  * Result codes of parsing command line arguments.
@@ -14,6 +19,18 @@ typedef enum
   CmdArgs_SUCCESS = 0,
   CmdArgs_PRINT_HELP = 1
 } ParseArgsReturnCode_t;
+/**
+ * @brief OutputFormat_t
+ * Formats of the packet output.
+ */
+typedef enum
+{
+  OutputFormat_TEXT = 0, //! Headers and the hex dump of the data
+  OutputFormat_BRIEF,    //! One line per packet
+  OutputFormat_JSON,     //! JSON Lines
+  OutputFormat_BINARY,   //! Binary records (see PacketRecord_t)
+  OutputFormat_STATS     //! No packets, the dashboard of traffic rates (see TrafficStats_t)
+} OutputFormat_t;
 /**
  * @brief CmdArgs_t
  * Stores arguments from command line.
@@ -24,6 +41,37 @@ typedef struct
   bool PromiscMode;
   bool IncludeETHHeader;
 #endif
+  bool VerifyChecksums;
+  bool BadChecksumsOnly;
+  bool DecodeDns;
+  bool DecodeHttp;
+  bool DecodeTls;
+  bool AnalyzeTcp;
+  bool HexAscii;
+  OutputFormat_t Format;
+  uint64_t PayloadBytes;
+  uint64_t FormatThreads;
+  uint64_t SampleFlows;
+  uint64_t SampleEvery;
+  uint64_t SampleRandom;
+  uint64_t MaxRate;
+  bool OutputStats;
+  bool Profile; //! Only with PROFILING_ENABLED
+  uint64_t StatsIntervalSec;
+#ifdef __linux__
+  char MetricsAddress[METRICS_ADDRESS_MAX_SIZE]; //! Empty if the metrics endpoint is disabled
+  char ControlPath[CONTROL_PATH_MAX_SIZE];       //! Empty if the control socket is disabled
+  uint64_t FlightRecorderSize;                   //! Size of the arena (0 if the flight recorder is disabled)
+  uint64_t FlightRecorderWindowSec;              //! Seconds before the trigger in dumps (0 - the whole arena)
+  bool DumpOnRst;                                //! Dump the flight recorder on TCP RST to DumpOnRstPort
+  uint64_t DumpOnRstPort;                        //! 0 - any port
+  char StorePath[STORAGE_PATH_MAX_SIZE];         //! Empty if the indexed storage is disabled
+  uint64_t StoreSegmentSize;                     //! Max bytes of each segment of the storage
+  uint64_t StoreCompressThreads;                 //! Threads compressing segments (0 - segments are not compressed)
+#endif
+  uint64_t FlushIntervalMs;
+  uint64_t FlushSize;
+  char RulesPath[RULES_PATH_MAX_SIZE]; //! Empty if addresses are not loaded from the rules file
   char Interface[IFACE_MAX_SIZE];
   Filter_t Filters[ADDRESSES_MAX_COUNT];
   char Addresses[ADDRESSES_MAX_COUNT][ADDRESS_MAX_SIZE];
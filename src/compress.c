@@ -0,0 +1,382 @@
+#include "compress.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#elif _WIN32
+#include <io.h>
+#endif
+
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5 // the last bytes are always literals
+#define LZ_MATCH_LIMIT 12  // the last match starts before it, so 4-byte reads never pass the end
+#define LZ_MAX_OFFSET 65535
+#define LZ_SKIP_TRIGGER 6 // the search step grows after 2^6 misses, incompressible data is skipped faster
+#define LZ_RUN_MASK 15
+
+static uint32_t Read32(const uint8_t* p);
+static uint32_t HashSequence(uint32_t sequence);
+static bool WriteLength(uint8_t** op, const uint8_t* oend, size_t length);
+static bool ReadLength(const uint8_t** ip, const uint8_t* iend, size_t* length);
+static void CompressJob(size_t slot, size_t worker, void* args);
+static void WriteJob(size_t slot, size_t worker, void* args);
+static bool WriteFully(int fd, const void* data, size_t size);
+static void CloseFile(int fd);
+
+size_t LzCompressBound(size_t size)
+{
+  return size + size / 255 + 16;
+}
+
+size_t LzCompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity, uint32_t* table)
+{
+  const uint8_t* ip = src;
+  const uint8_t* anchor = src;
+  const uint8_t* end = src + size;
+  uint8_t* op = dst;
+  const uint8_t* oend = dst + capacity;
+
+  if (size > LZ_MATCH_LIMIT) {
+    const uint8_t* mflimit = end - LZ_MATCH_LIMIT;
+    const uint8_t* matchlimit = end - LZ_LAST_LITERALS;
+    // positions of the previous block are not valid, the empty entry is the position 0
+    memset(table, 0, sizeof(uint32_t) << COMPRESS_HASH_LOG);
+    size_t misses = 0;
+    ip++;
+    while (ip < mflimit) {
+      uint32_t sequence = Read32(ip);
+      uint32_t hash = HashSequence(sequence);
+      const uint8_t* ref = src + table[hash];
+      table[hash] = (uint32_t) (ip - src);
+      if (ref >= ip || (size_t) (ip - ref) > LZ_MAX_OFFSET || Read32(ref) != sequence) {
+        ip += 1 + (misses++ >> LZ_SKIP_TRIGGER);
+        continue;
+      }
+      misses = 0;
+
+      while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+        ip--;
+        ref--;
+      }
+      const uint8_t* matchEnd = ip + LZ_MIN_MATCH;
+      const uint8_t* refEnd = ref + LZ_MIN_MATCH;
+      while (matchEnd < matchlimit && *matchEnd == *refEnd) {
+        matchEnd++;
+        refEnd++;
+      }
+
+      // the token, literals, the offset and the match length
+      size_t literals = (size_t) (ip - anchor);
+      size_t matchLength = (size_t) (matchEnd - ip) - LZ_MIN_MATCH;
+      if (op >= oend || (size_t) (oend - op) < 1 + literals / 255 + 1 + literals + 2)
+        return 0;
+      uint8_t* token = op++;
+      *token = (uint8_t) ((literals < LZ_RUN_MASK ? literals : LZ_RUN_MASK) << 4);
+      if (literals >= LZ_RUN_MASK && !WriteLength(&op, oend, literals - LZ_RUN_MASK))
+        return 0;
+      memcpy(op, anchor, literals);
+      op += literals;
+      uint16_t offset = (uint16_t) (ip - ref);
+      *op++ = (uint8_t) (offset & 0xFF);
+      *op++ = (uint8_t) (offset >> 8);
+      *token |= (uint8_t) (matchLength < LZ_RUN_MASK ? matchLength : LZ_RUN_MASK);
+      if (matchLength >= LZ_RUN_MASK && !WriteLength(&op, oend, matchLength - LZ_RUN_MASK))
+        return 0;
+
+      ip = matchEnd;
+      anchor = ip;
+      if (ip < mflimit)
+        table[HashSequence(Read32(ip - 2))] = (uint32_t) (ip - 2 - src);
+    }
+  }
+
+  // the last sequence has only literals
+  size_t literals = (size_t) (end - anchor);
+  if (op >= oend || (size_t) (oend - op) < 1 + literals / 255 + 1 + literals)
+    return 0;
+  uint8_t* token = op++;
+  *token = (uint8_t) ((literals < LZ_RUN_MASK ? literals : LZ_RUN_MASK) << 4);
+  if (literals >= LZ_RUN_MASK && !WriteLength(&op, oend, literals - LZ_RUN_MASK))
+    return 0;
+  memcpy(op, anchor, literals);
+  op += literals;
+  return (size_t) (op - dst);
+}
+
+int64_t LzDecompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity)
+{
+  const uint8_t* ip = src;
+  const uint8_t* iend = src + size;
+  uint8_t* op = dst;
+  const uint8_t* oend = dst + capacity;
+
+  while (ip < iend) {
+    uint8_t token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == LZ_RUN_MASK && !ReadLength(&ip, iend, &literals))
+      return -1;
+    if (literals > (size_t) (iend - ip) || literals > (size_t) (oend - op))
+      return -1;
+    memcpy(op, ip, literals);
+    op += literals;
+    ip += literals;
+    // the last sequence has no match
+    if (ip == iend)
+      break;
+
+    if (iend - ip < 2)
+      return -1;
+    size_t offset = (size_t) ip[0] | ((size_t) ip[1] << 8);
+    ip += 2;
+    size_t matchLength = token & LZ_RUN_MASK;
+    if (matchLength == LZ_RUN_MASK && !ReadLength(&ip, iend, &matchLength))
+      return -1;
+    matchLength += LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t) (op - dst) || matchLength > (size_t) (oend - op))
+      return -1;
+
+    // the match overlaps the output if the offset is shorter than the match
+    const uint8_t* ref = op - offset;
+    if (offset >= matchLength)
+      memcpy(op, ref, matchLength);
+    else
+      for (size_t i = 0; i < matchLength; ++i)
+        op[i] = ref[i];
+    op += matchLength;
+  }
+  return (int64_t) (op - dst);
+}
+
+void CompressFileHeaderInit(CompressFileHeader_t* header, uint32_t blockSize)
+{
+  header->Magic = COMPRESS_FILE_MAGIC;
+  header->Version = COMPRESS_VERSION;
+  header->BlockSize = blockSize;
+  header->__reserved = 0;
+}
+
+int64_t CompressListBlocks(const uint8_t* data, size_t size, CompressBlock_t** blocks, size_t* capacity)
+{
+  CompressFileHeader_t file;
+  if (size < sizeof(file))
+    return -1;
+  memcpy(&file, data, sizeof(file));
+  if (file.Magic != COMPRESS_FILE_MAGIC || file.Version != COMPRESS_VERSION || file.BlockSize == 0 ||
+      file.BlockSize > COMPRESS_BLOCK_MAX_SIZE)
+    return -1;
+
+  // blocks are written in order, the first invalid frame ends the file
+  size_t count = 0;
+  uint64_t offset = sizeof(file), rawOffset = 0;
+  while (offset + sizeof(CompressFrameHeader_t) <= size) {
+    CompressFrameHeader_t frame;
+    memcpy(&frame, data + offset, sizeof(frame));
+    bool compressed = (frame.Flags & COMPRESS_FRAME_COMPRESSED) != 0;
+    size_t maxSize = compressed ? LzCompressBound(frame.RawSize) : frame.RawSize;
+    if (frame.Magic != COMPRESS_FRAME_MAGIC || frame.RawOffset != rawOffset || frame.RawSize == 0 ||
+        frame.RawSize > file.BlockSize || frame.Size > maxSize || (!compressed && frame.Size != frame.RawSize) ||
+        offset + sizeof(frame) + frame.Size > size)
+      break;
+
+    if (count == *capacity) {
+      *capacity = *capacity == 0 ? 64 : *capacity * 2;
+      *blocks = realloc(*blocks, sizeof(CompressBlock_t) * *capacity);
+      ASSERT("Cannot initialize a new buffer: realloc returned size '0'.", *blocks != NULL);
+    }
+    CompressBlock_t* block = &(*blocks)[count++];
+    block->RawOffset = frame.RawOffset;
+    block->FileOffset = offset + sizeof(frame);
+    block->RawSize = frame.RawSize;
+    block->Size = frame.Size;
+    block->Compressed = compressed;
+    offset += sizeof(frame) + frame.Size;
+    rawOffset += frame.RawSize;
+  }
+  return (int64_t) count;
+}
+
+void CompressPoolInit(CompressPool_t* p, size_t threads, size_t blockSize)
+{
+  ASSERT("Cannot init pool ('CompressPool_t'): p == NULL.", p != NULL);
+
+  p->Blocks = 0;
+  p->StoredBlocks = 0;
+  p->RawBytes = 0;
+  p->Bytes = 0;
+  p->WriteErrors = 0;
+  memset(p->Workers, 0, sizeof(p->Workers));
+
+  threads = threads > COMPRESS_THREADS_MAX ? COMPRESS_THREADS_MAX : threads;
+  SlotPoolInit(&p->Slots, threads, threads * COMPRESS_JOBS_PER_THREAD, CompressJob, WriteJob, p);
+  p->__blockSize = blockSize > COMPRESS_BLOCK_MAX_SIZE ? COMPRESS_BLOCK_MAX_SIZE : blockSize;
+  p->__slot = 0;
+  // blocks of the window are allocated once, workers never allocate
+  size_t tables = threads > 0 ? threads : 1;
+  p->__tables = malloc((sizeof(uint32_t) << COMPRESS_HASH_LOG) * tables);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", p->__tables != NULL);
+  p->__jobs = malloc(sizeof(CompressJob_t) * p->Slots.Window);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", p->__jobs != NULL);
+  for (size_t i = 0; i < p->Slots.Window; ++i) {
+    p->__jobs[i].Input = malloc(p->__blockSize);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", p->__jobs[i].Input != NULL);
+    p->__jobs[i].Output = malloc(LzCompressBound(p->__blockSize));
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", p->__jobs[i].Output != NULL);
+    p->__jobs[i].InputSize = 0;
+    p->__jobs[i].OutputSize = 0;
+    p->__jobs[i].Fd = -1;
+    p->__jobs[i].RawOffset = 0;
+    p->__jobs[i].Close = false;
+  }
+}
+
+int CompressPoolStart(CompressPool_t* p)
+{
+  return SlotPoolStart(&p->Slots);
+}
+
+uint8_t* CompressPoolAcquire(CompressPool_t* p)
+{
+  p->__slot = SlotPoolAcquire(&p->Slots);
+  return p->__jobs[p->__slot].Input;
+}
+
+void CompressPoolSubmit(CompressPool_t* p, size_t size, int fd, uint64_t rawOffset, bool close)
+{
+  CompressJob_t* job = &p->__jobs[p->__slot];
+  job->InputSize = size;
+  job->OutputSize = 0;
+  job->Fd = fd;
+  job->RawOffset = rawOffset;
+  job->Close = close;
+  SlotPoolSubmit(&p->Slots);
+}
+
+void CompressPoolStop(CompressPool_t* p)
+{
+  SlotPoolStop(&p->Slots);
+}
+
+void CompressPoolClear(CompressPool_t* p)
+{
+  if (p == NULL)
+    return;
+
+  for (size_t i = 0; i < p->Slots.Window; ++i) {
+    free(p->__jobs[i].Input);
+    free(p->__jobs[i].Output);
+  }
+  free(p->__jobs);
+  free(p->__tables);
+  SlotPoolClear(&p->Slots);
+}
+
+uint32_t Read32(const uint8_t* p)
+{
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+uint32_t HashSequence(uint32_t sequence)
+{
+  return (sequence * 2654435761U) >> (32 - COMPRESS_HASH_LOG);
+}
+
+bool WriteLength(uint8_t** op, const uint8_t* oend, size_t length)
+{
+  // the length is continued by bytes 255 and ends with the byte below 255
+  if ((size_t) (oend - *op) < length / 255 + 1)
+    return false;
+  for (; length >= 255; length -= 255)
+    *(*op)++ = 255;
+  *(*op)++ = (uint8_t) length;
+  return true;
+}
+
+bool ReadLength(const uint8_t** ip, const uint8_t* iend, size_t* length)
+{
+  uint8_t byte;
+  do {
+    if (*ip >= iend || *length > SIZE_MAX / 2)
+      return false;
+    byte = *(*ip)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+void CompressJob(size_t slot, size_t worker, void* args)
+{
+  CompressPool_t* p = (CompressPool_t*) args;
+  CompressJob_t* job = &p->__jobs[slot];
+  if (job->InputSize == 0)
+    return;
+
+  // the block is stored if it does not get smaller
+  uint64_t start = GetMonotonicTimeUs();
+  uint32_t* table = p->__tables + ((size_t) worker << COMPRESS_HASH_LOG);
+  job->OutputSize = LzCompress(job->Input, job->InputSize, job->Output, job->InputSize - 1, table);
+  // the counters are only changed by the thread
+  CompressWorkerStats_t* stats = &p->Workers[worker];
+  stats->Blocks++;
+  stats->RawBytes += job->InputSize;
+  stats->CompressedBytes += job->OutputSize > 0 ? job->OutputSize : job->InputSize;
+  stats->BusyUs += GetMonotonicTimeUs() - start;
+}
+
+void WriteJob(size_t slot, size_t worker, void* args)
+{
+  (void) worker;
+
+  CompressPool_t* p = (CompressPool_t*) args;
+  CompressJob_t* job = &p->__jobs[slot];
+  if (job->InputSize > 0) {
+    CompressFrameHeader_t frame;
+    frame.Magic = COMPRESS_FRAME_MAGIC;
+    frame.Flags = job->OutputSize > 0 ? COMPRESS_FRAME_COMPRESSED : 0;
+    frame.RawOffset = job->RawOffset;
+    frame.RawSize = (uint32_t) job->InputSize;
+    frame.Size = (uint32_t) (job->OutputSize > 0 ? job->OutputSize : job->InputSize);
+    const uint8_t* data = job->OutputSize > 0 ? job->Output : job->Input;
+    if (WriteFully(job->Fd, &frame, sizeof(frame)) && WriteFully(job->Fd, data, frame.Size)) {
+      p->Blocks++;
+      p->StoredBlocks += job->OutputSize == 0;
+      p->RawBytes += job->InputSize;
+      p->Bytes += sizeof(frame) + frame.Size;
+    } else
+      p->WriteErrors++;
+  }
+  if (job->Close && job->Fd >= 0)
+    CloseFile(job->Fd);
+}
+
+bool WriteFully(int fd, const void* data, size_t size)
+{
+  size_t written = 0;
+  while (written < size) {
+#ifdef __linux__
+    ssize_t rc = write(fd, (const uint8_t*) data + written, size - written);
+    if (rc < 0 && errno == EINTR)
+      continue;
+#elif _WIN32
+    int rc = _write(fd, (const uint8_t*) data + written, (unsigned int) (size - written));
+#endif
+    if (rc <= 0)
+      return false;
+    written += (size_t) rc;
+  }
+  return true;
+}
+
+void CloseFile(int fd)
+{
+#ifdef __linux__
+  close(fd);
+#elif _WIN32
+  _close(fd);
+#endif
+}
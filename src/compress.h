@@ -0,0 +1,201 @@
+#ifndef __COMPRESS_H
+#define __COMPRESS_H
+
+#include "slotpool.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPRESS_THREADS_MAX 64
+#define COMPRESS_JOBS_PER_THREAD 4
+#define COMPRESS_BLOCK_MAX_SIZE (16 * 1024 * 1024)
+#define COMPRESS_HASH_LOG 14
+#define COMPRESS_FILE_MAGIC 0x465A534E  // "NSZF"
+#define COMPRESS_FRAME_MAGIC 0x425A534E // "NSZB"
+#define COMPRESS_VERSION 1
+#define COMPRESS_FRAME_COMPRESSED 0x1
+
+/**
+ * @brief CompressFileHeader_t
+ * The header of the compressed file. It is followed by frames: the frame header and the block (compressed or stored).
+ * Blocks are independent, each frame header has the offset of its block in the uncompressed data, so the reader finds
+ * the block of any offset by frame headers and decompresses only that block.
+ */
+typedef struct
+{
+  uint32_t Magic;     //! COMPRESS_FILE_MAGIC
+  uint32_t Version;   //! COMPRESS_VERSION
+  uint32_t BlockSize; //! Max uncompressed bytes of the block
+  uint32_t __reserved;
+} CompressFileHeader_t;
+
+/**
+ * @brief CompressFrameHeader_t
+ * The header of the block.
+ */
+typedef struct
+{
+  uint32_t Magic;     //! COMPRESS_FRAME_MAGIC
+  uint32_t Flags;     //! COMPRESS_FRAME_COMPRESSED if the block is compressed, otherwise it is stored
+  uint64_t RawOffset; //! Offset of the block in the uncompressed data
+  uint32_t RawSize;   //! Uncompressed bytes of the block
+  uint32_t Size;      //! Bytes of the block in the file
+} CompressFrameHeader_t;
+
+/**
+ * @brief CompressBlock_t
+ * The block of the compressed file found by CompressListBlocks().
+ */
+typedef struct
+{
+  uint64_t RawOffset;  //! Offset of the block in the uncompressed data
+  uint64_t FileOffset; //! Offset of the block in the file (after its frame header)
+  uint32_t RawSize;    //! Uncompressed bytes of the block
+  uint32_t Size;       //! Bytes of the block in the file
+  bool Compressed;     //! The block is compressed, otherwise it is stored
+} CompressBlock_t;
+
+/**
+ * @brief CompressWorkerStats_t
+ * Counters of the compression thread.
+ */
+typedef struct
+{
+  uint64_t Blocks;          //! Compressed blocks
+  uint64_t RawBytes;        //! Uncompressed bytes of blocks
+  uint64_t CompressedBytes; //! Bytes of blocks in the file (stored blocks are not compressed)
+  uint64_t BusyUs;          //! Time spent compressing blocks
+} CompressWorkerStats_t;
+
+/**
+ * @brief CompressJob_t
+ * The slot of the reorder window.
+ */
+typedef struct
+{
+  uint8_t* Input;
+  size_t InputSize;   //! Bytes of the block
+  uint8_t* Output;    //! The compressed block
+  size_t OutputSize;  //! Bytes of the compressed block (0 - the block is stored)
+  int Fd;             //! The file of the block
+  uint64_t RawOffset; //! Offset of the block in the uncompressed data of the file
+  bool Close;         //! The file is closed after the block is written
+} CompressJob_t;
+
+/**
+ * @brief CompressPool_t
+ * Compresses blocks by worker threads and writes frames to their files in the order of submission, the same way
+ * FormatPool_t writes records: the producer fills the next slot of the reorder window (SlotPool_t), the worker which
+ * completes the oldest slot writes all completed frames from it. Blocks are compressed by the fast LZ codec (LZ77 with
+ * the hash table of 4-byte sequences), a block which does not get smaller is stored. The producer only waits for a free
+ * slot if the workers together are slower than the producer.
+ */
+typedef struct
+{
+  uint64_t Blocks;       //! Written frames
+  uint64_t StoredBlocks; //! Frames of blocks which are not compressed
+  uint64_t RawBytes;     //! Uncompressed bytes of written blocks
+  uint64_t Bytes;        //! Written bytes (frame headers and blocks)
+  uint64_t WriteErrors;  //! Frames which are not written
+  SlotPool_t Slots;      //! The reorder window: compressed blocks (Jobs), reordered blocks and stalls of the producer
+  CompressWorkerStats_t Workers[COMPRESS_THREADS_MAX]; //! Counters of each thread (the producer without threads)
+  // private fields
+  CompressJob_t* __jobs; // Slots.Window jobs
+  uint32_t* __tables; // the hash table of each thread
+  size_t __blockSize;
+  size_t __slot; // the slot returned by SlotPoolAcquire()
+} CompressPool_t;
+
+/**
+ * @brief LzCompressBound
+ * Returns max bytes of the compressed data.
+ * @param size Bytes of the data
+ * @return Max bytes of the compressed data.
+ */
+size_t LzCompressBound(size_t size);
+/**
+ * @brief LzCompress
+ * Compresses the data.
+ * @param src The data
+ * @param size Bytes of the data
+ * @param dst The compressed data
+ * @param capacity The size of the dst buffer
+ * @param table The hash table (1 << COMPRESS_HASH_LOG entries)
+ * @return Bytes of the compressed data, 0 if it does not fit the dst buffer.
+ */
+size_t LzCompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity, uint32_t* table);
+/**
+ * @brief LzDecompress
+ * Decompresses the data, the compressed data is validated.
+ * @param src The compressed data
+ * @param size Bytes of the compressed data
+ * @param dst The data
+ * @param capacity The size of the dst buffer
+ * @return Bytes of the data, -1 if the compressed data is invalid or the data does not fit the dst buffer.
+ */
+int64_t LzDecompress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+/**
+ * @brief CompressFileHeaderInit
+ * Initializes the header of the compressed file.
+ * @param header The pointer to the header
+ * @param blockSize Max uncompressed bytes of the block
+ */
+void CompressFileHeaderInit(CompressFileHeader_t* header, uint32_t blockSize);
+/**
+ * @brief CompressListBlocks
+ * Reads frame headers of the compressed file. The incomplete last frame (the file is being written) is not listed.
+ * @param data The compressed file
+ * @param size Bytes of the file
+ * @param blocks Blocks of the file in the order of the uncompressed data (the array grows)
+ * @param capacity Entries of the blocks array
+ * @return Blocks of the file, -1 if it is not the compressed file.
+ */
+int64_t CompressListBlocks(const uint8_t* data, size_t size, CompressBlock_t** blocks, size_t* capacity);
+
+/**
+ * @brief CompressPoolInit
+ * Initializes values for the new pool object and allocates all blocks of the window.
+ * @param p The pointer to the pool object
+ * @param threads The number of worker threads (0 - COMPRESS_THREADS_MAX)
+ * @param blockSize Max bytes of the block (up to COMPRESS_BLOCK_MAX_SIZE)
+ */
+void CompressPoolInit(CompressPool_t* p, size_t threads, size_t blockSize);
+/**
+ * @brief CompressPoolStart
+ * Starts worker threads. Without them (and on Windows) blocks are compressed and written by the producer.
+ * @param p The pointer to the pool object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int CompressPoolStart(CompressPool_t* p);
+/**
+ * @brief CompressPoolAcquire
+ * Returns the buffer of the next block (blockSize bytes). Waits if the reorder window is full. Only one thread can
+ * submit blocks.
+ * @param p The pointer to the pool object
+ * @return The block buffer.
+ */
+uint8_t* CompressPoolAcquire(CompressPool_t* p);
+/**
+ * @brief CompressPoolSubmit
+ * Submits the block filled after CompressPoolAcquire().
+ * @param p The pointer to the pool object
+ * @param size Bytes of the block (0 - no frame is written)
+ * @param fd The file of the frame (after the file header)
+ * @param rawOffset Offset of the block in the uncompressed data of the file
+ * @param close The file is closed after the frame is written
+ */
+void CompressPoolSubmit(CompressPool_t* p, size_t size, int fd, uint64_t rawOffset, bool close);
+/**
+ * @brief CompressPoolStop
+ * Writes all submitted blocks and stops worker threads.
+ * @param p The pointer to the pool object
+ */
+void CompressPoolStop(CompressPool_t* p);
+/**
+ * @brief CompressPoolClear
+ * Clears the passed pool object. The pool must be stopped.
+ * @param p The pointer to the pool object
+ */
+void CompressPoolClear(CompressPool_t* p);
+
+#endif // __COMPRESS_H
@@ -0,0 +1,399 @@
+#include "control.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void* ServerThread(void* args);
+static void ServeClient(ControlServer_t* c, int client, char* request, char* response);
+static int WriteAll(int client, const char* data, size_t size);
+#endif
+
+static size_t AppendResponse(char* response, size_t responseSize, size_t length, const char* format, ...);
+static size_t ExecuteRuleCommand(
+    ControlServer_t* c, bool add, const char* rule, char* response, size_t responseSize, size_t length);
+static size_t ExecuteListCommand(ControlServer_t* c, char* response, size_t responseSize, size_t length);
+static size_t ExecutePcapCommand(ControlServer_t* c, const char* args, char* response, size_t responseSize);
+static size_t ExecuteDumpCommand(ControlServer_t* c, const char* args, char* response, size_t responseSize);
+static size_t CopyPathArg(const char* args, char* path, size_t pathSize);
+
+void ControlInit(ControlServer_t* c, RuleSet_t* rules, PcapSink_t* pcap, uint32_t linkType)
+{
+  ASSERT("Cannot init control ('ControlServer_t'): c == NULL.", c != NULL);
+
+  c->Commands = 0;
+  c->Errors = 0;
+  c->ErrorMessage = NULL;
+  c->__rules = rules;
+  // the server reads tables (the list command), it reports quiescent states between commands
+  c->__rulesReader = RuleSetAddReader(rules);
+  c->__pcap = pcap;
+  c->__recorder = NULL;
+  c->__linkType = linkType;
+  c->__statsHandler = NULL;
+  c->__statsArgs = NULL;
+  c->__unixPath[0] = '\0';
+  c->__sock = -1;
+  atomic_init(&c->__running, false);
+}
+
+void ControlSetStatsHandler(ControlServer_t* c, ControlStatsHandler_t handler, void* args)
+{
+  c->__statsHandler = handler;
+  c->__statsArgs = args;
+}
+
+void ControlSetRecorder(ControlServer_t* c, FlightRecorder_t* recorder)
+{
+  c->__recorder = recorder;
+}
+
+int ControlListen(ControlServer_t* c, const char* path)
+{
+#ifdef __linux__
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) == 0 || strlen(path) >= sizeof(address.sun_path) || strlen(path) >= CONTROL_PATH_MAX_SIZE) {
+    FormatStringBuffer(&c->ErrorMessage, "Invalid path of the control socket '%s'.", path);
+    return -1;
+  }
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  // the socket of the previous run is replaced, other files are not removed
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  c->__sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (c->__sock < 0 || bind(c->__sock, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+      listen(c->__sock, SOMAXCONN) < 0) {
+    FormatStringBuffer(&c->ErrorMessage, "Cannot listen on the control socket '%s': %s", path, strerror(errno));
+    return -1;
+  }
+  // commands change the capture, only the owner may connect
+  chmod(path, S_IRUSR | S_IWUSR);
+  strncpy(c->__unixPath, path, CONTROL_PATH_MAX_SIZE - 1);
+  c->__unixPath[CONTROL_PATH_MAX_SIZE - 1] = '\0';
+  return 0;
+#else
+  (void) path;
+  FormatStringBuffer(&c->ErrorMessage, "The control socket is only available on Linux.");
+  return -1;
+#endif
+}
+
+int ControlStart(ControlServer_t* c)
+{
+#ifdef __linux__
+  atomic_store(&c->__running, true);
+  int rc = pthread_create(&c->__serverThread, NULL, ServerThread, c);
+  if (rc != 0) {
+    atomic_store(&c->__running, false);
+    FormatStringBuffer(&c->ErrorMessage, "Cannot start the control thread: %s", strerror(rc));
+    return -1;
+  }
+  return 0;
+#else
+  FormatStringBuffer(&c->ErrorMessage, "The control socket is only available on Linux.");
+  return -1;
+#endif
+}
+
+size_t ControlExecute(ControlServer_t* c, const char* line, char* response, size_t responseSize)
+{
+  c->Commands++;
+  if (c->__rulesReader < 0) {
+    c->Errors++;
+    return AppendResponse(response, responseSize, 0, "ERROR Too many readers of rules.\n");
+  }
+  // the server holds no table between commands
+  RuleSetQuiescent(c->__rules, c->__rulesReader);
+
+  while (*line == ' ' || *line == '\t')
+    ++line;
+  size_t commandLength = strcspn(line, " \t\r");
+  const char* args = line + commandLength;
+  while (*args == ' ' || *args == '\t')
+    ++args;
+
+  size_t length;
+  if (commandLength == 3 && strncmp(line, "add", 3) == 0)
+    length = ExecuteRuleCommand(c, true, args, response, responseSize, 0);
+  else if (commandLength == 6 && strncmp(line, "remove", 6) == 0)
+    length = ExecuteRuleCommand(c, false, args, response, responseSize, 0);
+  else if (commandLength == 4 && strncmp(line, "list", 4) == 0)
+    length = ExecuteListCommand(c, response, responseSize, 0);
+  else if (commandLength == 5 && strncmp(line, "stats", 5) == 0) {
+    if (c->__statsHandler == NULL)
+      length = AppendResponse(response, responseSize, 0, "ERROR Statistics are not available.\n");
+    else {
+      length = c->__statsHandler(response, responseSize, c->__statsArgs);
+      length = AppendResponse(response, responseSize, length, "OK\n");
+    }
+  } else if (commandLength == 4 && strncmp(line, "pcap", 4) == 0)
+    length = ExecutePcapCommand(c, args, response, responseSize);
+  else if (commandLength == 4 && strncmp(line, "dump", 4) == 0)
+    length = ExecuteDumpCommand(c, args, response, responseSize);
+  else if (commandLength == 4 && strncmp(line, "help", 4) == 0)
+    length = AppendResponse(response,
+                            responseSize,
+                            0,
+                            "add RULE, remove RULE, list, stats, pcap start FILE, pcap stop, dump [FILE]\n"
+                            "OK\n");
+  else
+    length = AppendResponse(
+        response, responseSize, 0, "ERROR Unknown command '%.*s', try 'help'.\n", (int) commandLength, line);
+
+  // the last line is the status
+  const char* status = response;
+  for (const char* p = response; p + 1 < response + length; ++p)
+    if (*p == '\n')
+      status = p + 1;
+  if (strncmp(status, "ERROR", 5) == 0)
+    c->Errors++;
+  return length;
+}
+
+void ControlStop(ControlServer_t* c)
+{
+  if (c == NULL)
+    return;
+
+#ifdef __linux__
+  if (atomic_exchange(&c->__running, false))
+    pthread_join(c->__serverThread, NULL);
+  if (c->__sock >= 0) {
+    close(c->__sock);
+    c->__sock = -1;
+  }
+  if (c->__unixPath[0] != '\0') {
+    unlink(c->__unixPath);
+    c->__unixPath[0] = '\0';
+  }
+#endif
+}
+
+void ControlClear(ControlServer_t* c)
+{
+  if (c == NULL)
+    return;
+
+  ControlStop(c);
+  if (c->__rulesReader >= 0) {
+    RuleSetRemoveReader(c->__rules, c->__rulesReader);
+    c->__rulesReader = -1;
+  }
+  free(c->ErrorMessage);
+  c->ErrorMessage = NULL;
+}
+
+size_t AppendResponse(char* response, size_t responseSize, size_t length, const char* format, ...)
+{
+  if (length + 1 >= responseSize)
+    return length;
+
+  va_list args;
+  va_start(args, format);
+  int rc = vsnprintf(response + length, responseSize - length, format, args);
+  va_end(args);
+  if (rc < 0)
+    return length;
+  return length + (size_t) rc < responseSize ? length + (size_t) rc : responseSize - 1;
+}
+
+size_t ExecuteRuleCommand(
+    ControlServer_t* c, bool add, const char* rule, char* response, size_t responseSize, size_t length)
+{
+  Rule_t parsed;
+  char* error = NULL;
+  int rc = RuleParse(rule, strlen(rule), &parsed, &error);
+  if (rc <= 0) {
+    length = AppendResponse(
+        response, responseSize, length, "ERROR Invalid rule: %s\n", rc < 0 ? error : "the rule is empty.");
+    free(error);
+    return length;
+  }
+
+  uint64_t version = add ? RuleSetAddRule(c->__rules, &parsed) : RuleSetRemoveRule(c->__rules, &parsed);
+  if (version == 0 && add)
+    return AppendResponse(response, responseSize, length, "ERROR Max rules count: %d.\n", RULES_MAX_COUNT);
+  if (version == 0)
+    return AppendResponse(response, responseSize, length, "ERROR The rule is not found.\n");
+  return AppendResponse(response, responseSize, length, "OK version %" PRIu64 "\n", version);
+}
+
+size_t ExecuteListCommand(ControlServer_t* c, char* response, size_t responseSize, size_t length)
+{
+  const RuleTable_t* t = RuleSetCurrent(c->__rules);
+  if (t == NULL)
+    return AppendResponse(response, responseSize, length, "OK version 0, 0 rules\n");
+
+  // the status line always fits, long tables are truncated
+  size_t reserved = 128;
+  size_t i = 0;
+  for (; i < t->Count && length + RULE_STRING_MAX_SIZE + 16 + reserved < responseSize; ++i) {
+    char rule[RULE_STRING_MAX_SIZE];
+    RuleToString(&t->Rules[i], rule, sizeof(rule));
+    length = AppendResponse(response, responseSize, length, "%zu: %s\n", i, rule);
+  }
+  if (i < t->Count)
+    length = AppendResponse(response, responseSize, length, "... %zu more rules\n", t->Count - i);
+  return AppendResponse(
+      response, responseSize, length, "OK version %" PRIu64 ", %zu rules\n", t->Version, t->Count);
+}
+
+size_t ExecutePcapCommand(ControlServer_t* c, const char* args, char* response, size_t responseSize)
+{
+  if (c->__pcap == NULL)
+    return AppendResponse(response, responseSize, 0, "ERROR The pcap sink is not available.\n");
+
+  if (strncmp(args, "start", 5) == 0 && (args[5] == ' ' || args[5] == '\t')) {
+    char file[CONTROL_LINE_MAX_SIZE];
+    if (CopyPathArg(args + 6, file, sizeof(file)) == 0)
+      return AppendResponse(response, responseSize, 0, "ERROR Invalid pcap file.\n");
+
+    char* error = NULL;
+    if (PcapSinkStart(c->__pcap, file, c->__linkType, &error) < 0) {
+      size_t length = AppendResponse(response, responseSize, 0, "ERROR %s\n", error);
+      free(error);
+      return length;
+    }
+    return AppendResponse(response, responseSize, 0, "OK writing '%s'\n", file);
+  }
+  if (strncmp(args, "stop", 4) == 0 && strspn(args + 4, " \t\r") == strlen(args + 4)) {
+    int64_t packets = PcapSinkStop(c->__pcap);
+    if (packets < 0)
+      return AppendResponse(response, responseSize, 0, "ERROR The pcap file is not written.\n");
+    return AppendResponse(response, responseSize, 0, "OK %" PRId64 " packets\n", packets);
+  }
+  return AppendResponse(response, responseSize, 0, "ERROR Usage: pcap start FILE, pcap stop.\n");
+}
+
+size_t ExecuteDumpCommand(ControlServer_t* c, const char* args, char* response, size_t responseSize)
+{
+  if (c->__recorder == NULL)
+    return AppendResponse(response, responseSize, 0, "ERROR The flight recorder is disabled.\n");
+
+  char file[CONTROL_LINE_MAX_SIZE];
+  size_t pathLength = CopyPathArg(args, file, sizeof(file));
+  if (pathLength >= RECORDER_PATH_MAX_SIZE)
+    return AppendResponse(response, responseSize, 0, "ERROR Invalid pcap file.\n");
+  // the dump is written by the thread of the recorder, the command does not wait for it
+  if (!FlightRecorderTrigger(c->__recorder, pathLength > 0 ? file : NULL))
+    return AppendResponse(response, responseSize, 0, "ERROR The previous dump is not written yet.\n");
+  return AppendResponse(response, responseSize, 0, "OK dumping\n");
+}
+
+size_t CopyPathArg(const char* args, char* path, size_t pathSize)
+{
+  while (*args == ' ' || *args == '\t')
+    ++args;
+  size_t length = strcspn(args, "\r");
+  while (length > 0 && (args[length - 1] == ' ' || args[length - 1] == '\t'))
+    --length;
+  if (length >= pathSize)
+    return pathSize;
+  memcpy(path, args, length);
+  path[length] = '\0';
+  return length;
+}
+
+#ifdef __linux__
+void* ServerThread(void* args)
+{
+  ControlServer_t* c = (ControlServer_t*) args;
+
+  char* request = malloc(CONTROL_LINE_MAX_SIZE);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", request != NULL);
+  char* response = malloc(CONTROL_RESPONSE_MAX_SIZE);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", response != NULL);
+
+  while (atomic_load(&c->__running)) {
+    if (c->__rulesReader >= 0)
+      RuleSetQuiescent(c->__rules, c->__rulesReader);
+    struct pollfd pfd = {.fd = c->__sock, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, CONTROL_POLL_TIMEOUT_MS) <= 0)
+      continue;
+
+    int client = accept(c->__sock, NULL, NULL);
+    if (client < 0)
+      continue;
+    ServeClient(c, client, request, response);
+    close(client);
+  }
+
+  free(response);
+  free(request);
+  return NULL;
+}
+
+void ServeClient(ControlServer_t* c, int client, char* request, char* response)
+{
+  // a stuck client must not block the next clients forever
+  struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  size_t length = 0;
+  uint64_t idleMs = 0;
+  while (atomic_load(&c->__running) && idleMs < CONTROL_CLIENT_IDLE_TIMEOUT_MS) {
+    if (c->__rulesReader >= 0)
+      RuleSetQuiescent(c->__rules, c->__rulesReader);
+    struct pollfd pfd = {.fd = client, .events = POLLIN, .revents = 0};
+    int rc = poll(&pfd, 1, CONTROL_POLL_TIMEOUT_MS);
+    if (rc == 0) {
+      idleMs += CONTROL_POLL_TIMEOUT_MS;
+      continue;
+    }
+    if (rc < 0)
+      return;
+
+    ssize_t received = recv(client, request + length, CONTROL_LINE_MAX_SIZE - 1 - length, 0);
+    if (received <= 0)
+      return;
+    idleMs = 0;
+    length += (size_t) received;
+
+    char* begin = request;
+    char* end;
+    while ((end = memchr(begin, '\n', length - (size_t) (begin - request))) != NULL) {
+      *end = '\0';
+      size_t responseLength = ControlExecute(c, begin, response, CONTROL_RESPONSE_MAX_SIZE);
+      if (WriteAll(client, response, responseLength) < 0)
+        return;
+      begin = end + 1;
+    }
+    length -= (size_t) (begin - request);
+    memmove(request, begin, length);
+    if (length == CONTROL_LINE_MAX_SIZE - 1) {
+      static const char tooLong[] = "ERROR The command is too long.\n";
+      c->Errors++;
+      WriteAll(client, tooLong, sizeof(tooLong) - 1);
+      return;
+    }
+  }
+}
+
+int WriteAll(int client, const char* data, size_t size)
+{
+  while (size > 0) {
+    ssize_t rc = send(client, data, size, MSG_NOSIGNAL);
+    if (rc <= 0)
+      return -1;
+    data += rc;
+    size -= (size_t) rc;
+  }
+  return 0;
+}
+#endif
@@ -0,0 +1,120 @@
+#ifndef __CONTROL_H
+#define __CONTROL_H
+
+#include "rules.h"
+#include "pcap.h"
+#include "recorder.h"
+#include <stdatomic.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#define CONTROL_PATH_MAX_SIZE 108
+#define CONTROL_POLL_TIMEOUT_MS 100
+#define CONTROL_CLIENT_IDLE_TIMEOUT_MS 30000
+#define CONTROL_LINE_MAX_SIZE 1024
+#define CONTROL_RESPONSE_MAX_SIZE 65536
+
+typedef size_t (*ControlStatsHandler_t)(char* buffer, size_t bufferSize, void* args);
+
+/**
+ * @brief ControlServer_t
+ * The control socket (the unix socket) of the running sniffer. Commands are text lines, each response ends with the
+ * line 'OK ...' or 'ERROR ...':
+ *   add RULE          - appends the rule (the syntax of the rules file), replies 'OK version N'
+ *   remove RULE       - removes the first equal rule, replies 'OK version N'
+ *   list              - prints 'INDEX: RULE' lines, replies 'OK version N, M rules'
+ *   stats             - prints the capture counters
+ *   pcap start FILE   - writes next matched packets to the pcap file
+ *   pcap stop         - closes the pcap file, replies 'OK N packets'
+ *   dump [FILE]       - dumps the flight recorder to the pcap file in the background
+ * Rules are changed by swapping the versioned table of the rule set, so the capture thread never waits for commands
+ * and packets are never matched by the partially changed table. Clients are served one by one. The server is only
+ * available on Linux.
+ */
+typedef struct
+{
+  uint64_t Commands;  //! Executed commands
+  uint64_t Errors;    //! Failed commands
+  char* ErrorMessage; //! Error messages
+  // private fields
+  RuleSet_t* __rules;
+  int __rulesReader;
+  PcapSink_t* __pcap;
+  FlightRecorder_t* __recorder;
+  uint32_t __linkType;
+  ControlStatsHandler_t __statsHandler;
+  void* __statsArgs;
+  char __unixPath[CONTROL_PATH_MAX_SIZE];
+  int __sock;
+  atomic_bool __running;
+#ifdef __linux__
+  pthread_t __serverThread;
+#endif
+} ControlServer_t;
+
+/**
+ * @brief ControlInit
+ * Initializates values for the new control server object.
+ * @param c The pointer to the control server object
+ * @param rules The rule set changed by commands (the server is registered as its reader)
+ * @param pcap The pcap sink started by commands (NULL if pcap commands are not available)
+ * @param linkType The link type of the pcap file (PCAP_LINKTYPE_ETHERNET or PCAP_LINKTYPE_RAW)
+ */
+void ControlInit(ControlServer_t* c, RuleSet_t* rules, PcapSink_t* pcap, uint32_t linkType);
+/**
+ * @brief ControlSetStatsHandler
+ * Sets the handler of the 'stats' command.
+ * @param c The pointer to the control server object
+ * @param handler Prints statistics to the buffer, returns the length
+ * @param args Argument of the handler
+ */
+void ControlSetStatsHandler(ControlServer_t* c, ControlStatsHandler_t handler, void* args);
+/**
+ * @brief ControlSetRecorder
+ * Sets the flight recorder of the 'dump' command.
+ * @param c The pointer to the control server object
+ * @param recorder The started flight recorder
+ */
+void ControlSetRecorder(ControlServer_t* c, FlightRecorder_t* recorder);
+/**
+ * @brief ControlListen
+ * Creates the unix socket.
+ * @param c The pointer to the control server object
+ * @param path The path of the socket (the socket of the previous run is replaced)
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int ControlListen(ControlServer_t* c, const char* path);
+/**
+ * @brief ControlStart
+ * Starts the server thread.
+ * @param c The pointer to the control server object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int ControlStart(ControlServer_t* c);
+/**
+ * @brief ControlExecute
+ * Executes the command line (without the line break).
+ * @param c The pointer to the control server object
+ * @param line The command
+ * @param response The response, ends with the line 'OK ...' or 'ERROR ...'
+ * @param responseSize The size of the response buffer (CONTROL_RESPONSE_MAX_SIZE is sufficient)
+ * @return The length of the response.
+ */
+size_t ControlExecute(ControlServer_t* c, const char* line, char* response, size_t responseSize);
+/**
+ * @brief ControlStop
+ * Stops the server thread, closes and removes the socket. The pcap file is not closed.
+ * @param c The pointer to the control server object
+ */
+void ControlStop(ControlServer_t* c);
+/**
+ * @brief ControlClear
+ * Clears the passed control server object.
+ * @param c The pointer to the control server object
+ */
+void ControlClear(ControlServer_t* c);
+
+#endif // __CONTROL_H
@@ -0,0 +1,366 @@
+#include "dns.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_TC 0x0200
+#define DNS_LABEL_POINTER 0xC0
+#define DNS_PENDING_PROBES_COUNT 8
+
+static uint16_t ReadUInt16(const uint8_t* p);
+static uint32_t ReadUInt32(const uint8_t* p);
+static uint64_t HashQName(const char* name);
+static bool EqualQNames(const char* a, const char* b);
+static size_t PendingQueryIndex(const DnsTracker_t* t, uint32_t addr, uint16_t port, uint16_t id);
+static void AddLatency(DnsTracker_t* t, DnsEvent_t* event);
+
+int DnsParseMessage(const uint8_t* data, size_t size, DnsMessage_t* msg)
+{
+  if (data == NULL || msg == NULL || size < DNS_HEADER_SIZE)
+    return -1;
+
+  memset(msg, 0, sizeof(DnsMessage_t));
+  msg->Data = data;
+  msg->Size = size;
+
+  uint16_t flags = ReadUInt16(data + 2);
+  msg->Id = ReadUInt16(data);
+  msg->Response = (flags & DNS_FLAG_QR) != 0;
+  msg->Opcode = (uint8_t) ((flags >> 11) & 0x0F);
+  msg->Truncated = (flags & DNS_FLAG_TC) != 0;
+  msg->Rcode = (uint8_t) (flags & 0x0F);
+  msg->QDCount = ReadUInt16(data + 4);
+  msg->ANCount = ReadUInt16(data + 6);
+  msg->NSCount = ReadUInt16(data + 8);
+  msg->ARCount = ReadUInt16(data + 10);
+
+  msg->QNameOffset = DNS_HEADER_SIZE;
+  msg->AnswersOffset = DNS_HEADER_SIZE;
+  if (msg->QDCount == 0)
+    return 0;
+
+  size_t next;
+  if (DnsReadName(data, size, DNS_HEADER_SIZE, NULL, 0, &next) < 0 || next + 4 > size)
+    return -1;
+
+  msg->QType = ReadUInt16(data + next);
+  msg->QClass = ReadUInt16(data + next + 2);
+  msg->AnswersOffset = next + 4;
+  return 0;
+}
+
+int DnsReadName(const uint8_t* msg, size_t size, size_t offset, char* name, size_t nameSize, size_t* next)
+{
+  size_t length = 0;
+  bool jumped = false;
+  int jumps = 0;
+
+  for (;;) {
+    if (offset >= size)
+      return -1;
+
+    uint8_t label = msg[offset];
+    if ((label & DNS_LABEL_POINTER) == DNS_LABEL_POINTER) {
+      if (offset + 1 >= size)
+        return -1;
+
+      size_t pointer = (size_t) ((label & ~DNS_LABEL_POINTER) << 8 | msg[offset + 1]);
+      if (pointer >= offset)
+        /*
+         * Pointers may only refer to prior occurrences of names. It also protects against loops.
+         */
+        return -1;
+      if (++jumps > DNS_POINTER_JUMPS_MAX)
+        return -1; // chains of pointers are bounded, each jump costs a pass over the message
+
+      if (!jumped && next != NULL)
+        *next = offset + 2;
+      jumped = true;
+      offset = pointer;
+      continue;
+    }
+    if (label & DNS_LABEL_POINTER)
+      return -1; // extended label types are not supported
+
+    if (label == 0) {
+      if (!jumped && next != NULL)
+        *next = offset + 1;
+      break;
+    }
+
+    if (offset + 1 + label > size || length + label + 1 > DNS_NAME_MAX_SIZE - 1)
+      return -1;
+
+    if (name != NULL) {
+      if (length + label + 2 > nameSize)
+        return -1;
+      if (length > 0)
+        name[length++] = '.';
+      memcpy(name + length, msg + offset + 1, label);
+      length += label;
+    } else {
+      length += (size_t) label + (length > 0 ? 1 : 0);
+    }
+    offset += (size_t) label + 1;
+  }
+
+  if (name != NULL) {
+    if (nameSize < 2)
+      return -1;
+    if (length == 0)
+      name[length++] = '.'; // root
+    name[length] = '\0';
+  }
+  return 0;
+}
+
+int DnsReadRecord(const DnsMessage_t* msg, size_t offset, DnsRecord_t* record, size_t* next)
+{
+  size_t end;
+  if (DnsReadName(msg->Data, msg->Size, offset, NULL, 0, &end) < 0 || end + 10 > msg->Size)
+    return -1;
+
+  record->NameOffset = offset;
+  record->Type = ReadUInt16(msg->Data + end);
+  record->Class = ReadUInt16(msg->Data + end + 2);
+  record->TTL = ReadUInt32(msg->Data + end + 4);
+  record->RDLength = ReadUInt16(msg->Data + end + 8);
+  record->RData = msg->Data + end + 10;
+  if (end + 10 + record->RDLength > msg->Size)
+    return -1;
+
+  if (next != NULL)
+    *next = end + 10 + record->RDLength;
+  return 0;
+}
+
+const char* DnsTypeToString(uint16_t type)
+{
+  switch (type) {
+  case 1:
+    return "A";
+  case 2:
+    return "NS";
+  case 5:
+    return "CNAME";
+  case 6:
+    return "SOA";
+  case 12:
+    return "PTR";
+  case 15:
+    return "MX";
+  case 16:
+    return "TXT";
+  case 28:
+    return "AAAA";
+  case 33:
+    return "SRV";
+  case 64:
+    return "SVCB";
+  case 65:
+    return "HTTPS";
+  case 255:
+    return "ANY";
+  default:
+    return NULL;
+  }
+}
+
+const char* DnsRcodeToString(uint8_t rcode)
+{
+  static const char* names[DNS_RCODES_COUNT] = {"NOERROR",
+                                                "FORMERR",
+                                                "SERVFAIL",
+                                                "NXDOMAIN",
+                                                "NOTIMP",
+                                                "REFUSED",
+                                                "YXDOMAIN",
+                                                "YXRRSET",
+                                                "NXRRSET",
+                                                "NOTAUTH",
+                                                "NOTZONE",
+                                                "RCODE11",
+                                                "RCODE12",
+                                                "RCODE13",
+                                                "RCODE14",
+                                                "RCODE15"};
+  return names[rcode & 0x0F];
+}
+
+void DnsTrackerInit(DnsTracker_t* t, size_t capacity)
+{
+  ASSERT("Cannot init the DNS tracker: t == NULL.", t != NULL);
+
+  size_t pow2 = 1;
+  while (pow2 < capacity)
+    pow2 <<= 1;
+
+  t->Queries = 0;
+  t->Responses = 0;
+  t->Matched = 0;
+  t->Unmatched = 0;
+  t->Expired = 0;
+  t->Malformed = 0;
+  HistogramInit(&t->Latency);
+  for (int i = 0; i < DNS_RCODES_COUNT; ++i)
+    HistogramInit(&t->RcodeLatency[i]);
+
+  t->QNames = malloc(sizeof(DnsQNameStats_t) * DNS_QNAME_STATS_MAX_COUNT);
+  ASSERT("Cannot initialize a new DNS names table: malloc returned 'NULL'.", t->QNames != NULL);
+  t->QNamesCount = 0;
+  HistogramInit(&t->OtherQNamesLatency);
+
+  t->__pending = calloc(pow2, sizeof(DnsPendingQuery_t));
+  ASSERT("Cannot initialize a new DNS pending queries table: calloc returned 'NULL'.", t->__pending != NULL);
+  t->__capacity = pow2;
+}
+
+int DnsTrackerProcess(DnsTracker_t* t, const PacketView_t* view, const TimeInfo_t* time, DnsEvent_t* event)
+{
+  if (view->Protocol != Protocol_UDP || (view->SourcePort != DNS_PORT && view->DestinationPort != DNS_PORT))
+    return 0;
+
+  event->Matched = false;
+  event->LatencyUs = 0;
+  event->QName[0] = '\0';
+
+  DnsMessage_t* msg = &event->Message;
+  if (DnsParseMessage((const uint8_t*) view->Payload, view->PayloadSize, msg) < 0) {
+    t->Malformed++;
+    return -1;
+  }
+  if (msg->QDCount > 0 &&
+      DnsReadName(msg->Data, msg->Size, msg->QNameOffset, event->QName, DNS_NAME_MAX_SIZE, NULL) < 0) {
+    t->Malformed++;
+    return -1;
+  }
+
+  uint64_t now = TimeInfoToMicroseconds(time);
+  if (!msg->Response) {
+    t->Queries++;
+
+    size_t index = PendingQueryIndex(t, view->SourceAddress, view->SourcePort, msg->Id);
+    size_t victim = index;
+    for (size_t i = 0; i < DNS_PENDING_PROBES_COUNT; ++i) {
+      DnsPendingQuery_t* q = &t->__pending[(index + i) & (t->__capacity - 1)];
+      if (!q->Used || now - q->TimestampUs > DNS_PENDING_QUERY_TIMEOUT_US ||
+          (q->ClientAddress == view->SourceAddress && q->ClientPort == view->SourcePort && q->Id == msg->Id)) {
+        victim = (index + i) & (t->__capacity - 1);
+        break;
+      }
+      if (q->TimestampUs < t->__pending[victim].TimestampUs)
+        victim = (index + i) & (t->__capacity - 1);
+    }
+
+    DnsPendingQuery_t* q = &t->__pending[victim];
+    if (q->Used)
+      t->Expired++; // timeout, retransmission or eviction of the oldest query
+
+    q->ClientAddress = view->SourceAddress;
+    q->ClientPort = view->SourcePort;
+    q->Id = msg->Id;
+    q->TimestampUs = now;
+    q->Used = true;
+    return 1;
+  }
+
+  t->Responses++;
+
+  size_t index = PendingQueryIndex(t, view->DestinationAddress, view->DestinationPort, msg->Id);
+  for (size_t i = 0; i < DNS_PENDING_PROBES_COUNT; ++i) {
+    DnsPendingQuery_t* q = &t->__pending[(index + i) & (t->__capacity - 1)];
+    if (q->Used && q->ClientAddress == view->DestinationAddress && q->ClientPort == view->DestinationPort &&
+        q->Id == msg->Id) {
+      q->Used = false;
+      event->Matched = true;
+      event->LatencyUs = now >= q->TimestampUs ? now - q->TimestampUs : 0;
+      break;
+    }
+  }
+
+  if (event->Matched)
+    AddLatency(t, event);
+  else
+    t->Unmatched++;
+  return 1;
+}
+
+void DnsTrackerClear(DnsTracker_t* t)
+{
+  if (t == NULL)
+    return;
+
+  free(t->__pending);
+  free(t->QNames);
+  t->__pending = NULL;
+  t->QNames = NULL;
+}
+
+uint16_t ReadUInt16(const uint8_t* p)
+{
+  return (uint16_t) (p[0] << 8 | p[1]);
+}
+
+uint32_t ReadUInt32(const uint8_t* p)
+{
+  return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | (uint32_t) p[3];
+}
+
+uint64_t HashQName(const char* name)
+{
+  uint64_t hash = 14695981039346656037ULL; // FNV-1a
+  for (; *name != '\0'; ++name) {
+    char c = *name;
+    if (c >= 'A' && c <= 'Z')
+      c = (char) (c - 'A' + 'a');
+    hash = (hash ^ (uint8_t) c) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+size_t PendingQueryIndex(const DnsTracker_t* t, uint32_t addr, uint16_t port, uint16_t id)
+{
+  uint64_t key = (uint64_t) addr << 32 | (uint64_t) port << 16 | id;
+  key *= 0x9E3779B97F4A7C15ULL;
+  return (size_t) (key >> 32) & (t->__capacity - 1);
+}
+
+bool EqualQNames(const char* a, const char* b)
+{
+  // names are compared like they are hashed, ignoring the case
+  for (; *a != '\0' && *b != '\0'; ++a, ++b) {
+    char ca = *a >= 'A' && *a <= 'Z' ? (char) (*a - 'A' + 'a') : *a;
+    char cb = *b >= 'A' && *b <= 'Z' ? (char) (*b - 'A' + 'a') : *b;
+    if (ca != cb)
+      return false;
+  }
+  return *a == *b;
+}
+
+void AddLatency(DnsTracker_t* t, DnsEvent_t* event)
+{
+  t->Matched++;
+  HistogramAdd(&t->Latency, event->LatencyUs);
+  HistogramAdd(&t->RcodeLatency[event->Message.Rcode], event->LatencyUs);
+
+  uint64_t hash = HashQName(event->QName);
+  for (size_t i = 0; i < t->QNamesCount; ++i) {
+    if (t->QNames[i].Hash == hash && EqualQNames(t->QNames[i].QName, event->QName)) {
+      HistogramAdd(&t->QNames[i].Latency, event->LatencyUs);
+      return;
+    }
+  }
+
+  if (t->QNamesCount < DNS_QNAME_STATS_MAX_COUNT) {
+    DnsQNameStats_t* stats = &t->QNames[t->QNamesCount++];
+    strncpy(stats->QName, event->QName, DNS_NAME_MAX_SIZE);
+    stats->QName[DNS_NAME_MAX_SIZE - 1] = '\0';
+    stats->Hash = hash;
+    HistogramInit(&stats->Latency);
+    HistogramAdd(&stats->Latency, event->LatencyUs);
+  } else {
+    HistogramAdd(&t->OtherQNamesLatency, event->LatencyUs);
+  }
+}
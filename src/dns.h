@@ -0,0 +1,183 @@
+#ifndef __DNS_H
+#define __DNS_H
+
+#include "structures.h"
+#include "histogram.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DNS_PORT 53
+#define DNS_HEADER_SIZE 12
+#define DNS_NAME_MAX_SIZE 256 /* 255 characters + '\0' */
+#define DNS_POINTER_JUMPS_MAX 16
+#define DNS_RCODES_COUNT 16
+#define DNS_PENDING_QUERIES_DEFAULT_CAPACITY 4096
+#define DNS_PENDING_QUERY_TIMEOUT_US 5000000 /* 5 sec */
+#define DNS_QNAME_STATS_MAX_COUNT 64
+
+/**
+ * @brief DnsMessage_t
+ * Decoded DNS header and the first question. The message is not copied, all offsets point into the UDP payload.
+ */
+typedef struct
+{
+  const uint8_t* Data;   //! The pointer to the DNS message
+  size_t Size;           //! Size of the DNS message
+  uint16_t Id;           //! Transaction ID
+  bool Response;         //! QR flag
+  uint8_t Opcode;        //! Opcode
+  uint8_t Rcode;         //! Response code
+  bool Truncated;        //! TC flag
+  uint16_t QDCount;      //! Questions count
+  uint16_t ANCount;      //! Answers count
+  uint16_t NSCount;      //! Authority records count
+  uint16_t ARCount;      //! Additional records count
+  size_t QNameOffset;    //! Offset of the first question name
+  uint16_t QType;        //! Type of the first question
+  uint16_t QClass;       //! Class of the first question
+  size_t AnswersOffset;  //! Offset of the first resource record after the first question
+} DnsMessage_t;
+
+/**
+ * @brief DnsRecord_t
+ * Decoded DNS resource record. RData points into the DNS message.
+ */
+typedef struct
+{
+  size_t NameOffset;
+  uint16_t Type;
+  uint16_t Class;
+  uint32_t TTL;
+  const uint8_t* RData;
+  uint16_t RDLength;
+} DnsRecord_t;
+
+/**
+ * @brief DnsEvent_t
+ * The result of processing a DNS packet by the tracker.
+ */
+typedef struct
+{
+  DnsMessage_t Message;
+  char QName[DNS_NAME_MAX_SIZE]; //! Decoded name of the first question
+  bool Matched;                  //! The response was matched to the query
+  uint64_t LatencyUs;            //! Resolution latency (if matched)
+} DnsEvent_t;
+
+/**
+ * @brief DnsPendingQuery_t
+ * Query waiting for the response.
+ */
+typedef struct
+{
+  uint32_t ClientAddress;
+  uint16_t ClientPort;
+  uint16_t Id;
+  bool Used;
+  uint64_t TimestampUs;
+} DnsPendingQuery_t;
+
+/**
+ * @brief DnsQNameStats_t
+ * Latency histogram of the question name.
+ */
+typedef struct
+{
+  char QName[DNS_NAME_MAX_SIZE];
+  uint64_t Hash;
+  Histogram_t Latency;
+} DnsQNameStats_t;
+
+/**
+ * @brief DnsTracker_t
+ * Matches DNS responses to queries and collects latency histograms.
+ */
+typedef struct
+{
+  uint64_t Queries;                            //! Decoded queries
+  uint64_t Responses;                          //! Decoded responses
+  uint64_t Matched;                            //! Responses matched to queries
+  uint64_t Unmatched;                          //! Responses without queries
+  uint64_t Expired;                            //! Queries without responses (timeout or table overflow)
+  uint64_t Malformed;                          //! Malformed DNS messages
+  Histogram_t Latency;                         //! Latency of all responses (microseconds)
+  Histogram_t RcodeLatency[DNS_RCODES_COUNT];  //! Latency per response code
+  DnsQNameStats_t* QNames;                     //! Latency per question name
+  size_t QNamesCount;                          //! Question names count
+  Histogram_t OtherQNamesLatency;              //! Latency of names which do not fit into QNames
+  // private fields
+  DnsPendingQuery_t* __pending;
+  size_t __capacity;
+} DnsTracker_t;
+
+/**
+ * @brief DnsParseMessage
+ * Parses the DNS header and the first question. Does not allocate memory.
+ * @param data The pointer to the UDP payload
+ * @param size Size of the UDP payload
+ * @param msg The pointer to the decoded message
+ * @return -1 if the message is malformed, otherwise 0.
+ */
+int DnsParseMessage(const uint8_t* data, size_t size, DnsMessage_t* msg);
+/**
+ * @brief DnsReadName
+ * Decodes the domain name at the offset, following compression pointers. If the name buffer is NULL, the name will be
+ * only validated. Names with more than DNS_POINTER_JUMPS_MAX pointers are malformed.
+ * @param msg The pointer to the DNS message
+ * @param size Size of the DNS message
+ * @param offset Offset of the name
+ * @param name The buffer for the decoded name (may be NULL)
+ * @param nameSize The size of the name buffer
+ * @param next The offset after the name in the message (may be NULL)
+ * @return -1 if the name is malformed or does not fit into the buffer, otherwise 0.
+ */
+int DnsReadName(const uint8_t* msg, size_t size, size_t offset, char* name, size_t nameSize, size_t* next);
+/**
+ * @brief DnsReadRecord
+ * Decodes the resource record at the offset.
+ * @param msg The decoded DNS message
+ * @param offset Offset of the record
+ * @param record The pointer to the decoded record
+ * @param next The offset of the next record
+ * @return -1 if the record is malformed, otherwise 0.
+ */
+int DnsReadRecord(const DnsMessage_t* msg, size_t offset, DnsRecord_t* record, size_t* next);
+/**
+ * @brief DnsTypeToString
+ * @param type The record type
+ * @return The name of the record type, or NULL if unknown.
+ */
+const char* DnsTypeToString(uint16_t type);
+/**
+ * @brief DnsRcodeToString
+ * @param rcode The response code
+ * @return The name of the response code.
+ */
+const char* DnsRcodeToString(uint8_t rcode);
+
+/**
+ * @brief DnsTrackerInit
+ * Initializes values for the new tracker object.
+ * @param t The pointer to the tracker object
+ * @param capacity Max count of pending queries (rounded up to the power of two)
+ */
+void DnsTrackerInit(DnsTracker_t* t, size_t capacity);
+/**
+ * @brief DnsTrackerProcess
+ * Decodes the DNS message from the UDP packet (port 53). Queries are stored in the pending table, responses are matched
+ * to them by the client address, client port and transaction ID.
+ * @param t The pointer to the tracker object
+ * @param view The decoded packet
+ * @param time The packet timestamp
+ * @param event The pointer to the result
+ * @return 1 if the DNS message was decoded, 0 if this packet is not a DNS packet, -1 if the message is malformed.
+ */
+int DnsTrackerProcess(DnsTracker_t* t, const PacketView_t* view, const TimeInfo_t* time, DnsEvent_t* event);
+/**
+ * @brief DnsTrackerClear
+ * Clears the passed tracker object.
+ * @param t The pointer to the tracker object
+ */
+void DnsTrackerClear(DnsTracker_t* t);
+
+#endif // __DNS_H
@@ -0,0 +1,112 @@
+#include "formatpool.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void FormatJob(size_t slot, size_t worker, void* args);
+static void WriteJob(size_t slot, size_t worker, void* args);
+
+void FormatSlabWrite(FormatSlab_t* slab, const char* data, size_t size)
+{
+  if (slab->Size + size > slab->Capacity) {
+    size_t capacity = slab->Capacity > 0 ? slab->Capacity : 4096;
+    while (capacity < slab->Size + size)
+      capacity *= 2;
+    slab->Data = realloc(slab->Data, capacity);
+    ASSERT("Cannot reinitialize a buffer: realloc returned size '0'.", slab->Data != NULL);
+    slab->Capacity = capacity;
+  }
+  memcpy(slab->Data + slab->Size, data, size);
+  slab->Size += size;
+}
+
+void FormatSlabWriteString(FormatSlab_t* slab, const char* str)
+{
+  FormatSlabWrite(slab, str, strlen(str));
+}
+
+void FormatPoolInit(FormatPool_t* p,
+                    size_t threads,
+                    size_t window,
+                    size_t inputCapacity,
+                    FormatPoolFunc_t format,
+                    void* args,
+                    Output_t* output)
+{
+  ASSERT("Cannot init pool ('FormatPool_t'): p == NULL.", p != NULL);
+
+  SlotPoolInit(&p->Slots,
+               threads > FORMAT_POOL_THREADS_MAX ? FORMAT_POOL_THREADS_MAX : threads,
+               window,
+               FormatJob,
+               WriteJob,
+               p);
+  p->__format = format;
+  p->__args = args;
+  p->__output = output;
+  p->__inputCapacity = inputCapacity;
+  p->__slot = 0;
+  p->__jobs = malloc(sizeof(FormatJob_t) * p->Slots.Window);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", p->__jobs != NULL);
+  for (size_t i = 0; i < p->Slots.Window; ++i) {
+    p->__jobs[i].Input = malloc(inputCapacity);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", p->__jobs[i].Input != NULL);
+    p->__jobs[i].InputSize = 0;
+    p->__jobs[i].Output.Data = NULL;
+    p->__jobs[i].Output.Size = 0;
+    p->__jobs[i].Output.Capacity = 0;
+  }
+}
+
+int FormatPoolStart(FormatPool_t* p)
+{
+  return SlotPoolStart(&p->Slots);
+}
+
+uint8_t* FormatPoolAcquire(FormatPool_t* p)
+{
+  p->__slot = SlotPoolAcquire(&p->Slots);
+  return p->__jobs[p->__slot].Input;
+}
+
+void FormatPoolSubmit(FormatPool_t* p, size_t size)
+{
+  p->__jobs[p->__slot].InputSize = size;
+  SlotPoolSubmit(&p->Slots);
+}
+
+void FormatPoolStop(FormatPool_t* p)
+{
+  SlotPoolStop(&p->Slots);
+}
+
+void FormatPoolClear(FormatPool_t* p)
+{
+  if (p == NULL)
+    return;
+
+  for (size_t i = 0; i < p->Slots.Window; ++i) {
+    free(p->__jobs[i].Input);
+    free(p->__jobs[i].Output.Data);
+  }
+  free(p->__jobs);
+  SlotPoolClear(&p->Slots);
+}
+
+void FormatJob(size_t slot, size_t worker, void* args)
+{
+  FormatPool_t* p = (FormatPool_t*) args;
+  FormatJob_t* job = &p->__jobs[slot];
+  p->__format(job->Input, job->InputSize, &job->Output, worker, p->__args);
+}
+
+void WriteJob(size_t slot, size_t worker, void* args)
+{
+  (void) worker;
+
+  FormatPool_t* p = (FormatPool_t*) args;
+  FormatJob_t* job = &p->__jobs[slot];
+  OutputWrite(p->__output, job->Output.Data, job->Output.Size);
+  job->Output.Size = 0;
+}
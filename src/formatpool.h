@@ -0,0 +1,134 @@
+#ifndef __FORMATPOOL_H
+#define __FORMATPOOL_H
+
+#include "output.h"
+#include "slotpool.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FORMAT_POOL_THREADS_MAX 64
+#define FORMAT_POOL_JOBS_PER_THREAD 16
+
+/**
+ * @brief FormatSlab_t
+ * The growable buffer of the formatted record. The memory is kept between jobs, so it is allocated only while the
+ * records grow.
+ */
+typedef struct
+{
+  char* Data;
+  size_t Size;     //! Bytes of the record
+  size_t Capacity; //! Allocated bytes
+} FormatSlab_t;
+
+/**
+ * @brief FormatPoolFunc_t
+ * Formats the job input to the slab. Called by worker threads, so it can use only the state of the worker.
+ * @param input The input of the job
+ * @param size The size of the input
+ * @param slab The slab of the record
+ * @param worker The index of the worker thread (0 if the job is formatted by the producer)
+ * @param args The arguments passed to FormatPoolInit()
+ */
+typedef void (*FormatPoolFunc_t)(const uint8_t* input, size_t size, FormatSlab_t* slab, size_t worker, void* args);
+
+/**
+ * @brief FormatJob_t
+ * The slot of the reorder window.
+ */
+typedef struct
+{
+  uint8_t* Input;
+  size_t InputSize;    //! Bytes of the input
+  FormatSlab_t Output; //! The formatted record
+} FormatJob_t;
+
+/**
+ * @brief FormatPool_t
+ * Formats records by worker threads and writes them to the output in the order of submission. The producer copies the
+ * input to the next slot of the reorder window (SlotPool_t), the worker which completes the oldest slot writes all
+ * completed records from it.
+ */
+typedef struct
+{
+  SlotPool_t Slots; //! The reorder window: formatted records (Jobs), reordered records and stalls of the producer
+  // private fields
+  FormatPoolFunc_t __format;
+  void* __args;
+  Output_t* __output;
+  FormatJob_t* __jobs; // Slots.Window jobs
+  size_t __inputCapacity;
+  size_t __slot; // the slot returned by SlotPoolAcquire()
+} FormatPool_t;
+
+/**
+ * @brief FormatSlabWrite
+ * Appends the data to the slab.
+ * @param slab The pointer to the slab
+ * @param data The data
+ * @param size The size of the data
+ */
+void FormatSlabWrite(FormatSlab_t* slab, const char* data, size_t size);
+/**
+ * @brief FormatSlabWriteString
+ * Appends the null-terminated string to the slab.
+ * @param slab The pointer to the slab
+ * @param str The string
+ */
+void FormatSlabWriteString(FormatSlab_t* slab, const char* str);
+
+/**
+ * @brief FormatPoolInit
+ * Initializes values for the new pool object.
+ * @param p The pointer to the pool object
+ * @param threads The number of worker threads (1 - FORMAT_POOL_THREADS_MAX)
+ * @param window The number of records in the reorder window (at least threads)
+ * @param inputCapacity Max size of the job input
+ * @param format The formatting function
+ * @param args The arguments of the formatting function
+ * @param output The output of formatted records
+ */
+void FormatPoolInit(FormatPool_t* p,
+                    size_t threads,
+                    size_t window,
+                    size_t inputCapacity,
+                    FormatPoolFunc_t format,
+                    void* args,
+                    Output_t* output);
+/**
+ * @brief FormatPoolStart
+ * Starts worker threads. Without them (and on Windows) records are formatted and written by the producer.
+ * @param p The pointer to the pool object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int FormatPoolStart(FormatPool_t* p);
+/**
+ * @brief FormatPoolAcquire
+ * Returns the input buffer of the next job (inputCapacity bytes). Waits if the reorder window is full. Only one thread
+ * can submit jobs.
+ * @param p The pointer to the pool object
+ * @return The input buffer.
+ */
+uint8_t* FormatPoolAcquire(FormatPool_t* p);
+/**
+ * @brief FormatPoolSubmit
+ * Submits the job filled after FormatPoolAcquire().
+ * @param p The pointer to the pool object
+ * @param size The size of the input
+ */
+void FormatPoolSubmit(FormatPool_t* p, size_t size);
+/**
+ * @brief FormatPoolStop
+ * Writes all submitted records to the output and stops worker threads.
+ * @param p The pointer to the pool object
+ */
+void FormatPoolStop(FormatPool_t* p);
+/**
+ * @brief FormatPoolClear
+ * Clears the passed pool object. The pool must be stopped.
+ * @param p The pointer to the pool object
+ */
+void FormatPoolClear(FormatPool_t* p);
+
+#endif // __FORMATPOOL_H
@@ -0,0 +1,83 @@
+#include "histogram.h"
+
+#include <string.h>
+
+void HistogramInit(Histogram_t* h)
+{
+  if (h == NULL)
+    return;
+
+  memset(h, 0, sizeof(Histogram_t));
+  h->Min = UINT64_MAX;
+}
+
+int HistogramBucketIndex(uint64_t value)
+{
+  if (value < HISTOGRAM_SUB_BUCKETS)
+    return (int) value;
+
+  int msb = 63 - __builtin_clzll(value);
+  int sub = (int) ((value >> (msb - 2)) & (HISTOGRAM_SUB_BUCKETS - 1));
+  return (msb - 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint64_t HistogramBucketUpperBound(int index)
+{
+  if (index < HISTOGRAM_SUB_BUCKETS)
+    return (uint64_t) index;
+  if (index >= HISTOGRAM_BUCKETS_COUNT - 1)
+    return UINT64_MAX;
+
+  int msb = index / HISTOGRAM_SUB_BUCKETS + 1;
+  uint64_t sub = (uint64_t) (index % HISTOGRAM_SUB_BUCKETS);
+  uint64_t lower = (HISTOGRAM_SUB_BUCKETS + sub) << (msb - 2);
+  return lower + (1ULL << (msb - 2)) - 1;
+}
+
+void HistogramAdd(Histogram_t* h, uint64_t value)
+{
+  h->Buckets[HistogramBucketIndex(value)]++;
+  h->Count++;
+  h->Sum += value;
+  if (value < h->Min)
+    h->Min = value;
+  if (value > h->Max)
+    h->Max = value;
+}
+
+void HistogramMerge(Histogram_t* h, const Histogram_t* other)
+{
+  for (int i = 0; i < HISTOGRAM_BUCKETS_COUNT; ++i)
+    h->Buckets[i] += other->Buckets[i];
+  h->Count += other->Count;
+  h->Sum += other->Sum;
+  if (other->Min < h->Min)
+    h->Min = other->Min;
+  if (other->Max > h->Max)
+    h->Max = other->Max;
+}
+
+uint64_t HistogramPercentile(const Histogram_t* h, double percentile)
+{
+  if (h->Count == 0)
+    return 0;
+
+  uint64_t rank = (uint64_t) ((double) h->Count * percentile / 100.0);
+  if (rank >= h->Count)
+    rank = h->Count - 1;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS_COUNT; ++i) {
+    seen += h->Buckets[i];
+    if (seen > rank) {
+      uint64_t bound = HistogramBucketUpperBound(i);
+      return bound > h->Max ? h->Max : bound;
+    }
+  }
+  return h->Max;
+}
+
+uint64_t HistogramMean(const Histogram_t* h)
+{
+  return h->Count == 0 ? 0 : h->Sum / h->Count;
+}
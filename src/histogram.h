@@ -0,0 +1,71 @@
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Every power of two is split into HISTOGRAM_SUB_BUCKETS buckets, so the relative error of percentiles is below 25%.
+ */
+#define HISTOGRAM_SUB_BUCKETS 4
+#define HISTOGRAM_BUCKETS_COUNT 252
+
+/**
+ * @brief Histogram_t
+ * Log-bucketed histogram of unsigned values (latencies, sizes). Does not allocate memory.
+ */
+typedef struct
+{
+  uint64_t Buckets[HISTOGRAM_BUCKETS_COUNT];
+  uint64_t Count;
+  uint64_t Sum;
+  uint64_t Min;
+  uint64_t Max;
+} Histogram_t;
+
+/**
+ * @brief HistogramInit
+ * Initializes values for the new histogram object.
+ * @param h The pointer to the histogram object
+ */
+void HistogramInit(Histogram_t* h);
+/**
+ * @brief HistogramAdd
+ * Adds the value to the histogram.
+ * @param h The pointer to the histogram object
+ * @param value The value
+ */
+void HistogramAdd(Histogram_t* h, uint64_t value);
+/**
+ * @brief HistogramMerge
+ * Adds all values of the second histogram to the first histogram.
+ * @param h The pointer to the histogram object
+ * @param other The pointer to the other histogram object
+ */
+void HistogramMerge(Histogram_t* h, const Histogram_t* other);
+/**
+ * @brief HistogramPercentile
+ * @param h The pointer to the histogram object
+ * @param percentile The percentile (0-100)
+ * @return The upper bound of the bucket which contains the percentile, or 0 if the histogram is empty.
+ */
+uint64_t HistogramPercentile(const Histogram_t* h, double percentile);
+/**
+ * @brief HistogramMean
+ * @param h The pointer to the histogram object
+ * @return The mean value, or 0 if the histogram is empty.
+ */
+uint64_t HistogramMean(const Histogram_t* h);
+/**
+ * @brief HistogramBucketIndex
+ * @param value The value
+ * @return The index of the bucket for this value.
+ */
+int HistogramBucketIndex(uint64_t value);
+/**
+ * @brief HistogramBucketUpperBound
+ * @param index The index of the bucket
+ * @return The max value stored in this bucket.
+ */
+uint64_t HistogramBucketUpperBound(int index);
+
+#endif // __HISTOGRAM_H
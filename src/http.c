@@ -0,0 +1,417 @@
+#include "http.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HTTP_METHOD_MAX_SIZE 7 /* OPTIONS, CONNECT */
+#define HTTP_VERSION_SIZE 8    /* HTTP/1.x */
+#define HTTP_CONNECTION_PROBES_COUNT 8
+
+static const char* HttpMethodNames[HttpMethod_COUNT] =
+    {"UNKNOWN", "GET", "HEAD", "POST", "PUT", "DELETE", "CONNECT", "OPTIONS", "TRACE", "PATCH"};
+
+static HttpMethod_t ParseMethod(const uint8_t* data, size_t size);
+static bool IsHttpPrefix(const uint8_t* data, size_t size);
+static HttpConnection_t* FindConnection(HttpTracker_t* t, const PacketView_t* view, bool insert);
+static void ReleaseConnection(HttpTracker_t* t, HttpConnection_t* conn);
+static int FindEndpoint(HttpTracker_t* t, HttpMethod_t method, const char* path);
+static void CopyPath(const HttpStartLine_t* line, char* path, size_t pathSize);
+static void PathPrefix(const char* path, size_t segments, char* prefix, size_t prefixSize);
+static uint64_t HashEndpoint(HttpMethod_t method, const char* prefix);
+
+size_t HttpFindDelimiter(const uint8_t* data, size_t size)
+{
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i space = _mm_set1_epi8(' '), cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+  for (; i + 16 <= size; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*) (data + i));
+    __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, cr)), _mm_cmpeq_epi8(v, lf));
+    int mask = _mm_movemask_epi8(eq);
+    if (mask != 0)
+      return i + (size_t) __builtin_ctz((unsigned int) mask);
+  }
+#endif
+  for (; i < size; ++i) {
+    if (data[i] == ' ' || data[i] == '\r' || data[i] == '\n')
+      return i;
+  }
+  return size;
+}
+
+int HttpParseStartLine(const uint8_t* data, size_t size, HttpStartLine_t* line)
+{
+  memset(line, 0, sizeof(HttpStartLine_t));
+  if (size == 0)
+    return 0;
+  if (!IsHttpPrefix(data, size))
+    return -1;
+
+  if (data[0] == 'H' && size >= 5 && memcmp(data, "HTTP/", 5) == 0) {
+    // HTTP/1.x SP 3DIGIT SP reason CRLF
+    if (size < HTTP_VERSION_SIZE + 4)
+      return 0;
+    if (memcmp(data, "HTTP/1.", 7) != 0 || data[7] < '0' || data[7] > '9' || data[8] != ' ')
+      return -1;
+
+    uint16_t status = 0;
+    for (int i = 9; i < 12; ++i) {
+      if (data[i] < '0' || data[i] > '9')
+        return -1;
+      status = (uint16_t) (status * 10 + (data[i] - '0'));
+    }
+
+    const uint8_t* end = memchr(data + 12, '\r', size - 12);
+    if (end == NULL || end + 1 >= data + size)
+      return 0;
+    if (end[1] != '\n')
+      return -1;
+
+    line->Response = true;
+    line->VersionMinor = (uint8_t) (data[7] - '0');
+    line->Status = status;
+    line->Reason = data + 12 + (data[12] == ' ' ? 1 : 0);
+    line->ReasonSize = (size_t) (end - line->Reason);
+    return (int) (end - data) + 2;
+  }
+
+  // METHOD SP request-target SP HTTP/1.x CRLF
+  size_t methodEnd = HttpFindDelimiter(data, size < HTTP_METHOD_MAX_SIZE + 1 ? size : HTTP_METHOD_MAX_SIZE + 1);
+  if (methodEnd == size)
+    return size <= HTTP_METHOD_MAX_SIZE ? 0 : -1;
+  if (data[methodEnd] != ' ' || (line->Method = ParseMethod(data, methodEnd)) == HttpMethod_UNKNOWN)
+    return -1;
+
+  size_t targetStart = methodEnd + 1;
+  size_t targetEnd = targetStart + HttpFindDelimiter(data + targetStart, size - targetStart);
+  if (targetEnd == size)
+    return 0;
+  if (data[targetEnd] != ' ' || targetEnd == targetStart)
+    return -1;
+
+  size_t versionStart = targetEnd + 1;
+  if (versionStart + HTTP_VERSION_SIZE + 2 > size)
+    return 0;
+  if (memcmp(data + versionStart, "HTTP/1.", 7) != 0 || data[versionStart + 7] < '0' ||
+      data[versionStart + 7] > '9' || data[versionStart + 8] != '\r' || data[versionStart + 9] != '\n')
+    return -1;
+
+  line->Target = data + targetStart;
+  line->TargetSize = targetEnd - targetStart;
+  line->VersionMinor = (uint8_t) (data[versionStart + 7] - '0');
+  return (int) (versionStart + HTTP_VERSION_SIZE + 2);
+}
+
+const char* HttpMethodToString(HttpMethod_t method)
+{
+  return method < HttpMethod_COUNT ? HttpMethodNames[method] : HttpMethodNames[HttpMethod_UNKNOWN];
+}
+
+void HttpTrackerInit(HttpTracker_t* t, size_t capacity)
+{
+  ASSERT("Cannot init the HTTP tracker: t == NULL.", t != NULL);
+
+  size_t pow2 = 1;
+  while (pow2 < capacity)
+    pow2 <<= 1;
+
+  t->Requests = 0;
+  t->Responses = 0;
+  t->Matched = 0;
+  t->Unmatched = 0;
+  t->Unanswered = 0;
+  t->Reassembled = 0;
+  HistogramInit(&t->Latency);
+
+  t->Endpoints = malloc(sizeof(HttpEndpointStats_t) * HTTP_ENDPOINT_STATS_MAX_COUNT);
+  ASSERT("Cannot initialize a new HTTP endpoints table: malloc returned 'NULL'.", t->Endpoints != NULL);
+  t->EndpointsCount = 0;
+  memset(&t->OtherEndpoints, 0, sizeof(t->OtherEndpoints));
+  strncpy(t->OtherEndpoints.PathPrefix, "(other endpoints)", HTTP_PATH_MAX_SIZE);
+  HistogramInit(&t->OtherEndpoints.Latency);
+  t->PathPrefixSegments = HTTP_PATH_PREFIX_SEGMENTS;
+
+  t->__connections = calloc(pow2, sizeof(HttpConnection_t));
+  ASSERT("Cannot initialize a new HTTP connections table: calloc returned 'NULL'.", t->__connections != NULL);
+  t->__capacity = pow2;
+}
+
+int HttpTrackerProcess(HttpTracker_t* t, const PacketView_t* view, const TimeInfo_t* time, HttpEvent_t* event)
+{
+  if (view->Protocol != Protocol_TCP)
+    return 0;
+
+  uint64_t now = TimeInfoToMicroseconds(time);
+  const uint8_t* payload = (const uint8_t*) view->Payload;
+  size_t payloadSize = view->PayloadSize;
+
+  HttpStartLine_t line;
+  int rc = -1;
+  HttpConnection_t* conn = NULL;
+
+  if (payloadSize > 0) {
+    bool carried = false;
+    conn = FindConnection(t, view, false);
+    if (conn != NULL && conn->CarrySize > 0 && conn->CarryAddress == view->SourceAddress &&
+        conn->CarryPort == view->SourcePort) {
+      carried = conn->CarryNextSeq == view->SequenceNumber;
+      if (carried) {
+        size_t chunk = HTTP_CARRY_MAX_SIZE - conn->CarrySize;
+        if (chunk > payloadSize)
+          chunk = payloadSize;
+        memcpy(conn->Carry + conn->CarrySize, payload, chunk);
+        conn->CarrySize = (uint16_t) (conn->CarrySize + chunk);
+        conn->CarryNextSeq += (uint32_t) chunk;
+
+        rc = HttpParseStartLine(conn->Carry, conn->CarrySize, &line);
+        if (rc > 0)
+          t->Reassembled++;
+        if (rc != 0 || conn->CarrySize == HTTP_CARRY_MAX_SIZE)
+          conn->CarrySize = 0;
+      } else {
+        conn->CarrySize = 0; // out of order or retransmission, the segment is parsed alone
+      }
+    }
+    if (!carried) {
+      rc = HttpParseStartLine(payload, payloadSize, &line);
+      if (rc == 0 && payloadSize < HTTP_CARRY_MAX_SIZE && (conn = FindConnection(t, view, true)) != NULL) {
+        memcpy(conn->Carry, payload, payloadSize);
+        conn->CarrySize = (uint16_t) payloadSize;
+        conn->CarryNextSeq = view->SequenceNumber + (uint32_t) payloadSize;
+        conn->CarryAddress = view->SourceAddress;
+        conn->CarryPort = view->SourcePort;
+        conn->LastSeenUs = now;
+      }
+    }
+  }
+
+  if (rc <= 0) {
+    if (view->TCPFlags & (TCPFlag_RST | TCPFlag_FIN)) {
+      conn = FindConnection(t, view, false);
+      if (conn != NULL && (view->TCPFlags & TCPFlag_RST || conn->PendingCount == 0))
+        ReleaseConnection(t, conn);
+    }
+    return 0;
+  }
+
+  memset(event, 0, sizeof(HttpEvent_t));
+  event->Response = line.Response;
+
+  if (!line.Response) {
+    t->Requests++;
+    event->Method = line.Method;
+    CopyPath(&line, event->Path, sizeof(event->Path));
+
+    conn = FindConnection(t, view, true);
+    if (conn->ClientAddress != view->SourceAddress || conn->ClientPort != view->SourcePort) {
+      // the first decoded message of this connection was not a request
+      conn->ServerAddress = conn->ClientAddress;
+      conn->ServerPort = conn->ClientPort;
+      conn->ClientAddress = view->SourceAddress;
+      conn->ClientPort = view->SourcePort;
+    }
+    conn->LastSeenUs = now;
+
+    if (conn->PendingCount == HTTP_PIPELINE_MAX_COUNT) {
+      conn->PendingHead = (uint8_t) ((conn->PendingHead + 1) % HTTP_PIPELINE_MAX_COUNT);
+      conn->PendingCount--;
+      t->Unanswered++;
+    }
+
+    struct HttpPendingRequest_t* req =
+        &conn->Pending[(conn->PendingHead + conn->PendingCount) % HTTP_PIPELINE_MAX_COUNT];
+    req->Method = line.Method;
+    req->EndpointIndex = FindEndpoint(t, line.Method, event->Path);
+    req->TimestampUs = now;
+    conn->PendingCount++;
+    return 1;
+  }
+
+  t->Responses++;
+  event->Status = line.Status;
+
+  conn = FindConnection(t, view, false);
+  if (conn == NULL || conn->PendingCount == 0 || conn->ClientAddress != view->DestinationAddress ||
+      conn->ClientPort != view->DestinationPort) {
+    t->Unmatched++;
+    return 1;
+  }
+  conn->LastSeenUs = now;
+
+  struct HttpPendingRequest_t* req = &conn->Pending[conn->PendingHead];
+  event->Matched = true;
+  event->Method = req->Method;
+  event->LatencyUs = now >= req->TimestampUs ? now - req->TimestampUs : 0;
+
+  HttpEndpointStats_t* endpoint = req->EndpointIndex >= 0 ? &t->Endpoints[req->EndpointIndex] : &t->OtherEndpoints;
+  strncpy(event->Path, endpoint->PathPrefix, sizeof(event->Path));
+  event->Path[sizeof(event->Path) - 1] = '\0';
+
+  if (line.Status >= 100 && line.Status < 200 && line.Status != 101)
+    return 1; // interim response, the final response follows
+
+  conn->PendingHead = (uint8_t) ((conn->PendingHead + 1) % HTTP_PIPELINE_MAX_COUNT);
+  conn->PendingCount--;
+
+  t->Matched++;
+  HistogramAdd(&t->Latency, event->LatencyUs);
+  HistogramAdd(&endpoint->Latency, event->LatencyUs);
+  endpoint->StatusClasses[line.Status / 100 < HTTP_STATUS_CLASSES_COUNT ? line.Status / 100 : 0]++;
+
+  if (view->TCPFlags & (TCPFlag_RST | TCPFlag_FIN) && conn->PendingCount == 0)
+    ReleaseConnection(t, conn);
+  return 1;
+}
+
+void HttpTrackerClear(HttpTracker_t* t)
+{
+  if (t == NULL)
+    return;
+
+  free(t->__connections);
+  free(t->Endpoints);
+  t->__connections = NULL;
+  t->Endpoints = NULL;
+}
+
+HttpMethod_t ParseMethod(const uint8_t* data, size_t size)
+{
+  for (int m = HttpMethod_GET; m < HttpMethod_COUNT; ++m) {
+    if (strlen(HttpMethodNames[m]) == size && memcmp(HttpMethodNames[m], data, size) == 0)
+      return (HttpMethod_t) m;
+  }
+  return HttpMethod_UNKNOWN;
+}
+
+bool IsHttpPrefix(const uint8_t* data, size_t size)
+{
+  /*
+   * Cheap check of the first bytes, most of TCP segments are rejected here.
+   */
+  static const char* prefixes[] = {"HTTP/", "GET ", "HEAD ", "POST ", "PUT ", "DELETE ", "CONNECT ", "OPTIONS ", "TRACE ",
+                                   "PATCH "};
+  for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i) {
+    size_t len = strlen(prefixes[i]);
+    if (memcmp(data, prefixes[i], size < len ? size : len) == 0)
+      return true;
+  }
+  return false;
+}
+
+HttpConnection_t* FindConnection(HttpTracker_t* t, const PacketView_t* view, bool insert)
+{
+  /*
+   * The hash does not depend on the direction, both directions share one entry.
+   */
+  uint64_t a = (uint64_t) view->SourceAddress << 16 | view->SourcePort;
+  uint64_t b = (uint64_t) view->DestinationAddress << 16 | view->DestinationPort;
+  uint64_t key = (a < b ? a * 31 + b : b * 31 + a) * 0x9E3779B97F4A7C15ULL;
+  size_t index = (size_t) (key >> 32) & (t->__capacity - 1);
+
+  HttpConnection_t* freeSlot = NULL;
+  HttpConnection_t* oldest = NULL;
+  for (size_t i = 0; i < HTTP_CONNECTION_PROBES_COUNT; ++i) {
+    HttpConnection_t* conn = &t->__connections[(index + i) & (t->__capacity - 1)];
+    if (!conn->Used) {
+      if (freeSlot == NULL)
+        freeSlot = conn;
+      continue;
+    }
+
+    if ((conn->ClientAddress == view->SourceAddress && conn->ClientPort == view->SourcePort &&
+         conn->ServerAddress == view->DestinationAddress && conn->ServerPort == view->DestinationPort) ||
+        (conn->ClientAddress == view->DestinationAddress && conn->ClientPort == view->DestinationPort &&
+         conn->ServerAddress == view->SourceAddress && conn->ServerPort == view->SourcePort))
+      return conn;
+
+    if (oldest == NULL || conn->LastSeenUs < oldest->LastSeenUs)
+      oldest = conn;
+  }
+
+  if (!insert)
+    return NULL;
+
+  HttpConnection_t* conn = freeSlot;
+  if (conn == NULL) {
+    conn = oldest;
+    ReleaseConnection(t, conn);
+  }
+
+  memset(conn, 0, sizeof(HttpConnection_t));
+  conn->Used = true;
+  conn->ClientAddress = view->SourceAddress;
+  conn->ClientPort = view->SourcePort;
+  conn->ServerAddress = view->DestinationAddress;
+  conn->ServerPort = view->DestinationPort;
+  return conn;
+}
+
+void ReleaseConnection(HttpTracker_t* t, HttpConnection_t* conn)
+{
+  t->Unanswered += conn->PendingCount;
+  conn->Used = false;
+  conn->PendingCount = 0;
+  conn->CarrySize = 0;
+}
+
+int FindEndpoint(HttpTracker_t* t, HttpMethod_t method, const char* path)
+{
+  char prefix[HTTP_PATH_MAX_SIZE];
+  PathPrefix(path, t->PathPrefixSegments, prefix, sizeof(prefix));
+
+  uint64_t hash = HashEndpoint(method, prefix);
+  for (size_t i = 0; i < t->EndpointsCount; ++i) {
+    if (t->Endpoints[i].Hash == hash)
+      return (int) i;
+  }
+
+  if (t->EndpointsCount == HTTP_ENDPOINT_STATS_MAX_COUNT)
+    return -1;
+
+  HttpEndpointStats_t* endpoint = &t->Endpoints[t->EndpointsCount];
+  memset(endpoint, 0, sizeof(HttpEndpointStats_t));
+  endpoint->Method = method;
+  strncpy(endpoint->PathPrefix, prefix, HTTP_PATH_MAX_SIZE);
+  endpoint->Hash = hash;
+  HistogramInit(&endpoint->Latency);
+  return (int) t->EndpointsCount++;
+}
+
+void CopyPath(const HttpStartLine_t* line, char* path, size_t pathSize)
+{
+  size_t size = line->TargetSize < pathSize - 1 ? line->TargetSize : pathSize - 1;
+  for (size_t i = 0; i < size; ++i)
+    path[i] = (line->Target[i] >= 0x20 && line->Target[i] < 0x7F) ? (char) line->Target[i] : '?';
+  path[size] = '\0';
+}
+
+void PathPrefix(const char* path, size_t segments, char* prefix, size_t prefixSize)
+{
+  // absolute-form: http://host/path
+  const char* scheme = strstr(path, "://");
+  if (scheme != NULL && scheme < strchr(path, '/')) {
+    const char* slash = strchr(scheme + 3, '/');
+    path = slash != NULL ? slash : "/";
+  }
+
+  size_t length = 0, seen = 0;
+  for (; path[length] != '\0' && path[length] != '?' && path[length] != '#' && length < prefixSize - 1; ++length) {
+    if (path[length] == '/' && length > 0 && ++seen == segments)
+      break;
+  }
+  memcpy(prefix, path, length);
+  prefix[length] = '\0';
+}
+
+uint64_t HashEndpoint(HttpMethod_t method, const char* prefix)
+{
+  uint64_t hash = 14695981039346656037ULL ^ (uint64_t) method; // FNV-1a
+  for (; *prefix != '\0'; ++prefix)
+    hash = (hash ^ (uint8_t) *prefix) * 1099511628211ULL;
+  return hash;
+}
@@ -0,0 +1,179 @@
+#ifndef __HTTP_H
+#define __HTTP_H
+
+#include "structures.h"
+#include "histogram.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HTTP_PATH_MAX_SIZE 128
+#define HTTP_PATH_PREFIX_SEGMENTS 2
+#define HTTP_CARRY_MAX_SIZE 128
+#define HTTP_PIPELINE_MAX_COUNT 4
+#define HTTP_CONNECTIONS_DEFAULT_CAPACITY 4096
+#define HTTP_ENDPOINT_STATS_MAX_COUNT 128
+#define HTTP_STATUS_CLASSES_COUNT 6 /* 0 (invalid), 1xx-5xx */
+
+/**
+ * @brief HttpMethod_t
+ * HTTP request methods.
+ */
+typedef enum
+{
+  HttpMethod_UNKNOWN = 0,
+  HttpMethod_GET,
+  HttpMethod_HEAD,
+  HttpMethod_POST,
+  HttpMethod_PUT,
+  HttpMethod_DELETE,
+  HttpMethod_CONNECT,
+  HttpMethod_OPTIONS,
+  HttpMethod_TRACE,
+  HttpMethod_PATCH,
+  HttpMethod_COUNT
+} HttpMethod_t;
+
+/**
+ * @brief HttpStartLine_t
+ * Decoded request line or status line. Target and Reason point into the parsed data.
+ */
+typedef struct
+{
+  bool Response;         //! Status line
+  HttpMethod_t Method;   //! Request method
+  const uint8_t* Target; //! Request target
+  size_t TargetSize;     //! Size of the request target
+  uint8_t VersionMinor;  //! HTTP/1.x
+  uint16_t Status;       //! Response status code
+  const uint8_t* Reason; //! Response reason phrase
+  size_t ReasonSize;     //! Size of the response reason phrase
+} HttpStartLine_t;
+
+/**
+ * @brief HttpEvent_t
+ * The result of processing a TCP segment by the tracker.
+ */
+typedef struct
+{
+  bool Response;                 //! Response (otherwise request)
+  HttpMethod_t Method;           //! Method of the request (or of the matched request)
+  char Path[HTTP_PATH_MAX_SIZE]; //! Request target (truncated), or the endpoint of the matched request
+  uint16_t Status;               //! Response status code
+  bool Matched;                  //! The response was matched to the request
+  uint64_t LatencyUs;            //! Response time (if matched)
+} HttpEvent_t;
+
+/**
+ * @brief HttpEndpointStats_t
+ * Response time histogram of the (method, path prefix) pair.
+ */
+typedef struct
+{
+  HttpMethod_t Method;
+  char PathPrefix[HTTP_PATH_MAX_SIZE];
+  uint64_t Hash;
+  Histogram_t Latency;
+  uint64_t StatusClasses[HTTP_STATUS_CLASSES_COUNT];
+} HttpEndpointStats_t;
+
+/**
+ * @brief HttpConnection_t
+ * State of the TCP connection: requests waiting for responses and the incomplete start line.
+ */
+typedef struct
+{
+  bool Used;
+  uint32_t ClientAddress;
+  uint32_t ServerAddress;
+  uint16_t ClientPort;
+  uint16_t ServerPort;
+  uint64_t LastSeenUs;
+  struct HttpPendingRequest_t
+  {
+    int EndpointIndex;
+    HttpMethod_t Method;
+    uint64_t TimestampUs;
+  } Pending[HTTP_PIPELINE_MAX_COUNT];
+  uint8_t PendingHead;
+  uint8_t PendingCount;
+  uint8_t Carry[HTTP_CARRY_MAX_SIZE]; //! Beginning of the start line split across segments
+  uint16_t CarrySize;                 //! Size of the incomplete start line
+  uint32_t CarryNextSeq;              //! Sequence number of the segment which continues the start line
+  uint32_t CarryAddress;              //! Sender of the incomplete start line
+  uint16_t CarryPort;                 //! Sender port of the incomplete start line
+} HttpConnection_t;
+
+/**
+ * @brief HttpTracker_t
+ * Pairs HTTP/1.x requests with responses on the same connection and collects response time histograms per (method,
+ * path prefix).
+ */
+typedef struct
+{
+  uint64_t Requests;                  //! Decoded requests
+  uint64_t Responses;                 //! Decoded responses
+  uint64_t Matched;                   //! Responses matched to requests
+  uint64_t Unmatched;                 //! Responses without requests
+  uint64_t Unanswered;                //! Requests without responses (connection closed or evicted)
+  uint64_t Reassembled;               //! Start lines reassembled from several segments
+  Histogram_t Latency;                //! Response time of all requests (microseconds)
+  HttpEndpointStats_t* Endpoints;     //! Response time per (method, path prefix)
+  size_t EndpointsCount;              //! Endpoints count
+  HttpEndpointStats_t OtherEndpoints; //! Endpoints which do not fit into Endpoints
+  size_t PathPrefixSegments;          //! Path segments in the endpoint key
+  // private fields
+  HttpConnection_t* __connections;
+  size_t __capacity;
+} HttpTracker_t;
+
+/**
+ * @brief HttpFindDelimiter
+ * Finds the first space, CR or LF character. Uses SSE2 if it is available.
+ * @param data The data
+ * @param size Size of the data
+ * @return The index of the delimiter, or size if not found.
+ */
+size_t HttpFindDelimiter(const uint8_t* data, size_t size);
+/**
+ * @brief HttpParseStartLine
+ * Parses the HTTP/1.x request line or status line. Does not allocate memory.
+ * @param data The pointer to the TCP payload
+ * @param size Size of the TCP payload
+ * @param line The pointer to the decoded line
+ * @return The size of the start line (with CRLF) if it was decoded, 0 if the data is incomplete, -1 if the data is not
+ * an HTTP/1.x start line.
+ */
+int HttpParseStartLine(const uint8_t* data, size_t size, HttpStartLine_t* line);
+/**
+ * @brief HttpMethodToString
+ * @param method The request method
+ * @return The name of the request method.
+ */
+const char* HttpMethodToString(HttpMethod_t method);
+
+/**
+ * @brief HttpTrackerInit
+ * Initializes values for the new tracker object.
+ * @param t The pointer to the tracker object
+ * @param capacity Max count of tracked connections (rounded up to the power of two)
+ */
+void HttpTrackerInit(HttpTracker_t* t, size_t capacity);
+/**
+ * @brief HttpTrackerProcess
+ * Decodes the start line of the TCP segment. Start lines split across segments are reassembled (in order segments
+ * only). Requests are stored in the connection state, responses are matched to them in order.
+ * @param t The pointer to the tracker object
+ * @param view The decoded packet
+ * @param time The packet timestamp
+ * @param event The pointer to the result
+ * @return 1 if the start line was decoded, otherwise 0.
+ */
+int HttpTrackerProcess(HttpTracker_t* t, const PacketView_t* view, const TimeInfo_t* time, HttpEvent_t* event);
+/**
+ * @brief HttpTrackerClear
+ * Clears the passed tracker object.
+ * @param t The pointer to the tracker object
+ */
+void HttpTrackerClear(HttpTracker_t* t);
+
+#endif // __HTTP_H
@@ -1,9 +1,13 @@
-#include "sniffer.h"
-#include "cmdargs.h"
-#include "printing.h"
+#include "packetpath.h"
 #include "utils.h"
 
+#ifdef ALLOCATION_AUDIT_ENABLED
+#include "allocaudit.h"
+#endif
+
+#include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 #include <stdatomic.h>
 
@@ -11,6 +15,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <sys/inotify.h>
 
 typedef void* ThreadArgs_t;
 typedef void* ThreadReturnValue_t;
@@ -25,11 +30,39 @@ typedef DWORD ThreadReturnValue_t;
 #define FAIL_THREAD FALSE
 #endif
 
-static PROCESSING_HANDLER_FUNC(PrintPacket, owner, buffer, size, time, args);
+/**
+ * @brief CaptureThreadArgs_t
+ * Arguments of the capture thread.
+ */
+typedef struct
+{
+  Sniffer_t* Sniffer;
+  PrintingContext_t* Context;
+} CaptureThreadArgs_t;
+
+static void ReadCaptureStats(
+    Sniffer_t* sniffer, const PrintingContext_t* context, CaptureStats_t* stats, uint64_t* suppressed, uint64_t* waits);
+static void PrintCaptureStatsInterval(Sniffer_t* sniffer, const PrintingContext_t* context, CaptureStats_t* previous);
+static size_t PrintControlStats(char* buffer, size_t bufferSize, void* args);
+static void ReportRecorderDump(const RecorderDump_t* dump, void* args);
+static void ClearCapture(Sniffer_t* sniffer, RuleSet_t* rules, int rulesWatch, PrintingContext_t* context);
+static void PrintTrafficDashboardInterval(const Sniffer_t* sniffer,
+                                          const PrintingContext_t* context,
+                                          TrafficStats_t* previous,
+                                          uint64_t* previousUs,
+                                          bool redraw);
+static void PublishMetrics(Sniffer_t* sniffer, PrintingContext_t* context, uint64_t nowUs);
 static ThreadReturnValue_t StartSniffingPackets(ThreadArgs_t args);
 
 static atomic_int IsRunning = 0;
 static void SignalHandler(int sig);
+static atomic_int ReloadRequested = 0;
+static void ReloadSignalHandler(int sig);
+static atomic_int DumpRequested = 0;
+static void DumpSignalHandler(int sig);
+static int WatchRulesFile(const char* path);
+static bool RulesFileChanged(int watch, const char* path);
+static void ReloadRules(RuleSet_t* rules, const char* path);
 
 static
 #ifdef __linux__
@@ -66,13 +99,25 @@ int main(int argc, char** argv)
 
   signal(SIGINT, SignalHandler);
   signal(SIGTERM, SignalHandler);
+#ifdef __linux__
+  signal(SIGHUP, ReloadSignalHandler);
+  signal(SIGUSR2, DumpSignalHandler);
+#endif
 
-  PacketBuffers_t buffers;
+  PrintingContext_t context;
+  PrintingContextInit(&context, args.Format, (size_t) args.PayloadBytes);
 #ifdef __linux
   SetPromiscMode(args.PromiscMode);
 #endif
   Sniffer_t sniffer;
-  if (SnifferInit(&sniffer, args.Interface, PrintPacket, &buffers) < 0) {
+  // the handler is measured for the metrics endpoint
+  bool metricsEnabled = false;
+  bool controlEnabled = false;
+#ifdef __linux__
+  metricsEnabled = strlen(args.MetricsAddress) > 0;
+  controlEnabled = strlen(args.ControlPath) > 0;
+#endif
+  if (SnifferInit(&sniffer, args.Interface, metricsEnabled ? MeasurePacket : ProcessPacket, &context) < 0) {
     printf("%s\n", sniffer.ErrorMessage);
     SnifferClear(&sniffer);
     return 1;
@@ -89,25 +134,223 @@ int main(int argc, char** argv)
 #ifdef __linux__
   SnifferIncludeETHHeader(&sniffer, args.IncludeETHHeader);
 #endif
-
-  PacketBuffersInit(&buffers);
-
-  if (SnifferStart(&sniffer) < 0) {
+  if (SnifferVerifyChecksums(&sniffer, args.VerifyChecksums, args.BadChecksumsOnly) < 0) {
     printf("%s\n", sniffer.ErrorMessage);
     SnifferClear(&sniffer);
-    PacketBuffersDelete(&buffers);
     return 1;
   }
+  if (args.DecodeTls && SnifferDecodeTls(&sniffer) < 0) {
+    printf("%s\n", sniffer.ErrorMessage);
+    SnifferClear(&sniffer);
+    return 1;
+  }
+  // the table is swapped by the main thread on SIGHUP or the change of the file, and by commands of the control socket
+  RuleSet_t rules;
+  RuleSetInit(&rules, NULL);
+  int rulesWatch = -1;
+  if (strlen(args.RulesPath) > 0) {
+    RuleTable_t* table = RuleTableLoad(args.RulesPath, &errorMsg);
+    if (table == NULL) {
+      printf("%s\n", errorMsg);
+      free(errorMsg);
+      SnifferClear(&sniffer);
+      return 1;
+    }
+    fprintf(stderr,
+            "Loaded %zu rules from '%s' in %.1f ms.\n",
+            table->Count,
+            table->Path,
+            (double) table->LoadNs / 1e6);
+    RuleSetInit(&rules, table);
+    rulesWatch = WatchRulesFile(args.RulesPath);
+  } else if (controlEnabled)
+    RuleSetInit(&rules, RuleTableParse("", 0, &errorMsg));
+  if (RuleSetCurrent(&rules) != NULL && SnifferSetRules(&sniffer, &rules) < 0) {
+    printf("%s\n", sniffer.ErrorMessage);
+    RuleSetClear(&rules);
+    SnifferClear(&sniffer);
+    return 1;
+  }
+
+  PacketBuffersInit(&context.Buffers);
+  context.Buffers.AsciiGutter = args.HexAscii;
+  OutputInit(&context.Output, fileno(stdout), (size_t) args.FlushSize, args.FlushIntervalMs);
+  if (context.Format == OutputFormat_JSON) {
+    context.RecordBuffer = malloc(PACKET_RECORD_JSON_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", context.RecordBuffer != NULL);
+  } else if (context.Format == OutputFormat_BINARY) {
+    PacketRecordStreamHeader_t header;
+    PacketRecordStreamHeaderInit(&header);
+    OutputWrite(&context.Output, (const char*) &header, sizeof(header));
+  }
+  // the statistics must not be mixed with records
+  FILE* statsStream = context.Format == OutputFormat_JSON || context.Format == OutputFormat_BINARY ? stderr : stdout;
+
+  DnsTracker_t dnsTracker;
+  if (args.DecodeDns) {
+    DnsTrackerInit(&dnsTracker, DNS_PENDING_QUERIES_DEFAULT_CAPACITY);
+    context.Dns = &dnsTracker;
+  }
+  HttpTracker_t httpTracker;
+  if (args.DecodeHttp) {
+    HttpTrackerInit(&httpTracker, HTTP_CONNECTIONS_DEFAULT_CAPACITY);
+    context.Http = &httpTracker;
+  }
+  if (context.Format == OutputFormat_TEXT && (context.Dns != NULL || context.Http != NULL || sniffer.Tls != NULL)) {
+    context.DecodedBuffer = malloc(DECODED_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", context.DecodedBuffer != NULL);
+  }
+  TcpAnalyzer_t tcpAnalyzer;
+  if (args.AnalyzeTcp) {
+    TcpAnalyzerInit(&tcpAnalyzer, TCP_FLOWS_DEFAULT_CAPACITY);
+    context.Tcp = &tcpAnalyzer;
+    if (context.Format == OutputFormat_TEXT) {
+      context.AnalysisBuffer = malloc(DECODED_BUFFER_SUFFICIENT_SIZE);
+      ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", context.AnalysisBuffer != NULL);
+    }
+  }
+  Sampler_t sampler;
+  SamplerInit(&sampler, args.SampleFlows, args.SampleEvery, args.SampleRandom, args.MaxRate);
+  if (SamplerEnabled(&sampler))
+    context.Sampler = &sampler;
+  TrafficStats_t traffic;
+  if (context.Format == OutputFormat_STATS || metricsEnabled) {
+    TrafficStatsInit(&traffic);
+    context.Traffic = &traffic;
+  }
+#ifdef __linux__
+  MetricsServer_t metrics;
+  Histogram_t handlerLatency;
+  if (metricsEnabled) {
+    MetricsInit(&metrics, &sniffer);
+    if (MetricsListen(&metrics, args.MetricsAddress) < 0) {
+      printf("%s\n", metrics.ErrorMessage);
+      MetricsClear(&metrics);
+      ClearCapture(&sniffer, &rules, rulesWatch, &context);
+      return 1;
+    }
+    HistogramInit(&handlerLatency);
+    context.HandlerLatency = &handlerLatency;
+    context.Metrics = &metrics;
+  }
+#endif
+  // commands are executed by the thread of the server, the capture thread only sees new tables and the pcap file
+  CaptureThreadArgs_t captureArgs = {&sniffer, &context};
+  ControlServer_t control;
+  PcapSink_t pcap;
+  PcapSinkInit(&pcap);
+  if (controlEnabled) {
+    ControlInit(&control, &rules, &pcap, sniffer.ETHHeaderIncluded ? PCAP_LINKTYPE_ETHERNET : PCAP_LINKTYPE_RAW);
+    ControlSetStatsHandler(&control, PrintControlStats, &captureArgs);
+#ifdef __linux__
+    if (ControlListen(&control, args.ControlPath) < 0) {
+      printf("%s\n", control.ErrorMessage);
+      ControlClear(&control);
+      ClearCapture(&sniffer, &rules, rulesWatch, &context);
+      return 1;
+    }
+#endif
+    context.Control = &control;
+    context.Pcap = &pcap;
+  }
+  // packets are copied to the arena by the capture thread, dumps are written by the thread of the recorder
+  FlightRecorder_t recorder;
+#ifdef __linux__
+  if (args.FlightRecorderSize > 0) {
+    FlightRecorderInit(&recorder,
+                       (size_t) args.FlightRecorderSize,
+                       args.FlightRecorderWindowSec,
+                       sniffer.ETHHeaderIncluded ? PCAP_LINKTYPE_ETHERNET : PCAP_LINKTYPE_RAW);
+    FlightRecorderSetDumpHandler(&recorder, ReportRecorderDump, NULL);
+    context.Recorder = &recorder;
+    if (args.DumpOnRst)
+      context.DumpOnRstPort = (int64_t) args.DumpOnRstPort;
+    if (context.Control != NULL)
+      ControlSetRecorder(context.Control, context.Recorder);
+  }
+#endif
+  // segments are written by the capture thread, their indexes by the index thread of the storage
+  StorageWriter_t storage;
+#ifdef __linux__
+  if (strlen(args.StorePath) > 0) {
+    StorageWriterInit(&storage,
+                      args.StorePath,
+                      args.StoreSegmentSize,
+                      sniffer.ETHHeaderIncluded ? PCAP_LINKTYPE_ETHERNET : PCAP_LINKTYPE_RAW);
+    StorageWriterSetCompression(&storage, args.StoreCompressThreads);
+    if (StorageWriterStart(&storage) < 0) {
+      printf("%s\n", storage.ErrorMessage);
+      StorageWriterClear(&storage);
+      ClearCapture(&sniffer, &rules, rulesWatch, &context);
+      return 1;
+    }
+    context.Storage = &storage;
+  }
+#endif
+  FormatPool_t formatPool;
+  if (context.Format == OutputFormat_TEXT && args.FormatThreads > 0) {
+    context.WorkersCount = (size_t) args.FormatThreads;
+    context.WorkerBuffers = malloc(sizeof(PacketBuffers_t) * context.WorkersCount);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", context.WorkerBuffers != NULL);
+    for (size_t i = 0; i < context.WorkersCount; ++i) {
+      PacketBuffersInit(&context.WorkerBuffers[i]);
+      context.WorkerBuffers[i].AsciiGutter = args.HexAscii;
+    }
+    FormatPoolInit(&formatPool,
+                   context.WorkersCount,
+                   context.WorkersCount * FORMAT_POOL_JOBS_PER_THREAD,
+                   TEXT_RECORD_INPUT_SIZE,
+                   FormatTextRecord,
+                   &context,
+                   &context.Output);
+    context.Pool = &formatPool;
+  }
+  // stages run inline in the capture thread, trackers and the sniffer keep the state of the current packet
+  Pipeline_t pipeline;
+  PipelineInit(&pipeline, PIPELINE_BATCH_DEFAULT_SIZE, PIPELINE_QUEUE_DEFAULT_DEPTH);
+  context.Pipeline = &pipeline;
+  context.Sniffer = &sniffer;
+
+#ifdef PROFILING_ENABLED
+  if (args.Profile)
+    ProfileEnable();
+#endif
+
+  if (AddPipelineStages(&context) < 0 || PipelineStart(context.Pipeline) < 0 || SnifferStart(&sniffer) < 0) {
+    printf("%s\n", pipeline.ErrorMessage != NULL ? pipeline.ErrorMessage : sniffer.ErrorMessage);
+    ClearCapture(&sniffer, &rules, rulesWatch, &context);
+    return 1;
+  }
+
+  if (OutputStart(&context.Output) < 0)
+    printf("Cannot start the output thread, the output is written synchronously: %s\n", GetLastErrorMessage());
+  if (context.Pool != NULL && FormatPoolStart(context.Pool) < 0)
+    printf("Cannot start format threads, records are formatted by the capture thread: %s\n", GetLastErrorMessage());
+  if (context.Metrics != NULL && MetricsStart(context.Metrics) < 0)
+    printf("%s\n", context.Metrics->ErrorMessage);
+  if (context.Recorder != NULL && FlightRecorderStart(context.Recorder) < 0)
+    printf("%s\n", context.Recorder->ErrorMessage);
 
   InitMainMutex();
+  if (context.Control != NULL && ControlStart(context.Control) < 0)
+    printf("%s\n", context.Control->ErrorMessage);
 #ifdef __linux__
   pthread_t snifferThread;
-  pthread_create(&snifferThread, NULL, StartSniffingPackets, &sniffer);
+  pthread_create(&snifferThread, NULL, StartSniffingPackets, &captureArgs);
 #elif _WIN32
   HANDLE snifferThread = CreateThread(
-      NULL, 0, (LPTHREAD_START_ROUTINE) StartSniffingPackets, &sniffer, STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
+      NULL, 0, (LPTHREAD_START_ROUTINE) StartSniffingPackets, &captureArgs, STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
 #endif
 
+  uint64_t statsIntervalUs = args.StatsIntervalSec * 1000000;
+  uint64_t nextStatsUs = GetMonotonicTimeUs() + statsIntervalUs;
+  CaptureStats_t previousStats;
+  memset(&previousStats, 0, sizeof(previousStats));
+  uint64_t dashboardUs = GetMonotonicTimeUs();
+  bool dashboardDrawn = false;
+  TrafficStats_t previousTraffic;
+  TrafficStatsInit(&previousTraffic);
+
   IsRunning = 1;
   while (IsRunning) {
 #ifdef __linux__
@@ -115,6 +358,23 @@ int main(int argc, char** argv)
 #elif _WIN32
     Sleep(500);
 #endif
+    if (statsIntervalUs > 0 && GetMonotonicTimeUs() >= nextStatsUs) {
+      PrintCaptureStatsInterval(&sniffer, &context, &previousStats);
+      nextStatsUs += statsIntervalUs;
+    }
+    if (context.Format == OutputFormat_STATS && GetMonotonicTimeUs() - dashboardUs >= TRAFFIC_DASHBOARD_INTERVAL_US) {
+      PrintTrafficDashboardInterval(&sniffer, &context, &previousTraffic, &dashboardUs, dashboardDrawn);
+      dashboardDrawn = true;
+    }
+    if (sniffer.Rules != NULL) {
+      bool reload = atomic_exchange(&ReloadRequested, 0) || RulesFileChanged(rulesWatch, args.RulesPath);
+      if (reload && strlen(args.RulesPath) > 0)
+        ReloadRules(&rules, args.RulesPath);
+      RuleSetReclaim(&rules);
+    }
+    if (atomic_exchange(&DumpRequested, 0) && context.Recorder != NULL &&
+        !FlightRecorderTrigger(context.Recorder, NULL))
+      fprintf(stderr, "The flight recorder is not dumped, the previous dump is not written yet.\n");
   }
 
   if (LockMainMutex() != 0)
@@ -131,44 +391,290 @@ int main(int argc, char** argv)
 #elif _WIN32
   WaitForSingleObject(snifferThread, INFINITE);
 #endif
+  ControlStop(context.Control);
   DestroyMainMutex();
+  MetricsStop(context.Metrics);
+  PipelineStop(context.Pipeline);
+  // the pending dump is written, packets are not recorded after the pipeline stops
+  FlightRecorderStop(context.Recorder);
+  if (context.Storage != NULL) {
+    StorageWriterStop(context.Storage);
+    char* statsBuffer = malloc(STORAGE_SUMMARY_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintStorageSummary(
+        context.Storage, (size_t) args.StoreCompressThreads, &statsBuffer, STORAGE_SUMMARY_BUFFER_SUFFICIENT_SIZE);
+    fputs(statsBuffer, stderr);
+
+    free(statsBuffer);
+  }
+  if (context.Pcap != NULL && PcapSinkStarted(context.Pcap))
+    fprintf(stderr, "The pcap file is closed, %" PRId64 " packets are written.\n", PcapSinkStop(context.Pcap));
+  if (context.Pool != NULL)
+    FormatPoolStop(context.Pool);
+  OutputStop(&context.Output);
+
+  if (args.StatsIntervalSec > 0 || args.OutputStats) {
+    char* statsBuffer = malloc(STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintCaptureStats(&sniffer.Stats, &statsBuffer, STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+
+    free(statsBuffer);
+  }
+  if (sniffer.Stats.KernelDrops > 0)
+    fprintf(stderr,
+            "Warning: the kernel dropped %llu of %llu packets (the socket buffer was full).\n",
+            (unsigned long long) sniffer.Stats.KernelDrops,
+            (unsigned long long) sniffer.Stats.KernelPackets);
+
+  if (args.OutputStats) {
+    char* statsBuffer = malloc(STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintOutputStats(&context.Output, &statsBuffer, STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+    if (context.Pool != NULL) {
+      PrintFormatPoolStats(context.Pool, &statsBuffer, STATS_BUFFER_SUFFICIENT_SIZE);
+      fprintf(statsStream, "%s", statsBuffer);
+    }
+
+    free(statsBuffer);
+
+    PipelineStageCounters_t stages[PIPELINE_STAGES_MAX];
+    size_t stagesCount = PipelineReadCounters(context.Pipeline, stages);
+    statsBuffer = malloc(PIPELINE_STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintPipelineStats(stages, stagesCount, &statsBuffer, PIPELINE_STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+
+    free(statsBuffer);
+  }
+
+  if (context.Sampler != NULL) {
+    char* statsBuffer = malloc(STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintSamplingStats(context.Sampler, &statsBuffer, STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+
+    free(statsBuffer);
+  }
+
+  if (sniffer.VerifyChecksums) {
+    char* statsBuffer = malloc(STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintChecksumStats(&sniffer.ChecksumStats, &statsBuffer, STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+
+    free(statsBuffer);
+  }
+
+  if (context.Dns != NULL) {
+    char* statsBuffer = malloc(DNS_STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintDnsStats(context.Dns, &statsBuffer, DNS_STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+
+    free(statsBuffer);
+  }
+
+  if (context.Http != NULL) {
+    char* statsBuffer = malloc(HTTP_STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
 
-  SnifferClear(&sniffer);
-  PacketBuffersDelete(&buffers);
+    PrintHttpStats(context.Http, &statsBuffer, HTTP_STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
 
+    free(statsBuffer);
+  }
+
+  if (sniffer.Tls != NULL) {
+    char* statsBuffer = malloc(TLS_STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintTlsStats(sniffer.Tls, &statsBuffer, TLS_STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+
+    free(statsBuffer);
+  }
+
+  if (context.Tcp != NULL) {
+    char* statsBuffer = malloc(TCP_STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintTcpStats(context.Tcp, &statsBuffer, TCP_STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+
+    free(statsBuffer);
+  }
+
+#ifdef PROFILING_ENABLED
+  if (args.Profile) {
+    // threads of the packet path are stopped, their histograms are not changed
+    Histogram_t stages[ProfileStage_COUNT];
+    ProfileRead(stages);
+    char* statsBuffer = malloc(PROFILE_STATS_BUFFER_SUFFICIENT_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", statsBuffer != NULL);
+
+    PrintProfileStats(stages, ProfileTicksPerNs(), &statsBuffer, PROFILE_STATS_BUFFER_SUFFICIENT_SIZE);
+    fprintf(statsStream, "%s", statsBuffer);
+
+    free(statsBuffer);
+  }
+#endif
+
+  ClearCapture(&sniffer, &rules, rulesWatch, &context);
   return 0;
 }
 
-PROCESSING_HANDLER_FUNC(PrintPacket, owner, buffer, size, time, args)
+void ReadCaptureStats(
+    Sniffer_t* sniffer, const PrintingContext_t* context, CaptureStats_t* stats, uint64_t* suppressed, uint64_t* waits)
 {
-  if (args == NULL)
-    return;
+  // counters are changed by the capture thread, it holds the mutex while it processes the packet
+  if (LockMainMutex() != 0)
+    printf("%s\n", GetLastErrorMessage());
 
-  Sniffer_t* sniffer = (Sniffer_t*) owner;
-  ASSERT("Cannot convert 'void*' to 'Sniffer_t*'.", sniffer != NULL);
-  (void) sniffer;
+  if (SnifferUpdateStats(sniffer) < 0)
+    fprintf(stderr, "%s\n", sniffer->ErrorMessage);
+  *stats = sniffer->Stats;
+  *suppressed = context->Sampler != NULL ? context->Sampler->Suppressed : 0;
+  // the capture thread waits for the pool (if it is used) or for the output
+  *waits = context->Pool != NULL ? context->Pool->Slots.Stalls : context->Output.Blocked;
 
-  PacketBuffers_t* buffers = (PacketBuffers_t*) args;
-  ASSERT("Cannot convert 'handlerArgs_t' to 'PacketBuffers_t*'.", buffer != NULL);
+  if (UnlockMainMutex() != 0)
+    printf("%s\n", GetLastErrorMessage());
+}
 
-  size_t hdroffset = 0;
-#ifdef __linux__
-  if (sniffer->ETHHeaderIncluded) {
-    char* ethHeaderBuffer = malloc(ETH_HEADER_BUFFER_SUFFICIENT_SIZE);
-    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", ethHeaderBuffer != NULL);
+void PrintCaptureStatsInterval(Sniffer_t* sniffer, const PrintingContext_t* context, CaptureStats_t* previous)
+{
+  CaptureStats_t stats;
+  uint64_t suppressed, waits;
+  ReadCaptureStats(sniffer, context, &stats, &suppressed, &waits);
+
+  char line[CAPTURE_STATS_LINE_MAX_SIZE];
+  PrintCaptureStatsLine(&stats, previous, suppressed, waits, line, sizeof(line));
+  fputs(line, stderr);
+  *previous = stats;
+}
 
-    PrintPacketETHHeader(buffer, &ethHeaderBuffer, ETH_HEADER_BUFFER_SUFFICIENT_SIZE);
-    printf("%s ", ethHeaderBuffer);
+size_t PrintControlStats(char* buffer, size_t bufferSize, void* args)
+{
+  CaptureThreadArgs_t* capture = (CaptureThreadArgs_t*) args;
+  ASSERT("Cannot convert 'void*' to 'CaptureThreadArgs_t*'.", capture != NULL);
+  // changes are counted since the previous command, only the thread of the control server calls it
+  static CaptureStats_t previous;
+
+  CaptureStats_t stats;
+  uint64_t suppressed, waits;
+  ReadCaptureStats(capture->Sniffer, capture->Context, &stats, &suppressed, &waits);
+  if (bufferSize < CAPTURE_STATS_LINE_MAX_SIZE)
+    return 0;
+  size_t length = PrintCaptureStatsLine(&stats, &previous, suppressed, waits, buffer, bufferSize);
+  previous = stats;
+
+  // the server is a reader of the rule set, the table is valid until its next command
+  const RuleTable_t* rules = RuleSetCurrent(capture->Sniffer->Rules);
+  int rc = snprintf(buffer + length,
+                    bufferSize - length,
+                    "rules: version %" PRIu64 ", %zu rules\npcap: %s\n",
+                    rules != NULL ? rules->Version : 0,
+                    rules != NULL ? rules->Count : 0,
+                    PcapSinkStarted(capture->Context->Pcap) ? "writing" : "stopped");
+  if (rc > 0)
+    length += (size_t) rc < bufferSize - length ? (size_t) rc : bufferSize - length - 1;
+  return length;
+}
 
-    free(ethHeaderBuffer);
+void ReportRecorderDump(const RecorderDump_t* dump, void* args)
+{
+  (void) args;
+  char line[RECORDER_DUMP_LINE_MAX_SIZE];
+  PrintRecorderDump(dump, line, sizeof(line));
+  fputs(line, stderr);
+}
 
-    hdroffset = GetETHHeaderLength();
-  }
+void ClearCapture(Sniffer_t* sniffer, RuleSet_t* rules, int rulesWatch, PrintingContext_t* context)
+{
+  SnifferClear(sniffer);
+  RuleSetClear(rules);
+#ifdef __linux__
+  if (rulesWatch >= 0)
+    close(rulesWatch);
+#else
+  (void) rulesWatch;
 #endif
+  PipelineClear(context->Pipeline);
+  MetricsClear(context->Metrics);
+  ControlClear(context->Control);
+  FlightRecorderClear(context->Recorder);
+  StorageWriterClear(context->Storage);
+  PacketBuffersDelete(&context->Buffers);
+  OutputClear(&context->Output);
+  DnsTrackerClear(context->Dns);
+  HttpTrackerClear(context->Http);
+  TcpAnalyzerClear(context->Tcp);
+  FormatPoolClear(context->Pool);
+  for (size_t i = 0; i < context->WorkersCount; ++i)
+    PacketBuffersDelete(&context->WorkerBuffers[i]);
+  free(context->WorkerBuffers);
+  free(context->DecodedBuffer);
+  free(context->AnalysisBuffer);
+  free(context->RecordBuffer);
+}
+
+void PrintTrafficDashboardInterval(const Sniffer_t* sniffer,
+                                   const PrintingContext_t* context,
+                                   TrafficStats_t* previous,
+                                   uint64_t* previousUs,
+                                   bool redraw)
+{
+  // counters are changed by the capture thread, it holds the mutex while it processes the packet
+  if (LockMainMutex() != 0)
+    printf("%s\n", GetLastErrorMessage());
+
+  TrafficStats_t current = *context->Traffic;
 
-  PrintPacketToBuffers(buffer + hdroffset, size, buffers, &time);
+  if (UnlockMainMutex() != 0)
+    printf("%s\n", GetLastErrorMessage());
 
-  printf("%s %s %s", buffers->IPHeaderBuffer, buffers->ProtocolHeaderBuffer, buffers->DataBuffer);
+  uint64_t now = GetMonotonicTimeUs();
+  char* dashboard = malloc(TRAFFIC_DASHBOARD_BUFFER_SUFFICIENT_SIZE);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", dashboard != NULL);
+
+  size_t length = PrintTrafficDashboard(&current,
+                                        previous,
+                                        (double) (now - *previousUs) / 1000000.0,
+                                        sniffer,
+                                        redraw,
+                                        dashboard,
+                                        TRAFFIC_DASHBOARD_BUFFER_SUFFICIENT_SIZE);
+  fwrite(dashboard, 1, length, stdout);
+  fflush(stdout);
+
+  free(dashboard);
+  *previous = current;
+  *previousUs = now;
+}
+
+void PublishMetrics(Sniffer_t* sniffer, PrintingContext_t* context, uint64_t nowUs)
+{
+  // the snapshot is large, it is not allocated on the stack of the capture thread
+  static MetricsSnapshot_t snapshot;
+
+  if (SnifferUpdateStats(sniffer) < 0)
+    fprintf(stderr, "%s\n", sniffer->ErrorMessage);
+  snapshot.Capture = sniffer->Stats;
+  snapshot.Traffic = *context->Traffic;
+  snapshot.HandlerLatency = *context->HandlerLatency;
+  snapshot.Suppressed = context->Sampler != NULL ? context->Sampler->Suppressed : 0;
+  snapshot.Waits = context->Pool != NULL ? context->Pool->Slots.Stalls : context->Output.Blocked;
+  snapshot.StagesCount = PipelineReadCounters(context->Pipeline, snapshot.Stages);
+  MetricsPublish(context->Metrics, &snapshot, nowUs);
 }
 
 ThreadReturnValue_t StartSniffingPackets(ThreadArgs_t args)
@@ -176,24 +682,48 @@ ThreadReturnValue_t StartSniffingPackets(ThreadArgs_t args)
   if (args == NULL)
     return FAIL_THREAD;
 
-  Sniffer_t* sniffer = (Sniffer_t*) args;
-  ASSERT("Cannot convert 'ThreadArgs_t' to 'Sniffer_t*'.", sniffer != NULL);
+  CaptureThreadArgs_t* captureArgs = (CaptureThreadArgs_t*) args;
+  ASSERT("Cannot convert 'ThreadArgs_t' to 'CaptureThreadArgs_t*'.", captureArgs != NULL);
+  Sniffer_t* sniffer = captureArgs->Sniffer;
+  PrintingContext_t* context = captureArgs->Context;
+#ifdef ALLOCATION_AUDIT_ENABLED
+  bool auditing = false;
+#endif
 
   while (IsRunning) {
     if (LockMainMutex() != 0)
       printf("%s\n", GetLastErrorMessage());
 
     int rc = SnifferProcessNextPacket(sniffer);
+#ifdef ALLOCATION_AUDIT_ENABLED
+    // buffers of the packet path grow while the first packets are processed, later packets must not allocate
+    if (!auditing && sniffer->Stats.Handled >= ALLOCATION_AUDIT_WARMUP_PACKETS) {
+      AllocAuditBegin(true);
+      auditing = true;
+    }
+#endif
+    // counters are published by their only writer, the metrics server never takes the mutex
+    if (rc == 0 && context->Metrics != NULL) {
+      uint64_t now = GetMonotonicTimeUs();
+      if (MetricsPublishDue(context->Metrics, now))
+        PublishMetrics(sniffer, context, now);
+    }
 
     if (UnlockMainMutex() != 0)
       printf("%s\n", GetLastErrorMessage());
 
     if (rc < 0) {
+#ifdef ALLOCATION_AUDIT_ENABLED
+      AllocAuditEnd();
+#endif
       printf("%s\n", sniffer->ErrorMessage);
       return FAIL_THREAD;
     }
   }
 
+#ifdef ALLOCATION_AUDIT_ENABLED
+  AllocAuditEnd();
+#endif
   return SUCCESS_THREAD;
 }
 
@@ -203,6 +733,86 @@ void SignalHandler(int sig)
   IsRunning = 0;
 }
 
+void ReloadSignalHandler(int sig)
+{
+  (void) sig;
+  ReloadRequested = 1;
+}
+
+void DumpSignalHandler(int sig)
+{
+  (void) sig;
+  // the trigger takes the mutex of the recorder, the main thread calls it
+  DumpRequested = 1;
+}
+
+int WatchRulesFile(const char* path)
+{
+#ifdef __linux__
+  // editors replace the file by rename, the directory is watched
+  char directory[RULES_PATH_MAX_SIZE];
+  const char* slash = strrchr(path, '/');
+  if (slash == NULL)
+    strcpy(directory, ".");
+  else {
+    size_t size = slash == path ? 1 : (size_t) (slash - path);
+    memcpy(directory, path, size);
+    directory[size] = '\0';
+  }
+
+  int watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (watch < 0 || inotify_add_watch(watch, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+    fprintf(stderr, "Cannot watch the rules file, it is reloaded only on SIGHUP: %s\n", GetLastErrorMessage());
+    if (watch >= 0)
+      close(watch);
+    return -1;
+  }
+  return watch;
+#elif _WIN32
+  (void) path;
+  return -1;
+#endif
+}
+
+bool RulesFileChanged(int watch, const char* path)
+{
+  bool changed = false;
+#ifdef __linux__
+  if (watch < 0)
+    return false;
+
+  const char* slash = strrchr(path, '/');
+  const char* name = slash != NULL ? slash + 1 : path;
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t size;
+  while ((size = read(watch, events, sizeof(events))) > 0) {
+    for (char* p = events; p < events + size;) {
+      const struct inotify_event* event = (const struct inotify_event*) p;
+      if (event->len > 0 && strcmp(event->name, name) == 0)
+        changed = true;
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+#elif _WIN32
+  (void) watch;
+  (void) path;
+#endif
+  return changed;
+}
+
+void ReloadRules(RuleSet_t* rules, const char* path)
+{
+  char* error = NULL;
+  RuleTable_t* table = RuleTableLoad(path, &error);
+  if (table == NULL) {
+    fprintf(stderr, "Rules are not reloaded, the previous rules are used: %s\n", error);
+    free(error);
+    return;
+  }
+  fprintf(stderr, "Reloaded %zu rules from '%s' in %.1f ms.\n", table->Count, path, (double) table->LoadNs / 1e6);
+  RuleSetSwap(rules, table);
+}
+
 void InitMainMutex()
 {
 #ifdef __linux__
@@ -0,0 +1,286 @@
+#include "metrics.h"
+#include "printing.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void* ServerThread(void* args);
+static void ServeClient(MetricsServer_t* m,
+                        int client,
+                        char* request,
+                        char* body,
+                        MetricsSnapshot_t* snapshot,
+                        const RuleTable_t* rules);
+static void WriteAll(MetricsServer_t* m, int client, const char* data, size_t size);
+#endif
+
+void MetricsInit(MetricsServer_t* m, const Sniffer_t* sniffer)
+{
+  ASSERT("Cannot init metrics ('MetricsServer_t'): m == NULL.", m != NULL);
+
+  m->Requests = 0;
+  m->Errors = 0;
+  m->ErrorMessage = NULL;
+  memset(&m->__snapshot, 0, sizeof(m->__snapshot));
+  atomic_init(&m->__sequence, 0);
+  m->__publishedUs = 0;
+  m->__sniffer = sniffer;
+  m->__unixPath[0] = '\0';
+  m->__sock = -1;
+  atomic_init(&m->__running, false);
+}
+
+int MetricsListen(MetricsServer_t* m, const char* address)
+{
+#ifdef __linux__
+  if (strchr(address, ':') == NULL && strspn(address, "0123456789") != strlen(address)) {
+    struct sockaddr_un unixAddress;
+    memset(&unixAddress, 0, sizeof(unixAddress));
+    unixAddress.sun_family = AF_UNIX;
+    if (strlen(address) >= sizeof(unixAddress.sun_path)) {
+      FormatStringBuffer(&m->ErrorMessage, "The path of the metrics socket '%s' is too long.", address);
+      return -1;
+    }
+    strncpy(unixAddress.sun_path, address, sizeof(unixAddress.sun_path) - 1);
+
+    // the socket of the previous run is replaced, other files are not removed
+    struct stat st;
+    if (stat(address, &st) == 0 && S_ISSOCK(st.st_mode))
+      unlink(address);
+
+    m->__sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m->__sock < 0 || bind(m->__sock, (struct sockaddr*) &unixAddress, sizeof(unixAddress)) < 0 ||
+        listen(m->__sock, SOMAXCONN) < 0) {
+      FormatStringBuffer(&m->ErrorMessage, "Cannot listen on the metrics socket '%s': %s", address, strerror(errno));
+      return -1;
+    }
+    strncpy(m->__unixPath, address, METRICS_ADDRESS_MAX_SIZE - 1);
+    m->__unixPath[METRICS_ADDRESS_MAX_SIZE - 1] = '\0';
+    return 0;
+  }
+
+  char* ip = NULL;
+  int port = 0;
+  if (strchr(address, ':') != NULL) {
+    if (ParseAddressString(address, &ip, &port, &m->ErrorMessage) < 0) {
+      free(ip);
+      return -1;
+    }
+  } else
+    port = atoi(address);
+
+  struct sockaddr_in inetAddress;
+  memset(&inetAddress, 0, sizeof(inetAddress));
+  inetAddress.sin_family = AF_INET;
+  inetAddress.sin_port = htons((uint16_t) port);
+  if (port > UINT16_MAX || inet_pton(AF_INET, ip != NULL ? ip : "127.0.0.1", &inetAddress.sin_addr) != 1) {
+    FormatStringBuffer(&m->ErrorMessage, "Invalid metrics address '%s'.", address);
+    free(ip);
+    return -1;
+  }
+  free(ip);
+
+  int reuse = 1;
+  m->__sock = socket(AF_INET, SOCK_STREAM, 0);
+  if (m->__sock < 0 || setsockopt(m->__sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+      bind(m->__sock, (struct sockaddr*) &inetAddress, sizeof(inetAddress)) < 0 || listen(m->__sock, SOMAXCONN) < 0) {
+    FormatStringBuffer(&m->ErrorMessage, "Cannot listen on the metrics address '%s': %s", address, strerror(errno));
+    return -1;
+  }
+  return 0;
+#else
+  (void) address;
+  FormatStringBuffer(&m->ErrorMessage, "The metrics endpoint is only available on Linux.");
+  return -1;
+#endif
+}
+
+int MetricsStart(MetricsServer_t* m)
+{
+#ifdef __linux__
+  atomic_store(&m->__running, true);
+  int rc = pthread_create(&m->__serverThread, NULL, ServerThread, m);
+  if (rc != 0) {
+    atomic_store(&m->__running, false);
+    FormatStringBuffer(&m->ErrorMessage, "Cannot start the metrics thread: %s", strerror(rc));
+    return -1;
+  }
+  return 0;
+#else
+  FormatStringBuffer(&m->ErrorMessage, "The metrics endpoint is only available on Linux.");
+  return -1;
+#endif
+}
+
+bool MetricsPublishDue(const MetricsServer_t* m, uint64_t nowUs)
+{
+  return nowUs - m->__publishedUs >= METRICS_PUBLISH_INTERVAL_US;
+}
+
+void MetricsPublish(MetricsServer_t* m, const MetricsSnapshot_t* snapshot, uint64_t nowUs)
+{
+  // the only writer, readers retry while the sequence is odd or changed during their copy
+  uint_fast64_t sequence = atomic_load_explicit(&m->__sequence, memory_order_relaxed);
+  atomic_store_explicit(&m->__sequence, sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&m->__snapshot, snapshot, sizeof(MetricsSnapshot_t));
+  atomic_store_explicit(&m->__sequence, sequence + 2, memory_order_release);
+  m->__publishedUs = nowUs;
+}
+
+void MetricsRead(MetricsServer_t* m, MetricsSnapshot_t* snapshot)
+{
+  while (true) {
+    uint_fast64_t before = atomic_load_explicit(&m->__sequence, memory_order_acquire);
+    if (before & 1)
+      continue;
+    memcpy(snapshot, &m->__snapshot, sizeof(MetricsSnapshot_t));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&m->__sequence, memory_order_relaxed) == before)
+      return;
+  }
+}
+
+void MetricsStop(MetricsServer_t* m)
+{
+  if (m == NULL)
+    return;
+
+#ifdef __linux__
+  if (atomic_exchange(&m->__running, false))
+    pthread_join(m->__serverThread, NULL);
+  if (m->__sock >= 0) {
+    close(m->__sock);
+    m->__sock = -1;
+  }
+  if (m->__unixPath[0] != '\0') {
+    unlink(m->__unixPath);
+    m->__unixPath[0] = '\0';
+  }
+#endif
+}
+
+void MetricsClear(MetricsServer_t* m)
+{
+  if (m == NULL)
+    return;
+
+  MetricsStop(m);
+  free(m->ErrorMessage);
+  m->ErrorMessage = NULL;
+}
+
+#ifdef __linux__
+void* ServerThread(void* args)
+{
+  MetricsServer_t* m = (MetricsServer_t*) args;
+
+  char* request = malloc(METRICS_REQUEST_MAX_SIZE);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", request != NULL);
+  char* body = malloc(METRICS_BUFFER_SUFFICIENT_SIZE);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", body != NULL);
+  MetricsSnapshot_t* snapshot = malloc(sizeof(MetricsSnapshot_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", snapshot != NULL);
+  RuleSet_t* rules = m->__sniffer->Rules;
+  int reader = rules != NULL ? RuleSetAddReader(rules) : -1;
+
+  // clients are served one by one, scrapes are rare
+  while (atomic_load(&m->__running)) {
+    // tables of rules printed by previous requests are not used anymore
+    if (reader >= 0)
+      RuleSetQuiescent(rules, reader);
+    struct pollfd pfd = {.fd = m->__sock, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, METRICS_POLL_TIMEOUT_MS) <= 0)
+      continue;
+
+    int client = accept(m->__sock, NULL, NULL);
+    if (client < 0)
+      continue;
+    ServeClient(m, client, request, body, snapshot, reader >= 0 ? RuleSetCurrent(rules) : NULL);
+    close(client);
+  }
+
+  if (reader >= 0)
+    RuleSetRemoveReader(rules, reader);
+
+  free(snapshot);
+  free(body);
+  free(request);
+  return NULL;
+}
+
+void ServeClient(MetricsServer_t* m,
+                 int client,
+                 char* request,
+                 char* body,
+                 MetricsSnapshot_t* snapshot,
+                 const RuleTable_t* rules)
+{
+  // a slow client must not block the next scrapes for long
+  struct timeval timeout = {.tv_sec = 1, .tv_usec = 0};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  size_t length = 0;
+  while (length < METRICS_REQUEST_MAX_SIZE - 1) {
+    ssize_t rc = recv(client, request + length, METRICS_REQUEST_MAX_SIZE - 1 - length, 0);
+    if (rc <= 0)
+      break;
+    length += (size_t) rc;
+    request[length] = '\0';
+    if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+      break;
+  }
+  request[length] = '\0';
+
+  char header[256];
+  if (strncmp(request, "GET /metrics ", 13) != 0 && strncmp(request, "GET /metrics?", 13) != 0) {
+    static const char notFound[] = "Not found, the metrics are at /metrics.\n";
+    int headerLength = snprintf(header,
+                                sizeof(header),
+                                "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain; charset=utf-8\r\n"
+                                "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                                sizeof(notFound) - 1);
+    WriteAll(m, client, header, (size_t) headerLength);
+    WriteAll(m, client, notFound, sizeof(notFound) - 1);
+    m->Errors++;
+    return;
+  }
+
+  MetricsRead(m, snapshot);
+  size_t bodyLength = PrintMetrics(snapshot, m->__sniffer, rules, body, METRICS_BUFFER_SUFFICIENT_SIZE);
+  int headerLength = snprintf(header,
+                              sizeof(header),
+                              "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                              "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+                              bodyLength);
+  WriteAll(m, client, header, (size_t) headerLength);
+  WriteAll(m, client, body, bodyLength);
+  m->Requests++;
+}
+
+void WriteAll(MetricsServer_t* m, int client, const char* data, size_t size)
+{
+  while (size > 0) {
+    ssize_t rc = send(client, data, size, MSG_NOSIGNAL);
+    if (rc <= 0) {
+      m->Errors++;
+      return;
+    }
+    data += rc;
+    size -= (size_t) rc;
+  }
+}
+#endif
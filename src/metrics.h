@@ -0,0 +1,122 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include "sniffer.h"
+#include "traffic.h"
+#include "histogram.h"
+#include "pipeline.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#define METRICS_ADDRESS_MAX_SIZE 108
+#define METRICS_PUBLISH_INTERVAL_US 100000
+#define METRICS_POLL_TIMEOUT_MS 500
+#define METRICS_REQUEST_MAX_SIZE 4096
+#define METRICS_BUFFER_SUFFICIENT_SIZE 131072
+#define METRICS_RULES_MAX_COUNT 256
+
+/**
+ * @brief MetricsSnapshot_t
+ * Counters of the capture thread, published for the metrics endpoint.
+ */
+typedef struct
+{
+  CaptureStats_t Capture;                              //! Counters of captured packets
+  TrafficStats_t Traffic;                              //! Packets and bytes by protocol, direction, address and size
+  Histogram_t HandlerLatency;                          //! Time of the packet handler (nanoseconds)
+  uint64_t Suppressed;                                 //! Packets suppressed by sampling
+  uint64_t Waits;                                      //! Waits of the capture thread for the output
+  PipelineStageCounters_t Stages[PIPELINE_STAGES_MAX]; //! Counters of pipeline stages
+  size_t StagesCount;                                  //! Pipeline stages count
+} MetricsSnapshot_t;
+
+/**
+ * @brief MetricsServer_t
+ * Minimal HTTP server of the Prometheus text format on the TCP or unix socket. The capture thread publishes snapshots
+ * of its counters through the seqlock, so the server never takes locks of the capture thread and the capture thread
+ * never waits for the server. Counters of rules of the file are read from the current table, the server is the reader of
+ * the rule set. The server is only available on Linux.
+ */
+typedef struct
+{
+  uint64_t Requests;  //! Served requests
+  uint64_t Errors;    //! Invalid requests and failed writes
+  char* ErrorMessage; //! Error messages
+  // private fields
+  MetricsSnapshot_t __snapshot;
+  atomic_uint_fast64_t __sequence; // odd while the snapshot is written
+  uint64_t __publishedUs;
+  const Sniffer_t* __sniffer;
+  char __unixPath[METRICS_ADDRESS_MAX_SIZE];
+  int __sock;
+  atomic_bool __running;
+#ifdef __linux__
+  pthread_t __serverThread;
+#endif
+} MetricsServer_t;
+
+/**
+ * @brief MetricsInit
+ * Initializates values for the new metrics server object.
+ * @param m The pointer to the metrics server object
+ * @param sniffer The sniffer (names of addresses, they must not be changed after the server is started)
+ */
+void MetricsInit(MetricsServer_t* m, const Sniffer_t* sniffer);
+/**
+ * @brief MetricsListen
+ * Creates the listening socket. The address is "IP:PORT", "PORT" (on 127.0.0.1) or the path of the unix socket.
+ * @param m The pointer to the metrics server object
+ * @param address The address
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int MetricsListen(MetricsServer_t* m, const char* address);
+/**
+ * @brief MetricsStart
+ * Starts the server thread.
+ * @param m The pointer to the metrics server object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int MetricsStart(MetricsServer_t* m);
+/**
+ * @brief MetricsPublishDue
+ * Checks if the publish interval is over. Only the capture thread calls it.
+ * @param m The pointer to the metrics server object
+ * @param nowUs The current time (microseconds, monotonic clock)
+ * @return true if the snapshot must be published.
+ */
+bool MetricsPublishDue(const MetricsServer_t* m, uint64_t nowUs);
+/**
+ * @brief MetricsPublish
+ * Replaces the snapshot served by the server. Only the capture thread calls it, it never waits.
+ * @param m The pointer to the metrics server object
+ * @param snapshot The counters
+ * @param nowUs The current time (microseconds, monotonic clock)
+ */
+void MetricsPublish(MetricsServer_t* m, const MetricsSnapshot_t* snapshot, uint64_t nowUs);
+/**
+ * @brief MetricsRead
+ * Copies the last published snapshot (zero counters if nothing is published yet). The copy is retried if the
+ * snapshot is replaced while it is copied.
+ * @param m The pointer to the metrics server object
+ * @param snapshot The copy of counters
+ */
+void MetricsRead(MetricsServer_t* m, MetricsSnapshot_t* snapshot);
+/**
+ * @brief MetricsStop
+ * Stops the server thread and closes the socket.
+ * @param m The pointer to the metrics server object
+ */
+void MetricsStop(MetricsServer_t* m);
+/**
+ * @brief MetricsClear
+ * Clears the passed metrics server object.
+ * @param m The pointer to the metrics server object
+ */
+void MetricsClear(MetricsServer_t* m);
+
+#endif // __METRICS_H
@@ -0,0 +1,11 @@
+#include "netsniffer.h"
+
+const char* NetsnifferVersion()
+{
+  return NETSNIFFER_VERSION_STRING;
+}
+
+unsigned int NetsnifferVersionNumber()
+{
+  return NETSNIFFER_VERSION_MAJOR * 10000 + NETSNIFFER_VERSION_MINOR * 100 + NETSNIFFER_VERSION_PATCH;
+}
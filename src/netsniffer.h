@@ -0,0 +1,35 @@
+#ifndef __NETSNIFFER_H
+#define __NETSNIFFER_H
+
+/*
+ * The public API of libnetsniffer: the sniffer (backend selection, packet and batch handlers, capture statistics),
+ * pipelines of packet stages, hot-reloadable rule sets, decoded records of packets and traffic counters. The version of
+ * the API follows semantic versioning, the major version is changed with incompatible changes of these headers.
+ */
+#include "sniffer.h"
+#include "structures.h"
+#include "records.h"
+#include "traffic.h"
+#include "histogram.h"
+#include "pipeline.h"
+#include "rules.h"
+
+#define NETSNIFFER_VERSION_MAJOR 0
+#define NETSNIFFER_VERSION_MINOR 2
+#define NETSNIFFER_VERSION_PATCH 0
+#define NETSNIFFER_VERSION_STRING "0.2.0"
+
+/**
+ * @brief NetsnifferVersion
+ * Returns the version of the linked library, it may differ from the version of headers (NETSNIFFER_VERSION_STRING).
+ * @return The version string "MAJOR.MINOR.PATCH".
+ */
+const char* NetsnifferVersion();
+/**
+ * @brief NetsnifferVersionNumber
+ * Returns the version of the linked library as the number (MAJOR * 10000 + MINOR * 100 + PATCH).
+ * @return The version number.
+ */
+unsigned int NetsnifferVersionNumber();
+
+#endif // __NETSNIFFER_H
@@ -0,0 +1,300 @@
+#include "output.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#elif _WIN32
+#include <io.h>
+#endif
+
+static void Lock(Output_t* o);
+static void Unlock(Output_t* o);
+static void Submit(Output_t* o);
+static void WriteBlocks(Output_t* o, uint64_t first, uint64_t count);
+#ifdef __linux__
+static void* WriterThread(void* args);
+static void WaitSubmitted(Output_t* o, uint64_t deadlineUs);
+#endif
+
+void OutputInit(Output_t* o, int fd, size_t blockSize, uint64_t flushIntervalMs)
+{
+  ASSERT("Cannot init output ('Output_t'): o == NULL.", o != NULL);
+
+  o->BytesWritten = 0;
+  o->Writes = 0;
+  o->Blocks = 0;
+  o->SizeFlushes = 0;
+  o->TimeFlushes = 0;
+  o->Blocked = 0;
+  o->BlockedUs = 0;
+  o->WriteErrors = 0;
+  HistogramInit(&o->FlushLatency);
+
+  o->__fd = fd;
+  o->__blockSize = blockSize > 0 ? blockSize : OUTPUT_DEFAULT_BLOCK_SIZE;
+  o->__flushIntervalUs = flushIntervalMs * 1000;
+  for (size_t i = 0; i < OUTPUT_BLOCKS_COUNT; ++i) {
+    o->__blocks[i].Data = malloc(o->__blockSize);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", o->__blocks[i].Data != NULL);
+    o->__blocks[i].Size = 0;
+    o->__blocks[i].FirstWriteUs = 0;
+  }
+  o->__submitted = 0;
+  o->__written = 0;
+  o->__running = false;
+
+#ifdef __linux__
+  pthread_mutex_init(&o->__mutex, NULL);
+  // the flush deadline is measured by the monotonic clock
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&o->__submittedCond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&o->__writtenCond, NULL);
+#endif
+}
+
+int OutputStart(Output_t* o)
+{
+#ifdef __linux__
+  o->__running = true;
+  int rc = pthread_create(&o->__writer, NULL, WriterThread, o);
+  if (rc != 0) {
+    o->__running = false;
+    errno = rc;
+    return -1;
+  }
+#else
+  (void) o;
+#endif
+  return 0;
+}
+
+void OutputWrite(Output_t* o, const char* data, size_t size)
+{
+  Lock(o);
+  while (size > 0) {
+    OutputBlock_t* block = &o->__blocks[o->__submitted % OUTPUT_BLOCKS_COUNT];
+    if (block->Size == 0) {
+      block->FirstWriteUs = GetMonotonicTimeUs();
+#ifdef __linux__
+      if (o->__running)
+        pthread_cond_signal(&o->__submittedCond); // the writer waits for the flush deadline of this block
+#endif
+    }
+
+    size_t count = o->__blockSize - block->Size < size ? o->__blockSize - block->Size : size;
+    memcpy(block->Data + block->Size, data, count);
+    block->Size += count;
+    data += count;
+    size -= count;
+
+    if (block->Size == o->__blockSize) {
+      o->SizeFlushes++;
+      Submit(o);
+    }
+  }
+
+  if (!o->__running) {
+    // without the writer thread the flush interval is checked by the producer
+    OutputBlock_t* block = &o->__blocks[o->__submitted % OUTPUT_BLOCKS_COUNT];
+    if (block->Size > 0 && GetMonotonicTimeUs() - block->FirstWriteUs >= o->__flushIntervalUs) {
+      o->TimeFlushes++;
+      Submit(o);
+    }
+  }
+  Unlock(o);
+}
+
+void OutputWriteString(Output_t* o, const char* str)
+{
+  OutputWrite(o, str, strlen(str));
+}
+
+void OutputStop(Output_t* o)
+{
+  Lock(o);
+  if (o->__blocks[o->__submitted % OUTPUT_BLOCKS_COUNT].Size > 0)
+    Submit(o);
+
+#ifdef __linux__
+  if (o->__running) {
+    o->__running = false;
+    pthread_cond_signal(&o->__submittedCond);
+    Unlock(o);
+    pthread_join(o->__writer, NULL);
+    return;
+  }
+#endif
+  Unlock(o);
+}
+
+void OutputClear(Output_t* o)
+{
+  if (o == NULL)
+    return;
+
+  for (size_t i = 0; i < OUTPUT_BLOCKS_COUNT; ++i)
+    free(o->__blocks[i].Data);
+#ifdef __linux__
+  pthread_cond_destroy(&o->__writtenCond);
+  pthread_cond_destroy(&o->__submittedCond);
+  pthread_mutex_destroy(&o->__mutex);
+#endif
+}
+
+void Lock(Output_t* o)
+{
+#ifdef __linux__
+  pthread_mutex_lock(&o->__mutex);
+#else
+  (void) o;
+#endif
+}
+
+void Unlock(Output_t* o)
+{
+#ifdef __linux__
+  pthread_mutex_unlock(&o->__mutex);
+#else
+  (void) o;
+#endif
+}
+
+void Submit(Output_t* o)
+{
+  o->__submitted++;
+#ifdef __linux__
+  if (o->__running) {
+    pthread_cond_signal(&o->__submittedCond);
+    // the next block is filled only after it was written
+    if (o->__submitted - o->__written >= OUTPUT_BLOCKS_COUNT) {
+      uint64_t start = GetMonotonicTimeUs();
+      o->Blocked++;
+      while (o->__submitted - o->__written >= OUTPUT_BLOCKS_COUNT)
+        pthread_cond_wait(&o->__writtenCond, &o->__mutex);
+      o->BlockedUs += GetMonotonicTimeUs() - start;
+    }
+    return;
+  }
+#endif
+  WriteBlocks(o, o->__written, 1);
+  o->__written++;
+}
+
+void WriteBlocks(Output_t* o, uint64_t first, uint64_t count)
+{
+#ifdef __linux__
+  struct iovec iov[OUTPUT_BLOCKS_COUNT];
+  for (uint64_t i = 0; i < count; ++i) {
+    iov[i].iov_base = o->__blocks[(first + i) % OUTPUT_BLOCKS_COUNT].Data;
+    iov[i].iov_len = o->__blocks[(first + i) % OUTPUT_BLOCKS_COUNT].Size;
+  }
+
+  struct iovec* pending = iov;
+  int pendingCount = (int) count;
+  while (pendingCount > 0) {
+    ssize_t rc = writev(o->__fd, pending, pendingCount);
+    o->Writes++;
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      o->WriteErrors++;
+      break;
+    }
+    o->BytesWritten += (uint64_t) rc;
+
+    // skip the written part of the batch
+    size_t written = (size_t) rc;
+    while (pendingCount > 0 && written >= pending->iov_len) {
+      written -= pending->iov_len;
+      ++pending;
+      --pendingCount;
+    }
+    if (pendingCount > 0) {
+      pending->iov_base = (char*) pending->iov_base + written;
+      pending->iov_len -= written;
+    }
+  }
+#elif _WIN32
+  for (uint64_t i = 0; i < count; ++i) {
+    const OutputBlock_t* block = &o->__blocks[(first + i) % OUTPUT_BLOCKS_COUNT];
+    for (size_t offset = 0; offset < block->Size;) {
+      int rc = _write(o->__fd, block->Data + offset, (unsigned int) (block->Size - offset));
+      o->Writes++;
+      if (rc <= 0) {
+        o->WriteErrors++;
+        break;
+      }
+      o->BytesWritten += (uint64_t) rc;
+      offset += (size_t) rc;
+    }
+  }
+#endif
+
+  uint64_t now = GetMonotonicTimeUs();
+  for (uint64_t i = 0; i < count; ++i) {
+    OutputBlock_t* block = &o->__blocks[(first + i) % OUTPUT_BLOCKS_COUNT];
+    HistogramAdd(&o->FlushLatency, now - block->FirstWriteUs);
+    block->Size = 0;
+    o->Blocks++;
+  }
+}
+
+#ifdef __linux__
+void* WriterThread(void* args)
+{
+  Output_t* o = (Output_t*) args;
+
+  Lock(o);
+  while (true) {
+    uint64_t count = o->__submitted - o->__written;
+    if (count == 0) {
+      if (!o->__running)
+        break;
+
+      const OutputBlock_t* block = &o->__blocks[o->__submitted % OUTPUT_BLOCKS_COUNT];
+      if (block->Size == 0) {
+        pthread_cond_wait(&o->__submittedCond, &o->__mutex);
+        continue;
+      }
+      uint64_t deadline = block->FirstWriteUs + o->__flushIntervalUs;
+      if (GetMonotonicTimeUs() < deadline) {
+        WaitSubmitted(o, deadline);
+        continue;
+      }
+
+      o->TimeFlushes++;
+      o->__submitted++;
+      count = 1;
+    }
+
+    // the producer does not touch submitted blocks, they are written without the lock
+    uint64_t first = o->__written;
+    Unlock(o);
+    WriteBlocks(o, first, count);
+    Lock(o);
+
+    o->__written += count;
+    pthread_cond_signal(&o->__writtenCond);
+  }
+  Unlock(o);
+
+  return NULL;
+}
+
+void WaitSubmitted(Output_t* o, uint64_t deadlineUs)
+{
+  struct timespec deadline;
+  deadline.tv_sec = (time_t) (deadlineUs / 1000000);
+  deadline.tv_nsec = (long) (deadlineUs % 1000000) * 1000;
+  pthread_cond_timedwait(&o->__submittedCond, &o->__mutex, &deadline);
+}
+#endif
@@ -0,0 +1,106 @@
+#ifndef __OUTPUT_H
+#define __OUTPUT_H
+
+#include "histogram.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#define OUTPUT_BLOCKS_COUNT 16
+#define OUTPUT_DEFAULT_BLOCK_SIZE (256 * 1024)
+#define OUTPUT_DEFAULT_FLUSH_INTERVAL_MS 100
+
+/**
+ * @brief OutputBlock_t
+ * The block of formatted records.
+ */
+typedef struct
+{
+  char* Data;
+  size_t Size;           //! Bytes of records in the block
+  uint64_t FirstWriteUs; //! Time of the first record (monotonic clock)
+} OutputBlock_t;
+
+/**
+ * @brief Output_t
+ * Batched writer of formatted records. Records are appended to the ring of blocks, the block is submitted when it is
+ * full or its first record is older than the flush interval. On Linux submitted blocks are written by the writer thread
+ * with one writev() call per batch, so the capture thread waits only if all blocks are waiting for the write.
+ */
+typedef struct
+{
+  uint64_t BytesWritten;    //! Bytes written to the file descriptor
+  uint64_t Writes;          //! Write calls (writev)
+  uint64_t Blocks;          //! Written blocks
+  uint64_t SizeFlushes;     //! Blocks submitted because they were full
+  uint64_t TimeFlushes;     //! Blocks submitted by the flush interval
+  uint64_t Blocked;         //! Waits of the producer for a free block
+  uint64_t BlockedUs;       //! Time spent by the producer waiting for a free block
+  uint64_t WriteErrors;     //! Failed writes (the data of the batch is lost)
+  Histogram_t FlushLatency; //! Time between the first record of the block and the end of its write (microseconds)
+  // private fields
+  int __fd;
+  size_t __blockSize;
+  uint64_t __flushIntervalUs;
+  OutputBlock_t __blocks[OUTPUT_BLOCKS_COUNT];
+  uint64_t __submitted; // the block being filled is __blocks[__submitted % OUTPUT_BLOCKS_COUNT]
+  uint64_t __written;
+  bool __running;
+#ifdef __linux__
+  pthread_t __writer;
+  pthread_mutex_t __mutex;
+  pthread_cond_t __submittedCond;
+  pthread_cond_t __writtenCond;
+#endif
+} Output_t;
+
+/**
+ * @brief OutputInit
+ * Initializes values for the new output object.
+ * @param o The pointer to the output object
+ * @param fd The file descriptor (1 for stdout)
+ * @param blockSize The size of each block, the full block is submitted for writing
+ * @param flushIntervalMs Max time of the record in the block before it is written (0 - write as soon as possible)
+ */
+void OutputInit(Output_t* o, int fd, size_t blockSize, uint64_t flushIntervalMs);
+/**
+ * @brief OutputStart
+ * Starts the writer thread. Without it (and on Windows) blocks are written by the producer.
+ * @param o The pointer to the output object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int OutputStart(Output_t* o);
+/**
+ * @brief OutputWrite
+ * Appends the data to the current block. The record can be split between blocks, blocks are written in order. Only one
+ * thread can write to the output.
+ * @param o The pointer to the output object
+ * @param data The data
+ * @param size The size of the data
+ */
+void OutputWrite(Output_t* o, const char* data, size_t size);
+/**
+ * @brief OutputWriteString
+ * Appends the null-terminated string to the current block.
+ * @param o The pointer to the output object
+ * @param str The string
+ */
+void OutputWriteString(Output_t* o, const char* str);
+/**
+ * @brief OutputStop
+ * Writes all pending records and stops the writer thread.
+ * @param o The pointer to the output object
+ */
+void OutputStop(Output_t* o);
+/**
+ * @brief OutputClear
+ * Clears the passed output object. The output must be stopped.
+ * @param o The pointer to the output object
+ */
+void OutputClear(Output_t* o);
+
+#endif // __OUTPUT_H
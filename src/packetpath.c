@@ -0,0 +1,487 @@
+#include "packetpath.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static size_t RecordPackets(void* state, SnifferPacket_t* packets, size_t count);
+static size_t WritePcap(void* state, SnifferPacket_t* packets, size_t count);
+static size_t StorePackets(void* state, SnifferPacket_t* packets, size_t count);
+static size_t CountTraffic(void* state, SnifferPacket_t* packets, size_t count);
+static size_t SamplePackets(void* state, SnifferPacket_t* packets, size_t count);
+static size_t PrintPackets(void* state, SnifferPacket_t* packets, size_t count);
+static void PrintPacket(PrintingContext_t* context, const Sniffer_t* sniffer, const SnifferPacket_t* packet);
+static void DecodePacketEvents(PrintingContext_t* context,
+                               const SnifferPacket_t* packet,
+                               size_t hdroffset,
+                               const char** decoded,
+                               const char** analysis);
+static void SubmitTextRecord(PrintingContext_t* context,
+                             const Sniffer_t* sniffer,
+                             const SnifferPacket_t* packet,
+                             const char* decoded,
+                             const char* analysis);
+static void SubmitTextNote(PrintingContext_t* context, const char* note, size_t length);
+static bool SamplePacket(PrintingContext_t* context, const Sniffer_t* sniffer, Buffer_t buffer, size_t size);
+static void PrintPacketRecord(const Sniffer_t* sniffer, PrintingContext_t* context, const SnifferPacket_t* packet);
+
+void PrintingContextInit(PrintingContext_t* context, OutputFormat_t format, size_t payloadBytes)
+{
+  ASSERT("Cannot init the printing context ('PrintingContext_t'): context == NULL.", context != NULL);
+
+  context->Dns = NULL;
+  context->Http = NULL;
+  context->Tcp = NULL;
+  context->DecodedBuffer = NULL;
+  context->AnalysisBuffer = NULL;
+  context->RecordBuffer = NULL;
+  context->Pool = NULL;
+  context->WorkerBuffers = NULL;
+  context->WorkersCount = 0;
+  context->Sampler = NULL;
+  context->Traffic = NULL;
+  context->Metrics = NULL;
+  context->Control = NULL;
+  context->Pcap = NULL;
+  context->Recorder = NULL;
+  context->DumpOnRstPort = -1;
+  context->Storage = NULL;
+  context->HandlerLatency = NULL;
+  context->Pipeline = NULL;
+  context->Sniffer = NULL;
+  context->Format = format;
+  context->PayloadBytes = payloadBytes;
+}
+
+PROCESSING_HANDLER_FUNC(ProcessPacket, owner, buffer, size, time, args)
+{
+  if (args == NULL)
+    return;
+
+  Sniffer_t* sniffer = (Sniffer_t*) owner;
+  ASSERT("Cannot convert 'void*' to 'Sniffer_t*'.", sniffer != NULL);
+
+  PrintingContext_t* context = (PrintingContext_t*) args;
+  ASSERT("Cannot convert 'handlerArgs_t' to 'PrintingContext_t*'.", context != NULL);
+
+  SnifferPacket_t packet;
+  packet.Data = buffer;
+  packet.Size = size;
+  packet.Time = time;
+  packet.MatchedAddress = sniffer->MatchedAddress;
+  packet.MatchedDirection = sniffer->MatchedDirection;
+  packet.ChecksumStatus = sniffer->ChecksumStatus;
+  packet.ClientHelloDecoded = sniffer->TlsEvent.ClientHelloDecoded;
+  packet.SNI = sniffer->TlsEvent.SNI;
+  PipelinePush(context->Pipeline, &packet, 1);
+}
+
+PROCESSING_HANDLER_FUNC(MeasurePacket, owner, buffer, size, time, args)
+{
+  uint64_t start = GetMonotonicTimeNs();
+  ProcessPacket(owner, buffer, size, time, args);
+  PrintingContext_t* context = (PrintingContext_t*) args;
+  HistogramAdd(context->HandlerLatency, GetMonotonicTimeNs() - start);
+}
+
+int AddPipelineStages(PrintingContext_t* context)
+{
+  // the recorder, the pcap file, the storage and counters see all packets, sampling drops packets before they are
+  // decoded and formatted
+  PipelineStage_t recorder = {"recorder", NULL, RecordPackets, NULL, NULL, context, false};
+  PipelineStage_t pcap = {"pcap", NULL, WritePcap, NULL, NULL, context, false};
+  PipelineStage_t store = {"store", NULL, StorePackets, NULL, NULL, context, false};
+  PipelineStage_t traffic = {"traffic", NULL, CountTraffic, NULL, NULL, context, false};
+  PipelineStage_t sampling = {"sampling", NULL, SamplePackets, NULL, NULL, context, false};
+  PipelineStage_t output = {"output", NULL, PrintPackets, NULL, NULL, context, false};
+
+  if (context->Recorder != NULL && PipelineAddStage(context->Pipeline, &recorder) < 0)
+    return -1;
+  if (context->Pcap != NULL && PipelineAddStage(context->Pipeline, &pcap) < 0)
+    return -1;
+  if (context->Storage != NULL && PipelineAddStage(context->Pipeline, &store) < 0)
+    return -1;
+  if (context->Traffic != NULL && PipelineAddStage(context->Pipeline, &traffic) < 0)
+    return -1;
+  if (context->Sampler != NULL && PipelineAddStage(context->Pipeline, &sampling) < 0)
+    return -1;
+  // only counters are updated, packets are not decoded
+  if (context->Format != OutputFormat_STATS && PipelineAddStage(context->Pipeline, &output) < 0)
+    return -1;
+  return 0;
+}
+
+size_t RecordPackets(void* state, SnifferPacket_t* packets, size_t count)
+{
+  PrintingContext_t* context = (PrintingContext_t*) state;
+
+  size_t hdroffset = 0;
+#ifdef __linux__
+  if (context->Sniffer->ETHHeaderIncluded)
+    hdroffset = GetETHHeaderLength();
+#endif
+
+  for (size_t i = 0; i < count; ++i) {
+    FlightRecorderAdd(context->Recorder, (const uint8_t*) packets[i].Data, packets[i].Size, &packets[i].Time);
+    if (context->DumpOnRstPort < 0)
+      continue;
+    // the RST is recorded before the trigger, so the dump includes it
+    PacketView_t view;
+    if (DecodePacketView(packets[i].Data + hdroffset, packets[i].Size - hdroffset, &view) == 0 &&
+        view.Protocol == Protocol_TCP && (view.TCPFlags & TCPFlag_RST) != 0 &&
+        (context->DumpOnRstPort == 0 || view.DestinationPort == context->DumpOnRstPort))
+      FlightRecorderTrigger(context->Recorder, NULL);
+  }
+  return count;
+}
+
+size_t WritePcap(void* state, SnifferPacket_t* packets, size_t count)
+{
+  PrintingContext_t* context = (PrintingContext_t*) state;
+  PcapSinkWrite(context->Pcap, packets, count);
+  return count;
+}
+
+size_t StorePackets(void* state, SnifferPacket_t* packets, size_t count)
+{
+  PrintingContext_t* context = (PrintingContext_t*) state;
+  StorageWriterWrite(context->Storage, packets, count);
+  return count;
+}
+
+size_t CountTraffic(void* state, SnifferPacket_t* packets, size_t count)
+{
+  PrintingContext_t* context = (PrintingContext_t*) state;
+
+  size_t hdroffset = 0;
+#ifdef __linux__
+  if (context->Sniffer->ETHHeaderIncluded)
+    hdroffset = GetETHHeaderLength();
+#endif
+
+  // rules of the file are counted by their table, the traffic has their sum
+  size_t addresses = context->Sniffer->AddressesCount;
+  for (size_t i = 0; i < count; ++i)
+    TrafficStatsAdd(context->Traffic,
+                    GetIPHeader(packets[i].Data + hdroffset)->Protocol,
+                    packets[i].MatchedDirection,
+                    packets[i].MatchedAddress < addresses ? packets[i].MatchedAddress : TRAFFIC_RULES_FILE,
+                    packets[i].Size - hdroffset);
+  return count;
+}
+
+size_t SamplePackets(void* state, SnifferPacket_t* packets, size_t count)
+{
+  PrintingContext_t* context = (PrintingContext_t*) state;
+
+  size_t passed = 0;
+  for (size_t i = 0; i < count; ++i)
+    if (SamplePacket(context, context->Sniffer, packets[i].Data, packets[i].Size))
+      packets[passed++] = packets[i];
+  return passed;
+}
+
+size_t PrintPackets(void* state, SnifferPacket_t* packets, size_t count)
+{
+  PrintingContext_t* context = (PrintingContext_t*) state;
+  for (size_t i = 0; i < count; ++i)
+    PrintPacket(context, context->Sniffer, &packets[i]);
+  return count;
+}
+
+void PrintPacket(PrintingContext_t* context, const Sniffer_t* sniffer, const SnifferPacket_t* packet)
+{
+  PacketBuffers_t* buffers = &context->Buffers;
+  Buffer_t buffer = packet->Data;
+  size_t size = packet->Size;
+  TimeInfo_t time = packet->Time;
+
+  size_t hdroffset = 0;
+#ifdef __linux__
+  if (sniffer->ETHHeaderIncluded)
+    hdroffset = GetETHHeaderLength();
+#endif
+
+  if (context->Format != OutputFormat_TEXT) {
+    PrintPacketRecord(sniffer, context, packet);
+    return;
+  }
+
+  // trackers keep the state of flows, so events are decoded in the capture order
+  const char* decoded;
+  const char* analysis;
+  DecodePacketEvents(context, packet, hdroffset, &decoded, &analysis);
+  if (context->Pool != NULL) {
+    SubmitTextRecord(context, sniffer, packet, decoded, analysis);
+    return;
+  }
+
+#ifdef __linux__
+  if (sniffer->ETHHeaderIncluded) {
+    char ethHeader[ETH_HEADER_BUFFER_SUFFICIENT_SIZE];
+    char* ethHeaderBuffer = ethHeader;
+    PrintPacketETHHeader(buffer, &ethHeaderBuffer, sizeof(ethHeader));
+    OutputWriteString(&context->Output, ethHeaderBuffer);
+    OutputWrite(&context->Output, " ", 1);
+  }
+#endif
+
+  // decoded packets are printed by their decoder instead of the hex dump
+  if (decoded != NULL)
+    PrintPacketHeadersToBuffers(buffer + hdroffset, buffers, &time);
+  else
+    PrintPacketToBuffers(buffer + hdroffset, size - hdroffset, buffers, &time);
+
+  PROFILE_START(outputStart);
+  OutputWriteString(&context->Output, buffers->IPHeaderBuffer);
+  OutputWrite(&context->Output, " ", 1);
+  OutputWriteString(&context->Output, buffers->ProtocolHeaderBuffer);
+  OutputWrite(&context->Output, " ", 1);
+  OutputWriteString(&context->Output, decoded != NULL ? decoded : buffers->DataBuffer);
+  if (analysis != NULL)
+    OutputWriteString(&context->Output, analysis);
+  if (sniffer->VerifyChecksums) {
+    OutputWriteString(&context->Output, "| Checksum status: ");
+    OutputWriteString(&context->Output, ChecksumStatusToString(packet->ChecksumStatus));
+    OutputWrite(&context->Output, "\n\n", 2);
+  }
+  PROFILE_STOP(ProfileStage_OUTPUT, outputStart);
+}
+
+void DecodePacketEvents(PrintingContext_t* context,
+                        const SnifferPacket_t* packet,
+                        size_t hdroffset,
+                        const char** decoded,
+                        const char** analysis)
+{
+  *decoded = NULL;
+  *analysis = NULL;
+
+  const TimeInfo_t* time = &packet->Time;
+  PacketView_t view;
+  bool viewDecoded =
+      (packet->ClientHelloDecoded || context->Dns != NULL || context->Http != NULL || context->Tcp != NULL) &&
+      DecodePacketView(packet->Data + hdroffset, packet->Size - hdroffset, &view) == 0;
+
+  // the ClientHello is parsed again from the payload, the packet keeps only the result of the sniffer
+  TlsEvent_t tlsEvent;
+  if (viewDecoded && packet->ClientHelloDecoded &&
+      TlsParseClientHello((const uint8_t*) view.Payload, view.PayloadSize, &tlsEvent.Hello) == 0) {
+    tlsEvent.ClientHelloDecoded = true;
+    tlsEvent.SNI = packet->SNI;
+    tlsEvent.PatternMask = 0;
+    PrintTlsEvent(&tlsEvent, &context->DecodedBuffer, DECODED_BUFFER_SUFFICIENT_SIZE);
+    *decoded = context->DecodedBuffer;
+  } else if (viewDecoded) {
+    bool found = false;
+    if (context->Dns != NULL) {
+      DnsEvent_t dnsEvent;
+      if ((found = DnsTrackerProcess(context->Dns, &view, time, &dnsEvent) > 0))
+        PrintDnsEvent(&dnsEvent, &context->DecodedBuffer, DECODED_BUFFER_SUFFICIENT_SIZE);
+    }
+    if (!found && context->Http != NULL) {
+      HttpEvent_t httpEvent;
+      if ((found = HttpTrackerProcess(context->Http, &view, time, &httpEvent) > 0))
+        PrintHttpEvent(&httpEvent, &context->DecodedBuffer, DECODED_BUFFER_SUFFICIENT_SIZE);
+    }
+    if (found)
+      *decoded = context->DecodedBuffer;
+  }
+
+  if (viewDecoded && context->Tcp != NULL) {
+    TcpEvent_t tcpEvent;
+    if (TcpAnalyzerProcess(context->Tcp, &view, time, &tcpEvent) > 0) {
+      PrintTcpEvent(&tcpEvent, &context->AnalysisBuffer, DECODED_BUFFER_SUFFICIENT_SIZE);
+      *analysis = context->AnalysisBuffer;
+    }
+  }
+}
+
+void SubmitTextRecord(PrintingContext_t* context,
+                      const Sniffer_t* sniffer,
+                      const SnifferPacket_t* packet,
+                      const char* decoded,
+                      const char* analysis)
+{
+  TextRecordHeader_t header;
+  header.Time = packet->Time;
+  header.PacketSize = packet->Size < ETH_MAX_PACKET_SIZE ? packet->Size : ETH_MAX_PACKET_SIZE;
+  header.DecodedSize = decoded != NULL ? strnlen(decoded, DECODED_BUFFER_SUFFICIENT_SIZE - 1) + 1 : 0;
+  header.AnalysisSize = analysis != NULL ? strnlen(analysis, DECODED_BUFFER_SUFFICIENT_SIZE - 1) + 1 : 0;
+  header.ChecksumStatus = packet->ChecksumStatus;
+#ifdef __linux__
+  header.ETHHeaderIncluded = sniffer->ETHHeaderIncluded;
+#else
+  header.ETHHeaderIncluded = false;
+#endif
+  header.VerifyChecksums = sniffer->VerifyChecksums;
+
+  // the window can be full, the capture thread waits for the writer here
+  uint8_t* input = FormatPoolAcquire(context->Pool);
+  size_t length = 0;
+  memcpy(input + length, &header, sizeof(header));
+  length += sizeof(header);
+  memcpy(input + length, packet->Data, header.PacketSize);
+  length += header.PacketSize;
+  if (header.DecodedSize > 0) {
+    memcpy(input + length, decoded, header.DecodedSize - 1);
+    input[length + header.DecodedSize - 1] = '\0';
+    length += header.DecodedSize;
+  }
+  if (header.AnalysisSize > 0) {
+    memcpy(input + length, analysis, header.AnalysisSize - 1);
+    input[length + header.AnalysisSize - 1] = '\0';
+    length += header.AnalysisSize;
+  }
+  FormatPoolSubmit(context->Pool, length);
+}
+
+void SubmitTextNote(PrintingContext_t* context, const char* note, size_t length)
+{
+  TextRecordHeader_t header;
+  memset(&header, 0, sizeof(header));
+  header.DecodedSize = length + 1;
+
+  uint8_t* input = FormatPoolAcquire(context->Pool);
+  memcpy(input, &header, sizeof(header));
+  memcpy(input + sizeof(header), note, length);
+  input[sizeof(header) + length] = '\0';
+  FormatPoolSubmit(context->Pool, sizeof(header) + header.DecodedSize);
+}
+
+void FormatTextRecord(const uint8_t* input, size_t size, FormatSlab_t* slab, size_t worker, void* args)
+{
+  PrintingContext_t* context = (PrintingContext_t*) args;
+  ASSERT("Cannot convert 'void*' to 'PrintingContext_t*'.", context != NULL);
+  PacketBuffers_t* buffers = &context->WorkerBuffers[worker];
+  (void) size;
+
+  TextRecordHeader_t header;
+  memcpy(&header, input, sizeof(header));
+  Buffer_t packet = (Buffer_t) (input + sizeof(header));
+  const char* decoded = (const char*) packet + header.PacketSize;
+  const char* analysis = decoded + header.DecodedSize;
+  if (header.PacketSize == 0) {
+    FormatSlabWriteString(slab, decoded);
+    return;
+  }
+
+  size_t hdroffset = 0;
+#ifdef __linux__
+  if (header.ETHHeaderIncluded) {
+    char ethHeader[ETH_HEADER_BUFFER_SUFFICIENT_SIZE];
+    char* ethHeaderBuffer = ethHeader;
+    PrintPacketETHHeader(packet, &ethHeaderBuffer, sizeof(ethHeader));
+    FormatSlabWriteString(slab, ethHeaderBuffer);
+    FormatSlabWrite(slab, " ", 1);
+
+    hdroffset = GetETHHeaderLength();
+  }
+#endif
+
+  if (header.DecodedSize > 0)
+    PrintPacketHeadersToBuffers(packet + hdroffset, buffers, &header.Time);
+  else
+    PrintPacketToBuffers(packet + hdroffset, header.PacketSize - hdroffset, buffers, &header.Time);
+
+  FormatSlabWriteString(slab, buffers->IPHeaderBuffer);
+  FormatSlabWrite(slab, " ", 1);
+  FormatSlabWriteString(slab, buffers->ProtocolHeaderBuffer);
+  FormatSlabWrite(slab, " ", 1);
+  FormatSlabWriteString(slab, header.DecodedSize > 0 ? decoded : buffers->DataBuffer);
+  if (header.AnalysisSize > 0)
+    FormatSlabWriteString(slab, analysis);
+  if (header.VerifyChecksums) {
+    FormatSlabWriteString(slab, "| Checksum status: ");
+    FormatSlabWriteString(slab, ChecksumStatusToString(header.ChecksumStatus));
+    FormatSlabWrite(slab, "\n\n", 2);
+  }
+}
+
+void PrintPacketRecord(const Sniffer_t* sniffer, PrintingContext_t* context, const SnifferPacket_t* packet)
+{
+  size_t hdroffset = 0;
+#ifdef __linux__
+  if (sniffer->ETHHeaderIncluded)
+    hdroffset = GetETHHeaderLength();
+#else
+  (void) sniffer;
+#endif
+
+  PacketView_t view;
+  if (DecodePacketView(packet->Data + hdroffset, packet->Size - hdroffset, &view) < 0)
+    return; // truncated packet
+
+  if (context->Format == OutputFormat_BRIEF) {
+    char line[BRIEF_LINE_MAX_SIZE];
+    size_t length = PrintPacketBrief(&view, &packet->Time, line, sizeof(line));
+    PROFILE_START(outputStart);
+    OutputWrite(&context->Output, line, length);
+    PROFILE_STOP(ProfileStage_OUTPUT, outputStart);
+  } else {
+    PacketRecord_t record;
+    PacketRecordInit(&record, &view, &packet->Time, packet->ChecksumStatus, context->PayloadBytes);
+    if (context->Format == OutputFormat_JSON) {
+      size_t length = PacketRecordToJson(&record,
+                                         (const uint8_t*) view.Payload,
+                                         packet->SNI,
+                                         context->RecordBuffer,
+                                         PACKET_RECORD_JSON_BUFFER_SUFFICIENT_SIZE);
+      PROFILE_START(outputStart);
+      OutputWrite(&context->Output, context->RecordBuffer, length);
+      PROFILE_STOP(ProfileStage_OUTPUT, outputStart);
+    } else {
+      static const char padding[PACKET_RECORD_ALIGNMENT] = {0};
+      PROFILE_START(outputStart);
+      OutputWrite(&context->Output, (const char*) &record, sizeof(record));
+      OutputWrite(&context->Output, (const char*) view.Payload, record.CapturedSize);
+      OutputWrite(&context->Output, padding, record.Length - sizeof(record) - record.CapturedSize);
+      PROFILE_STOP(ProfileStage_OUTPUT, outputStart);
+    }
+  }
+
+  // events are not printed, but counted in the statistics
+  if (context->Dns != NULL) {
+    DnsEvent_t dnsEvent;
+    DnsTrackerProcess(context->Dns, &view, &packet->Time, &dnsEvent);
+  }
+  if (context->Http != NULL) {
+    HttpEvent_t httpEvent;
+    HttpTrackerProcess(context->Http, &view, &packet->Time, &httpEvent);
+  }
+  if (context->Tcp != NULL) {
+    TcpEvent_t tcpEvent;
+    TcpAnalyzerProcess(context->Tcp, &view, &packet->Time, &tcpEvent);
+  }
+}
+
+bool SamplePacket(PrintingContext_t* context, const Sniffer_t* sniffer, Buffer_t buffer, size_t size)
+{
+  size_t hdroffset = 0;
+#ifdef __linux__
+  if (sniffer->ETHHeaderIncluded)
+    hdroffset = GetETHHeaderLength();
+#else
+  (void) sniffer;
+#endif
+
+  PacketView_t view;
+  bool viewDecoded = DecodePacketView(buffer + hdroffset, size - hdroffset, &view) == 0;
+  uint64_t now = GetMonotonicTimeUs();
+  bool pass = SamplerPass(context->Sampler, viewDecoded ? &view : NULL, now);
+
+  // suppressed packets are reported in the output, so the sampled output can be interpreted
+  if (SamplerReportDue(context->Sampler, now)) {
+    char report[SAMPLING_REPORT_BUFFER_SUFFICIENT_SIZE];
+    size_t length =
+        PrintSamplingReport(context->Sampler, now, context->Format == OutputFormat_JSON, report, sizeof(report));
+    if (context->Format == OutputFormat_BINARY)
+      fputs(report, stderr);
+    else if (context->Pool != NULL)
+      SubmitTextNote(context, report, length);
+    else
+      OutputWrite(&context->Output, report, length);
+    SamplerReportDone(context->Sampler, now);
+  }
+  return pass;
+}
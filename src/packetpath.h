@@ -0,0 +1,106 @@
+#ifndef __PACKETPATH_H
+#define __PACKETPATH_H
+
+#include "sniffer.h"
+#include "cmdargs.h"
+#include "printing.h"
+#include "output.h"
+#include "records.h"
+#include "formatpool.h"
+#include "sampling.h"
+#include "traffic.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "control.h"
+#include "pcap.h"
+#include "recorder.h"
+#include "storage.h"
+
+/*
+ * The packet path of the command line tool: the handler of the sniffer pushes packets to the pipeline, its stages
+ * record, store, count, sample and print packets. Text records are formatted by the capture thread or by workers of
+ * the format pool (FormatTextRecord).
+ */
+
+/**
+ * @brief PrintingContext_t
+ * Arguments of the ProcessPacket handler and stages of the pipeline.
+ */
+typedef struct
+{
+  PacketBuffers_t Buffers;
+  Output_t Output;
+  char* DecodedBuffer;
+  char* AnalysisBuffer;
+  char* RecordBuffer;             //! JSON line (NULL if the format is not JSON)
+  DnsTracker_t* Dns;              //! NULL if DNS decoding is disabled
+  HttpTracker_t* Http;            //! NULL if HTTP decoding is disabled
+  TcpAnalyzer_t* Tcp;             //! NULL if TCP analysis is disabled
+  OutputFormat_t Format;          //! Decoders only collect statistics if the format is not text
+  size_t PayloadBytes;            //! Max payload bytes in JSON and binary records
+  FormatPool_t* Pool;             //! NULL if text records are formatted by the capture thread
+  PacketBuffers_t* WorkerBuffers; //! Buffers of each worker of the pool
+  size_t WorkersCount;            //! Workers of the pool
+  Sampler_t* Sampler;             //! NULL if all packets are printed
+  TrafficStats_t* Traffic;        //! Traffic counters (NULL without the dashboard and the metrics endpoint)
+  MetricsServer_t* Metrics;       //! NULL if the metrics endpoint is disabled
+  ControlServer_t* Control;       //! NULL if the control socket is disabled
+  PcapSink_t* Pcap;               //! The pcap file of the control socket (NULL if the control socket is disabled)
+  FlightRecorder_t* Recorder;     //! NULL if the flight recorder is disabled
+  int64_t DumpOnRstPort;          //! TCP RST to the port triggers the dump (0 - any port, -1 - disabled)
+  StorageWriter_t* Storage;       //! NULL if the indexed storage is disabled
+  Histogram_t* HandlerLatency;    //! Time of the handler (NULL if the metrics endpoint is disabled)
+  Pipeline_t* Pipeline;           //! Stages of captured packets
+  const Sniffer_t* Sniffer;       //! The sniffer (stages run inline, its fields describe the current packet)
+} PrintingContext_t;
+
+/**
+ * @brief TextRecordHeader_t
+ * The beginning of the text record input in the pool. It is followed by the packet, the decoded text and the analysis
+ * text (both null-terminated). The input without the packet is the note, only the decoded text is written.
+ */
+typedef struct
+{
+  TimeInfo_t Time;
+  size_t PacketSize;               //! 0 if the record is the note
+  size_t DecodedSize;              //! 0 if the data is dumped
+  size_t AnalysisSize;             //! 0 if there is no TCP event
+  ChecksumStatus_t ChecksumStatus; //! Checksum status of the packet
+  bool ETHHeaderIncluded;          //! The packet starts with the ETH header
+  bool VerifyChecksums;            //! Print the checksum status
+} TextRecordHeader_t;
+
+#define TEXT_RECORD_INPUT_SIZE (sizeof(TextRecordHeader_t) + ETH_MAX_PACKET_SIZE + 2 * DECODED_BUFFER_SUFFICIENT_SIZE)
+
+/**
+ * @brief PrintingContextInit
+ * Initializes values for the new context object, all optional parts are disabled (NULL).
+ * @param context The pointer to the context object
+ * @param format The output format
+ * @param payloadBytes Max payload bytes in JSON and binary records
+ */
+void PrintingContextInit(PrintingContext_t* context, OutputFormat_t format, size_t payloadBytes);
+/**
+ * @brief ProcessPacket
+ * The handler of the sniffer, pushes the packet to the pipeline of the context (args).
+ */
+PROCESSING_HANDLER_FUNC(ProcessPacket, owner, buffer, size, time, args);
+/**
+ * @brief MeasurePacket
+ * The handler of the sniffer, calls ProcessPacket() and adds its time to the HandlerLatency histogram.
+ */
+PROCESSING_HANDLER_FUNC(MeasurePacket, owner, buffer, size, time, args);
+/**
+ * @brief AddPipelineStages
+ * Adds stages of enabled parts of the context to its pipeline.
+ * @param context The pointer to the context object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int AddPipelineStages(PrintingContext_t* context);
+/**
+ * @brief FormatTextRecord
+ * Formats the text record submitted by the capture thread (FormatPoolFunc_t), args is the context.
+ */
+void FormatTextRecord(const uint8_t* input, size_t size, FormatSlab_t* slab, size_t worker, void* args);
+
+#endif // __PACKETPATH_H
@@ -0,0 +1,152 @@
+#include "pcap.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+void PcapFileHeaderInit(PcapFileHeader_t* header, uint32_t linkType)
+{
+  header->Magic = PCAP_MAGIC_NANOSECONDS;
+  header->VersionMajor = PCAP_VERSION_MAJOR;
+  header->VersionMinor = PCAP_VERSION_MINOR;
+  header->ThisZone = 0;
+  header->SigFigs = 0;
+  header->SnapshotLength = PCAP_SNAPSHOT_LENGTH;
+  header->LinkType = linkType;
+}
+
+int PcapWriterOpen(PcapWriter_t* w, const char* path, uint32_t linkType)
+{
+  ASSERT("Cannot open the pcap file ('PcapWriter_t'): w == NULL.", w != NULL);
+
+  w->Packets = 0;
+  w->Bytes = 0;
+  w->Errors = 0;
+  w->ErrorMessage = NULL;
+  w->__file = fopen(path, "wb");
+  if (w->__file == NULL) {
+    FormatStringBuffer(&w->ErrorMessage, "Cannot create the pcap file '%s': %s", path, strerror(errno));
+    return -1;
+  }
+
+  PcapFileHeader_t header;
+  PcapFileHeaderInit(&header, linkType);
+  if (fwrite(&header, sizeof(header), 1, w->__file) != 1) {
+    FormatStringBuffer(&w->ErrorMessage, "Cannot write the pcap file '%s': %s", path, strerror(errno));
+    fclose(w->__file);
+    w->__file = NULL;
+    return -1;
+  }
+  w->Bytes = sizeof(header);
+  return 0;
+}
+
+int PcapWriterWrite(PcapWriter_t* w, const uint8_t* data, size_t size, const TimeInfo_t* time)
+{
+  PcapRecordHeader_t header;
+  header.TimestampSec = (uint32_t) time->TimestampSec;
+  header.TimestampNanosec = time->TimestampNanosec;
+  header.CapturedLength = (uint32_t) (size < PCAP_SNAPSHOT_LENGTH ? size : PCAP_SNAPSHOT_LENGTH);
+  header.OriginalLength = (uint32_t) size;
+  return PcapWriterWriteRecord(w, &header, data);
+}
+
+int PcapWriterWriteRecord(PcapWriter_t* w, const PcapRecordHeader_t* header, const uint8_t* data)
+{
+  if (fwrite(header, sizeof(PcapRecordHeader_t), 1, w->__file) != 1 ||
+      fwrite(data, 1, header->CapturedLength, w->__file) != header->CapturedLength) {
+    w->Errors++;
+    return -1;
+  }
+  w->Packets++;
+  w->Bytes += sizeof(PcapRecordHeader_t) + header->CapturedLength;
+  return 0;
+}
+
+int PcapWriterClose(PcapWriter_t* w)
+{
+  if (w == NULL)
+    return 0;
+
+  int rc = 0;
+  if (w->__file != NULL) {
+    rc = fclose(w->__file) == 0 && w->Errors == 0 ? 0 : -1;
+    w->__file = NULL;
+  }
+  free(w->ErrorMessage);
+  w->ErrorMessage = NULL;
+  return rc;
+}
+
+void PcapSinkInit(PcapSink_t* s)
+{
+  ASSERT("Cannot init the pcap sink ('PcapSink_t'): s == NULL.", s != NULL);
+
+  atomic_init(&s->__writer, NULL);
+  atomic_init(&s->__busy, false);
+}
+
+int PcapSinkStart(PcapSink_t* s, const char* path, uint32_t linkType, char** error)
+{
+  if (atomic_load(&s->__writer) != NULL) {
+    FormatStringBuffer(error, "The pcap file is already written, stop it first.");
+    return -1;
+  }
+
+  PcapWriter_t* w = malloc(sizeof(PcapWriter_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", w != NULL);
+  if (PcapWriterOpen(w, path, linkType) < 0) {
+    FormatStringBuffer(error, "%s", w->ErrorMessage);
+    PcapWriterClose(w);
+    free(w);
+    return -1;
+  }
+
+  PcapWriter_t* expected = NULL;
+  if (!atomic_compare_exchange_strong(&s->__writer, &expected, w)) {
+    FormatStringBuffer(error, "The pcap file is already written, stop it first.");
+    PcapWriterClose(w);
+    free(w);
+    return -1;
+  }
+  return 0;
+}
+
+int64_t PcapSinkStop(PcapSink_t* s)
+{
+  PcapWriter_t* w = atomic_exchange(&s->__writer, NULL);
+  if (w == NULL)
+    return -1;
+
+  // the capture thread has loaded the writer before the exchange if it is busy, it writes at most one batch
+  while (atomic_load(&s->__busy))
+    ;
+
+  int64_t packets = (int64_t) w->Packets;
+  PcapWriterClose(w);
+  free(w);
+  return packets;
+}
+
+void PcapSinkWrite(PcapSink_t* s, const SnifferPacket_t* packets, size_t count)
+{
+  // the stopped sink costs one relaxed load per batch
+  if (atomic_load_explicit(&s->__writer, memory_order_relaxed) == NULL)
+    return;
+
+  // the busy flag is stored before the writer is loaded (both sequentially consistent), so PcapSinkStop() either sees
+  // the flag or the capture thread sees NULL
+  atomic_store(&s->__busy, true);
+  PcapWriter_t* w = atomic_load(&s->__writer);
+  if (w != NULL) {
+    for (size_t i = 0; i < count; ++i)
+      PcapWriterWrite(w, (const uint8_t*) packets[i].Data, packets[i].Size, &packets[i].Time);
+  }
+  atomic_store_explicit(&s->__busy, false, memory_order_release);
+}
+
+bool PcapSinkStarted(PcapSink_t* s)
+{
+  return atomic_load(&s->__writer) != NULL;
+}
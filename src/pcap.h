@@ -0,0 +1,151 @@
+#ifndef __PCAP_H
+#define __PCAP_H
+
+#include "sniffer.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PCAP_MAGIC_NANOSECONDS 0xA1B23C4D
+#define PCAP_VERSION_MAJOR 2
+#define PCAP_VERSION_MINOR 4
+#define PCAP_SNAPSHOT_LENGTH 65535
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_LINKTYPE_RAW 101
+
+/**
+ * @brief PcapFileHeader_t
+ * The header of the pcap file (timestamps in nanoseconds, the byte order of the host).
+ */
+typedef struct
+{
+  uint32_t Magic;
+  uint16_t VersionMajor;
+  uint16_t VersionMinor;
+  int32_t ThisZone;
+  uint32_t SigFigs;
+  uint32_t SnapshotLength;
+  uint32_t LinkType;
+} PcapFileHeader_t;
+
+/**
+ * @brief PcapRecordHeader_t
+ * The header of the packet of the pcap file.
+ */
+typedef struct
+{
+  uint32_t TimestampSec;
+  uint32_t TimestampNanosec;
+  uint32_t CapturedLength;
+  uint32_t OriginalLength;
+} PcapRecordHeader_t;
+
+/**
+ * @brief PcapWriter_t
+ * Writes packets to the pcap file.
+ */
+typedef struct
+{
+  uint64_t Packets;   //! Written packets
+  uint64_t Bytes;     //! Written bytes (including headers)
+  uint64_t Errors;    //! Failed writes
+  char* ErrorMessage; //! Error messages
+  // private fields
+  FILE* __file;
+} PcapWriter_t;
+
+/**
+ * @brief PcapSink_t
+ * The pcap file started and stopped while packets are captured. The capture thread never waits: it marks itself busy
+ * while it writes, and the writer is closed only after the capture thread is not busy with it.
+ */
+typedef struct
+{
+  // private fields
+  _Atomic(PcapWriter_t*) __writer;
+  atomic_bool __busy; // the capture thread uses the writer
+} PcapSink_t;
+
+/**
+ * @brief PcapFileHeaderInit
+ * Initializes the file header.
+ * @param header The pointer to the file header
+ * @param linkType PCAP_LINKTYPE_ETHERNET if packets start with the ETH header, otherwise PCAP_LINKTYPE_RAW
+ */
+void PcapFileHeaderInit(PcapFileHeader_t* header, uint32_t linkType);
+/**
+ * @brief PcapWriterOpen
+ * Creates the file and writes the file header.
+ * @param w The pointer to the writer object
+ * @param path The file
+ * @param linkType PCAP_LINKTYPE_ETHERNET if packets start with the ETH header, otherwise PCAP_LINKTYPE_RAW
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int PcapWriterOpen(PcapWriter_t* w, const char* path, uint32_t linkType);
+/**
+ * @brief PcapWriterWrite
+ * Writes the packet (truncated to PCAP_SNAPSHOT_LENGTH bytes).
+ * @param w The pointer to the writer object
+ * @param data The packet
+ * @param size The size of the packet
+ * @param time Time of the capture
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int PcapWriterWrite(PcapWriter_t* w, const uint8_t* data, size_t size, const TimeInfo_t* time);
+/**
+ * @brief PcapWriterWriteRecord
+ * Writes the packet read from another pcap file or the storage, the original length of the packet is kept.
+ * @param w The pointer to the writer object
+ * @param header The header of the record (CapturedLength bytes of the data are written)
+ * @param data The captured part of the packet
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int PcapWriterWriteRecord(PcapWriter_t* w, const PcapRecordHeader_t* header, const uint8_t* data);
+/**
+ * @brief PcapWriterClose
+ * Flushes and closes the file, frees error messages.
+ * @param w The pointer to the writer object
+ * @return -1 if the file is not completely written, otherwise 0.
+ */
+int PcapWriterClose(PcapWriter_t* w);
+
+/**
+ * @brief PcapSinkInit
+ * Initializes values for the new (stopped) sink object.
+ * @param s The pointer to the sink object
+ */
+void PcapSinkInit(PcapSink_t* s);
+/**
+ * @brief PcapSinkStart
+ * Opens the file, next packets passed to PcapSinkWrite() are written to it.
+ * @param s The pointer to the sink object
+ * @param path The file
+ * @param linkType PCAP_LINKTYPE_ETHERNET or PCAP_LINKTYPE_RAW
+ * @param error Error message (if occurred)
+ * @return -1 if an error occurred or the sink is already started, otherwise 0.
+ */
+int PcapSinkStart(PcapSink_t* s, const char* path, uint32_t linkType, char** error);
+/**
+ * @brief PcapSinkStop
+ * Closes the file. Waits until the capture thread finishes the batch it writes.
+ * @param s The pointer to the sink object
+ * @return Packets written to the file, or -1 if the sink is not started.
+ */
+int64_t PcapSinkStop(PcapSink_t* s);
+/**
+ * @brief PcapSinkWrite
+ * Writes packets if the sink is started. Only the capture thread calls it.
+ * @param s The pointer to the sink object
+ * @param packets Packets
+ * @param count Packets count
+ */
+void PcapSinkWrite(PcapSink_t* s, const SnifferPacket_t* packets, size_t count);
+/**
+ * @brief PcapSinkStarted
+ * @param s The pointer to the sink object
+ * @return true if packets are written.
+ */
+bool PcapSinkStarted(PcapSink_t* s);
+
+#endif // __PCAP_H
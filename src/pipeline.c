@@ -0,0 +1,359 @@
+#include "pipeline.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void RunStages(Pipeline_t* p, size_t first, bool queued, SnifferPacket_t* packets, size_t count);
+static void PublishCounters(Pipeline_t* p,
+                            size_t first,
+                            size_t last,
+                            const size_t* packetsIn,
+                            const size_t* packetsOut,
+                            const uint64_t* elapsed);
+#ifdef __linux__
+static void InitQueue(Pipeline_t* p, size_t index);
+static void StopQueue(PipelineQueue_t* q);
+static void Enqueue(Pipeline_t* p, PipelineQueue_t* q, const SnifferPacket_t* packets, size_t count);
+static void* StageThread(void* args);
+#endif
+
+void PipelineInit(Pipeline_t* p, size_t batchCapacity, size_t queueDepth)
+{
+  ASSERT("Cannot init pipeline ('Pipeline_t'): p == NULL.", p != NULL);
+
+  p->StagesCount = 0;
+  p->ErrorMessage = NULL;
+  memset(p->__stages, 0, sizeof(p->__stages));
+  memset(p->__counters, 0, sizeof(p->__counters));
+  memset(p->__queues, 0, sizeof(p->__queues));
+  for (size_t i = 0; i < PIPELINE_STAGES_MAX; ++i) {
+    HistogramInit(&p->__counters[i].BatchNs);
+    atomic_init(&p->__sequences[i], 0);
+  }
+
+  p->__batchCapacity = batchCapacity > 0 ? batchCapacity : 1;
+  p->__queueDepth = queueDepth > 0 ? queueDepth : 1;
+  p->__pushBatch = malloc(sizeof(SnifferPacket_t) * p->__batchCapacity);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", p->__pushBatch != NULL);
+  p->__threaded = false;
+  p->__started = false;
+}
+
+int PipelineAddStage(Pipeline_t* p, const PipelineStage_t* stage)
+{
+  if (p->__started) {
+    FormatStringBuffer(&p->ErrorMessage, "This pipeline was already started.");
+    return -1;
+  }
+  if (p->StagesCount >= PIPELINE_STAGES_MAX) {
+    FormatStringBuffer(&p->ErrorMessage, "Too many pipeline stages (max: %d).", PIPELINE_STAGES_MAX);
+    return -1;
+  }
+  if (stage->Process == NULL) {
+    FormatStringBuffer(&p->ErrorMessage, "The pipeline stage '%s' has no Process callback.", stage->Name);
+    return -1;
+  }
+
+  p->__stages[p->StagesCount] = *stage;
+  p->__counters[p->StagesCount].Name = stage->Name;
+  p->__counters[p->StagesCount].Threaded = stage->Threaded;
+  p->StagesCount++;
+  return 0;
+}
+
+int PipelineStart(Pipeline_t* p)
+{
+  if (p->__started) {
+    FormatStringBuffer(&p->ErrorMessage, "This pipeline was already started.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < p->StagesCount; ++i) {
+    if (p->__stages[i].Init != NULL && p->__stages[i].Init(p->__stages[i].State) < 0) {
+      FormatStringBuffer(&p->ErrorMessage, "Cannot init the pipeline stage '%s'.", p->__stages[i].Name);
+      return -1;
+    }
+  }
+  p->__started = true;
+
+#ifdef __linux__
+  p->__threaded = true;
+  for (size_t i = 0; i < p->StagesCount; ++i) {
+    if (!p->__stages[i].Threaded)
+      continue;
+
+    InitQueue(p, i);
+    if (pthread_create(&p->__queues[i].__stageThread, NULL, StageThread, &p->__queues[i]) != 0) {
+      // nothing is pushed yet, started threads exit at once and all stages run inline
+      for (size_t j = 0; j < i; ++j)
+        if (p->__stages[j].Threaded)
+          StopQueue(&p->__queues[j]);
+      p->__threaded = false;
+      break;
+    }
+  }
+  for (size_t i = 0; i < p->StagesCount; ++i)
+    p->__counters[i].Threaded = p->__threaded && p->__stages[i].Threaded;
+#endif
+  return 0;
+}
+
+void PipelinePush(Pipeline_t* p, const SnifferPacket_t* packets, size_t count)
+{
+  // descriptors are copied, stages may drop and reorder packets of the batch
+  while (count > 0) {
+    size_t n = count < p->__batchCapacity ? count : p->__batchCapacity;
+    memcpy(p->__pushBatch, packets, sizeof(SnifferPacket_t) * n);
+    RunStages(p, 0, false, p->__pushBatch, n);
+    packets += n;
+    count -= n;
+  }
+}
+
+void PipelineStop(Pipeline_t* p)
+{
+  if (p == NULL || !p->__started)
+    return;
+
+#ifdef __linux__
+  if (p->__threaded) {
+    // each thread processes its queue before it exits, so the queues are stopped in the order of stages
+    for (size_t i = 0; i < p->StagesCount; ++i)
+      if (p->__stages[i].Threaded)
+        StopQueue(&p->__queues[i]);
+    p->__threaded = false;
+  }
+#endif
+  for (size_t i = 0; i < p->StagesCount; ++i)
+    if (p->__stages[i].Flush != NULL)
+      p->__stages[i].Flush(p->__stages[i].State);
+  p->__started = false;
+}
+
+size_t PipelineReadCounters(Pipeline_t* p, PipelineStageCounters_t* counters)
+{
+  // each stage has one writer, the copy is retried while the sequence is odd or changed during the copy
+  for (size_t i = 0; i < p->StagesCount; ++i) {
+    while (true) {
+      uint_fast64_t before = atomic_load_explicit(&p->__sequences[i], memory_order_acquire);
+      if (before % 2 == 0) {
+        memcpy(&counters[i], &p->__counters[i], sizeof(PipelineStageCounters_t));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&p->__sequences[i], memory_order_relaxed) == before)
+          break;
+      }
+    }
+  }
+
+#ifdef __linux__
+  for (size_t i = 0; i < p->StagesCount; ++i) {
+    PipelineQueue_t* q = &p->__queues[i];
+    if (q->__slots == NULL)
+      continue;
+
+    pthread_mutex_lock(&q->__mutex);
+    counters[i].QueueDepth = (size_t) (q->__pushed - q->__released);
+    counters[i].QueueMaxDepth = q->__maxDepth;
+    counters[i].QueueWaits = q->__waits;
+    pthread_mutex_unlock(&q->__mutex);
+  }
+#endif
+  return p->StagesCount;
+}
+
+size_t PipelinePrintStageStats(const Pipeline_t* p, size_t stage, char* buffer, size_t bufferSize)
+{
+  if (stage >= p->StagesCount || p->__stages[stage].Stats == NULL)
+    return 0;
+  return p->__stages[stage].Stats(p->__stages[stage].State, buffer, bufferSize);
+}
+
+void PipelineClear(Pipeline_t* p)
+{
+  if (p == NULL)
+    return;
+
+  PipelineStop(p);
+#ifdef __linux__
+  for (size_t i = 0; i < PIPELINE_STAGES_MAX; ++i) {
+    PipelineQueue_t* q = &p->__queues[i];
+    if (q->__slots == NULL)
+      continue;
+
+    for (size_t j = 0; j < p->__queueDepth; ++j) {
+      free(q->__slots[j].Packets);
+      free(q->__slots[j].Data);
+    }
+    free(q->__slots);
+    q->__slots = NULL;
+    pthread_cond_destroy(&q->__notFull);
+    pthread_cond_destroy(&q->__notEmpty);
+    pthread_mutex_destroy(&q->__mutex);
+  }
+#endif
+  free(p->__pushBatch);
+  p->__pushBatch = NULL;
+  free(p->ErrorMessage);
+  p->ErrorMessage = NULL;
+}
+
+void RunStages(Pipeline_t* p, size_t first, bool queued, SnifferPacket_t* packets, size_t count)
+{
+  // the clock is read once per stage of the batch, counters are published after the last stage of this thread
+  size_t packetsIn[PIPELINE_STAGES_MAX];
+  size_t packetsOut[PIPELINE_STAGES_MAX];
+  uint64_t elapsed[PIPELINE_STAGES_MAX];
+  size_t last = first;
+  uint64_t time = GetMonotonicTimeNs();
+  for (size_t i = first; i < p->StagesCount && count > 0; ++i) {
+#ifdef __linux__
+    // the stage and next inline stages are run by the thread of the stage
+    if (p->__threaded && p->__stages[i].Threaded && !(queued && i == first)) {
+      PublishCounters(p, first, last, packetsIn, packetsOut, elapsed);
+      Enqueue(p, &p->__queues[i], packets, count);
+      return;
+    }
+#else
+    (void) queued;
+#endif
+    const PipelineStage_t* stage = &p->__stages[i];
+    size_t passed = stage->Process(stage->State, packets, count);
+    uint64_t now = GetMonotonicTimeNs();
+    packetsIn[i] = count;
+    packetsOut[i] = passed < count ? passed : count;
+    elapsed[i] = now - time;
+    count = packetsOut[i];
+    time = now;
+    last = i + 1;
+  }
+  PublishCounters(p, first, last, packetsIn, packetsOut, elapsed);
+}
+
+void PublishCounters(Pipeline_t* p,
+                     size_t first,
+                     size_t last,
+                     const size_t* packetsIn,
+                     const size_t* packetsOut,
+                     const uint64_t* elapsed)
+{
+  // the only writer of these stages, readers retry while the sequence is odd or changed during their copy
+  for (size_t i = first; i < last; ++i) {
+    PipelineStageCounters_t* counters = &p->__counters[i];
+    uint_fast64_t sequence = atomic_load_explicit(&p->__sequences[i], memory_order_relaxed);
+    atomic_store_explicit(&p->__sequences[i], sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    counters->Batches++;
+    counters->PacketsIn += packetsIn[i];
+    counters->PacketsOut += packetsOut[i];
+    counters->BusyNs += elapsed[i];
+    HistogramAdd(&counters->BatchNs, elapsed[i]);
+    atomic_store_explicit(&p->__sequences[i], sequence + 2, memory_order_release);
+  }
+}
+
+#ifdef __linux__
+void InitQueue(Pipeline_t* p, size_t index)
+{
+  PipelineQueue_t* q = &p->__queues[index];
+  q->__slots = malloc(sizeof(PipelineBatch_t) * p->__queueDepth);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", q->__slots != NULL);
+  for (size_t i = 0; i < p->__queueDepth; ++i) {
+    q->__slots[i].Packets = malloc(sizeof(SnifferPacket_t) * p->__batchCapacity);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", q->__slots[i].Packets != NULL);
+    q->__slots[i].Count = 0;
+    q->__slots[i].Data = NULL;
+    q->__slots[i].DataCapacity = 0;
+  }
+  q->__pushed = 0;
+  q->__taken = 0;
+  q->__released = 0;
+  q->__maxDepth = 0;
+  q->__waits = 0;
+  q->__stopping = false;
+  q->__stage = index;
+  q->__pipeline = p;
+  pthread_mutex_init(&q->__mutex, NULL);
+  pthread_cond_init(&q->__notEmpty, NULL);
+  pthread_cond_init(&q->__notFull, NULL);
+}
+
+void StopQueue(PipelineQueue_t* q)
+{
+  pthread_mutex_lock(&q->__mutex);
+  q->__stopping = true;
+  pthread_cond_broadcast(&q->__notEmpty);
+  pthread_mutex_unlock(&q->__mutex);
+  pthread_join(q->__stageThread, NULL);
+}
+
+void Enqueue(Pipeline_t* p, PipelineQueue_t* q, const SnifferPacket_t* packets, size_t count)
+{
+  // each queue has one producer, the thread of the previous stages
+  pthread_mutex_lock(&q->__mutex);
+  if (q->__pushed - q->__released >= p->__queueDepth) {
+    q->__waits++;
+    while (q->__pushed - q->__released >= p->__queueDepth)
+      pthread_cond_wait(&q->__notFull, &q->__mutex);
+  }
+  pthread_mutex_unlock(&q->__mutex);
+
+  // the slot is not used by the thread of the stage until it is pushed
+  PipelineBatch_t* slot = &q->__slots[q->__pushed % p->__queueDepth];
+  size_t dataSize = 0;
+  for (size_t i = 0; i < count; ++i)
+    dataSize += packets[i].Size;
+  if (dataSize > slot->DataCapacity) {
+    size_t capacity = slot->DataCapacity > 0 ? slot->DataCapacity : 4096;
+    while (capacity < dataSize)
+      capacity *= 2;
+    slot->Data = realloc(slot->Data, capacity);
+    ASSERT("Cannot reinitialize a buffer: realloc returned size '0'.", slot->Data != NULL);
+    slot->DataCapacity = capacity;
+  }
+
+  size_t offset = 0;
+  for (size_t i = 0; i < count; ++i) {
+    slot->Packets[i] = packets[i];
+    slot->Packets[i].Data = slot->Data + offset;
+    memcpy(slot->Data + offset, packets[i].Data, packets[i].Size);
+    offset += packets[i].Size;
+  }
+  slot->Count = count;
+
+  pthread_mutex_lock(&q->__mutex);
+  q->__pushed++;
+  if (q->__pushed - q->__released > q->__maxDepth)
+    q->__maxDepth = (size_t) (q->__pushed - q->__released);
+  pthread_cond_signal(&q->__notEmpty);
+  pthread_mutex_unlock(&q->__mutex);
+}
+
+void* StageThread(void* args)
+{
+  PipelineQueue_t* q = (PipelineQueue_t*) args;
+  Pipeline_t* p = (Pipeline_t*) q->__pipeline;
+
+  pthread_mutex_lock(&q->__mutex);
+  while (true) {
+    if (q->__taken == q->__pushed) {
+      if (q->__stopping)
+        break;
+      pthread_cond_wait(&q->__notEmpty, &q->__mutex);
+      continue;
+    }
+
+    PipelineBatch_t* slot = &q->__slots[q->__taken % p->__queueDepth];
+    q->__taken++;
+    pthread_mutex_unlock(&q->__mutex);
+    RunStages(p, q->__stage, true, slot->Packets, slot->Count);
+    pthread_mutex_lock(&q->__mutex);
+
+    q->__released++;
+    pthread_cond_signal(&q->__notFull);
+  }
+  pthread_mutex_unlock(&q->__mutex);
+
+  return NULL;
+}
+#endif
@@ -0,0 +1,182 @@
+#ifndef __PIPELINE_H
+#define __PIPELINE_H
+
+#include "sniffer.h"
+#include "histogram.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#define PIPELINE_STAGES_MAX 8
+#define PIPELINE_BATCH_DEFAULT_SIZE 64
+#define PIPELINE_QUEUE_DEFAULT_DEPTH 16
+
+typedef int (*PipelineStageInit_t)(void* state);
+typedef size_t (*PipelineStageProcess_t)(void* state, SnifferPacket_t* packets, size_t count);
+typedef void (*PipelineStageFlush_t)(void* state);
+typedef size_t (*PipelineStagePrintStats_t)(const void* state, char* buffer, size_t bufferSize);
+
+/**
+ * @brief PipelineStage_t
+ * The stage of the pipeline. Process() receives the batch of packets, it may drop packets by moving the packets passed
+ * to the next stage to the beginning of the batch, and returns their count. Other callbacks are optional (NULL).
+ */
+typedef struct
+{
+  const char* Name;                //! Name of the stage in statistics
+  PipelineStageInit_t Init;        //! Called by PipelineStart(), returns -1 if an error occurred
+  PipelineStageProcess_t Process;  //! Processes the batch, returns packets passed to the next stage
+  PipelineStageFlush_t Flush;      //! Called by PipelineStop() after all packets are processed
+  PipelineStagePrintStats_t Stats; //! Prints counters of the stage, returns the length
+  void* State;                     //! Argument of callbacks
+  bool Threaded;                   //! The stage runs on its own thread, fed by the bounded queue (only on Linux)
+} PipelineStage_t;
+
+/**
+ * @brief PipelineStageCounters_t
+ * Counters of the stage, recorded by the pipeline.
+ */
+typedef struct
+{
+  const char* Name;     //! Name of the stage
+  uint64_t Batches;     //! Processed batches
+  uint64_t PacketsIn;   //! Packets received by the stage
+  uint64_t PacketsOut;  //! Packets passed to the next stage
+  uint64_t BusyNs;      //! Time of Process() calls
+  Histogram_t BatchNs;  //! Time of one Process() call (nanoseconds)
+  bool Threaded;        //! The stage runs on its own thread
+  size_t QueueDepth;    //! Batches in the queue of the stage (threaded stages)
+  size_t QueueMaxDepth; //! Max batches in the queue of the stage
+  uint64_t QueueWaits;  //! The previous stage waited for the free slot of the queue (backpressure)
+} PipelineStageCounters_t;
+
+/**
+ * @brief PipelineBatch_t
+ * The slot of the queue. Packets are copied to the data of the slot.
+ */
+typedef struct
+{
+  SnifferPacket_t* Packets;
+  size_t Count;
+  Buffer_t Data;
+  size_t DataCapacity;
+} PipelineBatch_t;
+
+/**
+ * @brief PipelineQueue_t
+ * The bounded queue of batches of the threaded stage. The previous stage waits while the queue is full, so packets
+ * are never dropped between stages.
+ */
+typedef struct
+{
+  PipelineBatch_t* __slots;
+  uint64_t __pushed;   // batches pushed by the previous stage
+  uint64_t __taken;    // batches taken by the thread of the stage
+  uint64_t __released; // batches processed, their slots are free
+  size_t __maxDepth;
+  uint64_t __waits;
+  bool __stopping;
+  size_t __stage;
+  void* __pipeline;
+#ifdef __linux__
+  pthread_mutex_t __mutex;
+  pthread_cond_t __notEmpty;
+  pthread_cond_t __notFull;
+  pthread_t __stageThread;
+#endif
+} PipelineQueue_t;
+
+/**
+ * @brief Pipeline_t
+ * The ordered list of stages over the packet descriptor of the sniffer (SnifferPacket_t). Stages run inline, in the
+ * thread of PipelinePush(), until the threaded stage. Batches are copied to the queue of the threaded stage, its
+ * thread runs the stage and next inline stages. The time of each stage and queue depths are recorded. Counters of the
+ * stage are only written by the thread which runs it, once per batch, and are published through the sequence lock of
+ * the stage, so threads of stages never wait for readers of counters.
+ */
+typedef struct
+{
+  size_t StagesCount; //! Added stages
+  char* ErrorMessage; //! Error messages
+  // private fields
+  PipelineStage_t __stages[PIPELINE_STAGES_MAX];
+  PipelineStageCounters_t __counters[PIPELINE_STAGES_MAX];
+  atomic_uint_fast64_t __sequences[PIPELINE_STAGES_MAX]; // odd while counters of the stage are written
+  PipelineQueue_t __queues[PIPELINE_STAGES_MAX];
+  SnifferPacket_t* __pushBatch;
+  size_t __batchCapacity;
+  size_t __queueDepth;
+  bool __threaded; // threads of threaded stages are running
+  bool __started;
+} Pipeline_t;
+
+/**
+ * @brief PipelineInit
+ * Initializes values for the new pipeline object.
+ * @param p The pointer to the pipeline object
+ * @param batchCapacity Max packets of the batch in queues (larger batches are split)
+ * @param queueDepth Max batches in the queue of each threaded stage
+ */
+void PipelineInit(Pipeline_t* p, size_t batchCapacity, size_t queueDepth);
+/**
+ * @brief PipelineAddStage
+ * Adds the stage after added stages. Stages must be added before PipelineStart().
+ * @param p The pointer to the pipeline object
+ * @param stage The stage (copied)
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int PipelineAddStage(Pipeline_t* p, const PipelineStage_t* stage);
+/**
+ * @brief PipelineStart
+ * Initializes stages and starts threads of threaded stages. If threads cannot be started, all stages run inline.
+ * @param p The pointer to the pipeline object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int PipelineStart(Pipeline_t* p);
+/**
+ * @brief PipelinePush
+ * Passes the batch to the first stage. The data of packets is only used until the function returns. Only one thread
+ * pushes packets.
+ * @param p The pointer to the pipeline object
+ * @param packets Packets
+ * @param count Packets count
+ */
+void PipelinePush(Pipeline_t* p, const SnifferPacket_t* packets, size_t count);
+/**
+ * @brief PipelineStop
+ * Waits until queued batches are processed, stops threads and flushes stages.
+ * @param p The pointer to the pipeline object
+ */
+void PipelineStop(Pipeline_t* p);
+/**
+ * @brief PipelineReadCounters
+ * Copies counters of stages. It may be called by any thread while the pipeline is running, it retries the copy of
+ * the stage while its counters are written.
+ * @param p The pointer to the pipeline object
+ * @param counters Counters of each stage (PIPELINE_STAGES_MAX or StagesCount elements)
+ * @return Stages count.
+ */
+size_t PipelineReadCounters(Pipeline_t* p, PipelineStageCounters_t* counters);
+/**
+ * @brief PipelinePrintStageStats
+ * Prints counters of the stage by its Stats() callback.
+ * @param p The pointer to the pipeline object
+ * @param stage The index of the stage
+ * @param buffer The buffer
+ * @param bufferSize The size of the buffer
+ * @return The length of printed text (0 if the stage has no callback).
+ */
+size_t PipelinePrintStageStats(const Pipeline_t* p, size_t stage, char* buffer, size_t bufferSize);
+/**
+ * @brief PipelineClear
+ * Clears the passed pipeline object.
+ * @param p The pointer to the pipeline object
+ */
+void PipelineClear(Pipeline_t* p);
+
+#endif // __PIPELINE_H
@@ -4,13 +4,43 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
 
 #ifdef __linux__
 #include <arpa/inet.h>
 #elif _WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #endif
 
+#define DNS_PRINTED_ANSWERS_MAX_COUNT 8
+
+static const char HexTable[] = // two hex digits of each byte value
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+static void PrintHeaders(Buffer_t packetBuffer, PacketBuffers_t* buffers, TimeInfo_t* t);
+static size_t AppendFormat(char* buffer, size_t bufferSize, const char* format, ...);
+static char* WriteUnsigned(char* cursor, uint32_t value, int minDigits);
+static char* WriteIPv4(char* cursor, uint32_t address);
+static size_t PrintTcpFlow(const TcpFlow_t* flow, char* buffer, size_t bufferSize);
+static size_t PrintTrafficRow(const char* title,
+                              const char* direction,
+                              const TrafficCounter_t* current,
+                              const TrafficCounter_t* previous,
+                              double seconds,
+                              char* buffer,
+                              size_t bufferSize);
+static const char* FormatRate(double value, char* buffer, size_t bufferSize);
+static const char* FormatAddressTitle(const struct FilterAddress_t* address, char* buffer, size_t bufferSize);
+static size_t PrintMetricHeader(const char* name, const char* type, const char* help, char* buffer, size_t bufferSize);
+
 void PacketBuffersInit(PacketBuffers_t* p)
 {
   ASSERT("Cannot init buffers ('PacketBuffers_t'): p == NULL.", p != NULL);
@@ -23,6 +53,8 @@ void PacketBuffersInit(PacketBuffers_t* p)
 
   p->DataBuffer = malloc(sizeof(char) * DATA_BUFFER_SUFFICIENT_SIZE + 1);
   ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", p->DataBuffer != NULL);
+
+  p->AsciiGutter = false;
 }
 
 void PacketBuffersDelete(PacketBuffers_t* p)
@@ -37,33 +69,27 @@ void PacketBuffersDelete(PacketBuffers_t* p)
 
 void PrintPacketToBuffers(Buffer_t packetBuffer, size_t size, PacketBuffers_t* buffers, TimeInfo_t* t)
 {
-  memset(buffers->IPHeaderBuffer, 0, IP_HEADER_BUFFER_SUFFICIENT_SIZE);
-  memset(buffers->ProtocolHeaderBuffer, 0, PROTOCOL_HEADER_BUFFER_SUFFICIENT_SIZE);
-  memset(buffers->DataBuffer, 0, DATA_BUFFER_SUFFICIENT_SIZE);
+  PROFILE_START(formatStart);
+  PrintHeaders(packetBuffer, buffers, t);
 
-  IPHeader_t* iphdr = GetIPHeader(packetBuffer);
-  PrintPacketIPHeader(packetBuffer, &buffers->IPHeaderBuffer, IP_HEADER_BUFFER_SUFFICIENT_SIZE, t);
-  switch (iphdr->Protocol) {
-  case Protocol_ICMP: {
-    PrintPacketICMPHeader(packetBuffer, &buffers->ProtocolHeaderBuffer, PROTOCOL_HEADER_BUFFER_SUFFICIENT_SIZE);
-    break;
-  }
-  case Protocol_TCP: {
-    PrintPacketTCPHeader(packetBuffer, &buffers->ProtocolHeaderBuffer, PROTOCOL_HEADER_BUFFER_SUFFICIENT_SIZE);
-    break;
-  }
-  case Protocol_UDP: {
-    PrintPacketUDPHeader(packetBuffer, &buffers->ProtocolHeaderBuffer, PROTOCOL_HEADER_BUFFER_SUFFICIENT_SIZE);
-    break;
-  }
-  default:
-    break;
-  }
+  // the frame can be longer than the IP packet (the Ethernet padding)
+  size_t totalLength = ntohs(GetIPHeader(packetBuffer)->TotalLength);
+  if (totalLength > 0 && totalLength < size)
+    size = totalLength;
 
   size_t offset = 0;
   Buffer_t packetDataBuffer = GetPacketData(packetBuffer, &offset);
   if (size >= offset)
-    PrintPacketData(packetDataBuffer, size - offset, &buffers->DataBuffer, DATA_BUFFER_SUFFICIENT_SIZE);
+    PrintPacketData(
+        packetDataBuffer, size - offset, &buffers->DataBuffer, DATA_BUFFER_SUFFICIENT_SIZE, buffers->AsciiGutter);
+  PROFILE_STOP(ProfileStage_FORMAT, formatStart);
+}
+
+void PrintPacketHeadersToBuffers(Buffer_t packetBuffer, PacketBuffers_t* buffers, TimeInfo_t* t)
+{
+  PROFILE_START(formatStart);
+  PrintHeaders(packetBuffer, buffers, t);
+  PROFILE_STOP(ProfileStage_FORMAT, formatStart);
 }
 
 #ifndef _WIN32
@@ -71,28 +97,31 @@ void PrintPacketETHHeader(Buffer_t packetBuffer, char** ethHeaderBuffer, size_t
 {
   ETHHeader_t* ethhdr = GetETHHeader(packetBuffer);
 
-  int length = 0;
-  length += snprintf(*ethHeaderBuffer + length, ethHeaderBufferSize, "\n        ETH Header\n");
-  length += snprintf(*ethHeaderBuffer + length,
-                     ethHeaderBufferSize,
-                     "| Destination Address: %.2x:%.2x:%.2x:%.2x:%.2x:%.2x\n",
-                     ethhdr->DestinationAddressMac[0],
-                     ethhdr->DestinationAddressMac[1],
-                     ethhdr->DestinationAddressMac[2],
-                     ethhdr->DestinationAddressMac[3],
-                     ethhdr->DestinationAddressMac[4],
-                     ethhdr->DestinationAddressMac[5]);
-  length += snprintf(*ethHeaderBuffer + length,
-                     ethHeaderBufferSize,
-                     "| Source Address: %.2x:%.2x:%.2x:%.2x:%.2x:%.2x\n",
-                     ethhdr->SourceAddressMac[0],
-                     ethhdr->SourceAddressMac[1],
-                     ethhdr->SourceAddressMac[2],
-                     ethhdr->SourceAddressMac[3],
-                     ethhdr->SourceAddressMac[4],
-                     ethhdr->SourceAddressMac[5]);
-  length += snprintf(*ethHeaderBuffer + length, ethHeaderBufferSize, "| Protocol: %d\n", ntohs(ethhdr->Protocol));
-  snprintf(*ethHeaderBuffer + length, ethHeaderBufferSize, "\n");
+  size_t length = 0;
+  length += AppendFormat(*ethHeaderBuffer + length, ethHeaderBufferSize - length, "\n        ETH Header\n");
+  length += AppendFormat(*ethHeaderBuffer + length,
+                         ethHeaderBufferSize - length,
+                         "| Destination Address: %.2x:%.2x:%.2x:%.2x:%.2x:%.2x\n",
+                         ethhdr->DestinationAddressMac[0],
+                         ethhdr->DestinationAddressMac[1],
+                         ethhdr->DestinationAddressMac[2],
+                         ethhdr->DestinationAddressMac[3],
+                         ethhdr->DestinationAddressMac[4],
+                         ethhdr->DestinationAddressMac[5]);
+  length += AppendFormat(*ethHeaderBuffer + length,
+                         ethHeaderBufferSize - length,
+                         "| Source Address: %.2x:%.2x:%.2x:%.2x:%.2x:%.2x\n",
+                         ethhdr->SourceAddressMac[0],
+                         ethhdr->SourceAddressMac[1],
+                         ethhdr->SourceAddressMac[2],
+                         ethhdr->SourceAddressMac[3],
+                         ethhdr->SourceAddressMac[4],
+                         ethhdr->SourceAddressMac[5]);
+  length += AppendFormat(*ethHeaderBuffer + length,
+                         ethHeaderBufferSize - length,
+                         "| Protocol: %d\n",
+                         ntohs(ethhdr->Protocol));
+  AppendFormat(*ethHeaderBuffer + length, ethHeaderBufferSize - length, "\n");
 }
 #endif
 
@@ -107,109 +136,1323 @@ void PrintPacketIPHeader(Buffer_t packetBuffer, char** ipHeaderBuffer, size_t ip
   source.sin_addr.s_addr = iphdr->SourceAddress;
   dest.sin_addr.s_addr = iphdr->DestinationAddress;
 
-  int length = 0;
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "\n        IP Header\n");
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Version: %d\n", iphdr->Version);
-  length += snprintf(*ipHeaderBuffer + length,
-                     ipHeaderBufferSize,
-                     "| Header Length: %lu bytes\n",
-                     (unsigned long) GetIPHeaderLength(iphdr));
+  size_t length = 0;
+  length += AppendFormat(*ipHeaderBuffer + length, ipHeaderBufferSize - length, "\n        IP Header\n");
+  length += AppendFormat(*ipHeaderBuffer + length, ipHeaderBufferSize - length, "| Version: %d\n", iphdr->Version);
+  length += AppendFormat(*ipHeaderBuffer + length,
+                         ipHeaderBufferSize - length,
+                         "| Header Length: %lu bytes\n",
+                         (unsigned long) GetIPHeaderLength(iphdr));
 #ifdef NET_STRUCTS_VERBOSE
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Type Of Service: %d\n", iphdr->TOS);
+  length += AppendFormat(*ipHeaderBuffer + length, ipHeaderBufferSize - length, "| Type Of Service: %d\n", iphdr->TOS);
 #endif
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Total Length: %d bytes\n", iphdr->TotalLength);
+  length += AppendFormat(*ipHeaderBuffer + length,
+                         ipHeaderBufferSize - length,
+                         "| Total Length: %d bytes\n",
+                         iphdr->TotalLength);
 #ifdef NET_STRUCTS_VERBOSE
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Identification: %d\n", iphdr->ID);
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Fragment offset: %d\n", iphdr->FragmentOffset);
+  length += AppendFormat(*ipHeaderBuffer + length, ipHeaderBufferSize - length, "| Identification: %d\n", iphdr->ID);
+  length += AppendFormat(*ipHeaderBuffer + length,
+                         ipHeaderBufferSize - length,
+                         "| Fragment offset: %d\n",
+                         iphdr->FragmentOffset);
 #endif
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| TTL (Time To Live): %d\n", iphdr->TTL);
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Protocol number value: %d\n", iphdr->Protocol);
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Checksum: %u\n", ntohs(iphdr->Checksum));
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Source IP: %s\n", inet_ntoa(source.sin_addr));
-  length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Destination IP: %s\n", inet_ntoa(dest.sin_addr));
+  length += AppendFormat(*ipHeaderBuffer + length,
+                         ipHeaderBufferSize - length,
+                         "| TTL (Time To Live): %d\n",
+                         iphdr->TTL);
+  length += AppendFormat(*ipHeaderBuffer + length,
+                         ipHeaderBufferSize - length,
+                         "| Protocol number value: %d\n",
+                         iphdr->Protocol);
+  length += AppendFormat(*ipHeaderBuffer + length,
+                         ipHeaderBufferSize - length,
+                         "| Checksum: %u\n",
+                         ntohs(iphdr->Checksum));
+  // inet_ntoa() returns the static buffer, records can be formatted by several threads
+  char sourceIP[INET_ADDRSTRLEN], destIP[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &source.sin_addr, sourceIP, sizeof(sourceIP));
+  inet_ntop(AF_INET, &dest.sin_addr, destIP, sizeof(destIP));
+  length += AppendFormat(*ipHeaderBuffer + length, ipHeaderBufferSize - length, "| Source IP: %s\n", sourceIP);
+  length += AppendFormat(*ipHeaderBuffer + length, ipHeaderBufferSize - length, "| Destination IP: %s\n", destIP);
   if (t != NULL) {
-    char* time;
-    TimeInfoToString(t, &time);
-    length += snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "| Time: %s\n", time);
-    free(time);
+    char time[TIME_INFO_BUFFER_MAX_SIZE];
+    TimeInfoToString(t, time, sizeof(time));
+    length += AppendFormat(*ipHeaderBuffer + length, ipHeaderBufferSize - length, "| Time: %s\n", time);
   }
-  snprintf(*ipHeaderBuffer + length, ipHeaderBufferSize, "\n");
+  AppendFormat(*ipHeaderBuffer + length, ipHeaderBufferSize - length, "\n");
 }
 
 void PrintPacketICMPHeader(Buffer_t packetBuffer, char** headerBuffer, size_t headerBufferSize)
 {
   ICMPHeader_t* icmphdr = GetICMPHeader(packetBuffer);
 
-  int length = 0;
-  length += snprintf(*headerBuffer + length, headerBufferSize, "\n        ICMP Header\n");
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Type: %d\n", icmphdr->Type);
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Code: %d\n", icmphdr->Code);
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Checksum: %u\n", ntohs(icmphdr->Checksum));
-  snprintf(*headerBuffer + length, headerBufferSize, "\n");
+  size_t length = 0;
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "\n        ICMP Header\n");
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "| Type: %d\n", icmphdr->Type);
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "| Code: %d\n", icmphdr->Code);
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Checksum: %u\n",
+                         ntohs(icmphdr->Checksum));
+  AppendFormat(*headerBuffer + length, headerBufferSize - length, "\n");
 }
 
 void PrintPacketTCPHeader(Buffer_t packetBuffer, char** headerBuffer, size_t headerBufferSize)
 {
   TCPV4Header_t* tcphdr = GetTCPV4Header(packetBuffer);
 
-  int length = 0;
-  length += snprintf(*headerBuffer + length, headerBufferSize, "\n        TCP Header\n");
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Source Port: %u\n", ntohs(tcphdr->SourcePort));
-  length +=
-      snprintf(*headerBuffer + length, headerBufferSize, "| Destination Port: %u\n", ntohs(tcphdr->DestinationPort));
-  length += snprintf(*headerBuffer + length,
-                     headerBufferSize,
-                     "| Sequence Number: %lu\n",
-                     (unsigned long) ntohl(tcphdr->SequenceNumber));
-  length += snprintf(*headerBuffer + length,
-                     headerBufferSize,
-                     "| Acknowledge Number: %lu\n",
-                     (unsigned long) ntohl(tcphdr->AckNumber));
+  size_t length = 0;
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "\n        TCP Header\n");
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Source Port: %u\n",
+                         ntohs(tcphdr->SourcePort));
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Destination Port: %u\n",
+                         ntohs(tcphdr->DestinationPort));
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Sequence Number: %lu\n",
+                         (unsigned long) ntohl(tcphdr->SequenceNumber));
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Acknowledge Number: %lu\n",
+                         (unsigned long) ntohl(tcphdr->AckNumber));
 #ifdef NET_STRUCTS_VERBOSE
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| DataOffset: %d Bytes\n", tcphdr->DataOffset * 4);
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| NS (Flag): %d\n", tcphdr->FlagNS);
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| DataOffset: %d Bytes\n",
+                         tcphdr->DataOffset * 4);
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "| NS (Flag): %d\n", tcphdr->FlagNS);
 #endif
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Finish (Flag): %d\n", tcphdr->FlagFinish);
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Sync (Flag): %d\n", tcphdr->FlagSync);
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Reset (Flag): %d\n", tcphdr->FlagReset);
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Acknowledge (Flag): %d\n", tcphdr->FlagAck);
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Urgent (Flag): %d\n", tcphdr->FlagUrgent);
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Finish (Flag): %d\n",
+                         tcphdr->FlagFinish);
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "| Sync (Flag): %d\n", tcphdr->FlagSync);
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "| Reset (Flag): %d\n", tcphdr->FlagReset);
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Acknowledge (Flag): %d\n",
+                         tcphdr->FlagAck);
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Urgent (Flag): %d\n",
+                         tcphdr->FlagUrgent);
 #ifdef NET_STRUCTS_VERBOSE
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| ECE (Flag): %d\n", tcphdr->FlagECE);
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| CWR (Flag): %d\n", tcphdr->FlagCWR);
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "| ECE (Flag): %d\n", tcphdr->FlagECE);
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "| CWR (Flag): %d\n", tcphdr->FlagCWR);
 #endif
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Window Size: %u\n", ntohs(tcphdr->WindowSize));
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Checksum: %u\n", ntohs(tcphdr->Checksum));
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Urgent Point: %d\n", tcphdr->UrgentPoint);
-  snprintf(*headerBuffer + length, headerBufferSize, "\n");
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Window Size: %u\n",
+                         ntohs(tcphdr->WindowSize));
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Checksum: %u\n",
+                         ntohs(tcphdr->Checksum));
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Urgent Point: %d\n",
+                         tcphdr->UrgentPoint);
+  AppendFormat(*headerBuffer + length, headerBufferSize - length, "\n");
 }
 
 void PrintPacketUDPHeader(Buffer_t packetBuffer, char** headerBuffer, size_t headerBufferSize)
 {
   UDPHeader_t* udphdr = GetUDPHeader(packetBuffer);
 
-  int length = 0;
-  length += snprintf(*headerBuffer + length, headerBufferSize, "\n        UDP Header\n");
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Source Port: %u\n", ntohs(udphdr->SourcePort));
-  length +=
-      snprintf(*headerBuffer + length, headerBufferSize, "| Destination Port: %u\n", ntohs(udphdr->DestinationPort));
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Length: %u\n", ntohs(udphdr->Length));
-  length += snprintf(*headerBuffer + length, headerBufferSize, "| Checksum: %u\n", ntohs(udphdr->Checksum));
-  snprintf(*headerBuffer + length, headerBufferSize, "\n");
+  size_t length = 0;
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "\n        UDP Header\n");
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Source Port: %u\n",
+                         ntohs(udphdr->SourcePort));
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Destination Port: %u\n",
+                         ntohs(udphdr->DestinationPort));
+  length += AppendFormat(*headerBuffer + length, headerBufferSize - length, "| Length: %u\n", ntohs(udphdr->Length));
+  length += AppendFormat(*headerBuffer + length,
+                         headerBufferSize - length,
+                         "| Checksum: %u\n",
+                         ntohs(udphdr->Checksum));
+  AppendFormat(*headerBuffer + length, headerBufferSize - length, "\n");
+}
+
+void PrintPacketData(Buffer_t packetBuffer, size_t size, char** dataBuffer, size_t dataBufferSize, bool ascii)
+{
+  size_t length = AppendFormat(*dataBuffer, dataBufferSize, "\n      Data\n");
+  PrintHexDump((const uint8_t*) packetBuffer, size, *dataBuffer + length, dataBufferSize - length, ascii);
+}
+
+size_t PrintHexDump(const uint8_t* data, size_t size, char* buffer, size_t bufferSize, bool ascii)
+{
+  if (bufferSize == 0)
+    return 0;
+
+  char* cursor = buffer;
+  const char* end = buffer + bufferSize - 1; // the terminating null
+  for (size_t offset = 0; offset < size && (size_t) (end - cursor) >= HEX_DUMP_LINE_MAX_LENGTH;
+       offset += HEX_DUMP_LINE_SIZE) {
+    const uint8_t* line = data + offset;
+    size_t count = size - offset < HEX_DUMP_LINE_SIZE ? size - offset : HEX_DUMP_LINE_SIZE;
+
+    for (size_t i = 0; i < count; ++i) {
+      const char* hex = HexTable + line[i] * 2;
+      cursor[0] = '[';
+      cursor[1] = hex[0];
+      cursor[2] = hex[1];
+      cursor[3] = ']';
+      cursor[4] = ' ';
+      cursor += 5;
+    }
+
+    if (ascii) {
+      // align the gutter of the last line
+      memset(cursor, ' ', (HEX_DUMP_LINE_SIZE - count) * 5);
+      cursor += (HEX_DUMP_LINE_SIZE - count) * 5;
+      *cursor++ = '|';
+      for (size_t i = 0; i < count; ++i)
+        *cursor++ = (line[i] >= 0x20 && line[i] < 0x7F) ? (char) line[i] : '.';
+      *cursor++ = '|';
+    } else {
+      --cursor; // the separator after the last byte
+    }
+    *cursor++ = '\n';
+  }
+  *cursor = '\0';
+  return (size_t) (cursor - buffer);
+}
+
+size_t PrintPacketBrief(const PacketView_t* view, const TimeInfo_t* t, char* buffer, size_t bufferSize)
+{
+  if (bufferSize < BRIEF_LINE_MAX_SIZE)
+    return 0;
+
+  PROFILE_START(formatStart);
+  char* cursor = buffer;
+  cursor = WriteUnsigned(cursor, (uint32_t) t->Hours, 2);
+  *cursor++ = ':';
+  cursor = WriteUnsigned(cursor, (uint32_t) t->Minutes, 2);
+  *cursor++ = ':';
+  cursor = WriteUnsigned(cursor, (uint32_t) t->Seconds, 2);
+  *cursor++ = '.';
+  cursor = WriteUnsigned(cursor, t->TimestampNanosec / 1000, 6);
+
+  bool ports = view->Protocol == Protocol_TCP || view->Protocol == Protocol_UDP;
+  switch (view->Protocol) {
+  case Protocol_TCP:
+    memcpy(cursor, " TCP ", 5);
+    cursor += 5;
+    break;
+  case Protocol_UDP:
+    memcpy(cursor, " UDP ", 5);
+    cursor += 5;
+    break;
+  case Protocol_ICMP:
+    memcpy(cursor, " ICMP ", 6);
+    cursor += 6;
+    break;
+  default:
+    memcpy(cursor, " IP proto ", 10);
+    cursor = WriteUnsigned(cursor + 10, view->Protocol, 1);
+    *cursor++ = ' ';
+    break;
+  }
+
+  cursor = WriteIPv4(cursor, view->SourceAddress);
+  if (ports) {
+    *cursor++ = ':';
+    cursor = WriteUnsigned(cursor, view->SourcePort, 1);
+  }
+  memcpy(cursor, " > ", 3);
+  cursor = WriteIPv4(cursor + 3, view->DestinationAddress);
+  if (ports) {
+    *cursor++ = ':';
+    cursor = WriteUnsigned(cursor, view->DestinationPort, 1);
+  }
+
+  if (view->Protocol == Protocol_TCP) {
+    memcpy(cursor, " Flags [", 8);
+    cursor += 8;
+    cursor += PrintTCPFlags(view->TCPFlags, cursor);
+    *cursor++ = ']';
+    *cursor++ = ',';
+  } else if (view->Protocol == Protocol_ICMP) {
+    const ICMPHeader_t* icmphdr = GetICMPHeader((Buffer_t) view->IPHeader);
+    memcpy(cursor, " type ", 6);
+    cursor = WriteUnsigned(cursor + 6, icmphdr->Type, 1);
+    memcpy(cursor, " code ", 6);
+    cursor = WriteUnsigned(cursor + 6, icmphdr->Code, 1);
+    *cursor++ = ',';
+  }
+
+  memcpy(cursor, " length ", 8);
+  cursor = WriteUnsigned(cursor + 8, (uint32_t) view->PayloadSize, 1);
+  *cursor++ = '\n';
+  *cursor = '\0';
+  PROFILE_STOP(ProfileStage_FORMAT, formatStart);
+  return (size_t) (cursor - buffer);
+}
+
+size_t PrintTCPFlags(uint8_t flags, char* buffer)
+{
+  // the order of tcpdump, '.' is ACK
+  static const struct
+  {
+    uint8_t Flag;
+    char Symbol;
+  } symbols[] = {{TCPFlag_FIN, 'F'},
+                 {TCPFlag_SYN, 'S'},
+                 {TCPFlag_RST, 'R'},
+                 {TCPFlag_PSH, 'P'},
+                 {TCPFlag_URG, 'U'},
+                 {TCPFlag_ECE, 'E'},
+                 {TCPFlag_CWR, 'W'},
+                 {TCPFlag_ACK, '.'}};
+
+  size_t length = 0;
+  for (size_t i = 0; i < sizeof(symbols) / sizeof(symbols[0]); ++i) {
+    if (flags & symbols[i].Flag)
+      buffer[length++] = symbols[i].Symbol;
+  }
+  buffer[length] = '\0';
+  return length;
 }
 
-void PrintPacketData(Buffer_t packetBuffer, size_t size, char** dataBuffer, size_t dataBufferSize)
+void PrintChecksumStats(const ChecksumStats_t* stats, char** statsBuffer, size_t statsBufferSize)
 {
-  static const size_t lineSize = 32;
-  int length = 0;
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "\n        Checksums (%s)\n",
+                         ChecksumImplementationName());
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Verified: %llu\n",
+                         (unsigned long long) stats->Verified);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Bad IP header: %llu\n",
+                         (unsigned long long) stats->BadIPHeader);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Bad ICMP: %llu\n",
+                         (unsigned long long) stats->BadICMP);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Bad TCP: %llu\n",
+                         (unsigned long long) stats->BadTCP);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Bad UDP: %llu\n",
+                         (unsigned long long) stats->BadUDP);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Validated by kernel: %llu\n",
+                         (unsigned long long) stats->KernelValid);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Offloaded to NIC: %llu\n",
+                         (unsigned long long) stats->Offloaded);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Not checked: %llu\n",
+                         (unsigned long long) stats->NotChecked);
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+void PrintDnsEvent(const DnsEvent_t* event, char** dnsBuffer, size_t dnsBufferSize)
+{
+  const DnsMessage_t* msg = &event->Message;
+  const char* type = DnsTypeToString(msg->QType);
+
+  size_t length = 0;
+  length += AppendFormat(*dnsBuffer + length,
+                         dnsBufferSize - length,
+                         "\n        DNS %s\n",
+                         msg->Response ? "Response" : "Query");
+  length += AppendFormat(*dnsBuffer + length, dnsBufferSize - length, "| ID: 0x%04X\n", msg->Id);
+  if (msg->QDCount > 0) {
+    if (type != NULL)
+      length += AppendFormat(*dnsBuffer + length, dnsBufferSize - length, "| Question: %s %s\n", event->QName, type);
+    else
+      length +=
+          AppendFormat(*dnsBuffer + length, dnsBufferSize - length, "| Question: %s TYPE%u\n", event->QName, msg->QType);
+  }
+
+  if (msg->Response) {
+    length += AppendFormat(*dnsBuffer + length,
+                           dnsBufferSize - length,
+                           "| Response code: %s%s\n",
+                           DnsRcodeToString(msg->Rcode),
+                           msg->Truncated ? " (truncated)" : "");
+    length += AppendFormat(*dnsBuffer + length, dnsBufferSize - length, "| Answers: %u\n", msg->ANCount);
+
+    size_t offset = msg->AnswersOffset;
+    for (uint16_t i = 0; i < msg->ANCount && i < DNS_PRINTED_ANSWERS_MAX_COUNT; ++i) {
+      DnsRecord_t record;
+      char name[DNS_NAME_MAX_SIZE], data[DNS_NAME_MAX_SIZE];
+      if (DnsReadRecord(msg, offset, &record, &offset) < 0 ||
+          DnsReadName(msg->Data, msg->Size, record.NameOffset, name, sizeof(name), NULL) < 0)
+        break;
 
-  length += snprintf(*dataBuffer + length, dataBufferSize, "\n      Data\n");
-  for (size_t i = 0; i < size && i < dataBufferSize; ++i) {
-    length += snprintf(*dataBuffer + length, dataBufferSize, "[%02X]", (uint8_t) packetBuffer[i]);
-    if (i % lineSize == 0)
-      length += snprintf(*dataBuffer + length, dataBufferSize, "\n");
+      data[0] = '\0';
+      switch (record.Type) {
+      case 1 /* A */: {
+        if (record.RDLength == 4)
+          inet_ntop(AF_INET, record.RData, data, sizeof(data));
+        break;
+      }
+      case 28 /* AAAA */: {
+        if (record.RDLength == 16)
+          inet_ntop(AF_INET6, record.RData, data, sizeof(data));
+        break;
+      }
+      case 2 /* NS */:
+      case 5 /* CNAME */:
+      case 12 /* PTR */: {
+        if (DnsReadName(msg->Data, msg->Size, (size_t) (record.RData - msg->Data), data, sizeof(data), NULL) < 0)
+          data[0] = '\0';
+        break;
+      }
+      default:
+        break;
+      }
+
+      type = DnsTypeToString(record.Type);
+      length += AppendFormat(*dnsBuffer + length,
+                             dnsBufferSize - length,
+                             "| Answer: %s %s %s (TTL %lu)\n",
+                             name,
+                             type != NULL ? type : "?",
+                             data,
+                             (unsigned long) record.TTL);
+    }
+
+    if (event->Matched)
+      length += AppendFormat(*dnsBuffer + length,
+                             dnsBufferSize - length,
+                             "| Latency: %.3f ms\n",
+                             (double) event->LatencyUs / 1000.0);
     else
-      length += snprintf(*dataBuffer + length, dataBufferSize, " ");
+      length += AppendFormat(*dnsBuffer + length, dnsBufferSize - length, "| Latency: unknown (no query)\n");
+  }
+  AppendFormat(*dnsBuffer + length, dnsBufferSize - length, "\n");
+}
+
+void PrintDnsStats(const DnsTracker_t* tracker, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        DNS (latency, ms)\n");
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Queries: %llu, responses: %llu, matched: %llu, unmatched: %llu, expired: %llu, "
+                         "malformed: %llu\n",
+                         (unsigned long long) tracker->Queries,
+                         (unsigned long long) tracker->Responses,
+                         (unsigned long long) tracker->Matched,
+                         (unsigned long long) tracker->Unmatched,
+                         (unsigned long long) tracker->Expired,
+                         (unsigned long long) tracker->Malformed);
+  length +=
+      PrintHistogramSummary("All", &tracker->Latency, 1000.0, *statsBuffer + length, statsBufferSize - length);
+
+  for (uint8_t rcode = 0; rcode < DNS_RCODES_COUNT; ++rcode) {
+    if (tracker->RcodeLatency[rcode].Count > 0)
+      length += PrintHistogramSummary(DnsRcodeToString(rcode),
+                                      &tracker->RcodeLatency[rcode],
+                                      1000.0,
+                                      *statsBuffer + length,
+                                      statsBufferSize - length);
+  }
+  for (size_t i = 0; i < tracker->QNamesCount; ++i)
+    length += PrintHistogramSummary(tracker->QNames[i].QName,
+                                    &tracker->QNames[i].Latency,
+                                    1000.0,
+                                    *statsBuffer + length,
+                                    statsBufferSize - length);
+  if (tracker->OtherQNamesLatency.Count > 0)
+    length += PrintHistogramSummary(
+        "(other names)", &tracker->OtherQNamesLatency, 1000.0, *statsBuffer + length, statsBufferSize - length);
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+void PrintHttpEvent(const HttpEvent_t* event, char** httpBuffer, size_t httpBufferSize)
+{
+  size_t length = 0;
+  if (!event->Response) {
+    length += AppendFormat(*httpBuffer + length, httpBufferSize - length, "\n        HTTP Request\n");
+    length += AppendFormat(
+        *httpBuffer + length, httpBufferSize - length, "| Method: %s\n", HttpMethodToString(event->Method));
+    length += AppendFormat(*httpBuffer + length, httpBufferSize - length, "| Path: %s\n", event->Path);
+  } else {
+    length += AppendFormat(*httpBuffer + length, httpBufferSize - length, "\n        HTTP Response\n");
+    length += AppendFormat(*httpBuffer + length, httpBufferSize - length, "| Status: %u\n", event->Status);
+    if (event->Matched) {
+      length += AppendFormat(*httpBuffer + length,
+                             httpBufferSize - length,
+                             "| Request: %s %s\n",
+                             HttpMethodToString(event->Method),
+                             event->Path);
+      length += AppendFormat(*httpBuffer + length,
+                             httpBufferSize - length,
+                             "| Response time: %.3f ms\n",
+                             (double) event->LatencyUs / 1000.0);
+    } else {
+      length += AppendFormat(*httpBuffer + length, httpBufferSize - length, "| Response time: unknown (no request)\n");
+    }
+  }
+  AppendFormat(*httpBuffer + length, httpBufferSize - length, "\n");
+}
+
+void PrintHttpStats(const HttpTracker_t* tracker, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        HTTP (response time, ms)\n");
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Requests: %llu, responses: %llu, matched: %llu, unmatched: %llu, unanswered: %llu, "
+                         "reassembled: %llu\n",
+                         (unsigned long long) tracker->Requests,
+                         (unsigned long long) tracker->Responses,
+                         (unsigned long long) tracker->Matched,
+                         (unsigned long long) tracker->Unmatched,
+                         (unsigned long long) tracker->Unanswered,
+                         (unsigned long long) tracker->Reassembled);
+  length +=
+      PrintHistogramSummary("All", &tracker->Latency, 1000.0, *statsBuffer + length, statsBufferSize - length);
+
+  for (size_t i = 0; i <= tracker->EndpointsCount; ++i) {
+    const HttpEndpointStats_t* endpoint = i < tracker->EndpointsCount ? &tracker->Endpoints[i] : &tracker->OtherEndpoints;
+    if (endpoint->Latency.Count == 0)
+      continue;
+
+    char title[HTTP_PATH_MAX_SIZE + 16];
+    snprintf(title, sizeof(title), "%s %s", HttpMethodToString(endpoint->Method), endpoint->PathPrefix);
+    length += PrintHistogramSummary(title, &endpoint->Latency, 1000.0, *statsBuffer + length, statsBufferSize - length);
+    length += AppendFormat(*statsBuffer + length,
+                           statsBufferSize - length,
+                           "|   1xx: %llu, 2xx: %llu, 3xx: %llu, 4xx: %llu, 5xx: %llu\n",
+                           (unsigned long long) endpoint->StatusClasses[1],
+                           (unsigned long long) endpoint->StatusClasses[2],
+                           (unsigned long long) endpoint->StatusClasses[3],
+                           (unsigned long long) endpoint->StatusClasses[4],
+                           (unsigned long long) endpoint->StatusClasses[5]);
+  }
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+void PrintTlsEvent(const TlsEvent_t* event, char** tlsBuffer, size_t tlsBufferSize)
+{
+  const TlsClientHello_t* hello = &event->Hello;
+  size_t length = 0;
+  length += AppendFormat(*tlsBuffer + length, tlsBufferSize - length, "\n        TLS ClientHello\n");
+  length += AppendFormat(
+      *tlsBuffer + length, tlsBufferSize - length, "| SNI: %s\n", hello->SNI[0] != '\0' ? hello->SNI : "(none)");
+  length += AppendFormat(
+      *tlsBuffer + length, tlsBufferSize - length, "| ALPN: %s\n", hello->ALPN[0] != '\0' ? hello->ALPN : "(none)");
+  length += AppendFormat(*tlsBuffer + length,
+                         tlsBufferSize - length,
+                         "| Version: %s (record: %s",
+                         TlsVersionToString(hello->ClientVersion),
+                         TlsVersionToString(hello->RecordVersion));
+  if (hello->MaxSupportedVersion != 0)
+    length += AppendFormat(*tlsBuffer + length,
+                           tlsBufferSize - length,
+                           ", supported up to: %s",
+                           TlsVersionToString(hello->MaxSupportedVersion));
+  length += AppendFormat(*tlsBuffer + length, tlsBufferSize - length, ")\n");
+  length += AppendFormat(*tlsBuffer + length,
+                         tlsBufferSize - length,
+                         "| Cipher suites: %u, extensions: %u\n",
+                         hello->CipherSuitesCount,
+                         hello->ExtensionsCount);
+  length += AppendFormat(*tlsBuffer + length,
+                         tlsBufferSize - length,
+                         "| Fingerprint: %016llx%s\n",
+                         (unsigned long long) hello->Fingerprint,
+                         hello->Truncated ? " (partial, the ClientHello is truncated)" : "");
+  AppendFormat(*tlsBuffer + length, tlsBufferSize - length, "\n");
+}
+
+void PrintTlsStats(const TlsTracker_t* tracker, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        TLS\n");
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| ClientHello: %llu, truncated: %llu, not TLS flows: %llu, evicted flows: %llu\n",
+                         (unsigned long long) tracker->ClientHellos,
+                         (unsigned long long) tracker->Truncated,
+                         (unsigned long long) tracker->NotTls,
+                         (unsigned long long) tracker->Evicted);
+
+  for (size_t i = 0; i <= tracker->SNIsCount; ++i) {
+    const TlsSNIStats_t* stats = i < tracker->SNIsCount ? &tracker->SNIs[i] : &tracker->OtherSNIs;
+    if (stats->Connections == 0)
+      continue;
+
+    length += AppendFormat(*statsBuffer + length,
+                           statsBufferSize - length,
+                           "| %s: connections %llu, packets %llu, bytes %llu\n",
+                           stats->SNI,
+                           (unsigned long long) stats->Connections,
+                           (unsigned long long) stats->Packets,
+                           (unsigned long long) stats->Bytes);
+  }
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+void PrintTcpEvent(const TcpEvent_t* event, char** tcpBuffer, size_t tcpBufferSize)
+{
+  static const struct
+  {
+    TcpAnalysis_t Flag;
+    const char* Name;
+  } names[] = {{TcpAnalysis_RETRANSMISSION, "retransmission"},
+               {TcpAnalysis_OUT_OF_ORDER, "out-of-order"},
+               {TcpAnalysis_DUP_ACK, "duplicate ACK"},
+               {TcpAnalysis_ZERO_WINDOW, "zero window"},
+               {TcpAnalysis_WINDOW_OPEN, "window reopened"}};
+
+  size_t length = 0;
+  if (event->Analysis != TcpAnalysis_NONE) {
+    length += AppendFormat(*tcpBuffer + length, tcpBufferSize - length, "| TCP analysis:");
+    const char* separator = " ";
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+      if (event->Analysis & names[i].Flag) {
+        length += AppendFormat(*tcpBuffer + length, tcpBufferSize - length, "%s%s", separator, names[i].Name);
+        separator = ", ";
+      }
+    }
+    if (event->Analysis & TcpAnalysis_HANDSHAKE_RTT) {
+      length += AppendFormat(*tcpBuffer + length,
+                             tcpBufferSize - length,
+                             "%shandshake RTT %.3f ms",
+                             separator,
+                             (double) event->HandshakeRttUs / 1000.0);
+      separator = ", ";
+    }
+    if (event->Analysis & TcpAnalysis_DATA_RTT)
+      length += AppendFormat(
+          *tcpBuffer + length, tcpBufferSize - length, "%sRTT %.3f ms", separator, (double) event->RttUs / 1000.0);
+    length += AppendFormat(*tcpBuffer + length, tcpBufferSize - length, "\n");
+  }
+
+  if (event->Closed) {
+    length += AppendFormat(*tcpBuffer + length, tcpBufferSize - length, "\n        TCP Flow (closed)\n");
+    length += PrintTcpFlow(&event->Flow, *tcpBuffer + length, tcpBufferSize - length);
+  }
+  AppendFormat(*tcpBuffer + length, tcpBufferSize - length, "\n");
+}
+
+void PrintTcpStats(const TcpAnalyzer_t* analyzer, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        TCP (RTT, ms)\n");
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Flows: %llu, closed: %llu, evicted: %llu, segments: %llu\n",
+                         (unsigned long long) analyzer->Flows,
+                         (unsigned long long) analyzer->ClosedFlows,
+                         (unsigned long long) analyzer->Evicted,
+                         (unsigned long long) analyzer->Segments);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Retransmissions: %llu, out-of-order: %llu, duplicate ACKs: %llu, zero windows: %llu\n",
+                         (unsigned long long) analyzer->Retransmissions,
+                         (unsigned long long) analyzer->OutOfOrder,
+                         (unsigned long long) analyzer->DupAcks,
+                         (unsigned long long) analyzer->ZeroWindows);
+  length += PrintHistogramSummary(
+      "Handshake", &analyzer->HandshakeRtt, 1000.0, *statsBuffer + length, statsBufferSize - length);
+  length += PrintHistogramSummary("Data", &analyzer->DataRtt, 1000.0, *statsBuffer + length, statsBufferSize - length);
+
+  const TcpFlow_t* flows[TCP_STATS_FLOWS_MAX_COUNT];
+  size_t count = TcpAnalyzerWorstFlows(analyzer, flows, TCP_STATS_FLOWS_MAX_COUNT);
+  for (size_t i = 0; i < count; ++i) {
+    length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        TCP Flow (open)\n");
+    length += PrintTcpFlow(flows[i], *statsBuffer + length, statsBufferSize - length);
+  }
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+void PrintOutputStats(const Output_t* output, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        Output (ms)\n");
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Bytes written: %llu, writes: %llu, blocks: %llu, errors: %llu\n",
+                         (unsigned long long) output->BytesWritten,
+                         (unsigned long long) output->Writes,
+                         (unsigned long long) output->Blocks,
+                         (unsigned long long) output->WriteErrors);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Flushed by size: %llu, by time: %llu\n",
+                         (unsigned long long) output->SizeFlushes,
+                         (unsigned long long) output->TimeFlushes);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Blocked: %llu times, %.3f ms\n",
+                         (unsigned long long) output->Blocked,
+                         (double) output->BlockedUs / 1000.0);
+  length += PrintHistogramSummary(
+      "Flush latency", &output->FlushLatency, 1000.0, *statsBuffer + length, statsBufferSize - length);
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+void PrintFormatPoolStats(const FormatPool_t* pool, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        Format threads\n");
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Records: %llu, completed out of order: %llu\n",
+                         (unsigned long long) pool->Slots.Jobs,
+                         (unsigned long long) pool->Slots.Reordered);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Window stalls: %llu times, %.3f ms\n",
+                         (unsigned long long) pool->Slots.Stalls,
+                         (double) pool->Slots.StalledUs / 1000.0);
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+void PrintPipelineStats(const PipelineStageCounters_t* stages, size_t count, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        Pipeline stages\n");
+  for (size_t i = 0; i < count; ++i) {
+    const PipelineStageCounters_t* stage = &stages[i];
+    length += AppendFormat(*statsBuffer + length,
+                           statsBufferSize - length,
+                           "| %s%s: packets in %llu, out %llu, batches %llu, busy %.3f ms\n",
+                           stage->Name,
+                           stage->Threaded ? " (thread)" : "",
+                           (unsigned long long) stage->PacketsIn,
+                           (unsigned long long) stage->PacketsOut,
+                           (unsigned long long) stage->Batches,
+                           (double) stage->BusyNs / 1e6);
+    if (stage->Threaded)
+      length += AppendFormat(*statsBuffer + length,
+                             statsBufferSize - length,
+                             "| %s queue: max depth %zu, waits of the previous stage %llu\n",
+                             stage->Name,
+                             stage->QueueMaxDepth,
+                             (unsigned long long) stage->QueueWaits);
+
+    char title[64];
+    snprintf(title, sizeof(title), "%s batch time (us)", stage->Name);
+    length += PrintHistogramSummary(title, &stage->BatchNs, 1000.0, *statsBuffer + length, statsBufferSize - length);
+  }
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+void PrintProfileStats(const Histogram_t* stages, double ticksPerNs, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        Profile of stages (ns)\n");
+  for (int i = 0; i < ProfileStage_COUNT; ++i) {
+    const Histogram_t* h = &stages[i];
+    const char* name = ProfileStageToString((ProfileStage_t) i);
+    if (h->Count == 0) {
+      length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "| %s: count 0\n", name);
+      continue;
+    }
+    length += AppendFormat(*statsBuffer + length,
+                           statsBufferSize - length,
+                           "| %s: count %llu, p50 %.0f, p99 %.0f, p999 %.0f, max %.0f\n",
+                           name,
+                           (unsigned long long) h->Count,
+                           (double) HistogramPercentile(h, 50.0) / ticksPerNs,
+                           (double) HistogramPercentile(h, 99.0) / ticksPerNs,
+                           (double) HistogramPercentile(h, 99.9) / ticksPerNs,
+                           (double) h->Max / ticksPerNs);
+  }
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+size_t PrintCaptureStatsLine(const CaptureStats_t* stats,
+                             const CaptureStats_t* previous,
+                             uint64_t suppressed,
+                             uint64_t waits,
+                             char* buffer,
+                             size_t bufferSize)
+{
+  return AppendFormat(buffer,
+                      bufferSize,
+                      "capture: received %llu (+%llu), handled %llu (+%llu), filtered out %llu, kernel drops %llu (+%llu), "
+                      "suppressed %llu, waits %llu\n",
+                      (unsigned long long) stats->Received,
+                      (unsigned long long) (stats->Received - previous->Received),
+                      (unsigned long long) stats->Handled,
+                      (unsigned long long) (stats->Handled - previous->Handled),
+                      (unsigned long long) stats->FilteredOut,
+                      (unsigned long long) stats->KernelDrops,
+                      (unsigned long long) (stats->KernelDrops - previous->KernelDrops),
+                      (unsigned long long) suppressed,
+                      (unsigned long long) waits);
+}
+
+void PrintCaptureStats(const CaptureStats_t* stats, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        Capture\n");
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Received: %llu, handled: %llu, filtered out: %llu\n",
+                         (unsigned long long) stats->Received,
+                         (unsigned long long) stats->Handled,
+                         (unsigned long long) stats->FilteredOut);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Kernel: packets %llu, drops %llu\n",
+                         (unsigned long long) stats->KernelPackets,
+                         (unsigned long long) stats->KernelDrops);
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+size_t PrintRecorderDump(const RecorderDump_t* dump, char* buffer, size_t bufferSize)
+{
+  if (dump->Error != NULL)
+    return AppendFormat(buffer, bufferSize, "Cannot dump the flight recorder to '%s': %s\n", dump->Path, dump->Error);
+  return AppendFormat(buffer,
+                      bufferSize,
+                      "The flight recorder is dumped to '%s': %llu packets (%llu overwritten while dumped) in %.1f "
+                      "ms.\n",
+                      dump->Path,
+                      (unsigned long long) dump->Packets,
+                      (unsigned long long) dump->Skipped,
+                      (double) dump->DurationUs / 1e3);
+}
+
+void PrintStorageSummary(const StorageWriter_t* storage,
+                         size_t compressThreads,
+                         char** statsBuffer,
+                         size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "The storage is closed, %llu packets are written to %llu segments (%llu indexed, %llu without "
+                         "the index).\n",
+                         (unsigned long long) storage->Packets,
+                         (unsigned long long) storage->Segments,
+                         (unsigned long long) storage->Indexed,
+                         (unsigned long long) storage->IndexSkipped);
+  if (storage->Stalls > 0)
+    length += AppendFormat(*statsBuffer + length,
+                           statsBufferSize - length,
+                           "The capture waited for the write thread of the storage %llu times.\n",
+                           (unsigned long long) storage->Stalls);
+  if (storage->Errors > 0)
+    length += AppendFormat(*statsBuffer + length,
+                           statsBufferSize - length,
+                           "Warning: %llu packets are not stored (write error).\n",
+                           (unsigned long long) storage->Errors);
+  if (storage->ErrorMessage != NULL)
+    length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "%s\n", storage->ErrorMessage);
+
+  const CompressPool_t* compressor = storage->Compressor;
+  if (compressor == NULL)
+    return;
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "Segments are compressed from %.1f MiB to %.1f MiB (ratio %.2f), %llu blocks (%llu stored), "
+                         "the write thread waited for the compression %llu times (%.1f ms).\n",
+                         (double) compressor->RawBytes / (1024 * 1024),
+                         (double) compressor->Bytes / (1024 * 1024),
+                         compressor->Bytes > 0 ? (double) compressor->RawBytes / (double) compressor->Bytes : 0.0,
+                         (unsigned long long) compressor->Blocks,
+                         (unsigned long long) compressor->StoredBlocks,
+                         (unsigned long long) compressor->Slots.Stalls,
+                         (double) compressor->Slots.StalledUs / 1e3);
+  for (size_t i = 0; i < compressThreads && i < COMPRESS_THREADS_MAX; ++i) {
+    const CompressWorkerStats_t* worker = &compressor->Workers[i];
+    length += AppendFormat(*statsBuffer + length,
+                           statsBufferSize - length,
+                           "  compression thread %zu: %llu blocks, ratio %.2f, %.1f MB/s\n",
+                           i,
+                           (unsigned long long) worker->Blocks,
+                           worker->CompressedBytes > 0 ? (double) worker->RawBytes / (double) worker->CompressedBytes
+                                                       : 0.0,
+                           worker->BusyUs > 0 ? (double) worker->RawBytes / (double) worker->BusyUs : 0.0);
+  }
+  if (compressor->WriteErrors > 0)
+    AppendFormat(*statsBuffer + length,
+                 statsBufferSize - length,
+                 "Warning: %llu compressed blocks are not written (write error).\n",
+                 (unsigned long long) compressor->WriteErrors);
+}
+
+size_t PrintTrafficDashboard(const TrafficStats_t* current,
+                             const TrafficStats_t* previous,
+                             double seconds,
+                             const Sniffer_t* sniffer,
+                             bool redraw,
+                             char* buffer,
+                             size_t bufferSize)
+{
+  static const TrafficProtocol_t protocols[TRAFFIC_PROTOCOLS_COUNT] = {
+      TrafficProtocol_TCP, TrafficProtocol_UDP, TrafficProtocol_ICMP, TrafficProtocol_OTHER};
+  static const char* sizeTitles[TRAFFIC_SIZE_BUCKETS_COUNT] = {
+      "<64", "64-127", "128-255", "256-511", "512-1023", "1024-2047", "2048-4095", ">=4096"};
+
+  size_t length = 0;
+  size_t rows = (size_t) sniffer->AddressesCount + (sniffer->Rules != NULL ? 1 : 0);
+  if (redraw)
+    length += AppendFormat(buffer + length, bufferSize - length, "\033[%uA", (unsigned) TRAFFIC_DASHBOARD_LINES(rows));
+
+  length += AppendFormat(buffer + length,
+                         bufferSize - length,
+                         "\033[2KTraffic: %llu packets, %llu bytes\n",
+                         (unsigned long long) current->Total.Packets,
+                         (unsigned long long) current->Total.Bytes);
+  length += AppendFormat(buffer + length,
+                         bufferSize - length,
+                         "\033[2K%-26s %-4s %10s %10s %9s %14s\n",
+                         "protocol",
+                         "dir",
+                         "pps",
+                         "bps",
+                         "avg size",
+                         "packets");
+  // Direction_SOURCE (the address sends the packet) is the first row of the protocol
+  for (size_t i = 0; i < TRAFFIC_PROTOCOLS_COUNT; ++i)
+    for (size_t d = 0; d < TRAFFIC_DIRECTIONS_COUNT; ++d)
+      length += PrintTrafficRow(TrafficProtocolName(protocols[i]),
+                                d == 0 ? "out" : "in",
+                                &current->Protocols[protocols[i]][d],
+                                &previous->Protocols[protocols[i]][d],
+                                seconds,
+                                buffer + length,
+                                bufferSize - length);
+  length += PrintTrafficRow(
+      "total", "", &current->Total, &previous->Total, seconds, buffer + length, bufferSize - length);
+
+  length += AppendFormat(buffer + length,
+                         bufferSize - length,
+                         "\033[2K%-26s %-4s %10s %10s %9s %14s\n",
+                         "address",
+                         "",
+                         "pps",
+                         "bps",
+                         "avg size",
+                         "packets");
+  for (uint16_t i = 0; i < sniffer->AddressesCount; ++i) {
+    char title[64];
+    length += PrintTrafficRow(FormatAddressTitle(&sniffer->Addresses[i], title, sizeof(title)),
+                              "",
+                              &current->Rules[i],
+                              &previous->Rules[i],
+                              seconds,
+                              buffer + length,
+                              bufferSize - length);
+  }
+  if (sniffer->Rules != NULL)
+    length += PrintTrafficRow("rules file",
+                              "",
+                              &current->Rules[TRAFFIC_RULES_FILE],
+                              &previous->Rules[TRAFFIC_RULES_FILE],
+                              seconds,
+                              buffer + length,
+                              bufferSize - length);
+
+  length += AppendFormat(buffer + length, bufferSize - length, "\033[2K%-9s", "size");
+  for (size_t i = 0; i < TRAFFIC_SIZE_BUCKETS_COUNT; ++i)
+    length += AppendFormat(buffer + length, bufferSize - length, " %10s", sizeTitles[i]);
+  length += AppendFormat(buffer + length, bufferSize - length, "\n\033[2K%-9s", "pps");
+  for (size_t i = 0; i < TRAFFIC_SIZE_BUCKETS_COUNT; ++i) {
+    char rate[16];
+    length += AppendFormat(buffer + length,
+                           bufferSize - length,
+                           " %10s",
+                           FormatRate((double) (current->Sizes[i] - previous->Sizes[i]) / seconds, rate, sizeof(rate)));
+  }
+  length += AppendFormat(buffer + length, bufferSize - length, "\n\033[2K%-9s", "share");
+  for (size_t i = 0; i < TRAFFIC_SIZE_BUCKETS_COUNT; ++i) {
+    double share =
+        current->Total.Packets > 0 ? 100.0 * (double) current->Sizes[i] / (double) current->Total.Packets : 0.0;
+    length += AppendFormat(buffer + length, bufferSize - length, " %9.1f%%", share);
+  }
+  length += AppendFormat(buffer + length, bufferSize - length, "\n");
+  return length;
+}
+
+size_t PrintMetrics(const MetricsSnapshot_t* snapshot,
+                    const Sniffer_t* sniffer,
+                    const RuleTable_t* rules,
+                    char* buffer,
+                    size_t bufferSize)
+{
+  static const char* protocols[TRAFFIC_PROTOCOLS_COUNT] = {"other", "tcp", "udp", "icmp"};
+  static const char* directions[TRAFFIC_DIRECTIONS_COUNT] = {"out", "in"};
+  const struct
+  {
+    const char* Name;
+    const char* Help;
+    uint64_t Value;
+  } counters[] = {
+      {"netsniffer_received_packets_total", "Frames read from the socket.", snapshot->Capture.Received},
+      {"netsniffer_handled_packets_total", "Packets passed to the handler.", snapshot->Capture.Handled},
+      {"netsniffer_filtered_out_packets_total", "Frames not matched by filters.", snapshot->Capture.FilteredOut},
+      {"netsniffer_kernel_packets_total", "Frames seen by the socket.", snapshot->Capture.KernelPackets},
+      {"netsniffer_kernel_drops_total", "Frames dropped by the kernel.", snapshot->Capture.KernelDrops},
+      {"netsniffer_suppressed_packets_total", "Packets suppressed by sampling.", snapshot->Suppressed},
+      {"netsniffer_capture_waits_total", "Waits of the capture thread for the output.", snapshot->Waits},
+  };
+
+  size_t length = 0;
+  for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+    length += PrintMetricHeader(counters[i].Name, "counter", counters[i].Help, buffer + length, bufferSize - length);
+    length += AppendFormat(
+        buffer + length, bufferSize - length, "%s %llu\n", counters[i].Name, (unsigned long long) counters[i].Value);
+  }
+
+  const char* names[] = {"netsniffer_protocol_packets_total", "netsniffer_protocol_bytes_total"};
+  const char* helps[] = {"Packets by protocol and direction.", "Bytes of IP packets by protocol and direction."};
+  for (size_t n = 0; n < 2; ++n) {
+    length += PrintMetricHeader(names[n], "counter", helps[n], buffer + length, bufferSize - length);
+    for (size_t p = 0; p < TRAFFIC_PROTOCOLS_COUNT; ++p)
+      for (size_t d = 0; d < TRAFFIC_DIRECTIONS_COUNT; ++d) {
+        const TrafficCounter_t* counter = &snapshot->Traffic.Protocols[p][d];
+        length += AppendFormat(buffer + length,
+                               bufferSize - length,
+                               "%s{protocol=\"%s\",direction=\"%s\"} %llu\n",
+                               names[n],
+                               protocols[p],
+                               directions[d],
+                               (unsigned long long) (n == 0 ? counter->Packets : counter->Bytes));
+      }
+  }
+
+  names[0] = "netsniffer_rule_packets_total";
+  names[1] = "netsniffer_rule_bytes_total";
+  helps[0] = "Packets matched by the address.";
+  helps[1] = "Bytes of IP packets matched by the address.";
+  for (size_t n = 0; n < 2; ++n) {
+    length += PrintMetricHeader(names[n], "counter", helps[n], buffer + length, bufferSize - length);
+    for (uint16_t i = 0; i < sniffer->AddressesCount; ++i) {
+      const TrafficCounter_t* counter = &snapshot->Traffic.Rules[i];
+      char title[64];
+      length += AppendFormat(buffer + length,
+                             bufferSize - length,
+                             "%s{rule=\"%u\",address=\"%s\"} %llu\n",
+                             names[n],
+                             (unsigned) i,
+                             FormatAddressTitle(&sniffer->Addresses[i], title, sizeof(title)),
+                             (unsigned long long) (n == 0 ? counter->Packets : counter->Bytes));
+    }
+    // indexes of rules follow indexes of addresses (as MatchedAddress)
+    size_t printed = 0;
+    for (size_t i = 0; rules != NULL && i < rules->Count && printed < METRICS_RULES_MAX_COUNT; ++i) {
+      const RuleCounter_t* counter = &rules->Counters[i];
+      if (atomic_load_explicit(&counter->Packets, memory_order_relaxed) == 0)
+        continue;
+      char title[RULE_STRING_MAX_SIZE];
+      RuleToString(&rules->Rules[i], title, sizeof(title));
+      uint64_t value = atomic_load_explicit(n == 0 ? &counter->Packets : &counter->Bytes, memory_order_relaxed);
+      length += AppendFormat(buffer + length,
+                             bufferSize - length,
+                             "%s{rule=\"%zu\",address=\"%s\"} %llu\n",
+                             names[n],
+                             sniffer->AddressesCount + i,
+                             title,
+                             (unsigned long long) value);
+      printed++;
+    }
+  }
+
+  length += PrintMetricHeader(
+      "netsniffer_packet_size_bytes", "histogram", "Sizes of IP packets.", buffer + length, bufferSize - length);
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < TRAFFIC_SIZE_BUCKETS_COUNT - 1; ++i) {
+    cumulative += snapshot->Traffic.Sizes[i];
+    length += AppendFormat(buffer + length,
+                           bufferSize - length,
+                           "netsniffer_packet_size_bytes_bucket{le=\"%llu\"} %llu\n",
+                           (unsigned long long) ((64ULL << i) - 1),
+                           (unsigned long long) cumulative);
+  }
+  length += AppendFormat(buffer + length,
+                         bufferSize - length,
+                         "netsniffer_packet_size_bytes_bucket{le=\"+Inf\"} %llu\n"
+                         "netsniffer_packet_size_bytes_sum %llu\n"
+                         "netsniffer_packet_size_bytes_count %llu\n",
+                         (unsigned long long) snapshot->Traffic.Total.Packets,
+                         (unsigned long long) snapshot->Traffic.Total.Bytes,
+                         (unsigned long long) snapshot->Traffic.Total.Packets);
+
+  const Histogram_t* latency = &snapshot->HandlerLatency;
+  length += PrintMetricHeader("netsniffer_handler_latency_seconds",
+                              "summary",
+                              "Time of decoding and formatting the packet by the capture thread.",
+                              buffer + length,
+                              bufferSize - length);
+  const double quantiles[] = {0.5, 0.9, 0.99};
+  for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i)
+    length += AppendFormat(buffer + length,
+                           bufferSize - length,
+                           "netsniffer_handler_latency_seconds{quantile=\"%g\"} %.9f\n",
+                           quantiles[i],
+                           (double) HistogramPercentile(latency, quantiles[i] * 100.0) / 1e9);
+  length += AppendFormat(buffer + length,
+                         bufferSize - length,
+                         "netsniffer_handler_latency_seconds_sum %.9f\n"
+                         "netsniffer_handler_latency_seconds_count %llu\n",
+                         (double) latency->Sum / 1e9,
+                         (unsigned long long) latency->Count);
+
+  const struct
+  {
+    const char* Name;
+    const char* Type;
+    const char* Help;
+  } stageMetrics[] = {
+      {"netsniffer_stage_packets_in_total", "counter", "Packets received by the pipeline stage."},
+      {"netsniffer_stage_packets_out_total", "counter", "Packets passed to the next stage."},
+      {"netsniffer_stage_busy_seconds_total", "counter", "Time of processing batches by the stage."},
+      {"netsniffer_stage_queue_depth", "gauge", "Batches in the queue of the threaded stage."},
+      {"netsniffer_stage_queue_waits_total", "counter", "Waits of the previous stage for the full queue."},
+  };
+  for (size_t n = 0; n < sizeof(stageMetrics) / sizeof(stageMetrics[0]) && snapshot->StagesCount > 0; ++n) {
+    length += PrintMetricHeader(
+        stageMetrics[n].Name, stageMetrics[n].Type, stageMetrics[n].Help, buffer + length, bufferSize - length);
+    for (size_t i = 0; i < snapshot->StagesCount; ++i) {
+      const PipelineStageCounters_t* stage = &snapshot->Stages[i];
+      length += AppendFormat(
+          buffer + length, bufferSize - length, "%s{stage=\"%s\"} ", stageMetrics[n].Name, stage->Name);
+      if (n == 2)
+        length += AppendFormat(buffer + length, bufferSize - length, "%.9f\n", (double) stage->BusyNs / 1e9);
+      else
+        length += AppendFormat(buffer + length,
+                               bufferSize - length,
+                               "%llu\n",
+                               (unsigned long long) (n == 0   ? stage->PacketsIn
+                                                     : n == 1 ? stage->PacketsOut
+                                                     : n == 3 ? stage->QueueDepth
+                                                              : stage->QueueWaits));
+    }
+  }
+  return length;
+}
+
+size_t PrintSamplingReport(const Sampler_t* sampler, uint64_t nowUs, bool json, char* buffer, size_t bufferSize)
+{
+  unsigned long long suppressed = (unsigned long long) (sampler->Suppressed - sampler->ReportedSuppressed);
+  unsigned long long packets = suppressed + (unsigned long long) (sampler->Passed - sampler->ReportedPassed);
+  unsigned long long intervalUs = (unsigned long long) (nowUs - sampler->LastReportUs);
+  if (json)
+    return AppendFormat(buffer,
+                        bufferSize,
+                        "{\"sampling\":{\"suppressed\":%llu,\"packets\":%llu,\"interval_us\":%llu}}\n",
+                        suppressed,
+                        packets,
+                        intervalUs);
+  return AppendFormat(buffer,
+                      bufferSize,
+                      "# sampling: suppressed %llu of %llu packets in %.3f s\n",
+                      suppressed,
+                      packets,
+                      (double) intervalUs / 1e6);
+}
+
+void PrintSamplingStats(const Sampler_t* sampler, char** statsBuffer, size_t statsBufferSize)
+{
+  size_t length = 0;
+  length += AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n        Sampling\n");
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Printed: %llu, suppressed: %llu\n",
+                         (unsigned long long) sampler->Passed,
+                         (unsigned long long) sampler->Suppressed);
+  length += AppendFormat(*statsBuffer + length,
+                         statsBufferSize - length,
+                         "| Suppressed by flow: %llu, 1-in-N: %llu, random: %llu, rate limit: %llu\n",
+                         (unsigned long long) sampler->SuppressedByFlow,
+                         (unsigned long long) sampler->SuppressedByCount,
+                         (unsigned long long) sampler->SuppressedByRandom,
+                         (unsigned long long) sampler->SuppressedByRate);
+  AppendFormat(*statsBuffer + length, statsBufferSize - length, "\n");
+}
+
+size_t PrintHistogramSummary(const char* title, const Histogram_t* h, double divider, char* buffer, size_t bufferSize)
+{
+  if (h->Count == 0)
+    return AppendFormat(buffer, bufferSize, "| %s: count 0\n", title);
+
+  return AppendFormat(buffer,
+                      bufferSize,
+                      "| %s: count %llu, min %.3f, mean %.3f, p50 %.3f, p90 %.3f, p99 %.3f, max %.3f\n",
+                      title,
+                      (unsigned long long) h->Count,
+                      (double) h->Min / divider,
+                      (double) HistogramMean(h) / divider,
+                      (double) HistogramPercentile(h, 50.0) / divider,
+                      (double) HistogramPercentile(h, 90.0) / divider,
+                      (double) HistogramPercentile(h, 99.0) / divider,
+                      (double) h->Max / divider);
+}
+
+size_t PrintTcpFlow(const TcpFlow_t* flow, char* buffer, size_t bufferSize)
+{
+  char client[INET_ADDRSTRLEN], server[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &flow->ClientAddress, client, sizeof(client));
+  inet_ntop(AF_INET, &flow->ServerAddress, server, sizeof(server));
+
+  size_t length = 0;
+  length += AppendFormat(buffer + length,
+                         bufferSize - length,
+                         "| %s:%u -> %s:%u\n",
+                         client,
+                         flow->ClientPort,
+                         server,
+                         flow->ServerPort);
+  length += AppendFormat(buffer + length,
+                         bufferSize - length,
+                         "| Duration: %.3f ms, packets: %u, bytes: %llu\n",
+                         (double) (flow->LastSeenUs - flow->StartUs) / 1000.0,
+                         flow->Packets,
+                         (unsigned long long) flow->Bytes);
+  length += AppendFormat(buffer + length,
+                         bufferSize - length,
+                         "| Retransmissions: %u, out-of-order: %u, duplicate ACKs: %u, zero windows: %u\n",
+                         flow->Retransmissions,
+                         flow->OutOfOrder,
+                         flow->DupAcks,
+                         flow->ZeroWindows);
+  if (flow->HandshakeDone)
+    length += AppendFormat(
+        buffer + length, bufferSize - length, "| Handshake RTT: %.3f ms\n", (double) flow->HandshakeRttUs / 1000.0);
+  if (flow->RttCount > 0)
+    length += AppendFormat(buffer + length,
+                           bufferSize - length,
+                           "| RTT: samples %u, min %.3f ms, mean %.3f ms, max %.3f ms\n",
+                           flow->RttCount,
+                           (double) flow->RttMinUs / 1000.0,
+                           (double) flow->RttSumUs / flow->RttCount / 1000.0,
+                           (double) flow->RttMaxUs / 1000.0);
+  return length;
+}
+
+char* WriteUnsigned(char* cursor, uint32_t value, int minDigits)
+{
+  char digits[10];
+  int count = 0;
+  do {
+    digits[count++] = (char) ('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+  while (count < minDigits)
+    digits[count++] = '0';
+
+  while (count > 0)
+    *cursor++ = digits[--count];
+  return cursor;
+}
+
+char* WriteIPv4(char* cursor, uint32_t address)
+{
+  const uint8_t* octets = (const uint8_t*) &address; // network byte order
+  for (int i = 0; i < 4; ++i) {
+    if (i > 0)
+      *cursor++ = '.';
+    cursor = WriteUnsigned(cursor, octets[i], 1);
+  }
+  return cursor;
+}
+
+size_t PrintTrafficRow(const char* title,
+                       const char* direction,
+                       const TrafficCounter_t* current,
+                       const TrafficCounter_t* previous,
+                       double seconds,
+                       char* buffer,
+                       size_t bufferSize)
+{
+  uint64_t packets = current->Packets - previous->Packets;
+  uint64_t bytes = current->Bytes - previous->Bytes;
+  char pps[16], bps[16];
+  return AppendFormat(buffer,
+                      bufferSize,
+                      "\033[2K%-26s %-4s %10s %10s %9llu %14llu\n",
+                      title,
+                      direction,
+                      FormatRate((double) packets / seconds, pps, sizeof(pps)),
+                      FormatRate((double) bytes * 8.0 / seconds, bps, sizeof(bps)),
+                      (unsigned long long) (packets > 0 ? bytes / packets : 0),
+                      (unsigned long long) current->Packets);
+}
+
+const char* FormatRate(double value, char* buffer, size_t bufferSize)
+{
+  static const char* units[] = {"", "k", "M", "G", "T"};
+  size_t unit = 0;
+  while (value >= 1000.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+    value /= 1000.0;
+    unit++;
   }
-  snprintf(*dataBuffer + length, dataBufferSize, "\n");
+  snprintf(buffer, bufferSize, unit == 0 ? "%.0f%s" : "%.1f%s", value, units[unit]);
+  return buffer;
+}
+
+const char* FormatAddressTitle(const struct FilterAddress_t* address, char* buffer, size_t bufferSize)
+{
+  const char* protocol = address->Filter.Protocol == Protocol_TCP    ? "tcp "
+                         : address->Filter.Protocol == Protocol_UDP  ? "udp "
+                         : address->Filter.Protocol == Protocol_ICMP ? "icmp "
+                                                                      : "";
+  snprintf(buffer, bufferSize, "%s%s:%u", protocol, address->Address.IP, address->Address.Port);
+  return buffer;
+}
+
+size_t PrintMetricHeader(const char* name, const char* type, const char* help, char* buffer, size_t bufferSize)
+{
+  return AppendFormat(buffer, bufferSize, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void PrintHeaders(Buffer_t packetBuffer, PacketBuffers_t* buffers, TimeInfo_t* t)
+{
+  // each printer terminates its text, only the buffers which are not printed are emptied
+  buffers->ProtocolHeaderBuffer[0] = '\0';
+  buffers->DataBuffer[0] = '\0';
+
+  PrintPacketIPHeader(packetBuffer, &buffers->IPHeaderBuffer, IP_HEADER_BUFFER_SUFFICIENT_SIZE, t);
+  switch (GetIPHeader(packetBuffer)->Protocol) {
+  case Protocol_ICMP: {
+    PrintPacketICMPHeader(packetBuffer, &buffers->ProtocolHeaderBuffer, PROTOCOL_HEADER_BUFFER_SUFFICIENT_SIZE);
+    break;
+  }
+  case Protocol_TCP: {
+    PrintPacketTCPHeader(packetBuffer, &buffers->ProtocolHeaderBuffer, PROTOCOL_HEADER_BUFFER_SUFFICIENT_SIZE);
+    break;
+  }
+  case Protocol_UDP: {
+    PrintPacketUDPHeader(packetBuffer, &buffers->ProtocolHeaderBuffer, PROTOCOL_HEADER_BUFFER_SUFFICIENT_SIZE);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+size_t AppendFormat(char* buffer, size_t bufferSize, const char* format, ...)
+{
+  if (bufferSize == 0)
+    return 0;
+
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, bufferSize, format, args);
+  va_end(args);
+
+  if (length < 0)
+    return 0;
+  return (size_t) length < bufferSize ? (size_t) length : bufferSize - 1;
 }
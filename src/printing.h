@@ -2,13 +2,48 @@
 #define __PRINTING_H
 
 #include "structures.h"
+#include "checksum.h"
+#include "histogram.h"
+#include "dns.h"
+#include "http.h"
+#include "tls.h"
+#include "tcpanalyzer.h"
+#include "output.h"
+#include "formatpool.h"
+#include "sampling.h"
+#include "sniffer.h"
+#include "traffic.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "recorder.h"
+#include "storage.h"
 
 #ifdef __linux__
 #define ETH_HEADER_BUFFER_SUFFICIENT_SIZE 256
 #endif
 #define IP_HEADER_BUFFER_SUFFICIENT_SIZE 512
 #define PROTOCOL_HEADER_BUFFER_SUFFICIENT_SIZE 512
-#define DATA_BUFFER_SUFFICIENT_SIZE (65536 - 512) * 2 /* brackets */ + ((65536 - 512) / 3) /* spaces and breaks */
+#define STATS_BUFFER_SUFFICIENT_SIZE 1024
+#define CAPTURE_STATS_LINE_MAX_SIZE 256
+#define TRAFFIC_DASHBOARD_BUFFER_SUFFICIENT_SIZE 8192
+#define TRAFFIC_DASHBOARD_LINES(rulesCount) (15 + (rulesCount))
+#define DECODED_BUFFER_SUFFICIENT_SIZE 4096
+#define DNS_STATS_BUFFER_SUFFICIENT_SIZE 32768
+#define HTTP_STATS_BUFFER_SUFFICIENT_SIZE 65536
+#define TLS_STATS_BUFFER_SUFFICIENT_SIZE 131072
+#define TCP_STATS_BUFFER_SUFFICIENT_SIZE 16384
+#define PIPELINE_STATS_BUFFER_SUFFICIENT_SIZE 4096
+#define PROFILE_STATS_BUFFER_SUFFICIENT_SIZE 2048
+#define STORAGE_SUMMARY_BUFFER_SUFFICIENT_SIZE 8192
+#define RECORDER_DUMP_LINE_MAX_SIZE (RECORDER_PATH_MAX_SIZE + 512)
+#define TCP_STATS_FLOWS_MAX_COUNT 16
+#define BRIEF_LINE_MAX_SIZE 128
+#define TCP_FLAGS_STRING_MAX_SIZE 9
+#define HEX_DUMP_LINE_SIZE 32 /* bytes per line */
+#define HEX_DUMP_LINE_MAX_LENGTH (HEX_DUMP_LINE_SIZE * 6 + 3) /* "[XX] " and the ASCII gutter "|...|\n" */
+#define DATA_BUFFER_SUFFICIENT_SIZE                                                                                    \
+  (16 /* title */ + (65536 / HEX_DUMP_LINE_SIZE) * HEX_DUMP_LINE_MAX_LENGTH + 1 /* null */)
 
 /**
  * @brief PacketBuffers_t
@@ -19,6 +54,7 @@ typedef struct
   char* IPHeaderBuffer;
   char* ProtocolHeaderBuffer;
   char* DataBuffer;
+  bool AsciiGutter; //! Print printable characters of the data next to the hex dump
 } PacketBuffers_t;
 
 /**
@@ -44,6 +80,15 @@ void PacketBuffersDelete(PacketBuffers_t* p);
  * @param t The pointer to the TimeInfo_t
  */
 void PrintPacketToBuffers(Buffer_t packetBuffer, size_t size, PacketBuffers_t* buffers, TimeInfo_t* t);
+/**
+ * @brief PrintPacketHeadersToBuffers
+ * Prints only the IP and protocol headers of the packet, the data buffer is empty. It is used for packets which are
+ * printed by the decoder (DNS, HTTP, TLS) instead of the hex dump.
+ * @param packetBuffer The network packet without the ETH header
+ * @param buffers The pointer to buffers (PacketBuffers_t*)
+ * @param t The pointer to the TimeInfo_t
+ */
+void PrintPacketHeadersToBuffers(Buffer_t packetBuffer, PacketBuffers_t* buffers, TimeInfo_t* t);
 #ifdef __linux__
 /**
  * @brief PrintPacketETHHeader
@@ -96,7 +141,267 @@ void PrintPacketUDPHeader(Buffer_t packetBuffer, char** headerBuffer, size_t hea
  * @param size Size of the data part of this packet
  * @param dataBuffer The pointer to the buffer for the data of this packet
  * @param dataBufferSize The size of the data buffer
+ * @param ascii Print the ASCII gutter
+ */
+void PrintPacketData(Buffer_t packetBuffer, size_t size, char** dataBuffer, size_t dataBufferSize, bool ascii);
+/**
+ * @brief PrintHexDump
+ * Writes the hex dump of the data, HEX_DUMP_LINE_SIZE bytes per line ("[45] [00] ..."). Bytes are converted by the
+ * lookup table and written directly to the buffer. Only whole lines are written, if the buffer is too small.
+ * @param data The data
+ * @param size The size of the data
+ * @param buffer The buffer for the hex dump
+ * @param bufferSize The size of the buffer
+ * @param ascii Append printable characters of each line ("|E..T..@.|"), other bytes are printed as '.'
+ * @return The length of the written string (without the terminating null).
+ */
+size_t PrintHexDump(const uint8_t* data, size_t size, char* buffer, size_t bufferSize, bool ascii);
+/**
+ * @brief PrintPacketBrief
+ * Prints one line with the time, protocol, addresses, TCP flags and payload length of the packet, for example
+ * "12:30:45.123456 TCP 10.0.0.1:40000 > 10.0.0.2:80 Flags [S.], length 0". The line is written directly to the buffer
+ * without formatting functions.
+ * @param view The decoded packet
+ * @param t The pointer to the TimeInfo_t
+ * @param buffer The buffer for the line
+ * @param bufferSize The size of the buffer (at least BRIEF_LINE_MAX_SIZE)
+ * @return The length of the line (0 if the buffer is too small).
+ */
+size_t PrintPacketBrief(const PacketView_t* view, const TimeInfo_t* t, char* buffer, size_t bufferSize);
+/**
+ * @brief PrintTCPFlags
+ * Prints TCP flags in the notation of tcpdump ("S.", "FP."), '.' is ACK.
+ * @param flags TCP flags (see TCPFlag_t)
+ * @param buffer The buffer for the string (at least TCP_FLAGS_STRING_MAX_SIZE)
+ * @return The length of the string.
+ */
+size_t PrintTCPFlags(uint8_t flags, char* buffer);
+/**
+ * @brief PrintChecksumStats
+ * Prints the checksum verification counters.
+ * @param stats The pointer to the counters
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintChecksumStats(const ChecksumStats_t* stats, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintDnsEvent
+ * Prints the decoded DNS message: the first question, answers and the resolution latency.
+ * @param event The pointer to the DNS event
+ * @param dnsBuffer The pointer to the buffer for the DNS message
+ * @param dnsBufferSize The size of the buffer
+ */
+void PrintDnsEvent(const DnsEvent_t* event, char** dnsBuffer, size_t dnsBufferSize);
+/**
+ * @brief PrintDnsStats
+ * Prints DNS counters and latency histograms per response code and per question name.
+ * @param tracker The pointer to the DNS tracker
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintDnsStats(const DnsTracker_t* tracker, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintHttpEvent
+ * Prints the decoded HTTP request line or status line and the response time.
+ * @param event The pointer to the HTTP event
+ * @param httpBuffer The pointer to the buffer for the HTTP message
+ * @param httpBufferSize The size of the buffer
+ */
+void PrintHttpEvent(const HttpEvent_t* event, char** httpBuffer, size_t httpBufferSize);
+/**
+ * @brief PrintHttpStats
+ * Prints HTTP counters and response time histograms per (method, path prefix).
+ * @param tracker The pointer to the HTTP tracker
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintHttpStats(const HttpTracker_t* tracker, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintTlsEvent
+ * Prints the decoded TLS ClientHello: server name, ALPN protocols, versions and the fingerprint.
+ * @param event The pointer to the TLS event
+ * @param tlsBuffer The pointer to the buffer for the TLS message
+ * @param tlsBufferSize The size of the buffer
+ */
+void PrintTlsEvent(const TlsEvent_t* event, char** tlsBuffer, size_t tlsBufferSize);
+/**
+ * @brief PrintTlsStats
+ * Prints TLS counters and per-SNI connections, packets and bytes.
+ * @param tracker The pointer to the TLS tracker
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintTlsStats(const TlsTracker_t* tracker, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintTcpEvent
+ * Prints events detected by the TCP analyzer in the segment, RTT samples and the summary of the closed flow.
+ * @param event The pointer to the TCP event
+ * @param tcpBuffer The pointer to the buffer for the analysis
+ * @param tcpBufferSize The size of the buffer
+ */
+void PrintTcpEvent(const TcpEvent_t* event, char** tcpBuffer, size_t tcpBufferSize);
+/**
+ * @brief PrintTcpStats
+ * Prints TCP analyzer counters, RTT histograms and summaries of the worst open flows (TCP_STATS_FLOWS_MAX_COUNT).
+ * @param analyzer The pointer to the TCP analyzer
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintTcpStats(const TcpAnalyzer_t* analyzer, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintOutputStats
+ * Prints counters of the output writer.
+ * @param output The pointer to the stopped output
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintOutputStats(const Output_t* output, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintFormatPoolStats
+ * Prints counters of the formatter pool.
+ * @param pool The pointer to the stopped pool
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintFormatPoolStats(const FormatPool_t* pool, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintPipelineStats
+ * Prints counters of pipeline stages: packets, the time of stages and queues of threaded stages.
+ * @param stages Counters of stages
+ * @param count Stages count
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintPipelineStats(const PipelineStageCounters_t* stages,
+                        size_t count,
+                        char** statsBuffer,
+                        size_t statsBufferSize);
+/**
+ * @brief PrintProfileStats
+ * Prints percentiles of the time of each profiled stage of the packet path.
+ * @param stages Histograms of stages (ProfileStage_COUNT elements, ticks)
+ * @param ticksPerNs Ticks per nanosecond
+ * @param statsBuffer The pointer to the buffer for the percentiles
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintProfileStats(const Histogram_t* stages, double ticksPerNs, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintCaptureStatsLine
+ * Prints one line with capture counters and their changes since the previous line, for example
+ * "capture: received 1200 (+200), handled 1000 (+180), filtered out 200, kernel drops 0 (+0), suppressed 0, waits 0".
+ * @param stats The counters
+ * @param previous The counters of the previous line
+ * @param suppressed Packets suppressed by sampling
+ * @param waits Waits of the capture thread for the output
+ * @param buffer The buffer for the line
+ * @param bufferSize The size of the buffer (CAPTURE_STATS_LINE_MAX_SIZE)
+ * @return The length of the line.
+ */
+size_t PrintCaptureStatsLine(const CaptureStats_t* stats,
+                             const CaptureStats_t* previous,
+                             uint64_t suppressed,
+                             uint64_t waits,
+                             char* buffer,
+                             size_t bufferSize);
+/**
+ * @brief PrintCaptureStats
+ * Prints capture counters.
+ * @param stats The counters
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintCaptureStats(const CaptureStats_t* stats, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintRecorderDump
+ * Prints one line with the result of the flight recorder dump: the path and written packets, or the error.
+ * @param dump The result of the dump
+ * @param buffer The buffer for the line
+ * @param bufferSize The size of the buffer (RECORDER_DUMP_LINE_MAX_SIZE)
+ * @return The length of the line.
+ */
+size_t PrintRecorderDump(const RecorderDump_t* dump, char* buffer, size_t bufferSize);
+/**
+ * @brief PrintStorageSummary
+ * Prints counters of the stopped storage writer, the compression and its threads (if segments are compressed).
+ * @param storage The storage writer
+ * @param compressThreads The number of compression threads
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer (STORAGE_SUMMARY_BUFFER_SUFFICIENT_SIZE)
+ */
+void PrintStorageSummary(const StorageWriter_t* storage,
+                         size_t compressThreads,
+                         char** statsBuffer,
+                         size_t statsBufferSize);
+/**
+ * @brief PrintTrafficDashboard
+ * Prints the dashboard of rates since the previous counters: packets and bits per second and the average size by
+ * protocol and direction, by each address of the sniffer and by the packet size. Rules of the file have one row of
+ * their sum. The dashboard always has TRAFFIC_DASHBOARD_LINES(sniffer->AddressesCount + (sniffer->Rules != NULL))
+ * lines, each line clears the rest of the terminal line. If redraw is true, the cursor is moved up to the first line of
+ * the previous dashboard (ANSI escape codes).
+ * @param current The counters
+ * @param previous The counters of the previous dashboard
+ * @param seconds Seconds since the previous counters
+ * @param sniffer The sniffer (names of addresses)
+ * @param redraw Replace the previous dashboard
+ * @param buffer The buffer for the dashboard
+ * @param bufferSize The size of the buffer (TRAFFIC_DASHBOARD_BUFFER_SUFFICIENT_SIZE)
+ * @return The length of the dashboard.
+ */
+size_t PrintTrafficDashboard(const TrafficStats_t* current,
+                             const TrafficStats_t* previous,
+                             double seconds,
+                             const Sniffer_t* sniffer,
+                             bool redraw,
+                             char* buffer,
+                             size_t bufferSize);
+/**
+ * @brief PrintMetrics
+ * Prints counters in the Prometheus text format (version 0.0.4).
+ * Rules of the file are printed after addresses, only matched rules in the order of the file (up to
+ * METRICS_RULES_MAX_COUNT rules).
+ * @param snapshot The counters
+ * @param sniffer The sniffer (names of addresses)
+ * @param rules The table of rules of the file and their counters (NULL if not used)
+ * @param buffer The buffer for the metrics
+ * @param bufferSize The size of the buffer (METRICS_BUFFER_SUFFICIENT_SIZE)
+ * @return The length of the metrics.
+ */
+size_t PrintMetrics(const MetricsSnapshot_t* snapshot,
+                    const Sniffer_t* sniffer,
+                    const RuleTable_t* rules,
+                    char* buffer,
+                    size_t bufferSize);
+/**
+ * @brief PrintSamplingReport
+ * Prints one line with packets suppressed and passed since the last report, for example
+ * "# sampling: suppressed 900 of 1000 packets in 1.000 s". The JSON line is the object with the "sampling" member.
+ * @param sampler The pointer to the sampler
+ * @param nowUs The current time (microseconds, monotonic clock)
+ * @param json Print the JSON line
+ * @param buffer The buffer for the line
+ * @param bufferSize The size of the buffer (SAMPLING_REPORT_BUFFER_SUFFICIENT_SIZE)
+ * @return The length of the line.
+ */
+size_t PrintSamplingReport(const Sampler_t* sampler, uint64_t nowUs, bool json, char* buffer, size_t bufferSize);
+/**
+ * @brief PrintSamplingStats
+ * Prints counters of packets suppressed by each sampler.
+ * @param sampler The pointer to the sampler
+ * @param statsBuffer The pointer to the buffer for the counters
+ * @param statsBufferSize The size of the buffer
+ */
+void PrintSamplingStats(const Sampler_t* sampler, char** statsBuffer, size_t statsBufferSize);
+/**
+ * @brief PrintHistogramSummary
+ * Prints one line with the count, min, mean, percentiles and max values of the histogram.
+ * @param title The title of the line
+ * @param h The pointer to the histogram
+ * @param divider Values are divided by this number (for example, 1000 to print microseconds as milliseconds)
+ * @param buffer The buffer
+ * @param bufferSize The size of the buffer
+ * @return The length of the printed line.
  */
-void PrintPacketData(Buffer_t packetBuffer, size_t size, char** dataBuffer, size_t dataBufferSize);
+size_t PrintHistogramSummary(const char* title, const Histogram_t* h, double divider, char* buffer, size_t bufferSize);
 
 #endif // __PRINTING_H
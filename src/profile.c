@@ -0,0 +1,89 @@
+#include "profile.h"
+#include "utils.h"
+
+#ifdef PROFILING_ENABLED
+#include <stdatomic.h>
+
+typedef struct
+{
+  Histogram_t Stages[ProfileStage_COUNT];
+} ProfileThread_t;
+
+bool ProfileActive = false;
+
+static ProfileThread_t Threads[PROFILE_THREADS_MAX];
+static atomic_size_t ThreadsCount = 0;
+static _Thread_local ProfileThread_t* Current = NULL;
+static _Thread_local bool Registered = false;
+static uint64_t EnabledTicks = 0;
+static uint64_t EnabledNs = 0;
+
+void ProfileEnable()
+{
+  EnabledTicks = ProfileTicks();
+  EnabledNs = GetMonotonicTimeNs();
+  ProfileActive = true;
+}
+
+void ProfileAdd(ProfileStage_t stage, uint64_t ticks)
+{
+  if (!Registered) {
+    Registered = true;
+    size_t index = atomic_fetch_add(&ThreadsCount, 1);
+    if (index < PROFILE_THREADS_MAX) {
+      Current = &Threads[index];
+      for (int i = 0; i < ProfileStage_COUNT; ++i)
+        HistogramInit(&Current->Stages[i]);
+    }
+  }
+  if (Current != NULL)
+    HistogramAdd(&Current->Stages[stage], ticks);
+}
+
+size_t ProfileRead(Histogram_t* stages)
+{
+  for (int i = 0; i < ProfileStage_COUNT; ++i)
+    HistogramInit(&stages[i]);
+
+  size_t count = atomic_load(&ThreadsCount);
+  if (count > PROFILE_THREADS_MAX)
+    count = PROFILE_THREADS_MAX;
+  for (size_t t = 0; t < count; ++t) {
+    for (int i = 0; i < ProfileStage_COUNT; ++i)
+      HistogramMerge(&stages[i], &Threads[t].Stages[i]);
+  }
+  return count;
+}
+
+double ProfileTicksPerNs()
+{
+  uint64_t ns = GetMonotonicTimeNs() - EnabledNs;
+  if (!ProfileActive || ns == 0)
+    return 1.0;
+  return (double) (ProfileTicks() - EnabledTicks) / (double) ns;
+}
+#endif
+
+const char* ProfileStageToString(ProfileStage_t stage)
+{
+  switch (stage) {
+  case ProfileStage_RECEIVE:
+    return "receive";
+  case ProfileStage_DISSECT:
+    return "dissect";
+  case ProfileStage_FILTER:
+    return "filter";
+  case ProfileStage_CHECKSUM:
+    return "checksum";
+  case ProfileStage_TIMESTAMP:
+    return "timestamp";
+  case ProfileStage_HANDLER:
+    return "handler";
+  case ProfileStage_FORMAT:
+    return "format";
+  case ProfileStage_OUTPUT:
+    return "output";
+  default:
+    return "unknown";
+  }
+}
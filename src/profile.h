@@ -0,0 +1,97 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include "histogram.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Instrumentation points of the packet path. They are only compiled with PROFILING_ENABLED, otherwise PROFILE_START()
+ * and PROFILE_STOP() expand to nothing. Each thread records ticks of stages to its own histograms, they are merged
+ * by ProfileRead() after threads are stopped.
+ */
+#define PROFILE_THREADS_MAX 32
+
+typedef enum
+{
+  ProfileStage_RECEIVE = 0, //! recvmsg() or recvfrom() of the frame
+  ProfileStage_DISSECT,     //! Addresses and ports of the frame
+  ProfileStage_FILTER,      //! Matching of address filters
+  ProfileStage_CHECKSUM,    //! Checksum verification
+  ProfileStage_TIMESTAMP,   //! Capture time of the frame
+  ProfileStage_HANDLER,     //! The packet handler (the batch handler is timed per batch)
+  ProfileStage_FORMAT,      //! Formatting of headers, the data, brief lines and JSON records
+  ProfileStage_OUTPUT,      //! Copying of the formatted packet to the output
+  ProfileStage_COUNT
+} ProfileStage_t;
+
+#ifdef PROFILING_ENABLED
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+//! Stages are recorded, set by ProfileEnable() before threads of the packet path are started
+extern bool ProfileActive;
+
+#define PROFILE_START(var) uint64_t var = ProfileActive ? ProfileTicks() : 0
+#define PROFILE_STOP(stage, var)                                                                                       \
+  do {                                                                                                                 \
+    if (ProfileActive)                                                                                                 \
+      ProfileAdd(stage, ProfileTicks() - (var));                                                                       \
+  } while (0)
+
+/**
+ * @brief ProfileTicks
+ * @return The time stamp counter on x86, otherwise nanoseconds of the raw monotonic clock.
+ */
+static inline uint64_t ProfileTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+  return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#endif
+}
+/**
+ * @brief ProfileEnable
+ * Starts recording of stages and the calibration of ticks.
+ */
+void ProfileEnable();
+/**
+ * @brief ProfileAdd
+ * Records the time of the stage to histograms of the current thread. Threads after PROFILE_THREADS_MAX are not
+ * recorded.
+ * @param stage The stage
+ * @param ticks The time of the stage (ticks)
+ */
+void ProfileAdd(ProfileStage_t stage, uint64_t ticks);
+/**
+ * @brief ProfileRead
+ * Merges histograms of all threads. Threads must not record stages while they are read.
+ * @param stages Histograms of each stage (ProfileStage_COUNT elements, ticks)
+ * @return Recorded threads count.
+ */
+size_t ProfileRead(Histogram_t* stages);
+/**
+ * @brief ProfileTicksPerNs
+ * @return Ticks per nanosecond, measured since ProfileEnable().
+ */
+double ProfileTicksPerNs();
+#else
+#define PROFILE_START(var)
+#define PROFILE_STOP(stage, var)
+#endif
+
+/**
+ * @brief ProfileStageToString
+ * @param stage The stage
+ * @return The name of the stage.
+ */
+const char* ProfileStageToString(ProfileStage_t stage);
+
+#endif // __PROFILE_H
@@ -0,0 +1,218 @@
+/*
+ * Extracts packets of the flow or the time range from the storage directory of 'netsniffer -store DIR' to the pcap
+ * file. Segments are mapped, indexed segments are read at offsets of the flow or from the time entry before the time
+ * range, so the directory is not scanned. Only blocks of compressed segments with these offsets are decompressed. The
+ * flow matches both directions.
+ * Usage: netsniffer-query -dir DIR [-flow PROTO SRC_IP:PORT DST_IP:PORT] [-from SEC[.FRACTION]] [-to SEC[.FRACTION]]
+ *                         [-o FILE|-]
+ */
+#include "storage.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define QUERY_NANOSECONDS_DIGITS 9
+
+typedef struct
+{
+  const char* Directory;
+  const char* Output;
+  StorageQuery_t Query;
+} QueryArgs_t;
+
+/**
+ * @brief QueryOutput_t
+ * The pcap file of the query, it is created with the link type of the first matched packet.
+ */
+typedef struct
+{
+  PcapWriter_t Writer;
+  const char* Path;
+  bool Opened;
+  uint32_t LinkType;
+  uint64_t Mismatched; // packets of segments of the other link type
+  char* ErrorMessage;
+} QueryOutput_t;
+
+static int ParseFlow(const char* protocol, const char* source, const char* destination, StorageQuery_t* q);
+static int ParseEndpoint(const char* value, uint32_t* address, uint16_t* port);
+static int ParseTime(const char* value, uint64_t* ns);
+static int OpenOutput(QueryOutput_t* output, uint32_t linkType);
+static void WritePacket(const PcapRecordHeader_t* header, const uint8_t* data, uint32_t linkType, void* args);
+
+int main(int argc, char** argv)
+{
+  QueryArgs_t args;
+  args.Directory = NULL;
+  args.Output = "-";
+  StorageQueryInit(&args.Query);
+  for (int i = 1; i < argc; ++i) {
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    bool valid = value != NULL;
+    if (valid && strcmp(argv[i], "-dir") == 0)
+      args.Directory = value;
+    else if (valid && strcmp(argv[i], "-o") == 0)
+      args.Output = value;
+    else if (valid && strcmp(argv[i], "-from") == 0)
+      valid = ParseTime(value, &args.Query.FromNs) == 0;
+    else if (valid && strcmp(argv[i], "-to") == 0)
+      valid = ParseTime(value, &args.Query.ToNs) == 0;
+    else if (strcmp(argv[i], "-flow") == 0 && i + 3 < argc) {
+      if (ParseFlow(argv[i + 1], argv[i + 2], argv[i + 3], &args.Query) < 0) {
+        fprintf(stderr,
+                "Invalid flow: '%s %s %s' (PROTO SRC_IP:PORT DST_IP:PORT).\n",
+                argv[i + 1],
+                argv[i + 2],
+                argv[i + 3]);
+        return 1;
+      }
+      i += 3;
+      continue;
+    } else
+      valid = false;
+    if (!valid) {
+      fprintf(stderr,
+              "Usage: netsniffer-query -dir DIR [-flow PROTO SRC_IP:PORT DST_IP:PORT] [-from SEC[.FRACTION]] "
+              "[-to SEC[.FRACTION]] [-o FILE|-]\n");
+      return 1;
+    }
+    ++i;
+  }
+  if (args.Directory == NULL) {
+    fprintf(stderr, "The storage directory is not specified (-dir DIR).\n");
+    return 1;
+  }
+
+  // the pcap file is written to stdout by default, for example to 'tcpdump -r -'
+  QueryOutput_t output;
+  memset(&output, 0, sizeof(output));
+  output.Path = strcmp(args.Output, "-") == 0 ? "/dev/stdout" : args.Output;
+
+  char* error = NULL;
+  StorageQueryStats_t stats;
+  uint64_t start = GetMonotonicTimeUs();
+  int rc = StorageQueryRun(args.Directory, &args.Query, WritePacket, &output, &stats, &error);
+  uint64_t durationUs = GetMonotonicTimeUs() - start;
+  if (rc == 0 && !output.Opened)
+    OpenOutput(&output, PCAP_LINKTYPE_RAW);
+  if (rc == 0 && output.ErrorMessage != NULL) {
+    FormatStringBuffer(&error, "%s", output.ErrorMessage);
+    rc = -1;
+  }
+  if (output.Opened && PcapWriterClose(&output.Writer) < 0 && rc == 0) {
+    FormatStringBuffer(&error, "Cannot write the pcap file '%s'.", output.Path);
+    rc = -1;
+  }
+  free(output.ErrorMessage);
+  if (rc < 0) {
+    fprintf(stderr, "%s\n", error);
+    free(error);
+    return 1;
+  }
+  if (output.Mismatched > 0)
+    fprintf(stderr,
+            "%" PRIu64 " packets are not written, their segments have the other link type (-eth).\n",
+            output.Mismatched);
+
+  fprintf(stderr,
+          "%" PRIu64 " packets from %" PRIu64 " segments (%" PRIu64 " indexed, %" PRIu64 " scanned, %" PRIu64
+          " outside the time range), %" PRIu64 " packets read in %.1f ms.\n",
+          stats.Packets,
+          stats.Segments,
+          stats.IndexedSegments,
+          stats.ScannedSegments,
+          stats.SkippedSegments,
+          stats.ReadPackets,
+          (double) durationUs / 1e3);
+  if (stats.DecompressedBlocks > 0)
+    fprintf(stderr, "%" PRIu64 " blocks of compressed segments are decompressed.\n", stats.DecompressedBlocks);
+  return 0;
+}
+
+int ParseFlow(const char* protocol, const char* source, const char* destination, StorageQuery_t* q)
+{
+  if (strcmp(protocol, "tcp") == 0)
+    q->Protocol = Protocol_TCP;
+  else if (strcmp(protocol, "udp") == 0)
+    q->Protocol = Protocol_UDP;
+  else if (strcmp(protocol, "icmp") == 0)
+    q->Protocol = Protocol_ICMP;
+  else
+    return -1;
+
+  if (ParseEndpoint(source, &q->SourceAddress, &q->SourcePort) < 0 ||
+      ParseEndpoint(destination, &q->DestinationAddress, &q->DestinationPort) < 0)
+    return -1;
+  q->HasFlow = true;
+  return 0;
+}
+
+int ParseEndpoint(const char* value, uint32_t* address, uint16_t* port)
+{
+  char* ip = NULL;
+  char* error = NULL;
+  int parsedPort = 0;
+  int rc = ParseAddressString(value, &ip, &parsedPort, &error) == 0 && inet_pton(AF_INET, ip, address) == 1 &&
+                   parsedPort >= 0 && parsedPort <= UINT16_MAX
+               ? 0
+               : -1;
+  *port = (uint16_t) parsedPort;
+  free(ip);
+  free(error);
+  return rc;
+}
+
+int ParseTime(const char* value, uint64_t* ns)
+{
+  // seconds of the epoch with the optional fraction
+  char* endptr = NULL;
+  unsigned long long sec = strtoull(value, &endptr, 10);
+  if (endptr == value || *value == '-' || sec > UINT64_MAX / 1000000000ULL - 1)
+    return -1;
+
+  uint64_t fraction = 0;
+  if (*endptr == '.') {
+    const char* digit = endptr + 1;
+    int digits = 0;
+    for (; *digit >= '0' && *digit <= '9'; ++digit, ++digits)
+      if (digits < QUERY_NANOSECONDS_DIGITS)
+        fraction = fraction * 10 + (uint64_t) (*digit - '0');
+    for (; digits < QUERY_NANOSECONDS_DIGITS; ++digits)
+      fraction *= 10;
+    endptr = (char*) digit;
+  }
+  if (*endptr != '\0')
+    return -1;
+  *ns = (uint64_t) sec * 1000000000ULL + fraction;
+  return 0;
+}
+
+int OpenOutput(QueryOutput_t* output, uint32_t linkType)
+{
+  if (PcapWriterOpen(&output->Writer, output->Path, linkType) < 0) {
+    FormatStringBuffer(&output->ErrorMessage, "%s", output->Writer.ErrorMessage);
+    PcapWriterClose(&output->Writer);
+    return -1;
+  }
+  output->Opened = true;
+  output->LinkType = linkType;
+  return 0;
+}
+
+void WritePacket(const PcapRecordHeader_t* header, const uint8_t* data, uint32_t linkType, void* args)
+{
+  QueryOutput_t* output = (QueryOutput_t*) args;
+  if (output->ErrorMessage != NULL || (!output->Opened && OpenOutput(output, linkType) < 0))
+    return;
+  if (linkType != output->LinkType) {
+    output->Mismatched++;
+    return;
+  }
+
+  // packets truncated by the capture keep their original length
+  PcapWriterWriteRecord(&output->Writer, header, data);
+}
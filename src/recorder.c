@@ -0,0 +1,275 @@
+#include "recorder.h"
+#include "pcap.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static size_t AlignRecord(size_t size);
+static void Dump(FlightRecorder_t* r, uint64_t head, uint64_t triggerSec, const char* path);
+#ifdef __linux__
+static void* DumpThread(void* args);
+#endif
+
+void FlightRecorderInit(FlightRecorder_t* r, size_t size, uint64_t windowSec, uint32_t linkType)
+{
+  ASSERT("Cannot init the flight recorder ('FlightRecorder_t'): r == NULL.", r != NULL);
+
+  r->Packets = 0;
+  r->Overwritten = 0;
+  r->Truncated = 0;
+  r->Triggers = 0;
+  r->Dumps = 0;
+  r->ErrorMessage = NULL;
+  // records never cross the end of the arena, its size is a multiple of their alignment
+  r->__size = (size < RECORDER_MIN_SIZE ? RECORDER_MIN_SIZE : size) / RECORDER_RECORD_ALIGNMENT *
+              RECORDER_RECORD_ALIGNMENT;
+  r->__arena = malloc(r->__size);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", r->__arena != NULL);
+  r->__windowSec = windowSec;
+  r->__linkType = linkType;
+  atomic_init(&r->__head, 0);
+  atomic_init(&r->__tail, 0);
+  r->__handler = NULL;
+  r->__handlerArgs = NULL;
+  r->__pending = false;
+  r->__running = false;
+  r->__triggerHead = 0;
+  r->__triggerSec = 0;
+  r->__dumpPath[0] = '\0';
+#ifdef __linux__
+  pthread_mutex_init(&r->__mutex, NULL);
+  pthread_cond_init(&r->__triggered, NULL);
+#endif
+}
+
+void FlightRecorderSetDumpHandler(FlightRecorder_t* r, RecorderDumpHandler_t handler, void* args)
+{
+  r->__handler = handler;
+  r->__handlerArgs = args;
+}
+
+int FlightRecorderStart(FlightRecorder_t* r)
+{
+#ifdef __linux__
+  r->__running = true;
+  int rc = pthread_create(&r->__dumpThread, NULL, DumpThread, r);
+  if (rc != 0) {
+    r->__running = false;
+    FormatStringBuffer(&r->ErrorMessage, "Cannot start the dump thread of the flight recorder: %s", strerror(rc));
+    return -1;
+  }
+  return 0;
+#else
+  FormatStringBuffer(&r->ErrorMessage, "The flight recorder is only available on Linux.");
+  return -1;
+#endif
+}
+
+void FlightRecorderAdd(FlightRecorder_t* r, const uint8_t* data, size_t size, const TimeInfo_t* time)
+{
+  size_t captured = size;
+  if (captured > PCAP_SNAPSHOT_LENGTH) {
+    captured = PCAP_SNAPSHOT_LENGTH;
+    r->Truncated++;
+  }
+  size_t recordSize = AlignRecord(sizeof(RecorderRecord_t) + captured);
+  // the capture thread is the only writer of positions
+  uint64_t head = atomic_load_explicit(&r->__head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&r->__tail, memory_order_relaxed);
+  size_t offset = (size_t) (head % r->__size);
+  size_t padding = offset + recordSize > r->__size ? r->__size - offset : 0;
+  uint64_t end = head + padding + recordSize;
+
+  if (end - tail > r->__size) {
+    while (end - tail > r->__size) {
+      const RecorderRecord_t* oldest = (const RecorderRecord_t*) (r->__arena + tail % r->__size);
+      r->Overwritten += oldest->PacketSize > 0;
+      tail += oldest->Size;
+    }
+    // the dump thread checks the tail after it copies the record, the tail is stored before bytes are overwritten
+    atomic_store_explicit(&r->__tail, tail, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+  }
+
+  if (padding > 0) {
+    RecorderRecord_t* pad = (RecorderRecord_t*) (r->__arena + offset);
+    pad->Size = (uint32_t) padding;
+    pad->PacketSize = 0;
+    offset = 0;
+  }
+  RecorderRecord_t* record = (RecorderRecord_t*) (r->__arena + offset);
+  record->Size = (uint32_t) recordSize;
+  record->PacketSize = (uint32_t) captured;
+  record->TimestampSec = (uint32_t) time->TimestampSec;
+  record->TimestampNanosec = time->TimestampNanosec;
+  memcpy(r->__arena + offset + sizeof(RecorderRecord_t), data, captured);
+  atomic_store_explicit(&r->__head, end, memory_order_release);
+  r->Packets++;
+}
+
+bool FlightRecorderTrigger(FlightRecorder_t* r, const char* path)
+{
+#ifdef __linux__
+  // only the raw time is taken by the trigger, the default name of the dump is formatted by the dump thread
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  pthread_mutex_lock(&r->__mutex);
+  r->Triggers++;
+  bool scheduled = r->__running && !r->__pending;
+  if (scheduled) {
+    r->__pending = true;
+    r->__triggerHead = atomic_load_explicit(&r->__head, memory_order_acquire);
+    r->__triggerSec = (uint64_t) now.tv_sec;
+    if (path != NULL)
+      snprintf(r->__dumpPath, sizeof(r->__dumpPath), "%s", path);
+    else
+      r->__dumpPath[0] = '\0';
+    pthread_cond_signal(&r->__triggered);
+  }
+  pthread_mutex_unlock(&r->__mutex);
+  return scheduled;
+#else
+  (void) r;
+  (void) path;
+  return false;
+#endif
+}
+
+void FlightRecorderStop(FlightRecorder_t* r)
+{
+  if (r == NULL)
+    return;
+
+#ifdef __linux__
+  pthread_mutex_lock(&r->__mutex);
+  bool running = r->__running;
+  r->__running = false;
+  pthread_cond_signal(&r->__triggered);
+  pthread_mutex_unlock(&r->__mutex);
+  if (running)
+    pthread_join(r->__dumpThread, NULL);
+#endif
+}
+
+void FlightRecorderClear(FlightRecorder_t* r)
+{
+  if (r == NULL)
+    return;
+
+  FlightRecorderStop(r);
+#ifdef __linux__
+  pthread_cond_destroy(&r->__triggered);
+  pthread_mutex_destroy(&r->__mutex);
+#endif
+  free(r->__arena);
+  r->__arena = NULL;
+  free(r->ErrorMessage);
+  r->ErrorMessage = NULL;
+}
+
+size_t AlignRecord(size_t size)
+{
+  return (size + RECORDER_RECORD_ALIGNMENT - 1) / RECORDER_RECORD_ALIGNMENT * RECORDER_RECORD_ALIGNMENT;
+}
+
+void Dump(FlightRecorder_t* r, uint64_t head, uint64_t triggerSec, const char* path)
+{
+  uint64_t startUs = GetMonotonicTimeUs();
+  RecorderDump_t dump;
+  memset(&dump, 0, sizeof(dump));
+  dump.Path = path;
+
+  PcapWriter_t writer;
+  if (PcapWriterOpen(&writer, path, r->__linkType) < 0) {
+    dump.Error = writer.ErrorMessage;
+    if (r->__handler != NULL)
+      r->__handler(&dump, r->__handlerArgs);
+    PcapWriterClose(&writer);
+    return;
+  }
+
+  // one packet is copied at a time, the capture thread may overwrite it while it is copied
+  uint8_t* packet = malloc(sizeof(RecorderRecord_t) + PCAP_SNAPSHOT_LENGTH);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", packet != NULL);
+  uint64_t position = atomic_load_explicit(&r->__tail, memory_order_acquire);
+  while (position < head) {
+    size_t offset = (size_t) (position % r->__size);
+    RecorderRecord_t record;
+    memcpy(&record, r->__arena + offset, sizeof(record));
+    bool valid = record.Size >= sizeof(RecorderRecord_t) && record.Size % RECORDER_RECORD_ALIGNMENT == 0 &&
+                 offset + record.Size <= r->__size && record.PacketSize <= record.Size - sizeof(RecorderRecord_t);
+    if (valid && record.PacketSize > 0)
+      memcpy(packet, r->__arena + offset + sizeof(RecorderRecord_t), record.PacketSize);
+
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&r->__tail, memory_order_relaxed);
+    if (tail > position) {
+      // the record is overwritten, the tail is the oldest complete record
+      dump.Skipped += record.PacketSize > 0;
+      position = tail;
+      continue;
+    }
+    if (!valid)
+      break;
+
+    if (record.PacketSize > 0 && (r->__windowSec == 0 || record.TimestampSec + r->__windowSec >= triggerSec)) {
+      TimeInfo_t time;
+      memset(&time, 0, sizeof(time));
+      time.TimestampSec = record.TimestampSec;
+      time.TimestampNanosec = record.TimestampNanosec;
+      if (PcapWriterWrite(&writer, packet, record.PacketSize, &time) == 0)
+        dump.Packets++;
+    }
+    position += record.Size;
+  }
+  free(packet);
+
+  if (PcapWriterClose(&writer) < 0)
+    dump.Error = "Cannot write the pcap file.";
+  dump.DurationUs = GetMonotonicTimeUs() - startUs;
+  if (r->__handler != NULL)
+    r->__handler(&dump, r->__handlerArgs);
+}
+
+#ifdef __linux__
+void* DumpThread(void* args)
+{
+  FlightRecorder_t* r = (FlightRecorder_t*) args;
+
+  char path[RECORDER_PATH_MAX_SIZE];
+  pthread_mutex_lock(&r->__mutex);
+  while (true) {
+    // the pending dump is written before the thread stops
+    while (r->__running && !r->__pending)
+      pthread_cond_wait(&r->__triggered, &r->__mutex);
+    if (!r->__pending)
+      break;
+    uint64_t head = r->__triggerHead;
+    uint64_t triggerSec = r->__triggerSec;
+    uint64_t number = r->Dumps + 1;
+    memcpy(path, r->__dumpPath, sizeof(path));
+    pthread_mutex_unlock(&r->__mutex);
+
+    if (path[0] == '\0') {
+      struct tm local;
+      time_t sec = (time_t) triggerSec;
+      localtime_r(&sec, &local);
+      char stamp[32];
+      strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+      snprintf(path, sizeof(path), "%s-%s-%llu.pcap", RECORDER_DEFAULT_PREFIX, stamp, (unsigned long long) number);
+    }
+
+    Dump(r, head, triggerSec, path);
+
+    pthread_mutex_lock(&r->__mutex);
+    r->Dumps++;
+    r->__pending = false;
+  }
+  pthread_mutex_unlock(&r->__mutex);
+  return NULL;
+}
+#endif
@@ -0,0 +1,140 @@
+#ifndef __RECORDER_H
+#define __RECORDER_H
+
+#include "structures.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#define RECORDER_MIN_SIZE (1024 * 1024)
+#define RECORDER_MAX_SIZE (16ULL * 1024 * 1024 * 1024)
+#define RECORDER_DEFAULT_SIZE (64 * 1024 * 1024)
+#define RECORDER_RECORD_ALIGNMENT 16
+#define RECORDER_PATH_MAX_SIZE 1024
+#define RECORDER_DEFAULT_PREFIX "netsniffer-flight"
+
+/**
+ * @brief RecorderRecord_t
+ * The header of the packet in the arena. The record with the zero packet size pads the end of the arena.
+ */
+typedef struct
+{
+  uint32_t Size;       //! Bytes to the next record (aligned to RECORDER_RECORD_ALIGNMENT)
+  uint32_t PacketSize; //! Bytes of the packet after the header (0 for the padding)
+  uint32_t TimestampSec;
+  uint32_t TimestampNanosec;
+} RecorderRecord_t;
+
+/**
+ * @brief RecorderDump_t
+ * The result of the dump, passed to the dump handler.
+ */
+typedef struct
+{
+  const char* Path;    //! The pcap file
+  uint64_t Packets;    //! Written packets
+  uint64_t Skipped;    //! Overwritten by the capture while they were written (the oldest packets)
+  uint64_t DurationUs; //! Time of the dump
+  const char* Error;   //! NULL if the dump is written
+} RecorderDump_t;
+
+typedef void (*RecorderDumpHandler_t)(const RecorderDump_t* dump, void* args);
+
+/**
+ * @brief FlightRecorder_t
+ * Keeps the latest captured packets in the fixed circular arena of variable-length records, the oldest records are
+ * overwritten. Nothing is allocated per packet. The trigger schedules the dump of the arena to the pcap file, it is
+ * written by the dump thread while the capture thread keeps recording: records overwritten during the dump are
+ * detected by the tail position (like the seqlock) and skipped. Triggers are coalesced while the dump is pending. The
+ * dump thread is only available on Linux.
+ */
+typedef struct
+{
+  uint64_t Packets;     //! Recorded packets
+  uint64_t Overwritten; //! Packets overwritten by newer packets
+  uint64_t Truncated;   //! Packets truncated to PCAP_SNAPSHOT_LENGTH bytes
+  uint64_t Triggers;    //! Triggers, including coalesced (changed by the dump thread, read after the stop)
+  uint64_t Dumps;       //! Written dumps (changed by the dump thread, read after the stop)
+  char* ErrorMessage;   //! Error messages
+  // private fields
+  uint8_t* __arena;
+  size_t __size;
+  uint64_t __windowSec; // 0 - the whole arena is dumped
+  uint32_t __linkType;
+  atomic_uint_fast64_t __head; // logical positions, the record is at position % size
+  atomic_uint_fast64_t __tail; // the oldest record, moved before its bytes are overwritten
+  RecorderDumpHandler_t __handler;
+  void* __handlerArgs;
+  bool __pending; // the dump is scheduled or written
+  bool __running;
+  uint64_t __triggerHead;
+  uint64_t __triggerSec;
+  char __dumpPath[RECORDER_PATH_MAX_SIZE]; // empty - the default name is formatted by the dump thread
+#ifdef __linux__
+  pthread_t __dumpThread;
+  pthread_mutex_t __mutex;
+  pthread_cond_t __triggered;
+#endif
+} FlightRecorder_t;
+
+/**
+ * @brief FlightRecorderInit
+ * Initializes values for the new flight recorder object and allocates the arena.
+ * @param r The pointer to the flight recorder object
+ * @param size The size of the arena (RECORDER_MIN_SIZE - RECORDER_MAX_SIZE)
+ * @param windowSec Only packets of the last seconds before the trigger are dumped (0 - all recorded packets)
+ * @param linkType The link type of dumps (PCAP_LINKTYPE_ETHERNET or PCAP_LINKTYPE_RAW)
+ */
+void FlightRecorderInit(FlightRecorder_t* r, size_t size, uint64_t windowSec, uint32_t linkType);
+/**
+ * @brief FlightRecorderSetDumpHandler
+ * Sets the handler called by the dump thread after each dump.
+ * @param r The pointer to the flight recorder object
+ * @param handler The handler
+ * @param args Argument of the handler
+ */
+void FlightRecorderSetDumpHandler(FlightRecorder_t* r, RecorderDumpHandler_t handler, void* args);
+/**
+ * @brief FlightRecorderStart
+ * Starts the dump thread.
+ * @param r The pointer to the flight recorder object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int FlightRecorderStart(FlightRecorder_t* r);
+/**
+ * @brief FlightRecorderAdd
+ * Appends the packet (truncated to PCAP_SNAPSHOT_LENGTH bytes), overwrites the oldest packets if the arena is full.
+ * Only the capture thread calls it, it never waits.
+ * @param r The pointer to the flight recorder object
+ * @param data The packet
+ * @param size The size of the packet
+ * @param time Time of the capture
+ */
+void FlightRecorderAdd(FlightRecorder_t* r, const uint8_t* data, size_t size, const TimeInfo_t* time);
+/**
+ * @brief FlightRecorderTrigger
+ * Schedules the dump of packets recorded before the call. It is called from any thread, but not from signal handlers.
+ * @param r The pointer to the flight recorder object
+ * @param path The pcap file (NULL - RECORDER_DEFAULT_PREFIX with the time of the trigger in the working directory)
+ * @return false if the previous dump is not written yet (the trigger is coalesced with it) or the thread is stopped.
+ */
+bool FlightRecorderTrigger(FlightRecorder_t* r, const char* path);
+/**
+ * @brief FlightRecorderStop
+ * Writes the pending dump and stops the dump thread.
+ * @param r The pointer to the flight recorder object
+ */
+void FlightRecorderStop(FlightRecorder_t* r);
+/**
+ * @brief FlightRecorderClear
+ * Clears the passed flight recorder object.
+ * @param r The pointer to the flight recorder object
+ */
+void FlightRecorderClear(FlightRecorder_t* r);
+
+#endif // __RECORDER_H
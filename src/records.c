@@ -0,0 +1,230 @@
+#include "records.h"
+#include "printing.h"
+#include "profile.h"
+
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#elif _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+static void Append(JsonWriter_t* w, const char* data, size_t size);
+static void AppendKey(JsonWriter_t* w, const char* key);
+static void AppendAddress(JsonWriter_t* w, const char* key, uint32_t address);
+
+void JsonWriterInit(JsonWriter_t* w, char* buffer, size_t size)
+{
+  w->Buffer = buffer;
+  w->Size = size;
+  w->Length = 0;
+  w->Overflowed = size == 0;
+  w->__first = true;
+}
+
+void JsonBeginObject(JsonWriter_t* w)
+{
+  Append(w, "{", 1);
+  w->__first = true;
+}
+
+void JsonEndObject(JsonWriter_t* w)
+{
+  Append(w, "}", 1);
+  if (w->Length < w->Size)
+    w->Buffer[w->Length] = '\0';
+  else
+    w->Overflowed = true;
+}
+
+void JsonAddString(JsonWriter_t* w, const char* key, const char* value)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  AppendKey(w, key);
+  Append(w, "\"", 1);
+  for (const char* c = value; *c != '\0'; ++c) {
+    uint8_t ch = (uint8_t) *c;
+    if (ch == '"' || ch == '\\') {
+      char escaped[2] = {'\\', (char) ch};
+      Append(w, escaped, 2);
+    } else if (ch < 0x20 || ch >= 0x7F) {
+      char escaped[6] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0x0F]};
+      Append(w, escaped, 6);
+    } else {
+      Append(w, c, 1);
+    }
+  }
+  Append(w, "\"", 1);
+}
+
+void JsonAddUnsigned(JsonWriter_t* w, const char* key, uint64_t value)
+{
+  char digits[20];
+  size_t count = 0;
+  do {
+    digits[sizeof(digits) - ++count] = (char) ('0' + value % 10);
+    value /= 10;
+  } while (value > 0);
+
+  AppendKey(w, key);
+  Append(w, digits + sizeof(digits) - count, count);
+}
+
+void JsonAddHex(JsonWriter_t* w, const char* key, const uint8_t* data, size_t size)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  AppendKey(w, key);
+  Append(w, "\"", 1);
+  if (w->Length + size * 2 > w->Size) {
+    w->Overflowed = true;
+    return;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    w->Buffer[w->Length++] = hex[data[i] >> 4];
+    w->Buffer[w->Length++] = hex[data[i] & 0x0F];
+  }
+  Append(w, "\"", 1);
+}
+
+void PacketRecordStreamHeaderInit(PacketRecordStreamHeader_t* h)
+{
+  memcpy(h->Magic, PACKET_RECORD_MAGIC, sizeof(h->Magic));
+  h->ByteOrderMark = PACKET_RECORD_BYTE_ORDER_MARK;
+  h->Version = PACKET_RECORD_VERSION;
+  h->RecordHeaderSize = sizeof(PacketRecord_t);
+  h->Reserved = 0;
+}
+
+void PacketRecordInit(
+    PacketRecord_t* r, const PacketView_t* view, const TimeInfo_t* t, ChecksumStatus_t checksum, size_t maxPayload)
+{
+  memset(r, 0, sizeof(PacketRecord_t));
+  r->HeaderSize = sizeof(PacketRecord_t);
+  r->Protocol = view->Protocol;
+  r->TCPFlags = view->TCPFlags;
+  r->TimestampUs = TimeInfoToMicroseconds(t);
+  r->SourceAddress = view->SourceAddress;
+  r->DestinationAddress = view->DestinationAddress;
+  r->SourcePort = view->SourcePort;
+  r->DestinationPort = view->DestinationPort;
+  r->SequenceNumber = view->SequenceNumber;
+  r->AckNumber = view->AckNumber;
+  r->WindowSize = view->WindowSize;
+  r->PacketSize = (uint16_t) view->PacketSize;
+  r->PayloadSize = (uint16_t) view->PayloadSize;
+  r->CapturedSize = (uint16_t) (view->PayloadSize < maxPayload ? view->PayloadSize : maxPayload);
+  r->TTL = view->IPHeader != NULL ? view->IPHeader->TTL : 0;
+  r->ChecksumStatus = (uint8_t) checksum;
+  if (view->Protocol == Protocol_ICMP && view->IPHeader != NULL) {
+    const ICMPHeader_t* icmphdr = GetICMPHeader((Buffer_t) view->IPHeader);
+    r->ICMPType = icmphdr->Type;
+    r->ICMPCode = icmphdr->Code;
+  }
+
+  size_t length = sizeof(PacketRecord_t) + r->CapturedSize;
+  r->Length = (uint32_t) ((length + PACKET_RECORD_ALIGNMENT - 1) / PACKET_RECORD_ALIGNMENT * PACKET_RECORD_ALIGNMENT);
+}
+
+size_t PacketRecordToJson(const PacketRecord_t* r, const uint8_t* payload, const char* sni, char* buffer,
+                          size_t bufferSize)
+{
+  PROFILE_START(formatStart);
+  JsonWriter_t w;
+  JsonWriterInit(&w, buffer, bufferSize);
+  JsonBeginObject(&w);
+  JsonAddUnsigned(&w, "ts_us", r->TimestampUs);
+  switch (r->Protocol) {
+  case Protocol_TCP:
+    JsonAddString(&w, "proto", "TCP");
+    break;
+  case Protocol_UDP:
+    JsonAddString(&w, "proto", "UDP");
+    break;
+  case Protocol_ICMP:
+    JsonAddString(&w, "proto", "ICMP");
+    break;
+  default:
+    JsonAddUnsigned(&w, "proto", r->Protocol);
+    break;
+  }
+  AppendAddress(&w, "src", r->SourceAddress);
+  AppendAddress(&w, "dst", r->DestinationAddress);
+  if (r->Protocol == Protocol_TCP || r->Protocol == Protocol_UDP) {
+    JsonAddUnsigned(&w, "sport", r->SourcePort);
+    JsonAddUnsigned(&w, "dport", r->DestinationPort);
+  }
+  JsonAddUnsigned(&w, "len", r->PacketSize);
+  JsonAddUnsigned(&w, "ttl", r->TTL);
+  if (r->Protocol == Protocol_TCP) {
+    char flags[TCP_FLAGS_STRING_MAX_SIZE];
+    PrintTCPFlags(r->TCPFlags, flags);
+    JsonAddString(&w, "flags", flags);
+    JsonAddUnsigned(&w, "seq", r->SequenceNumber);
+    JsonAddUnsigned(&w, "ack", r->AckNumber);
+    JsonAddUnsigned(&w, "win", r->WindowSize);
+  } else if (r->Protocol == Protocol_ICMP) {
+    JsonAddUnsigned(&w, "icmp_type", r->ICMPType);
+    JsonAddUnsigned(&w, "icmp_code", r->ICMPCode);
+  }
+  JsonAddUnsigned(&w, "payload_len", r->PayloadSize);
+  if (r->ChecksumStatus != ChecksumStatus_NOT_CHECKED)
+    JsonAddString(&w, "checksum", ChecksumStatusToString((ChecksumStatus_t) r->ChecksumStatus));
+  if (sni != NULL)
+    JsonAddString(&w, "sni", sni);
+  if (r->CapturedSize > 0)
+    JsonAddHex(&w, "payload", payload, r->CapturedSize);
+  JsonEndObject(&w);
+  Append(&w, "\n", 1);
+  PROFILE_STOP(ProfileStage_FORMAT, formatStart);
+
+  if (w.Overflowed || w.Length >= bufferSize)
+    return 0;
+  buffer[w.Length] = '\0';
+  return w.Length;
+}
+
+const PacketRecord_t* PacketRecordNext(const uint8_t* data, size_t size, size_t* offset)
+{
+  if (*offset + sizeof(PacketRecord_t) > size)
+    return NULL;
+
+  const PacketRecord_t* r = (const PacketRecord_t*) (const void*) (data + *offset);
+  if (r->HeaderSize < sizeof(PacketRecord_t) || r->Length < r->HeaderSize + (size_t) r->CapturedSize ||
+      r->Length % PACKET_RECORD_ALIGNMENT != 0 || *offset + r->Length > size)
+    return NULL;
+
+  *offset += r->Length;
+  return r;
+}
+
+void Append(JsonWriter_t* w, const char* data, size_t size)
+{
+  if (w->Overflowed || w->Length + size > w->Size) {
+    w->Overflowed = true;
+    return;
+  }
+  memcpy(w->Buffer + w->Length, data, size);
+  w->Length += size;
+}
+
+void AppendKey(JsonWriter_t* w, const char* key)
+{
+  if (!w->__first)
+    Append(w, ",", 1);
+  w->__first = false;
+
+  Append(w, "\"", 1);
+  Append(w, key, strlen(key));
+  Append(w, "\":", 2);
+}
+
+void AppendAddress(JsonWriter_t* w, const char* key, uint32_t address)
+{
+  char ip[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &address, ip, sizeof(ip));
+  JsonAddString(w, key, ip);
+}
@@ -0,0 +1,159 @@
+#ifndef __RECORDS_H
+#define __RECORDS_H
+
+#include "structures.h"
+#include "checksum.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACKET_RECORD_VERSION 1
+#define PACKET_RECORD_ALIGNMENT 8
+#define PACKET_RECORD_MAGIC "NSPR"
+#define PACKET_RECORD_BYTE_ORDER_MARK 0x01020304
+#define PACKET_RECORD_JSON_BUFFER_SUFFICIENT_SIZE (2048 /* fields and the escaped SNI */ + 65536 * 2 /* payload */)
+
+/**
+ * @brief PacketRecordStreamHeader_t
+ * The header of the binary stream, written once before records. Numbers are in the byte order of the writer, the
+ * consumer detects it by ByteOrderMark.
+ */
+typedef struct
+{
+  char Magic[4];             //! PACKET_RECORD_MAGIC
+  uint32_t ByteOrderMark;    //! PACKET_RECORD_BYTE_ORDER_MARK
+  uint16_t Version;          //! PACKET_RECORD_VERSION
+  uint16_t RecordHeaderSize; //! sizeof(PacketRecord_t)
+  uint32_t Reserved;
+} PacketRecordStreamHeader_t;
+
+/**
+ * @brief PacketRecord_t
+ * The fixed-layout header of the binary packet record. The captured payload follows the header, the record is padded
+ * to PACKET_RECORD_ALIGNMENT bytes, so records can be walked in the mapped file by Length. Addresses are in the network
+ * byte order, other numbers are in the byte order of the stream.
+ */
+typedef struct
+{
+  uint32_t Length;             //! Size of the record: the header, the payload and the padding
+  uint16_t HeaderSize;         //! sizeof(PacketRecord_t)
+  uint8_t Protocol;            //! Protocol number value
+  uint8_t TCPFlags;            //! TCP flags (see TCPFlag_t)
+  uint64_t TimestampUs;        //! Capture time (microseconds since the epoch)
+  uint32_t SourceAddress;      //! Source IP (network byte order)
+  uint32_t DestinationAddress; //! Destination IP (network byte order)
+  uint16_t SourcePort;         //! Source port (TCP, UDP)
+  uint16_t DestinationPort;    //! Destination port (TCP, UDP)
+  uint32_t SequenceNumber;     //! TCP sequence number
+  uint32_t AckNumber;          //! TCP acknowledgment number
+  uint16_t WindowSize;         //! TCP window size
+  uint16_t PacketSize;         //! IP total length
+  uint16_t PayloadSize;        //! Size of the protocol payload in the packet
+  uint16_t CapturedSize;       //! Bytes of the payload after the header
+  uint8_t TTL;                 //! IP time to live
+  uint8_t ChecksumStatus;      //! See ChecksumStatus_t
+  uint8_t ICMPType;            //! ICMP type
+  uint8_t ICMPCode;            //! ICMP code
+} PacketRecord_t;
+
+/**
+ * @brief JsonWriter_t
+ * Writes the JSON object to the fixed buffer without allocations.
+ */
+typedef struct
+{
+  char* Buffer;
+  size_t Size;     //! The size of the buffer
+  size_t Length;   //! The length of the written JSON
+  bool Overflowed; //! The buffer was too small, the JSON is incomplete
+  // private fields
+  bool __first;
+} JsonWriter_t;
+
+/**
+ * @brief JsonWriterInit
+ * Initializes values for the new writer object.
+ * @param w The pointer to the writer object
+ * @param buffer The buffer for the JSON
+ * @param size The size of the buffer
+ */
+void JsonWriterInit(JsonWriter_t* w, char* buffer, size_t size);
+/**
+ * @brief JsonBeginObject
+ * Writes the beginning of the object.
+ * @param w The pointer to the writer object
+ */
+void JsonBeginObject(JsonWriter_t* w);
+/**
+ * @brief JsonEndObject
+ * Writes the end of the object and the terminating null.
+ * @param w The pointer to the writer object
+ */
+void JsonEndObject(JsonWriter_t* w);
+/**
+ * @brief JsonAddString
+ * Writes the string member. Quotes, backslashes, control and not ASCII characters are escaped.
+ * @param w The pointer to the writer object
+ * @param key The member name (not escaped)
+ * @param value The value
+ */
+void JsonAddString(JsonWriter_t* w, const char* key, const char* value);
+/**
+ * @brief JsonAddUnsigned
+ * Writes the number member.
+ * @param w The pointer to the writer object
+ * @param key The member name (not escaped)
+ * @param value The value
+ */
+void JsonAddUnsigned(JsonWriter_t* w, const char* key, uint64_t value);
+/**
+ * @brief JsonAddHex
+ * Writes the data as the hex string member.
+ * @param w The pointer to the writer object
+ * @param key The member name (not escaped)
+ * @param data The data
+ * @param size The size of the data
+ */
+void JsonAddHex(JsonWriter_t* w, const char* key, const uint8_t* data, size_t size);
+
+/**
+ * @brief PacketRecordStreamHeaderInit
+ * Initializes the header of the binary stream.
+ * @param h The pointer to the header
+ */
+void PacketRecordStreamHeaderInit(PacketRecordStreamHeader_t* h);
+/**
+ * @brief PacketRecordInit
+ * Fills the record header from the decoded packet.
+ * @param r The pointer to the record
+ * @param view The decoded packet
+ * @param t The capture time
+ * @param checksum The checksum status of the packet
+ * @param maxPayload Max bytes of the payload in the record
+ */
+void PacketRecordInit(
+    PacketRecord_t* r, const PacketView_t* view, const TimeInfo_t* t, ChecksumStatus_t checksum, size_t maxPayload);
+/**
+ * @brief PacketRecordToJson
+ * Formats the record as the JSON line.
+ * @param r The pointer to the record
+ * @param payload The captured payload (r->CapturedSize bytes)
+ * @param sni The TLS server name of the flow (NULL if unknown)
+ * @param buffer The buffer for the line
+ * @param bufferSize The size of the buffer
+ * @return The length of the line (0 if the buffer is too small).
+ */
+size_t PacketRecordToJson(const PacketRecord_t* r, const uint8_t* payload, const char* sni, char* buffer,
+                          size_t bufferSize);
+/**
+ * @brief PacketRecordNext
+ * Returns the record at the offset in the binary stream (without the stream header) and moves the offset to the next
+ * record.
+ * @param data The records
+ * @param size The size of the records
+ * @param offset The offset of the record (aligned to PACKET_RECORD_ALIGNMENT)
+ * @return The pointer to the record or NULL if there are no more complete records.
+ */
+const PacketRecord_t* PacketRecordNext(const uint8_t* data, size_t size, size_t* offset);
+
+#endif // __RECORDS_H
@@ -0,0 +1,561 @@
+#include "rules.h"
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif _WIN32
+#include <ws2tcpip.h>
+#endif
+
+#define RULES_INITIAL_CAPACITY 1024
+#define RULES_READER_OFFLINE UINT64_MAX
+
+typedef struct
+{
+  uint32_t IP;
+  uint32_t Index;
+} RuleKey_t;
+
+static int CompileTable(RuleTable_t* t);
+static int CompareRuleKeys(const void* a, const void* b);
+static size_t HashIP(uint32_t ip);
+static const uint32_t* FindIPGroup(const RuleTable_t* t, uint32_t ip, uint32_t* count);
+static bool MatchRule(const Rule_t* rule, uint8_t protocol, uint16_t port, Direction_t direction);
+static bool EqualRules(const Rule_t* a, const Rule_t* b);
+static RuleTable_t* CopyTable(const RuleTable_t* t, size_t extra);
+static void CopyCounters(RuleTable_t* t, size_t first, const RuleTable_t* source, size_t sourceFirst, size_t count);
+static void SwapTable(RuleSet_t* s, RuleTable_t* table);
+static void LockWriter(RuleSet_t* s);
+static void UnlockWriter(RuleSet_t* s);
+
+RuleTable_t* RuleTableLoad(const char* path, char** error)
+{
+  uint64_t startNs = GetMonotonicTimeNs();
+  RuleTable_t* t = NULL;
+#ifdef __linux__
+  int fd = open(path, O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) < 0) {
+    FormatStringBuffer(error, "Cannot open the rules file '%s': %s", path, GetLastErrorMessage());
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  size_t size = (size_t) info.st_size;
+  if (size == 0) {
+    close(fd);
+    t = RuleTableParse("", 0, error);
+  } else {
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      FormatStringBuffer(error, "Cannot map the rules file '%s': %s", path, GetLastErrorMessage());
+      return NULL;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    t = RuleTableParse((const char*) data, size, error);
+    munmap(data, size);
+  }
+#elif _WIN32
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    FormatStringBuffer(error, "Cannot open the rules file '%s': %s", path, GetLastErrorMessage());
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  size_t size = (size_t) ftell(file);
+  fseek(file, 0, SEEK_SET);
+  char* data = malloc(size + 1);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", data != NULL);
+  size = fread(data, 1, size, file);
+  fclose(file);
+  t = RuleTableParse(data, size, error);
+  free(data);
+#endif
+  if (t == NULL)
+    return NULL;
+
+  size_t pathSize = strlen(path) + 1;
+  t->Path = malloc(pathSize);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", t->Path != NULL);
+  memcpy(t->Path, path, pathSize);
+  t->LoadNs = GetMonotonicTimeNs() - startNs;
+  return t;
+}
+
+RuleTable_t* RuleTableParse(const char* data, size_t size, char** error)
+{
+  RuleTable_t* t = calloc(1, sizeof(RuleTable_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", t != NULL);
+  size_t capacity = RULES_INITIAL_CAPACITY;
+  t->Rules = malloc(capacity * sizeof(Rule_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", t->Rules != NULL);
+
+  const char* end = data + size;
+  for (const char* line = data; line < end;) {
+    const char* next = memchr(line, '\n', (size_t) (end - line));
+    size_t length = (size_t) ((next != NULL ? next : end) - line);
+    t->Lines++;
+
+    Rule_t rule;
+    int parsed = RuleParse(line, length, &rule, error);
+    if (parsed < 0) {
+      char* reason = *error;
+      *error = NULL;
+      FormatStringBuffer(error, "Invalid rule at the line %zu: %s", t->Lines, reason);
+      free(reason);
+      RuleTableDelete(t);
+      return NULL;
+    }
+    if (parsed > 0) {
+      if (t->Count >= RULES_MAX_COUNT) {
+        FormatStringBuffer(error, "Max rules count: %d.", RULES_MAX_COUNT);
+        RuleTableDelete(t);
+        return NULL;
+      }
+      if (t->Count == capacity) {
+        capacity *= 2;
+        t->Rules = realloc(t->Rules, capacity * sizeof(Rule_t));
+        ASSERT("Cannot initialize a new buffer: realloc returned 'NULL'.", t->Rules != NULL);
+      }
+      t->Rules[t->Count++] = rule;
+    }
+    line = next != NULL ? next + 1 : end;
+  }
+
+  if (CompileTable(t) < 0) {
+    FormatStringBuffer(error, "Cannot compile the rules table.");
+    RuleTableDelete(t);
+    return NULL;
+  }
+  return t;
+}
+
+size_t RuleToString(const Rule_t* rule, char* buffer, size_t bufferSize)
+{
+  char ip[IP_MAX_SIZE] = "any";
+  if (!rule->AnyIP)
+    inet_ntop(AF_INET, &rule->IP, ip, sizeof(ip));
+  const char* direction = rule->Direction == Direction_SOURCE        ? "src "
+                          : rule->Direction == Direction_DESTINATION ? "dst "
+                                                                     : "";
+  const char* protocol = rule->Protocol == Protocol_TCP    ? "tcp "
+                         : rule->Protocol == Protocol_UDP  ? "udp "
+                         : rule->Protocol == Protocol_ICMP ? "icmp "
+                                                           : "";
+  int length = snprintf(buffer, bufferSize, "%s%s%s:%u", direction, protocol, ip, (unsigned int) rule->Port);
+  if (length < 0)
+    return 0;
+  return (size_t) length < bufferSize ? (size_t) length : bufferSize - 1;
+}
+
+int64_t RuleTableMatch(const RuleTable_t* t,
+                       uint8_t protocol,
+                       uint32_t sourceIP,
+                       uint16_t sourcePort,
+                       uint32_t destIP,
+                       uint16_t destPort,
+                       Direction_t* direction)
+{
+  // indexes of each group are in the order of the file, the first match of the group is its best rule
+  uint64_t best = UINT64_MAX;
+  uint32_t count;
+  const uint32_t* group = FindIPGroup(t, sourceIP, &count);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (MatchRule(&t->Rules[group[i]], protocol, sourcePort, Direction_SOURCE)) {
+      best = group[i];
+      *direction = Direction_SOURCE;
+      break;
+    }
+  }
+  group = FindIPGroup(t, destIP, &count);
+  for (uint32_t i = 0; i < count && group[i] < best; ++i) {
+    if (MatchRule(&t->Rules[group[i]], protocol, destPort, Direction_DESTINATION)) {
+      best = group[i];
+      *direction = Direction_DESTINATION;
+      break;
+    }
+  }
+  for (size_t i = 0; i < t->__anyIPCount && t->__anyIP[i] < best; ++i) {
+    const Rule_t* rule = &t->Rules[t->__anyIP[i]];
+    if (MatchRule(rule, protocol, sourcePort, Direction_SOURCE) ||
+        MatchRule(rule, protocol, destPort, Direction_DESTINATION)) {
+      best = t->__anyIP[i];
+      *direction = MatchRule(rule, protocol, sourcePort, Direction_SOURCE) ? Direction_SOURCE : Direction_DESTINATION;
+      break;
+    }
+  }
+  return best == UINT64_MAX ? -1 : (int64_t) best;
+}
+
+void RuleTableDelete(RuleTable_t* t)
+{
+  if (t == NULL)
+    return;
+
+  free(t->Rules);
+  free(t->Counters);
+  free(t->Path);
+  free(t->__byIP);
+  free(t->__slots);
+  free(t->__anyIP);
+  free(t);
+}
+
+void RuleSetInit(RuleSet_t* s, RuleTable_t* table)
+{
+  s->Swaps = 0;
+  s->Reclaims = 0;
+  atomic_init(&s->__current, table);
+  atomic_init(&s->__epoch, 1);
+  for (int i = 0; i < RULES_READERS_MAX; ++i)
+    atomic_init(&s->__readers[i], RULES_READER_OFFLINE);
+  atomic_init(&s->__readersCount, 0);
+  s->__retired = NULL;
+  atomic_flag_clear(&s->__writer);
+  if (table != NULL)
+    table->Version = 1;
+}
+
+int RuleSetAddReader(RuleSet_t* s)
+{
+  // slots of removed readers are claimed again, the count only covers slots used so far
+  for (size_t i = 0; i < RULES_READERS_MAX; ++i) {
+    uint_fast64_t offline = RULES_READER_OFFLINE;
+    if (atomic_load(&s->__readers[i]) != offline)
+      continue;
+
+    // the count is raised before the claim, so reclaims scan the slot once the epoch is stored
+    size_t count = atomic_load(&s->__readersCount);
+    while (count < i + 1 && !atomic_compare_exchange_weak(&s->__readersCount, &count, i + 1))
+      ;
+    if (atomic_compare_exchange_strong(&s->__readers[i], &offline, atomic_load(&s->__epoch)))
+      return (int) i;
+  }
+  return -1;
+}
+
+void RuleSetRemoveReader(RuleSet_t* s, int reader)
+{
+  atomic_store(&s->__readers[reader], RULES_READER_OFFLINE);
+}
+
+void RuleSetQuiescent(RuleSet_t* s, int reader)
+{
+  // tables retired before the epoch are not used by the reader anymore, the store is skipped without swaps
+  uint64_t epoch = atomic_load(&s->__epoch);
+  if (atomic_load_explicit(&s->__readers[reader], memory_order_relaxed) != epoch)
+    atomic_store(&s->__readers[reader], epoch);
+}
+
+void RuleSetSwap(RuleSet_t* s, RuleTable_t* table)
+{
+  LockWriter(s);
+  SwapTable(s, table);
+  UnlockWriter(s);
+}
+
+uint64_t RuleSetAddRule(RuleSet_t* s, const Rule_t* rule)
+{
+  LockWriter(s);
+  const RuleTable_t* current = RuleSetCurrent(s);
+  if (current != NULL && current->Count >= RULES_MAX_COUNT) {
+    UnlockWriter(s);
+    return 0;
+  }
+
+  RuleTable_t* t = CopyTable(current, 1);
+  t->Rules[t->Count++] = *rule;
+  CompileTable(t);
+  CopyCounters(t, 0, current, 0, t->Count - 1);
+  SwapTable(s, t);
+  uint64_t version = t->Version; // the table can be replaced and reclaimed after the unlock
+  UnlockWriter(s);
+  return version;
+}
+
+uint64_t RuleSetRemoveRule(RuleSet_t* s, const Rule_t* rule)
+{
+  LockWriter(s);
+  const RuleTable_t* current = RuleSetCurrent(s);
+  size_t index = 0;
+  while (current != NULL && index < current->Count && !EqualRules(&current->Rules[index], rule))
+    ++index;
+  if (current == NULL || index == current->Count) {
+    UnlockWriter(s);
+    return 0;
+  }
+
+  RuleTable_t* t = CopyTable(current, 0);
+  memmove(&t->Rules[index], &t->Rules[index + 1], (t->Count - index - 1) * sizeof(Rule_t));
+  t->Count--;
+  CompileTable(t);
+  CopyCounters(t, 0, current, 0, index);
+  CopyCounters(t, index, current, index + 1, t->Count - index);
+  SwapTable(s, t);
+  uint64_t version = t->Version; // the table can be replaced and reclaimed after the unlock
+  UnlockWriter(s);
+  return version;
+}
+
+size_t RuleSetReclaim(RuleSet_t* s)
+{
+  LockWriter(s);
+  uint64_t seen = RULES_READER_OFFLINE;
+  size_t readers = atomic_load(&s->__readersCount);
+  for (size_t i = 0; i < readers && i < RULES_READERS_MAX; ++i) {
+    uint64_t epoch = atomic_load(&s->__readers[i]);
+    if (epoch < seen)
+      seen = epoch;
+  }
+
+  size_t waiting = 0;
+  RuleTable_t** link = &s->__retired;
+  while (*link != NULL) {
+    RuleTable_t* t = *link;
+    if (t->__retiredEpoch <= seen) {
+      *link = t->__nextRetired;
+      RuleTableDelete(t);
+      s->Reclaims++;
+    } else {
+      link = &t->__nextRetired;
+      waiting++;
+    }
+  }
+  UnlockWriter(s);
+  return waiting;
+}
+
+void RuleSetClear(RuleSet_t* s)
+{
+  while (s->__retired != NULL) {
+    RuleTable_t* next = s->__retired->__nextRetired;
+    RuleTableDelete(s->__retired);
+    s->__retired = next;
+  }
+  RuleTableDelete(atomic_exchange(&s->__current, NULL));
+}
+
+int RuleParse(const char* line, size_t length, Rule_t* rule, char** error)
+{
+  memset(rule, 0, sizeof(Rule_t));
+  rule->Protocol = Protocol_ANY;
+  rule->Direction = Direction_ANY;
+  bool hasAddress = false;
+  bool hasTokens = false;
+
+  size_t i = 0;
+  while (i < length) {
+    while (i < length && (line[i] == ' ' || line[i] == '\t' || line[i] == '\r'))
+      ++i;
+    if (i == length || line[i] == '#')
+      break;
+    size_t start = i;
+    hasTokens = true;
+    while (i < length && line[i] != ' ' && line[i] != '\t' && line[i] != '\r')
+      ++i;
+
+    char token[RULES_LINE_MAX_SIZE];
+    size_t tokenSize = i - start;
+    if (tokenSize >= sizeof(token)) {
+      FormatStringBuffer(error, "the token is too long.");
+      return -1;
+    }
+    memcpy(token, line + start, tokenSize);
+    token[tokenSize] = '\0';
+
+    char* colon = strchr(token, ':');
+    if (colon != NULL) {
+      if (hasAddress) {
+        FormatStringBuffer(error, "only one address is allowed per line.");
+        return -1;
+      }
+      *colon = '\0';
+      char* portEnd;
+      long port = strtol(colon + 1, &portEnd, 10);
+      if (*portEnd != '\0' || colon[1] == '\0' || port < 0 || port > 65535) {
+        FormatStringBuffer(error, "invalid port '%s'.", colon + 1);
+        return -1;
+      }
+      rule->Port = (uint16_t) port;
+      if (strcmp(token, "any") == 0)
+        rule->AnyIP = true;
+      else if (inet_pton(AF_INET, token, &rule->IP) != 1) {
+        FormatStringBuffer(error, "invalid IP '%s'.", token);
+        return -1;
+      }
+      hasAddress = true;
+    } else if (hasAddress) {
+      FormatStringBuffer(error, "filter options must precede the address.");
+      return -1;
+    } else if (strcmp(token, "src") == 0)
+      rule->Direction = Direction_SOURCE;
+    else if (strcmp(token, "dst") == 0)
+      rule->Direction = Direction_DESTINATION;
+    else if (strcmp(token, "tcp") == 0)
+      rule->Protocol = Protocol_TCP;
+    else if (strcmp(token, "udp") == 0)
+      rule->Protocol = Protocol_UDP;
+    else if (strcmp(token, "icmp") == 0)
+      rule->Protocol = Protocol_ICMP;
+    else {
+      // server names are matched by the TLS tracker of the sniffer, its patterns are fixed after the start
+      FormatStringBuffer(error, "invalid filter option '%s' (src, dst, tcp, udp or icmp).", token);
+      return -1;
+    }
+  }
+
+  if (!hasTokens)
+    return 0; // an empty line or the comment
+  if (!hasAddress) {
+    FormatStringBuffer(error, "no address 'IP:PORT'.");
+    return -1;
+  }
+  return 1;
+}
+
+int CompileTable(RuleTable_t* t)
+{
+  t->Counters = calloc(t->Count > 0 ? t->Count : 1, sizeof(RuleCounter_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", t->Counters != NULL);
+  RuleKey_t* keys = malloc((t->Count > 0 ? t->Count : 1) * sizeof(RuleKey_t));
+  t->__anyIP = malloc((t->Count > 0 ? t->Count : 1) * sizeof(uint32_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", keys != NULL && t->__anyIP != NULL);
+
+  size_t keysCount = 0;
+  for (size_t i = 0; i < t->Count; ++i) {
+    if (t->Rules[i].AnyIP)
+      t->__anyIP[t->__anyIPCount++] = (uint32_t) i;
+    else {
+      keys[keysCount].IP = t->Rules[i].IP;
+      keys[keysCount++].Index = (uint32_t) i;
+    }
+  }
+  // groups of the same IP keep the order of the file
+  qsort(keys, keysCount, sizeof(RuleKey_t), CompareRuleKeys);
+
+  size_t groups = 0;
+  for (size_t i = 0; i < keysCount; ++i)
+    groups += i == 0 || keys[i].IP != keys[i - 1].IP;
+  size_t slots = 16;
+  while (slots < groups * 2)
+    slots *= 2;
+  t->__slotsMask = slots - 1;
+  t->__slots = calloc(slots * 3, sizeof(uint32_t));
+  t->__byIP = malloc((keysCount > 0 ? keysCount : 1) * sizeof(uint32_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", t->__slots != NULL && t->__byIP != NULL);
+
+  for (size_t i = 0; i < keysCount;) {
+    size_t first = i;
+    for (; i < keysCount && keys[i].IP == keys[first].IP; ++i)
+      t->__byIP[i] = keys[i].Index;
+
+    size_t slot = HashIP(keys[first].IP) & t->__slotsMask;
+    while (t->__slots[slot * 3 + 2] != 0)
+      slot = (slot + 1) & t->__slotsMask;
+    t->__slots[slot * 3] = keys[first].IP;
+    t->__slots[slot * 3 + 1] = (uint32_t) first;
+    t->__slots[slot * 3 + 2] = (uint32_t) (i - first);
+  }
+  free(keys);
+  return 0;
+}
+
+int CompareRuleKeys(const void* a, const void* b)
+{
+  const RuleKey_t* left = (const RuleKey_t*) a;
+  const RuleKey_t* right = (const RuleKey_t*) b;
+  if (left->IP != right->IP)
+    return left->IP < right->IP ? -1 : 1;
+  return left->Index < right->Index ? -1 : (left->Index > right->Index);
+}
+
+size_t HashIP(uint32_t ip)
+{
+  return (size_t) (((uint64_t) ip * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+const uint32_t* FindIPGroup(const RuleTable_t* t, uint32_t ip, uint32_t* count)
+{
+  size_t slot = HashIP(ip) & t->__slotsMask;
+  // empty slots have no rules
+  while (t->__slots[slot * 3 + 2] != 0) {
+    if (t->__slots[slot * 3] == ip) {
+      *count = t->__slots[slot * 3 + 2];
+      return &t->__byIP[t->__slots[slot * 3 + 1]];
+    }
+    slot = (slot + 1) & t->__slotsMask;
+  }
+  *count = 0;
+  return NULL;
+}
+
+bool MatchRule(const Rule_t* rule, uint8_t protocol, uint16_t port, Direction_t direction)
+{
+  return (rule->Protocol == Protocol_ANY || rule->Protocol == protocol) &&
+         (rule->Direction == Direction_ANY || rule->Direction == direction) && (rule->Port == 0 || rule->Port == port);
+}
+
+bool EqualRules(const Rule_t* a, const Rule_t* b)
+{
+  return a->IP == b->IP && a->Port == b->Port && a->AnyIP == b->AnyIP && a->Protocol == b->Protocol &&
+         a->Direction == b->Direction;
+}
+
+RuleTable_t* CopyTable(const RuleTable_t* t, size_t extra)
+{
+  size_t count = t != NULL ? t->Count : 0;
+  RuleTable_t* copy = calloc(1, sizeof(RuleTable_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", copy != NULL);
+  copy->Rules = malloc((count + extra > 0 ? count + extra : 1) * sizeof(Rule_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", copy->Rules != NULL);
+  if (count > 0)
+    memcpy(copy->Rules, t->Rules, count * sizeof(Rule_t));
+  copy->Count = count;
+  copy->Lines = t != NULL ? t->Lines : 0;
+  return copy;
+}
+
+void CopyCounters(RuleTable_t* t, size_t first, const RuleTable_t* source, size_t sourceFirst, size_t count)
+{
+  // packets counted by readers of the source table after the copy are not moved
+  for (size_t i = 0; i < count; ++i) {
+    RuleCounter_t* from = &source->Counters[sourceFirst + i];
+    atomic_init(&t->Counters[first + i].Packets, atomic_load_explicit(&from->Packets, memory_order_relaxed));
+    atomic_init(&t->Counters[first + i].Bytes, atomic_load_explicit(&from->Bytes, memory_order_relaxed));
+  }
+}
+
+void SwapTable(RuleSet_t* s, RuleTable_t* table)
+{
+  // the writer lock is held, so the table is not replaced by others; readers see the version with the table
+  RuleTable_t* previous = atomic_load(&s->__current);
+  table->Version = previous != NULL ? previous->Version + 1 : 1;
+  atomic_store(&s->__current, table);
+  if (previous == NULL)
+    return;
+  // readers that have seen the new epoch load the new table
+  previous->__retiredEpoch = atomic_fetch_add(&s->__epoch, 1) + 1;
+  previous->__nextRetired = s->__retired;
+  s->__retired = previous;
+  s->Swaps++;
+}
+
+void LockWriter(RuleSet_t* s)
+{
+  while (atomic_flag_test_and_set_explicit(&s->__writer, memory_order_acquire))
+    ;
+}
+
+void UnlockWriter(RuleSet_t* s)
+{
+  atomic_flag_clear_explicit(&s->__writer, memory_order_release);
+}
@@ -0,0 +1,236 @@
+#ifndef __RULES_H
+#define __RULES_H
+
+#include "structures.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RULES_MAX_COUNT 4000000
+#define RULES_READERS_MAX 16
+#define RULES_LINE_MAX_SIZE 512
+#define RULE_STRING_MAX_SIZE 64
+
+/**
+ * @brief Rule_t
+ * The compiled rule. The syntax of the rule in the file is the syntax of the address in the command line: filter
+ * options followed by 'IP:PORT', for example 'src tcp 10.0.0.1:443'. 'any' matches any IP, the port 0 matches any
+ * port.
+ */
+typedef struct
+{
+  uint32_t IP;           //! IPv4 address (network byte order, 0 if AnyIP)
+  uint16_t Port;         //! Port (0 matches any port)
+  bool AnyIP;            //! Any IP is matched
+  Protocol_t Protocol;   //! Protocol of the packet
+  Direction_t Direction; //! The address is the source, the destination or both
+} Rule_t;
+
+/**
+ * @brief RuleCounter_t
+ * Packets and bytes (of IP packets) matched by the rule. Counters are added by readers and read by other threads
+ * without locks.
+ */
+typedef struct
+{
+  atomic_uint_fast64_t Packets;
+  atomic_uint_fast64_t Bytes;
+} RuleCounter_t;
+
+/**
+ * @brief RuleTable_t
+ * The immutable table of rules loaded from the file. Rules are indexed by their IP, the packet is compared only with
+ * rules of its source and destination IPs and rules of any IP. The first matched rule of the file wins.
+ */
+typedef struct RuleTable_t
+{
+  Rule_t* Rules;            //! Rules in the order of the file
+  RuleCounter_t* Counters;  //! Counters of each rule (kept by RuleSetAddRule() and RuleSetRemoveRule())
+  size_t Count;             //! Rules count
+  size_t Lines;             //! Lines of the file (including comments and empty lines)
+  char* Path;               //! The file (NULL if the table is changed by RuleSetAddRule() or RuleSetRemoveRule())
+  uint64_t LoadNs;          //! Time of loading and compiling (nanoseconds)
+  uint64_t Version;         //! Incremented by each swap of the set, starts with 1
+  // private fields
+  uint32_t* __byIP;  // indexes of rules with the IP, grouped by the IP in the order of the file
+  uint32_t* __slots; // the hash table: the IP of the group (0 is empty), the first index and the count
+  size_t __slotsMask;
+  uint32_t* __anyIP; // indexes of rules of any IP
+  size_t __anyIPCount;
+  uint64_t __retiredEpoch;
+  struct RuleTable_t* __nextRetired;
+} RuleTable_t;
+
+/**
+ * @brief RuleSet_t
+ * The current rule table shared with capture threads. Readers never take a lock: they load the current table
+ * (RuleSetCurrent) and report a quiescent state (RuleSetQuiescent) when they hold no pointer to any table, for example
+ * between calls of SnifferProcessNextPacket(). Tables replaced by RuleSetSwap() are freed by RuleSetReclaim() after all
+ * readers pass a quiescent state. Writers (swaps, changes of rules and reclaims) are serialized by the spin lock, for
+ * example the reload of the file and commands of the control socket.
+ */
+typedef struct
+{
+  uint64_t Swaps;    //! Tables swapped in
+  uint64_t Reclaims; //! Replaced tables freed
+  // private fields
+  _Atomic(RuleTable_t*) __current;
+  atomic_uint_fast64_t __epoch;
+  atomic_uint_fast64_t __readers[RULES_READERS_MAX]; // the last epoch seen by each reader
+  atomic_size_t __readersCount; // slots used by readers, removed readers leave offline slots for the next ones
+  RuleTable_t* __retired;
+  atomic_flag __writer;
+} RuleSet_t;
+
+/**
+ * @brief RuleTableLoad
+ * Loads and compiles rules of the file, the file is memory-mapped. Empty lines and lines started with '#' are skipped.
+ * @param path The rules file
+ * @param error Error message with the line number (if occurred)
+ * @return The new table, or NULL if an error occurred.
+ */
+RuleTable_t* RuleTableLoad(const char* path, char** error);
+/**
+ * @brief RuleTableParse
+ * Compiles rules of the buffer (the content of the rules file).
+ * @param data The content of the file
+ * @param size The size of the content
+ * @param error Error message with the line number (if occurred)
+ * @return The new table, or NULL if an error occurred.
+ */
+RuleTable_t* RuleTableParse(const char* data, size_t size, char** error);
+/**
+ * @brief RuleParse
+ * Parses the rule of the line (without the line break).
+ * @param line The line
+ * @param length The length of the line
+ * @param rule The parsed rule
+ * @param error Error message (if occurred)
+ * @return -1 if an error occurred, 0 if the line is empty or the comment, otherwise 1.
+ */
+int RuleParse(const char* line, size_t length, Rule_t* rule, char** error);
+/**
+ * @brief RuleToString
+ * Formats the rule in the syntax of the file, for example 'src tcp 10.0.0.1:443'.
+ * @param rule The rule
+ * @param buffer The buffer (RULE_STRING_MAX_SIZE is sufficient)
+ * @param bufferSize The size of the buffer
+ * @return The length of the string.
+ */
+size_t RuleToString(const Rule_t* rule, char* buffer, size_t bufferSize);
+/**
+ * @brief RuleTableMatch
+ * Finds the first rule of the file that matches the packet.
+ * @param t The pointer to the table
+ * @param protocol The protocol of the packet
+ * @param sourceIP The source IP (network byte order)
+ * @param sourcePort The source port (0 if the protocol has no ports)
+ * @param destIP The destination IP (network byte order)
+ * @param destPort The destination port
+ * @param direction The matched address is the source or the destination (set by the function)
+ * @return Index of the matched rule, or -1 if no rule matches.
+ */
+int64_t RuleTableMatch(const RuleTable_t* t,
+                       uint8_t protocol,
+                       uint32_t sourceIP,
+                       uint16_t sourcePort,
+                       uint32_t destIP,
+                       uint16_t destPort,
+                       Direction_t* direction);
+/**
+ * @brief RuleTableCount
+ * Counts the packet matched by the rule.
+ * @param t The pointer to the table
+ * @param rule Index of the rule (returned by RuleTableMatch())
+ * @param size The size of the IP packet
+ */
+static inline void RuleTableCount(const RuleTable_t* t, size_t rule, size_t size)
+{
+  atomic_fetch_add_explicit(&t->Counters[rule].Packets, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&t->Counters[rule].Bytes, size, memory_order_relaxed);
+}
+/**
+ * @brief RuleTableDelete
+ * Frees the table.
+ * @param t The pointer to the table (may be NULL)
+ */
+void RuleTableDelete(RuleTable_t* t);
+
+/**
+ * @brief RuleSetInit
+ * Initializes values for the new rule set object.
+ * @param s The pointer to the rule set object
+ * @param table The first table (the set owns it)
+ */
+void RuleSetInit(RuleSet_t* s, RuleTable_t* table);
+/**
+ * @brief RuleSetAddReader
+ * Registers the reader of the set. Readers must report quiescent states, otherwise replaced tables are never freed.
+ * The slot of a removed reader is reused.
+ * @param s The pointer to the rule set object
+ * @return Index of the reader, or -1 if RULES_READERS_MAX readers are registered.
+ */
+int RuleSetAddReader(RuleSet_t* s);
+/**
+ * @brief RuleSetRemoveReader
+ * Unregisters the reader, its quiescent states are not waited for.
+ * @param s The pointer to the rule set object
+ * @param reader Index of the reader
+ */
+void RuleSetRemoveReader(RuleSet_t* s, int reader);
+/**
+ * @brief RuleSetCurrent
+ * @param s The pointer to the rule set object
+ * @return The current table, valid until the next quiescent state of the reader.
+ */
+static inline const RuleTable_t* RuleSetCurrent(RuleSet_t* s)
+{
+  return atomic_load_explicit(&s->__current, memory_order_acquire);
+}
+/**
+ * @brief RuleSetQuiescent
+ * Reports that the reader holds no pointer to tables loaded before the call.
+ * @param s The pointer to the rule set object
+ * @param reader Index of the reader
+ */
+void RuleSetQuiescent(RuleSet_t* s, int reader);
+/**
+ * @brief RuleSetSwap
+ * Replaces the current table. The replaced table is freed by RuleSetReclaim() after all readers pass a quiescent
+ * state.
+ * @param s The pointer to the rule set object
+ * @param table The new table (the set owns it)
+ */
+void RuleSetSwap(RuleSet_t* s, RuleTable_t* table);
+/**
+ * @brief RuleSetAddRule
+ * Swaps in the copy of the current table with the rule appended.
+ * @param s The pointer to the rule set object
+ * @param rule The rule
+ * @return The version of the new table, or 0 if the table has RULES_MAX_COUNT rules.
+ */
+uint64_t RuleSetAddRule(RuleSet_t* s, const Rule_t* rule);
+/**
+ * @brief RuleSetRemoveRule
+ * Swaps in the copy of the current table without the first rule equal to the passed rule.
+ * @param s The pointer to the rule set object
+ * @param rule The rule
+ * @return The version of the new table, or 0 if the rule is not found.
+ */
+uint64_t RuleSetRemoveRule(RuleSet_t* s, const Rule_t* rule);
+/**
+ * @brief RuleSetReclaim
+ * Frees replaced tables that are not used by readers.
+ * @param s The pointer to the rule set object
+ * @return Tables that are still waiting for readers.
+ */
+size_t RuleSetReclaim(RuleSet_t* s);
+/**
+ * @brief RuleSetClear
+ * Frees all tables. Readers must be stopped.
+ * @param s The pointer to the rule set object
+ */
+void RuleSetClear(RuleSet_t* s);
+
+#endif // __RULES_H
@@ -0,0 +1,84 @@
+#include "sampling.h"
+
+#include <string.h>
+
+#define TOKEN_SCALE 1000000
+
+static uint64_t NextRandom(Sampler_t* s);
+
+void SamplerInit(Sampler_t* s, uint64_t flows, uint64_t every, uint64_t random, uint64_t maxRate)
+{
+  memset(s, 0, sizeof(Sampler_t));
+  s->__flows = flows;
+  s->__every = every;
+  s->__random = random;
+  s->__randomState = 0x9E3779B97F4A7C15ULL;
+  s->__rate = maxRate;
+  s->__tokens = maxRate * TOKEN_SCALE;
+}
+
+bool SamplerEnabled(const Sampler_t* s)
+{
+  return s->__flows > 1 || s->__every > 1 || s->__random > 1 || s->__rate > 0;
+}
+
+bool SamplerPass(Sampler_t* s, const PacketView_t* view, uint64_t nowUs)
+{
+  if (s->LastReportUs == 0)
+    s->LastReportUs = nowUs; // the first report covers the time from the first packet
+  if (s->__flows > 1 && view != NULL && GetFlowHash(view) % s->__flows != 0) {
+    s->SuppressedByFlow++;
+    s->Suppressed++;
+    return false;
+  }
+  if (s->__every > 1 && s->__counter++ % s->__every != 0) {
+    s->SuppressedByCount++;
+    s->Suppressed++;
+    return false;
+  }
+  if (s->__random > 1 && NextRandom(s) % s->__random != 0) {
+    s->SuppressedByRandom++;
+    s->Suppressed++;
+    return false;
+  }
+  if (s->__rate > 0) {
+    // the bucket holds one second of packets, a token is refilled every 1/rate seconds
+    uint64_t capacity = s->__rate * TOKEN_SCALE;
+    if (s->__refillUs == 0)
+      s->__refillUs = nowUs;
+    uint64_t elapsedUs = nowUs - s->__refillUs;
+    uint64_t refill = elapsedUs < 1000000 ? elapsedUs * s->__rate : capacity;
+    s->__tokens = refill >= capacity - s->__tokens ? capacity : s->__tokens + refill;
+    s->__refillUs = nowUs;
+    if (s->__tokens < TOKEN_SCALE) {
+      s->SuppressedByRate++;
+      s->Suppressed++;
+      return false;
+    }
+    s->__tokens -= TOKEN_SCALE;
+  }
+
+  s->Passed++;
+  return true;
+}
+
+bool SamplerReportDue(const Sampler_t* s, uint64_t nowUs)
+{
+  return s->Suppressed != s->ReportedSuppressed && nowUs - s->LastReportUs >= SAMPLING_REPORT_INTERVAL_US;
+}
+
+void SamplerReportDone(Sampler_t* s, uint64_t nowUs)
+{
+  s->ReportedPassed = s->Passed;
+  s->ReportedSuppressed = s->Suppressed;
+  s->LastReportUs = nowUs;
+}
+
+uint64_t NextRandom(Sampler_t* s)
+{
+  // xorshift64*
+  s->__randomState ^= s->__randomState >> 12;
+  s->__randomState ^= s->__randomState << 25;
+  s->__randomState ^= s->__randomState >> 27;
+  return (s->__randomState * 0x2545F4914F6CDD1DULL) >> 32;
+}
@@ -0,0 +1,81 @@
+#ifndef __SAMPLING_H
+#define __SAMPLING_H
+
+#include "structures.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SAMPLING_REPORT_INTERVAL_US 1000000
+#define SAMPLING_REPORT_BUFFER_SUFFICIENT_SIZE 256
+
+/**
+ * @brief Sampler_t
+ * Selects packets for the output. Samplers are applied in order: per-flow (all or none packets of the flow),
+ * deterministic 1-in-N, probabilistic 1-in-N and the token bucket of printed packets per second. A disabled sampler
+ * passes all packets.
+ */
+typedef struct
+{
+  uint64_t Passed;             //! Packets passed to the output
+  uint64_t Suppressed;         //! Packets suppressed by all samplers
+  uint64_t SuppressedByFlow;   //! Packets of flows not selected by the flow hash
+  uint64_t SuppressedByCount;  //! Packets suppressed by the 1-in-N sampler
+  uint64_t SuppressedByRandom; //! Packets suppressed by the probabilistic sampler
+  uint64_t SuppressedByRate;   //! Packets over the rate limit
+  uint64_t ReportedPassed;     //! Passed packets at the last report
+  uint64_t ReportedSuppressed; //! Suppressed packets at the last report
+  uint64_t LastReportUs;       //! Time of the last report (monotonic clock)
+  // private fields
+  uint64_t __flows;
+  uint64_t __every;
+  uint64_t __counter;
+  uint64_t __random;
+  uint64_t __randomState;
+  uint64_t __rate;
+  uint64_t __tokens; // millionths of the packet
+  uint64_t __refillUs;
+} Sampler_t;
+
+/**
+ * @brief SamplerInit
+ * Initializes values for the new sampler object. 0 disables the corresponding sampler.
+ * @param s The pointer to the sampler object
+ * @param flows Keep 1 of N flows (by the hash of addresses, ports and the protocol)
+ * @param every Keep every N-th packet
+ * @param random Keep the packet with the probability 1/random
+ * @param maxRate Max packets per second (the burst is one second of packets)
+ */
+void SamplerInit(Sampler_t* s, uint64_t flows, uint64_t every, uint64_t random, uint64_t maxRate);
+/**
+ * @brief SamplerEnabled
+ * Checks if any sampler is enabled.
+ * @param s The pointer to the sampler object
+ * @return true if packets can be suppressed.
+ */
+bool SamplerEnabled(const Sampler_t* s);
+/**
+ * @brief SamplerPass
+ * Decides if the packet is passed to the output.
+ * @param s The pointer to the sampler object
+ * @param view The decoded packet (NULL if it is not decoded, then the flow sampler passes it)
+ * @param nowUs The current time (microseconds, monotonic clock)
+ * @return true if the packet is passed.
+ */
+bool SamplerPass(Sampler_t* s, const PacketView_t* view, uint64_t nowUs);
+/**
+ * @brief SamplerReportDue
+ * Checks if packets were suppressed since the last report and the report interval is over.
+ * @param s The pointer to the sampler object
+ * @param nowUs The current time (microseconds, monotonic clock)
+ * @return true if the report must be printed.
+ */
+bool SamplerReportDue(const Sampler_t* s, uint64_t nowUs);
+/**
+ * @brief SamplerReportDone
+ * Remembers counters of the printed report.
+ * @param s The pointer to the sampler object
+ * @param nowUs The current time (microseconds, monotonic clock)
+ */
+void SamplerReportDone(Sampler_t* s, uint64_t nowUs);
+
+#endif // __SAMPLING_H
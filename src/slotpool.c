@@ -0,0 +1,221 @@
+#include "slotpool.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+static void Lock(SlotPool_t* p);
+static void Unlock(SlotPool_t* p);
+static void Drain(SlotPool_t* p);
+#ifdef __linux__
+static void* WorkerThread(void* args);
+#endif
+
+void SlotPoolInit(SlotPool_t* p,
+                  size_t threads,
+                  size_t window,
+                  SlotPoolFunc_t process,
+                  SlotPoolFunc_t write,
+                  void* args)
+{
+  ASSERT("Cannot init pool ('SlotPool_t'): p == NULL.", p != NULL);
+
+  p->Jobs = 0;
+  p->Reordered = 0;
+  p->Stalls = 0;
+  p->StalledUs = 0;
+
+  p->__process = process;
+  p->__write = write;
+  p->__args = args;
+  p->__threadsCount = threads > SLOT_POOL_THREADS_MAX ? SLOT_POOL_THREADS_MAX : threads;
+  p->Window = window > p->__threadsCount ? window : p->__threadsCount;
+  if (p->Window == 0)
+    p->Window = 1;
+  p->__done = calloc(p->Window, sizeof(bool));
+  ASSERT("Cannot initialize a new buffer: calloc returned size '0'.", p->__done != NULL);
+  p->__submitted = 0;
+  p->__taken = 0;
+  p->__written = 0;
+  p->__draining = false;
+  p->__running = false;
+
+#ifdef __linux__
+  pthread_mutex_init(&p->__mutex, NULL);
+  pthread_cond_init(&p->__pendingCond, NULL);
+  pthread_cond_init(&p->__freeCond, NULL);
+#endif
+}
+
+int SlotPoolStart(SlotPool_t* p)
+{
+#ifdef __linux__
+  if (p->__threadsCount == 0)
+    return 0;
+
+  p->__running = true;
+  for (size_t i = 0; i < p->__threadsCount; ++i) {
+    p->__workers[i].Index = i;
+    p->__workers[i].Pool = p;
+    int rc = pthread_create(&p->__workers[i].Thread, NULL, WorkerThread, &p->__workers[i]);
+    if (rc != 0) {
+      // the started workers are enough to process slots
+      if (i > 0) {
+        p->__threadsCount = i;
+        return 0;
+      }
+      p->__running = false;
+      errno = rc;
+      return -1;
+    }
+  }
+#else
+  (void) p;
+#endif
+  return 0;
+}
+
+size_t SlotPoolAcquire(SlotPool_t* p)
+{
+#ifdef __linux__
+  if (p->__running) {
+    Lock(p);
+    if (p->__submitted - p->__written >= p->Window) {
+      uint64_t start = GetMonotonicTimeUs();
+      p->Stalls++;
+      while (p->__submitted - p->__written >= p->Window)
+        pthread_cond_wait(&p->__freeCond, &p->__mutex);
+      p->StalledUs += GetMonotonicTimeUs() - start;
+    }
+    Unlock(p);
+  }
+#endif
+  // the slot is not used by workers until it is submitted
+  return (size_t) (p->__submitted % p->Window);
+}
+
+void SlotPoolSubmit(SlotPool_t* p)
+{
+  size_t slot = (size_t) (p->__submitted % p->Window);
+  p->__done[slot] = false;
+
+#ifdef __linux__
+  if (p->__running) {
+    Lock(p);
+    p->__submitted++;
+    pthread_cond_signal(&p->__pendingCond);
+    Unlock(p);
+    return;
+  }
+#endif
+  p->__process(slot, 0, p->__args);
+  p->__write(slot, 0, p->__args);
+  p->Jobs++;
+  p->__submitted++;
+  p->__taken++;
+  p->__written++;
+}
+
+void SlotPoolStop(SlotPool_t* p)
+{
+#ifdef __linux__
+  if (p->__running) {
+    Lock(p);
+    p->__running = false;
+    pthread_cond_broadcast(&p->__pendingCond);
+    Unlock(p);
+    // workers write all submitted slots before they exit
+    for (size_t i = 0; i < p->__threadsCount; ++i)
+      pthread_join(p->__workers[i].Thread, NULL);
+  }
+#else
+  (void) p;
+#endif
+}
+
+void SlotPoolClear(SlotPool_t* p)
+{
+  if (p == NULL)
+    return;
+
+  free(p->__done);
+  p->__done = NULL;
+#ifdef __linux__
+  pthread_cond_destroy(&p->__freeCond);
+  pthread_cond_destroy(&p->__pendingCond);
+  pthread_mutex_destroy(&p->__mutex);
+#endif
+}
+
+void Lock(SlotPool_t* p)
+{
+#ifdef __linux__
+  pthread_mutex_lock(&p->__mutex);
+#else
+  (void) p;
+#endif
+}
+
+void Unlock(SlotPool_t* p)
+{
+#ifdef __linux__
+  pthread_mutex_unlock(&p->__mutex);
+#else
+  (void) p;
+#endif
+}
+
+void Drain(SlotPool_t* p)
+{
+  // only one worker writes, the others leave completed slots to it
+  if (p->__draining)
+    return;
+
+  p->__draining = true;
+  while (p->__written < p->__submitted && p->__done[p->__written % p->Window]) {
+    size_t slot = (size_t) (p->__written % p->Window);
+    Unlock(p);
+    p->__write(slot, 0, p->__args);
+    Lock(p);
+
+    p->__done[slot] = false;
+    p->__written++;
+#ifdef __linux__
+    pthread_cond_signal(&p->__freeCond);
+#endif
+  }
+  p->__draining = false;
+}
+
+#ifdef __linux__
+void* WorkerThread(void* args)
+{
+  struct SlotWorker_t* worker = (struct SlotWorker_t*) args;
+  SlotPool_t* p = (SlotPool_t*) worker->Pool;
+
+  Lock(p);
+  while (true) {
+    if (p->__taken == p->__submitted) {
+      if (!p->__running)
+        break;
+      pthread_cond_wait(&p->__pendingCond, &p->__mutex);
+      continue;
+    }
+
+    uint64_t sequence = p->__taken++;
+    size_t slot = (size_t) (sequence % p->Window);
+    Unlock(p);
+    p->__process(slot, worker->Index, p->__args);
+    Lock(p);
+
+    p->__done[slot] = true;
+    p->Jobs++;
+    if (sequence != p->__written)
+      p->Reordered++;
+    Drain(p);
+  }
+  Unlock(p);
+
+  return NULL;
+}
+#endif
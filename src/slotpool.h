@@ -0,0 +1,111 @@
+#ifndef __SLOTPOOL_H
+#define __SLOTPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#define SLOT_POOL_THREADS_MAX 64
+
+/**
+ * @brief SlotPoolFunc_t
+ * Processes or writes the slot of the window.
+ * @param slot The index of the slot (0 - Window - 1)
+ * @param worker The index of the worker thread (0 if the slot is processed by the producer)
+ * @param args The arguments passed to SlotPoolInit()
+ */
+typedef void (*SlotPoolFunc_t)(size_t slot, size_t worker, void* args);
+
+/**
+ * @brief SlotPool_t
+ * The reorder window of slots processed by worker threads and written in the order of submission. The producer fills
+ * the next slot, free workers take slots in order and the worker which completes the oldest slot writes all completed
+ * slots from it, so slots are written by one thread at a time. The window is bounded: the producer waits for a free
+ * slot if the oldest slot is still being processed. Data of slots is kept by the owner of the pool in arrays of Window
+ * entries.
+ */
+typedef struct
+{
+  uint64_t Jobs;      //! Processed slots
+  uint64_t Reordered; //! Slots completed while an older slot was not written (held in the window)
+  uint64_t Stalls;    //! Waits of the producer for a free slot of the window
+  uint64_t StalledUs; //! Time spent by the producer waiting for a free slot
+  size_t Window;      //! Slots of the window
+  // private fields
+  SlotPoolFunc_t __process;
+  SlotPoolFunc_t __write;
+  void* __args;
+  bool* __done; // the slot is processed and waits for the write
+  size_t __threadsCount;
+  uint64_t __submitted; // the next slot is __submitted % Window
+  uint64_t __taken;
+  uint64_t __written;
+  bool __draining;
+  bool __running;
+#ifdef __linux__
+  struct SlotWorker_t
+  {
+    pthread_t Thread;
+    size_t Index;
+    void* Pool;
+  } __workers[SLOT_POOL_THREADS_MAX];
+  pthread_mutex_t __mutex;
+  pthread_cond_t __pendingCond;
+  pthread_cond_t __freeCond;
+#endif
+} SlotPool_t;
+
+/**
+ * @brief SlotPoolInit
+ * Initializes values for the new pool object.
+ * @param p The pointer to the pool object
+ * @param threads The number of worker threads (0 - SLOT_POOL_THREADS_MAX)
+ * @param window The number of slots (at least threads)
+ * @param process Processes the slot, called by worker threads
+ * @param write Writes the processed slot, called in the order of submission
+ * @param args The arguments of both functions
+ */
+void SlotPoolInit(SlotPool_t* p,
+                  size_t threads,
+                  size_t window,
+                  SlotPoolFunc_t process,
+                  SlotPoolFunc_t write,
+                  void* args);
+/**
+ * @brief SlotPoolStart
+ * Starts worker threads. Without them (and on Windows) slots are processed and written by the producer.
+ * @param p The pointer to the pool object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int SlotPoolStart(SlotPool_t* p);
+/**
+ * @brief SlotPoolAcquire
+ * Returns the next slot. Waits if the window is full. Only one thread can submit slots.
+ * @param p The pointer to the pool object
+ * @return The index of the slot.
+ */
+size_t SlotPoolAcquire(SlotPool_t* p);
+/**
+ * @brief SlotPoolSubmit
+ * Submits the slot filled after SlotPoolAcquire().
+ * @param p The pointer to the pool object
+ */
+void SlotPoolSubmit(SlotPool_t* p);
+/**
+ * @brief SlotPoolStop
+ * Writes all submitted slots and stops worker threads.
+ * @param p The pointer to the pool object
+ */
+void SlotPoolStop(SlotPool_t* p);
+/**
+ * @brief SlotPoolClear
+ * Clears the passed pool object. The pool must be stopped.
+ * @param p The pointer to the pool object
+ */
+void SlotPoolClear(SlotPool_t* p);
+
+#endif // __SLOTPOOL_H
@@ -1,5 +1,6 @@
 #include "sniffer.h"
 #include "utils.h"
+#include "profile.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -9,9 +10,8 @@
 #ifdef __linux__
 #include <arpa/inet.h>
 #include <net/if.h>
-#include <net/if_packet.h>
 #include <net/ethernet.h>
-#include <netpacket/packet.h>
+#include <linux/if_packet.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -32,15 +32,24 @@
 
 #ifdef __linux__
 #define SOCKET_ERROR_CODE -1
+#define RECV_NONBLOCKING_FLAGS MSG_DONTWAIT
+typedef struct sockaddr_ll SocketAddress_t;
 static bool PromiscModeEnabled = false;
 #elif _WIN32
 #define SOCKET_ERROR_CODE SOCKET_ERROR
+#define RECV_NONBLOCKING_FLAGS 0 // the socket is non-blocking (FIONBIO)
+typedef struct sockaddr_in SocketAddress_t;
 static int WSAIoctlEnableMode = 1;
 static unsigned long WSAIoctlSupperss;
 #endif
 
 #define LOOPBACK_ADDRESS "127.0.0.1"
 
+static void ProcessTls(Sniffer_t* s, Buffer_t buffer, size_t size);
+static int64_t ReceiveFrame(Sniffer_t* s, int flags, SocketAddress_t* from, ChecksumHint_t* checksumHint);
+static int ProcessFrame(Sniffer_t* s, int64_t recvBytes, const SocketAddress_t* from, ChecksumHint_t checksumHint);
+static void AppendToBatch(Sniffer_t* s, Buffer_t buffer, size_t size, const TimeInfo_t* time);
+
 int SnifferInit(Sniffer_t* s, const char* iface, ProcessingPacketHandler_t handler, HandlerArgs_t args)
 {
   if (s == NULL)
@@ -50,12 +59,32 @@ int SnifferInit(Sniffer_t* s, const char* iface, ProcessingPacketHandler_t handl
     s->Addresses[i].Address.IP[0] = '\0';
     s->Addresses[i].Address.Port = 0;
     FilterInitDefaults(&s->Addresses[i].Filter);
+    s->Addresses[i].__sniPattern = -1;
   }
 
   s->AddressesCount = 0;
   strncpy(s->Interface, iface, IFACE_MAX_SIZE);
 
   s->ErrorMessage = NULL;
+  s->VerifyChecksums = false;
+  s->BadChecksumsOnly = false;
+  memset(&s->ChecksumStats, 0, sizeof(s->ChecksumStats));
+  memset(&s->Stats, 0, sizeof(s->Stats));
+  s->MatchedAddress = 0;
+  s->MatchedDirection = Direction_ANY;
+  s->ChecksumStatus = ChecksumStatus_NOT_CHECKED;
+  s->Tls = NULL;
+  s->Backend = SnifferBackend_AUTO;
+  s->Rules = NULL;
+  s->__rulesReader = -1;
+  s->__batchHandler = NULL;
+  s->__batch = NULL;
+  s->__batchData = NULL;
+  s->__batchCapacity = 0;
+  s->__batchCount = 0;
+  s->TlsEvent.ClientHelloDecoded = false;
+  s->TlsEvent.SNI = NULL;
+  s->TlsEvent.PatternMask = 0;
 
 #ifdef _WIN32
   if (WSAStartup(MAKEWORD(2, 2), &s->__wsadata) != NO_ERROR) {
@@ -138,12 +167,22 @@ int SnifferAddAddress(Sniffer_t* s, const char* addr, const Filter_t* filter)
     return -1;
 
   int currentIndex = s->AddressesCount++;
+  s->Addresses[currentIndex].__sniPattern = -1;
   strncpy(s->Addresses[currentIndex].Address.IP, ip, IP_MAX_SIZE);
   s->Addresses[currentIndex].Address.Port = (uint16_t) port;
   if (filter != NULL)
     memcpy(&s->Addresses[currentIndex].Filter, filter, sizeof(Filter_t));
-
   free(ip);
+
+  if (s->Addresses[currentIndex].Filter.SNI[0] != '\0') {
+    if (SnifferDecodeTls(s) < 0)
+      return -1;
+    if ((s->Addresses[currentIndex].__sniPattern =
+             TlsTrackerAddSNIPattern(s->Tls, s->Addresses[currentIndex].Filter.SNI)) < 0) {
+      FormatStringBuffer(&s->ErrorMessage, "Max SNI patterns count: %d.", TLS_SNI_PATTERNS_MAX_COUNT);
+      return -1;
+    }
+  }
   return 0;
 }
 
@@ -298,6 +337,10 @@ int SnifferProcessNextPacket(Sniffer_t* s)
     return -1;
   }
 
+  // tables of rules loaded by previous calls are not used anymore
+  if (s->Rules != NULL)
+    RuleSetQuiescent(s->Rules, s->__rulesReader);
+
   memset(s->__buf, 0, ETH_MAX_PACKET_SIZE);
 
   fd_set input;
@@ -315,160 +358,282 @@ int SnifferProcessNextPacket(Sniffer_t* s)
       return 0;
   }
   }
+  SocketAddress_t from;
+  memset(&from, 0, sizeof(from));
+  ChecksumHint_t checksumHint;
+  int64_t recvBytes = ReceiveFrame(s, 0, &from, &checksumHint);
+  if (recvBytes > 0 && ProcessFrame(s, recvBytes, &from, checksumHint) < 0)
+    return -1;
+
+  if (s->__batchHandler != NULL) {
+    // frames already queued in the socket are added to the batch without waiting
+    for (size_t i = 1; recvBytes > 0 && i < s->__batchCapacity; ++i) {
+      recvBytes = ReceiveFrame(s, RECV_NONBLOCKING_FLAGS, &from, &checksumHint);
+      if (recvBytes > 0 && ProcessFrame(s, recvBytes, &from, checksumHint) < 0)
+        return -1;
+    }
+    if (s->__batchCount > 0) {
+      PROFILE_START(handlerStart);
+      s->__batchHandler(s, s->__batch, s->__batchCount, s->__args);
+      PROFILE_STOP(ProfileStage_HANDLER, handlerStart);
+      s->__batchCount = 0;
+    }
+  }
+
+  if (s->__running && recvBytes < 0 && errno != EAGAIN /* finish timeout */
+      && errno != EWOULDBLOCK) {
+    FormatStringBuffer(&s->ErrorMessage, "recvfrom(..): %s", GetLastErrorMessage());
+    return -1;
+  }
+  return 0;
+}
+bool SnifferMatchAddress(Sniffer_t* s,
+                         Buffer_t buffer,
+                         size_t size,
+                         const char* sourceIP,
+                         int sourcePort,
+                         const char* destIP,
+                         int destPort,
+                         bool* tlsProcessed)
+{
+  IPHeader_t* iphdr = GetIPHeader(buffer);
+  for (int i = 0; i < s->AddressesCount; ++i) {
+    if (s->Addresses[i].Filter.Protocol != iphdr->Protocol && s->Addresses[i].Filter.Protocol != Protocol_ANY)
+      continue;
+
+    bool matched = false;
+    Direction_t direction = Direction_ANY;
+
+    if (s->Addresses[i].Filter.Direction == Direction_ANY || s->Addresses[i].Filter.Direction == Direction_SOURCE) {
+      if (( // if specified any address, ip was found. We received any packet with any direction
+              (strcmp(s->Addresses[i].Address.IP, "any") == 0) //
+              || // compare source ip with the specified ip, find direction
+              (strcmp(s->Addresses[i].Address.IP, sourceIP) == 0))
+          // compare the source port and the specified port
+          && (s->Addresses[i].Address.Port == 0 || s->Addresses[i].Address.Port == sourcePort)) //
+      {
+        matched = true;
+        direction = Direction_SOURCE;
+      }
+    }
+
+    if (!matched && (s->Addresses[i].Filter.Direction == Direction_ANY ||
+                     s->Addresses[i].Filter.Direction == Direction_DESTINATION)) {
+      if (( // if specified any address, ip was found. We received any packet with any direction
+              (strcmp(s->Addresses[i].Address.IP, "any") == 0) //
+              || // compare dest ip with the specified ip, find direction
+              (strcmp(s->Addresses[i].Address.IP, destIP) == 0))
+          // compare the destination port and the specified port
+          && (s->Addresses[i].Address.Port == 0 || s->Addresses[i].Address.Port == destPort)) //
+      {
+        matched = true;
+        direction = Direction_DESTINATION;
+      }
+    }
+
+    if (!matched)
+      continue;
+
+    if (s->Addresses[i].__sniPattern >= 0) {
+      // the server name of the flow is known after the ClientHello
+      if (!*tlsProcessed) {
+        ProcessTls(s, buffer, size);
+        *tlsProcessed = true;
+      }
+      if ((s->TlsEvent.PatternMask & (1U << s->Addresses[i].__sniPattern)) == 0)
+        continue;
+    }
+
+    s->MatchedAddress = (uint32_t) i;
+    s->MatchedDirection = direction;
+    return true;
+  }
+
+  if (s->Rules != NULL) {
+    Direction_t direction = Direction_ANY;
+    const RuleTable_t* table = RuleSetCurrent(s->Rules);
+    int64_t rule = RuleTableMatch(table,
+                                  iphdr->Protocol,
+                                  iphdr->SourceAddress,
+                                  (uint16_t) sourcePort,
+                                  iphdr->DestinationAddress,
+                                  (uint16_t) destPort,
+                                  &direction);
+    if (rule >= 0) {
+      RuleTableCount(table, (size_t) rule, size);
+      s->MatchedAddress = (uint32_t) (s->AddressesCount + rule);
+      s->MatchedDirection = direction;
+      return true;
+    }
+  }
+  return false;
+}
+
 #ifdef __linux__
-  struct sockaddr_ll from;
-#elif _WIN32
-  struct sockaddr_in from;
-  (void) from;
+int SnifferIncludeETHHeader(Sniffer_t* s, bool inc)
+{
+  if (s == NULL)
+    return -1;
+
+  if (!s->__running)
+    s->ETHHeaderIncluded = inc;
+  else {
+    FormatStringBuffer(&s->ErrorMessage, "This sniffer was already started.");
+    return -1;
+  }
+
+  return 0;
+}
 #endif
-  socklen_t fromBytes = sizeof(from);
 
-  int64_t recvBytes;
-  if ((recvBytes =
-           recvfrom(s->__sock, (char*) s->__buf, ETH_MAX_PACKET_SIZE, 0, (struct sockaddr*) &from, &fromBytes)) > 0) {
-    do {
-      Buffer_t buffer;
+int SnifferVerifyChecksums(Sniffer_t* s, bool verify, bool badOnly)
+{
+  if (s == NULL)
+    return -1;
+
+  if (s->__running) {
+    FormatStringBuffer(&s->ErrorMessage, "This sniffer was already started.");
+    return -1;
+  }
+
 #ifdef __linux__
-      buffer = s->__buf + GetETHHeaderLength(); // ETH_P_ALL
-#elif _WIN32
-      buffer = s->__buf;
+  int auxdata = verify ? 1 : 0;
+  if (setsockopt(s->__sock, SOL_PACKET, PACKET_AUXDATA, &auxdata, sizeof(auxdata)) < 0) {
+    FormatStringBuffer(&s->ErrorMessage, "Cannot set PACKET_AUXDATA: %s", GetLastErrorMessage());
+    return -1;
+  }
 #endif
-      IPHeader_t* iphdr = GetIPHeader(buffer);
-
-      if (iphdr) {
-        char sourceIP[IP_MAX_SIZE] = "\0", destIP[IP_MAX_SIZE] = "\0";
-        {
-          static struct sockaddr_in src, dst;
-          memset(&src, 0, sizeof(src));
-          memset(&dst, 0, sizeof(dst));
-          src.sin_addr.s_addr = iphdr->SourceAddress;
-          dst.sin_addr.s_addr = iphdr->DestinationAddress;
-
-          strncpy(sourceIP, inet_ntoa(src.sin_addr), IP_MAX_SIZE);
-          strncpy(destIP, inet_ntoa(dst.sin_addr), IP_MAX_SIZE);
-        }
 
-#ifdef __linux__
-        // duplicate packets
-        if (strcmp(sourceIP, destIP) == 0 && from.sll_pkttype == PACKET_OUTGOING)
-          /*
-           * It is the same packet.
-           */
-          break;
+  s->VerifyChecksums = verify;
+  s->BadChecksumsOnly = verify && badOnly;
+  return 0;
+}
 
-        if (from.sll_pkttype == PACKET_OUTGOING && strcmp(s->__bindIP, sourceIP) != 0)
-          /*
-           * If this packet has type == PACKET_OUTGOING, the bind IP should be equals to source IP! Otherwise, may be it
-           * is duplicate (from localhost to localhost, 127.0.0.2 -> 127.0.0.1).
-           */
-          break;
+int SnifferDecodeTls(Sniffer_t* s)
+{
+  if (s == NULL)
+    return -1;
 
-        if (from.sll_pkttype == PACKET_HOST && strcmp(s->__bindIP, destIP) != 0)
-          /*
-           * If this packet has type == PACKET_HOST, the bind IP shoul be equals to destination IP!
-           */
-          break;
-#endif
+  if (s->__running) {
+    FormatStringBuffer(&s->ErrorMessage, "This sniffer was already started.");
+    return -1;
+  }
 
-        int sourcePort = 0, destPort = 0;
-        {
-          switch (iphdr->Protocol) {
-          case Protocol_TCP: {
-            TCPV4Header_t* tcphdr = GetTCPV4Header(buffer);
-            sourcePort = ntohs(tcphdr->SourcePort);
-            destPort = ntohs(tcphdr->DestinationPort);
-            break;
-          }
-          case Protocol_UDP: {
-            UDPHeader_t* udphdr = GetUDPHeader(buffer);
-            sourcePort = htons(udphdr->SourcePort);
-            destPort = htons(udphdr->DestinationPort);
-            break;
-          }
-          default:
-            break;
-          }
-        }
+  if (s->Tls == NULL) {
+    s->Tls = malloc(sizeof(TlsTracker_t));
+    ASSERT("Cannot initialize a new TLS tracker: malloc returned 'NULL'.", s->Tls != NULL);
+    TlsTrackerInit(s->Tls, TLS_FLOWS_DEFAULT_CAPACITY);
+  }
+  return 0;
+}
 
-        bool addrFound = false;
-        for (int i = 0; i < s->AddressesCount; ++i) {
-          if (s->Addresses[i].Filter.Protocol != iphdr->Protocol && s->Addresses[i].Filter.Protocol != Protocol_ANY)
-            continue;
-
-          if (s->Addresses[i].Filter.Direction == Direction_ANY ||
-              s->Addresses[i].Filter.Direction == Direction_SOURCE) {
-            if (( // if specified any address, ip was found. We received any packet with any direction
-                    (strcmp(s->Addresses[i].Address.IP, "any") == 0) //
-                    || // compare source ip with the specified ip, find direction
-                    (strcmp(s->Addresses[i].Address.IP, sourceIP) == 0))
-                // compare the source port and the specified port
-                && (s->Addresses[i].Address.Port == 0 || s->Addresses[i].Address.Port == sourcePort)) //
-            {
-              addrFound = true;
-              break;
-            }
-          }
-
-          if (s->Addresses[i].Filter.Direction == Direction_ANY ||
-              s->Addresses[i].Filter.Direction == Direction_DESTINATION) {
-            if (( // if specified any address, ip was found. We received any packet with any direction
-                    (strcmp(s->Addresses[i].Address.IP, "any") == 0) //
-                    || // compare dest ip with the specified ip, find direction
-                    (strcmp(s->Addresses[i].Address.IP, destIP) == 0))
-                // compare the destination port and the specified port
-                && (s->Addresses[i].Address.Port == 0 || s->Addresses[i].Address.Port == destPort)) //
-            {
-              addrFound = true;
-              break;
-            }
-          }
-        }
+int SnifferSetBatchHandler(Sniffer_t* s, ProcessingBatchHandler_t handler, HandlerArgs_t args, size_t batchSize)
+{
+  if (s == NULL)
+    return -1;
 
-        if (!addrFound)
-          break;
+  if (s->__running) {
+    FormatStringBuffer(&s->ErrorMessage, "This sniffer was already started.");
+    return -1;
+  }
+  if (handler == NULL || batchSize == 0 || batchSize > SNIFFER_BATCH_MAX_SIZE) {
+    FormatStringBuffer(&s->ErrorMessage, "Invalid batch handler or batch size %zu (max: %d).", batchSize,
+                       SNIFFER_BATCH_MAX_SIZE);
+    return -1;
+  }
 
-        if (s->__handler) {
-          TimeInfo_t tinfo;
-          GetTimeInfoNow(&tinfo, &s->ErrorMessage);
+  free(s->__batch);
+  free(s->__batchData);
+  s->__batch = malloc(sizeof(SnifferPacket_t) * batchSize);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", s->__batch != NULL);
+  s->__batchData = malloc(ETH_MAX_PACKET_SIZE * batchSize);
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", s->__batchData != NULL);
+  for (size_t i = 0; i < batchSize; ++i)
+    s->__batch[i].Data = s->__batchData + i * ETH_MAX_PACKET_SIZE;
 
-#ifdef __linux__
-          if (s->ETHHeaderIncluded)
-            buffer = s->__buf;
-#endif
-          s->__handler(s, buffer, (size_t) recvBytes, tinfo, s->__args);
-        } else {
-          FormatStringBuffer(&s->ErrorMessage, "Handler to processing network packets == 'NULL'.");
-          return -1;
-        }
+  s->__batchHandler = handler;
+  s->__args = args;
+  s->__batchCapacity = batchSize;
+  s->__batchCount = 0;
+  return 0;
+}
 
-        memset(s->__buf, 0, ETH_MAX_PACKET_SIZE);
-      }
-    } while (0);
+int SnifferSelectBackend(Sniffer_t* s, SnifferBackend_t backend)
+{
+  if (s == NULL)
+    return -1;
+
+  if (s->__running) {
+    FormatStringBuffer(&s->ErrorMessage, "This sniffer was already started.");
+    return -1;
   }
 
-  if (s->__running && recvBytes < 0 && errno != EAGAIN /* finish timeout */
-      && errno != EWOULDBLOCK) {
-    FormatStringBuffer(&s->ErrorMessage, "recvfrom(..): %s", GetLastErrorMessage());
+#ifdef __linux__
+  if (backend != SnifferBackend_AUTO && backend != SnifferBackend_PACKET_SOCKET) {
+#elif _WIN32
+  if (backend != SnifferBackend_AUTO && backend != SnifferBackend_RAW_SOCKET) {
+#endif
+    FormatStringBuffer(&s->ErrorMessage, "The capture backend '%s' is not available on this platform.",
+                       SnifferBackendToString(backend));
     return -1;
   }
+  s->Backend = backend;
   return 0;
 }
-#ifdef __linux__
-int SnifferIncludeETHHeader(Sniffer_t* s, bool inc)
+
+int SnifferSetRules(Sniffer_t* s, RuleSet_t* rules)
 {
   if (s == NULL)
     return -1;
 
-  if (!s->__running)
-    s->ETHHeaderIncluded = inc;
-  else {
+  if (s->__running) {
     FormatStringBuffer(&s->ErrorMessage, "This sniffer was already started.");
     return -1;
   }
 
+  if ((s->__rulesReader = RuleSetAddReader(rules)) < 0) {
+    FormatStringBuffer(&s->ErrorMessage, "Max readers of the rule set: %d.", RULES_READERS_MAX);
+    return -1;
+  }
+  s->Rules = rules;
   return 0;
 }
+
+const char* SnifferBackendToString(SnifferBackend_t backend)
+{
+  switch (backend) {
+  case SnifferBackend_AUTO:
+    return "auto";
+  case SnifferBackend_PACKET_SOCKET:
+    return "packet-socket";
+  case SnifferBackend_RAW_SOCKET:
+    return "raw-socket";
+  default:
+    return "unknown";
+  }
+}
+
+int SnifferUpdateStats(Sniffer_t* s)
+{
+  if (s == NULL)
+    return -1;
+
+#ifdef __linux__
+  if (!s->__running)
+    return 0;
+
+  struct tpacket_stats stats;
+  socklen_t statsBytes = sizeof(stats);
+  if (getsockopt(s->__sock, SOL_PACKET, PACKET_STATISTICS, &stats, &statsBytes) < 0) {
+    FormatStringBuffer(&s->ErrorMessage, "Cannot get PACKET_STATISTICS: %s", GetLastErrorMessage());
+    return -1;
+  }
+  // tp_packets includes dropped frames
+  s->Stats.KernelPackets += stats.tp_packets;
+  s->Stats.KernelDrops += stats.tp_drops;
 #endif
+  return 0;
+}
 
 int SnifferStop(Sniffer_t* s)
 {
@@ -502,6 +667,9 @@ int SnifferStop(Sniffer_t* s)
   }
 #endif
 
+  // the counters of the socket are lost after close()
+  SnifferUpdateStats(s);
+
 #ifdef __linux__
   close(s->__sock);
 #elif _WIN32
@@ -523,8 +691,28 @@ void SnifferClear(Sniffer_t* s)
     return;
 
   free(s->__buf);
+  free(s->__batch);
+  free(s->__batchData);
+  s->__batch = NULL;
+  s->__batchData = NULL;
 
   free(s->ErrorMessage);
+
+  TlsTrackerClear(s->Tls);
+  free(s->Tls);
+  s->Tls = NULL;
+}
+
+void ProcessTls(Sniffer_t* s, Buffer_t buffer, size_t size)
+{
+  PacketView_t view;
+  if (DecodePacketView(buffer, size, &view) == 0) {
+    TlsTrackerProcess(s->Tls, &view, &s->TlsEvent);
+  } else {
+    s->TlsEvent.ClientHelloDecoded = false;
+    s->TlsEvent.SNI = NULL;
+    s->TlsEvent.PatternMask = 0;
+  }
 }
 
 #ifdef __linux__
@@ -533,3 +721,198 @@ void SetPromiscMode(bool enable)
   PromiscModeEnabled = enable;
 }
 #endif
+
+int64_t ReceiveFrame(Sniffer_t* s, int flags, SocketAddress_t* from, ChecksumHint_t* checksumHint)
+{
+  *checksumHint = ChecksumHint_NONE;
+  int64_t recvBytes;
+#ifdef __linux__
+  {
+    union
+    {
+      struct cmsghdr align;
+      char buf[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+    } control;
+    struct iovec iov = {s->__buf, ETH_MAX_PACKET_SIZE};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = from;
+    msg.msg_namelen = sizeof(*from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    PROFILE_START(receiveStart);
+    recvBytes = recvmsg(s->__sock, &msg, flags);
+    PROFILE_STOP(ProfileStage_RECEIVE, receiveStart);
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); recvBytes > 0 && cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level != SOL_PACKET || cmsg->cmsg_type != PACKET_AUXDATA ||
+          cmsg->cmsg_len < CMSG_LEN(sizeof(struct tpacket_auxdata)))
+        continue;
+
+      struct tpacket_auxdata aux;
+      memcpy(&aux, CMSG_DATA(cmsg), sizeof(aux));
+      if (aux.tp_status & TP_STATUS_CSUMNOTREADY)
+        *checksumHint = ChecksumHint_NOT_READY;
+      else if (aux.tp_status & TP_STATUS_CSUM_VALID)
+        *checksumHint = ChecksumHint_KERNEL_VALID;
+    }
+  }
+#elif _WIN32
+  socklen_t fromBytes = sizeof(*from);
+  PROFILE_START(receiveStart);
+  recvBytes = recvfrom(s->__sock, (char*) s->__buf, ETH_MAX_PACKET_SIZE, flags, (struct sockaddr*) from, &fromBytes);
+  PROFILE_STOP(ProfileStage_RECEIVE, receiveStart);
+#endif
+  return recvBytes;
+}
+
+int ProcessFrame(Sniffer_t* s, int64_t recvBytes, const SocketAddress_t* from, ChecksumHint_t checksumHint)
+{
+#ifdef _WIN32
+  (void) from;
+#endif
+  bool handled = false;
+  do {
+    Buffer_t buffer;
+    size_t bufferBytes;
+#ifdef __linux__
+    buffer = s->__buf + GetETHHeaderLength(); // ETH_P_ALL
+    bufferBytes = (size_t) recvBytes > GetETHHeaderLength() ? (size_t) recvBytes - GetETHHeaderLength() : 0;
+#elif _WIN32
+    buffer = s->__buf;
+    bufferBytes = (size_t) recvBytes;
+#endif
+    PROFILE_START(dissectStart);
+    IPHeader_t* iphdr = GetIPHeader(buffer);
+
+    if (iphdr) {
+      char sourceIP[IP_MAX_SIZE] = "\0", destIP[IP_MAX_SIZE] = "\0";
+      {
+        static struct sockaddr_in src, dst;
+        memset(&src, 0, sizeof(src));
+        memset(&dst, 0, sizeof(dst));
+        src.sin_addr.s_addr = iphdr->SourceAddress;
+        dst.sin_addr.s_addr = iphdr->DestinationAddress;
+
+        strncpy(sourceIP, inet_ntoa(src.sin_addr), IP_MAX_SIZE);
+        strncpy(destIP, inet_ntoa(dst.sin_addr), IP_MAX_SIZE);
+      }
+
+#ifdef __linux__
+      // duplicate packets
+      if (strcmp(sourceIP, destIP) == 0 && from->sll_pkttype == PACKET_OUTGOING)
+        /*
+         * It is the same packet.
+         */
+        break;
+
+      if (from->sll_pkttype == PACKET_OUTGOING && strcmp(s->__bindIP, sourceIP) != 0)
+        /*
+         * If this packet has type == PACKET_OUTGOING, the bind IP should be equals to source IP! Otherwise, may be it
+         * is duplicate (from localhost to localhost, 127.0.0.2 -> 127.0.0.1).
+         */
+        break;
+
+      if (from->sll_pkttype == PACKET_HOST && strcmp(s->__bindIP, destIP) != 0)
+        /*
+         * If this packet has type == PACKET_HOST, the bind IP shoul be equals to destination IP!
+         */
+        break;
+#endif
+
+      int sourcePort = 0, destPort = 0;
+      {
+        switch (iphdr->Protocol) {
+        case Protocol_TCP: {
+          TCPV4Header_t* tcphdr = GetTCPV4Header(buffer);
+          sourcePort = ntohs(tcphdr->SourcePort);
+          destPort = ntohs(tcphdr->DestinationPort);
+          break;
+        }
+        case Protocol_UDP: {
+          UDPHeader_t* udphdr = GetUDPHeader(buffer);
+          sourcePort = htons(udphdr->SourcePort);
+          destPort = htons(udphdr->DestinationPort);
+          break;
+        }
+        default:
+          break;
+        }
+      }
+      PROFILE_STOP(ProfileStage_DISSECT, dissectStart);
+
+      PROFILE_START(filterStart);
+      bool tlsProcessed = false;
+      bool addrFound =
+          SnifferMatchAddress(s, buffer, bufferBytes, sourceIP, sourcePort, destIP, destPort, &tlsProcessed);
+      PROFILE_STOP(ProfileStage_FILTER, filterStart);
+
+      if (!addrFound)
+        break;
+
+      if (s->Tls != NULL && !tlsProcessed)
+        ProcessTls(s, buffer, bufferBytes);
+
+      s->ChecksumStatus = ChecksumStatus_NOT_CHECKED;
+      if (s->VerifyChecksums) {
+        PROFILE_START(checksumStart);
+        s->ChecksumStatus = ChecksumVerifyPacket(buffer, bufferBytes, checksumHint, &s->ChecksumStats);
+        PROFILE_STOP(ProfileStage_CHECKSUM, checksumStart);
+        if (s->BadChecksumsOnly && !ChecksumStatusIsBad(s->ChecksumStatus))
+          break;
+      }
+
+      if (s->__handler == NULL && s->__batchHandler == NULL) {
+        FormatStringBuffer(&s->ErrorMessage, "Handler to processing network packets == 'NULL'.");
+        return -1;
+      }
+
+      PROFILE_START(timestampStart);
+      TimeInfo_t tinfo;
+      GetTimeInfoNow(&tinfo, &s->ErrorMessage);
+      PROFILE_STOP(ProfileStage_TIMESTAMP, timestampStart);
+
+      size_t handlerBytes = bufferBytes;
+#ifdef __linux__
+      if (s->ETHHeaderIncluded) {
+        buffer = s->__buf;
+        handlerBytes = (size_t) recvBytes;
+      }
+#endif
+      handled = true;
+      if (s->__batchHandler != NULL)
+        AppendToBatch(s, buffer, handlerBytes, &tinfo);
+      else {
+        PROFILE_START(handlerStart);
+        s->__handler(s, buffer, handlerBytes, tinfo, s->__args);
+        PROFILE_STOP(ProfileStage_HANDLER, handlerStart);
+      }
+
+      memset(s->__buf, 0, ETH_MAX_PACKET_SIZE);
+    }
+  } while (0);
+
+  s->Stats.Received++;
+  if (handled)
+    s->Stats.Handled++;
+  else
+    s->Stats.FilteredOut++;
+  return 0;
+}
+
+void AppendToBatch(Sniffer_t* s, Buffer_t buffer, size_t size, const TimeInfo_t* time)
+{
+  // the socket buffer is reused by the next frame, the packet is copied to its slot
+  SnifferPacket_t* packet = &s->__batch[s->__batchCount++];
+  memcpy(packet->Data, buffer, size);
+  packet->Size = size;
+  packet->Time = *time;
+  packet->MatchedAddress = s->MatchedAddress;
+  packet->MatchedDirection = s->MatchedDirection;
+  packet->ChecksumStatus = s->ChecksumStatus;
+  // the event of the sniffer describes only the last frame of the batch
+  packet->ClientHelloDecoded = s->TlsEvent.ClientHelloDecoded;
+  packet->SNI = s->TlsEvent.SNI;
+}
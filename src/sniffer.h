@@ -2,12 +2,57 @@
 #define __SNIFFER_H
 
 #include "structures.h"
+#include "checksum.h"
+#include "tls.h"
+#include "rules.h"
 #include <stdbool.h>
 
 #define SOCKET_WAITING_TIMEOUT_MS 1000
+#define SNIFFER_BATCH_MAX_SIZE 1024
+
+/**
+ * @brief SnifferBackend_t
+ * Capture backends. Each platform has its own backend, AUTO selects it.
+ */
+typedef enum
+{
+  SnifferBackend_AUTO = 0,      //! The backend of the platform
+  SnifferBackend_PACKET_SOCKET, //! AF_PACKET socket, all frames of the interface (Linux)
+  SnifferBackend_RAW_SOCKET     //! Raw IP socket with SIO_RCVALL (Windows)
+} SnifferBackend_t;
+
+/**
+ * @brief CaptureStats_t
+ * Counters of captured packets. Kernel counters are read by SnifferUpdateStats() (only on Linux).
+ */
+typedef struct
+{
+  uint64_t Received;      //! Frames read from the socket
+  uint64_t FilteredOut;   //! Frames not passed to the handler (filters, duplicates, not IP packets)
+  uint64_t Handled;       //! Packets passed to the handler
+  uint64_t KernelPackets; //! Frames seen by the socket, including dropped (PACKET_STATISTICS)
+  uint64_t KernelDrops;   //! Frames dropped by the kernel, the socket buffer was full (PACKET_STATISTICS)
+} CaptureStats_t;
+
+/**
+ * @brief SnifferPacket_t
+ * The packet of the batch. The data is valid until the batch handler returns.
+ */
+typedef struct
+{
+  Buffer_t Data;                   //! The packet (starts with the ETH header if it is included)
+  size_t Size;                     //! The size of the packet
+  TimeInfo_t Time;                 //! Time of the capture
+  uint32_t MatchedAddress;         //! Index of the matched address
+  Direction_t MatchedDirection;    //! The address is the source or the destination of the packet
+  ChecksumStatus_t ChecksumStatus; //! Checksum status of the packet
+  bool ClientHelloDecoded;         //! The packet carried the TLS ClientHello (TLS decoding is enabled)
+  const char* SNI;                 //! Server name of the TLS flow of the packet (NULL if unknown), kept by the tracker
+} SnifferPacket_t;
 
 typedef void* HandlerArgs_t;
 typedef void (*ProcessingPacketHandler_t)(void*, Buffer_t, size_t, TimeInfo_t, HandlerArgs_t);
+typedef void (*ProcessingBatchHandler_t)(void*, const SnifferPacket_t*, size_t, HandlerArgs_t);
 /**
  * @brief Sniffer_t
  * Implements a sniffer object on specified address.
@@ -18,13 +63,25 @@ typedef struct
   {
     Address_t Address;
     Filter_t Filter;
+    int __sniPattern;
   } Addresses[ADDRESSES_MAX_COUNT]; //! Addresses in the format 'IP:PORT'
   uint16_t AddressesCount;          //! Addresses count
   char Interface[IFACE_MAX_SIZE];   //! Interface name (On Windows this field is interface index )
   char* ErrorMessage;               //! Error messages
 #ifdef __linux__                    //
   bool ETHHeaderIncluded;           //! ETH header included
-#endif
+#endif                              //
+  bool VerifyChecksums;             //! Verify checksums of packets
+  bool BadChecksumsOnly;            //! Pass only packets with bad checksums to the handler
+  ChecksumStats_t ChecksumStats;    //! Checksum verification counters
+  ChecksumStatus_t ChecksumStatus;  //! Checksum status of the packet passed to the handler
+  TlsTracker_t* Tls;                //! TLS tracker (NULL if TLS decoding is disabled)
+  TlsEvent_t TlsEvent;              //! TLS information of the packet passed to the handler
+  CaptureStats_t Stats;             //! Counters of captured packets
+  uint32_t MatchedAddress;          //! Index of the address matched by the packet passed to the handler
+  Direction_t MatchedDirection;     //! The address is the source or the destination of the packet
+  SnifferBackend_t Backend;         //! The capture backend
+  RuleSet_t* Rules;                 //! Rules of the file matched after addresses (NULL if not used)
   // private fields
 #ifdef __linux__
   int __sock;
@@ -37,8 +94,14 @@ typedef struct
   char __bindIP[IP_MAX_SIZE];
   Buffer_t __buf;
   ProcessingPacketHandler_t __handler;
+  ProcessingBatchHandler_t __batchHandler;
   HandlerArgs_t __args;
+  SnifferPacket_t* __batch;
+  Buffer_t __batchData;
+  size_t __batchCapacity;
+  size_t __batchCount;
   int8_t __running;
+  int __rulesReader;
 } Sniffer_t;
 
 #define PROCESSING_HANDLER_FUNC(funcname, owner, buffer, size, timestamp, args)                                        \
@@ -91,9 +154,98 @@ int SnifferProcessNextPacket(Sniffer_t* s);
  */
 int SnifferIncludeETHHeader(Sniffer_t* s, bool inc);
 #endif
+/**
+ * @brief SnifferVerifyChecksums
+ * Enables the verification of IP, ICMP, TCP and UDP checksums. On Linux, packets already validated by the kernel (and
+ * outgoing packets with the checksum offloaded to the NIC) are not verified again. If badOnly is true, only packets
+ * with bad checksums will be passed to the handler. Recommended calls this functions before SnifferStart().
+ * @param s The pointer to the sniffer object
+ * @param verify Verify checksums
+ * @param badOnly Pass only packets with bad checksums to the handler
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int SnifferVerifyChecksums(Sniffer_t* s, bool verify, bool badOnly);
+/**
+ * @brief SnifferDecodeTls
+ * Enables decoding of TLS ClientHello messages. Only the first data segment of each TCP flow is parsed, the server name
+ * is remembered for other segments of the flow. Adding an address with the SNI filter enables it automatically.
+ * Recommended calls this functions before SnifferStart().
+ * @param s The pointer to the sniffer object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int SnifferDecodeTls(Sniffer_t* s);
+/**
+ * @brief SnifferSetBatchHandler
+ * Replaces the handler of packets with the batch handler. Each SnifferProcessNextPacket() call waits for the first
+ * frame, reads up to batchSize frames already queued in the socket and passes matched packets to the batch handler
+ * with one call. Recommended calls this functions before SnifferStart().
+ * @param s The pointer to the sniffer object
+ * @param handler Handler to processing batches of packets
+ * @param args Handler arguments
+ * @param batchSize Max packets of the batch (max value: SNIFFER_BATCH_MAX_SIZE)
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int SnifferSetBatchHandler(Sniffer_t* s, ProcessingBatchHandler_t handler, HandlerArgs_t args, size_t batchSize);
+/**
+ * @brief SnifferSelectBackend
+ * Selects the capture backend. Only backends of the current platform are available. Recommended calls this functions
+ * before SnifferStart().
+ * @param s The pointer to the sniffer object
+ * @param backend The capture backend
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int SnifferSelectBackend(Sniffer_t* s, SnifferBackend_t backend);
+/**
+ * @brief SnifferSetRules
+ * Matches packets that are not matched by addresses with rules of the set. The current table of the set can be swapped
+ * while the sniffer is running, the sniffer reports a quiescent state on each SnifferProcessNextPacket() call.
+ * Recommended calls this functions before SnifferStart().
+ * @param s The pointer to the sniffer object
+ * @param rules The rule set (the sniffer is registered as its reader)
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int SnifferSetRules(Sniffer_t* s, RuleSet_t* rules);
+/**
+ * @brief SnifferMatchAddress
+ * Finds the first address that matches the packet and stores its index and the direction to MatchedAddress and
+ * MatchedDirection. The TLS ClientHello of the packet is decoded once if the address has the server name pattern.
+ * Rules are matched after addresses, the index of the rule follows indexes of addresses. The matched rule is counted
+ * by the counters of its table.
+ * @param s The pointer to the sniffer object
+ * @param buffer The network packet without the ETH header
+ * @param size Packet size
+ * @param sourceIP The source IP of the packet
+ * @param sourcePort The source port of the packet (0 if the protocol has no ports)
+ * @param destIP The destination IP of the packet
+ * @param destPort The destination port of the packet
+ * @param tlsProcessed The TLS ClientHello of the packet is decoded (set by the function)
+ * @return true if the address is found.
+ */
+bool SnifferMatchAddress(Sniffer_t* s,
+                         Buffer_t buffer,
+                         size_t size,
+                         const char* sourceIP,
+                         int sourcePort,
+                         const char* destIP,
+                         int destPort,
+                         bool* tlsProcessed);
+/**
+ * @brief SnifferBackendToString
+ * @param backend The capture backend
+ * @return The name of the backend.
+ */
+const char* SnifferBackendToString(SnifferBackend_t backend);
+/**
+ * @brief SnifferUpdateStats
+ * Adds kernel counters of the socket (PACKET_STATISTICS) to Stats. The kernel resets its counters on each read. On
+ * Windows kernel counters are not available, the function does nothing.
+ * @param s The pointer to the sniffer object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int SnifferUpdateStats(Sniffer_t* s);
 /**
  * @brief SnifferStop
- * Stops sniffing network packets.
+ * Stops sniffing network packets. Kernel counters are updated before the socket is closed.
  * @param s The pointer to the sniffer object
  * @return -1 if an error occurred, otherwise 0.
  */
@@ -0,0 +1,958 @@
+#include "storage.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define STORAGE_TIME_ENTRIES_MAX (STORAGE_SEGMENT_MAX_PACKETS / STORAGE_TIME_INDEX_INTERVAL + 1)
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+/**
+ * @brief StorageMapping_t
+ * The file mapped by the query.
+ */
+typedef struct
+{
+  const uint8_t* Data;
+  size_t Size;
+} StorageMapping_t;
+
+/**
+ * @brief StorageSegment_t
+ * The segment read by the query. Blocks of the compressed segment are decompressed when they are read, the last
+ * decompressed block is kept. Arrays are kept between segments.
+ */
+typedef struct
+{
+  StorageMapping_t File;
+  bool Compressed;
+  uint64_t Size;           //! Bytes of the uncompressed segment
+  uint32_t LinkType;       //! The link type of the pcap header
+  CompressBlock_t* Blocks; //! Blocks of the compressed segment
+  size_t BlocksCount;
+  size_t BlocksCapacity;
+  uint8_t* Block; //! The decompressed block
+  size_t BlockCapacity;
+  size_t Current; //! The index of the decompressed block (SIZE_MAX - none)
+  const uint8_t* CurrentData;
+} StorageSegment_t;
+
+static void ResetBuild(StorageIndexBuild_t* b, uint64_t segment);
+#ifdef __linux__
+static int CompareEntries(const void* a, const void* b);
+static int CompareNumbers(const void* a, const void* b);
+static int WriteIndex(const char* directory, StorageIndexBuild_t* b, char** error);
+static const StorageIndexHeader_t* ReadIndex(const StorageMapping_t* index, uint64_t segmentSize);
+static void ScanSegment(StorageSegment_t* segment,
+                        uint64_t offset,
+                        const StorageQuery_t* q,
+                        StorageQueryHandler_t handler,
+                        void* args,
+                        StorageQueryStats_t* stats);
+static bool ReadPacket(StorageSegment_t* segment,
+                       uint64_t offset,
+                       const StorageQuery_t* q,
+                       StorageQueryHandler_t handler,
+                       void* args,
+                       StorageQueryStats_t* stats,
+                       uint64_t* next);
+static const uint8_t* ReadSegment(StorageSegment_t* segment,
+                                  uint64_t offset,
+                                  size_t* available,
+                                  StorageQueryStats_t* stats);
+static bool MatchFlow(const StorageQuery_t* q, const uint8_t* data, size_t size, uint32_t linkType);
+static void BeginSegment(StorageWriter_t* s, bool open);
+static void EndSegment(StorageWriter_t* s);
+static void SubmitBuffer(StorageWriter_t* s);
+static int OpenSegment(StorageWriter_t* s, uint64_t segment);
+static bool WriteBuffer(StorageWriter_t* s, const StorageWriteBuffer_t* buffer);
+static int64_t ListSegments(const char* directory, uint64_t** numbers, char** error);
+static int MapFile(const char* path, StorageMapping_t* mapping);
+static void UnmapFile(StorageMapping_t* mapping);
+static int MapSegment(const char* directory,
+                      uint64_t number,
+                      StorageSegment_t* segment,
+                      StorageQueryStats_t* stats,
+                      char** error);
+static int QuerySegment(const char* directory,
+                        uint64_t number,
+                        StorageSegment_t* segment,
+                        const StorageQuery_t* q,
+                        StorageQueryHandler_t handler,
+                        void* args,
+                        StorageQueryStats_t* stats,
+                        char** error);
+static void* WriteThread(void* args);
+static void* IndexThread(void* args);
+#endif
+
+void StorageWriterInit(StorageWriter_t* s, const char* directory, uint64_t segmentSize, uint32_t linkType)
+{
+  ASSERT("Cannot init the storage writer ('StorageWriter_t'): s == NULL.", s != NULL);
+
+  s->Packets = 0;
+  s->Bytes = 0;
+  s->Segments = 0;
+  s->Errors = 0;
+  s->Stalls = 0;
+  s->IndexSkipped = 0;
+  s->Indexed = 0;
+  s->ErrorMessage = NULL;
+  s->Compressor = NULL;
+  snprintf(s->__directory, sizeof(s->__directory), "%s", directory);
+  s->__segmentSize = segmentSize < STORAGE_SEGMENT_MIN_SIZE   ? STORAGE_SEGMENT_MIN_SIZE
+                     : segmentSize > STORAGE_SEGMENT_MAX_SIZE ? STORAGE_SEGMENT_MAX_SIZE
+                                                              : segmentSize;
+  s->__linkType = linkType;
+  s->__segment = 0;
+  s->__offset = 0;
+  for (size_t i = 0; i < STORAGE_WRITE_BUFFERS_COUNT; ++i) {
+    memset(&s->__buffers[i], 0, sizeof(StorageWriteBuffer_t));
+    s->__buffers[i].Data = malloc(STORAGE_WRITE_BUFFER_SIZE);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", s->__buffers[i].Data != NULL);
+  }
+  s->__buffer = &s->__buffers[0];
+  s->__submitted = 0;
+  s->__written = 0;
+  s->__fd = -1;
+  s->__failed = false;
+  // entries of both indexes are preallocated, the capture thread never allocates them
+  for (size_t i = 0; i < 2; ++i) {
+    s->__builds[i].Entries = malloc(sizeof(StorageIndexEntry_t) * STORAGE_SEGMENT_MAX_PACKETS);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", s->__builds[i].Entries != NULL);
+    s->__builds[i].Times = malloc(sizeof(StorageIndexTime_t) * STORAGE_TIME_ENTRIES_MAX);
+    ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", s->__builds[i].Times != NULL);
+    ResetBuild(&s->__builds[i], 0);
+  }
+  s->__building = &s->__builds[0];
+  s->__pending = NULL;
+  s->__indexReady = false;
+  s->__running = false;
+#ifdef __linux__
+  pthread_mutex_init(&s->__mutex, NULL);
+  pthread_cond_init(&s->__changed, NULL);
+#endif
+}
+
+void StorageWriterSetCompression(StorageWriter_t* s, size_t threads)
+{
+  if (s->Compressor != NULL || threads == 0)
+    return;
+
+  // blocks are at most the write buffer, so the block of whole records is submitted for each buffer
+  s->Compressor = malloc(sizeof(CompressPool_t));
+  ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", s->Compressor != NULL);
+  CompressPoolInit(s->Compressor, threads, STORAGE_WRITE_BUFFER_SIZE);
+}
+
+int StorageWriterStart(StorageWriter_t* s)
+{
+#ifdef __linux__
+  if (mkdir(s->__directory, 0755) < 0 && errno != EEXIST) {
+    FormatStringBuffer(
+        &s->ErrorMessage, "Cannot create the storage directory '%s': %s", s->__directory, strerror(errno));
+    return -1;
+  }
+
+  // segments of previous runs are kept
+  uint64_t* numbers = NULL;
+  int64_t count = ListSegments(s->__directory, &numbers, &s->ErrorMessage);
+  if (count < 0)
+    return -1;
+  s->__segment = count > 0 ? numbers[count - 1] + 1 : 0;
+  free(numbers);
+
+  if (s->Compressor != NULL) {
+    if (CompressPoolStart(s->Compressor) < 0) {
+      FormatStringBuffer(&s->ErrorMessage, "Cannot start compression threads of the storage: %s", strerror(errno));
+      return -1;
+    }
+  }
+  // the first segment is created before the capture, errors of next segments are counted by the write thread
+  s->__failed = false;
+  if (OpenSegment(s, s->__segment) < 0) {
+    if (s->Compressor != NULL)
+      CompressPoolStop(s->Compressor);
+    return -1;
+  }
+  BeginSegment(s, false);
+  s->__running = true;
+  int rc = pthread_create(&s->__writeThread, NULL, WriteThread, s);
+  if (rc == 0) {
+    rc = pthread_create(&s->__indexThread, NULL, IndexThread, s);
+    if (rc != 0) {
+      pthread_mutex_lock(&s->__mutex);
+      s->__running = false;
+      pthread_cond_broadcast(&s->__changed);
+      pthread_mutex_unlock(&s->__mutex);
+      pthread_join(s->__writeThread, NULL);
+    }
+  }
+  if (rc != 0) {
+    s->__running = false;
+    close(s->__fd);
+    s->__fd = -1;
+    if (s->Compressor != NULL)
+      CompressPoolStop(s->Compressor);
+    FormatStringBuffer(&s->ErrorMessage, "Cannot start threads of the storage: %s", strerror(rc));
+    return -1;
+  }
+  return 0;
+#else
+  FormatStringBuffer(&s->ErrorMessage, "The storage is only available on Linux.");
+  return -1;
+#endif
+}
+
+void StorageWriterWrite(StorageWriter_t* s, const SnifferPacket_t* packets, size_t count)
+{
+#ifdef __linux__
+  size_t hdroffset = s->__linkType == PCAP_LINKTYPE_ETHERNET ? GetETHHeaderLength() : 0;
+  for (size_t i = 0; i < count; ++i) {
+    size_t captured = packets[i].Size < PCAP_SNAPSHOT_LENGTH ? packets[i].Size : PCAP_SNAPSHOT_LENGTH;
+    size_t recordSize = sizeof(PcapRecordHeader_t) + captured;
+    StorageIndexBuild_t* b = s->__building;
+    if (b->Count == STORAGE_SEGMENT_MAX_PACKETS || (b->Count > 0 && s->__offset + recordSize > s->__segmentSize)) {
+      EndSegment(s);
+      s->__segment++;
+      BeginSegment(s, true);
+      b = s->__building;
+    }
+
+    PcapRecordHeader_t header;
+    header.TimestampSec = (uint32_t) packets[i].Time.TimestampSec;
+    header.TimestampNanosec = packets[i].Time.TimestampNanosec;
+    header.CapturedLength = (uint32_t) captured;
+    header.OriginalLength = (uint32_t) packets[i].Size;
+    uint64_t ns = (uint64_t) packets[i].Time.TimestampSec * NANOSECONDS_PER_SECOND + packets[i].Time.TimestampNanosec;
+
+    PacketView_t view;
+    StorageIndexEntry_t* entry = &b->Entries[b->Count];
+    entry->Hash = packets[i].Size > hdroffset &&
+                          DecodePacketView(packets[i].Data + hdroffset, packets[i].Size - hdroffset, &view) == 0
+                      ? GetFlowHash(&view)
+                      : 0;
+    entry->Offset = (uint32_t) s->__offset;
+    entry->__reserved = 0;
+    if (b->Count % STORAGE_TIME_INDEX_INTERVAL == 0) {
+      b->Times[b->TimesCount].TimestampNs = ns;
+      b->Times[b->TimesCount].Offset = s->__offset;
+      b->TimesCount++;
+    }
+    b->FirstNs = b->Count == 0 || ns < b->FirstNs ? ns : b->FirstNs;
+    b->LastNs = b->Count == 0 || ns > b->LastNs ? ns : b->LastNs;
+    b->Count++;
+
+    // the record is not split between buffers (blocks of the compressed segment)
+    if (s->__buffer->Size + recordSize > STORAGE_WRITE_BUFFER_SIZE)
+      SubmitBuffer(s);
+    StorageWriteBuffer_t* buffer = s->__buffer;
+    memcpy(buffer->Data + buffer->Size, &header, sizeof(header));
+    memcpy(buffer->Data + buffer->Size + sizeof(header), packets[i].Data, captured);
+    buffer->Size += recordSize;
+    buffer->Packets++;
+    s->__offset += recordSize;
+  }
+#else
+  (void) packets;
+  s->Errors += count;
+#endif
+}
+
+void StorageWriterStop(StorageWriter_t* s)
+{
+  if (s == NULL)
+    return;
+
+#ifdef __linux__
+  pthread_mutex_lock(&s->__mutex);
+  if (!s->__running) {
+    pthread_mutex_unlock(&s->__mutex);
+    return;
+  }
+  // the index of the last segment is not skipped
+  while (s->__pending != NULL)
+    pthread_cond_wait(&s->__changed, &s->__mutex);
+  pthread_mutex_unlock(&s->__mutex);
+
+  EndSegment(s);
+
+  // threads stop after all buffers and the pending index are written
+  pthread_mutex_lock(&s->__mutex);
+  while (s->__written != s->__submitted)
+    pthread_cond_wait(&s->__changed, &s->__mutex);
+  s->__running = false;
+  pthread_cond_broadcast(&s->__changed);
+  pthread_mutex_unlock(&s->__mutex);
+  pthread_join(s->__writeThread, NULL);
+  pthread_join(s->__indexThread, NULL);
+  if (s->Compressor != NULL)
+    CompressPoolStop(s->Compressor);
+#endif
+}
+
+void StorageWriterClear(StorageWriter_t* s)
+{
+  if (s == NULL)
+    return;
+
+  StorageWriterStop(s);
+#ifdef __linux__
+  pthread_cond_destroy(&s->__changed);
+  pthread_mutex_destroy(&s->__mutex);
+#endif
+  for (size_t i = 0; i < 2; ++i) {
+    free(s->__builds[i].Entries);
+    free(s->__builds[i].Times);
+    s->__builds[i].Entries = NULL;
+    s->__builds[i].Times = NULL;
+  }
+  for (size_t i = 0; i < STORAGE_WRITE_BUFFERS_COUNT; ++i) {
+    free(s->__buffers[i].Data);
+    s->__buffers[i].Data = NULL;
+  }
+  s->__buffer = NULL;
+  CompressPoolClear(s->Compressor);
+  free(s->Compressor);
+  s->Compressor = NULL;
+  free(s->ErrorMessage);
+  s->ErrorMessage = NULL;
+}
+
+void StorageQueryInit(StorageQuery_t* q)
+{
+  memset(q, 0, sizeof(StorageQuery_t));
+  q->ToNs = UINT64_MAX;
+}
+
+int StorageQueryRun(const char* directory,
+                    const StorageQuery_t* q,
+                    StorageQueryHandler_t handler,
+                    void* args,
+                    StorageQueryStats_t* stats,
+                    char** error)
+{
+  memset(stats, 0, sizeof(StorageQueryStats_t));
+#ifdef __linux__
+  uint64_t* numbers = NULL;
+  int64_t count = ListSegments(directory, &numbers, error);
+  if (count < 0)
+    return -1;
+
+  StorageSegment_t segment;
+  memset(&segment, 0, sizeof(segment));
+  int rc = 0;
+  for (int64_t i = 0; i < count && rc == 0; ++i)
+    rc = QuerySegment(directory, numbers[i], &segment, q, handler, args, stats, error);
+  free(segment.Blocks);
+  free(segment.Block);
+  free(numbers);
+  return rc;
+#else
+  (void) directory;
+  (void) q;
+  (void) handler;
+  (void) args;
+  FormatStringBuffer(error, "The storage is only available on Linux.");
+  return -1;
+#endif
+}
+
+void ResetBuild(StorageIndexBuild_t* b, uint64_t segment)
+{
+  b->Count = 0;
+  b->TimesCount = 0;
+  b->FirstNs = 0;
+  b->LastNs = 0;
+  b->SegmentSize = 0;
+  b->Segment = segment;
+}
+
+#ifdef __linux__
+int CompareEntries(const void* a, const void* b)
+{
+  const StorageIndexEntry_t* first = (const StorageIndexEntry_t*) a;
+  const StorageIndexEntry_t* second = (const StorageIndexEntry_t*) b;
+  if (first->Hash != second->Hash)
+    return first->Hash < second->Hash ? -1 : 1;
+  return first->Offset < second->Offset ? -1 : first->Offset > second->Offset;
+}
+
+int CompareNumbers(const void* a, const void* b)
+{
+  uint64_t first = *(const uint64_t*) a;
+  uint64_t second = *(const uint64_t*) b;
+  return first < second ? -1 : first > second;
+}
+
+int WriteIndex(const char* directory, StorageIndexBuild_t* b, char** error)
+{
+  // offsets of each flow stay in the order of the segment
+  qsort(b->Entries, b->Count, sizeof(StorageIndexEntry_t), CompareEntries);
+
+  StorageIndexHeader_t header;
+  memset(&header, 0, sizeof(header));
+  header.Magic = STORAGE_INDEX_MAGIC;
+  header.Version = STORAGE_INDEX_VERSION;
+  header.Packets = b->Count;
+  header.FirstNs = b->FirstNs;
+  header.LastNs = b->LastNs;
+  header.SegmentSize = b->SegmentSize;
+  header.TimeEntriesCount = (uint32_t) b->TimesCount;
+  for (size_t i = 0; i < b->Count; ++i)
+    header.FlowsCount += i == 0 || b->Entries[i].Hash != b->Entries[i - 1].Hash;
+
+  // the index appears complete, the query scans the segment until it is renamed
+  char path[STORAGE_PATH_MAX_SIZE + 32], temporary[STORAGE_PATH_MAX_SIZE + 40];
+  snprintf(path, sizeof(path), "%s/" STORAGE_INDEX_FORMAT, directory, (unsigned long long) b->Segment);
+  snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+  FILE* file = fopen(temporary, "wb");
+  if (file == NULL) {
+    FormatStringBuffer(error, "Cannot create the index '%s': %s", temporary, strerror(errno));
+    return -1;
+  }
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (size_t i = 0; i < b->Count && written;) {
+    StorageIndexFlow_t flow;
+    flow.Hash = b->Entries[i].Hash;
+    flow.First = (uint32_t) i;
+    while (i < b->Count && b->Entries[i].Hash == flow.Hash)
+      ++i;
+    flow.Count = (uint32_t) i - flow.First;
+    written = fwrite(&flow, sizeof(flow), 1, file) == 1;
+  }
+  written = written && fwrite(b->Times, sizeof(StorageIndexTime_t), b->TimesCount, file) == b->TimesCount;
+  for (size_t i = 0; i < b->Count && written; ++i)
+    written = fwrite(&b->Entries[i].Offset, sizeof(uint32_t), 1, file) == 1;
+
+  if (fclose(file) != 0 || !written || rename(temporary, path) != 0) {
+    FormatStringBuffer(error, "Cannot write the index '%s': %s", path, strerror(errno));
+    remove(temporary);
+    return -1;
+  }
+  return 0;
+}
+
+const StorageIndexHeader_t* ReadIndex(const StorageMapping_t* index, uint64_t segmentSize)
+{
+  if (index->Data == NULL || index->Size < sizeof(StorageIndexHeader_t))
+    return NULL;
+  const StorageIndexHeader_t* header = (const StorageIndexHeader_t*) index->Data;
+  uint64_t size = sizeof(StorageIndexHeader_t) + (uint64_t) header->FlowsCount * sizeof(StorageIndexFlow_t) +
+                  (uint64_t) header->TimeEntriesCount * sizeof(StorageIndexTime_t) + header->Packets * sizeof(uint32_t);
+  bool valid = header->Magic == STORAGE_INDEX_MAGIC && header->Version == STORAGE_INDEX_VERSION &&
+               header->Packets <= STORAGE_SEGMENT_MAX_PACKETS && size == index->Size &&
+               header->SegmentSize <= segmentSize;
+  return valid ? header : NULL;
+}
+
+void ScanSegment(StorageSegment_t* segment,
+                 uint64_t offset,
+                 const StorageQuery_t* q,
+                 StorageQueryHandler_t handler,
+                 void* args,
+                 StorageQueryStats_t* stats)
+{
+  // packets of the segment are in the order of the capture, the scan stops after the time range
+  while (ReadPacket(segment, offset, q, handler, args, stats, &offset))
+    ;
+}
+
+bool ReadPacket(StorageSegment_t* segment,
+                uint64_t offset,
+                const StorageQuery_t* q,
+                StorageQueryHandler_t handler,
+                void* args,
+                StorageQueryStats_t* stats,
+                uint64_t* next)
+{
+  // the last record of the segment may be incomplete while it is written
+  PcapRecordHeader_t header;
+  size_t available = 0;
+  const uint8_t* record = ReadSegment(segment, offset, &available, stats);
+  if (record == NULL || available < sizeof(header))
+    return false;
+  memcpy(&header, record, sizeof(header));
+  if (header.CapturedLength > PCAP_SNAPSHOT_LENGTH || sizeof(header) + header.CapturedLength > available)
+    return false;
+
+  stats->ReadPackets++;
+  uint64_t ns = (uint64_t) header.TimestampSec * NANOSECONDS_PER_SECOND + header.TimestampNanosec;
+  if (ns > q->ToNs)
+    return false;
+
+  const uint8_t* data = record + sizeof(header);
+  if (ns >= q->FromNs && (!q->HasFlow || MatchFlow(q, data, header.CapturedLength, segment->LinkType))) {
+    stats->Packets++;
+    handler(&header, data, segment->LinkType, args);
+  }
+  if (next != NULL)
+    *next = offset + sizeof(header) + header.CapturedLength;
+  return true;
+}
+
+const uint8_t* ReadSegment(StorageSegment_t* segment, uint64_t offset, size_t* available, StorageQueryStats_t* stats)
+{
+  if (!segment->Compressed) {
+    if (offset >= segment->File.Size)
+      return NULL;
+    *available = segment->File.Size - offset;
+    return segment->File.Data + offset;
+  }
+
+  // the last block which starts before the offset, records are not split between blocks
+  size_t low = 0, high = segment->BlocksCount;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (segment->Blocks[middle].RawOffset <= offset)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  if (low == 0 || offset >= segment->Blocks[low - 1].RawOffset + segment->Blocks[low - 1].RawSize)
+    return NULL;
+  const CompressBlock_t* block = &segment->Blocks[low - 1];
+  if (segment->Current != low - 1) {
+    const uint8_t* data = segment->File.Data + block->FileOffset;
+    if (block->Compressed) {
+      if (LzDecompress(data, block->Size, segment->Block, segment->BlockCapacity) != (int64_t) block->RawSize)
+        return NULL;
+      data = segment->Block;
+      stats->DecompressedBlocks++;
+    }
+    segment->Current = low - 1;
+    segment->CurrentData = data;
+  }
+  *available = block->RawOffset + block->RawSize - offset;
+  return segment->CurrentData + (offset - block->RawOffset);
+}
+
+bool MatchFlow(const StorageQuery_t* q, const uint8_t* data, size_t size, uint32_t linkType)
+{
+  size_t hdroffset = linkType == PCAP_LINKTYPE_ETHERNET ? GetETHHeaderLength() : 0;
+  // flows of the same hash are different flows
+  PacketView_t view;
+  if (size <= hdroffset || DecodePacketView((Buffer_t) (data + hdroffset), size - hdroffset, &view) < 0 ||
+      view.Protocol != q->Protocol)
+    return false;
+  bool forward = view.SourceAddress == q->SourceAddress && view.SourcePort == q->SourcePort &&
+                 view.DestinationAddress == q->DestinationAddress && view.DestinationPort == q->DestinationPort;
+  bool backward = view.SourceAddress == q->DestinationAddress && view.SourcePort == q->DestinationPort &&
+                  view.DestinationAddress == q->SourceAddress && view.DestinationPort == q->SourcePort;
+  return forward || backward;
+}
+
+void BeginSegment(StorageWriter_t* s, bool open)
+{
+  // the segment starts in the empty buffer
+  StorageWriteBuffer_t* buffer = s->__buffer;
+  PcapFileHeader_t header;
+  PcapFileHeaderInit(&header, s->__linkType);
+  memcpy(buffer->Data, &header, sizeof(header));
+  buffer->Size = sizeof(header);
+  buffer->Segment = s->__segment;
+  buffer->RawOffset = 0;
+  buffer->Open = open;
+  s->__offset = sizeof(header);
+  ResetBuild(s->__building, s->__segment);
+}
+
+void EndSegment(StorageWriter_t* s)
+{
+  StorageIndexBuild_t* b = s->__building;
+  b->SegmentSize = s->__offset;
+
+  // the index is written after the write thread closes the segment
+  pthread_mutex_lock(&s->__mutex);
+  if (s->__pending == NULL) {
+    s->__pending = b;
+    s->__indexReady = false;
+    s->__buffer->Index = b;
+    s->__building = b == &s->__builds[0] ? &s->__builds[1] : &s->__builds[0];
+  } else
+    s->IndexSkipped++;
+  pthread_mutex_unlock(&s->__mutex);
+  s->__buffer->Close = true;
+  SubmitBuffer(s);
+}
+
+void SubmitBuffer(StorageWriter_t* s)
+{
+  pthread_mutex_lock(&s->__mutex);
+  s->__submitted++;
+  pthread_cond_broadcast(&s->__changed);
+  if (s->__submitted - s->__written == STORAGE_WRITE_BUFFERS_COUNT) {
+    s->Stalls++;
+    while (s->__submitted - s->__written == STORAGE_WRITE_BUFFERS_COUNT)
+      pthread_cond_wait(&s->__changed, &s->__mutex);
+  }
+  pthread_mutex_unlock(&s->__mutex);
+
+  StorageWriteBuffer_t* buffer = &s->__buffers[s->__submitted % STORAGE_WRITE_BUFFERS_COUNT];
+  buffer->Size = 0;
+  buffer->Segment = s->__segment;
+  buffer->RawOffset = s->__offset;
+  buffer->Packets = 0;
+  buffer->Open = false;
+  buffer->Close = false;
+  buffer->Index = NULL;
+  s->__buffer = buffer;
+}
+
+int OpenSegment(StorageWriter_t* s, uint64_t segment)
+{
+  char path[STORAGE_PATH_MAX_SIZE + 32];
+  snprintf(path,
+           sizeof(path),
+           "%s/" STORAGE_SEGMENT_FORMAT "%s",
+           s->__directory,
+           (unsigned long long) segment,
+           s->Compressor != NULL ? STORAGE_COMPRESSED_SUFFIX : "");
+  s->__fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool written = s->__fd >= 0;
+  // the compressed segment starts with its header, blocks are written by the pool
+  if (written && s->Compressor != NULL) {
+    CompressFileHeader_t file;
+    CompressFileHeaderInit(&file, STORAGE_WRITE_BUFFER_SIZE);
+    written = write(s->__fd, &file, sizeof(file)) == (ssize_t) sizeof(file);
+  }
+  if (!written) {
+    pthread_mutex_lock(&s->__mutex);
+    FormatStringBuffer(&s->ErrorMessage, "Cannot create the segment '%s': %s", path, strerror(errno));
+    pthread_mutex_unlock(&s->__mutex);
+    if (s->__fd >= 0)
+      close(s->__fd);
+    s->__fd = -1;
+    return -1;
+  }
+  s->Segments++;
+  return 0;
+}
+
+bool WriteBuffer(StorageWriter_t* s, const StorageWriteBuffer_t* buffer)
+{
+  if (s->Compressor != NULL) {
+    // the pool closes the segment after its last block
+    uint8_t* block = CompressPoolAcquire(s->Compressor);
+    memcpy(block, buffer->Data, buffer->Size);
+    CompressPoolSubmit(s->Compressor, buffer->Size, s->__fd, buffer->RawOffset, buffer->Close);
+    return true;
+  }
+
+  size_t written = 0;
+  while (written < buffer->Size) {
+    ssize_t rc = write(s->__fd, buffer->Data + written, buffer->Size - written);
+    if (rc < 0 && errno == EINTR)
+      continue;
+    if (rc <= 0)
+      return false;
+    written += (size_t) rc;
+  }
+  if (buffer->Close)
+    close(s->__fd);
+  return true;
+}
+
+int64_t ListSegments(const char* directory, uint64_t** numbers, char** error)
+{
+  DIR* dir = opendir(directory);
+  if (dir == NULL) {
+    FormatStringBuffer(error, "Cannot open the storage directory '%s': %s", directory, strerror(errno));
+    return -1;
+  }
+
+  size_t count = 0, capacity = 0;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    unsigned long long number = 0;
+    int length = 0;
+    if (sscanf(entry->d_name, STORAGE_SEGMENT_FORMAT "%n", &number, &length) != 1 ||
+        (entry->d_name[length] != '\0' && strcmp(entry->d_name + length, STORAGE_COMPRESSED_SUFFIX) != 0))
+      continue;
+    if (count == capacity) {
+      capacity = capacity == 0 ? 64 : capacity * 2;
+      *numbers = realloc(*numbers, sizeof(uint64_t) * capacity);
+      ASSERT("Cannot initialize a new buffer: realloc returned size '0'.", *numbers != NULL);
+    }
+    (*numbers)[count++] = number;
+  }
+  closedir(dir);
+
+  if (count == 0)
+    return 0;
+  qsort(*numbers, count, sizeof(uint64_t), CompareNumbers);
+  // the segment is listed once if both its files exist
+  size_t unique = 1;
+  for (size_t i = 1; i < count; ++i)
+    if ((*numbers)[i] != (*numbers)[unique - 1])
+      (*numbers)[unique++] = (*numbers)[i];
+  return (int64_t) unique;
+}
+
+int MapFile(const char* path, StorageMapping_t* mapping)
+{
+  mapping->Data = NULL;
+  mapping->Size = 0;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+  // the empty file cannot be mapped
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return -1;
+  mapping->Data = (const uint8_t*) data;
+  mapping->Size = (size_t) st.st_size;
+  return 0;
+}
+
+void UnmapFile(StorageMapping_t* mapping)
+{
+  if (mapping->Data != NULL)
+    munmap((void*) mapping->Data, mapping->Size);
+  mapping->Data = NULL;
+  mapping->Size = 0;
+}
+
+int MapSegment(const char* directory,
+               uint64_t number,
+               StorageSegment_t* segment,
+               StorageQueryStats_t* stats,
+               char** error)
+{
+  char path[STORAGE_PATH_MAX_SIZE + 40];
+  snprintf(path, sizeof(path), "%s/" STORAGE_SEGMENT_FORMAT, directory, (unsigned long long) number);
+  segment->Compressed = false;
+  int rc = MapFile(path, &segment->File);
+  if (rc < 0 && errno == ENOENT) {
+    snprintf(path,
+             sizeof(path),
+             "%s/" STORAGE_SEGMENT_FORMAT STORAGE_COMPRESSED_SUFFIX,
+             directory,
+             (unsigned long long) number);
+    segment->Compressed = true;
+    rc = MapFile(path, &segment->File);
+  }
+  if (rc < 0) {
+    FormatStringBuffer(error, "Cannot read the segment '%s': %s", path, strerror(errno));
+    return -1;
+  }
+
+  segment->Size = segment->File.Size;
+  segment->BlocksCount = 0;
+  segment->Current = SIZE_MAX;
+  if (segment->Compressed) {
+    // the segment is created, but its header is not written yet
+    int64_t count = segment->File.Size < sizeof(CompressFileHeader_t)
+                        ? 0
+                        : CompressListBlocks(
+                              segment->File.Data, segment->File.Size, &segment->Blocks, &segment->BlocksCapacity);
+    if (count < 0) {
+      FormatStringBuffer(error, "Invalid segment '%s': it is not written by the storage.", path);
+      UnmapFile(&segment->File);
+      return -1;
+    }
+    segment->BlocksCount = (size_t) count;
+    segment->Size = 0;
+    for (size_t i = 0; i < segment->BlocksCount; ++i) {
+      const CompressBlock_t* block = &segment->Blocks[i];
+      segment->Size = block->RawOffset + block->RawSize;
+      if (block->RawSize > segment->BlockCapacity) {
+        segment->BlockCapacity = block->RawSize;
+        free(segment->Block);
+        segment->Block = malloc(segment->BlockCapacity);
+        ASSERT("Cannot initialize a new buffer: malloc returned size '0'.", segment->Block != NULL);
+      }
+    }
+  }
+  if (segment->Size < sizeof(PcapFileHeader_t))
+    return 0;
+
+  size_t available = 0;
+  PcapFileHeader_t header;
+  const uint8_t* data = ReadSegment(segment, 0, &available, stats);
+  if (data != NULL && available >= sizeof(header))
+    memcpy(&header, data, sizeof(header));
+  if (data == NULL || available < sizeof(header) || header.Magic != PCAP_MAGIC_NANOSECONDS) {
+    FormatStringBuffer(error, "Invalid segment '%s': it is not written by the storage.", path);
+    UnmapFile(&segment->File);
+    return -1;
+  }
+  segment->LinkType = header.LinkType;
+  return 0;
+}
+
+int QuerySegment(const char* directory,
+                 uint64_t number,
+                 StorageSegment_t* segment,
+                 const StorageQuery_t* q,
+                 StorageQueryHandler_t handler,
+                 void* args,
+                 StorageQueryStats_t* stats,
+                 char** error)
+{
+  if (MapSegment(directory, number, segment, stats, error) < 0)
+    return -1;
+  stats->Segments++;
+  // the segment is created, but its header is not written yet
+  if (segment->Size < sizeof(PcapFileHeader_t)) {
+    UnmapFile(&segment->File);
+    return 0;
+  }
+
+  // the segment without the valid index (the current segment, the skipped index) is scanned
+  char path[STORAGE_PATH_MAX_SIZE + 32];
+  snprintf(path, sizeof(path), "%s/" STORAGE_INDEX_FORMAT, directory, (unsigned long long) number);
+  StorageMapping_t index = {NULL, 0};
+  MapFile(path, &index);
+  const StorageIndexHeader_t* header = ReadIndex(&index, segment->Size);
+  if (header == NULL) {
+    stats->ScannedSegments++;
+    ScanSegment(segment, sizeof(PcapFileHeader_t), q, handler, args, stats);
+  } else if (header->Packets == 0 || header->LastNs < q->FromNs || header->FirstNs > q->ToNs)
+    stats->SkippedSegments++;
+  else {
+    stats->IndexedSegments++;
+    const StorageIndexFlow_t* flows = (const StorageIndexFlow_t*) (header + 1);
+    const StorageIndexTime_t* times = (const StorageIndexTime_t*) (flows + header->FlowsCount);
+    const uint32_t* offsets = (const uint32_t*) (times + header->TimeEntriesCount);
+    if (q->HasFlow) {
+      PacketView_t view;
+      memset(&view, 0, sizeof(view));
+      view.Protocol = q->Protocol;
+      view.SourceAddress = q->SourceAddress;
+      view.DestinationAddress = q->DestinationAddress;
+      view.SourcePort = q->SourcePort;
+      view.DestinationPort = q->DestinationPort;
+      uint64_t hash = GetFlowHash(&view);
+      size_t low = 0, high = header->FlowsCount;
+      while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (flows[middle].Hash < hash)
+          low = middle + 1;
+        else
+          high = middle;
+      }
+      // offsets of the flow are read in order, the time range ends the flow
+      bool found = low < header->FlowsCount && flows[low].Hash == hash &&
+                   (uint64_t) flows[low].First + flows[low].Count <= header->Packets;
+      for (uint32_t i = 0; found && i < flows[low].Count; ++i)
+        if (!ReadPacket(segment, offsets[flows[low].First + i], q, handler, args, stats, NULL))
+          break;
+    } else {
+      // the scan starts from the last time entry before the time range
+      size_t low = 0, high = header->TimeEntriesCount;
+      while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (times[middle].TimestampNs < q->FromNs)
+          low = middle + 1;
+        else
+          high = middle;
+      }
+      uint64_t offset = low > 0 ? times[low - 1].Offset : sizeof(PcapFileHeader_t);
+      ScanSegment(segment, offset, q, handler, args, stats);
+    }
+  }
+  UnmapFile(&index);
+  UnmapFile(&segment->File);
+  return 0;
+}
+
+void* WriteThread(void* args)
+{
+  StorageWriter_t* s = (StorageWriter_t*) args;
+
+  pthread_mutex_lock(&s->__mutex);
+  while (true) {
+    // submitted buffers are written before the thread stops
+    while (s->__running && s->__written == s->__submitted)
+      pthread_cond_wait(&s->__changed, &s->__mutex);
+    if (s->__written == s->__submitted)
+      break;
+    const StorageWriteBuffer_t* buffer = &s->__buffers[s->__written % STORAGE_WRITE_BUFFERS_COUNT];
+    pthread_mutex_unlock(&s->__mutex);
+
+    // the storage stops after the error, next segments are not created
+    if (buffer->Open && !s->__failed)
+      s->__failed = OpenSegment(s, buffer->Segment) < 0;
+    if (!s->__failed && !WriteBuffer(s, buffer)) {
+      close(s->__fd);
+      s->__fd = -1;
+      s->__failed = true;
+    }
+    if (s->__failed)
+      s->Errors += buffer->Packets;
+    else {
+      s->Packets += buffer->Packets;
+      s->Bytes += buffer->Size;
+    }
+    if (buffer->Close)
+      s->__fd = -1;
+
+    pthread_mutex_lock(&s->__mutex);
+    // the index of the segment which is not written is dropped
+    if (buffer->Index != NULL) {
+      s->__indexReady = !s->__failed;
+      if (s->__failed)
+        s->__pending = NULL;
+    }
+    s->__written++;
+    pthread_cond_broadcast(&s->__changed);
+  }
+  pthread_mutex_unlock(&s->__mutex);
+  return NULL;
+}
+
+void* IndexThread(void* args)
+{
+  StorageWriter_t* s = (StorageWriter_t*) args;
+
+  pthread_mutex_lock(&s->__mutex);
+  while (true) {
+    // the pending index is written before the thread stops
+    while (s->__running && !s->__indexReady)
+      pthread_cond_wait(&s->__changed, &s->__mutex);
+    if (!s->__indexReady)
+      break;
+    StorageIndexBuild_t* b = s->__pending;
+    pthread_mutex_unlock(&s->__mutex);
+
+    char* error = NULL;
+    int rc = WriteIndex(s->__directory, b, &error);
+
+    pthread_mutex_lock(&s->__mutex);
+    if (rc == 0)
+      s->Indexed++;
+    else {
+      free(s->ErrorMessage);
+      s->ErrorMessage = error;
+    }
+    s->__pending = NULL;
+    s->__indexReady = false;
+    pthread_cond_broadcast(&s->__changed);
+  }
+  pthread_mutex_unlock(&s->__mutex);
+  return NULL;
+}
+#endif
@@ -0,0 +1,264 @@
+#ifndef __STORAGE_H
+#define __STORAGE_H
+
+#include "compress.h"
+#include "pcap.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#endif
+
+#define STORAGE_PATH_MAX_SIZE 1024
+#define STORAGE_SEGMENT_MIN_SIZE (1024 * 1024)
+#define STORAGE_SEGMENT_MAX_SIZE (4ULL * 1024 * 1024 * 1024) // offsets of the index are 32-bit
+#define STORAGE_SEGMENT_DEFAULT_SIZE (256 * 1024 * 1024)
+#define STORAGE_SEGMENT_MAX_PACKETS (1024 * 1024)
+#define STORAGE_TIME_INDEX_INTERVAL 1024
+#define STORAGE_WRITE_BUFFER_SIZE (1024 * 1024)
+#define STORAGE_WRITE_BUFFERS_COUNT 4
+#define STORAGE_INDEX_MAGIC 0x5849534E // "NSIX"
+#define STORAGE_INDEX_VERSION 1
+#define STORAGE_SEGMENT_FORMAT "segment-%08llu.pcap"
+#define STORAGE_INDEX_FORMAT "segment-%08llu.idx"
+#define STORAGE_COMPRESSED_SUFFIX ".nsz" // the compressed segment (CompressFileHeader_t)
+
+/**
+ * @brief StorageIndexHeader_t
+ * The header of the index file of the segment. It is followed by flows (sorted by the hash), time entries and offsets
+ * of packets of each flow (in the order of the segment).
+ */
+typedef struct
+{
+  uint32_t Magic;            //! STORAGE_INDEX_MAGIC
+  uint32_t Version;          //! STORAGE_INDEX_VERSION
+  uint64_t Packets;          //! Packets of the segment (count of offsets)
+  uint64_t FirstNs;          //! The earliest timestamp of the segment (nanoseconds)
+  uint64_t LastNs;           //! The latest timestamp of the segment (nanoseconds)
+  uint64_t SegmentSize;      //! Bytes of the segment file
+  uint32_t FlowsCount;       //! StorageIndexFlow_t entries
+  uint32_t TimeEntriesCount; //! StorageIndexTime_t entries
+} StorageIndexHeader_t;
+
+/**
+ * @brief StorageIndexFlow_t
+ * Packets of the flow (by GetFlowHash(), 0 - packets that are not IPv4).
+ */
+typedef struct
+{
+  uint64_t Hash;  //! The hash of the flow
+  uint32_t First; //! The index of the first offset of the flow
+  uint32_t Count; //! Offsets of the flow
+} StorageIndexFlow_t;
+
+/**
+ * @brief StorageIndexTime_t
+ * The offset of each STORAGE_TIME_INDEX_INTERVAL-th packet.
+ */
+typedef struct
+{
+  uint64_t TimestampNs; //! The timestamp of the packet (nanoseconds)
+  uint64_t Offset;      //! The offset of its pcap record header
+} StorageIndexTime_t;
+
+/**
+ * @brief StorageIndexEntry_t
+ * The packet of the segment while the index is built.
+ */
+typedef struct
+{
+  uint64_t Hash;
+  uint32_t Offset;
+  uint32_t __reserved;
+} StorageIndexEntry_t;
+
+/**
+ * @brief StorageIndexBuild_t
+ * The index of the segment built by the capture thread and written by the index thread.
+ */
+typedef struct
+{
+  StorageIndexEntry_t* Entries; //! STORAGE_SEGMENT_MAX_PACKETS entries
+  StorageIndexTime_t* Times;    //! Time entries
+  size_t Count;                 //! Packets
+  size_t TimesCount;            //! Time entries
+  uint64_t FirstNs;             //! The earliest timestamp
+  uint64_t LastNs;              //! The latest timestamp
+  uint64_t SegmentSize;         //! Bytes of the segment
+  uint64_t Segment;             //! The number of the segment
+} StorageIndexBuild_t;
+
+/**
+ * @brief StorageWriteBuffer_t
+ * Records of the segment filled by the capture thread and written by the write thread.
+ */
+typedef struct
+{
+  uint8_t* Data;              //! STORAGE_WRITE_BUFFER_SIZE bytes
+  size_t Size;                //! Bytes of whole records
+  uint64_t Segment;           //! The number of the segment
+  uint64_t RawOffset;         //! The offset of the buffer in the segment
+  uint64_t Packets;           //! Packets of the buffer
+  bool Open;                  //! The first buffer of the segment (the write thread creates the segment)
+  bool Close;                 //! The last buffer of the segment (the write thread closes the segment)
+  StorageIndexBuild_t* Index; //! The index of the closed segment (NULL - the index is skipped)
+} StorageWriteBuffer_t;
+
+/**
+ * @brief StorageWriter_t
+ * Writes captured packets to pcap segment files of the directory, each segment has the sidecar index: its time range,
+ * offsets of packets of each flow and offsets of every STORAGE_TIME_INDEX_INTERVAL-th packet. The capture thread
+ * appends packets to buffers and entries of the index to the preallocated array, nothing is allocated per packet.
+ * Full buffers are handed to the write thread, which creates, writes and closes segment files, so the capture thread
+ * makes no system calls and only waits if all STORAGE_WRITE_BUFFERS_COUNT buffers are not written yet. The finished
+ * segment is rotated by the capture thread, its index is sorted and written by the index thread after the segment is
+ * closed. If the index of the previous segment is not written yet, the index of the segment is skipped (the query
+ * scans it), so the capture thread never waits for the index. Compressed segments (STORAGE_COMPRESSED_SUFFIX) are
+ * written in blocks of whole records by the compression pool (the write thread submits buffers), offsets of the index
+ * are offsets of the uncompressed segment. The writer is only available on Linux.
+ */
+typedef struct
+{
+  uint64_t Packets;      //! Written packets (changed by the write thread, read after the stop)
+  uint64_t Bytes;        //! Written bytes of segments (changed by the write thread, read after the stop)
+  uint64_t Segments;     //! Created segments (changed by the write thread, read after the stop)
+  uint64_t Errors;       //! Packets not written (the segment cannot be written)
+  uint64_t Stalls;       //! Waits of the capture thread for the written buffer
+  uint64_t IndexSkipped; //! Segments without the index
+  uint64_t Indexed;      //! Written indexes (changed by the index thread, read after the stop)
+  char* ErrorMessage;    //! Error messages (changed by threads of the storage after the start)
+  CompressPool_t* Compressor; //! Compresses blocks of segments (NULL - segments are not compressed)
+  // private fields
+  char __directory[STORAGE_PATH_MAX_SIZE];
+  uint64_t __segmentSize;
+  uint32_t __linkType;
+  uint64_t __segment;
+  uint64_t __offset; // bytes of the segment, including buffered bytes
+  StorageWriteBuffer_t __buffers[STORAGE_WRITE_BUFFERS_COUNT];
+  StorageWriteBuffer_t* __buffer; // the buffer filled by the capture thread
+  uint64_t __submitted; // buffers handed to the write thread
+  uint64_t __written; // buffers written by the write thread
+  int __fd; // the segment of the write thread
+  bool __failed; // the write thread stops after the error
+  StorageIndexBuild_t __builds[2];
+  StorageIndexBuild_t* __building;
+  StorageIndexBuild_t* __pending; // the index of the closed segment (NULL - the index thread is idle)
+  bool __indexReady; // the segment of the pending index is written
+  bool __running;
+#ifdef __linux__
+  pthread_t __writeThread;
+  pthread_t __indexThread;
+  pthread_mutex_t __mutex;
+  pthread_cond_t __changed;
+#endif
+} StorageWriter_t;
+
+/**
+ * @brief StorageQuery_t
+ * Packets of the query: the flow (in both directions) and the time range.
+ */
+typedef struct
+{
+  bool HasFlow;                //! Only packets of the flow
+  uint8_t Protocol;            //! Protocol number value of the flow
+  uint32_t SourceAddress;      //! Source IP of the flow (network byte order)
+  uint32_t DestinationAddress; //! Destination IP of the flow (network byte order)
+  uint16_t SourcePort;         //! Source port of the flow
+  uint16_t DestinationPort;    //! Destination port of the flow
+  uint64_t FromNs;             //! The earliest timestamp (0 - any)
+  uint64_t ToNs;               //! The latest timestamp (UINT64_MAX - any)
+} StorageQuery_t;
+
+/**
+ * @brief StorageQueryStats_t
+ * Counters of the query.
+ */
+typedef struct
+{
+  uint64_t Packets;         //! Matched packets
+  uint64_t Segments;        //! Segments of the directory
+  uint64_t SkippedSegments; //! Segments outside the time range (by the index)
+  uint64_t IndexedSegments; //! Segments read by the index
+  uint64_t ScannedSegments; //! Segments without the index (read from the beginning)
+  uint64_t ReadPackets;     //! Packets read from segments
+  uint64_t DecompressedBlocks; //! Blocks of compressed segments decompressed by the query
+} StorageQueryStats_t;
+
+typedef void (*StorageQueryHandler_t)(const PcapRecordHeader_t* header,
+                                      const uint8_t* data,
+                                      uint32_t linkType,
+                                      void* args);
+
+/**
+ * @brief StorageWriterInit
+ * Initializes values for the new storage writer object and allocates buffers.
+ * @param s The pointer to the storage writer object
+ * @param directory The directory of segments
+ * @param segmentSize Max bytes of the segment (STORAGE_SEGMENT_MIN_SIZE - STORAGE_SEGMENT_MAX_SIZE)
+ * @param linkType The link type of segments (PCAP_LINKTYPE_ETHERNET or PCAP_LINKTYPE_RAW)
+ */
+void StorageWriterInit(StorageWriter_t* s, const char* directory, uint64_t segmentSize, uint32_t linkType);
+/**
+ * @brief StorageWriterSetCompression
+ * Enables the compression of segments, blocks of segments are compressed by the pool of threads. It is called before
+ * the start.
+ * @param s The pointer to the storage writer object
+ * @param threads Compression threads (1 - COMPRESS_THREADS_MAX)
+ */
+void StorageWriterSetCompression(StorageWriter_t* s, size_t threads);
+/**
+ * @brief StorageWriterStart
+ * Creates the directory and the first segment (numbers continue after existing segments), starts the write thread and
+ * the index thread.
+ * @param s The pointer to the storage writer object
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int StorageWriterStart(StorageWriter_t* s);
+/**
+ * @brief StorageWriterWrite
+ * Appends packets to the segment, rotates the segment if it is full. Only the capture thread calls it.
+ * @param s The pointer to the storage writer object
+ * @param packets Packets
+ * @param count Packets count
+ */
+void StorageWriterWrite(StorageWriter_t* s, const SnifferPacket_t* packets, size_t count);
+/**
+ * @brief StorageWriterStop
+ * Closes the segment, writes its buffers and its index, stops the write thread and the index thread.
+ * @param s The pointer to the storage writer object
+ */
+void StorageWriterStop(StorageWriter_t* s);
+/**
+ * @brief StorageWriterClear
+ * Clears the passed storage writer object.
+ * @param s The pointer to the storage writer object
+ */
+void StorageWriterClear(StorageWriter_t* s);
+/**
+ * @brief StorageQueryInit
+ * Initializes the query of all packets.
+ * @param q The pointer to the query
+ */
+void StorageQueryInit(StorageQuery_t* q);
+/**
+ * @brief StorageQueryRun
+ * Reads packets of the query from segments of the directory, in the order of segments. Segments are mapped (mmap),
+ * indexed segments are only read at offsets of the flow or from the time entry before the time range.
+ * @param directory The directory of segments
+ * @param q The query
+ * @param handler Called for each matched packet
+ * @param args Argument of the handler
+ * @param stats Counters of the query
+ * @param error Error messages
+ * @return -1 if an error occurred, otherwise 0.
+ */
+int StorageQueryRun(const char* directory,
+                    const StorageQuery_t* q,
+                    StorageQueryHandler_t handler,
+                    void* args,
+                    StorageQueryStats_t* stats,
+                    char** error);
+
+#endif // __STORAGE_H
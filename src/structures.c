@@ -7,11 +7,12 @@
 #include <time.h>
 #include <stdio.h>
 
-#ifdef _WIN32
+#ifdef __linux__
+#include <arpa/inet.h>
+#elif _WIN32
 #include <Windows.h>
 #endif
 
-#define TIME_INFO_BUFFER_MAX_SIZE 14
 static const char* TIME_INFO_FORMAT = "%02d:%02d:%02d.%d";
 
 #ifndef _WIN32
@@ -73,6 +74,95 @@ Buffer_t GetPacketData(Buffer_t buf, size_t* offset)
   return buf + *offset;
 }
 
+size_t GetTCPV4HeaderLength(TCPV4Header_t* hdr)
+{
+  return (size_t) ((((const uint8_t*) hdr)[12] >> 4) * 4);
+}
+
+uint8_t GetTCPV4Flags(TCPV4Header_t* hdr)
+{
+  return ((const uint8_t*) hdr)[13];
+}
+
+int DecodePacketView(Buffer_t buf, size_t size, PacketView_t* view)
+{
+  memset(view, 0, sizeof(PacketView_t));
+  if (size < sizeof(IPHeader_t))
+    return -1;
+
+  IPHeader_t* iphdr = GetIPHeader(buf);
+  size_t hdrlen = GetIPHeaderLength(iphdr);
+  size_t totalLength = ntohs(iphdr->TotalLength);
+  if (iphdr->Version != 4 || hdrlen < sizeof(IPHeader_t) || hdrlen > size || totalLength < hdrlen)
+    return -1;
+
+  if (totalLength > size)
+    totalLength = size;
+
+  view->IPHeader = iphdr;
+  view->PacketSize = totalLength;
+  view->Protocol = iphdr->Protocol;
+  view->SourceAddress = iphdr->SourceAddress;
+  view->DestinationAddress = iphdr->DestinationAddress;
+
+  size_t protoOffset = hdrlen;
+  switch (iphdr->Protocol) {
+  case Protocol_ICMP: {
+    if (totalLength < hdrlen + sizeof(ICMPHeader_t))
+      return -1;
+    protoOffset += sizeof(ICMPHeader_t);
+    break;
+  }
+  case Protocol_TCP: {
+    if (totalLength < hdrlen + 20 /* minimal TCP header */)
+      return -1;
+
+    TCPV4Header_t* tcphdr = GetTCPV4Header(buf);
+    size_t tcplen = GetTCPV4HeaderLength(tcphdr);
+    if (tcplen < 20 || totalLength < hdrlen + tcplen)
+      return -1;
+
+    view->SourcePort = ntohs(tcphdr->SourcePort);
+    view->DestinationPort = ntohs(tcphdr->DestinationPort);
+    view->TCPFlags = GetTCPV4Flags(tcphdr);
+    view->SequenceNumber = ntohl(tcphdr->SequenceNumber);
+    view->AckNumber = ntohl(tcphdr->AckNumber);
+    // TCPV4Header_t::WindowSize is misaligned by the flags bit fields, the window is at the byte 14
+    const uint8_t* window = (const uint8_t*) tcphdr + 14;
+    view->WindowSize = (uint16_t) ((window[0] << 8) | window[1]);
+    protoOffset += tcplen;
+    break;
+  }
+  case Protocol_UDP: {
+    if (totalLength < hdrlen + sizeof(UDPHeader_t))
+      return -1;
+
+    UDPHeader_t* udphdr = GetUDPHeader(buf);
+    view->SourcePort = ntohs(udphdr->SourcePort);
+    view->DestinationPort = ntohs(udphdr->DestinationPort);
+    protoOffset += sizeof(UDPHeader_t);
+    break;
+  }
+  default:
+    break;
+  }
+
+  view->Payload = buf + protoOffset;
+  view->PayloadSize = totalLength - protoOffset;
+  return 0;
+}
+
+uint64_t GetFlowHash(const PacketView_t* view)
+{
+  uint64_t a = (uint64_t) view->SourceAddress << 16 | view->SourcePort;
+  uint64_t b = (uint64_t) view->DestinationAddress << 16 | view->DestinationPort;
+  uint64_t key = (a < b ? a * 31 + b : b * 31 + a) ^ view->Protocol;
+  // the finalizer of splitmix64, low bits of the key are not uniform
+  key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+  return key ^ (key >> 31);
+}
+
 void FilterInitDefaults(Filter_t* f)
 {
   if (f == NULL)
@@ -80,6 +170,7 @@ void FilterInitDefaults(Filter_t* f)
 
   f->Direction = Direction_ANY;
   f->Protocol = Protocol_ANY;
+  f->SNI[0] = '\0';
 }
 
 int GetTimeInfoNow(TimeInfo_t* ti, char** error)
@@ -138,7 +229,7 @@ int GetTimeInfoNow(TimeInfo_t* ti, char** error)
 
   static const uint32_t ul1e7 = 10000000;
   ti->TimestampSec = (time_t)(now.QuadPart / ul1e7);
-  ti->TimestampNanosec = (uint32_t)(now.QuadPart % ul1e7);
+  ti->TimestampNanosec = (uint32_t)(now.QuadPart % ul1e7) * 100 /* 100-nanosecond intervals */;
 
   SYSTEMTIME systemTimeNow;
   if (FileTimeToSystemTime(&fileTimeNow, &systemTimeNow) == 0) {
@@ -155,10 +246,14 @@ int GetTimeInfoNow(TimeInfo_t* ti, char** error)
   return 0;
 }
 
-void TimeInfoToString(TimeInfo_t* ti, char** buffer)
+uint64_t TimeInfoToMicroseconds(const TimeInfo_t* ti)
 {
-  *buffer = malloc(sizeof(char) * TIME_INFO_BUFFER_MAX_SIZE);
-  ASSERT("Cannot initialize a new string: realloc returned 'NULL'.", *buffer != NULL);
+  static const uint64_t ul1e6 = 1000000;
+  return (uint64_t) ti->TimestampSec * ul1e6 + ti->TimestampNanosec / 1000;
+}
 
-  snprintf(*buffer, TIME_INFO_BUFFER_MAX_SIZE, TIME_INFO_FORMAT, ti->Hours, ti->Minutes, ti->Seconds, ti->Milliseconds);
+size_t TimeInfoToString(const TimeInfo_t* ti, char* buffer, size_t bufferSize)
+{
+  int length = snprintf(buffer, bufferSize, TIME_INFO_FORMAT, ti->Hours, ti->Minutes, ti->Seconds, ti->Milliseconds);
+  return length < 0 ? 0 : (size_t) length;
 }
@@ -18,6 +18,7 @@
 #define IFACE_MAX_SIZE 24
 #define IP_MAX_SIZE 16
 #define ETH_MAX_PACKET_SIZE 65536
+#define TIME_INFO_BUFFER_MAX_SIZE 14
 #define ADDRESS_MAX_SIZE IP_MAX_SIZE + 1 /*:*/ + 4 /* port */
 
 /**
@@ -109,11 +110,48 @@ typedef struct
   uint16_t Length;
   uint16_t Checksum;
 } UDPHeader_t;
+/**
+ * @brief TCPFlag_t
+ * TCP flags (the 13th byte of the TCP header).
+ */
+typedef enum
+{
+  TCPFlag_FIN = 0x01,
+  TCPFlag_SYN = 0x02,
+  TCPFlag_RST = 0x04,
+  TCPFlag_PSH = 0x08,
+  TCPFlag_ACK = 0x10,
+  TCPFlag_URG = 0x20,
+  TCPFlag_ECE = 0x40,
+  TCPFlag_CWR = 0x80
+} TCPFlag_t;
 /**
  * @brief Buffer_t
  */
 typedef int8_t* Buffer_t;
 
+/**
+ * @brief PacketView_t
+ * Decoded view of the IPv4 packet. Addresses are in the network byte order, other numbers are in the host byte order.
+ * The payload points into the packet buffer.
+ */
+typedef struct
+{
+  IPHeader_t* IPHeader;        //! The IP header
+  size_t PacketSize;           //! IP total length (bounded by the captured size)
+  uint8_t Protocol;            //! Protocol number value
+  uint32_t SourceAddress;      //! Source IP (network byte order)
+  uint32_t DestinationAddress; //! Destination IP (network byte order)
+  uint16_t SourcePort;         //! Source port (TCP, UDP)
+  uint16_t DestinationPort;    //! Destination port (TCP, UDP)
+  uint8_t TCPFlags;            //! TCP flags (see TCPFlag_t)
+  uint32_t SequenceNumber;     //! TCP sequence number
+  uint32_t AckNumber;          //! TCP acknowledgment number
+  uint16_t WindowSize;         //! TCP window size
+  Buffer_t Payload;            //! The pointer to the protocol payload
+  size_t PayloadSize;          //! Size of the protocol payload
+} PacketView_t;
+
 #ifdef __linux__
 /**
  * @brief GetETHHeader
@@ -159,6 +197,18 @@ TCPV4Header_t* GetTCPV4Header(Buffer_t buf);
  * @returns A pointer to the UDP header structure.
  */
 UDPHeader_t* GetUDPHeader(Buffer_t buf);
+/**
+ * @brief GetTCPV4HeaderLength
+ * @param hdr The pointer to the TCP header object.
+ * @returns A length of this TCP header (the data offset field).
+ */
+size_t GetTCPV4HeaderLength(TCPV4Header_t* hdr);
+/**
+ * @brief GetTCPV4Flags
+ * @param hdr The pointer to the TCP header object.
+ * @returns TCP flags (see TCPFlag_t).
+ */
+uint8_t GetTCPV4Flags(TCPV4Header_t* hdr);
 /**
  * @brief GetPacketData
  * Sets a pointer to the packet data. Stores an offset (IP header length + Protocol header length) to the second
@@ -168,6 +218,23 @@ UDPHeader_t* GetUDPHeader(Buffer_t buf);
  * @returns The pointer to the packet data.
  */
 Buffer_t GetPacketData(Buffer_t buf, size_t* offset);
+/**
+ * @brief DecodePacketView
+ * Decodes IP and protocol headers of the network packet. All lengths are checked against the passed size.
+ * @param buf The pointer to the network packet without the ETH header
+ * @param size Size of the network packet
+ * @param view The pointer to the decoded view
+ * @returns -1 if this packet is not an IPv4 packet or it is truncated, otherwise 0.
+ */
+int DecodePacketView(Buffer_t buf, size_t size, PacketView_t* view);
+/**
+ * @brief GetFlowHash
+ * The hash of addresses, ports and the protocol. It does not depend on the direction, both directions of the flow have
+ * the same hash.
+ * @param view The decoded view of the packet
+ * @returns The hash of the flow.
+ */
+uint64_t GetFlowHash(const PacketView_t* view);
 
 /**
  * @brief Direction_t
@@ -191,6 +258,7 @@ typedef struct
 } Address_t;
 
 #define ADDRESSES_MAX_COUNT 20
+#define SNI_PATTERN_MAX_SIZE 256
 
 /**
  * @brief Filter_t
@@ -200,6 +268,7 @@ typedef struct
 {
   Direction_t Direction;
   Protocol_t Protocol;
+  char SNI[SNI_PATTERN_MAX_SIZE]; //! TLS server name pattern, for example '*.example.com' (empty to match any packet)
 } Filter_t;
 /**
  * @brief FilterInitDefaults
@@ -229,12 +298,20 @@ typedef struct
  * @return -1 if an error occurred, otherwise 0.
  */
 int GetTimeInfoNow(TimeInfo_t* ti, char** error);
+/**
+ * @brief TimeInfoToMicroseconds
+ * @param ti The pointer to the TimeInfo_t structure
+ * @return The timestamp in microseconds.
+ */
+uint64_t TimeInfoToMicroseconds(const TimeInfo_t* ti);
 /**
  * @brief TimeInfoToString
- * Convert TimeInfo_t to a string.
+ * Convert TimeInfo_t to a string "HH:MM:SS.mmm".
  * @param ti The pointer to the TimeInfo_t structure
- * @param buffer The pointer to the result.
+ * @param buffer The buffer (TIME_INFO_BUFFER_MAX_SIZE bytes are sufficient)
+ * @param bufferSize The size of the buffer
+ * @return The length of the string.
  */
-void TimeInfoToString(TimeInfo_t* ti, char** buffer);
+size_t TimeInfoToString(const TimeInfo_t* ti, char* buffer, size_t bufferSize);
 
 #endif // __STRUCTURES_H
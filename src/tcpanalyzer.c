@@ -0,0 +1,310 @@
+#include "tcpanalyzer.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TCP_FLOW_PROBES_COUNT 8
+
+static TcpFlow_t* FindFlow(TcpAnalyzer_t* a, const PacketView_t* view);
+static void ResetFlow(TcpAnalyzer_t* a, TcpFlow_t* flow, const PacketView_t* view, uint64_t now);
+static void ProcessData(TcpAnalyzer_t* a, TcpFlow_t* flow, int dir, const PacketView_t* view, uint64_t now,
+                        TcpEvent_t* event);
+static void ProcessAck(TcpAnalyzer_t* a, TcpFlow_t* flow, int dir, const PacketView_t* view, uint64_t now,
+                       TcpEvent_t* event);
+static uint64_t FlowScore(const TcpFlow_t* flow);
+
+/*
+ * Sequence numbers are compared modulo 2^32 (RFC 1982).
+ */
+static inline bool SeqBefore(uint32_t a, uint32_t b)
+{
+  return (int32_t) (a - b) < 0;
+}
+
+static inline bool SeqAfter(uint32_t a, uint32_t b)
+{
+  return (int32_t) (a - b) > 0;
+}
+
+void TcpAnalyzerInit(TcpAnalyzer_t* a, size_t capacity)
+{
+  ASSERT("Cannot init the TCP analyzer: a == NULL.", a != NULL);
+
+  size_t pow2 = 1;
+  while (pow2 < capacity)
+    pow2 <<= 1;
+
+  a->Flows = 0;
+  a->ClosedFlows = 0;
+  a->Evicted = 0;
+  a->Segments = 0;
+  a->Retransmissions = 0;
+  a->OutOfOrder = 0;
+  a->DupAcks = 0;
+  a->ZeroWindows = 0;
+  HistogramInit(&a->HandshakeRtt);
+  HistogramInit(&a->DataRtt);
+
+  a->__flows = calloc(pow2, sizeof(TcpFlow_t));
+  ASSERT("Cannot initialize a new TCP flows table: calloc returned 'NULL'.", a->__flows != NULL);
+  a->__capacity = pow2;
+}
+
+int TcpAnalyzerProcess(TcpAnalyzer_t* a, const PacketView_t* view, const TimeInfo_t* time, TcpEvent_t* event)
+{
+  event->Analysis = TcpAnalysis_NONE;
+  event->RttUs = 0;
+  event->HandshakeRttUs = 0;
+  event->Closed = false;
+  if (view->Protocol != Protocol_TCP)
+    return 0;
+
+  uint64_t now = TimeInfoToMicroseconds(time);
+  bool syn = (view->TCPFlags & (TCPFlag_SYN | TCPFlag_ACK)) == TCPFlag_SYN;
+
+  TcpFlow_t* flow = FindFlow(a, view);
+  if (!flow->Used) {
+    ResetFlow(a, flow, view, now);
+  } else if (syn && (flow->Closed || flow->Dirs[0].NextSeq != view->SequenceNumber + 1)) {
+    // the 4-tuple is reused by the new connection (the same ISN is the SYN retransmission)
+    ResetFlow(a, flow, view, now);
+  } else if (flow->Closed) {
+    return 0; // the last ACK of the closed flow
+  }
+
+  a->Segments++;
+  flow->Packets++;
+  flow->Bytes += view->PacketSize;
+  flow->LastSeenUs = now;
+
+  int dir = (view->SourceAddress == flow->ClientAddress && view->SourcePort == flow->ClientPort) ? 0 : 1;
+  ProcessData(a, flow, dir, view, now, event);
+  if (view->TCPFlags & TCPFlag_ACK)
+    ProcessAck(a, flow, dir, view, now, event);
+
+  if (view->TCPFlags & TCPFlag_FIN)
+    flow->Dirs[dir].FinSeen = true;
+  if (view->TCPFlags & TCPFlag_RST || (flow->Dirs[0].FinSeen && flow->Dirs[1].FinSeen)) {
+    flow->Closed = true;
+    a->ClosedFlows++;
+    event->Closed = true;
+    memcpy(&event->Flow, flow, sizeof(TcpFlow_t));
+  }
+
+  return event->Analysis != TcpAnalysis_NONE || event->Closed ? 1 : 0;
+}
+
+size_t TcpAnalyzerWorstFlows(const TcpAnalyzer_t* a, const TcpFlow_t** flows, size_t maxCount)
+{
+  size_t count = 0;
+  for (size_t i = 0; i < a->__capacity && maxCount > 0; ++i) {
+    const TcpFlow_t* flow = &a->__flows[i];
+    if (!flow->Used || flow->Closed)
+      continue;
+
+    // insertion into the sorted array of the worst flows
+    uint64_t score = FlowScore(flow);
+    size_t pos = count < maxCount ? count++ : maxCount;
+    while (pos > 0 && FlowScore(flows[pos - 1]) < score) {
+      if (pos < maxCount)
+        flows[pos] = flows[pos - 1];
+      --pos;
+    }
+    if (pos < maxCount)
+      flows[pos] = flow;
+  }
+  return count;
+}
+
+void TcpAnalyzerClear(TcpAnalyzer_t* a)
+{
+  if (a == NULL)
+    return;
+
+  free(a->__flows);
+  a->__flows = NULL;
+}
+
+TcpFlow_t* FindFlow(TcpAnalyzer_t* a, const PacketView_t* view)
+{
+  /*
+   * The hash does not depend on the direction, both directions share one entry. If the flow is not found, the free
+   * slot or the least recently seen flow is returned.
+   */
+  uint64_t x = (uint64_t) view->SourceAddress << 16 | view->SourcePort;
+  uint64_t y = (uint64_t) view->DestinationAddress << 16 | view->DestinationPort;
+  uint64_t key = (x < y ? x * 31 + y : y * 31 + x) * 0x9E3779B97F4A7C15ULL;
+  size_t index = (size_t) (key >> 32) & (a->__capacity - 1);
+
+  TcpFlow_t* freeSlot = NULL;
+  TcpFlow_t* oldest = NULL;
+  for (size_t i = 0; i < TCP_FLOW_PROBES_COUNT; ++i) {
+    TcpFlow_t* flow = &a->__flows[(index + i) & (a->__capacity - 1)];
+    if (!flow->Used) {
+      if (freeSlot == NULL)
+        freeSlot = flow;
+      continue;
+    }
+
+    if ((flow->ClientAddress == view->SourceAddress && flow->ClientPort == view->SourcePort &&
+         flow->ServerAddress == view->DestinationAddress && flow->ServerPort == view->DestinationPort) ||
+        (flow->ClientAddress == view->DestinationAddress && flow->ClientPort == view->DestinationPort &&
+         flow->ServerAddress == view->SourceAddress && flow->ServerPort == view->SourcePort))
+      return flow;
+
+    if (oldest == NULL || flow->LastSeenUs < oldest->LastSeenUs)
+      oldest = flow;
+  }
+
+  if (freeSlot != NULL)
+    return freeSlot;
+
+  if (!oldest->Closed)
+    a->Evicted++;
+  oldest->Used = false;
+  return oldest;
+}
+
+void ResetFlow(TcpAnalyzer_t* a, TcpFlow_t* flow, const PacketView_t* view, uint64_t now)
+{
+  memset(flow, 0, sizeof(TcpFlow_t));
+  flow->Used = true;
+
+  // the sender of the SYN-ACK is the server, otherwise the first seen sender is the client
+  bool synAck = (view->TCPFlags & (TCPFlag_SYN | TCPFlag_ACK)) == (TCPFlag_SYN | TCPFlag_ACK);
+  flow->ClientAddress = synAck ? view->DestinationAddress : view->SourceAddress;
+  flow->ClientPort = synAck ? view->DestinationPort : view->SourcePort;
+  flow->ServerAddress = synAck ? view->SourceAddress : view->DestinationAddress;
+  flow->ServerPort = synAck ? view->SourcePort : view->DestinationPort;
+  flow->StartUs = now;
+  a->Flows++;
+}
+
+void ProcessData(TcpAnalyzer_t* a, TcpFlow_t* flow, int dir, const PacketView_t* view, uint64_t now,
+                 TcpEvent_t* event)
+{
+  /*
+   * SYN and FIN occupy one sequence number, so their retransmissions are detected as data retransmissions.
+   */
+  bool syn = view->TCPFlags & TCPFlag_SYN;
+  uint32_t seq = view->SequenceNumber;
+  uint32_t length = (uint32_t) view->PayloadSize + (syn ? 1 : 0) + (view->TCPFlags & TCPFlag_FIN ? 1 : 0);
+  if (length == 0 || view->TCPFlags & TCPFlag_RST)
+    return;
+
+  TcpDirection_t* d = &flow->Dirs[dir];
+  uint32_t end = seq + length;
+  bool newData = false, retransmission = false;
+
+  if (!d->Initialized) {
+    d->Initialized = true;
+    newData = true;
+    if (syn && dir == 0 && !(view->TCPFlags & TCPFlag_ACK))
+      flow->SynUs = now;
+  } else if (!SeqBefore(seq, d->NextSeq)) {
+    d->GapPending = SeqAfter(seq, d->NextSeq); // the previous segments are lost or reordered
+    newData = true;
+  } else if (SeqAfter(end, d->NextSeq)) {
+    retransmission = true; // partially new data
+  } else if (view->PayloadSize == 1 && length == 1 && end == d->NextSeq) {
+    return; // keep-alive (one byte before the next sequence number)
+  } else {
+    // the old data: reordered if it fills the recent gap faster than the RTT
+    uint64_t threshold = flow->RttCount > 0 ? flow->RttMinUs : TCP_OUT_OF_ORDER_THRESHOLD_US;
+    if (d->GapPending && now - d->LastDataUs < threshold) {
+      event->Analysis |= TcpAnalysis_OUT_OF_ORDER;
+      flow->OutOfOrder++;
+      a->OutOfOrder++;
+    } else {
+      retransmission = true;
+    }
+  }
+
+  if (retransmission) {
+    event->Analysis |= TcpAnalysis_RETRANSMISSION;
+    flow->Retransmissions++;
+    a->Retransmissions++;
+    // Karn's algorithm: the ACK of the retransmitted data is ambiguous
+    if (d->SampleValid && SeqBefore(seq, d->SampleEnd))
+      d->SampleValid = false;
+    if (syn)
+      flow->SynUs = 0;
+  }
+
+  if (SeqAfter(end, d->NextSeq) || newData) {
+    d->NextSeq = end;
+    d->LastDataUs = now;
+  }
+
+  // only data is timed, the ACK of the FIN is often delayed by the application
+  if (newData && view->PayloadSize > 0 && !d->SampleValid) {
+    d->SampleValid = true;
+    d->SampleEnd = end;
+    d->SampleTimeUs = now;
+  }
+}
+
+void ProcessAck(TcpAnalyzer_t* a, TcpFlow_t* flow, int dir, const PacketView_t* view, uint64_t now,
+                TcpEvent_t* event)
+{
+  TcpDirection_t* d = &flow->Dirs[dir];
+  TcpDirection_t* peer = &flow->Dirs[1 - dir];
+  uint32_t ack = view->AckNumber;
+  bool control = view->TCPFlags & (TCPFlag_SYN | TCPFlag_FIN | TCPFlag_RST);
+
+  // the client acknowledged the SYN-ACK
+  if (dir == 0 && flow->SynUs != 0 && !flow->HandshakeDone && peer->Initialized && !SeqBefore(ack, peer->NextSeq)) {
+    flow->HandshakeDone = true;
+    flow->HandshakeRttUs = now - flow->SynUs;
+    event->Analysis |= TcpAnalysis_HANDSHAKE_RTT;
+    event->HandshakeRttUs = flow->HandshakeRttUs;
+    HistogramAdd(&a->HandshakeRtt, flow->HandshakeRttUs);
+  }
+
+  if (peer->SampleValid && !SeqBefore(ack, peer->SampleEnd)) {
+    uint64_t rtt = now - peer->SampleTimeUs;
+    peer->SampleValid = false;
+    event->Analysis |= TcpAnalysis_DATA_RTT;
+    event->RttUs = rtt;
+    HistogramAdd(&a->DataRtt, rtt);
+
+    uint32_t rtt32 = rtt < UINT32_MAX ? (uint32_t) rtt : UINT32_MAX;
+    if (flow->RttCount == 0 || rtt32 < flow->RttMinUs)
+      flow->RttMinUs = rtt32;
+    if (rtt32 > flow->RttMaxUs)
+      flow->RttMaxUs = rtt32;
+    flow->RttSumUs += rtt;
+    flow->RttCount++;
+  }
+
+  // the same ACK and window while the peer has unacknowledged data
+  if (view->PayloadSize == 0 && !control && d->AckSeen && ack == d->LastAck && view->WindowSize == d->LastWindow &&
+      peer->Initialized && SeqAfter(peer->NextSeq, ack)) {
+    event->Analysis |= TcpAnalysis_DUP_ACK;
+    flow->DupAcks++;
+    a->DupAcks++;
+  }
+
+  if (!(view->TCPFlags & (TCPFlag_SYN | TCPFlag_RST))) {
+    if (view->WindowSize == 0 && !d->ZeroWindow) {
+      d->ZeroWindow = true;
+      event->Analysis |= TcpAnalysis_ZERO_WINDOW;
+      flow->ZeroWindows++;
+      a->ZeroWindows++;
+    } else if (view->WindowSize != 0 && d->ZeroWindow) {
+      d->ZeroWindow = false;
+      event->Analysis |= TcpAnalysis_WINDOW_OPEN;
+    }
+  }
+
+  if (!d->AckSeen || SeqAfter(ack, d->LastAck))
+    d->LastAck = ack;
+  d->LastWindow = view->WindowSize;
+  d->AckSeen = true;
+}
+
+uint64_t FlowScore(const TcpFlow_t* flow)
+{
+  return (uint64_t) flow->Retransmissions + flow->OutOfOrder + flow->DupAcks + flow->ZeroWindows;
+}
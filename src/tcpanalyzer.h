@@ -0,0 +1,146 @@
+#ifndef __TCPANALYZER_H
+#define __TCPANALYZER_H
+
+#include "structures.h"
+#include "histogram.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TCP_FLOWS_DEFAULT_CAPACITY 16384
+#define TCP_OUT_OF_ORDER_THRESHOLD_US 3000 /* 3 ms, if the RTT of the flow is unknown */
+
+/**
+ * @brief TcpAnalysis_t
+ * Events detected in the TCP segment (bit flags).
+ */
+typedef enum
+{
+  TcpAnalysis_NONE = 0,
+  TcpAnalysis_RETRANSMISSION = 1, //! The segment carries already sent data
+  TcpAnalysis_OUT_OF_ORDER = 2,   //! The segment fills the gap shortly after later data (reordering, not a loss)
+  TcpAnalysis_DUP_ACK = 4,        //! Pure ACK which does not advance the acknowledged data or the window
+  TcpAnalysis_ZERO_WINDOW = 8,    //! The receive window of the sender is closed
+  TcpAnalysis_WINDOW_OPEN = 16,   //! The receive window was reopened after the zero window
+  TcpAnalysis_DATA_RTT = 32,      //! The segment acknowledged the timed data (TcpEvent_t::RttUs is valid)
+  TcpAnalysis_HANDSHAKE_RTT = 64  //! The segment finished the handshake (TcpEvent_t::HandshakeRttUs is valid)
+} TcpAnalysis_t;
+
+/**
+ * @brief TcpDirection_t
+ * State of one direction of the TCP flow.
+ */
+typedef struct
+{
+  bool Initialized;      //! The sequence number of this sender is known
+  bool GapPending;       //! The last new data was sent after a sequence gap
+  bool AckSeen;          //! LastAck and LastWindow are valid
+  bool ZeroWindow;       //! The last advertised window was 0
+  bool FinSeen;          //! The sender closed this direction
+  bool SampleValid;      //! The RTT sample is pending
+  uint16_t LastWindow;   //! The last advertised window
+  uint32_t NextSeq;      //! The highest sequence number sent + 1
+  uint32_t LastAck;      //! The highest acknowledged sequence number of the peer
+  uint32_t SampleEnd;    //! The peer must acknowledge this sequence number to finish the RTT sample
+  uint64_t SampleTimeUs; //! Time of the timed segment
+  uint64_t LastDataUs;   //! Time of the last new data
+} TcpDirection_t;
+
+/**
+ * @brief TcpFlow_t
+ * Small fixed-size state and counters of the TCP flow. The client is the sender of the SYN (or the first seen sender).
+ */
+typedef struct
+{
+  bool Used;
+  bool Closed;             //! Both FINs or RST were seen
+  bool HandshakeDone;      //! HandshakeRttUs is valid
+  uint32_t ClientAddress;  //! Network byte order
+  uint32_t ServerAddress;  //! Network byte order
+  uint16_t ClientPort;     //! Host byte order
+  uint16_t ServerPort;     //! Host byte order
+  TcpDirection_t Dirs[2];  //! 0 - client to server, 1 - server to client
+  uint64_t StartUs;        //! Time of the first segment
+  uint64_t LastSeenUs;     //! Time of the last segment
+  uint64_t SynUs;          //! Time of the SYN (0 if not seen or retransmitted)
+  uint64_t HandshakeRttUs; //! Time between the SYN and the ACK of the SYN-ACK
+  uint64_t Bytes;          //! Bytes of all packets
+  uint32_t Packets;        //! Packets count
+  uint32_t Retransmissions;
+  uint32_t OutOfOrder;
+  uint32_t DupAcks;
+  uint32_t ZeroWindows;
+  uint32_t RttCount; //! Data RTT samples
+  uint32_t RttMinUs;
+  uint32_t RttMaxUs;
+  uint64_t RttSumUs;
+} TcpFlow_t;
+
+/**
+ * @brief TcpEvent_t
+ * The result of processing a TCP segment by the analyzer.
+ */
+typedef struct
+{
+  uint32_t Analysis;       //! TcpAnalysis_t flags
+  uint64_t RttUs;          //! Data RTT sample finished by this segment
+  uint64_t HandshakeRttUs; //! Handshake RTT finished by this segment
+  bool Closed;             //! The flow was closed by this segment, Flow is valid
+  TcpFlow_t Flow;          //! Summary of the closed flow
+} TcpEvent_t;
+
+/**
+ * @brief TcpAnalyzer_t
+ * Tracks sequence ranges of TCP flows: RTT, retransmissions, duplicate ACKs, out-of-order segments and zero windows.
+ */
+typedef struct
+{
+  uint64_t Flows;           //! Tracked flows
+  uint64_t ClosedFlows;     //! Flows closed by both FINs or RST
+  uint64_t Evicted;         //! Open flows evicted from the table
+  uint64_t Segments;        //! Analyzed segments
+  uint64_t Retransmissions; //! Retransmitted segments
+  uint64_t OutOfOrder;      //! Out-of-order segments
+  uint64_t DupAcks;         //! Duplicate ACKs
+  uint64_t ZeroWindows;     //! Zero window advertisements (the window was open before)
+  Histogram_t HandshakeRtt; //! Handshake RTT (microseconds)
+  Histogram_t DataRtt;      //! Data RTT (microseconds)
+  // private fields
+  TcpFlow_t* __flows;
+  size_t __capacity;
+} TcpAnalyzer_t;
+
+/**
+ * @brief TcpAnalyzerInit
+ * Initializes values for the new analyzer object.
+ * @param a The pointer to the analyzer object
+ * @param capacity Max count of tracked flows (rounded up to the power of two)
+ */
+void TcpAnalyzerInit(TcpAnalyzer_t* a, size_t capacity);
+/**
+ * @brief TcpAnalyzerProcess
+ * Updates the state of the flow of the TCP segment. RTT is sampled from the SYN and the ACK of the SYN-ACK, and from
+ * new data and the ACK which covers it. Retransmitted data is not sampled (Karn's algorithm).
+ * @param a The pointer to the analyzer object
+ * @param view The decoded packet
+ * @param time The packet timestamp
+ * @param event The pointer to the result
+ * @return 1 if something was detected (event->Analysis or the closed flow), otherwise 0.
+ */
+int TcpAnalyzerProcess(TcpAnalyzer_t* a, const PacketView_t* view, const TimeInfo_t* time, TcpEvent_t* event);
+/**
+ * @brief TcpAnalyzerWorstFlows
+ * Selects open flows with the most retransmissions, out-of-order segments and duplicate ACKs.
+ * @param a The pointer to the analyzer object
+ * @param flows The array for selected flows
+ * @param maxCount The size of the array
+ * @return The count of selected flows.
+ */
+size_t TcpAnalyzerWorstFlows(const TcpAnalyzer_t* a, const TcpFlow_t** flows, size_t maxCount);
+/**
+ * @brief TcpAnalyzerClear
+ * Clears the passed analyzer object.
+ * @param a The pointer to the analyzer object
+ */
+void TcpAnalyzerClear(TcpAnalyzer_t* a);
+
+#endif // __TCPANALYZER_H
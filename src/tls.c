@@ -0,0 +1,510 @@
+#include "tls.h"
+#include "utils.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TLS_RECORD_HEADER_SIZE 5
+#define TLS_HANDSHAKE_HEADER_SIZE 4
+#define TLS_RANDOM_SIZE 32
+#define TLS_CONTENT_TYPE_HANDSHAKE 22
+#define TLS_HANDSHAKE_CLIENT_HELLO 1
+#define TLS_EXTENSION_SERVER_NAME 0
+#define TLS_EXTENSION_SUPPORTED_GROUPS 10
+#define TLS_EXTENSION_EC_POINT_FORMATS 11
+#define TLS_EXTENSION_ALPN 16
+#define TLS_EXTENSION_SUPPORTED_VERSIONS 43
+#define TLS_FLOW_PROBES_COUNT 8
+#define TLS_FNV_OFFSET 14695981039346656037ULL
+#define TLS_FNV_PRIME 1099511628211ULL
+
+/**
+ * @brief TlsReader_t
+ * Bounds-checked reader of the ClientHello message.
+ */
+typedef struct
+{
+  const uint8_t* Data;
+  size_t Position;
+  size_t End;
+} TlsReader_t;
+
+/**
+ * @brief TlsField_t
+ * Fields of the fingerprint.
+ */
+typedef enum
+{
+  TlsField_CIPHERS = 0,
+  TlsField_EXTENSIONS,
+  TlsField_GROUPS,
+  TlsField_FORMATS,
+  TlsField_COUNT
+} TlsField_t;
+
+static bool ReadU8(TlsReader_t* r, uint8_t* value);
+static bool ReadU16(TlsReader_t* r, uint16_t* value);
+static bool Skip(TlsReader_t* r, size_t size);
+static bool IsGrease(uint16_t value);
+static uint64_t HashU16(uint64_t hash, uint16_t value);
+static void ParseBody(TlsReader_t* r, TlsClientHello_t* hello, uint64_t* fields);
+static void ParseExtension(const uint8_t* data, size_t size, uint16_t type, TlsClientHello_t* hello, uint64_t* fields);
+static void ParseServerName(TlsReader_t* r, TlsClientHello_t* hello);
+static void ParseALPN(TlsReader_t* r, TlsClientHello_t* hello);
+static TlsFlow_t* FindFlow(TlsTracker_t* t, const PacketView_t* view, bool insert);
+static int FindSNI(TlsTracker_t* t, const char* sni);
+static uint32_t MatchPatterns(TlsTracker_t* t, const char* sni);
+
+int TlsParseClientHello(const uint8_t* data, size_t size, TlsClientHello_t* hello)
+{
+  hello->RecordVersion = 0;
+  hello->ClientVersion = 0;
+  hello->MaxSupportedVersion = 0;
+  hello->CipherSuitesCount = 0;
+  hello->ExtensionsCount = 0;
+  hello->SNI[0] = '\0';
+  hello->ALPN[0] = '\0';
+  hello->Fingerprint = 0;
+  hello->Truncated = false;
+
+  // record header: type, version, length; handshake header: type, 24-bit length
+  if (size < TLS_RECORD_HEADER_SIZE + TLS_HANDSHAKE_HEADER_SIZE + 2)
+    return -1;
+  if (data[0] != TLS_CONTENT_TYPE_HANDSHAKE || data[1] != 3 || data[2] > 4 ||
+      data[5] != TLS_HANDSHAKE_CLIENT_HELLO)
+    return -1;
+
+  size_t helloSize = (size_t) data[6] << 16 | (size_t) data[7] << 8 | data[8];
+  size_t end = TLS_RECORD_HEADER_SIZE + TLS_HANDSHAKE_HEADER_SIZE + helloSize;
+  if (end > size) {
+    hello->Truncated = true;
+    end = size;
+  }
+
+  TlsReader_t r = {data, TLS_RECORD_HEADER_SIZE + TLS_HANDSHAKE_HEADER_SIZE, end};
+  hello->RecordVersion = (uint16_t) (data[1] << 8 | data[2]);
+  ReadU16(&r, &hello->ClientVersion);
+  if (hello->ClientVersion >> 8 != 3)
+    return -1;
+
+  /*
+   * The fingerprint covers the same fields as JA3: version, cipher suites, extensions, supported groups and point
+   * formats (without GREASE values). Every field is hashed separately, so the order of extensions does not mix
+   * groups and formats with the extensions list.
+   */
+  uint64_t fields[TlsField_COUNT] = {TLS_FNV_OFFSET, TLS_FNV_OFFSET, TLS_FNV_OFFSET, TLS_FNV_OFFSET};
+  ParseBody(&r, hello, fields);
+
+  hello->Fingerprint = HashU16(TLS_FNV_OFFSET, hello->ClientVersion);
+  for (size_t i = 0; i < TlsField_COUNT; ++i) {
+    for (int shift = 0; shift < 64; shift += 16)
+      hello->Fingerprint = HashU16(hello->Fingerprint, (uint16_t) (fields[i] >> shift));
+  }
+  return 0;
+}
+
+const char* TlsVersionToString(uint16_t version)
+{
+  switch (version) {
+  case 0x0300:
+    return "SSL 3.0";
+  case 0x0301:
+    return "TLS 1.0";
+  case 0x0302:
+    return "TLS 1.1";
+  case 0x0303:
+    return "TLS 1.2";
+  case 0x0304:
+    return "TLS 1.3";
+  default:
+    return "unknown";
+  }
+}
+
+bool TlsMatchSNI(const char* pattern, const char* sni)
+{
+  const char* star = NULL;
+  const char* resume = NULL;
+  while (*sni != '\0') {
+    if (*pattern == '*') {
+      star = pattern++;
+      resume = sni;
+    } else if (*pattern != '\0' && tolower((unsigned char) *pattern) == tolower((unsigned char) *sni)) {
+      ++pattern;
+      ++sni;
+    } else if (star != NULL) {
+      pattern = star + 1;
+      sni = ++resume;
+    } else {
+      return false;
+    }
+  }
+  while (*pattern == '*')
+    ++pattern;
+  return *pattern == '\0';
+}
+
+void TlsTrackerInit(TlsTracker_t* t, size_t capacity)
+{
+  ASSERT("Cannot init the TLS tracker: t == NULL.", t != NULL);
+
+  size_t pow2 = 1;
+  while (pow2 < capacity)
+    pow2 <<= 1;
+
+  t->ClientHellos = 0;
+  t->Truncated = 0;
+  t->NotTls = 0;
+  t->Evicted = 0;
+
+  t->SNIs = malloc(sizeof(TlsSNIStats_t) * TLS_SNI_STATS_MAX_COUNT);
+  ASSERT("Cannot initialize a new TLS server names table: malloc returned 'NULL'.", t->SNIs != NULL);
+  t->SNIsCount = 0;
+  memset(&t->OtherSNIs, 0, sizeof(t->OtherSNIs));
+  strncpy(t->OtherSNIs.SNI, "(other names)", TLS_SNI_MAX_SIZE);
+
+  t->__patternsCount = 0;
+  t->__flows = calloc(pow2, sizeof(TlsFlow_t));
+  ASSERT("Cannot initialize a new TLS flows table: calloc returned 'NULL'.", t->__flows != NULL);
+  t->__capacity = pow2;
+  t->__tick = 0;
+}
+
+int TlsTrackerAddSNIPattern(TlsTracker_t* t, const char* pattern)
+{
+  if (t->__patternsCount == TLS_SNI_PATTERNS_MAX_COUNT)
+    return -1;
+
+  strncpy(t->__patterns[t->__patternsCount], pattern, TLS_SNI_MAX_SIZE);
+  t->__patterns[t->__patternsCount][TLS_SNI_MAX_SIZE - 1] = '\0';
+  return (int) t->__patternsCount++;
+}
+
+int TlsTrackerProcess(TlsTracker_t* t, const PacketView_t* view, TlsEvent_t* event)
+{
+  event->ClientHelloDecoded = false;
+  event->SNI = NULL;
+  event->PatternMask = 0;
+  if (view->Protocol != Protocol_TCP)
+    return 0;
+
+  /*
+   * Segments without payload of unknown flows are not stored, the flow is created by SYN or by the first data segment.
+   * SYN (without ACK) starts a new connection, the previous state of this 4-tuple is dropped.
+   */
+  bool syn = (view->TCPFlags & (TCPFlag_SYN | TCPFlag_ACK)) == TCPFlag_SYN;
+  TlsFlow_t* flow = FindFlow(t, view, syn || view->PayloadSize > 0);
+  if (flow == NULL)
+    return 0;
+
+  flow->LastSeen = ++t->__tick;
+  if (syn && flow->Done) {
+    flow->Done = false;
+    flow->SNIIndex = -1;
+    flow->PatternMask = 0;
+  }
+
+  if (!flow->Done && view->PayloadSize > 0) {
+    // only the first data segment of the flow is parsed
+    flow->Done = true;
+    if (TlsParseClientHello((const uint8_t*) view->Payload, view->PayloadSize, &event->Hello) == 0) {
+      t->ClientHellos++;
+      if (event->Hello.Truncated)
+        t->Truncated++;
+      event->ClientHelloDecoded = true;
+      if (event->Hello.SNI[0] != '\0') {
+        int index = FindSNI(t, event->Hello.SNI);
+        flow->SNIIndex = (int16_t) (index >= 0 ? index : TLS_SNI_STATS_MAX_COUNT);
+        flow->PatternMask = MatchPatterns(t, event->Hello.SNI);
+        (index >= 0 ? &t->SNIs[index] : &t->OtherSNIs)->Connections++;
+      }
+    } else {
+      t->NotTls++;
+    }
+  }
+
+  if (flow->SNIIndex < 0)
+    return 0;
+
+  TlsSNIStats_t* stats = flow->SNIIndex < TLS_SNI_STATS_MAX_COUNT ? &t->SNIs[flow->SNIIndex] : &t->OtherSNIs;
+  stats->Packets++;
+  stats->Bytes += view->PacketSize;
+  event->SNI = stats->SNI;
+  event->PatternMask = flow->PatternMask;
+  return 1;
+}
+
+void TlsTrackerClear(TlsTracker_t* t)
+{
+  if (t == NULL)
+    return;
+
+  free(t->__flows);
+  free(t->SNIs);
+  t->__flows = NULL;
+  t->SNIs = NULL;
+}
+
+bool ReadU8(TlsReader_t* r, uint8_t* value)
+{
+  if (r->Position + 1 > r->End)
+    return false;
+  *value = r->Data[r->Position++];
+  return true;
+}
+
+bool ReadU16(TlsReader_t* r, uint16_t* value)
+{
+  if (r->Position + 2 > r->End)
+    return false;
+  *value = (uint16_t) (r->Data[r->Position] << 8 | r->Data[r->Position + 1]);
+  r->Position += 2;
+  return true;
+}
+
+bool Skip(TlsReader_t* r, size_t size)
+{
+  if (r->Position + size > r->End)
+    return false;
+  r->Position += size;
+  return true;
+}
+
+bool IsGrease(uint16_t value)
+{
+  // RFC 8701: 0x0A0A, 0x1A1A, ..., 0xFAFA
+  return (value & 0x0F0F) == 0x0A0A && (value >> 8) == (value & 0xFF);
+}
+
+uint64_t HashU16(uint64_t hash, uint16_t value)
+{
+  hash = (hash ^ (uint8_t) (value >> 8)) * TLS_FNV_PRIME; // FNV-1a
+  return (hash ^ (uint8_t) value) * TLS_FNV_PRIME;
+}
+
+void ParseBody(TlsReader_t* r, TlsClientHello_t* hello, uint64_t* fields)
+{
+  uint8_t sessionIdSize = 0;
+  uint16_t ciphersSize = 0;
+  if (!Skip(r, TLS_RANDOM_SIZE) || !ReadU8(r, &sessionIdSize) || !Skip(r, sessionIdSize) ||
+      !ReadU16(r, &ciphersSize) || (ciphersSize & 1) != 0)
+    return;
+
+  for (size_t i = 0; i < ciphersSize; i += 2) {
+    uint16_t suite = 0;
+    if (!ReadU16(r, &suite))
+      return;
+    if (!IsGrease(suite)) {
+      fields[TlsField_CIPHERS] = HashU16(fields[TlsField_CIPHERS], suite);
+      hello->CipherSuitesCount++;
+    }
+  }
+
+  uint8_t compressionSize = 0;
+  uint16_t extensionsSize = 0;
+  if (!ReadU8(r, &compressionSize) || !Skip(r, compressionSize) || !ReadU16(r, &extensionsSize))
+    return;
+
+  size_t extensionsEnd = r->Position + extensionsSize;
+  while (r->Position + 4 <= extensionsEnd) {
+    uint16_t type = 0, extensionSize = 0;
+    if (!ReadU16(r, &type) || !ReadU16(r, &extensionSize))
+      break;
+    if (!IsGrease(type)) {
+      fields[TlsField_EXTENSIONS] = HashU16(fields[TlsField_EXTENSIONS], type);
+      hello->ExtensionsCount++;
+    }
+    if (r->Position + extensionSize > r->End)
+      break; // the rest of the message is in the next segment
+    ParseExtension(r->Data + r->Position, extensionSize, type, hello, fields);
+    r->Position += extensionSize;
+  }
+}
+
+void ParseExtension(const uint8_t* data, size_t size, uint16_t type, TlsClientHello_t* hello, uint64_t* fields)
+{
+  TlsReader_t r = {data, 0, size};
+  switch (type) {
+  case TLS_EXTENSION_SERVER_NAME:
+    ParseServerName(&r, hello);
+    break;
+  case TLS_EXTENSION_ALPN:
+    ParseALPN(&r, hello);
+    break;
+  case TLS_EXTENSION_SUPPORTED_VERSIONS: {
+    uint8_t listSize = 0;
+    uint16_t version = 0;
+    if (!ReadU8(&r, &listSize))
+      break;
+    for (size_t i = 0; i + 2 <= listSize && ReadU16(&r, &version); i += 2) {
+      if (!IsGrease(version) && version > hello->MaxSupportedVersion)
+        hello->MaxSupportedVersion = version;
+    }
+    break;
+  }
+  case TLS_EXTENSION_SUPPORTED_GROUPS: {
+    uint16_t listSize = 0, group = 0;
+    if (!ReadU16(&r, &listSize))
+      break;
+    for (size_t i = 0; i + 2 <= listSize && ReadU16(&r, &group); i += 2) {
+      if (!IsGrease(group))
+        fields[TlsField_GROUPS] = HashU16(fields[TlsField_GROUPS], group);
+    }
+    break;
+  }
+  case TLS_EXTENSION_EC_POINT_FORMATS: {
+    uint8_t listSize = 0, format = 0;
+    if (!ReadU8(&r, &listSize))
+      break;
+    for (size_t i = 0; i < listSize && ReadU8(&r, &format); ++i)
+      fields[TlsField_FORMATS] = HashU16(fields[TlsField_FORMATS], format);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void ParseServerName(TlsReader_t* r, TlsClientHello_t* hello)
+{
+  // server_name_list: type (0 - host_name), 16-bit length, name
+  uint16_t listSize = 0;
+  if (!ReadU16(r, &listSize))
+    return;
+
+  size_t listEnd = r->Position + listSize;
+  while (r->Position < listEnd) {
+    uint8_t nameType = 0;
+    uint16_t nameSize = 0;
+    if (!ReadU8(r, &nameType) || !ReadU16(r, &nameSize) || r->Position + nameSize > r->End)
+      return;
+    if (nameType == 0) {
+      size_t size = nameSize < TLS_SNI_MAX_SIZE - 1 ? nameSize : TLS_SNI_MAX_SIZE - 1;
+      for (size_t i = 0; i < size; ++i) {
+        uint8_t c = r->Data[r->Position + i];
+        hello->SNI[i] = (c > 0x20 && c < 0x7F) ? (char) c : '?';
+      }
+      hello->SNI[size] = '\0';
+      return;
+    }
+    r->Position += nameSize;
+  }
+}
+
+void ParseALPN(TlsReader_t* r, TlsClientHello_t* hello)
+{
+  // protocol_name_list: 8-bit length, name
+  uint16_t listSize = 0;
+  if (!ReadU16(r, &listSize))
+    return;
+
+  size_t listEnd = r->Position + listSize, length = 0;
+  while (r->Position < listEnd) {
+    uint8_t nameSize = 0;
+    if (!ReadU8(r, &nameSize) || r->Position + nameSize > r->End)
+      break;
+    // only whole names are copied
+    if (length + nameSize + (length > 0 ? 1 : 0) >= TLS_ALPN_MAX_SIZE)
+      break;
+    if (length > 0)
+      hello->ALPN[length++] = ',';
+    for (size_t i = 0; i < nameSize; ++i) {
+      uint8_t c = r->Data[r->Position + i];
+      hello->ALPN[length++] = (c > 0x20 && c < 0x7F && c != ',') ? (char) c : '?';
+    }
+    r->Position += nameSize;
+  }
+  hello->ALPN[length] = '\0';
+}
+
+TlsFlow_t* FindFlow(TlsTracker_t* t, const PacketView_t* view, bool insert)
+{
+  /*
+   * Endpoints are ordered, both directions share one entry.
+   */
+  uint64_t a = (uint64_t) view->SourceAddress << 16 | view->SourcePort;
+  uint64_t b = (uint64_t) view->DestinationAddress << 16 | view->DestinationPort;
+  if (a > b) {
+    uint64_t tmp = a;
+    a = b;
+    b = tmp;
+  }
+  uint64_t key = (a * 31 + b) * 0x9E3779B97F4A7C15ULL;
+  size_t index = (size_t) (key >> 32) & (t->__capacity - 1);
+
+  uint32_t addressA = (uint32_t) (a >> 16), addressB = (uint32_t) (b >> 16);
+  uint16_t portA = (uint16_t) a, portB = (uint16_t) b;
+
+  TlsFlow_t* freeSlot = NULL;
+  TlsFlow_t* oldest = NULL;
+  for (size_t i = 0; i < TLS_FLOW_PROBES_COUNT; ++i) {
+    TlsFlow_t* flow = &t->__flows[(index + i) & (t->__capacity - 1)];
+    if (!flow->Used) {
+      if (freeSlot == NULL)
+        freeSlot = flow;
+      continue;
+    }
+
+    if (flow->AddressA == addressA && flow->AddressB == addressB && flow->PortA == portA && flow->PortB == portB)
+      return flow;
+
+    if (oldest == NULL || flow->LastSeen < oldest->LastSeen)
+      oldest = flow;
+  }
+
+  if (!insert)
+    return NULL;
+
+  TlsFlow_t* flow = freeSlot;
+  if (flow == NULL) {
+    flow = oldest;
+    t->Evicted++;
+  }
+
+  flow->AddressA = addressA;
+  flow->AddressB = addressB;
+  flow->PortA = portA;
+  flow->PortB = portB;
+  flow->Used = true;
+  flow->Done = false;
+  flow->SNIIndex = -1;
+  flow->PatternMask = 0;
+  flow->LastSeen = t->__tick;
+  return flow;
+}
+
+int FindSNI(TlsTracker_t* t, const char* sni)
+{
+  uint64_t hash = TLS_FNV_OFFSET;
+  for (const char* c = sni; *c != '\0'; ++c)
+    hash = (hash ^ (uint8_t) tolower((unsigned char) *c)) * TLS_FNV_PRIME;
+
+  for (size_t i = 0; i < t->SNIsCount; ++i) {
+    if (t->SNIs[i].Hash == hash)
+      return (int) i;
+  }
+
+  if (t->SNIsCount == TLS_SNI_STATS_MAX_COUNT)
+    return -1;
+
+  TlsSNIStats_t* stats = &t->SNIs[t->SNIsCount];
+  memset(stats, 0, sizeof(TlsSNIStats_t));
+  size_t length = strlen(sni);
+  if (length > TLS_SNI_MAX_SIZE - 1)
+    length = TLS_SNI_MAX_SIZE - 1;
+  memcpy(stats->SNI, sni, length);
+  stats->SNI[length] = '\0';
+  stats->Hash = hash;
+  return (int) t->SNIsCount++;
+}
+
+uint32_t MatchPatterns(TlsTracker_t* t, const char* sni)
+{
+  uint32_t mask = 0;
+  for (size_t i = 0; i < t->__patternsCount; ++i) {
+    if (TlsMatchSNI(t->__patterns[i], sni))
+      mask |= 1U << i;
+  }
+  return mask;
+}
@@ -0,0 +1,152 @@
+#ifndef __TLS_H
+#define __TLS_H
+
+#include "structures.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TLS_SNI_MAX_SIZE 256
+#define TLS_ALPN_MAX_SIZE 64
+#define TLS_SNI_PATTERNS_MAX_COUNT 32
+#define TLS_FLOWS_DEFAULT_CAPACITY 65536
+#define TLS_SNI_STATS_MAX_COUNT 256
+
+/**
+ * @brief TlsClientHello_t
+ * Decoded TLS ClientHello message.
+ */
+typedef struct
+{
+  uint16_t RecordVersion;       //! Version of the TLS record
+  uint16_t ClientVersion;       //! Legacy client version of the ClientHello
+  uint16_t MaxSupportedVersion; //! Max version of the supported_versions extension (0 if absent)
+  uint16_t CipherSuitesCount;   //! Cipher suites count (without GREASE values)
+  uint16_t ExtensionsCount;     //! Extensions count (without GREASE values)
+  char SNI[TLS_SNI_MAX_SIZE];   //! Server name (empty if absent)
+  char ALPN[TLS_ALPN_MAX_SIZE]; //! Comma-separated ALPN protocols (empty if absent)
+  uint64_t Fingerprint;         //! Hash of version, cipher suites, extensions, groups and point formats (JA3 fields)
+  bool Truncated;               //! The ClientHello does not fit into the segment, decoded partially
+} TlsClientHello_t;
+
+/**
+ * @brief TlsEvent_t
+ * The result of processing a TCP segment by the tracker.
+ */
+typedef struct
+{
+  bool ClientHelloDecoded; //! This segment carried the ClientHello (Hello is valid)
+  TlsClientHello_t Hello;  //! The decoded ClientHello
+  const char* SNI;         //! Server name of the flow (NULL if unknown)
+  uint32_t PatternMask;    //! SNI patterns matched by the flow (bit per pattern)
+} TlsEvent_t;
+
+/**
+ * @brief TlsFlow_t
+ * Small fixed-size state of the TCP flow.
+ */
+typedef struct
+{
+  uint32_t AddressA;
+  uint32_t AddressB;
+  uint16_t PortA;
+  uint16_t PortB;
+  bool Used;
+  bool Done;        //! The first data segment was seen
+  int16_t SNIIndex; //! Index in the SNI stats table (-1 if unknown, TLS_SNI_STATS_MAX_COUNT for other names)
+  uint32_t PatternMask;
+  uint64_t LastSeen;
+} TlsFlow_t;
+
+/**
+ * @brief TlsSNIStats_t
+ * Aggregate counters of the server name.
+ */
+typedef struct
+{
+  char SNI[TLS_SNI_MAX_SIZE];
+  uint64_t Hash;
+  uint64_t Connections;
+  uint64_t Packets;
+  uint64_t Bytes;
+} TlsSNIStats_t;
+
+/**
+ * @brief TlsTracker_t
+ * Parses the first data segment of each TCP flow and keeps per-SNI counters.
+ */
+typedef struct
+{
+  uint64_t ClientHellos;   //! Decoded ClientHello messages
+  uint64_t Truncated;      //! ClientHello messages which do not fit into the first segment
+  uint64_t NotTls;         //! Flows which do not start with the ClientHello
+  uint64_t Evicted;        //! Flows evicted from the table
+  TlsSNIStats_t* SNIs;     //! Counters per server name
+  size_t SNIsCount;        //! Server names count
+  TlsSNIStats_t OtherSNIs; //! Server names which do not fit into SNIs
+  // private fields
+  char __patterns[TLS_SNI_PATTERNS_MAX_COUNT][TLS_SNI_MAX_SIZE];
+  size_t __patternsCount;
+  TlsFlow_t* __flows;
+  size_t __capacity;
+  uint64_t __tick;
+} TlsTracker_t;
+
+/**
+ * @brief TlsParseClientHello
+ * Parses the TLS record with the ClientHello message. All lengths are checked, the memory is not allocated. If the
+ * message does not fit into the data, the available part is decoded and the Truncated flag is set.
+ * @param data The pointer to the TCP payload
+ * @param size Size of the TCP payload
+ * @param hello The pointer to the decoded message
+ * @return -1 if the data is not a TLS ClientHello, otherwise 0.
+ */
+int TlsParseClientHello(const uint8_t* data, size_t size, TlsClientHello_t* hello);
+/**
+ * @brief TlsVersionToString
+ * @param version The TLS version
+ * @return The name of the version.
+ */
+const char* TlsVersionToString(uint16_t version);
+/**
+ * @brief TlsMatchSNI
+ * Matches the server name with the pattern. The pattern may contain '*' (any characters), the match is case
+ * insensitive, for example '*.example.com'.
+ * @param pattern The pattern
+ * @param sni The server name
+ * @return true if the server name matches the pattern.
+ */
+bool TlsMatchSNI(const char* pattern, const char* sni);
+
+/**
+ * @brief TlsTrackerInit
+ * Initializes values for the new tracker object.
+ * @param t The pointer to the tracker object
+ * @param capacity Max count of tracked flows (rounded up to the power of two)
+ */
+void TlsTrackerInit(TlsTracker_t* t, size_t capacity);
+/**
+ * @brief TlsTrackerAddSNIPattern
+ * Adds the SNI pattern. Flows are matched with all patterns once, when the ClientHello is decoded.
+ * @param t The pointer to the tracker object
+ * @param pattern The pattern (see TlsMatchSNI())
+ * @return The bit of this pattern in TlsEvent_t::PatternMask, or -1 if there are too many patterns.
+ */
+int TlsTrackerAddSNIPattern(TlsTracker_t* t, const char* pattern);
+/**
+ * @brief TlsTrackerProcess
+ * Looks up the flow of the TCP segment. The first data segment of the flow is parsed as the ClientHello, other
+ * segments only update per-SNI counters.
+ * @param t The pointer to the tracker object
+ * @param view The decoded packet
+ * @param event The pointer to the result
+ * @return 1 if the server name of the flow is known, otherwise 0.
+ */
+int TlsTrackerProcess(TlsTracker_t* t, const PacketView_t* view, TlsEvent_t* event);
+/**
+ * @brief TlsTrackerClear
+ * Clears the passed tracker object.
+ * @param t The pointer to the tracker object
+ */
+void TlsTrackerClear(TlsTracker_t* t);
+
+#endif // __TLS_H
@@ -0,0 +1,51 @@
+#include "traffic.h"
+
+#include <string.h>
+
+// the protocol of the IP header to the protocol row, not listed protocols are TrafficProtocol_OTHER
+static const uint8_t ProtocolRows[256] = {
+    [Protocol_TCP] = TrafficProtocol_TCP,
+    [Protocol_UDP] = TrafficProtocol_UDP,
+    [Protocol_ICMP] = TrafficProtocol_ICMP,
+};
+
+void TrafficStatsInit(TrafficStats_t* t)
+{
+  memset(t, 0, sizeof(TrafficStats_t));
+}
+
+void TrafficStatsAdd(TrafficStats_t* t, uint8_t protocol, Direction_t direction, size_t rule, size_t size)
+{
+  // Direction_SOURCE is the row 0, Direction_DESTINATION is the row 1
+  TrafficCounter_t* row = &t->Protocols[ProtocolRows[protocol]][(direction - 1) & 1];
+  TrafficCounter_t* matched = &t->Rules[rule < TRAFFIC_RULES_FILE ? rule : TRAFFIC_RULES_FILE];
+
+  t->Total.Packets++;
+  t->Total.Bytes += size;
+  row->Packets++;
+  row->Bytes += size;
+  matched->Packets++;
+  matched->Bytes += size;
+  t->Sizes[TrafficSizeBucket(size)]++;
+}
+
+size_t TrafficSizeBucket(size_t size)
+{
+  // sizes below 64 bytes have the same most significant bit as 63
+  size_t bucket = (size_t) (63 - __builtin_clzll((unsigned long long) size | 63)) - 5;
+  return bucket < TRAFFIC_SIZE_BUCKETS_COUNT - 1 ? bucket : TRAFFIC_SIZE_BUCKETS_COUNT - 1;
+}
+
+const char* TrafficProtocolName(TrafficProtocol_t protocol)
+{
+  switch (protocol) {
+  case TrafficProtocol_TCP:
+    return "TCP";
+  case TrafficProtocol_UDP:
+    return "UDP";
+  case TrafficProtocol_ICMP:
+    return "ICMP";
+  default:
+    return "other";
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef __TRAFFIC_H
+#define __TRAFFIC_H
+
+#include "structures.h"
+#include <stdint.h>
+
+#define TRAFFIC_PROTOCOLS_COUNT 4
+#define TRAFFIC_DIRECTIONS_COUNT 2
+#define TRAFFIC_SIZE_BUCKETS_COUNT 8
+#define TRAFFIC_DASHBOARD_INTERVAL_US 1000000
+#define TRAFFIC_RULES_FILE ADDRESSES_MAX_COUNT /* the counter of all rules of the file */
+
+/**
+ * @brief TrafficProtocol_t
+ * Protocol rows of traffic counters.
+ */
+typedef enum
+{
+  TrafficProtocol_OTHER = 0,
+  TrafficProtocol_TCP,
+  TrafficProtocol_UDP,
+  TrafficProtocol_ICMP
+} TrafficProtocol_t;
+
+/**
+ * @brief TrafficCounter_t
+ * Packets and bytes (of IP packets) counter.
+ */
+typedef struct
+{
+  uint64_t Packets;
+  uint64_t Bytes;
+} TrafficCounter_t;
+
+/**
+ * @brief TrafficStats_t
+ * Traffic counters of the dashboard. The object is written only by the capture thread, other threads read its copy
+ * taken under the lock of the capture thread. Counters are updated without branches on packet fields.
+ */
+typedef struct
+{
+  TrafficCounter_t Total;                                                         //! All packets
+  TrafficCounter_t Protocols[TRAFFIC_PROTOCOLS_COUNT][TRAFFIC_DIRECTIONS_COUNT]; //! By protocol and direction
+  TrafficCounter_t Rules[ADDRESSES_MAX_COUNT + 1];                                //! By the matched address
+  uint64_t Sizes[TRAFFIC_SIZE_BUCKETS_COUNT];                                     //! Packet size histogram
+} TrafficStats_t;
+
+/**
+ * @brief TrafficStatsInit
+ * Initializes values for the new traffic counters object.
+ * @param t The pointer to the traffic counters object
+ */
+void TrafficStatsInit(TrafficStats_t* t);
+/**
+ * @brief TrafficStatsAdd
+ * Counts the packet.
+ * @param t The pointer to the traffic counters object
+ * @param protocol The protocol of the IP header
+ * @param direction The direction of the matched address (Direction_SOURCE is outgoing from the address)
+ * @param rule The index of the matched address (TRAFFIC_RULES_FILE for rules of the file)
+ * @param size The size of the IP packet
+ */
+void TrafficStatsAdd(TrafficStats_t* t, uint8_t protocol, Direction_t direction, size_t rule, size_t size);
+/**
+ * @brief TrafficSizeBucket
+ * Returns the bucket of the packet size histogram. The first bucket is sizes below 64 bytes, each next bucket is the
+ * next power of two, the last bucket is sizes from 4096 bytes.
+ * @param size The size of the packet
+ * @return The index of the bucket.
+ */
+size_t TrafficSizeBucket(size_t size);
+/**
+ * @brief TrafficProtocolName
+ * Returns the name of the protocol row.
+ * @param protocol The protocol row
+ * @return The name of the protocol.
+ */
+const char* TrafficProtocolName(TrafficProtocol_t protocol);
+
+#endif // __TRAFFIC_H
@@ -8,11 +8,15 @@
 
 #ifdef __linux__
 #include <errno.h>
+#include <malloc.h>
+#include <time.h>
 #elif _WIN32
 #include <Windows.h>
+#include <malloc.h>
 #endif
 
 #define ERROR_MESSAGE_BUFFER_CAPACITY 1024
+#define FORMAT_STRING_BUFFER_MIN_CAPACITY 256
 
 static char ErrorMessageBuffer[ERROR_MESSAGE_BUFFER_CAPACITY];
 static
@@ -22,6 +26,7 @@ static
     DWORD
 #endif
         ErrorMessageBufferSize = 0;
+static size_t AllocatedSize(void* p);
 
 void FormatStringBuffer(char** buffer, const char* msg, ...)
 {
@@ -34,10 +39,17 @@ void FormatStringBuffer(char** buffer, const char* msg, ...)
   if (msgSize < 0) // TODO:
     return;
 
-  *buffer = realloc(*buffer, sizeof(char) * (size_t) msgSize + 1);
-  ASSERT("Cannot initialize a new string: realloc returned 'NULL'.", *buffer != NULL);
+  // the buffer is reused by next messages, it is reallocated only if the message does not fit
+  size_t required = sizeof(char) * (size_t) msgSize + 1;
+  if (*buffer == NULL || AllocatedSize(*buffer) < required) {
+    if (required < FORMAT_STRING_BUFFER_MIN_CAPACITY)
+      required = FORMAT_STRING_BUFFER_MIN_CAPACITY;
+    *buffer = realloc(*buffer, required);
+    ASSERT("Cannot initialize a new string: realloc returned 'NULL'.", *buffer != NULL);
+  }
 
   vsnprintf(*buffer, (size_t) msgSize + 1, msg, argsCopy);
+  va_end(argsCopy);
   (*buffer)[msgSize] = '\0';
 }
 
@@ -100,3 +112,42 @@ int ParseAddressString(const char* address, char** ip, int* port, char** error)
   free(source);
   return 0;
 }
+
+uint64_t GetMonotonicTimeUs()
+{
+#ifdef __linux__
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000;
+#elif _WIN32
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t) (counter.QuadPart / frequency.QuadPart * 1000000 +
+                     counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+#endif
+}
+
+uint64_t GetMonotonicTimeNs()
+{
+#ifdef __linux__
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+#elif _WIN32
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t) (counter.QuadPart / frequency.QuadPart * 1000000000 +
+                     counter.QuadPart % frequency.QuadPart * 1000000000 / frequency.QuadPart);
+#endif
+}
+
+size_t AllocatedSize(void* p)
+{
+#ifdef __linux__
+  return malloc_usable_size(p);
+#elif _WIN32
+  return _msize(p);
+#endif
+}
@@ -2,6 +2,7 @@
 #define __UTILS_H
 
 #include <assert.h>
+#include <stdint.h>
 
 /**
  * @brief GetLastErrorMessage
@@ -25,6 +26,16 @@ void FormatStringBuffer(char** buffer, const char* msg, ...);
  * @return -1 if an error occurred, otherwise 0.
  */
 int ParseAddressString(const char* address, char** ip, int* port, char** error);
+/**
+ * @brief GetMonotonicTimeUs
+ * @return Microseconds of the monotonic clock (for measuring intervals).
+ */
+uint64_t GetMonotonicTimeUs();
+/**
+ * @brief GetMonotonicTimeNs
+ * @return Nanoseconds of the monotonic clock (for measuring short intervals).
+ */
+uint64_t GetMonotonicTimeNs();
 
 #define ASSERT(msg, cond) assert(((void) msg, cond));
 #endif // __UTILS_H
@@ -0,0 +1,223 @@
+#include "testing.h"
+
+#ifdef ALLOCATION_AUDIT_ENABLED
+#include "allocaudit.h"
+#include "packetpath.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SYNTHETIC_PACKETS_COUNT 4
+#define SYNTHETIC_PACKET_MAX_SIZE 256
+#define SYNTHETIC_SAMPLE_EVERY 3
+
+/*
+ * The ETH header (14 bytes) is followed by the IPv4 packet 127.0.0.1 <-> 127.0.0.2: the HTTP request and the response,
+ * the DNS query and the response.
+ */
+static uint8_t Packets[SYNTHETIC_PACKETS_COUNT][SYNTHETIC_PACKET_MAX_SIZE];
+static size_t PacketSizes[SYNTHETIC_PACKETS_COUNT];
+
+static size_t BuildPacket(
+    uint8_t* packet, uint8_t protocol, bool reply, uint16_t clientPort, uint16_t serverPort, const char* payload,
+    size_t payloadSize)
+{
+  memset(packet, 0, SYNTHETIC_PACKET_MAX_SIZE);
+  memcpy(packet, "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xAA\xBB\x08\x00", 14);
+  uint8_t* ip = packet + 14;
+  uint8_t* transport = ip + 20;
+  size_t transportSize = protocol == Protocol_TCP ? 20 : 8;
+  uint16_t totalLength = (uint16_t) (20 + transportSize + payloadSize);
+
+  uint32_t client = htonl(0x7F000001), server = htonl(0x7F000002);
+  uint16_t sport = htons(reply ? serverPort : clientPort), dport = htons(reply ? clientPort : serverPort);
+  ip[0] = 0x45;
+  ip[2] = (uint8_t) (totalLength >> 8);
+  ip[3] = (uint8_t) totalLength;
+  ip[8] = 64;
+  ip[9] = protocol;
+  memcpy(ip + 12, reply ? &server : &client, 4);
+  memcpy(ip + 16, reply ? &client : &server, 4);
+  memcpy(transport, &sport, 2);
+  memcpy(transport + 2, &dport, 2);
+  if (protocol == Protocol_TCP) {
+    transport[7] = reply ? 0xC8 : 0x64;  // sequence number
+    transport[11] = reply ? 0x6E : 0xC8; // acknowledgment number
+    transport[12] = 0x50;
+    transport[13] = 0x18; // PSH ACK
+    transport[14] = 0x01;
+  } else {
+    uint16_t udpLength = htons((uint16_t) (8 + payloadSize));
+    memcpy(transport + 4, &udpLength, 2);
+  }
+  memcpy(transport + transportSize, payload, payloadSize);
+  return 14 + totalLength;
+}
+
+static void BuildPackets()
+{
+  static const char request[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+  // ID 0x1234, the question example.com A
+  static const char query[] = "\x12\x34\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+                              "\x07" "example\x03" "com\x00\x00\x01\x00\x01";
+  static const char answer[] = "\x12\x34\x81\x80\x00\x01\x00\x00\x00\x00\x00\x00"
+                               "\x07" "example\x03" "com\x00\x00\x01\x00\x01";
+
+  PacketSizes[0] = BuildPacket(Packets[0], Protocol_TCP, false, 40000, 80, request, sizeof(request) - 1);
+  PacketSizes[1] = BuildPacket(Packets[1], Protocol_TCP, true, 40000, 80, response, sizeof(response) - 1);
+  PacketSizes[2] = BuildPacket(Packets[2], Protocol_UDP, false, 40001, 53, query, sizeof(query) - 1);
+  PacketSizes[3] = BuildPacket(Packets[3], Protocol_UDP, true, 40001, 53, answer, sizeof(answer) - 1);
+}
+
+static void PushPackets(Sniffer_t* sniffer, PrintingContext_t* context, uint64_t count)
+{
+  // packets are passed to the handler of the sniffer one by one, like captured packets
+  for (uint64_t i = 0; i < count; ++i) {
+    size_t n = (size_t) (i % SYNTHETIC_PACKETS_COUNT);
+    TimeInfo_t time;
+    memset(&time, 0, sizeof(time));
+    time.Seconds = (int) (i % 60);
+    time.TimestampSec = (time_t) i;
+    time.TimestampNanosec = (uint32_t) n;
+    sniffer->MatchedAddress = 0;
+    sniffer->MatchedDirection = n % 2 == 0 ? Direction_SOURCE : Direction_DESTINATION;
+    ProcessPacket(sniffer, (Buffer_t) Packets[n], PacketSizes[n], time, context);
+  }
+}
+
+/**
+ * Runs packets through the stages of the command line tool (the text format with decoders, sampling and traffic
+ * counters), the format pool and the output. All threads are audited: the capture thread, workers and the writer.
+ */
+static void CheckPacketPath(size_t formatThreads)
+{
+  BuildPackets();
+  PrintingContext_t context;
+  PrintingContextInit(&context, OutputFormat_TEXT, 0);
+  Sniffer_t sniffer;
+  TEST_ASSERT(SnifferInit(&sniffer, "lo", ProcessPacket, &context) == 0, "Cannot init the sniffer.");
+  SnifferIncludeETHHeader(&sniffer, true);
+
+  int fd = open("/dev/null", O_WRONLY);
+  TEST_ASSERT(fd >= 0, "Cannot open the output.");
+  PacketBuffersInit(&context.Buffers);
+  OutputInit(&context.Output, fd, OUTPUT_DEFAULT_BLOCK_SIZE, OUTPUT_DEFAULT_FLUSH_INTERVAL_MS);
+  DnsTracker_t dns;
+  DnsTrackerInit(&dns, 64);
+  context.Dns = &dns;
+  HttpTracker_t http;
+  HttpTrackerInit(&http, 64);
+  context.Http = &http;
+  TcpAnalyzer_t tcp;
+  TcpAnalyzerInit(&tcp, 64);
+  context.Tcp = &tcp;
+  context.DecodedBuffer = malloc(DECODED_BUFFER_SUFFICIENT_SIZE);
+  context.AnalysisBuffer = malloc(DECODED_BUFFER_SUFFICIENT_SIZE);
+  Sampler_t sampler;
+  SamplerInit(&sampler, 0, SYNTHETIC_SAMPLE_EVERY, 0, 0);
+  context.Sampler = &sampler;
+  TrafficStats_t traffic;
+  TrafficStatsInit(&traffic);
+  context.Traffic = &traffic;
+
+  FormatPool_t pool;
+  if (formatThreads > 0) {
+    context.WorkersCount = formatThreads;
+    context.WorkerBuffers = malloc(sizeof(PacketBuffers_t) * formatThreads);
+    for (size_t i = 0; i < formatThreads; ++i)
+      PacketBuffersInit(&context.WorkerBuffers[i]);
+    FormatPoolInit(&pool,
+                   formatThreads,
+                   formatThreads * FORMAT_POOL_JOBS_PER_THREAD,
+                   TEXT_RECORD_INPUT_SIZE,
+                   FormatTextRecord,
+                   &context,
+                   &context.Output);
+    context.Pool = &pool;
+  }
+  Pipeline_t pipeline;
+  PipelineInit(&pipeline, PIPELINE_BATCH_DEFAULT_SIZE, PIPELINE_QUEUE_DEFAULT_DEPTH);
+  context.Pipeline = &pipeline;
+  context.Sniffer = &sniffer;
+  TEST_ASSERT(AddPipelineStages(&context) == 0 && PipelineStart(&pipeline) == 0, "Cannot start the pipeline.");
+  TEST_ASSERT(OutputStart(&context.Output) == 0, "Cannot start the output thread.");
+  TEST_ASSERT(context.Pool == NULL || FormatPoolStart(context.Pool) == 0, "Cannot start format threads.");
+
+  // buffers of the path and slabs of the pool grow while the first packets are processed
+  PushPackets(&sniffer, &context, ALLOCATION_AUDIT_WARMUP_PACKETS);
+  AllocAuditBeginProcess();
+  PushPackets(&sniffer, &context, ALLOCATION_AUDIT_WARMUP_PACKETS * 10);
+  // threads are stopped when they have written all records, so their work is audited
+  PipelineStop(&pipeline);
+  if (context.Pool != NULL)
+    FormatPoolStop(context.Pool);
+  OutputStop(&context.Output);
+  uint64_t allocations = AllocAuditEndProcess();
+  TEST_ASSERT(allocations == 0, "Packets are allocated memory after the warm-up.");
+
+  TEST_ASSERT(traffic.Total.Packets == ALLOCATION_AUDIT_WARMUP_PACKETS * 11, "Packets are not counted.");
+  TEST_ASSERT(sampler.Suppressed > 0 && dns.Queries > 0 && dns.Matched > 0 && http.Requests > 0 && http.Responses > 0,
+              "Packets are not sampled or decoded.");
+  TEST_ASSERT(context.Pool == NULL || context.Pool->Slots.Jobs > ALLOCATION_AUDIT_WARMUP_PACKETS, "Records are not formatted.");
+  TEST_ASSERT(context.Output.BytesWritten > 0 && context.Output.WriteErrors == 0, "Records are not written.");
+
+  PipelineClear(&pipeline);
+  if (context.Pool != NULL) {
+    FormatPoolClear(context.Pool);
+    for (size_t i = 0; i < context.WorkersCount; ++i)
+      PacketBuffersDelete(&context.WorkerBuffers[i]);
+    free(context.WorkerBuffers);
+  }
+  free(context.AnalysisBuffer);
+  free(context.DecodedBuffer);
+  TcpAnalyzerClear(&tcp);
+  HttpTrackerClear(&http);
+  DnsTrackerClear(&dns);
+  OutputClear(&context.Output);
+  PacketBuffersDelete(&context.Buffers);
+  SnifferClear(&sniffer);
+  close(fd);
+}
+
+TEST_CASE(TestAllocAudit, Counting)
+{
+  AllocAuditBegin(false);
+  void* p = malloc(16);
+  p = realloc(p, 32);
+  uint64_t allocations = AllocAuditEnd();
+  free(p);
+  TEST_ASSERT(allocations == 2 && AllocAuditLastSize() == 32, "Allocations are not counted.");
+
+  p = malloc(16);
+  free(p);
+  TEST_ASSERT(AllocAuditEnd() == 2, "Allocations are counted out of the audit.");
+}
+
+TEST_CASE(TestAllocAudit, ErrorMessage)
+{
+  char* message = NULL;
+  FormatStringBuffer(&message, "The first error of the code %d.", 1);
+  AllocAuditBegin(false);
+  FormatStringBuffer(&message, "The next error of the code %d.", 2);
+  FormatStringBuffer(&message, "The last error.");
+  TEST_ASSERT(AllocAuditEnd() == 0, "The message buffer is reallocated.");
+  TEST_ASSERT(strcmp(message, "The last error.") == 0, "Invalid message.");
+  free(message);
+}
+
+TEST_CASE(TestAllocAudit, InlinePacketPath)
+{
+  CheckPacketPath(0);
+}
+
+TEST_CASE(TestAllocAudit, ThreadedPacketPath)
+{
+  // records are formatted by workers of the pool
+  CheckPacketPath(2);
+}
+#endif
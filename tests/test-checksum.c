@@ -0,0 +1,95 @@
+#include "testing.h"
+#include "checksum.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// 192.168.0.1 -> 192.168.0.199, UDP, valid IP header checksum 0xB861
+static const uint8_t IPHeaderSample[] = {0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+                                         0xB8, 0x61, 0xC0, 0xA8, 0x00, 0x01, 0xC0, 0xA8, 0x00, 0xC7};
+
+TEST_CASE(TestChecksum, VerifyIPHeader)
+{
+  int8_t packet[sizeof(IPHeaderSample)];
+  memcpy(packet, IPHeaderSample, sizeof(IPHeaderSample));
+
+  TEST_ASSERT(ChecksumVerifyIPHeader(packet, sizeof(packet)), "Valid IP header checksum is rejected.");
+
+  packet[8] = 0x3F; // TTL
+  TEST_ASSERT(!ChecksumVerifyIPHeader(packet, sizeof(packet)), "Bad IP header checksum is accepted.");
+}
+
+TEST_CASE(TestChecksum, Implementations)
+{
+  uint8_t* data = malloc(4096 + 1);
+  for (int i = 0; i < 4096 + 1; ++i)
+    data[i] = (uint8_t) rand();
+
+  static const ChecksumImplementation_t impls[] = {ChecksumImplementation_SSE2, ChecksumImplementation_AVX2};
+  for (size_t size = 0; size <= 4096 + 1; size += 37) {
+    ChecksumSetImplementation(ChecksumImplementation_SCALAR);
+    uint16_t expected = ChecksumFold(ChecksumAdd(data, size, 0));
+
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+      if (ChecksumSetImplementation(impls[i]) < 0)
+        continue; // not supported by the CPU
+      TEST_ASSERT(ChecksumFold(ChecksumAdd(data, size, 0)) == expected, "SIMD checksum differs from scalar.");
+    }
+  }
+
+  ChecksumSetImplementation(ChecksumImplementation_AUTO);
+  free(data);
+}
+
+TEST_CASE(TestChecksum, VerifyPacket)
+{
+  // 10.0.0.1:1000 -> 10.0.0.2:53, UDP, payload "abc"
+  uint8_t packet[] = {0x45, 0x00, 0x00, 0x1F, 0x00, 0x01, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x01,
+                      0x0A, 0x00, 0x00, 0x02, 0x03, 0xE8, 0x00, 0x35, 0x00, 0x0B, 0x00, 0x00, 'a',  'b',  'c'};
+
+  uint16_t ipChecksum = (uint16_t) ~ChecksumFold(ChecksumAdd(packet, 20, 0));
+  memcpy(packet + 10, &ipChecksum, sizeof(ipChecksum));
+
+  uint8_t pseudoHeader[] = {0x0A, 0x00, 0x00, 0x01, 0x0A, 0x00, 0x00, 0x02, 0x00, 0x11, 0x00, 0x0B};
+  uint16_t udpChecksum =
+      (uint16_t) ~ChecksumFold(ChecksumAdd(packet + 20, 11, ChecksumAdd(pseudoHeader, sizeof(pseudoHeader), 0)));
+  memcpy(packet + 26, &udpChecksum, sizeof(udpChecksum));
+
+  ChecksumStats_t stats;
+  memset(&stats, 0, sizeof(stats));
+
+  Buffer_t buf = (Buffer_t) packet;
+  TEST_ASSERT(ChecksumVerifyPacket(buf, sizeof(packet), ChecksumHint_NONE, &stats) == ChecksumStatus_VALID,
+              "Valid UDP packet is rejected.");
+
+  packet[30] = 'd';
+  TEST_ASSERT(ChecksumVerifyPacket(buf, sizeof(packet), ChecksumHint_NONE, &stats) == ChecksumStatus_BAD_TRANSPORT,
+              "Bad UDP checksum is accepted.");
+  TEST_ASSERT(ChecksumVerifyPacket(buf, sizeof(packet), ChecksumHint_KERNEL_VALID, &stats) ==
+                  ChecksumStatus_KERNEL_VALID,
+              "Packet validated by kernel is verified again.");
+
+  TEST_ASSERT(stats.Verified == 2, "Invalid verified counter.");
+  TEST_ASSERT(stats.BadUDP == 1, "Invalid bad UDP counter.");
+  TEST_ASSERT(stats.KernelValid == 1, "Invalid kernel counter.");
+
+  // the transport checksum is not computed: no UDP checksum, a fragment, other protocol
+  memset(packet + 26, 0, 2);
+  TEST_ASSERT(ChecksumVerifyPacket(buf, sizeof(packet), ChecksumHint_NONE, &stats) == ChecksumStatus_NOT_CHECKED,
+              "UDP packet without the checksum is verified.");
+  memcpy(packet + 26, &udpChecksum, sizeof(udpChecksum));
+  packet[6] = 0x20; // more fragments
+  packet[10] = packet[11] = 0;
+  ipChecksum = (uint16_t) ~ChecksumFold(ChecksumAdd(packet, 20, 0));
+  memcpy(packet + 10, &ipChecksum, sizeof(ipChecksum));
+  TEST_ASSERT(ChecksumVerifyPacket(buf, sizeof(packet), ChecksumHint_NONE, &stats) == ChecksumStatus_NOT_CHECKED,
+              "Fragment is verified.");
+  packet[6] = 0x00;
+  packet[9] = 47; // GRE
+  packet[10] = packet[11] = 0;
+  ipChecksum = (uint16_t) ~ChecksumFold(ChecksumAdd(packet, 20, 0));
+  memcpy(packet + 10, &ipChecksum, sizeof(ipChecksum));
+  TEST_ASSERT(ChecksumVerifyPacket(buf, sizeof(packet), ChecksumHint_NONE, &stats) == ChecksumStatus_NOT_CHECKED,
+              "Packet of other protocol is verified.");
+  TEST_ASSERT(stats.Verified == 2 && stats.NotChecked == 3, "Unverified packets are counted as verified.");
+}
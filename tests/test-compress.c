@@ -0,0 +1,193 @@
+#include "testing.h"
+#include "compress.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define COMPRESS_TEST_SIZE (256 * 1024)
+#define COMPRESS_TEST_BLOCK_SIZE (64 * 1024)
+#define COMPRESS_TEST_BLOCKS 48
+
+static uint32_t NextRandom(uint32_t* state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/**
+ * Fills the data like captured packets: repeated headers with counters (compressible) or random payloads.
+ */
+static void FillData(uint8_t* data, size_t size, uint32_t seed, bool random)
+{
+  uint32_t state = seed | 1;
+  for (size_t i = 0; i < size; ++i)
+    data[i] = random ? (uint8_t) NextRandom(&state) : (uint8_t) ((i % 64) < 40 ? i % 7 : (i / 64 + seed) & 0xFF);
+}
+
+static size_t RoundTrip(const uint8_t* data, size_t size, uint32_t* table)
+{
+  size_t capacity = LzCompressBound(size);
+  uint8_t* compressed = malloc(capacity);
+  uint8_t* decompressed = malloc(size + 1);
+  size_t compressedSize = LzCompress(data, size, compressed, capacity, table);
+  TEST_ASSERT(compressedSize > 0 && compressedSize <= capacity, "Cannot compress the data.");
+  TEST_ASSERT(LzDecompress(compressed, compressedSize, decompressed, size + 1) == (int64_t) size &&
+                  (size == 0 || memcmp(data, decompressed, size) == 0),
+              "The decompressed data is not equal to the data.");
+  // the output buffer is validated
+  TEST_ASSERT(size == 0 || LzDecompress(compressed, compressedSize, decompressed, size - 1) < 0,
+              "The data is decompressed beyond the buffer.");
+  free(compressed);
+  free(decompressed);
+  return compressedSize;
+}
+
+TEST_CASE(TestCompress, RoundTrip)
+{
+  uint32_t* table = malloc(sizeof(uint32_t) << COMPRESS_HASH_LOG);
+  uint8_t* data = malloc(COMPRESS_TEST_SIZE);
+
+  FillData(data, COMPRESS_TEST_SIZE, 1, false);
+  TEST_ASSERT(RoundTrip(data, COMPRESS_TEST_SIZE, table) * 4 < COMPRESS_TEST_SIZE, "Packets are not compressed.");
+  memset(data, 0, COMPRESS_TEST_SIZE);
+  TEST_ASSERT(RoundTrip(data, COMPRESS_TEST_SIZE, table) * 100 < COMPRESS_TEST_SIZE, "Zeros are not compressed.");
+  FillData(data, COMPRESS_TEST_SIZE, 2, true);
+  TEST_ASSERT(RoundTrip(data, COMPRESS_TEST_SIZE, table) > COMPRESS_TEST_SIZE, "Random data is compressed.");
+  // the random data does not fit the buffer of the smaller size
+  uint8_t* compressed = malloc(COMPRESS_TEST_SIZE);
+  TEST_ASSERT(LzCompress(data, COMPRESS_TEST_SIZE, compressed, COMPRESS_TEST_SIZE - 1, table) == 0,
+              "The compressed data passes the end of the buffer.");
+  free(compressed);
+
+  // short data and long runs of literals and matches
+  for (size_t size = 0; size < 300; ++size) {
+    FillData(data, size, (uint32_t) size, size % 2 == 0);
+    RoundTrip(data, size, table);
+  }
+  FillData(data, COMPRESS_TEST_SIZE, 3, true);
+  memset(data + 1000, 'a', 70000);
+  RoundTrip(data, COMPRESS_TEST_SIZE, table);
+  free(data);
+  free(table);
+}
+
+TEST_CASE(TestCompress, InvalidData)
+{
+  uint32_t* table = malloc(sizeof(uint32_t) << COMPRESS_HASH_LOG);
+  uint8_t data[4096], compressed[8192], decompressed[4096];
+  FillData(data, sizeof(data), 4, false);
+  size_t size = LzCompress(data, sizeof(data), compressed, sizeof(compressed), table);
+  TEST_ASSERT(size > 0, "Cannot compress the data.");
+
+  // the truncated data is never decompressed to the data
+  for (size_t i = 0; i < size; ++i)
+    TEST_ASSERT(LzDecompress(compressed, i, decompressed, sizeof(decompressed)) != (int64_t) sizeof(data),
+                "The truncated data is decompressed.");
+  uint8_t offset[] = {0x10, 'a', 0x05, 0x00};
+  TEST_ASSERT(LzDecompress(offset, sizeof(offset), decompressed, sizeof(decompressed)) < 0,
+              "The match before the data is decompressed.");
+  uint8_t length[] = {0xF0, 0xFF, 0xFF};
+  TEST_ASSERT(LzDecompress(length, sizeof(length), decompressed, sizeof(decompressed)) < 0,
+              "The literal length after the end is decompressed.");
+  free(table);
+}
+
+#ifdef __linux__
+/**
+ * Writes blocks to two files by the pool, checks that frames are in order and blocks are decompressed to the data.
+ */
+static void CheckPool(size_t threads)
+{
+  char paths[2][64];
+  int fds[2];
+  uint64_t rawOffsets[2] = {0, 0};
+  uint8_t* expected[2];
+  for (int i = 0; i < 2; ++i) {
+    snprintf(paths[i], sizeof(paths[i]), "/tmp/netsniffer-test-compress-%zu-%d-%d.nsz", threads, i, (int) getpid());
+    fds[i] = open(paths[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_ASSERT(fds[i] >= 0, "Cannot create the file.");
+    CompressFileHeader_t header;
+    CompressFileHeaderInit(&header, COMPRESS_TEST_BLOCK_SIZE);
+    TEST_ASSERT(write(fds[i], &header, sizeof(header)) == (ssize_t) sizeof(header), "Cannot write the header.");
+    expected[i] = malloc(COMPRESS_TEST_BLOCKS * COMPRESS_TEST_BLOCK_SIZE);
+  }
+
+  CompressPool_t p;
+  CompressPoolInit(&p, threads, COMPRESS_TEST_BLOCK_SIZE);
+  TEST_ASSERT(CompressPoolStart(&p) == 0, "Cannot start the pool.");
+  for (uint32_t i = 0; i < COMPRESS_TEST_BLOCKS; ++i) {
+    // blocks of different sizes, every third block is random (stored)
+    int file = (int) (i % 2);
+    size_t size = COMPRESS_TEST_BLOCK_SIZE - (i * 997) % 4096;
+    uint8_t* block = CompressPoolAcquire(&p);
+    FillData(block, size, i, i % 3 == 0);
+    memcpy(expected[file] + rawOffsets[file], block, size);
+    CompressPoolSubmit(&p, size, fds[file], rawOffsets[file], i + 2 >= COMPRESS_TEST_BLOCKS);
+    rawOffsets[file] += size;
+  }
+  CompressPoolStop(&p);
+
+  uint64_t blocks = 0, rawBytes = 0;
+  for (size_t i = 0; i < (threads > 0 ? threads : 1); ++i) {
+    blocks += p.Workers[i].Blocks;
+    rawBytes += p.Workers[i].RawBytes;
+  }
+  TEST_ASSERT(p.Blocks == COMPRESS_TEST_BLOCKS && p.StoredBlocks == COMPRESS_TEST_BLOCKS / 3 && p.WriteErrors == 0,
+              "Invalid counters of the pool.");
+  TEST_ASSERT(blocks == COMPRESS_TEST_BLOCKS && rawBytes == p.RawBytes && p.RawBytes == rawOffsets[0] + rawOffsets[1],
+              "Invalid counters of threads.");
+  TEST_ASSERT(p.Bytes < p.RawBytes, "Blocks are not compressed.");
+  CompressPoolClear(&p);
+
+  uint8_t* decompressed = malloc(COMPRESS_TEST_BLOCK_SIZE);
+  for (int i = 0; i < 2; ++i) {
+    // files are closed by the pool
+    TEST_ASSERT(close(fds[i]) < 0, "The file is not closed after the last block.");
+    FILE* file = fopen(paths[i], "rb");
+    TEST_ASSERT(file != NULL, "Cannot open the file.");
+    uint8_t* data = malloc(COMPRESS_TEST_BLOCKS * (COMPRESS_TEST_BLOCK_SIZE + 64));
+    size_t size = fread(data, 1, COMPRESS_TEST_BLOCKS * (COMPRESS_TEST_BLOCK_SIZE + 64), file);
+    fclose(file);
+
+    CompressBlock_t* list = NULL;
+    size_t capacity = 0;
+    TEST_ASSERT(CompressListBlocks(data, size, &list, &capacity) == COMPRESS_TEST_BLOCKS / 2, "Invalid frames.");
+    for (size_t j = 0; j < COMPRESS_TEST_BLOCKS / 2; ++j) {
+      const uint8_t* block = data + list[j].FileOffset;
+      if (list[j].Compressed) {
+        TEST_ASSERT(LzDecompress(block, list[j].Size, decompressed, COMPRESS_TEST_BLOCK_SIZE) ==
+                        (int64_t) list[j].RawSize,
+                    "Cannot decompress the block.");
+        block = decompressed;
+      }
+      TEST_ASSERT(memcmp(block, expected[i] + list[j].RawOffset, list[j].RawSize) == 0, "Invalid data of the block.");
+    }
+    // the incomplete last frame is not listed
+    TEST_ASSERT(CompressListBlocks(data, size - 1, &list, &capacity) == COMPRESS_TEST_BLOCKS / 2 - 1,
+                "The incomplete frame is listed.");
+    TEST_ASSERT(CompressListBlocks(data + 1, size - 1, &list, &capacity) < 0, "The invalid file is listed.");
+    free(list);
+    free(data);
+    free(expected[i]);
+    remove(paths[i]);
+  }
+  free(decompressed);
+}
+
+TEST_CASE(TestCompress, Pool)
+{
+  CheckPool(4);
+}
+
+TEST_CASE(TestCompress, PoolWithoutThreads)
+{
+  CheckPool(0);
+}
+#endif
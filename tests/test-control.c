@@ -0,0 +1,229 @@
+#include "testing.h"
+#include "control.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CONTROL_TEST_COMMANDS 100
+#define CONTROL_TEST_MAX_LATENCY_US 50000
+
+typedef struct
+{
+  RuleSet_t* Rules;
+  atomic_int Running;
+  uint64_t Matches;
+  uint64_t Misses;
+} ControlReader_t;
+
+static void* MatchBaseRule(void* args)
+{
+  ControlReader_t* r = (ControlReader_t*) args;
+  int reader = RuleSetAddReader(r->Rules);
+  while (atomic_load(&r->Running)) {
+    RuleSetQuiescent(r->Rules, reader);
+    const RuleTable_t* t = RuleSetCurrent(r->Rules);
+    Direction_t direction;
+    // the base rule is never removed, every table must match it
+    if (RuleTableMatch(t, Protocol_TCP, htonl(0x0A000001), 443, htonl(0x0A000002), 40000, &direction) >= 0)
+      r->Matches++;
+    else
+      r->Misses++;
+  }
+  RuleSetRemoveReader(r->Rules, reader);
+  return NULL;
+}
+
+static int Connect(const char* path)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock >= 0 && connect(sock, (struct sockaddr*) &address, sizeof(address)) < 0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+static size_t Command(int sock, const char* command, char* response, size_t size)
+{
+  send(sock, command, strlen(command), 0);
+
+  // the status line ends the response
+  size_t length = 0;
+  ssize_t rc;
+  while (length < size - 1 && (rc = recv(sock, response + length, size - 1 - length, 0)) > 0) {
+    length += (size_t) rc;
+    response[length] = '\0';
+    const char* last = length > 1 ? response + length - 2 : response;
+    while (last > response && *last != '\n')
+      --last;
+    if (last > response)
+      ++last;
+    if (response[length - 1] == '\n' && (strncmp(last, "OK", 2) == 0 || strncmp(last, "ERROR", 5) == 0))
+      break;
+  }
+  response[length] = '\0';
+  return length;
+}
+#endif
+
+static size_t PrintTestStats(char* buffer, size_t bufferSize, void* args)
+{
+  return (size_t) snprintf(buffer, bufferSize, "capture: handled %d\n", *(int*) args);
+}
+
+TEST_CASE(TestControl, Execute)
+{
+  char* error = NULL;
+  RuleSet_t rules;
+  RuleSetInit(&rules, RuleTableParse("", 0, &error));
+  ControlServer_t c;
+  ControlInit(&c, &rules, NULL, PCAP_LINKTYPE_RAW);
+  static char response[CONTROL_RESPONSE_MAX_SIZE];
+
+  ControlExecute(&c, "add src tcp 10.0.0.1:443", response, sizeof(response));
+  TEST_ASSERT(strcmp(response, "OK version 2\n") == 0, "Cannot add the rule.");
+  ControlExecute(&c, "  add udp any:53\r", response, sizeof(response));
+  TEST_ASSERT(strcmp(response, "OK version 3\n") == 0, "Cannot add the rule of any IP.");
+  ControlExecute(&c, "list", response, sizeof(response));
+  TEST_ASSERT(strcmp(response, "0: src tcp 10.0.0.1:443\n1: udp any:53\nOK version 3, 2 rules\n") == 0,
+              "Invalid list of rules.");
+
+  Direction_t direction;
+  uint32_t ip = 0;
+  inet_pton(AF_INET, "10.0.0.1", &ip);
+  TEST_ASSERT(RuleTableMatch(RuleSetCurrent(&rules), Protocol_TCP, ip, 443, 0, 1, &direction) == 0,
+              "The added rule does not match.");
+
+  ControlExecute(&c, "remove src tcp 10.0.0.1:443", response, sizeof(response));
+  TEST_ASSERT(strcmp(response, "OK version 4\n") == 0, "Cannot remove the rule.");
+  TEST_ASSERT(RuleTableMatch(RuleSetCurrent(&rules), Protocol_TCP, ip, 443, 0, 1, &direction) < 0,
+              "The removed rule matches.");
+  ControlExecute(&c, "remove src tcp 10.0.0.1:443", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "ERROR", 5) == 0, "The missing rule is removed.");
+  ControlExecute(&c, "add sni example.com 10.0.0.1:443", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "ERROR Invalid rule", 18) == 0, "The invalid rule is added.");
+  ControlExecute(&c, "add", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "ERROR", 5) == 0, "The empty rule is added.");
+  ControlExecute(&c, "drop all", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "ERROR Unknown command 'drop'", 28) == 0, "The unknown command is executed.");
+  ControlExecute(&c, "pcap start /tmp/netsniffer.pcap", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "ERROR", 5) == 0, "The pcap file is written without the sink.");
+  ControlExecute(&c, "stats", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "ERROR", 5) == 0, "Statistics are printed without the handler.");
+  ControlExecute(&c, "dump", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "ERROR", 5) == 0, "The flight recorder is dumped without the recorder.");
+
+  int handled = 7;
+  ControlSetStatsHandler(&c, PrintTestStats, &handled);
+  ControlExecute(&c, "stats", response, sizeof(response));
+  TEST_ASSERT(strcmp(response, "capture: handled 7\nOK\n") == 0, "Invalid statistics.");
+  TEST_ASSERT(c.Commands == 12 && c.Errors == 7, "Invalid counters.");
+
+  ControlClear(&c);
+  RuleSetClear(&rules);
+}
+
+TEST_CASE(TestControl, Pcap)
+{
+  char* error = NULL;
+  RuleSet_t rules;
+  RuleSetInit(&rules, RuleTableParse("", 0, &error));
+  PcapSink_t sink;
+  PcapSinkInit(&sink);
+  ControlServer_t c;
+  ControlInit(&c, &rules, &sink, PCAP_LINKTYPE_ETHERNET);
+  static char response[CONTROL_RESPONSE_MAX_SIZE];
+
+  char path[64], command[96];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-control-%d.pcap", (int) rand());
+  snprintf(command, sizeof(command), "pcap start %s  ", path);
+  ControlExecute(&c, command, response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "OK writing", 10) == 0 && PcapSinkStarted(&sink), "Cannot start the pcap file.");
+
+  int8_t data[60] = {0};
+  SnifferPacket_t packet;
+  memset(&packet, 0, sizeof(packet));
+  packet.Data = data;
+  packet.Size = sizeof(data);
+  PcapSinkWrite(&sink, &packet, 1);
+  ControlExecute(&c, "pcap stop", response, sizeof(response));
+  TEST_ASSERT(strcmp(response, "OK 1 packets\n") == 0, "Cannot stop the pcap file.");
+  ControlExecute(&c, "pcap stop", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "ERROR", 5) == 0, "The stopped pcap file is stopped.");
+
+  FILE* file = fopen(path, "rb");
+  PcapFileHeader_t header;
+  TEST_ASSERT(file != NULL && fread(&header, sizeof(header), 1, file) == 1 &&
+                  header.LinkType == PCAP_LINKTYPE_ETHERNET,
+              "Invalid pcap file.");
+  fclose(file);
+  remove(path);
+
+  ControlClear(&c);
+  RuleSetClear(&rules);
+}
+
+#ifdef __linux__
+TEST_CASE(TestControl, ServerWhileMatching)
+{
+  char* error = NULL;
+  RuleSet_t rules;
+  static const char base[] = "tcp 10.0.0.1:443\n";
+  RuleSetInit(&rules, RuleTableParse(base, sizeof(base) - 1, &error));
+  ControlServer_t c;
+  ControlInit(&c, &rules, NULL, PCAP_LINKTYPE_RAW);
+
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-control-%d.sock", (int) getpid());
+  TEST_ASSERT(ControlListen(&c, path) == 0, "Cannot listen on the unix socket.");
+  TEST_ASSERT(ControlStart(&c) == 0, "Cannot start the server thread.");
+
+  ControlReader_t reader = {&rules, 1, 0, 0};
+  pthread_t thread;
+  TEST_ASSERT(pthread_create(&thread, NULL, MatchBaseRule, &reader) == 0, "Cannot start the reader.");
+
+  int sock = Connect(path);
+  TEST_ASSERT(sock >= 0, "Cannot connect to the control socket.");
+  static char response[CONTROL_RESPONSE_MAX_SIZE];
+  uint64_t maxLatencyUs = 0;
+  for (int i = 0; i < CONTROL_TEST_COMMANDS; ++i) {
+    char command[64];
+    // rules of the IP of the base rule are added and removed while the reader matches the base rule
+    snprintf(command, sizeof(command), "%s udp 10.0.0.1:%d\n", i % 2 == 0 ? "add" : "remove", 1000 + i / 2);
+    uint64_t start = GetMonotonicTimeUs();
+    Command(sock, command, response, sizeof(response));
+    uint64_t latency = GetMonotonicTimeUs() - start;
+    maxLatencyUs = latency > maxLatencyUs ? latency : maxLatencyUs;
+    TEST_ASSERT(strncmp(response, "OK version ", 11) == 0, "The command failed.");
+  }
+  Command(sock, "list\n", response, sizeof(response));
+  TEST_ASSERT(strcmp(response, "0: tcp 10.0.0.1:443\nOK version 101, 1 rules\n") == 0, "Invalid rules after commands.");
+  close(sock);
+
+  atomic_store(&reader.Running, 0);
+  pthread_join(thread, NULL);
+  ControlStop(&c);
+  TEST_ASSERT(maxLatencyUs < CONTROL_TEST_MAX_LATENCY_US, "Commands are too slow.");
+  TEST_ASSERT(reader.Matches > 0 && reader.Misses == 0, "The base rule is not matched while rules are changed.");
+  TEST_ASSERT(c.Commands == CONTROL_TEST_COMMANDS + 1 && c.Errors == 0, "Invalid counters.");
+  TEST_ASSERT(access(path, F_OK) != 0, "The unix socket is not removed.");
+
+  // replaced tables are freed after quiescent states of the server and the reader
+  TEST_ASSERT(RuleSetReclaim(&rules) == 0 && rules.Reclaims == CONTROL_TEST_COMMANDS, "Tables are not freed.");
+  ControlClear(&c);
+  RuleSetClear(&rules);
+}
+#endif
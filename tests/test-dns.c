@@ -0,0 +1,140 @@
+#include "testing.h"
+#include "dns.h"
+
+#include <string.h>
+
+// Response: id 0x1234, www.example.com A, one answer with the compressed name (pointer to offset 12)
+static const uint8_t DnsResponseSample[] = {
+    0x12, 0x34, 0x81, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x03, 'w',  'w',  'w',  0x07,
+    'e',  'x',  'a',  'm',  'p',  'l',  'e',  0x03, 'c',  'o',  'm',  0x00, 0x00, 0x01, 0x00, 0x01, 0xC0,
+    0x0C, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x01, 0x2C, 0x00, 0x04, 0x5D, 0xB8, 0xD8, 0x22};
+
+TEST_CASE(TestDns, ParseMessage)
+{
+  DnsMessage_t msg;
+  TEST_ASSERT(DnsParseMessage(DnsResponseSample, sizeof(DnsResponseSample), &msg) == 0, "DnsParseMessage(..) < 0.");
+  TEST_ASSERT(msg.Id == 0x1234, "Invalid ID.");
+  TEST_ASSERT(msg.Response, "Invalid QR flag.");
+  TEST_ASSERT(msg.Rcode == 0, "Invalid response code.");
+  TEST_ASSERT(msg.QType == 1, "Invalid question type.");
+  TEST_ASSERT(msg.ANCount == 1, "Invalid answers count.");
+
+  char name[DNS_NAME_MAX_SIZE];
+  TEST_ASSERT(DnsReadName(msg.Data, msg.Size, msg.QNameOffset, name, sizeof(name), NULL) == 0, "DnsReadName(..) < 0.");
+  TEST_ASSERT(strcmp(name, "www.example.com") == 0, "Invalid question name.");
+
+  DnsRecord_t record;
+  size_t next;
+  TEST_ASSERT(DnsReadRecord(&msg, msg.AnswersOffset, &record, &next) == 0, "DnsReadRecord(..) < 0.");
+  TEST_ASSERT(next == sizeof(DnsResponseSample), "Invalid record size.");
+  TEST_ASSERT(record.TTL == 300 && record.RDLength == 4, "Invalid record.");
+  TEST_ASSERT(DnsReadName(msg.Data, msg.Size, record.NameOffset, name, sizeof(name), NULL) == 0,
+              "DnsReadName(..) < 0 (compressed).");
+  TEST_ASSERT(strcmp(name, "www.example.com") == 0, "Invalid compressed name.");
+
+  TEST_ASSERT(DnsParseMessage(DnsResponseSample, 20, &msg) < 0, "Truncated message is accepted.");
+}
+
+TEST_CASE(TestDns, CompressionLoop)
+{
+  // the name is a pointer to itself
+  const uint8_t message[] = {0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x0C};
+
+  char name[DNS_NAME_MAX_SIZE];
+  TEST_ASSERT(DnsReadName(message, sizeof(message), 12, name, sizeof(name), NULL) < 0, "Pointer loop is accepted.");
+
+  DnsMessage_t msg;
+  TEST_ASSERT(DnsParseMessage(message, sizeof(message), &msg) < 0, "Message with the pointer loop is accepted.");
+}
+
+TEST_CASE(TestDns, PointerJumps)
+{
+  // the root name at the offset 12 and the chain of pointers, each pointer refers to the previous one
+  uint8_t message[DNS_HEADER_SIZE + 1 + 2 * (DNS_POINTER_JUMPS_MAX + 1)];
+  memset(message, 0, sizeof(message));
+  for (size_t i = 0; i <= DNS_POINTER_JUMPS_MAX; ++i) {
+    size_t offset = DNS_HEADER_SIZE + 1 + 2 * i;
+    size_t pointer = i == 0 ? DNS_HEADER_SIZE : offset - 2;
+    message[offset] = (uint8_t) (0xC0 | pointer >> 8);
+    message[offset + 1] = (uint8_t) pointer;
+  }
+
+  char name[DNS_NAME_MAX_SIZE];
+  size_t last = DNS_HEADER_SIZE + 1 + 2 * DNS_POINTER_JUMPS_MAX;
+  TEST_ASSERT(DnsReadName(message, sizeof(message), last - 2, name, sizeof(name), NULL) == 0 && strcmp(name, ".") == 0,
+              "The name with max pointer jumps is not decoded.");
+  TEST_ASSERT(DnsReadName(message, sizeof(message), last, name, sizeof(name), NULL) < 0,
+              "The name with too many pointer jumps is accepted.");
+}
+
+TEST_CASE(TestDns, TrackerLatency)
+{
+  uint8_t query[sizeof(DnsResponseSample)];
+  memcpy(query, DnsResponseSample, sizeof(query));
+  query[2] = 0x01; // QR = 0
+  query[3] = 0x00;
+  query[7] = 0x00; // no answers
+
+  PacketView_t view;
+  memset(&view, 0, sizeof(view));
+  view.Protocol = Protocol_UDP;
+  view.SourceAddress = 0x0100000A;
+  view.DestinationAddress = 0x0200000A;
+  view.SourcePort = 40000;
+  view.DestinationPort = DNS_PORT;
+  view.Payload = (Buffer_t) query;
+  view.PayloadSize = 33;
+
+  TimeInfo_t time;
+  memset(&time, 0, sizeof(time));
+  time.TimestampSec = 100;
+
+  DnsTracker_t tracker;
+  DnsTrackerInit(&tracker, 16);
+
+  DnsEvent_t event;
+  TEST_ASSERT(DnsTrackerProcess(&tracker, &view, &time, &event) == 1, "Query is not decoded.");
+  TEST_ASSERT(!event.Message.Response, "Query is decoded as response.");
+
+  view.SourceAddress = 0x0200000A;
+  view.DestinationAddress = 0x0100000A;
+  view.SourcePort = DNS_PORT;
+  view.DestinationPort = 40000;
+  view.Payload = (Buffer_t) DnsResponseSample;
+  view.PayloadSize = sizeof(DnsResponseSample);
+  time.TimestampNanosec = 2500000; // 2.5 ms
+
+  TEST_ASSERT(DnsTrackerProcess(&tracker, &view, &time, &event) == 1, "Response is not decoded.");
+  TEST_ASSERT(event.Matched, "Response is not matched.");
+  TEST_ASSERT(event.LatencyUs == 2500, "Invalid latency.");
+  TEST_ASSERT(tracker.QNamesCount == 1 && strcmp(tracker.QNames[0].QName, "www.example.com") == 0,
+              "Invalid latency per name.");
+  TEST_ASSERT(tracker.RcodeLatency[0].Count == 1, "Invalid latency per response code.");
+
+  TEST_ASSERT(DnsTrackerProcess(&tracker, &view, &time, &event) == 1 && !event.Matched,
+              "Duplicate response is matched.");
+  TEST_ASSERT(tracker.Unmatched == 1, "Invalid unmatched counter.");
+
+  // another name with the same hash has its own latency
+  strcpy(tracker.QNames[0].QName, "other.example.com");
+  view.SourceAddress = 0x0100000A;
+  view.DestinationAddress = 0x0200000A;
+  view.SourcePort = 40000;
+  view.DestinationPort = DNS_PORT;
+  view.Payload = (Buffer_t) query;
+  view.PayloadSize = 33;
+  TEST_ASSERT(DnsTrackerProcess(&tracker, &view, &time, &event) == 1, "Query is not decoded.");
+
+  view.SourceAddress = 0x0200000A;
+  view.DestinationAddress = 0x0100000A;
+  view.SourcePort = DNS_PORT;
+  view.DestinationPort = 40000;
+  view.Payload = (Buffer_t) DnsResponseSample;
+  view.PayloadSize = sizeof(DnsResponseSample);
+  TEST_ASSERT(DnsTrackerProcess(&tracker, &view, &time, &event) == 1 && event.Matched, "Response is not matched.");
+  TEST_ASSERT(tracker.QNamesCount == 2 && strcmp(tracker.QNames[1].QName, "www.example.com") == 0 &&
+                  tracker.QNames[0].Latency.Count == 1,
+              "Latency of names with the same hash is mixed.");
+
+  DnsTrackerClear(&tracker);
+}
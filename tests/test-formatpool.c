@@ -0,0 +1,124 @@
+#include "testing.h"
+#include "formatpool.h"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <unistd.h>
+
+#define RECORDS_COUNT 200
+
+static void FormatNumber(const uint8_t* input, size_t size, FormatSlab_t* slab, size_t worker, void* args)
+{
+  (void) worker;
+  (void) args;
+
+  uint64_t number;
+  memcpy(&number, input, size);
+  // slow records are completed after the next ones
+  if (number % 4 == 0)
+    usleep(1000);
+
+  char line[32];
+  FormatSlabWrite(slab, line, (size_t) snprintf(line, sizeof(line), "%llu\n", (unsigned long long) number));
+}
+
+static void SubmitNumbers(FormatPool_t* pool, uint64_t count)
+{
+  for (uint64_t i = 0; i < count; ++i) {
+    uint8_t* input = FormatPoolAcquire(pool);
+    memcpy(input, &i, sizeof(i));
+    FormatPoolSubmit(pool, sizeof(i));
+  }
+}
+
+static bool ReadNumbers(int fd, uint64_t count)
+{
+  static char expected[RECORDS_COUNT * 8], buffer[RECORDS_COUNT * 8];
+  size_t expectedLength = 0;
+  for (uint64_t i = 0; i < count; ++i)
+    expectedLength += (size_t) snprintf(
+        expected + expectedLength, sizeof(expected) - expectedLength, "%llu\n", (unsigned long long) i);
+
+  // all records are written when the output is stopped
+  size_t length = 0;
+  while (length < expectedLength) {
+    ssize_t rc = read(fd, buffer + length, expectedLength - length);
+    if (rc <= 0)
+      break;
+    length += (size_t) rc;
+  }
+  return length == expectedLength && memcmp(buffer, expected, length) == 0;
+}
+
+TEST_CASE(TestFormatPool, Order)
+{
+  int fds[2];
+  TEST_ASSERT(pipe(fds) == 0, "Cannot create a pipe.");
+
+  Output_t output;
+  OutputInit(&output, fds[1], 64, 0);
+  FormatPool_t pool;
+  FormatPoolInit(&pool, 4, 16, sizeof(uint64_t), FormatNumber, NULL, &output);
+  TEST_ASSERT(FormatPoolStart(&pool) == 0, "Cannot start worker threads.");
+
+  SubmitNumbers(&pool, RECORDS_COUNT);
+  FormatPoolStop(&pool);
+  OutputStop(&output);
+  TEST_ASSERT(ReadNumbers(fds[0], RECORDS_COUNT), "Records are not written in the order of submission.");
+  TEST_ASSERT(pool.Slots.Jobs == RECORDS_COUNT, "Invalid count of formatted records.");
+  TEST_ASSERT(pool.Slots.Reordered > 0, "Records completed out of order are not counted.");
+
+  FormatPoolClear(&pool);
+  OutputClear(&output);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE(TestFormatPool, Stalls)
+{
+  int fds[2];
+  TEST_ASSERT(pipe(fds) == 0, "Cannot create a pipe.");
+
+  // the window is smaller than the submitted records, the producer waits for the writer
+  Output_t output;
+  OutputInit(&output, fds[1], 64, 0);
+  FormatPool_t pool;
+  FormatPoolInit(&pool, 2, 2, sizeof(uint64_t), FormatNumber, NULL, &output);
+  TEST_ASSERT(FormatPoolStart(&pool) == 0, "Cannot start worker threads.");
+
+  SubmitNumbers(&pool, 16);
+  FormatPoolStop(&pool);
+  OutputStop(&output);
+  TEST_ASSERT(ReadNumbers(fds[0], 16), "Records are not written in the order of submission.");
+  TEST_ASSERT(pool.Slots.Stalls > 0 && pool.Slots.StalledUs > 0, "Window stalls are not counted.");
+
+  FormatPoolClear(&pool);
+  OutputClear(&output);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE(TestFormatPool, Synchronous)
+{
+  int fds[2];
+  TEST_ASSERT(pipe(fds) == 0, "Cannot create a pipe.");
+
+  // without worker threads records are formatted by the producer
+  Output_t output;
+  OutputInit(&output, fds[1], 64, 0);
+  FormatPool_t pool;
+  FormatPoolInit(&pool, 2, 4, sizeof(uint64_t), FormatNumber, NULL, &output);
+
+  SubmitNumbers(&pool, 10);
+  FormatPoolStop(&pool);
+  OutputStop(&output);
+  TEST_ASSERT(ReadNumbers(fds[0], 10), "Records are not written in the order of submission.");
+  TEST_ASSERT(pool.Slots.Jobs == 10 && pool.Slots.Reordered == 0 && pool.Slots.Stalls == 0, "Invalid counters.");
+
+  FormatPoolClear(&pool);
+  OutputClear(&output);
+  close(fds[0]);
+  close(fds[1]);
+}
+#endif
@@ -0,0 +1,34 @@
+#include "testing.h"
+#include "histogram.h"
+
+TEST_CASE(TestHistogram, BucketBounds)
+{
+  for (uint64_t value = 0; value < 100000; value += 7) {
+    int index = HistogramBucketIndex(value);
+    TEST_ASSERT(index >= 0 && index < HISTOGRAM_BUCKETS_COUNT, "Invalid bucket index.");
+    TEST_ASSERT(value <= HistogramBucketUpperBound(index), "Value is greater than the bucket upper bound.");
+    TEST_ASSERT(index == 0 || value > HistogramBucketUpperBound(index - 1), "Value fits into the previous bucket.");
+  }
+  TEST_ASSERT(HistogramBucketIndex(UINT64_MAX) == HISTOGRAM_BUCKETS_COUNT - 1, "Invalid index of the max value.");
+}
+
+TEST_CASE(TestHistogram, Percentiles)
+{
+  Histogram_t h;
+  HistogramInit(&h);
+  for (uint64_t value = 1; value <= 1000; ++value)
+    HistogramAdd(&h, value);
+
+  TEST_ASSERT(h.Count == 1000 && h.Min == 1 && h.Max == 1000, "Invalid counters.");
+  TEST_ASSERT(HistogramMean(&h) == 500, "Invalid mean.");
+
+  uint64_t p50 = HistogramPercentile(&h, 50.0);
+  TEST_ASSERT(p50 >= 500 && p50 < 500 * 5 / 4, "Invalid p50.");
+  TEST_ASSERT(HistogramPercentile(&h, 100.0) == 1000, "Invalid p100.");
+
+  Histogram_t other;
+  HistogramInit(&other);
+  HistogramAdd(&other, 5000);
+  HistogramMerge(&h, &other);
+  TEST_ASSERT(h.Count == 1001 && h.Max == 5000, "Invalid merge.");
+}
@@ -0,0 +1,118 @@
+#include "testing.h"
+#include "http.h"
+
+#include <string.h>
+
+TEST_CASE(TestHttp, FindDelimiter)
+{
+  const char* data = "0123456789abcdefghijklmnopqrstuv wxyz";
+  TEST_ASSERT(HttpFindDelimiter((const uint8_t*) data, strlen(data)) == 32, "Invalid delimiter index.");
+  TEST_ASSERT(HttpFindDelimiter((const uint8_t*) data, 20) == 20, "Delimiter found out of the data.");
+  TEST_ASSERT(HttpFindDelimiter((const uint8_t*) "GET\r\n", 5) == 3, "Invalid CR index.");
+}
+
+TEST_CASE(TestHttp, ParseStartLine)
+{
+  HttpStartLine_t line;
+  const char* request = "GET /api/v1/users?id=1 HTTP/1.1\r\nHost: example.com\r\n\r\n";
+  TEST_ASSERT(HttpParseStartLine((const uint8_t*) request, strlen(request), &line) == 33, "Request is not decoded.");
+  TEST_ASSERT(!line.Response && line.Method == HttpMethod_GET, "Invalid method.");
+  TEST_ASSERT(line.TargetSize == 18 && memcmp(line.Target, "/api/v1/users?id=1", 18) == 0, "Invalid target.");
+
+  const char* response = "HTTP/1.1 404 Not Found\r\n\r\n";
+  TEST_ASSERT(HttpParseStartLine((const uint8_t*) response, strlen(response), &line) == 24, "Response is not decoded.");
+  TEST_ASSERT(line.Response && line.Status == 404, "Invalid status.");
+  TEST_ASSERT(line.ReasonSize == 9 && memcmp(line.Reason, "Not Found", 9) == 0, "Invalid reason.");
+
+  TEST_ASSERT(HttpParseStartLine((const uint8_t*) request, 10, &line) == 0, "Incomplete request is not detected.");
+  TEST_ASSERT(HttpParseStartLine((const uint8_t*) "\x16\x03\x01\x02", 4, &line) < 0, "TLS record is decoded.");
+  TEST_ASSERT(HttpParseStartLine((const uint8_t*) "FOO / HTTP/1.1\r\n", 16, &line) < 0, "Unknown method is decoded.");
+}
+
+TEST_CASE(TestHttp, TrackerLatency)
+{
+  HttpTracker_t tracker;
+  HttpTrackerInit(&tracker, 16);
+
+  PacketView_t view;
+  memset(&view, 0, sizeof(view));
+  view.Protocol = Protocol_TCP;
+  view.SourceAddress = 0x0100000A;
+  view.DestinationAddress = 0x0200000A;
+  view.SourcePort = 40000;
+  view.DestinationPort = 80;
+  view.SequenceNumber = 1000;
+
+  TimeInfo_t time;
+  memset(&time, 0, sizeof(time));
+  time.TimestampSec = 100;
+
+  // the request line is split across two segments
+  const char* request = "POST /api/v1/users/42 HTTP/1.1\r\n\r\n";
+  view.Payload = (Buffer_t) request;
+  view.PayloadSize = 12;
+
+  HttpEvent_t event;
+  TEST_ASSERT(HttpTrackerProcess(&tracker, &view, &time, &event) == 0, "Incomplete request is decoded.");
+
+  view.Payload = (Buffer_t) request + 12;
+  view.PayloadSize = strlen(request) - 12;
+  view.SequenceNumber = 1012;
+  TEST_ASSERT(HttpTrackerProcess(&tracker, &view, &time, &event) == 1, "Reassembled request is not decoded.");
+  TEST_ASSERT(event.Method == HttpMethod_POST && strcmp(event.Path, "/api/v1/users/42") == 0, "Invalid request.");
+  TEST_ASSERT(tracker.Reassembled == 1, "Invalid reassembled counter.");
+
+  const char* response = "HTTP/1.1 201 Created\r\n\r\n";
+  view.SourceAddress = 0x0200000A;
+  view.DestinationAddress = 0x0100000A;
+  view.SourcePort = 80;
+  view.DestinationPort = 40000;
+  view.Payload = (Buffer_t) response;
+  view.PayloadSize = strlen(response);
+  time.TimestampNanosec = 7000000; // 7 ms
+
+  TEST_ASSERT(HttpTrackerProcess(&tracker, &view, &time, &event) == 1, "Response is not decoded.");
+  TEST_ASSERT(event.Matched && event.LatencyUs == 7000, "Invalid response time.");
+  TEST_ASSERT(tracker.EndpointsCount == 1 && strcmp(tracker.Endpoints[0].PathPrefix, "/api/v1") == 0,
+              "Invalid endpoint.");
+  TEST_ASSERT(tracker.Endpoints[0].StatusClasses[2] == 1, "Invalid status class counter.");
+
+  TEST_ASSERT(HttpTrackerProcess(&tracker, &view, &time, &event) == 1 && !event.Matched,
+              "Duplicate response is matched.");
+
+  HttpTrackerClear(&tracker);
+}
+
+TEST_CASE(TestHttp, StaleCarry)
+{
+  HttpTracker_t tracker;
+  HttpTrackerInit(&tracker, 16);
+
+  PacketView_t view;
+  memset(&view, 0, sizeof(view));
+  view.Protocol = Protocol_TCP;
+  view.SourceAddress = 0x0100000A;
+  view.DestinationAddress = 0x0200000A;
+  view.SourcePort = 40000;
+  view.DestinationPort = 80;
+  view.SequenceNumber = 1000;
+
+  TimeInfo_t time;
+  memset(&time, 0, sizeof(time));
+
+  // the continuation of the incomplete line is lost, the next request starts at another sequence number
+  HttpEvent_t event;
+  view.Payload = (Buffer_t) "GET /lost";
+  view.PayloadSize = 9;
+  TEST_ASSERT(HttpTrackerProcess(&tracker, &view, &time, &event) == 0, "Incomplete request is decoded.");
+
+  const char* request = "GET /index.html HTTP/1.1\r\n\r\n";
+  view.Payload = (Buffer_t) request;
+  view.PayloadSize = strlen(request);
+  view.SequenceNumber = 5000;
+  TEST_ASSERT(HttpTrackerProcess(&tracker, &view, &time, &event) == 1, "The segment after the stale carry is skipped.");
+  TEST_ASSERT(event.Method == HttpMethod_GET && strcmp(event.Path, "/index.html") == 0, "Invalid request.");
+  TEST_ASSERT(tracker.Reassembled == 0, "The request is reassembled with the stale carry.");
+
+  HttpTrackerClear(&tracker);
+}
@@ -0,0 +1,85 @@
+#include "testing.h"
+#include "metrics.h"
+
+#include <string.h>
+#ifdef __linux__
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static size_t Request(const char* path, const char* request, char* response, size_t size)
+{
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0 || connect(sock, (struct sockaddr*) &address, sizeof(address)) < 0) {
+    close(sock);
+    return 0;
+  }
+  send(sock, request, strlen(request), 0);
+
+  size_t length = 0;
+  ssize_t rc;
+  while (length < size - 1 && (rc = recv(sock, response + length, size - 1 - length, 0)) > 0)
+    length += (size_t) rc;
+  response[length] = '\0';
+  close(sock);
+  return length;
+}
+
+TEST_CASE(TestMetrics, PublishRead)
+{
+  Sniffer_t sniffer;
+  memset(&sniffer, 0, sizeof(sniffer));
+  MetricsServer_t m;
+  MetricsInit(&m, &sniffer);
+
+  static MetricsSnapshot_t snapshot, copy;
+  MetricsRead(&m, &copy);
+  TEST_ASSERT(copy.Capture.Received == 0 && copy.Traffic.Total.Packets == 0, "The initial snapshot is not empty.");
+
+  TEST_ASSERT(MetricsPublishDue(&m, METRICS_PUBLISH_INTERVAL_US), "The first snapshot is not due.");
+  snapshot.Capture.Received = 10;
+  snapshot.Traffic.Total.Packets = 7;
+  MetricsPublish(&m, &snapshot, METRICS_PUBLISH_INTERVAL_US);
+  TEST_ASSERT(!MetricsPublishDue(&m, METRICS_PUBLISH_INTERVAL_US + 1), "The snapshot is due before the interval.");
+
+  MetricsRead(&m, &copy);
+  TEST_ASSERT(copy.Capture.Received == 10 && copy.Traffic.Total.Packets == 7, "The published snapshot is not read.");
+  MetricsClear(&m);
+}
+
+TEST_CASE(TestMetrics, Server)
+{
+  Sniffer_t sniffer;
+  memset(&sniffer, 0, sizeof(sniffer));
+  MetricsServer_t m;
+  MetricsInit(&m, &sniffer);
+
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-metrics-%d.sock", (int) getpid());
+  TEST_ASSERT(MetricsListen(&m, path) == 0, "Cannot listen on the unix socket.");
+  TEST_ASSERT(MetricsStart(&m) == 0, "Cannot start the server thread.");
+
+  static MetricsSnapshot_t snapshot;
+  snapshot.Capture.KernelDrops = 42;
+  MetricsPublish(&m, &snapshot, 1);
+
+  static char response[METRICS_BUFFER_SUFFICIENT_SIZE];
+  Request(path, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "HTTP/1.1 200 OK\r\n", 17) == 0, "Invalid status of /metrics.");
+  TEST_ASSERT(strstr(response, "\nnetsniffer_kernel_drops_total 42\n") != NULL, "The published counter is not served.");
+
+  Request(path, "GET / HTTP/1.1\r\n\r\n", response, sizeof(response));
+  TEST_ASSERT(strncmp(response, "HTTP/1.1 404 Not Found\r\n", 24) == 0, "Invalid status of the unknown path.");
+
+  MetricsStop(&m);
+  TEST_ASSERT(m.Requests == 1 && m.Errors == 1, "Invalid counters.");
+  TEST_ASSERT(access(path, F_OK) != 0, "The unix socket is not removed.");
+  MetricsClear(&m);
+}
+#endif
@@ -0,0 +1,165 @@
+#include "testing.h"
+#include "netsniffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define BATCH_TEST_FRAMES 3
+
+typedef struct
+{
+  bool ClientHelloDecoded[BATCH_TEST_FRAMES];
+  const char* SNI[BATCH_TEST_FRAMES];
+  size_t Count;
+  size_t Batches;
+} BatchState_t;
+
+static void HandleBatch(void* owner, const SnifferPacket_t* packets, size_t count, HandlerArgs_t args)
+{
+  (void) owner;
+
+  BatchState_t* state = (BatchState_t*) args;
+  state->Batches++;
+  for (size_t i = 0; i < count && state->Count < BATCH_TEST_FRAMES; ++i) {
+    state->ClientHelloDecoded[state->Count] = packets[i].ClientHelloDecoded;
+    state->SNI[state->Count++] = packets[i].SNI;
+  }
+}
+
+static void SendFrame(int sock, uint16_t sport, const char* sni)
+{
+  // ETH header (zeros), 10.0.0.1:sport -> 10.0.0.2:443, TCP with the ClientHello or other data
+  uint8_t frame[128];
+  memset(frame, 0, sizeof(frame));
+  uint8_t* ip = frame + 14;
+  uint8_t* tcp = ip + 20;
+  uint8_t* payload = tcp + 20;
+  size_t length = 3;
+  if (sni != NULL) {
+    size_t n = strlen(sni);
+    uint8_t hello[] = {0x16, 0x03, 0x01, 0x00, (uint8_t) (n + 56), // record: handshake, TLS 1.0, length
+                       0x01, 0x00, 0x00, (uint8_t) (n + 52),       // handshake: ClientHello, length
+                       0x03, 0x03};                                // client version: TLS 1.2
+    uint8_t tail[] = {0x00,                                        // session ID
+                      0x00, 0x02, 0x13, 0x01,                      // cipher suites: TLS_AES_128_GCM
+                      0x01, 0x00,                                  // compression methods: null
+                      0x00, (uint8_t) (n + 9),                     // extensions length
+                      0x00, 0x00, 0x00, (uint8_t) (n + 5),         // server_name
+                      0x00, (uint8_t) (n + 3), 0x00, 0x00, (uint8_t) n};
+    memcpy(payload, hello, sizeof(hello));
+    memcpy(payload + sizeof(hello) + 32, tail, sizeof(tail)); // zero random
+    memcpy(payload + sizeof(hello) + 32 + sizeof(tail), sni, n);
+    length = n + 61;
+  } else {
+    memcpy(payload, "xyz", 3);
+  }
+  ip[0] = 0x45;
+  ip[2] = (uint8_t) ((40 + length) >> 8);
+  ip[3] = (uint8_t) (40 + length);
+  ip[8] = 64;
+  ip[9] = 6;
+  ip[12] = ip[16] = 10;
+  ip[15] = 1;
+  ip[19] = 2;
+  tcp[0] = (uint8_t) (sport >> 8);
+  tcp[1] = (uint8_t) sport;
+  tcp[2] = 0x01;
+  tcp[3] = 0xBB;
+  tcp[12] = 0x50;
+  tcp[13] = 0x18; // PSH, ACK
+  tcp[14] = 0xFF;
+  send(sock, frame, 54 + length, 0);
+}
+#endif
+
+TEST_CASE(TestNetsniffer, Version)
+{
+  char version[32];
+  snprintf(version, sizeof(version), "%d.%d.%d", NETSNIFFER_VERSION_MAJOR, NETSNIFFER_VERSION_MINOR,
+           NETSNIFFER_VERSION_PATCH);
+  TEST_ASSERT(strcmp(NetsnifferVersion(), version) == 0, "The library version does not match the headers.");
+  TEST_ASSERT(NetsnifferVersionNumber() == NETSNIFFER_VERSION_MAJOR * 10000 + NETSNIFFER_VERSION_MINOR * 100 +
+                                               NETSNIFFER_VERSION_PATCH,
+              "Invalid version number.");
+}
+
+TEST_CASE(TestNetsniffer, BackendNames)
+{
+  TEST_ASSERT(strcmp(SnifferBackendToString(SnifferBackend_AUTO), "auto") == 0, "Invalid name of the auto backend.");
+  TEST_ASSERT(strcmp(SnifferBackendToString(SnifferBackend_PACKET_SOCKET), "packet-socket") == 0,
+              "Invalid name of the packet socket backend.");
+  TEST_ASSERT(strcmp(SnifferBackendToString(SnifferBackend_RAW_SOCKET), "raw-socket") == 0,
+              "Invalid name of the raw socket backend.");
+}
+
+TEST_CASE(TestNetsniffer, MatchAddress)
+{
+  // 127.0.0.1:40000 -> 127.0.0.2:53, UDP
+  uint8_t packet[28] = {0x45, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00, 0x7F, 0x00,
+                        0x00, 0x01, 0x7F, 0x00, 0x00, 0x02, 0x9C, 0x40, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00};
+  Sniffer_t s;
+  memset(&s, 0, sizeof(s));
+  Filter_t tcp, dst;
+  FilterInitDefaults(&tcp);
+  FilterInitDefaults(&dst);
+  tcp.Protocol = Protocol_TCP;
+  dst.Direction = Direction_DESTINATION;
+  TEST_ASSERT(SnifferAddAddress(&s, "127.0.0.2:53", &tcp) == 0 && SnifferAddAddress(&s, "127.0.0.1:0", &dst) == 0 &&
+                  SnifferAddAddress(&s, "any:53", NULL) == 0,
+              "Cannot add addresses.");
+
+  bool tlsProcessed = false;
+  TEST_ASSERT(SnifferMatchAddress(&s, (Buffer_t) packet, sizeof(packet), "127.0.0.1", 40000, "127.0.0.2", 53,
+                                  &tlsProcessed),
+              "The packet does not match.");
+  TEST_ASSERT(s.MatchedAddress == 2 && s.MatchedDirection == Direction_DESTINATION && !tlsProcessed,
+              "Invalid matched address.");
+  TEST_ASSERT(!SnifferMatchAddress(&s, (Buffer_t) packet, sizeof(packet), "127.0.0.1", 40000, "127.0.0.2", 54,
+                                   &tlsProcessed),
+              "The packet matches the other port.");
+  SnifferClear(&s);
+}
+
+#ifdef __linux__
+TEST_CASE(TestNetsniffer, BatchTls)
+{
+  // frames are read from the datagram socket instead of the packet socket
+  int fds[2];
+  TEST_ASSERT(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == 0, "Cannot create sockets.");
+  Sniffer_t s;
+  memset(&s, 0, sizeof(s));
+  s.__sock = fds[0];
+  s.__buf = malloc(ETH_MAX_PACKET_SIZE);
+  s.__rulesReader = -1;
+  strcpy(s.__bindIP, "10.0.0.2");
+  BatchState_t state;
+  memset(&state, 0, sizeof(state));
+  TEST_ASSERT(SnifferAddAddress(&s, "any:443", NULL) == 0 && SnifferDecodeTls(&s) == 0 &&
+                  SnifferSetBatchHandler(&s, HandleBatch, &state, 8) == 0,
+              "Cannot init the sniffer.");
+  s.__running = 1;
+
+  SendFrame(fds[1], 40000, "a.example.com");
+  SendFrame(fds[1], 40001, "b.example.com");
+  SendFrame(fds[1], 40000, NULL);
+  TEST_ASSERT(SnifferProcessNextPacket(&s) == 0, "Cannot process frames.");
+  TEST_ASSERT(state.Batches == 1 && state.Count == BATCH_TEST_FRAMES && s.Stats.Handled == BATCH_TEST_FRAMES,
+              "Frames are not passed in one batch.");
+
+  // each packet keeps the TLS result of its own frame
+  TEST_ASSERT(state.ClientHelloDecoded[0] && state.SNI[0] != NULL && strcmp(state.SNI[0], "a.example.com") == 0,
+              "Invalid TLS result of the first packet.");
+  TEST_ASSERT(state.ClientHelloDecoded[1] && state.SNI[1] != NULL && strcmp(state.SNI[1], "b.example.com") == 0,
+              "Invalid TLS result of the second packet.");
+  TEST_ASSERT(!state.ClientHelloDecoded[2] && state.SNI[2] != NULL && strcmp(state.SNI[2], "a.example.com") == 0,
+              "Invalid TLS result of the data segment.");
+
+  close(fds[0]);
+  close(fds[1]);
+  SnifferClear(&s);
+}
+#endif
@@ -0,0 +1,90 @@
+#include "testing.h"
+#include "output.h"
+
+#include <string.h>
+#ifdef __linux__
+#include <unistd.h>
+
+static size_t ReadAll(int fd, char* buffer, size_t size)
+{
+  size_t length = 0;
+  while (length < size) {
+    ssize_t rc = read(fd, buffer + length, size - length);
+    if (rc <= 0)
+      break;
+    length += (size_t) rc;
+  }
+  buffer[length] = '\0';
+  return length;
+}
+
+TEST_CASE(TestOutput, FlushBySize)
+{
+  int fds[2];
+  TEST_ASSERT(pipe(fds) == 0, "Cannot create a pipe.");
+
+  Output_t output;
+  OutputInit(&output, fds[1], 8, 60000);
+  TEST_ASSERT(OutputStart(&output) == 0, "Cannot start the writer thread.");
+
+  // the full block is written at once, the rest waits for the flush interval
+  OutputWriteString(&output, "0123");
+  OutputWriteString(&output, "456789AB");
+  char buffer[64];
+  TEST_ASSERT(ReadAll(fds[0], buffer, 8) == 8 && strcmp(buffer, "01234567") == 0, "The full block is not written.");
+
+  OutputStop(&output);
+  TEST_ASSERT(ReadAll(fds[0], buffer, 4) == 4 && strcmp(buffer, "89AB") == 0, "Pending records are not written.");
+  TEST_ASSERT(output.BytesWritten == 12 && output.Blocks == 2 && output.SizeFlushes == 1 && output.TimeFlushes == 0,
+              "Invalid counters.");
+  TEST_ASSERT(output.FlushLatency.Count == 2 && output.WriteErrors == 0, "Invalid flush latency.");
+
+  OutputClear(&output);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE(TestOutput, FlushByTime)
+{
+  int fds[2];
+  TEST_ASSERT(pipe(fds) == 0, "Cannot create a pipe.");
+
+  Output_t output;
+  OutputInit(&output, fds[1], 1024, 5);
+  TEST_ASSERT(OutputStart(&output) == 0, "Cannot start the writer thread.");
+
+  OutputWriteString(&output, "record");
+  char buffer[64];
+  TEST_ASSERT(ReadAll(fds[0], buffer, 6) == 6 && strcmp(buffer, "record") == 0, "The record is not flushed.");
+
+  OutputStop(&output);
+  TEST_ASSERT(output.TimeFlushes == 1 && output.SizeFlushes == 0 && output.Blocks == 1, "Invalid counters.");
+  TEST_ASSERT(output.FlushLatency.Min >= 5000, "The block is written before the flush interval.");
+
+  OutputClear(&output);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE(TestOutput, Synchronous)
+{
+  int fds[2];
+  TEST_ASSERT(pipe(fds) == 0, "Cannot create a pipe.");
+
+  // without the writer thread the producer writes full blocks
+  Output_t output;
+  OutputInit(&output, fds[1], 4, 60000);
+  char records[OUTPUT_BLOCKS_COUNT * 4 + 3];
+  memset(records, 'x', sizeof(records));
+  OutputWrite(&output, records, sizeof(records));
+  TEST_ASSERT(output.BytesWritten == OUTPUT_BLOCKS_COUNT * 4 && output.Blocked == 0, "Full blocks are not written.");
+
+  OutputStop(&output);
+  char buffer[sizeof(records) + 1];
+  TEST_ASSERT(ReadAll(fds[0], buffer, sizeof(records)) == sizeof(records), "Invalid written data.");
+
+  OutputClear(&output);
+  close(fds[0]);
+  close(fds[1]);
+}
+#endif
@@ -0,0 +1,147 @@
+#include "testing.h"
+#include "pcap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct
+{
+  PcapSink_t* Sink;
+  atomic_int Running;
+  uint64_t Batches;
+} PcapCapture_t;
+
+static void* CapturePackets(void* args)
+{
+  PcapCapture_t* capture = (PcapCapture_t*) args;
+  int8_t data[64] = {0x45};
+  SnifferPacket_t packets[8];
+  memset(packets, 0, sizeof(packets));
+  for (size_t i = 0; i < 8; ++i) {
+    packets[i].Data = data;
+    packets[i].Size = sizeof(data);
+  }
+  while (atomic_load(&capture->Running)) {
+    PcapSinkWrite(capture->Sink, packets, 8);
+    capture->Batches++;
+  }
+  return NULL;
+}
+#endif
+
+TEST_CASE(TestPcap, Write)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-%d.pcap", (int) rand());
+  PcapSink_t sink;
+  PcapSinkInit(&sink);
+
+  int8_t first[20] = {0x45, 0x00, 0x00, 0x14};
+  int8_t second[28] = {0x45, 0x00, 0x00, 0x1C};
+  SnifferPacket_t packets[2];
+  memset(packets, 0, sizeof(packets));
+  packets[0].Data = first;
+  packets[0].Size = sizeof(first);
+  packets[0].Time.TimestampSec = 1700000000;
+  packets[0].Time.TimestampNanosec = 123456789;
+  packets[1].Data = second;
+  packets[1].Size = sizeof(second);
+
+  // packets are not written before the start
+  PcapSinkWrite(&sink, packets, 2);
+  TEST_ASSERT(PcapSinkStop(&sink) < 0, "The stopped sink is stopped.");
+
+  char* error = NULL;
+  TEST_ASSERT(PcapSinkStart(&sink, path, PCAP_LINKTYPE_RAW, &error) == 0, "Cannot start the sink.");
+  TEST_ASSERT(PcapSinkStart(&sink, path, PCAP_LINKTYPE_RAW, &error) < 0, "The started sink is started.");
+  free(error);
+  error = NULL;
+  PcapSinkWrite(&sink, packets, 2);
+  TEST_ASSERT(PcapSinkStop(&sink) == 2, "Invalid count of written packets.");
+  PcapSinkWrite(&sink, packets, 2);
+
+  FILE* file = fopen(path, "rb");
+  TEST_ASSERT(file != NULL, "The pcap file is not created.");
+  PcapFileHeader_t header;
+  PcapRecordHeader_t record;
+  uint8_t data[64];
+  TEST_ASSERT(fread(&header, sizeof(header), 1, file) == 1, "The file header is not written.");
+  TEST_ASSERT(header.Magic == PCAP_MAGIC_NANOSECONDS && header.VersionMajor == 2 && header.VersionMinor == 4 &&
+                  header.LinkType == PCAP_LINKTYPE_RAW,
+              "Invalid file header.");
+  TEST_ASSERT(fread(&record, sizeof(record), 1, file) == 1 && record.TimestampSec == 1700000000 &&
+                  record.TimestampNanosec == 123456789 && record.CapturedLength == sizeof(first) &&
+                  record.OriginalLength == sizeof(first),
+              "Invalid header of the first packet.");
+  TEST_ASSERT(fread(data, 1, sizeof(first), file) == sizeof(first) && memcmp(data, first, sizeof(first)) == 0,
+              "Invalid data of the first packet.");
+  TEST_ASSERT(fread(&record, sizeof(record), 1, file) == 1 && record.CapturedLength == sizeof(second),
+              "Invalid header of the second packet.");
+  TEST_ASSERT(fread(data, 1, sizeof(second), file) == sizeof(second) && fread(data, 1, 1, file) == 0,
+              "Packets are written after the stop.");
+  fclose(file);
+  remove(path);
+
+  TEST_ASSERT(PcapSinkStart(&sink, "/nonexistent/netsniffer.pcap", PCAP_LINKTYPE_RAW, &error) < 0 && error != NULL,
+              "The file in the missing directory is created.");
+  free(error);
+}
+
+TEST_CASE(TestPcap, WriteRecord)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-%d.pcap", (int) rand());
+  PcapWriter_t writer;
+  memset(&writer, 0, sizeof(writer));
+  TEST_ASSERT(PcapWriterOpen(&writer, path, PCAP_LINKTYPE_RAW) == 0, "Cannot open the writer.");
+
+  // the packet of 1500 bytes was truncated by the capture
+  uint8_t packet[20] = {0x45, 0x00, 0x05, 0xDC};
+  PcapRecordHeader_t written = {1700000000, 5, sizeof(packet), 1500};
+  TEST_ASSERT(PcapWriterWriteRecord(&writer, &written, packet) == 0, "Cannot write the record.");
+  TEST_ASSERT(writer.Packets == 1 && writer.Bytes == sizeof(PcapFileHeader_t) + sizeof(written) + sizeof(packet),
+              "Invalid counters.");
+  PcapWriterClose(&writer);
+
+  FILE* file = fopen(path, "rb");
+  TEST_ASSERT(file != NULL, "The pcap file is not created.");
+  PcapFileHeader_t header;
+  PcapRecordHeader_t record;
+  uint8_t data[sizeof(packet)];
+  TEST_ASSERT(fread(&header, sizeof(header), 1, file) == 1 && fread(&record, sizeof(record), 1, file) == 1 &&
+                  memcmp(&record, &written, sizeof(record)) == 0,
+              "The original length is not kept.");
+  TEST_ASSERT(fread(data, 1, sizeof(data), file) == sizeof(data) && memcmp(data, packet, sizeof(packet)) == 0,
+              "Invalid data of the packet.");
+  fclose(file);
+  remove(path);
+}
+
+#ifdef __linux__
+TEST_CASE(TestPcap, StartStopWhileCapturing)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-%d.pcap", (int) getpid());
+  PcapSink_t sink;
+  PcapSinkInit(&sink);
+  PcapCapture_t capture = {&sink, 1, 0};
+  pthread_t thread;
+  TEST_ASSERT(pthread_create(&thread, NULL, CapturePackets, &capture) == 0, "Cannot start the capture thread.");
+
+  // writers are closed only after the capture thread leaves them, otherwise ASAN reports use after free
+  char* error = NULL;
+  for (int i = 0; i < 200; ++i) {
+    TEST_ASSERT(PcapSinkStart(&sink, path, PCAP_LINKTYPE_ETHERNET, &error) == 0, "Cannot start the sink.");
+    int64_t packets = PcapSinkStop(&sink);
+    TEST_ASSERT(packets >= 0 && packets % 8 == 0, "The batch is partially written.");
+  }
+  atomic_store(&capture.Running, 0);
+  pthread_join(thread, NULL);
+  TEST_ASSERT(capture.Batches > 0, "The capture thread is stuck.");
+  unlink(path);
+}
+#endif
@@ -0,0 +1,174 @@
+#include "testing.h"
+#include "pipeline.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PACKETS_COUNT 1000
+
+typedef struct
+{
+  bool Initialized;
+  bool Flushed;
+  uint64_t Packets;
+  uint64_t Next;     // the next expected number
+  bool Ordered;      // packets are received in the push order
+  uint64_t Checksum; // sum of numbers in data
+} SinkState_t;
+
+static int InitSink(void* state)
+{
+  ((SinkState_t*) state)->Initialized = true;
+  return 0;
+}
+
+static void FlushSink(void* state)
+{
+  ((SinkState_t*) state)->Flushed = true;
+}
+
+static size_t PrintSinkStats(const void* state, char* buffer, size_t bufferSize)
+{
+  return (size_t) snprintf(
+      buffer, bufferSize, "sink: %llu packets", (unsigned long long) ((const SinkState_t*) state)->Packets);
+}
+
+static size_t DropOddPackets(void* state, SnifferPacket_t* packets, size_t count)
+{
+  (void) state;
+
+  size_t passed = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t number;
+    memcpy(&number, packets[i].Data, sizeof(number));
+    if (number % 2 == 0)
+      packets[passed++] = packets[i];
+  }
+  return passed;
+}
+
+static size_t PassPackets(void* state, SnifferPacket_t* packets, size_t count)
+{
+  (void) state;
+  (void) packets;
+  return count;
+}
+
+static size_t CountPackets(void* state, SnifferPacket_t* packets, size_t count)
+{
+  SinkState_t* sink = (SinkState_t*) state;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t number;
+    memcpy(&number, packets[i].Data, sizeof(number));
+    if (number != sink->Next || packets[i].MatchedAddress != (uint32_t) (number % 3))
+      sink->Ordered = false;
+    sink->Next = number + 2;
+    sink->Checksum += number;
+    sink->Packets++;
+  }
+  return count;
+}
+
+static void PushNumbers(Pipeline_t* p, uint64_t count, size_t batchSize)
+{
+  // the data is reused by the next batch, the pipeline must copy it to queues
+  static int8_t data[16][sizeof(uint64_t)];
+  SnifferPacket_t packets[16];
+  for (uint64_t i = 0; i < count;) {
+    size_t n = 0;
+    for (; n < batchSize && i < count; ++n, ++i) {
+      memcpy(data[n], &i, sizeof(i));
+      memset(&packets[n], 0, sizeof(SnifferPacket_t));
+      packets[n].Data = data[n];
+      packets[n].Size = sizeof(i);
+      packets[n].MatchedAddress = (uint32_t) (i % 3);
+    }
+    PipelinePush(p, packets, n);
+  }
+}
+
+static void AddStages(Pipeline_t* p, SinkState_t* sink, bool threaded)
+{
+  PipelineStage_t filter = {"filter", NULL, DropOddPackets, NULL, NULL, NULL, threaded};
+  PipelineStage_t enrich = {"enrich", NULL, PassPackets, NULL, NULL, NULL, false};
+  PipelineStage_t output = {"sink", InitSink, CountPackets, FlushSink, PrintSinkStats, sink, threaded};
+  TEST_ASSERT(PipelineAddStage(p, &filter) == 0, "Cannot add the filter stage.");
+  TEST_ASSERT(PipelineAddStage(p, &enrich) == 0, "Cannot add the enrich stage.");
+  TEST_ASSERT(PipelineAddStage(p, &output) == 0, "Cannot add the sink stage.");
+}
+
+static void CheckPipeline(bool threaded)
+{
+  Pipeline_t p;
+  PipelineInit(&p, 4, 2);
+  SinkState_t sink = {false, false, 0, 0, true, 0};
+  AddStages(&p, &sink, threaded);
+
+  TEST_ASSERT(PipelineStart(&p) == 0, "Cannot start the pipeline.");
+  TEST_ASSERT(sink.Initialized, "The stage is not initialized.");
+  PushNumbers(&p, PACKETS_COUNT, 7);
+  // threads of stages may still write counters, each copied stage is consistent
+  PipelineStageCounters_t running[PIPELINE_STAGES_MAX];
+  PipelineReadCounters(&p, running);
+  for (size_t i = 0; i < 3; ++i)
+    TEST_ASSERT(running[i].PacketsOut <= running[i].PacketsIn && running[i].BatchNs.Count == running[i].Batches,
+                "Counters of the running stage are torn.");
+  PipelineStop(&p);
+
+  TEST_ASSERT(sink.Flushed, "The stage is not flushed.");
+  TEST_ASSERT(sink.Packets == PACKETS_COUNT / 2, "Packets are lost between stages.");
+  TEST_ASSERT(sink.Ordered, "Packets are reordered or their descriptors are changed.");
+  TEST_ASSERT(sink.Checksum == (PACKETS_COUNT / 2) * (PACKETS_COUNT / 2 - 1), "The data of packets is changed.");
+
+  PipelineStageCounters_t counters[PIPELINE_STAGES_MAX];
+  TEST_ASSERT(PipelineReadCounters(&p, counters) == 3, "Invalid stages count.");
+  TEST_ASSERT(strcmp(counters[0].Name, "filter") == 0 && strcmp(counters[2].Name, "sink") == 0,
+              "Invalid names of stages.");
+  TEST_ASSERT(counters[0].PacketsIn == PACKETS_COUNT && counters[0].PacketsOut == PACKETS_COUNT / 2,
+              "Invalid counters of the filter stage.");
+  TEST_ASSERT(counters[1].PacketsIn == PACKETS_COUNT / 2 && counters[2].PacketsOut == PACKETS_COUNT / 2,
+              "Invalid counters of next stages.");
+  TEST_ASSERT(counters[0].BatchNs.Count == counters[0].Batches && counters[0].Batches >= PACKETS_COUNT / 4,
+              "Batches are not timed or not split by the batch capacity.");
+#ifdef __linux__
+  TEST_ASSERT(counters[0].Threaded == threaded && counters[2].Threaded == threaded, "Invalid threads of stages.");
+  TEST_ASSERT(!threaded || (counters[0].QueueMaxDepth > 0 && counters[0].QueueMaxDepth <= 2),
+              "The queue is not bounded.");
+#endif
+  TEST_ASSERT(counters[0].QueueDepth == 0 && counters[2].QueueDepth == 0, "Queues are not drained.");
+
+  char stats[64];
+  TEST_ASSERT(PipelinePrintStageStats(&p, 2, stats, sizeof(stats)) > 0 && strcmp(stats, "sink: 500 packets") == 0,
+              "Invalid statistics of the stage.");
+  TEST_ASSERT(PipelinePrintStageStats(&p, 0, stats, sizeof(stats)) == 0, "The stage has no statistics.");
+  PipelineClear(&p);
+}
+
+TEST_CASE(TestPipeline, Inline)
+{
+  CheckPipeline(false);
+}
+
+TEST_CASE(TestPipeline, Threaded)
+{
+  CheckPipeline(true);
+}
+
+TEST_CASE(TestPipeline, InvalidStages)
+{
+  Pipeline_t p;
+  PipelineInit(&p, PIPELINE_BATCH_DEFAULT_SIZE, PIPELINE_QUEUE_DEFAULT_DEPTH);
+
+  PipelineStage_t invalid = {"invalid", NULL, NULL, NULL, NULL, NULL, false};
+  TEST_ASSERT(PipelineAddStage(&p, &invalid) < 0, "The stage without Process is added.");
+
+  PipelineStage_t stage = {"pass", NULL, PassPackets, NULL, NULL, NULL, false};
+  for (size_t i = 0; i < PIPELINE_STAGES_MAX; ++i)
+    TEST_ASSERT(PipelineAddStage(&p, &stage) == 0, "Cannot add the stage.");
+  TEST_ASSERT(PipelineAddStage(&p, &stage) < 0 && p.StagesCount == PIPELINE_STAGES_MAX, "Too many stages are added.");
+
+  TEST_ASSERT(PipelineStart(&p) == 0, "Cannot start the pipeline.");
+  TEST_ASSERT(PipelineAddStage(&p, &stage) < 0, "The stage is added to the started pipeline.");
+  PipelineClear(&p);
+}
@@ -0,0 +1,317 @@
+#include "testing.h"
+#include "printing.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+TEST_CASE(TestPrinting, HexDump)
+{
+  uint8_t data[HEX_DUMP_LINE_SIZE + 3];
+  for (size_t i = 0; i < sizeof(data); ++i)
+    data[i] = (uint8_t) (i * 8);
+  char buffer[1024];
+
+  size_t length = PrintHexDump(data, 3, buffer, sizeof(buffer), false);
+  TEST_ASSERT(strcmp(buffer, "[00] [08] [10]\n") == 0 && length == 15, "Invalid hex dump.");
+  PrintHexDump((const uint8_t*) "\xAB\xCD\xEF\xFF", 4, buffer, sizeof(buffer), false);
+  TEST_ASSERT(strcmp(buffer, "[AB] [CD] [EF] [FF]\n") == 0, "Invalid hex digits.");
+
+  // the second line starts after HEX_DUMP_LINE_SIZE bytes
+  length = PrintHexDump(data, sizeof(data), buffer, sizeof(buffer), false);
+  TEST_ASSERT(length == HEX_DUMP_LINE_SIZE * 5 + 15, "Invalid length of two lines.");
+  TEST_ASSERT(strncmp(buffer + HEX_DUMP_LINE_SIZE * 5 - 5, "[F8]\n[00] [08] [10]\n", 20) == 0, "Invalid line break.");
+
+  TEST_ASSERT(PrintHexDump(data, 0, buffer, sizeof(buffer), false) == 0 && buffer[0] == '\0', "Empty data is printed.");
+  TEST_ASSERT(PrintHexDump(data, sizeof(data), buffer, HEX_DUMP_LINE_MAX_LENGTH + 1, false) == HEX_DUMP_LINE_SIZE * 5,
+              "Partial line is written to the small buffer.");
+  TEST_ASSERT(PrintHexDump(data, sizeof(data), buffer, 16, false) == 0 && buffer[0] == '\0',
+              "Line is written to the too small buffer.");
+}
+
+TEST_CASE(TestPrinting, HexDumpAscii)
+{
+  char buffer[1024];
+  PrintHexDump((const uint8_t*) "GET\r\n", 5, buffer, sizeof(buffer), true);
+  TEST_ASSERT(strncmp(buffer, "[47] [45] [54] [0D] [0A] ", 25) == 0, "Invalid hex part.");
+
+  const char* gutter = strchr(buffer, '|');
+  TEST_ASSERT(gutter == buffer + HEX_DUMP_LINE_SIZE * 5, "The gutter is not aligned.");
+  TEST_ASSERT(strcmp(gutter, "|GET..|\n") == 0, "Invalid ASCII gutter.");
+}
+
+TEST_CASE(TestPrinting, PacketData)
+{
+  char* buffer = malloc(DATA_BUFFER_SUFFICIENT_SIZE);
+  PrintPacketData((Buffer_t) "\x01\x02", 2, &buffer, DATA_BUFFER_SUFFICIENT_SIZE, false);
+  TEST_ASSERT(strcmp(buffer, "\n      Data\n[01] [02]\n") == 0, "Invalid packet data.");
+
+  // the largest IP packet fits the buffer
+  uint8_t* data = calloc(65535, 1);
+  PrintPacketData((Buffer_t) data, 65535, &buffer, DATA_BUFFER_SUFFICIENT_SIZE, true);
+  size_t lastLine = HEX_DUMP_LINE_SIZE * 5 + (65535 % HEX_DUMP_LINE_SIZE) + 3;
+  TEST_ASSERT(strlen(buffer) == 12 + (65535 / HEX_DUMP_LINE_SIZE) * HEX_DUMP_LINE_MAX_LENGTH + lastLine,
+              "The largest packet is truncated.");
+
+  free(data);
+  free(buffer);
+}
+
+TEST_CASE(TestPrinting, PacketToBuffers)
+{
+  // IPv4 + UDP with 4 bytes of data
+  uint8_t packet[32] = {0x45, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x01,
+                        0x0A, 0x00, 0x00, 0x02, 0x04, 0xD2, 0x00, 0x35, 0x00, 0x0C, 0x00, 0x00, 0xDE, 0xAD, 0xBE, 0xEF};
+  PacketBuffers_t buffers;
+  PacketBuffersInit(&buffers);
+  PrintPacketToBuffers((Buffer_t) packet, sizeof(packet), &buffers, NULL);
+  TEST_ASSERT(strstr(buffers.IPHeaderBuffer, "| Source IP: 10.0.0.1\n") != NULL, "Invalid IP header.");
+  TEST_ASSERT(strstr(buffers.ProtocolHeaderBuffer, "| Destination Port: 53\n") != NULL, "Invalid UDP header.");
+  TEST_ASSERT(strcmp(buffers.DataBuffer, "\n      Data\n[DE] [AD] [BE] [EF]\n") == 0, "Invalid packet data.");
+
+  // decoded packets only have headers
+  PrintPacketHeadersToBuffers((Buffer_t) packet, &buffers, NULL);
+  TEST_ASSERT(strstr(buffers.ProtocolHeaderBuffer, "| Destination Port: 53\n") != NULL && buffers.DataBuffer[0] == '\0',
+              "The data of the decoded packet is printed.");
+  PrintPacketToBuffers((Buffer_t) packet, sizeof(packet), &buffers, NULL);
+
+  // buffers are not cleared before the packet, the text of the previous packet is not printed
+  PrintPacketToBuffers((Buffer_t) packet, 24, &buffers, NULL);
+  TEST_ASSERT(buffers.ProtocolHeaderBuffer[0] != '\0' && buffers.DataBuffer[0] == '\0',
+              "Data of the previous packet is printed.");
+  packet[9] = 99;
+  PrintPacketToBuffers((Buffer_t) packet, 20, &buffers, NULL);
+  TEST_ASSERT(buffers.ProtocolHeaderBuffer[0] == '\0', "The header of the previous packet is printed.");
+  PacketBuffersDelete(&buffers);
+}
+
+TEST_CASE(TestPrinting, PacketBrief)
+{
+  TimeInfo_t time;
+  memset(&time, 0, sizeof(time));
+  time.Hours = 9;
+  time.Minutes = 5;
+  time.Seconds = 7;
+  time.TimestampNanosec = 42000;
+
+  PacketView_t view;
+  memset(&view, 0, sizeof(view));
+  view.Protocol = Protocol_TCP;
+  view.SourceAddress = 0x0100000A;
+  view.DestinationAddress = 0xFFFFFFFF;
+  view.SourcePort = 40000;
+  view.DestinationPort = 80;
+  view.TCPFlags = TCPFlag_SYN | TCPFlag_ACK;
+
+  char buffer[BRIEF_LINE_MAX_SIZE];
+  size_t length = PrintPacketBrief(&view, &time, buffer, sizeof(buffer));
+  TEST_ASSERT(strcmp(buffer, "09:05:07.000042 TCP 10.0.0.1:40000 > 255.255.255.255:80 Flags [S.], length 0\n") == 0,
+              "Invalid TCP line.");
+  TEST_ASSERT(length == strlen(buffer), "Invalid length.");
+
+  view.Protocol = Protocol_UDP;
+  view.PayloadSize = 1472;
+  PrintPacketBrief(&view, &time, buffer, sizeof(buffer));
+  TEST_ASSERT(strcmp(buffer, "09:05:07.000042 UDP 10.0.0.1:40000 > 255.255.255.255:80 length 1472\n") == 0,
+              "Invalid UDP line.");
+
+  // echo request
+  uint8_t packet[28] = {0x45, 0x00, 0x00, 0x1C, 0, 0, 0, 0, 64, 1, 0, 0, 127, 0, 0, 1, 127, 0, 0, 2, 8, 0};
+  TEST_ASSERT(DecodePacketView((Buffer_t) packet, sizeof(packet), &view) == 0, "ICMP packet is not decoded.");
+  PrintPacketBrief(&view, &time, buffer, sizeof(buffer));
+  TEST_ASSERT(strcmp(buffer, "09:05:07.000042 ICMP 127.0.0.1 > 127.0.0.2 type 8 code 0, length 0\n") == 0,
+              "Invalid ICMP line.");
+
+  TEST_ASSERT(PrintPacketBrief(&view, &time, buffer, BRIEF_LINE_MAX_SIZE - 1) == 0, "Line is written to small buffer.");
+}
+
+TEST_CASE(TestPrinting, CaptureStatsLine)
+{
+  CaptureStats_t previous = {100, 20, 80, 110, 10};
+  CaptureStats_t stats = {300, 50, 250, 330, 30};
+
+  char buffer[CAPTURE_STATS_LINE_MAX_SIZE];
+  size_t length = PrintCaptureStatsLine(&stats, &previous, 7, 2, buffer, sizeof(buffer));
+  TEST_ASSERT(strcmp(buffer,
+                     "capture: received 300 (+200), handled 250 (+170), filtered out 50, kernel drops 30 (+20), "
+                     "suppressed 7, waits 2\n") == 0,
+              "Invalid line.");
+  TEST_ASSERT(length == strlen(buffer), "Invalid length.");
+}
+
+TEST_CASE(TestPrinting, TrafficDashboard)
+{
+  Sniffer_t sniffer;
+  memset(&sniffer, 0, sizeof(sniffer));
+  strcpy(sniffer.Addresses[0].Address.IP, "127.0.0.1");
+  sniffer.Addresses[0].Address.Port = 8765;
+  sniffer.Addresses[0].Filter.Protocol = Protocol_TCP;
+  sniffer.AddressesCount = 1;
+
+  TrafficStats_t previous, current;
+  TrafficStatsInit(&previous);
+  TrafficStatsAdd(&previous, Protocol_TCP, Direction_SOURCE, 0, 100);
+  current = previous;
+  for (int i = 0; i < 2000; ++i)
+    TrafficStatsAdd(&current, Protocol_TCP, Direction_DESTINATION, 0, 1500);
+
+  char* buffer = malloc(TRAFFIC_DASHBOARD_BUFFER_SUFFICIENT_SIZE);
+  size_t size = TRAFFIC_DASHBOARD_BUFFER_SUFFICIENT_SIZE;
+  size_t length = PrintTrafficDashboard(&current, &previous, 2.0, &sniffer, false, buffer, size);
+  TEST_ASSERT(length == strlen(buffer), "Invalid length.");
+
+  size_t lines = 0;
+  for (size_t i = 0; i < length; ++i)
+    lines += buffer[i] == '\n';
+  TEST_ASSERT(lines == TRAFFIC_DASHBOARD_LINES(1), "The dashboard size is not fixed.");
+  TEST_ASSERT(strstr(buffer, "\033[2KTraffic: 2001 packets, 3000100 bytes\n") != NULL, "Invalid title.");
+  // 1000 packets per second of 1500 bytes are 12 Mbit per second
+  TEST_ASSERT(strstr(buffer, "in         1.0k      12.0M      1500           2000\n") != NULL, "Invalid TCP row.");
+  TEST_ASSERT(strstr(buffer, "out           0          0         0              1\n") != NULL, "Invalid TCP row.");
+  TEST_ASSERT(strstr(buffer, "\033[2Ktcp 127.0.0.1:8765") != NULL, "The address is not printed.");
+
+  PrintTrafficDashboard(&current, &previous, 2.0, &sniffer, true, buffer, size);
+  TEST_ASSERT(strncmp(buffer, "\033[16A\033[2K", 9) == 0, "The cursor is not moved to the previous dashboard.");
+
+  // rules of the file have one row
+  RuleSet_t rules;
+  sniffer.Rules = &rules;
+  TrafficStatsAdd(&current, Protocol_UDP, Direction_SOURCE, TRAFFIC_RULES_FILE, 100);
+  length = PrintTrafficDashboard(&current, &previous, 2.0, &sniffer, false, buffer, size);
+  lines = 0;
+  for (size_t i = 0; i < length; ++i)
+    lines += buffer[i] == '\n';
+  TEST_ASSERT(lines == TRAFFIC_DASHBOARD_LINES(2) && strstr(buffer, "\033[2Krules file ") != NULL,
+              "The row of rules is not printed.");
+
+  free(buffer);
+}
+
+TEST_CASE(TestPrinting, Metrics)
+{
+  Sniffer_t sniffer;
+  memset(&sniffer, 0, sizeof(sniffer));
+  strcpy(sniffer.Addresses[0].Address.IP, "any");
+  sniffer.Addresses[0].Filter.Protocol = Protocol_UDP;
+  sniffer.AddressesCount = 1;
+
+  static MetricsSnapshot_t snapshot;
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.Capture.Received = 5;
+  TrafficStatsAdd(&snapshot.Traffic, Protocol_UDP, Direction_DESTINATION, 0, 100);
+  TrafficStatsAdd(&snapshot.Traffic, Protocol_UDP, Direction_DESTINATION, 0, 1000);
+  HistogramInit(&snapshot.HandlerLatency);
+  HistogramAdd(&snapshot.HandlerLatency, 2000);
+  snapshot.StagesCount = 1;
+  snapshot.Stages[0].Name = "output";
+  snapshot.Stages[0].PacketsIn = 3;
+  snapshot.Stages[0].BusyNs = 1500000000;
+
+  // only matched rules of the file are printed, their indexes follow addresses
+  char* error = NULL;
+  static const char content[] = "tcp 10.0.0.1:443\nudp any:53\n";
+  RuleTable_t* rules = RuleTableParse(content, sizeof(content) - 1, &error);
+  RuleTableCount(rules, 1, 60);
+
+  char* buffer = malloc(METRICS_BUFFER_SUFFICIENT_SIZE);
+  size_t length = PrintMetrics(&snapshot, &sniffer, rules, buffer, METRICS_BUFFER_SUFFICIENT_SIZE);
+  TEST_ASSERT(length == strlen(buffer), "Invalid length.");
+  TEST_ASSERT(strstr(buffer,
+                     "# HELP netsniffer_received_packets_total Frames read from the socket.\n"
+                     "# TYPE netsniffer_received_packets_total counter\n"
+                     "netsniffer_received_packets_total 5\n") != NULL,
+              "Invalid counter.");
+  TEST_ASSERT(strstr(buffer, "\nnetsniffer_protocol_bytes_total{protocol=\"udp\",direction=\"in\"} 1100\n") != NULL,
+              "Invalid protocol counter.");
+  TEST_ASSERT(strstr(buffer, "\nnetsniffer_rule_packets_total{rule=\"0\",address=\"udp any:0\"} 2\n") != NULL,
+              "Invalid rule counter.");
+  TEST_ASSERT(strstr(buffer, "\nnetsniffer_rule_bytes_total{rule=\"2\",address=\"udp any:53\"} 60\n") != NULL &&
+                  strstr(buffer, "rule=\"1\"") == NULL,
+              "Invalid counter of the rule of the file.");
+  TEST_ASSERT(strstr(buffer, "\nnetsniffer_packet_size_bytes_bucket{le=\"127\"} 1\n") != NULL &&
+                  strstr(buffer, "\nnetsniffer_packet_size_bytes_bucket{le=\"+Inf\"} 2\n") != NULL,
+              "Invalid size histogram.");
+  TEST_ASSERT(strstr(buffer, "\nnetsniffer_handler_latency_seconds_count 1\n") != NULL, "Invalid latency summary.");
+  TEST_ASSERT(strstr(buffer, "\nnetsniffer_stage_packets_in_total{stage=\"output\"} 3\n") != NULL &&
+                  strstr(buffer, "\nnetsniffer_stage_busy_seconds_total{stage=\"output\"} 1.500000000\n") != NULL,
+              "Invalid stage counters.");
+
+  RuleTableDelete(rules);
+  free(buffer);
+}
+
+TEST_CASE(TestPrinting, PipelineStats)
+{
+  PipelineStageCounters_t stages[2];
+  memset(stages, 0, sizeof(stages));
+  stages[0].Name = "filter";
+  stages[0].PacketsIn = 10;
+  stages[0].PacketsOut = 4;
+  stages[0].Batches = 2;
+  stages[0].BusyNs = 2500000;
+  HistogramInit(&stages[0].BatchNs);
+  stages[1].Name = "sink";
+  stages[1].Threaded = true;
+  stages[1].QueueMaxDepth = 3;
+  HistogramInit(&stages[1].BatchNs);
+
+  char* buffer = malloc(PIPELINE_STATS_BUFFER_SUFFICIENT_SIZE);
+  PrintPipelineStats(stages, 2, &buffer, PIPELINE_STATS_BUFFER_SUFFICIENT_SIZE);
+  TEST_ASSERT(strstr(buffer, "| filter: packets in 10, out 4, batches 2, busy 2.500 ms\n") != NULL,
+              "Invalid counters of the stage.");
+  TEST_ASSERT(strstr(buffer, "| sink (thread): ") != NULL &&
+                  strstr(buffer, "| sink queue: max depth 3, waits of the previous stage 0\n") != NULL,
+              "Invalid counters of the threaded stage.");
+  TEST_ASSERT(strstr(buffer, "| filter batch time (us): count 0\n") != NULL, "Invalid batch time.");
+  free(buffer);
+}
+
+TEST_CASE(TestPrinting, ChecksumStats)
+{
+  ChecksumStats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.Verified = 12;
+  stats.BadTCP = 3;
+
+  char* buffer = malloc(512);
+  PrintChecksumStats(&stats, &buffer, 512);
+  TEST_ASSERT(strstr(buffer, "| Verified: 12\n") != NULL && strstr(buffer, "| Bad TCP: 3\n") != NULL &&
+                  strstr(buffer, "| Not checked: 0\n\n") != NULL,
+              "Invalid checksum statistics.");
+  // the buffer is smaller than the statistics, the text is truncated
+  PrintChecksumStats(&stats, &buffer, 64);
+  TEST_ASSERT(strlen(buffer) == 63, "The statistics are not truncated to the buffer.");
+  free(buffer);
+}
+
+TEST_CASE(TestPrinting, RecorderDump)
+{
+  RecorderDump_t dump = {"/tmp/dump.pcap", 10, 2, 1500, NULL};
+  char line[RECORDER_DUMP_LINE_MAX_SIZE];
+  const char* expected =
+      "The flight recorder is dumped to '/tmp/dump.pcap': 10 packets (2 overwritten while dumped) in 1.5 ms.\n";
+  TEST_ASSERT(PrintRecorderDump(&dump, line, sizeof(line)) == strlen(expected) && strcmp(line, expected) == 0,
+              "Invalid dump line.");
+  dump.Error = "No space left on device";
+  PrintRecorderDump(&dump, line, sizeof(line));
+  TEST_ASSERT(strcmp(line, "Cannot dump the flight recorder to '/tmp/dump.pcap': No space left on device\n") == 0,
+              "Invalid dump error.");
+}
+
+TEST_CASE(TestPrinting, StorageSummary)
+{
+  StorageWriter_t storage;
+  memset(&storage, 0, sizeof(storage));
+  storage.Packets = 100;
+  storage.Segments = 2;
+  storage.Indexed = 1;
+  storage.IndexSkipped = 1;
+  storage.Stalls = 3;
+
+  char* buffer = malloc(STORAGE_SUMMARY_BUFFER_SUFFICIENT_SIZE);
+  PrintStorageSummary(&storage, 0, &buffer, STORAGE_SUMMARY_BUFFER_SUFFICIENT_SIZE);
+  TEST_ASSERT(strcmp(buffer,
+                     "The storage is closed, 100 packets are written to 2 segments (1 indexed, 1 without the index).\n"
+                     "The capture waited for the write thread of the storage 3 times.\n") == 0,
+              "Invalid storage summary.");
+  free(buffer);
+}
@@ -0,0 +1,67 @@
+#include "testing.h"
+#include "profile.h"
+#include "printing.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(PROFILING_ENABLED) && defined(__linux__)
+#include <pthread.h>
+
+static void* RecordStages(void* args)
+{
+  (void) args;
+  for (int i = 0; i < 100; ++i) {
+    PROFILE_START(start);
+    PROFILE_STOP(ProfileStage_FORMAT, start);
+  }
+  return NULL;
+}
+#endif
+
+TEST_CASE(TestProfile, Stats)
+{
+  Histogram_t stages[ProfileStage_COUNT];
+  for (int i = 0; i < ProfileStage_COUNT; ++i)
+    HistogramInit(&stages[i]);
+  for (uint64_t i = 1; i <= 1000; ++i)
+    HistogramAdd(&stages[ProfileStage_RECEIVE], 2);
+  HistogramAdd(&stages[ProfileStage_RECEIVE], 2000);
+
+  char* buffer = malloc(PROFILE_STATS_BUFFER_SUFFICIENT_SIZE);
+  PrintProfileStats(stages, 2.0, &buffer, PROFILE_STATS_BUFFER_SUFFICIENT_SIZE);
+  TEST_ASSERT(strstr(buffer, "| receive: count 1001, p50 1, p99 1, p999 1, max 1000\n") != NULL,
+              "Invalid percentiles of the stage.");
+  TEST_ASSERT(strstr(buffer, "| output: count 0\n") != NULL, "The empty stage is not printed.");
+  free(buffer);
+
+  TEST_ASSERT(strcmp(ProfileStageToString(ProfileStage_FILTER), "filter") == 0, "Invalid name of the stage.");
+}
+
+#ifdef PROFILING_ENABLED
+TEST_CASE(TestProfile, Threads)
+{
+  Histogram_t before[ProfileStage_COUNT], after[ProfileStage_COUNT];
+  ProfileRead(before);
+  ProfileEnable();
+
+  for (int i = 0; i < 100; ++i) {
+    PROFILE_START(start);
+    PROFILE_STOP(ProfileStage_OUTPUT, start);
+  }
+#ifdef __linux__
+  pthread_t thread;
+  TEST_ASSERT(pthread_create(&thread, NULL, RecordStages, NULL) == 0, "Cannot start the thread.");
+  pthread_join(thread, NULL);
+#endif
+
+  TEST_ASSERT(ProfileRead(after) >= 1, "Threads are not recorded.");
+  TEST_ASSERT(after[ProfileStage_OUTPUT].Count == before[ProfileStage_OUTPUT].Count + 100,
+              "Stages of the current thread are not recorded.");
+#ifdef __linux__
+  TEST_ASSERT(after[ProfileStage_FORMAT].Count >= before[ProfileStage_FORMAT].Count + 100,
+              "Histograms of threads are not merged.");
+#endif
+  TEST_ASSERT(ProfileTicksPerNs() > 0.0, "Ticks are not calibrated.");
+}
+#endif
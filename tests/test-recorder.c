@@ -0,0 +1,266 @@
+#include "testing.h"
+#include "recorder.h"
+#include "pcap.h"
+#include "utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <unistd.h>
+
+#define RECORDER_TEST_PACKET_SIZE 1000
+#define RECORDER_TEST_DUMPS 20
+#define RECORDER_TEST_ARENA_SIZE (16 * 1024 * 1024)
+#define RECORDER_TEST_BATCH 16
+
+typedef struct
+{
+  atomic_uint_fast64_t Dumps; // incremented after other fields are set
+  uint64_t Packets;
+  uint64_t Skipped;
+  bool Failed;
+  atomic_int Blocked; // the handler waits while it is set
+  char Path[RECORDER_PATH_MAX_SIZE];
+} RecorderResult_t;
+
+typedef struct
+{
+  FlightRecorder_t* Recorder;
+  atomic_int Running;
+  atomic_int Batches;
+  uint32_t Sequence;
+} RecorderCapture_t;
+
+static void SaveDump(const RecorderDump_t* dump, void* args)
+{
+  RecorderResult_t* result = (RecorderResult_t*) args;
+  while (atomic_load(&result->Blocked))
+    usleep(1000);
+  result->Packets = dump->Packets;
+  result->Skipped = dump->Skipped;
+  result->Failed = result->Failed || dump->Error != NULL;
+  snprintf(result->Path, sizeof(result->Path), "%s", dump->Path);
+  atomic_fetch_add(&result->Dumps, 1);
+}
+
+static void AddPacket(FlightRecorder_t* r, uint32_t sequence, size_t size, int64_t sec)
+{
+  // the sequence is followed by its low byte
+  uint8_t data[RECORDER_TEST_PACKET_SIZE];
+  memset(data, (int) (sequence & 0xFF), size);
+  memcpy(data, &sequence, sizeof(sequence));
+  TimeInfo_t time;
+  memset(&time, 0, sizeof(time));
+  time.TimestampSec = sec;
+  time.TimestampNanosec = sequence;
+  FlightRecorderAdd(r, data, size, &time);
+}
+
+static void* CapturePackets(void* args)
+{
+  RecorderCapture_t* capture = (RecorderCapture_t*) args;
+  TimeInfo_t now;
+  memset(&now, 0, sizeof(now));
+  GetTimeInfoNow(&now, NULL);
+  // batches are paced like the capture, otherwise the arena is overwritten before the dump thread wakes up
+  while (atomic_load(&capture->Running)) {
+    for (int i = 0; i < RECORDER_TEST_BATCH; ++i) {
+      size_t size = 64 + capture->Sequence % (RECORDER_TEST_PACKET_SIZE - 64);
+      AddPacket(capture->Recorder, capture->Sequence, size, now.TimestampSec);
+      capture->Sequence++;
+    }
+    atomic_fetch_add(&capture->Batches, 1);
+    usleep(100);
+  }
+  return NULL;
+}
+
+/**
+ * Reads packets of the dump, checks that each packet is complete and packets are in order.
+ * @return The count of packets, -1 if the dump is invalid.
+ */
+static int64_t ReadDump(const char* path, uint32_t* first, uint32_t* last)
+{
+  FILE* file = fopen(path, "rb");
+  if (file == NULL)
+    return -1;
+  PcapFileHeader_t header;
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.Magic != PCAP_MAGIC_NANOSECONDS ||
+      header.LinkType != PCAP_LINKTYPE_RAW) {
+    fclose(file);
+    return -1;
+  }
+
+  int64_t count = 0;
+  PcapRecordHeader_t record;
+  uint8_t data[RECORDER_TEST_PACKET_SIZE];
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    uint32_t sequence;
+    if (record.CapturedLength > sizeof(data) || record.CapturedLength < sizeof(sequence) ||
+        fread(data, 1, record.CapturedLength, file) != record.CapturedLength) {
+      fclose(file);
+      return -1;
+    }
+    memcpy(&sequence, data, sizeof(sequence));
+    bool torn = record.TimestampNanosec != sequence || (count > 0 && sequence <= *last);
+    for (size_t i = sizeof(sequence); i < record.CapturedLength; ++i)
+      torn = torn || data[i] != (uint8_t) (sequence & 0xFF);
+    if (torn) {
+      fclose(file);
+      return -1;
+    }
+    if (count == 0)
+      *first = sequence;
+    *last = sequence;
+    count++;
+  }
+  fclose(file);
+  return count;
+}
+
+TEST_CASE(TestRecorder, Wraparound)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-flight-%d.pcap", (int) getpid());
+  FlightRecorder_t r;
+  FlightRecorderInit(&r, RECORDER_MIN_SIZE, 0, PCAP_LINKTYPE_RAW);
+  RecorderResult_t result = {0, 0, 0, false, 0, ""};
+  FlightRecorderSetDumpHandler(&r, SaveDump, &result);
+  TEST_ASSERT(FlightRecorderStart(&r) == 0, "Cannot start the dump thread.");
+
+  // packets of different sizes wrap the arena several times
+  uint32_t count = 5000;
+  for (uint32_t i = 0; i < count; ++i)
+    AddPacket(&r, i, 100 + (i * 37) % (RECORDER_TEST_PACKET_SIZE - 100), 1);
+  TEST_ASSERT(r.Packets == count && r.Overwritten > 0 && r.Overwritten < count, "Invalid count of packets.");
+  TEST_ASSERT(FlightRecorderTrigger(&r, path), "Cannot trigger the dump.");
+  FlightRecorderStop(&r);
+  TEST_ASSERT(!FlightRecorderTrigger(&r, path), "The dump is triggered after the stop.");
+
+  uint32_t first = 0, last = 0;
+  int64_t packets = ReadDump(path, &first, &last);
+  TEST_ASSERT(result.Dumps == 1 && !result.Failed && r.Dumps == 1 && r.Triggers == 2, "Invalid dump counters.");
+  TEST_ASSERT(packets == (int64_t) (count - r.Overwritten) && (uint64_t) packets == result.Packets,
+              "The dump does not contain all recorded packets.");
+  TEST_ASSERT(first == r.Overwritten && last == count - 1, "The dump does not contain the latest packets.");
+  remove(path);
+  FlightRecorderClear(&r);
+}
+
+TEST_CASE(TestRecorder, Window)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-flight-window-%d.pcap", (int) getpid());
+  FlightRecorder_t r;
+  FlightRecorderInit(&r, RECORDER_MIN_SIZE, 10, PCAP_LINKTYPE_RAW);
+  RecorderResult_t result = {0, 0, 0, false, 0, ""};
+  FlightRecorderSetDumpHandler(&r, SaveDump, &result);
+  TEST_ASSERT(FlightRecorderStart(&r) == 0, "Cannot start the dump thread.");
+
+  TimeInfo_t now;
+  memset(&now, 0, sizeof(now));
+  GetTimeInfoNow(&now, NULL);
+  for (uint32_t i = 0; i < 10; ++i)
+    AddPacket(&r, i, 64, i < 4 ? now.TimestampSec - 60 : now.TimestampSec);
+  TEST_ASSERT(FlightRecorderTrigger(&r, path), "Cannot trigger the dump.");
+  // packets recorded after the trigger are not dumped
+  AddPacket(&r, 10, 64, now.TimestampSec);
+  FlightRecorderStop(&r);
+
+  uint32_t first = 0, last = 0;
+  TEST_ASSERT(ReadDump(path, &first, &last) == 6 && first == 4 && last == 9, "Invalid packets in the window.");
+  remove(path);
+  FlightRecorderClear(&r);
+}
+
+TEST_CASE(TestRecorder, CoalescedTriggers)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-flight-coalesced-%d.pcap", (int) getpid());
+  FlightRecorder_t r;
+  FlightRecorderInit(&r, RECORDER_MIN_SIZE, 0, PCAP_LINKTYPE_RAW);
+  RecorderResult_t result = {0, 0, 0, false, 1, ""};
+  FlightRecorderSetDumpHandler(&r, SaveDump, &result);
+  TEST_ASSERT(!FlightRecorderTrigger(&r, path), "The dump is triggered before the start.");
+  TEST_ASSERT(FlightRecorderStart(&r) == 0, "Cannot start the dump thread.");
+
+  AddPacket(&r, 0, 64, 1);
+  TEST_ASSERT(FlightRecorderTrigger(&r, path), "Cannot trigger the dump.");
+  // the handler of the first dump is blocked, the dump is pending
+  for (int i = 0; i < 10; ++i)
+    TEST_ASSERT(!FlightRecorderTrigger(&r, path), "The trigger is not coalesced with the pending dump.");
+  atomic_store(&result.Blocked, 0);
+  FlightRecorderStop(&r);
+  TEST_ASSERT(result.Dumps == 1 && r.Dumps == 1 && r.Triggers == 12, "Invalid dump counters.");
+  remove(path);
+  FlightRecorderClear(&r);
+
+  FlightRecorderInit(&r, RECORDER_MIN_SIZE, 0, PCAP_LINKTYPE_RAW);
+  FlightRecorderSetDumpHandler(&r, SaveDump, &result);
+  TEST_ASSERT(FlightRecorderStart(&r) == 0, "Cannot start the dump thread.");
+  TEST_ASSERT(FlightRecorderTrigger(&r, "/nonexistent/netsniffer.pcap"), "Cannot trigger the dump.");
+  FlightRecorderStop(&r);
+  TEST_ASSERT(result.Failed, "The dump to the missing directory is written.");
+  FlightRecorderClear(&r);
+}
+
+TEST_CASE(TestRecorder, DefaultPath)
+{
+  FlightRecorder_t r;
+  FlightRecorderInit(&r, RECORDER_MIN_SIZE, 0, PCAP_LINKTYPE_RAW);
+  RecorderResult_t result = {0, 0, 0, false, 0, ""};
+  FlightRecorderSetDumpHandler(&r, SaveDump, &result);
+  TEST_ASSERT(FlightRecorderStart(&r) == 0, "Cannot start the dump thread.");
+
+  // the name of the dump is formatted by the dump thread from the time of the trigger
+  AddPacket(&r, 0, 64, 1);
+  TEST_ASSERT(FlightRecorderTrigger(&r, NULL), "Cannot trigger the dump.");
+  FlightRecorderStop(&r);
+  size_t length = strlen(result.Path);
+  TEST_ASSERT(result.Dumps == 1 && !result.Failed, "The dump is not written.");
+  TEST_ASSERT(strncmp(result.Path, RECORDER_DEFAULT_PREFIX "-", strlen(RECORDER_DEFAULT_PREFIX "-")) == 0 &&
+                  length == strlen(RECORDER_DEFAULT_PREFIX "-YYYYmmdd-HHMMSS-1.pcap") &&
+                  strcmp(result.Path + length - strlen("-1.pcap"), "-1.pcap") == 0,
+              "Invalid default path of the dump.");
+  uint32_t first = 0, last = 0;
+  TEST_ASSERT(ReadDump(result.Path, &first, &last) == 1, "Invalid packets of the dump.");
+  remove(result.Path);
+  FlightRecorderClear(&r);
+}
+
+TEST_CASE(TestRecorder, DumpWhileCapturing)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/netsniffer-test-flight-capture-%d.pcap", (int) getpid());
+  FlightRecorder_t r;
+  FlightRecorderInit(&r, RECORDER_TEST_ARENA_SIZE, 0, PCAP_LINKTYPE_RAW);
+  RecorderResult_t result = {0, 0, 0, false, 0, ""};
+  FlightRecorderSetDumpHandler(&r, SaveDump, &result);
+  TEST_ASSERT(FlightRecorderStart(&r) == 0, "Cannot start the dump thread.");
+  RecorderCapture_t capture = {&r, 1, 0, 0};
+  pthread_t thread;
+  TEST_ASSERT(pthread_create(&thread, NULL, CapturePackets, &capture) == 0, "Cannot start the capture thread.");
+  while (atomic_load(&capture.Batches) == 0)
+    usleep(1000);
+
+  // the arena is overwritten while it is dumped, dumped packets must be complete and ordered
+  for (int i = 0; i < RECORDER_TEST_DUMPS; ++i) {
+    while (!FlightRecorderTrigger(&r, path))
+      usleep(1000);
+    while (atomic_load(&result.Dumps) == (uint64_t) i)
+      usleep(1000);
+    uint32_t first = 0, last = 0;
+    int64_t packets = ReadDump(path, &first, &last);
+    TEST_ASSERT(packets > 0 && (uint64_t) packets == result.Packets && !result.Failed, "Invalid dump while capturing.");
+  }
+  atomic_store(&capture.Running, 0);
+  pthread_join(thread, NULL);
+  FlightRecorderStop(&r);
+  TEST_ASSERT(capture.Sequence > 0 && r.Packets == capture.Sequence, "The capture thread is stuck.");
+  TEST_ASSERT(r.Dumps == RECORDER_TEST_DUMPS, "Invalid count of dumps.");
+  remove(path);
+  FlightRecorderClear(&r);
+}
+#endif
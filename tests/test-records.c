@@ -0,0 +1,99 @@
+#include "testing.h"
+#include "records.h"
+
+#include <string.h>
+
+/*
+ * 127.0.0.1:40000 -> 127.0.0.2:443, PSH ACK, 4 bytes of the payload.
+ */
+static uint8_t Packet[] = {
+    0x45, 0x00, 0x00, 0x2C, 0x00, 0x00, 0x00, 0x00, 0x40, 0x06, 0x00, 0x00, // IP header
+    0x7F, 0x00, 0x00, 0x01, 0x7F, 0x00, 0x00, 0x02,                         //
+    0x9C, 0x40, 0x01, 0xBB, 0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x00, 0xC8, // TCP header
+    0x50, 0x18, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,                         //
+    0xDE, 0xAD, 0xBE, 0xEF                                                  // payload
+};
+
+TEST_CASE(TestRecords, JsonWriter)
+{
+  char buffer[128];
+  JsonWriter_t w;
+  JsonWriterInit(&w, buffer, sizeof(buffer));
+  JsonBeginObject(&w);
+  JsonAddString(&w, "name", "a\"b\\c\n\x7F");
+  JsonAddUnsigned(&w, "zero", 0);
+  JsonAddUnsigned(&w, "max", UINT64_MAX);
+  JsonAddHex(&w, "hex", (const uint8_t*) "\x01\xAB", 2);
+  JsonEndObject(&w);
+  TEST_ASSERT(!w.Overflowed, "The buffer is overflowed.");
+  const char* expected = "{\"name\":\"a\\\"b\\\\c\\u000a\\u007f\",\"zero\":0,\"max\":18446744073709551615,"
+                         "\"hex\":\"01ab\"}";
+  TEST_ASSERT(strcmp(buffer, expected) == 0, "Invalid JSON.");
+
+  JsonWriterInit(&w, buffer, 8);
+  JsonBeginObject(&w);
+  JsonAddString(&w, "name", "value");
+  JsonEndObject(&w);
+  TEST_ASSERT(w.Overflowed && w.Length <= 8, "Overflow is not detected.");
+}
+
+TEST_CASE(TestRecords, Json)
+{
+  PacketView_t view;
+  TEST_ASSERT(DecodePacketView((Buffer_t) Packet, sizeof(Packet), &view) == 0, "Packet is not decoded.");
+  TimeInfo_t time;
+  memset(&time, 0, sizeof(time));
+  time.TimestampSec = 1700000000;
+  time.TimestampNanosec = 123456000;
+
+  PacketRecord_t record;
+  PacketRecordInit(&record, &view, &time, ChecksumStatus_NOT_CHECKED, 2);
+  char buffer[PACKET_RECORD_JSON_BUFFER_SUFFICIENT_SIZE];
+  size_t length = PacketRecordToJson(&record, (const uint8_t*) view.Payload, "example.com", buffer, sizeof(buffer));
+  TEST_ASSERT(strcmp(buffer,
+                     "{\"ts_us\":1700000000123456,\"proto\":\"TCP\",\"src\":\"127.0.0.1\",\"dst\":\"127.0.0.2\","
+                     "\"sport\":40000,\"dport\":443,\"len\":44,\"ttl\":64,\"flags\":\"P.\",\"seq\":100,\"ack\":200,"
+                     "\"win\":256,\"payload_len\":4,\"sni\":\"example.com\",\"payload\":\"dead\"}\n") == 0,
+              "Invalid JSON line.");
+  TEST_ASSERT(length == strlen(buffer), "Invalid length.");
+  TEST_ASSERT(PacketRecordToJson(&record, (const uint8_t*) view.Payload, NULL, buffer, 64) == 0,
+              "Line is written to the small buffer.");
+}
+
+TEST_CASE(TestRecords, Binary)
+{
+  TEST_ASSERT(sizeof(PacketRecord_t) == 48 && sizeof(PacketRecordStreamHeader_t) == 16, "Layout is changed.");
+
+  PacketView_t view;
+  TEST_ASSERT(DecodePacketView((Buffer_t) Packet, sizeof(Packet), &view) == 0, "Packet is not decoded.");
+  TimeInfo_t time;
+  memset(&time, 0, sizeof(time));
+
+  // two records: without the payload and with 4 bytes of the payload (padded to 8)
+  uint64_t stream[32];
+  uint8_t* data = (uint8_t*) stream;
+  size_t size = 0;
+  PacketRecord_t record;
+  PacketRecordInit(&record, &view, &time, ChecksumStatus_VALID, 0);
+  TEST_ASSERT(record.Length == sizeof(PacketRecord_t), "Invalid length of the record without the payload.");
+  memcpy(data + size, &record, sizeof(record));
+  size += record.Length;
+  PacketRecordInit(&record, &view, &time, ChecksumStatus_VALID, 100);
+  TEST_ASSERT(record.Length == sizeof(PacketRecord_t) + 8 && record.CapturedSize == 4, "Invalid padded length.");
+  memcpy(data + size, &record, sizeof(record));
+  memcpy(data + size + sizeof(record), view.Payload, record.CapturedSize);
+  size += record.Length;
+
+  size_t offset = 0;
+  const PacketRecord_t* r = PacketRecordNext(data, size, &offset);
+  TEST_ASSERT(r != NULL && r->CapturedSize == 0 && r->SourcePort == 40000 && r->TCPFlags == 0x18,
+              "Invalid first record.");
+  r = PacketRecordNext(data, size, &offset);
+  TEST_ASSERT(r != NULL && r->CapturedSize == 4 && memcmp(r + 1, "\xDE\xAD\xBE\xEF", 4) == 0,
+              "Invalid second record.");
+  TEST_ASSERT(r->ChecksumStatus == ChecksumStatus_VALID && r->PacketSize == 44, "Invalid fields.");
+  TEST_ASSERT(PacketRecordNext(data, size, &offset) == NULL && offset == size, "Record after the end.");
+
+  offset = 0;
+  TEST_ASSERT(PacketRecordNext(data, size - 1 - 48 - 8, &offset) == NULL, "Truncated record is returned.");
+}
@@ -0,0 +1,275 @@
+#include "testing.h"
+#include "rules.h"
+#include "sniffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <unistd.h>
+
+typedef struct
+{
+  RuleSet_t* Rules;
+  atomic_int Running;
+  uint64_t Loads;
+} RulesReader_t;
+
+static void* ReadRules(void* args)
+{
+  RulesReader_t* r = (RulesReader_t*) args;
+  int reader = RuleSetAddReader(r->Rules);
+  while (atomic_load(&r->Running)) {
+    RuleSetQuiescent(r->Rules, reader);
+    const RuleTable_t* t = RuleSetCurrent(r->Rules);
+    Direction_t direction;
+    // the table is valid until the next quiescent state
+    r->Loads += RuleTableMatch(t, Protocol_TCP, htonl(0x0A000001), 443, htonl(0x0A000002), 40000, &direction) >= 0;
+  }
+  RuleSetRemoveReader(r->Rules, reader);
+  return NULL;
+}
+#endif
+
+static RuleTable_t* ParseRules(const char* content, char** error)
+{
+  return RuleTableParse(content, strlen(content), error);
+}
+
+static uint32_t IPv4(const char* ip)
+{
+  uint32_t address = 0;
+  inet_pton(AF_INET, ip, &address);
+  return address;
+}
+
+TEST_CASE(TestRules, Parse)
+{
+  static const char content[] = "# watched addresses\n"
+                                "\n"
+                                "src tcp 10.0.0.1:443\n"
+                                "  udp any:53   # DNS\r\n"
+                                "dst 10.0.0.1:0\n"
+                                "10.0.0.2:0";
+  char* error = NULL;
+  RuleTable_t* t = RuleTableParse(content, sizeof(content) - 1, &error);
+  TEST_ASSERT(t != NULL, "Cannot parse rules.");
+  TEST_ASSERT(t->Count == 4 && t->Lines == 6, "Invalid rules count.");
+  TEST_ASSERT(t->Rules[0].Direction == Direction_SOURCE && t->Rules[0].Protocol == Protocol_TCP &&
+                  t->Rules[0].Port == 443 && t->Rules[0].IP == IPv4("10.0.0.1"),
+              "Invalid rule.");
+  TEST_ASSERT(t->Rules[1].AnyIP && t->Rules[1].Protocol == Protocol_UDP && t->Rules[1].Port == 53,
+              "Invalid rule of any IP.");
+  RuleTableDelete(t);
+
+  TEST_ASSERT(ParseRules("tcp 10.0.0.1:80\nsni example.com 10.0.0.2:443\n", &error) == NULL &&
+                  strstr(error, "line 2") != NULL,
+              "The line of the error is not reported.");
+  TEST_ASSERT(ParseRules("10.0.0.1:70000\n", &error) == NULL, "The invalid port is parsed.");
+  TEST_ASSERT(ParseRules("10.0.0.300:80\n", &error) == NULL, "The invalid IP is parsed.");
+  TEST_ASSERT(ParseRules("tcp\n", &error) == NULL, "The rule without the address is parsed.");
+  TEST_ASSERT(ParseRules("10.0.0.1:80 tcp\n", &error) == NULL, "Options after the address are parsed.");
+  free(error);
+
+  t = ParseRules("", &error);
+  TEST_ASSERT(t != NULL && t->Count == 0, "Cannot parse the empty file.");
+  Direction_t direction;
+  TEST_ASSERT(RuleTableMatch(t, Protocol_TCP, IPv4("10.0.0.1"), 1, IPv4("10.0.0.2"), 2, &direction) < 0,
+              "The empty table matches.");
+  RuleTableDelete(t);
+}
+
+TEST_CASE(TestRules, Match)
+{
+  static const char content[] = "src tcp 10.0.0.1:443\n"
+                                "udp any:53\n"
+                                "dst 10.0.0.1:0\n"
+                                "10.0.0.2:0\n"
+                                "10.0.0.3:22\n";
+  char* error = NULL;
+  RuleTable_t* t = RuleTableParse(content, sizeof(content) - 1, &error);
+  TEST_ASSERT(t != NULL, "Cannot parse rules.");
+  uint32_t first = IPv4("10.0.0.1"), second = IPv4("10.0.0.2"), other = IPv4("192.168.0.1");
+
+  Direction_t direction;
+  TEST_ASSERT(RuleTableMatch(t, Protocol_TCP, first, 443, second, 40000, &direction) == 0 &&
+                  direction == Direction_SOURCE,
+              "The first rule does not match.");
+  // the first rule of the file wins, not the first rule of the IP
+  TEST_ASSERT(RuleTableMatch(t, Protocol_UDP, second, 53, first, 53, &direction) == 1 && direction == Direction_SOURCE,
+              "The rule of any IP does not match.");
+  TEST_ASSERT(RuleTableMatch(t, Protocol_TCP, first, 80, second, 40000, &direction) == 3 &&
+                  direction == Direction_DESTINATION,
+              "The source rule matches the destination.");
+  TEST_ASSERT(RuleTableMatch(t, Protocol_TCP, other, 80, first, 40000, &direction) == 2 &&
+                  direction == Direction_DESTINATION,
+              "The destination rule does not match.");
+  TEST_ASSERT(RuleTableMatch(t, Protocol_TCP, other, 40000, IPv4("10.0.0.3"), 23, &direction) < 0,
+              "The rule matches the other port.");
+  RuleTableDelete(t);
+}
+
+TEST_CASE(TestRules, SnifferMatch)
+{
+  // 127.0.0.1:40000 -> 127.0.0.2:53, UDP
+  uint8_t packet[28] = {0x45, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00, 0x7F, 0x00,
+                        0x00, 0x01, 0x7F, 0x00, 0x00, 0x02, 0x9C, 0x40, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00};
+  Sniffer_t s;
+  memset(&s, 0, sizeof(s));
+  TEST_ASSERT(SnifferAddAddress(&s, "127.0.0.3:0", NULL) == 0, "Cannot add the address.");
+
+  char* error = NULL;
+  RuleSet_t rules;
+  RuleSetInit(&rules, ParseRules("tcp 127.0.0.2:53\n127.0.0.2:53\n", &error));
+  TEST_ASSERT(SnifferSetRules(&s, &rules) == 0, "Cannot set rules.");
+
+  bool tlsProcessed = false;
+  TEST_ASSERT(SnifferMatchAddress(&s, (Buffer_t) packet, sizeof(packet), "127.0.0.1", 40000, "127.0.0.2", 53,
+                                  &tlsProcessed),
+              "The packet does not match rules.");
+  TEST_ASSERT(s.MatchedAddress == 2 && s.MatchedDirection == Direction_DESTINATION,
+              "The index of the rule does not follow addresses.");
+
+  RuleSetSwap(&rules, ParseRules("127.0.0.5:0\n", &error));
+  TEST_ASSERT(!SnifferMatchAddress(&s, (Buffer_t) packet, sizeof(packet), "127.0.0.1", 40000, "127.0.0.2", 53,
+                                   &tlsProcessed),
+              "Rules of the previous table match.");
+  TEST_ASSERT(RuleSetReclaim(&rules) == 1, "The table is freed before the quiescent state.");
+  RuleSetQuiescent(&rules, s.__rulesReader);
+  TEST_ASSERT(RuleSetReclaim(&rules) == 0 && rules.Reclaims == 1, "The table is not freed.");
+
+  RuleSetClear(&rules);
+  SnifferClear(&s);
+}
+
+TEST_CASE(TestRules, Counters)
+{
+  // the index of the last rule does not fit 16 bits
+  const size_t count = 70000;
+  char* content = malloc(count * 24);
+  size_t length = 0;
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t ip = 0x0B000000 + (uint32_t) i;
+    length += (size_t) sprintf(
+        content + length, "%u.%u.%u.%u:0\n", ip >> 24, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF);
+  }
+  char* error = NULL;
+  RuleSet_t rules;
+  RuleSetInit(&rules, RuleTableParse(content, length, &error));
+  free(content);
+
+  // 127.0.0.1:40000 -> 11.1.17.111:53 (the last rule), UDP
+  uint8_t packet[28] = {0x45, 0x00, 0x00, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00, 0x7F, 0x00,
+                        0x00, 0x01, 0x0B, 0x01, 0x11, 0x6F, 0x9C, 0x40, 0x00, 0x35, 0x00, 0x08, 0x00, 0x00};
+  Sniffer_t s;
+  memset(&s, 0, sizeof(s));
+  TEST_ASSERT(SnifferAddAddress(&s, "127.0.0.3:0", NULL) == 0, "Cannot add the address.");
+  TEST_ASSERT(SnifferSetRules(&s, &rules) == 0, "Cannot set rules.");
+  bool tlsProcessed = false;
+  TEST_ASSERT(SnifferMatchAddress(&s, (Buffer_t) packet, sizeof(packet), "127.0.0.1", 40000, "11.1.17.111", 53,
+                                  &tlsProcessed) &&
+                  s.MatchedAddress == 1 + count - 1,
+              "The index of the rule is truncated.");
+  const RuleTable_t* t = RuleSetCurrent(&rules);
+  TEST_ASSERT(t->Counters[count - 1].Packets == 1 && t->Counters[count - 1].Bytes == sizeof(packet) &&
+                  t->Counters[0].Packets == 0,
+              "The rule is not counted.");
+
+  // counters of rules are kept by changes of the table
+  Rule_t rule;
+  TEST_ASSERT(RuleParse("10.0.0.1:0", 10, &rule, &error) == 1 && RuleSetAddRule(&rules, &rule) > 0,
+              "Cannot add the rule.");
+  t = RuleSetCurrent(&rules);
+  TEST_ASSERT(t->Count == count + 1 && t->Counters[count - 1].Packets == 1 && t->Counters[count].Packets == 0,
+              "Counters are not kept by the added rule.");
+  TEST_ASSERT(RuleParse("11.0.0.0:0", 10, &rule, &error) == 1 && RuleSetRemoveRule(&rules, &rule) > 0,
+              "Cannot remove the rule.");
+  t = RuleSetCurrent(&rules);
+  TEST_ASSERT(t->Count == count && t->Counters[count - 2].Packets == 1, "Counters are not moved by the removed rule.");
+
+  RuleSetClear(&rules);
+  SnifferClear(&s);
+}
+
+TEST_CASE(TestRules, Readers)
+{
+  char* error = NULL;
+  RuleSet_t rules;
+  RuleSetInit(&rules, ParseRules("tcp 10.0.0.1:443\n", &error));
+
+  // slots of removed readers are reused by the next readers
+  int first = RuleSetAddReader(&rules);
+  for (int i = 0; i < RULES_READERS_MAX * 4; ++i) {
+    int reader = RuleSetAddReader(&rules);
+    TEST_ASSERT(reader == 1, "The slot of the removed reader is not reused.");
+    RuleSetRemoveReader(&rules, reader);
+  }
+
+  int readers[RULES_READERS_MAX];
+  for (int i = 1; i < RULES_READERS_MAX; ++i)
+    readers[i] = RuleSetAddReader(&rules);
+  TEST_ASSERT(readers[RULES_READERS_MAX - 1] == RULES_READERS_MAX - 1 && RuleSetAddReader(&rules) < 0,
+              "Too many readers are registered.");
+  RuleSetRemoveReader(&rules, readers[5]);
+  TEST_ASSERT(RuleSetAddReader(&rules) == readers[5], "The free slot is not found.");
+
+  // offline slots do not hold replaced tables
+  for (int i = 1; i < RULES_READERS_MAX; ++i)
+    RuleSetRemoveReader(&rules, readers[i]);
+  RuleSetSwap(&rules, ParseRules("udp 10.0.0.1:53\n", &error));
+  TEST_ASSERT(RuleSetReclaim(&rules) == 1, "The table is freed before the quiescent state.");
+  RuleSetQuiescent(&rules, first);
+  TEST_ASSERT(RuleSetReclaim(&rules) == 0, "The table is not freed.");
+  RuleSetRemoveReader(&rules, first);
+  RuleSetClear(&rules);
+}
+
+#ifdef __linux__
+TEST_CASE(TestRules, Swap)
+{
+  char* error = NULL;
+  RuleSet_t rules;
+  RuleSetInit(&rules, ParseRules("tcp 10.0.0.1:443\n", &error));
+  RulesReader_t reader = {&rules, 1, 0};
+  pthread_t thread;
+  TEST_ASSERT(pthread_create(&thread, NULL, ReadRules, &reader) == 0, "Cannot start the reader.");
+
+  // tables are freed only after the reader passes the quiescent state, otherwise ASAN reports use after free
+  for (int i = 0; i < 1000; ++i) {
+    RuleSetSwap(&rules, ParseRules(i % 2 ? "tcp 10.0.0.1:443\n" : "udp 10.0.0.1:53\n", &error));
+    RuleSetReclaim(&rules);
+  }
+  atomic_store(&reader.Running, 0);
+  pthread_join(thread, NULL);
+
+  TEST_ASSERT(RuleSetReclaim(&rules) == 0, "Tables of the stopped reader are not freed.");
+  TEST_ASSERT(rules.Swaps == 1000 && rules.Reclaims == 1000, "Invalid counters.");
+  RuleSetClear(&rules);
+}
+
+TEST_CASE(TestRules, Load)
+{
+  char path[] = "/tmp/netsniffer-rules-XXXXXX";
+  int fd = mkstemp(path);
+  TEST_ASSERT(fd >= 0, "Cannot create the file.");
+  FILE* file = fdopen(fd, "w");
+  for (int i = 0; i < 100000; ++i)
+    fprintf(file, "%s 10.%d.%d.%d:%d\n", i % 3 == 0 ? "src tcp" : "udp", i >> 16, (i >> 8) & 0xFF, i & 0xFF, i % 1000);
+  fclose(file);
+
+  char* error = NULL;
+  RuleTable_t* t = RuleTableLoad(path, &error);
+  unlink(path);
+  TEST_ASSERT(t != NULL && t->Count == 100000 && strcmp(t->Path, path) == 0, "Cannot load rules.");
+  Direction_t direction;
+  TEST_ASSERT(RuleTableMatch(t, Protocol_UDP, IPv4("192.168.0.1"), 1, IPv4("10.1.134.158"), 998, &direction) == 99998 &&
+                  direction == Direction_DESTINATION,
+              "The last rule does not match.");
+  RuleTableDelete(t);
+
+  TEST_ASSERT(RuleTableLoad(path, &error) == NULL, "The removed file is loaded.");
+  free(error);
+}
+#endif
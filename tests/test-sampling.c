@@ -0,0 +1,119 @@
+#include "testing.h"
+#include "sampling.h"
+#include "printing.h"
+
+#include <string.h>
+
+static void InitView(PacketView_t* view, uint32_t src, uint16_t sport, uint32_t dst, uint16_t dport)
+{
+  memset(view, 0, sizeof(PacketView_t));
+  view->Protocol = Protocol_TCP;
+  view->SourceAddress = src;
+  view->SourcePort = sport;
+  view->DestinationAddress = dst;
+  view->DestinationPort = dport;
+}
+
+TEST_CASE(TestSampling, Disabled)
+{
+  Sampler_t s;
+  SamplerInit(&s, 0, 1, 0, 0);
+  TEST_ASSERT(!SamplerEnabled(&s), "The sampler 1-in-1 is enabled.");
+  for (int i = 0; i < 10; ++i)
+    TEST_ASSERT(SamplerPass(&s, NULL, 1), "The packet is suppressed.");
+  TEST_ASSERT(s.Passed == 10 && s.Suppressed == 0, "Invalid counters.");
+}
+
+TEST_CASE(TestSampling, Every)
+{
+  Sampler_t s;
+  SamplerInit(&s, 0, 4, 0, 0);
+  TEST_ASSERT(SamplerEnabled(&s), "The sampler is not enabled.");
+  for (int i = 0; i < 100; ++i)
+    TEST_ASSERT(SamplerPass(&s, NULL, 1) == (i % 4 == 0), "Not every 4th packet is passed.");
+  TEST_ASSERT(s.Passed == 25 && s.SuppressedByCount == 75 && s.Suppressed == 75, "Invalid counters.");
+}
+
+TEST_CASE(TestSampling, Random)
+{
+  Sampler_t s;
+  SamplerInit(&s, 0, 0, 10, 0);
+  for (int i = 0; i < 100000; ++i)
+    SamplerPass(&s, NULL, 1);
+  TEST_ASSERT(s.Passed > 9000 && s.Passed < 11000, "The probability is not 1/10.");
+  TEST_ASSERT(s.SuppressedByRandom == 100000 - s.Passed, "Invalid counters.");
+}
+
+TEST_CASE(TestSampling, Flows)
+{
+  Sampler_t s;
+  SamplerInit(&s, 8, 0, 0, 0);
+
+  size_t keptFlows = 0;
+  for (uint16_t port = 1; port <= 4000; ++port) {
+    PacketView_t request, response;
+    InitView(&request, 0x0100000A, port, 0x0200000A, 443);
+    InitView(&response, 0x0200000A, 443, 0x0100000A, port);
+
+    bool kept = SamplerPass(&s, &request, 1);
+    TEST_ASSERT(SamplerPass(&s, &response, 1) == kept, "Directions of the flow are sampled differently.");
+    TEST_ASSERT(SamplerPass(&s, &request, 1) == kept, "Packets of the flow are sampled differently.");
+    keptFlows += kept;
+  }
+  TEST_ASSERT(keptFlows > 400 && keptFlows < 600, "The flow ratio is not 1/8.");
+  TEST_ASSERT(s.SuppressedByFlow == (4000 - keptFlows) * 3, "Invalid counters.");
+
+  // packets without the flow are passed
+  TEST_ASSERT(SamplerPass(&s, NULL, 1), "The not decoded packet is suppressed.");
+}
+
+TEST_CASE(TestSampling, RateLimit)
+{
+  Sampler_t s;
+  SamplerInit(&s, 0, 0, 0, 10);
+
+  // the burst is one second of packets
+  uint64_t now = 1000000;
+  for (int i = 0; i < 10; ++i)
+    TEST_ASSERT(SamplerPass(&s, NULL, now), "The packet of the burst is suppressed.");
+  TEST_ASSERT(!SamplerPass(&s, NULL, now), "The packet over the limit is passed.");
+
+  TEST_ASSERT(!SamplerPass(&s, NULL, now + 50000), "The token is refilled too early.");
+  TEST_ASSERT(SamplerPass(&s, NULL, now + 100000), "The token is not refilled.");
+  TEST_ASSERT(!SamplerPass(&s, NULL, now + 100000), "The packet over the limit is passed.");
+
+  now += 60 * 1000000;
+  for (int i = 0; i < 10; ++i)
+    TEST_ASSERT(SamplerPass(&s, NULL, now), "The bucket is not refilled.");
+  TEST_ASSERT(!SamplerPass(&s, NULL, now), "The bucket holds more than one second of packets.");
+  TEST_ASSERT(s.Passed == 21 && s.SuppressedByRate == 4, "Invalid counters.");
+}
+
+TEST_CASE(TestSampling, Report)
+{
+  Sampler_t s;
+  SamplerInit(&s, 0, 2, 0, 0);
+
+  uint64_t now = 5000000;
+  SamplerPass(&s, NULL, now);
+  TEST_ASSERT(!SamplerReportDue(&s, now + SAMPLING_REPORT_INTERVAL_US), "The report is due, nothing is suppressed.");
+  for (int i = 0; i < 9; ++i)
+    SamplerPass(&s, NULL, now);
+  TEST_ASSERT(!SamplerReportDue(&s, now + 1000), "The report is due before the interval.");
+  TEST_ASSERT(SamplerReportDue(&s, now + SAMPLING_REPORT_INTERVAL_US), "The report is not due.");
+
+  char buffer[SAMPLING_REPORT_BUFFER_SUFFICIENT_SIZE];
+  PrintSamplingReport(&s, now + SAMPLING_REPORT_INTERVAL_US, false, buffer, sizeof(buffer));
+  TEST_ASSERT(strcmp(buffer, "# sampling: suppressed 5 of 10 packets in 1.000 s\n") == 0, "Invalid report.");
+  PrintSamplingReport(&s, now + SAMPLING_REPORT_INTERVAL_US, true, buffer, sizeof(buffer));
+  TEST_ASSERT(strcmp(buffer, "{\"sampling\":{\"suppressed\":5,\"packets\":10,\"interval_us\":1000000}}\n") == 0,
+              "Invalid JSON report.");
+
+  SamplerReportDone(&s, now + SAMPLING_REPORT_INTERVAL_US);
+  TEST_ASSERT(!SamplerReportDue(&s, now + 3 * SAMPLING_REPORT_INTERVAL_US), "The report is due without new packets.");
+  SamplerPass(&s, NULL, now + 3 * SAMPLING_REPORT_INTERVAL_US);
+  SamplerPass(&s, NULL, now + 3 * SAMPLING_REPORT_INTERVAL_US);
+  PrintSamplingReport(&s, now + 3 * SAMPLING_REPORT_INTERVAL_US, false, buffer, sizeof(buffer));
+  TEST_ASSERT(strcmp(buffer, "# sampling: suppressed 1 of 2 packets in 2.000 s\n") == 0,
+              "The report does not count packets since the last report.");
+}
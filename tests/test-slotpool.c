@@ -0,0 +1,79 @@
+#include "testing.h"
+#include "slotpool.h"
+
+#include <string.h>
+#ifdef __linux__
+#include <unistd.h>
+
+#define SLOTS_COUNT 200
+#define SLOTS_WINDOW 8
+
+typedef struct
+{
+  uint64_t Values[SLOTS_WINDOW]; //! The value of each slot
+  uint64_t Written[SLOTS_COUNT]; //! Values in the order of writes
+  size_t WrittenCount;
+} SlotState_t;
+
+static void ProcessSlot(size_t slot, size_t worker, void* args)
+{
+  (void) worker;
+
+  // slow slots are completed after the next ones
+  SlotState_t* state = (SlotState_t*) args;
+  if (state->Values[slot] % 4 == 0)
+    usleep(1000);
+  state->Values[slot] *= 2;
+}
+
+static void WriteSlot(size_t slot, size_t worker, void* args)
+{
+  (void) worker;
+
+  SlotState_t* state = (SlotState_t*) args;
+  state->Written[state->WrittenCount++] = state->Values[slot];
+}
+
+static bool CheckSlots(SlotPool_t* p, SlotState_t* state, uint64_t count)
+{
+  for (uint64_t i = 0; i < count; ++i) {
+    state->Values[SlotPoolAcquire(p)] = i;
+    SlotPoolSubmit(p);
+  }
+  SlotPoolStop(p);
+
+  bool ordered = state->WrittenCount == count;
+  for (uint64_t i = 0; i < count && ordered; ++i)
+    ordered = state->Written[i] == i * 2;
+  return ordered;
+}
+
+TEST_CASE(TestSlotPool, Order)
+{
+  SlotState_t state;
+  memset(&state, 0, sizeof(state));
+  SlotPool_t p;
+  SlotPoolInit(&p, 4, SLOTS_WINDOW, ProcessSlot, WriteSlot, &state);
+  TEST_ASSERT(p.Window == SLOTS_WINDOW, "Invalid window.");
+  TEST_ASSERT(SlotPoolStart(&p) == 0, "Cannot start worker threads.");
+
+  TEST_ASSERT(CheckSlots(&p, &state, SLOTS_COUNT), "Slots are not written in the order of submission.");
+  TEST_ASSERT(p.Jobs == SLOTS_COUNT && p.Reordered > 0, "Slots completed out of order are not counted.");
+  TEST_ASSERT(p.Stalls > 0, "Window stalls are not counted.");
+  SlotPoolClear(&p);
+}
+
+TEST_CASE(TestSlotPool, Synchronous)
+{
+  // without worker threads slots are processed and written by the producer
+  SlotState_t state;
+  memset(&state, 0, sizeof(state));
+  SlotPool_t p;
+  SlotPoolInit(&p, 0, 0, ProcessSlot, WriteSlot, &state);
+  TEST_ASSERT(p.Window == 1 && SlotPoolStart(&p) == 0, "Invalid window.");
+
+  TEST_ASSERT(CheckSlots(&p, &state, 10), "Slots are not written in the order of submission.");
+  TEST_ASSERT(p.Jobs == 10 && p.Reordered == 0 && p.Stalls == 0, "Invalid counters.");
+  SlotPoolClear(&p);
+}
+#endif
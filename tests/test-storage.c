@@ -0,0 +1,261 @@
+#include "testing.h"
+#include "storage.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#define STORAGE_TEST_PACKET_SIZE 1000
+#define STORAGE_TEST_PACKETS 4000
+#define STORAGE_TEST_FLOWS 8
+#define STORAGE_TEST_BATCH 64
+#define STORAGE_TEST_TIME_SEC 1700000000ULL
+
+typedef struct
+{
+  uint64_t Packets;
+  uint64_t LastNs;
+  uint16_t Port; // the client port of the flow, 0 - any flow
+  bool Valid;
+} StorageResult_t;
+
+static uint64_t GetPacketNs(uint32_t sequence)
+{
+  return (STORAGE_TEST_TIME_SEC + sequence / 1000) * 1000000000ULL + (sequence % 1000) * 1000000ULL;
+}
+
+static void InitPacket(uint8_t* data, SnifferPacket_t* packet, uint32_t sequence)
+{
+  // UDP packets of flows 10.0.0.1:(1000 + N) <-> 10.0.0.2:53, every other packet is the response
+  uint16_t clientPort = (uint16_t) (1000 + sequence % STORAGE_TEST_FLOWS);
+  bool response = (sequence / STORAGE_TEST_FLOWS) % 2 == 1;
+  uint8_t client[4] = {10, 0, 0, 1}, server[4] = {10, 0, 0, 2};
+  uint16_t sport = htons(response ? 53 : clientPort), dport = htons(response ? clientPort : 53);
+  uint16_t length = htons(STORAGE_TEST_PACKET_SIZE);
+  memset(data, 0, STORAGE_TEST_PACKET_SIZE);
+  data[0] = 0x45;
+  memcpy(data + 2, &length, sizeof(length));
+  data[8] = 64;
+  data[9] = 17;
+  memcpy(data + 12, response ? server : client, 4);
+  memcpy(data + 16, response ? client : server, 4);
+  memcpy(data + 20, &sport, sizeof(sport));
+  memcpy(data + 22, &dport, sizeof(dport));
+  memcpy(data + 28, &sequence, sizeof(sequence));
+
+  memset(packet, 0, sizeof(SnifferPacket_t));
+  packet->Data = (Buffer_t) data;
+  packet->Size = STORAGE_TEST_PACKET_SIZE;
+  packet->Time.TimestampSec = (int64_t) (GetPacketNs(sequence) / 1000000000ULL);
+  packet->Time.TimestampNanosec = (uint32_t) (GetPacketNs(sequence) % 1000000000ULL);
+}
+
+static void WritePackets(StorageWriter_t* s, uint32_t first, uint32_t count)
+{
+  static uint8_t data[STORAGE_TEST_BATCH][STORAGE_TEST_PACKET_SIZE];
+  SnifferPacket_t packets[STORAGE_TEST_BATCH];
+  for (uint32_t sequence = first; sequence < first + count;) {
+    size_t batch = 0;
+    for (; batch < STORAGE_TEST_BATCH && sequence < first + count; ++batch, ++sequence)
+      InitPacket(data[batch], &packets[batch], sequence);
+    StorageWriterWrite(s, packets, batch);
+    // batches are paced like the capture, the index of the segment is written before the next rotation
+    usleep(1000);
+  }
+}
+
+static void CheckPacket(const PcapRecordHeader_t* header, const uint8_t* data, uint32_t linkType, void* args)
+{
+  StorageResult_t* result = (StorageResult_t*) args;
+  uint32_t sequence;
+  memcpy(&sequence, data + 28, sizeof(sequence));
+  uint64_t ns = (uint64_t) header->TimestampSec * 1000000000ULL + header->TimestampNanosec;
+  uint16_t clientPort = (uint16_t) (1000 + sequence % STORAGE_TEST_FLOWS);
+  result->Valid = result->Valid && linkType == PCAP_LINKTYPE_RAW &&
+                  header->CapturedLength == STORAGE_TEST_PACKET_SIZE && ns == GetPacketNs(sequence) &&
+                  (result->Packets == 0 || ns > result->LastNs) && (result->Port == 0 || result->Port == clientPort);
+  result->LastNs = ns;
+  result->Packets++;
+}
+
+static int RunQuery(const char* directory, const StorageQuery_t* q, StorageResult_t* result, StorageQueryStats_t* stats)
+{
+  result->Packets = 0;
+  result->LastNs = 0;
+  result->Valid = true;
+  char* error = NULL;
+  int rc = StorageQueryRun(directory, q, CheckPacket, result, stats, &error);
+  free(error);
+  return rc;
+}
+
+static void InitFlowQuery(StorageQuery_t* q, uint16_t port, bool response)
+{
+  StorageQueryInit(q);
+  q->HasFlow = true;
+  q->Protocol = Protocol_UDP;
+  q->SourceAddress = htonl(response ? 0x0A000002 : 0x0A000001);
+  q->DestinationAddress = htonl(response ? 0x0A000001 : 0x0A000002);
+  q->SourcePort = response ? 53 : port;
+  q->DestinationPort = response ? port : 53;
+}
+
+static void RemoveDirectory(const char* directory)
+{
+  DIR* dir = opendir(directory);
+  if (dir == NULL)
+    return;
+  struct dirent* entry;
+  char path[STORAGE_PATH_MAX_SIZE + 256];
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+    remove(path);
+  }
+  closedir(dir);
+  rmdir(directory);
+}
+
+/**
+ * Writes segments (compressed by the threads), runs queries by indexes and without the index, restarts the storage.
+ */
+static void CheckStorage(const char* name, size_t compressThreads)
+{
+  char directory[64], path[128];
+  const char* suffix = compressThreads > 0 ? STORAGE_COMPRESSED_SUFFIX : "";
+  snprintf(directory, sizeof(directory), "/tmp/netsniffer-test-%s-%d", name, (int) getpid());
+  RemoveDirectory(directory);
+  StorageWriter_t s;
+  StorageWriterInit(&s, directory, STORAGE_SEGMENT_MIN_SIZE, PCAP_LINKTYPE_RAW);
+  StorageWriterSetCompression(&s, compressThreads);
+  TEST_ASSERT(StorageWriterStart(&s) == 0, "Cannot start the storage.");
+  WritePackets(&s, 0, STORAGE_TEST_PACKETS);
+  StorageWriterStop(&s);
+  TEST_ASSERT(s.Packets == STORAGE_TEST_PACKETS && s.Errors == 0 && s.ErrorMessage == NULL, "Invalid counters.");
+  TEST_ASSERT(s.Segments == 4 && s.Indexed + s.IndexSkipped == s.Segments && s.Indexed > 0, "Invalid segments.");
+  snprintf(path, sizeof(path), "%s/" STORAGE_SEGMENT_FORMAT "%s", directory, 3ULL, suffix);
+  TEST_ASSERT(access(path, F_OK) == 0, "The segment is not created.");
+  // packets are mostly zeros, all blocks are compressed
+  TEST_ASSERT(compressThreads == 0 || (s.Compressor->Blocks >= s.Segments && s.Compressor->StoredBlocks == 0 &&
+                                       s.Compressor->WriteErrors == 0 && s.Compressor->Bytes * 4 < s.Bytes),
+              "Segments are not compressed.");
+
+  // the flow is found in both directions, indexed segments only read packets of the flow
+  StorageQuery_t q;
+  StorageQueryStats_t stats;
+  StorageResult_t result = {0, 0, 1003, true};
+  for (int response = 0; response <= 1; ++response) {
+    InitFlowQuery(&q, 1003, response);
+    TEST_ASSERT(RunQuery(directory, &q, &result, &stats) == 0, "Cannot run the flow query.");
+    TEST_ASSERT(result.Valid && result.Packets == STORAGE_TEST_PACKETS / STORAGE_TEST_FLOWS,
+                "Invalid packets of the flow.");
+    TEST_ASSERT(stats.Segments == 4 && stats.IndexedSegments == s.Indexed && stats.ScannedSegments == s.IndexSkipped,
+                "Indexes are not used.");
+    TEST_ASSERT(s.IndexSkipped > 0 || stats.ReadPackets == result.Packets, "Packets of other flows are read.");
+    TEST_ASSERT((compressThreads > 0) == (stats.DecompressedBlocks > 0), "Invalid count of decompressed blocks.");
+  }
+
+  // segments outside the time range are skipped
+  StorageQueryInit(&q);
+  q.FromNs = GetPacketNs(1500);
+  q.ToNs = GetPacketNs(2499);
+  result.Port = 0;
+  TEST_ASSERT(RunQuery(directory, &q, &result, &stats) == 0, "Cannot run the time query.");
+  TEST_ASSERT(result.Valid && result.Packets == 1000, "Invalid packets of the time range.");
+  TEST_ASSERT(s.IndexSkipped > 0 || (stats.SkippedSegments == 2 && stats.ReadPackets < 1000 + 2 * 1024),
+              "The time range is not found by the index.");
+
+  // the segment without the index is scanned
+  snprintf(path, sizeof(path), "%s/" STORAGE_INDEX_FORMAT, directory, 1ULL);
+  remove(path);
+  InitFlowQuery(&q, 1003, false);
+  result.Port = 1003;
+  TEST_ASSERT(RunQuery(directory, &q, &result, &stats) == 0, "Cannot run the flow query.");
+  TEST_ASSERT(result.Valid && result.Packets == STORAGE_TEST_PACKETS / STORAGE_TEST_FLOWS && stats.ScannedSegments > 0,
+              "Invalid packets of the flow without the index.");
+  StorageWriterClear(&s);
+
+  // segments of the next run follow segments of the previous run
+  StorageWriterInit(&s, directory, STORAGE_SEGMENT_MIN_SIZE, PCAP_LINKTYPE_RAW);
+  StorageWriterSetCompression(&s, compressThreads);
+  TEST_ASSERT(StorageWriterStart(&s) == 0, "Cannot restart the storage.");
+  WritePackets(&s, STORAGE_TEST_PACKETS, 10);
+  StorageWriterStop(&s);
+  snprintf(path, sizeof(path), "%s/" STORAGE_SEGMENT_FORMAT "%s", directory, 4ULL, suffix);
+  TEST_ASSERT(s.Segments == 1 && access(path, F_OK) == 0, "Invalid number of the segment.");
+  StorageQueryInit(&q);
+  result.Port = 0;
+  TEST_ASSERT(RunQuery(directory, &q, &result, &stats) == 0, "Cannot run the query.");
+  TEST_ASSERT(result.Valid && result.Packets == STORAGE_TEST_PACKETS + 10 && stats.Segments == 5,
+              "Packets of the previous run are lost.");
+  StorageWriterClear(&s);
+  RemoveDirectory(directory);
+}
+
+TEST_CASE(TestStorage, Query)
+{
+  CheckStorage("storage", 0);
+}
+
+TEST_CASE(TestStorage, CompressedQuery)
+{
+  CheckStorage("storage-compressed", 4);
+}
+
+TEST_CASE(TestStorage, CompressedBlocks)
+{
+  char directory[64];
+  snprintf(directory, sizeof(directory), "/tmp/netsniffer-test-storage-blocks-%d", (int) getpid());
+  RemoveDirectory(directory);
+  StorageWriter_t s;
+  StorageWriterInit(&s, directory, 8 * STORAGE_SEGMENT_MIN_SIZE, PCAP_LINKTYPE_RAW);
+  StorageWriterSetCompression(&s, 2);
+  TEST_ASSERT(StorageWriterStart(&s) == 0, "Cannot start the storage.");
+  WritePackets(&s, 0, STORAGE_TEST_PACKETS);
+  StorageWriterStop(&s);
+  TEST_ASSERT(s.Segments == 1 && s.Indexed == 1 && s.Compressor->Blocks == 4, "Invalid blocks of the segment.");
+
+  // only blocks of the time range are decompressed, the block of the time entry before the range is the first
+  StorageQuery_t q;
+  StorageQueryStats_t stats;
+  StorageResult_t result = {0, 0, 0, true};
+  StorageQueryInit(&q);
+  q.FromNs = GetPacketNs(1500);
+  q.ToNs = GetPacketNs(2499);
+  TEST_ASSERT(RunQuery(directory, &q, &result, &stats) == 0, "Cannot run the time query.");
+  TEST_ASSERT(result.Valid && result.Packets == 1000 && stats.DecompressedBlocks == 3,
+              "Invalid blocks of the time range.");
+
+  // packets of the flow are in all blocks, each block is decompressed once
+  InitFlowQuery(&q, 1005, true);
+  result.Port = 1005;
+  TEST_ASSERT(RunQuery(directory, &q, &result, &stats) == 0, "Cannot run the flow query.");
+  TEST_ASSERT(result.Valid && result.Packets == STORAGE_TEST_PACKETS / STORAGE_TEST_FLOWS &&
+                  stats.ReadPackets == result.Packets && stats.DecompressedBlocks == 4,
+              "Invalid blocks of the flow.");
+  StorageWriterClear(&s);
+  RemoveDirectory(directory);
+}
+
+TEST_CASE(TestStorage, Errors)
+{
+  StorageWriter_t s;
+  StorageWriterInit(&s, "/nonexistent/netsniffer/storage", STORAGE_SEGMENT_MIN_SIZE, PCAP_LINKTYPE_RAW);
+  TEST_ASSERT(StorageWriterStart(&s) < 0 && s.ErrorMessage != NULL, "The storage in the missing directory is started.");
+  StorageWriterClear(&s);
+
+  StorageQuery_t q;
+  StorageQueryStats_t stats;
+  StorageQueryInit(&q);
+  char* error = NULL;
+  TEST_ASSERT(StorageQueryRun("/nonexistent/netsniffer/storage", &q, CheckPacket, NULL, &stats, &error) < 0 &&
+                  error != NULL,
+              "The missing directory is queried.");
+  free(error);
+}
+#endif
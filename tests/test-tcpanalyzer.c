@@ -0,0 +1,168 @@
+#include "testing.h"
+#include "tcpanalyzer.h"
+
+#include <string.h>
+
+#define CLIENT_ADDRESS 0x0100000A
+#define SERVER_ADDRESS 0x0200000A
+#define CLIENT_ISN 0xFFFFFF00 /* the sequence number wraps around */
+#define SERVER_ISN 5000
+
+static void Segment(PacketView_t* view, bool fromClient, uint8_t flags, uint32_t seq, uint32_t ack, size_t size,
+                    uint16_t window)
+{
+  memset(view, 0, sizeof(PacketView_t));
+  view->Protocol = Protocol_TCP;
+  view->SourceAddress = fromClient ? CLIENT_ADDRESS : SERVER_ADDRESS;
+  view->DestinationAddress = fromClient ? SERVER_ADDRESS : CLIENT_ADDRESS;
+  view->SourcePort = fromClient ? 40000 : 80;
+  view->DestinationPort = fromClient ? 80 : 40000;
+  view->TCPFlags = flags;
+  view->SequenceNumber = seq;
+  view->AckNumber = ack;
+  view->PayloadSize = size;
+  view->WindowSize = window;
+  view->PacketSize = 40 + size;
+}
+
+static TimeInfo_t AtMs(uint64_t ms)
+{
+  TimeInfo_t time;
+  memset(&time, 0, sizeof(time));
+  time.TimestampSec = (time_t) (100 + ms / 1000);
+  time.TimestampNanosec = (uint32_t) (ms % 1000) * 1000000;
+  return time;
+}
+
+TEST_CASE(TestTcpAnalyzer, HandshakeAndDataRtt)
+{
+  TcpAnalyzer_t analyzer;
+  TcpAnalyzerInit(&analyzer, 16);
+
+  PacketView_t view;
+  TcpEvent_t event;
+  TimeInfo_t time;
+
+  Segment(&view, true, TCPFlag_SYN, CLIENT_ISN, 0, 0, 1000);
+  time = AtMs(0);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 0, "Event for the SYN.");
+  Segment(&view, false, TCPFlag_SYN | TCPFlag_ACK, SERVER_ISN, CLIENT_ISN + 1, 0, 1000);
+  time = AtMs(10);
+  TcpAnalyzerProcess(&analyzer, &view, &time, &event);
+  Segment(&view, true, TCPFlag_ACK, CLIENT_ISN + 1, SERVER_ISN + 1, 0, 1000);
+  time = AtMs(12);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1, "Handshake is not finished.");
+  TEST_ASSERT(event.Analysis == TcpAnalysis_HANDSHAKE_RTT && event.HandshakeRttUs == 12000, "Invalid handshake RTT.");
+
+  // 512 bytes of the request cross the sequence number wraparound
+  Segment(&view, true, TCPFlag_ACK | TCPFlag_PSH, CLIENT_ISN + 1, SERVER_ISN + 1, 512, 1000);
+  time = AtMs(20);
+  TcpAnalyzerProcess(&analyzer, &view, &time, &event);
+  Segment(&view, false, TCPFlag_ACK | TCPFlag_PSH, SERVER_ISN + 1, CLIENT_ISN + 513, 100, 1000);
+  time = AtMs(25);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1, "Data is not acknowledged.");
+  TEST_ASSERT(event.Analysis == TcpAnalysis_DATA_RTT && event.RttUs == 5000, "Invalid data RTT.");
+
+  // FIN from both sides closes the flow
+  Segment(&view, true, TCPFlag_ACK | TCPFlag_FIN, CLIENT_ISN + 513, SERVER_ISN + 101, 0, 1000);
+  time = AtMs(30);
+  TcpAnalyzerProcess(&analyzer, &view, &time, &event);
+  TEST_ASSERT(!event.Closed, "The flow is closed by one FIN.");
+  Segment(&view, false, TCPFlag_ACK | TCPFlag_FIN, SERVER_ISN + 101, CLIENT_ISN + 514, 0, 1000);
+  time = AtMs(31);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1 && event.Closed, "The flow is not closed.");
+  TEST_ASSERT(event.Flow.Packets == 7 && event.Flow.Retransmissions == 0 && event.Flow.RttCount == 2,
+              "Invalid flow summary.");
+  TEST_ASSERT(event.Flow.ClientPort == 40000 && event.Flow.ServerPort == 80, "Invalid client.");
+  TEST_ASSERT(analyzer.HandshakeRtt.Count == 1 && analyzer.DataRtt.Count == 2, "Invalid histograms.");
+
+  TcpAnalyzerClear(&analyzer);
+}
+
+TEST_CASE(TestTcpAnalyzer, LossAndWindow)
+{
+  TcpAnalyzer_t analyzer;
+  TcpAnalyzerInit(&analyzer, 16);
+
+  PacketView_t view;
+  TcpEvent_t event;
+  TimeInfo_t time = AtMs(0);
+
+  // the flow is captured in the middle
+  Segment(&view, true, TCPFlag_ACK, 1000, 7000, 100, 1000);
+  TcpAnalyzerProcess(&analyzer, &view, &time, &event);
+  Segment(&view, true, TCPFlag_ACK, 1200, 7000, 100, 1000); // 1100-1200 is lost
+  time = AtMs(1);
+  TcpAnalyzerProcess(&analyzer, &view, &time, &event);
+
+  Segment(&view, false, TCPFlag_ACK, 7000, 1100, 0, 1000);
+  time = AtMs(20);
+  TcpAnalyzerProcess(&analyzer, &view, &time, &event);
+  Segment(&view, false, TCPFlag_ACK, 7000, 1100, 0, 1000);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1, "Duplicate ACK is not detected.");
+  TEST_ASSERT(event.Analysis == TcpAnalysis_DUP_ACK, "Invalid duplicate ACK analysis.");
+
+  // the lost segment is sent again after the RTO, Karn's algorithm skips the RTT sample
+  Segment(&view, true, TCPFlag_ACK, 1100, 7000, 100, 1000);
+  time = AtMs(200);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1, "Retransmission is not detected.");
+  TEST_ASSERT(event.Analysis == TcpAnalysis_RETRANSMISSION, "Invalid retransmission analysis.");
+  Segment(&view, false, TCPFlag_ACK, 7000, 1300, 0, 0);
+  time = AtMs(210);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1, "Zero window is not detected.");
+  TEST_ASSERT(event.Analysis == TcpAnalysis_ZERO_WINDOW, "RTT of the retransmitted data is sampled.");
+  Segment(&view, false, TCPFlag_ACK, 7000, 1300, 0, 0);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 0, "Zero window is counted twice.");
+  Segment(&view, false, TCPFlag_ACK, 7000, 1300, 0, 1000);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1 && event.Analysis == TcpAnalysis_WINDOW_OPEN,
+              "Window update is not detected.");
+
+  // the reordered segment arrives right after the later segment
+  Segment(&view, true, TCPFlag_ACK, 1400, 7000, 100, 1000);
+  time = AtMs(300);
+  TcpAnalyzerProcess(&analyzer, &view, &time, &event);
+  Segment(&view, true, TCPFlag_ACK, 1300, 7000, 100, 1000);
+  time = AtMs(301);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1 && event.Analysis == TcpAnalysis_OUT_OF_ORDER,
+              "Out-of-order segment is not detected.");
+
+  TEST_ASSERT(analyzer.Retransmissions == 1 && analyzer.OutOfOrder == 1 && analyzer.DupAcks == 1 &&
+                  analyzer.ZeroWindows == 1,
+              "Invalid counters.");
+
+  const TcpFlow_t* flows[4];
+  TEST_ASSERT(TcpAnalyzerWorstFlows(&analyzer, flows, 4) == 1 && flows[0]->Retransmissions == 1,
+              "Invalid worst flows.");
+
+  Segment(&view, false, TCPFlag_RST, 7000, 0, 0, 0);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1 && event.Closed, "RST does not close the flow.");
+  TEST_ASSERT(TcpAnalyzerWorstFlows(&analyzer, flows, 4) == 0, "Closed flow is selected.");
+
+  TcpAnalyzerClear(&analyzer);
+}
+
+TEST_CASE(TestTcpAnalyzer, DecodedWindow)
+{
+  // 10.0.0.2:80 -> 10.0.0.1:40000, ACK with the window 0x1234
+  uint8_t packet[40] = {0x45, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00, 0x40, 0x06, 0x00, 0x00, 0x0A, 0x00,
+                        0x00, 0x02, 0x0A, 0x00, 0x00, 0x01, 0x00, 0x50, 0x9C, 0x40, 0x00, 0x00, 0x13, 0x88,
+                        0x00, 0x00, 0x03, 0xE8, 0x50, 0x10, 0x12, 0x34, 0x00, 0x00, 0x00, 0x00};
+  PacketView_t view;
+  TEST_ASSERT(DecodePacketView((Buffer_t) packet, sizeof(packet), &view) == 0 && view.WindowSize == 0x1234,
+              "Invalid decoded window.");
+
+  TcpAnalyzer_t analyzer;
+  TcpAnalyzerInit(&analyzer, 16);
+  TcpEvent_t event;
+  TimeInfo_t time = AtMs(0);
+  TcpAnalyzerProcess(&analyzer, &view, &time, &event);
+
+  packet[34] = packet[35] = 0;
+  TEST_ASSERT(DecodePacketView((Buffer_t) packet, sizeof(packet), &view) == 0 && view.WindowSize == 0,
+              "Invalid decoded zero window.");
+  time = AtMs(1);
+  TEST_ASSERT(TcpAnalyzerProcess(&analyzer, &view, &time, &event) == 1 && event.Analysis == TcpAnalysis_ZERO_WINDOW,
+              "Decoded zero window is not detected.");
+  TEST_ASSERT(analyzer.ZeroWindows == 1, "Invalid zero windows counter.");
+  TcpAnalyzerClear(&analyzer);
+}
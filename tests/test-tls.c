@@ -0,0 +1,126 @@
+#include "testing.h"
+#include "tls.h"
+
+#include <string.h>
+
+/*
+ * ClientHello (TLS 1.3, www.example.com, h2 and http/1.1), GREASE values are included.
+ */
+static const uint8_t ClientHello[] = {
+    0x16, 0x03, 0x01, 0x00, 0x72,                   // record: handshake, TLS 1.0, length
+    0x01, 0x00, 0x00, 0x6E,                         // handshake: ClientHello, length
+    0x03, 0x03,                                     // client version: TLS 1.2
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, // random
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, //
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, //
+    0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, //
+    0x00,                                           // session ID
+    0x00, 0x06, 0x1A, 0x1A, 0x13, 0x01, 0x13, 0x02, // cipher suites: GREASE, TLS_AES_128_GCM, TLS_AES_256_GCM
+    0x01, 0x00,                                     // compression methods: null
+    0x00, 0x3F,                                     // extensions length
+    0x0A, 0x0A, 0x00, 0x00,                         // GREASE extension
+    0x00, 0x00, 0x00, 0x14, 0x00, 0x12, 0x00, 0x00, // server_name
+    0x0F, 'w',  'w',  'w',  '.',  'e',  'x',  'a',  //
+    'm',  'p',  'l',  'e',  '.',  'c',  'o',  'm',  //
+    0x00, 0x10, 0x00, 0x0E, 0x00, 0x0C, 0x02, 'h',  // ALPN
+    '2',  0x08, 'h',  't',  't',  'p',  '/',  '1',  //
+    '.',  '1',                                      //
+    0x00, 0x2B, 0x00, 0x05, 0x04, 0x2A, 0x2A, 0x03, // supported_versions: GREASE, TLS 1.3
+    0x04,                                           //
+    0x00, 0x0A, 0x00, 0x04, 0x00, 0x02, 0x00, 0x1D, // supported_groups: x25519
+};
+
+TEST_CASE(TestTls, ParseClientHello)
+{
+  TlsClientHello_t hello;
+  TEST_ASSERT(TlsParseClientHello(ClientHello, sizeof(ClientHello), &hello) == 0, "ClientHello is not decoded.");
+  TEST_ASSERT(!hello.Truncated, "Complete ClientHello is truncated.");
+  TEST_ASSERT(strcmp(hello.SNI, "www.example.com") == 0, "Invalid SNI.");
+  TEST_ASSERT(strcmp(hello.ALPN, "h2,http/1.1") == 0, "Invalid ALPN.");
+  TEST_ASSERT(hello.RecordVersion == 0x0301 && hello.ClientVersion == 0x0303, "Invalid versions.");
+  TEST_ASSERT(hello.MaxSupportedVersion == 0x0304, "Invalid supported version.");
+  TEST_ASSERT(hello.CipherSuitesCount == 2 && hello.ExtensionsCount == 4, "GREASE values are counted.");
+
+  uint64_t fingerprint = hello.Fingerprint;
+  uint8_t data[sizeof(ClientHello)];
+  memcpy(data, ClientHello, sizeof(ClientHello));
+  data[0x2E] = data[0x2F] = 0x2A; // other GREASE values
+  data[0x38] = data[0x39] = 0x3A;
+  TEST_ASSERT(TlsParseClientHello(data, sizeof(data), &hello) == 0 && hello.Fingerprint == fingerprint,
+              "GREASE values change the fingerprint.");
+  data[0x31] = 0x04; // TLS_AES_128_CCM
+  TEST_ASSERT(TlsParseClientHello(data, sizeof(data), &hello) == 0 && hello.Fingerprint != fingerprint,
+              "Cipher suites do not change the fingerprint.");
+
+  // the first segment ends inside the ALPN extension
+  TEST_ASSERT(TlsParseClientHello(ClientHello, 0x5E, &hello) == 0, "Truncated ClientHello is not decoded.");
+  TEST_ASSERT(hello.Truncated && strcmp(hello.SNI, "www.example.com") == 0 && hello.ALPN[0] == '\0',
+              "Invalid truncated ClientHello.");
+
+  for (size_t size = 0; size < 11; ++size)
+    TEST_ASSERT(TlsParseClientHello(ClientHello, size, &hello) < 0, "Too short data is decoded.");
+  TEST_ASSERT(TlsParseClientHello((const uint8_t*) "GET / HTTP/1.1\r\n", 16, &hello) < 0, "HTTP is decoded.");
+}
+
+TEST_CASE(TestTls, MatchSNI)
+{
+  TEST_ASSERT(TlsMatchSNI("*.example.com", "www.example.com"), "Subdomain is not matched.");
+  TEST_ASSERT(TlsMatchSNI("*.example.com", "a.b.EXAMPLE.com"), "Nested subdomain is not matched.");
+  TEST_ASSERT(!TlsMatchSNI("*.example.com", "example.com"), "Domain is matched by the subdomain pattern.");
+  TEST_ASSERT(!TlsMatchSNI("*.example.com", "www.example.org"), "Other domain is matched.");
+  TEST_ASSERT(TlsMatchSNI("example.com", "example.com") && !TlsMatchSNI("example.com", "example.co"),
+              "Exact name is not matched.");
+  TEST_ASSERT(TlsMatchSNI("*", "anything") && TlsMatchSNI("api*.example.*", "api2.example.net"),
+              "Wildcards are not matched.");
+}
+
+TEST_CASE(TestTls, TrackerFirstSegment)
+{
+  TlsTracker_t tracker;
+  TlsTrackerInit(&tracker, 16);
+  TEST_ASSERT(TlsTrackerAddSNIPattern(&tracker, "*.example.org") == 0, "Invalid pattern bit.");
+  TEST_ASSERT(TlsTrackerAddSNIPattern(&tracker, "*.example.com") == 1, "Invalid pattern bit.");
+
+  PacketView_t view;
+  memset(&view, 0, sizeof(view));
+  view.Protocol = Protocol_TCP;
+  view.SourceAddress = 0x0100000A;
+  view.DestinationAddress = 0x0200000A;
+  view.SourcePort = 40000;
+  view.DestinationPort = 443;
+  view.PacketSize = 60;
+  view.TCPFlags = TCPFlag_SYN;
+
+  TlsEvent_t event;
+  TEST_ASSERT(TlsTrackerProcess(&tracker, &view, &event) == 0 && event.SNI == NULL, "SNI is known before hello.");
+
+  view.TCPFlags = TCPFlag_ACK | TCPFlag_PSH;
+  view.Payload = (Buffer_t) ClientHello;
+  view.PayloadSize = sizeof(ClientHello);
+  view.PacketSize = 40 + sizeof(ClientHello);
+  TEST_ASSERT(TlsTrackerProcess(&tracker, &view, &event) == 1, "ClientHello is not decoded.");
+  TEST_ASSERT(event.ClientHelloDecoded && strcmp(event.SNI, "www.example.com") == 0, "Invalid SNI.");
+  TEST_ASSERT(event.PatternMask == 2, "Invalid pattern mask.");
+
+  // the response of the server: the same flow, not parsed
+  view.SourceAddress = 0x0200000A;
+  view.DestinationAddress = 0x0100000A;
+  view.SourcePort = 443;
+  view.DestinationPort = 40000;
+  TEST_ASSERT(TlsTrackerProcess(&tracker, &view, &event) == 1, "Flow is not found.");
+  TEST_ASSERT(!event.ClientHelloDecoded && event.PatternMask == 2, "The second segment is parsed.");
+  TEST_ASSERT(tracker.ClientHellos == 1 && tracker.SNIsCount == 1, "Invalid counters.");
+  TEST_ASSERT(tracker.SNIs[0].Connections == 1 && tracker.SNIs[0].Packets == 2, "Invalid SNI counters.");
+
+  // the other flow does not start with the ClientHello
+  view.SourcePort = 8080;
+  view.Payload = (Buffer_t) "HTTP/1.1 200 OK\r\n";
+  view.PayloadSize = 17;
+  TEST_ASSERT(TlsTrackerProcess(&tracker, &view, &event) == 0 && tracker.NotTls == 1, "Not TLS flow is decoded.");
+  view.Payload = (Buffer_t) ClientHello;
+  view.PayloadSize = sizeof(ClientHello);
+  TEST_ASSERT(TlsTrackerProcess(&tracker, &view, &event) == 0 && tracker.ClientHellos == 1,
+              "Not the first segment is parsed.");
+
+  TlsTrackerClear(&tracker);
+}
@@ -0,0 +1,39 @@
+#include "testing.h"
+#include "traffic.h"
+
+TEST_CASE(TestTraffic, SizeBuckets)
+{
+  TEST_ASSERT(TrafficSizeBucket(0) == 0 && TrafficSizeBucket(63) == 0, "Small packets are not in the first bucket.");
+  TEST_ASSERT(TrafficSizeBucket(64) == 1 && TrafficSizeBucket(127) == 1, "Invalid bucket of 64-127 bytes.");
+  TEST_ASSERT(TrafficSizeBucket(1024) == 5 && TrafficSizeBucket(1500) == 5, "Invalid bucket of 1024-2047 bytes.");
+  TEST_ASSERT(TrafficSizeBucket(4095) == 6, "Invalid bucket of 2048-4095 bytes.");
+  TEST_ASSERT(TrafficSizeBucket(4096) == TRAFFIC_SIZE_BUCKETS_COUNT - 1 &&
+                  TrafficSizeBucket(65535) == TRAFFIC_SIZE_BUCKETS_COUNT - 1,
+              "Large packets are not in the last bucket.");
+}
+
+TEST_CASE(TestTraffic, Counters)
+{
+  TrafficStats_t t;
+  TrafficStatsInit(&t);
+  TrafficStatsAdd(&t, Protocol_TCP, Direction_SOURCE, 0, 60);
+  TrafficStatsAdd(&t, Protocol_TCP, Direction_DESTINATION, 0, 1500);
+  TrafficStatsAdd(&t, Protocol_UDP, Direction_DESTINATION, 1, 100);
+  TrafficStatsAdd(&t, Protocol_ICMP, Direction_SOURCE, 2, 84);
+  TrafficStatsAdd(&t, 47 /* GRE */, Direction_SOURCE, 2, 200);
+
+  TEST_ASSERT(t.Total.Packets == 5 && t.Total.Bytes == 1944, "Invalid total counters.");
+  TEST_ASSERT(t.Protocols[TrafficProtocol_TCP][0].Packets == 1 && t.Protocols[TrafficProtocol_TCP][0].Bytes == 60,
+              "Invalid outgoing TCP counters.");
+  TEST_ASSERT(t.Protocols[TrafficProtocol_TCP][1].Packets == 1 && t.Protocols[TrafficProtocol_TCP][1].Bytes == 1500,
+              "Invalid incoming TCP counters.");
+  TEST_ASSERT(t.Protocols[TrafficProtocol_UDP][1].Packets == 1, "Invalid UDP counters.");
+  TEST_ASSERT(t.Protocols[TrafficProtocol_ICMP][0].Packets == 1, "Invalid ICMP counters.");
+  TEST_ASSERT(t.Protocols[TrafficProtocol_OTHER][0].Bytes == 200, "Other protocols are not counted.");
+  TEST_ASSERT(t.Rules[0].Packets == 2 && t.Rules[1].Packets == 1 && t.Rules[2].Bytes == 284, "Invalid rule counters.");
+  TEST_ASSERT(t.Sizes[0] == 1 && t.Sizes[1] == 2 && t.Sizes[2] == 1 && t.Sizes[5] == 1, "Invalid size histogram.");
+
+  // rules of the file are not folded onto counters of addresses
+  TrafficStatsAdd(&t, Protocol_UDP, Direction_SOURCE, TRAFFIC_RULES_FILE, 100);
+  TEST_ASSERT(t.Rules[TRAFFIC_RULES_FILE].Packets == 1 && t.Rules[0].Packets == 2, "Invalid counter of rules.");
+}